@@ -0,0 +1,89 @@
+#include "arena_bench.hpp"
+
+#include "arena.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define BENCH_ARENA_MAX_PUSHES 32
+#define BENCH_ARENA_MAX_SIZE 4096
+#define BENCH_ARENA_MAX_ALIGN_SHIFT 7
+
+static void run_round(Arena *arena, uint32_t round);
+static uint32_t next_random(uint32_t *state);
+
+void arena_bench::run(uint32_t rounds) {
+    Arena *scratch = arena::scratch();
+    if (!scratch->base) {
+        LOG("arena_bench: No scratch arena");
+        return;
+    }
+
+    // Both sides fill what they get
+    uint64_t pushes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; ++round) {
+        run_round(scratch, round);
+    }
+    double arena_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // The same sizes from the heap
+    void *blocks[BENCH_ARENA_MAX_PUSHES];
+    start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; ++round) {
+        uint32_t rng = round * 2654435761u + 1;
+        uint32_t count = 1 + next_random(&rng) % BENCH_ARENA_MAX_PUSHES;
+        for (uint32_t i = 0; i < count; ++i) {
+            size_t size = 1 + next_random(&rng) % BENCH_ARENA_MAX_SIZE;
+            next_random(&rng);
+            blocks[i] = malloc(size);
+            if (blocks[i]) {
+                memset(blocks[i], (int)(round + i) & 0xFF, size);
+            }
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            free(blocks[i]);
+        }
+        pushes += count;
+    }
+    double malloc_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Arenas: %u rounds, %llu pushes\n", rounds, (unsigned long long)pushes);
+    printf("  scratch: %8.2f ms, %6.1f ns per push, %llu bytes peak\n", arena_ms, arena_ms * 1e6 / (double)pushes, (unsigned long long)scratch->peak);
+    printf("  malloc:  %8.2f ms, %6.1f ns per allocation\n", malloc_ms, malloc_ms * 1e6 / (double)pushes);
+}
+
+// Pushes and fills a random batch, with a marker halfway that's rewound to first
+static void run_round(Arena *arena, uint32_t round) {
+    ArenaMarker marker = arena::get_marker(arena);
+    uint32_t rng = round * 2654435761u + 1;
+    uint32_t count = 1 + next_random(&rng) % BENCH_ARENA_MAX_PUSHES;
+    ArenaMarker inner = marker;
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t size = 1 + next_random(&rng) % BENCH_ARENA_MAX_SIZE;
+        size_t align = (size_t)1 << (next_random(&rng) % BENCH_ARENA_MAX_ALIGN_SHIFT);
+        if (i == count / 2) {
+            inner = arena::get_marker(arena);
+        }
+        void *block = arena::push(arena, size, align);
+        if (block) {
+            memset(block, (int)(round + i) & 0xFF, size);
+        }
+    }
+
+    arena::rewind(arena, inner);
+    arena::rewind(arena, marker);
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace arena_bench {
+
+// Runs n rounds of random pushes (sizes, alignments) on the scratch arena,
+// each one filled and rewound, and times them against malloc and free of the
+// same sizes. Only timing, the arena suite in tests checks alignment,
+// overlaps, rewinding, the frame arenas and the threads' scratch arenas. CPU
+// only, no device needed.
+void run(uint32_t rounds);
+
+} // namespace arena_bench
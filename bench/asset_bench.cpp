@@ -0,0 +1,146 @@
+#include "asset_bench.hpp"
+
+#include "asset_registry.hpp"
+#include "async.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#define BENCH_ASSET_TEXTURES 40
+#define BENCH_ASSET_MESHES 20
+#define BENCH_ASSET_SPELLINGS 4
+// Slots of the fake loader, per type, every file as sRGB and linear fits
+#define BENCH_ASSET_SLOTS (BENCH_ASSET_TEXTURES * 2)
+
+// Stands in for texture::load_async and mesh::load_async, counts what's read
+struct FakeLoader {
+    bool is_alive[2][BENCH_ASSET_SLOTS];
+    uint8_t generations[2][BENCH_ASSET_SLOTS];
+    uint32_t loads[2][BENCH_ASSET_TEXTURES * 2];
+};
+
+struct Reference {
+    AssetType type;
+    uint32_t file; // File index * 2 + sRGB, meshes are never sRGB
+    Id id;
+};
+
+static Id fake_load(FakeLoader *loader, AssetType type, uint32_t file);
+static void make_path(AssetType type, uint32_t file, uint32_t spelling, char *out_path, size_t out_size);
+static uint32_t next_random(uint32_t *state);
+
+void asset_bench::run(uint32_t references) {
+    AssetRegistry *registry = new AssetRegistry;
+    FakeLoader *loader = new FakeLoader;
+    Reference *refs = new Reference[references];
+    asset_registry::initialize(registry, false);
+    *loader = {};
+
+    // What deserialize_config does for every texture and mesh of the scene
+    uint32_t rng = 0xa55e7;
+    double acquire_ms = 0.0;
+    for (uint32_t i = 0; i < references; ++i) {
+        Reference *ref = &refs[i];
+        ref->type = next_random(&rng) % 3 == 0 ? ASSET_MESH : ASSET_TEXTURE;
+        uint32_t file_count = ref->type == ASSET_MESH ? BENCH_ASSET_MESHES : BENCH_ASSET_TEXTURES;
+        bool is_srgb = ref->type == ASSET_TEXTURE && next_random(&rng) % 2 == 0;
+        ref->file = (next_random(&rng) % file_count) * 2 + (is_srgb ? 1 : 0);
+
+        char path[ASSET_PATH_MAX];
+        make_path(ref->type, ref->file / 2, next_random(&rng) % BENCH_ASSET_SPELLINGS, path, sizeof(path));
+
+        auto acquire_begin = std::chrono::steady_clock::now();
+        AssetKey key;
+        AssetLoad load;
+        if (!asset_registry::make_key(registry, ref->type, is_srgb ? ASSET_FLAG_SRGB : 0, path, &key)) {
+            ref->id = id::invalid();
+            continue;
+        }
+        if (!asset_registry::acquire(registry, &key, &load)) {
+            load = async::finished(fake_load(loader, ref->type, ref->file));
+            asset_registry::add(registry, &key, load);
+        }
+        acquire_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquire_begin).count();
+        ref->id = load.id;
+    }
+
+    uint32_t unique = 0;
+    uint32_t loads = 0;
+    for (uint32_t type = 0; type < 2; ++type) {
+        for (uint32_t file = 0; file < BENCH_ASSET_TEXTURES * 2; ++file) {
+            unique += loader->loads[type][file] > 0 ? 1 : 0;
+            loads += loader->loads[type][file];
+        }
+    }
+    uint32_t peak_entries = registry->count;
+
+    // Back to front in a shuffled order
+    for (uint32_t i = references; i > 1; --i) {
+        uint32_t j = next_random(&rng) % i;
+        Reference swap = refs[i - 1];
+        refs[i - 1] = refs[j];
+        refs[j] = swap;
+    }
+    auto release_begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < references; ++i) {
+        Reference *ref = &refs[i];
+        if (id::is_invalid(ref->id)) {
+            continue;
+        }
+        if (asset_registry::release(registry, ref->type, ref->id)) {
+            loader->is_alive[ref->type][ref->id.id] = false;
+            loader->generations[ref->type][ref->id.id]++;
+        }
+    }
+    double release_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - release_begin).count();
+
+    printf("Assets: %u references to %u files (%u loads), %u entries at most\n", references, unique, loads, peak_entries);
+    printf("  %.3f us per acquire, %.3f us per release\n", references > 0 ? acquire_ms * 1000.0 / references : 0.0,
+           references > 0 ? release_ms * 1000.0 / references : 0.0);
+    printf("  %u acquired, %u shared by path, %u released, %u freed\n", registry->stats.acquires, registry->stats.path_hits,
+           registry->stats.releases, registry->stats.freed);
+
+    delete[] refs;
+    delete loader;
+    delete registry;
+}
+
+static Id fake_load(FakeLoader *loader, AssetType type, uint32_t file) {
+    for (uint8_t slot = 0; slot < BENCH_ASSET_SLOTS; ++slot) {
+        if (!loader->is_alive[type][slot]) {
+            loader->is_alive[type][slot] = true;
+            loader->loads[type][file]++;
+            return {slot, loader->generations[type][slot]};
+        }
+    }
+    return id::invalid();
+}
+
+static void make_path(AssetType type, uint32_t file, uint32_t spelling, char *out_path, size_t out_size) {
+    const char *name = type == ASSET_MESH ? "mesh" : "map";
+    const char *extension = type == ASSET_MESH ? "gltf" : "png";
+    switch (spelling) {
+        case 0:
+            snprintf(out_path, out_size, "assets/%s_%u.%s", name, file, extension);
+            break;
+        case 1:
+            snprintf(out_path, out_size, "./assets/%s_%u.%s", name, file, extension);
+            break;
+        case 2:
+            snprintf(out_path, out_size, "Assets\\%s_%u.%s", name, file, extension);
+            break;
+        default:
+            snprintf(out_path, out_size, "assets/maps/../%s_%u.%s", name, file, extension);
+            break;
+    }
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace asset_bench {
+
+// Loads a scene of n asset references (a few dozen files, each spelled several
+// ways, as sRGB and linear) through the asset registry and releases them in
+// random order, timing both. Only timing, the asset_registry suite in tests
+// checks the paths, the hash and the refcounts. CPU only, no device needed.
+void run(uint32_t references);
+
+} // namespace asset_bench
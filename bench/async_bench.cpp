@@ -0,0 +1,102 @@
+#include "async_bench.hpp"
+
+#include "async.hpp"
+#include "job_system.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Rounds of busy work per fake decode, about what a small texture costs
+#define BENCH_DECODE_ROUNDS 200000
+
+struct BenchLoads {
+    JobSystem jobs;
+    AsyncScheduler scheduler;
+    uint64_t *results; // The upload fills them in
+};
+
+static AsyncTask load_task(BenchLoads *bench, AssetLoad load, uint32_t index);
+static AsyncTask wait_task(AssetLoad load);
+static uint64_t decode(uint32_t index);
+
+void async_bench::run(uint32_t loads) {
+    BenchLoads *bench = new BenchLoads;
+    bench->results = (uint64_t *)calloc(loads, sizeof(uint64_t));
+    if (!bench->results || !job_system::initialize(&bench->jobs, 0)) {
+        LOG("async_bench: Couldn't set up the loads");
+        free(bench->results);
+        delete bench;
+        return;
+    }
+    async::initialize(&bench->scheduler, &bench->jobs);
+
+    // Blocking, what load used to do for every asset
+    auto start = std::chrono::steady_clock::now();
+    uint64_t blocking_sum = 0;
+    for (uint32_t i = 0; i < loads; ++i) {
+        blocking_sum += decode(i);
+    }
+    double blocking_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Handing out the placeholders only waits when too many loads are in flight
+    start = std::chrono::steady_clock::now();
+    double handout_ms = 0.0;
+    for (uint32_t i = 0; i < loads; ++i) {
+        while (!async::has_room(&bench->scheduler)) {
+            if (job_system::run_main_jobs(&bench->jobs) == 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        // Ids only for show, the index is what the tasks go by
+        Id placeholder = {(uint8_t)(i % INVALID_ID), 0};
+        AssetLoad load = async::begin_load(&bench->scheduler, placeholder);
+        load_task(bench, load, i);
+        wait_task(load);
+        if (i + 1 == (loads < ASYNC_MAX_LOADS ? loads : ASYNC_MAX_LOADS)) {
+            handout_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    async::wait_idle(&bench->scheduler);
+    double async_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t worker_count = bench->jobs.worker_count;
+    job_system::shutdown(&bench->jobs);
+
+    printf("Async loads: %u on %u threads, the first %u placeholders in %.3f ms\n",
+           loads, worker_count, loads < ASYNC_MAX_LOADS ? loads : ASYNC_MAX_LOADS, handout_ms);
+    printf("  all done in %.1f ms, %.1f ms blocking (checksum %llx)\n", async_ms, blocking_ms, (unsigned long long)blocking_sum);
+
+    free(bench->results);
+    delete bench;
+}
+
+static AsyncTask load_task(BenchLoads *bench, AssetLoad load, uint32_t index) {
+    co_await async::to_worker(&bench->scheduler);
+
+    uint64_t result = decode(index);
+
+    co_await async::to_main(&bench->scheduler);
+
+    bench->results[index] = result;
+    async::end_load(&bench->scheduler, &load);
+}
+
+static AsyncTask wait_task(AssetLoad load) {
+    co_await load;
+}
+
+static uint64_t decode(uint32_t index) {
+    // splitmix64 chain, never 0 in practice and different per index
+    uint64_t x = index + 1;
+    for (uint32_t i = 0; i < BENCH_DECODE_ROUNDS; ++i) {
+        x += 0x9E3779B97F4A7C15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        x ^= z ^ (z >> 31);
+    }
+    return x | 1;
+}
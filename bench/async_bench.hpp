@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace async_bench {
+
+// Runs n fake asset loads through the async scheduler: the decode is busy
+// work on the worker threads, the upload writes the result on the main
+// thread and a second coroutine waits on every load. Reports how long the
+// placeholders took to hand out, the time to the last load against doing the
+// same work blocking. Only timing, the async suite in tests checks where
+// the parts run and when the waiters wake up. CPU only, no device needed.
+void run(uint32_t loads);
+
+} // namespace async_bench
@@ -0,0 +1,601 @@
+// Deterministic benchmark: loads a scene (or generates one), drives the camera
+// from a replay with a fixed timestep and reports frame time percentiles,
+// per-pass GPU timings and heap allocation counts.
+//
+//   bench [--scene path | --synthetic instances,materials,lights] [--seed n]
+//         [--replay path] [--frames n] [--warmup n] [--dt seconds] [--vsync]
+//         [--csv path] [--max-p95 ms] [--max-allocs n]
+//         [--serial-shaders] [--no-shader-cache]
+//   bench --state-lookups n [--frames n]
+//   bench --range-churn n
+//   bench --meshlet-cull n
+//   bench --occlusion n
+//   bench --async-loads n
+//   bench --jobs n
+//   bench --pacing n
+//   bench --arenas n
+//   bench --memory n
+//   bench --streaming n
+//   bench --assets n
+//   bench --pack n
+//   bench --scene-file n
+//   bench --scene-diff n
+//
+// Startup is timed too, up to the end of the first frame since pipelines are
+// only waited on when they're first used. Run once with --serial-shaders (and
+// --no-shader-cache for a cold start) to compare against the job workers.
+//
+// --state-lookups only times n blend and rasterizer state lookups per frame
+// (old linear scan against the state cache), without opening a window.
+// --range-churn runs n random mesh sized allocations and releases against the
+// geometry arena's range allocator and reports its fragmentation.
+// --meshlet-cull culls the meshlets of a big sphere from n random cameras with
+// the reference and the SIMD path.
+// --occlusion tests n spheres against a Hi-Z pyramid of a scene of walls and
+// reports the time per test.
+// --async-loads runs n fake asset loads through the coroutine scheduler and
+// reports the time to the last one against loading them blocking.
+// --jobs runs n jobs a few ways through the job system (batches, nested waits,
+// dependencies, main thread jobs) from one worker up to every core and reports
+// the speedup.
+// --pacing drives the frame pacer with a fake clock for n frames per case
+// (fast, slow, limited and hitching frames) and prints the steps, dropped and
+// limited time of each.
+// --arenas times n rounds of pushes through the scratch arena against malloc.
+// --memory times n rounds of memory tracking on one thread and on the job
+// system's threads.
+// --streaming times n frames of texture streamer updates on a simulated scene
+// with four times the textures the budget holds.
+// --assets times n references to a few dozen files (spelled several ways)
+// acquired through the asset registry and released.
+// --pack times n random reads from a pack of test files through the vfs
+// against the loose files.
+// --scene-file times loading a generated config of n instances as JSON against
+// the compiled scene file.
+// --scene-diff times diffing a generated config of n instances against itself
+// and against an edited copy.
+//
+// Exit code is 2 when one of the --max-* gates is exceeded, so it can be used
+// as a performance regression check. --max-allocs is 0 unless it's given: a
+// measured frame allocating from the heap fails the run (-1 turns it off), so
+// does a frame arena push that didn't fit.
+
+#include "application.hpp"
+#include "arena_bench.hpp"
+#include "asset_bench.hpp"
+#include "async_bench.hpp"
+#include "job_bench.hpp"
+#include "logger.hpp"
+#include "memory_bench.hpp"
+#include "memory_tracker.hpp"
+#include "meshlet_bench.hpp"
+#include "occlusion_bench.hpp"
+#include "pacing_bench.hpp"
+#include "pack_bench.hpp"
+#include "profiler.hpp"
+#include "renderer.hpp"
+#include "range_allocator_bench.hpp"
+#include "replay.hpp"
+#include "scene_diff_bench.hpp"
+#include "scene_file_bench.hpp"
+#include "state_cache_bench.hpp"
+#include "streaming_bench.hpp"
+#include "synthetic_scene.hpp"
+#include "window.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// --- Allocation counting --------------------------------------------------- //
+// Only counts C++ heap allocations, C libraries (stb, cJSON) call malloc directly.
+static std::atomic<uint64_t> g_allocation_count{0};
+static std::atomic<uint64_t> g_allocation_bytes{0};
+
+void *operator new(size_t size) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    g_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+// --------------------------------------------------------------------------- //
+
+struct BenchOptions {
+    const char *scene_path;
+    const char *replay_path;
+    const char *csv_path;
+    bool synthetic;
+    SyntheticSceneDesc synthetic_desc;
+    uint32_t frames;
+    uint32_t warmup;
+    float dt;
+    bool vsync;
+    bool serial_shaders;
+    bool no_shader_cache;
+    double max_p95_ms;
+    int64_t max_allocs_per_frame;
+    uint32_t state_lookups;
+    uint32_t range_churn;
+    uint32_t meshlet_cull;
+    uint32_t occlusion;
+    uint32_t async_loads;
+    uint32_t jobs;
+    uint32_t pacing;
+    uint32_t arenas;
+    uint32_t memory;
+    uint32_t streaming;
+    uint32_t assets;
+    uint32_t pack;
+    uint32_t scene_file;
+    uint32_t scene_diff;
+};
+
+struct FrameSample {
+    double cpu_ms;
+    uint64_t allocations;
+    uint32_t shadow_caster_draws;
+    uint32_t shadow_views_updated;
+    uint32_t material_binds;
+    uint32_t material_switches;
+    uint32_t state_calls_issued;
+    uint32_t state_calls_filtered;
+    uint32_t meshlets_total;
+    uint32_t meshlets_visible;
+    uint32_t occluded_meshes;
+};
+
+static bool parse_options(int argc, char *argv[], BenchOptions *out);
+static int compare_double(const void *a, const void *b);
+static double percentile(const double *sorted, uint32_t count, double p);
+
+int main(int argc, char *argv[]) {
+    BenchOptions opt = {};
+    opt.scene_path = "assets/config.json";
+    opt.frames = 1000;
+    opt.warmup = 60;
+    opt.dt = 1.0f / 60.0f;
+    opt.max_p95_ms = -1.0;
+    // Past warmup a frame doesn't touch the heap, per frame data goes into the frame arena
+    opt.max_allocs_per_frame = 0;
+    opt.synthetic_desc.seed = 1;
+
+    if (!parse_options(argc, argv, &opt)) {
+        return 1;
+    }
+
+    if (opt.state_lookups > 0) {
+        state_cache_bench::run(opt.state_lookups, opt.frames);
+        return 0;
+    }
+
+    if (opt.range_churn > 0) {
+        range_allocator_bench::run(opt.range_churn);
+        return 0;
+    }
+
+    if (opt.meshlet_cull > 0) {
+        meshlet_bench::run(opt.meshlet_cull);
+        return 0;
+    }
+
+    if (opt.occlusion > 0) {
+        occlusion_bench::run(opt.occlusion);
+        return 0;
+    }
+
+    if (opt.async_loads > 0) {
+        async_bench::run(opt.async_loads);
+        return 0;
+    }
+
+    if (opt.jobs > 0) {
+        job_bench::run(opt.jobs);
+        return 0;
+    }
+
+    if (opt.pacing > 0) {
+        pacing_bench::run(opt.pacing);
+        return 0;
+    }
+
+    if (opt.arenas > 0) {
+        arena_bench::run(opt.arenas);
+        return 0;
+    }
+
+    if (opt.memory > 0) {
+        memory_bench::run(opt.memory);
+        return 0;
+    }
+
+    if (opt.streaming > 0) {
+        streaming_bench::run(opt.streaming);
+        return 0;
+    }
+
+    if (opt.assets > 0) {
+        asset_bench::run(opt.assets);
+        return 0;
+    }
+
+    if (opt.pack > 0) {
+        pack_bench::run(opt.pack);
+        return 0;
+    }
+
+    if (opt.scene_file > 0) {
+        scene_file_bench::run(opt.scene_file);
+        return 0;
+    }
+
+    if (opt.scene_diff > 0) {
+        scene_diff_bench::run(opt.scene_diff);
+        return 0;
+    }
+
+    ApplicationConfig cfg = {};
+    cfg.window_title = L"PBR Benchmark";
+    cfg.window_width = 1920;
+    cfg.window_height = 1080;
+    cfg.scene_path = opt.synthetic ? nullptr : opt.scene_path;
+    cfg.serial_shaders = opt.serial_shaders;
+    cfg.no_shader_cache = opt.no_shader_cache;
+
+    auto startup_begin = std::chrono::steady_clock::now();
+    if (!application::initialize(cfg)) {
+        LOG("bench: Couldn't initialize the application");
+        return 1;
+    }
+    auto initialize_end = std::chrono::steady_clock::now();
+
+    Scene *scene = &application::get_scenes()[0];
+    if (opt.synthetic && !synthetic_scene::generate(scene, &opt.synthetic_desc)) {
+        LOG("bench: Couldn't generate the synthetic scene");
+        return 1;
+    }
+
+    // Camera path: either the recorded one, or a slow orbit covering the whole run
+    Replay *path = new Replay;
+    if (opt.replay_path) {
+        if (!replay::load(path, opt.replay_path)) {
+            return 1;
+        }
+    } else {
+        float duration = (opt.warmup + opt.frames) * opt.dt;
+        SceneCamera *cam = scene->active_cam;
+        if (!cam) {
+            LOG("bench: The scene has no camera");
+            return 1;
+        }
+        replay::generate_orbit(path, duration, 1.0f, cam->distance, cam->pitch, cam->target);
+    }
+    application::set_replay(path);
+
+    Renderer *renderer = application::get_renderer();
+    renderer->present_interval = opt.vsync ? 1 : 0;
+    if (!profiler::initialize(&renderer->profiler, renderer->device.Get())) {
+        LOG("bench: GPU timings are not available");
+    }
+
+    FrameSample *samples = (FrameSample *)calloc(opt.frames, sizeof(FrameSample));
+    double *sorted = (double *)calloc(opt.frames, sizeof(double));
+    if (!samples || !sorted) {
+        LOG("bench: Couldn't allocate sample storage");
+        return 1;
+    }
+
+    Window *window = application::get_window();
+    uint32_t measured = 0;
+    double startup_ms = 0.0;
+    for (uint32_t frame = 0; frame < opt.warmup + opt.frames; ++frame) {
+        if (window::should_close(window)) {
+            LOG("bench: Window closed after %u measured frames", measured);
+            break;
+        }
+
+        // Warmup is done, start from clean stats
+        if (frame == opt.warmup) {
+            // The scene's assets load in the background, measure with all of them in
+            async::wait_idle(&renderer->asset_scheduler);
+            profiler::flush(&renderer->profiler, renderer->context.Get());
+            profiler::reset_stats(&renderer->profiler);
+        }
+
+        uint64_t allocs_before = g_allocation_count.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+
+        application::frame(opt.dt);
+
+        auto end = std::chrono::steady_clock::now();
+        uint64_t allocs_after = g_allocation_count.load(std::memory_order_relaxed);
+
+        // Everything between initialize and the first frame (scene setup) isn't startup work
+        if (frame == 0) {
+            startup_ms = std::chrono::duration<double, std::milli>((initialize_end - startup_begin) + (end - start)).count();
+        }
+
+        if (frame >= opt.warmup) {
+            samples[measured].cpu_ms = std::chrono::duration<double, std::milli>(end - start).count();
+            samples[measured].allocations = allocs_after - allocs_before;
+            samples[measured].shadow_caster_draws = renderer->shadow_caster_draws;
+            samples[measured].shadow_views_updated = renderer->shadow_views_updated;
+            samples[measured].material_binds = renderer->material_binds;
+            samples[measured].material_switches = renderer->material_switches;
+            samples[measured].state_calls_issued = renderer->state_tracker.stats.issued;
+            samples[measured].state_calls_filtered = renderer->state_tracker.stats.filtered;
+            samples[measured].meshlets_total = renderer->meshlets_total;
+            samples[measured].meshlets_visible = renderer->meshlets_visible;
+            samples[measured].occluded_meshes = renderer->occluded_meshes;
+            measured++;
+        }
+    }
+
+    profiler::flush(&renderer->profiler, renderer->context.Get());
+
+    if (measured == 0) {
+        LOG("bench: No frames were measured");
+        return 1;
+    }
+
+    // --- Report ------------------------------------------------------------ //
+    double total_ms = 0.0;
+    uint64_t total_allocs = 0;
+    uint64_t max_allocs = 0;
+    uint64_t total_shadow_draws = 0;
+    uint64_t total_shadow_updates = 0;
+    uint64_t total_material_binds = 0;
+    uint64_t total_material_switches = 0;
+    uint64_t total_state_issued = 0;
+    uint64_t total_state_filtered = 0;
+    uint64_t total_meshlets = 0;
+    uint64_t total_meshlets_visible = 0;
+    uint64_t total_occluded = 0;
+    for (uint32_t i = 0; i < measured; ++i) {
+        sorted[i] = samples[i].cpu_ms;
+        total_ms += samples[i].cpu_ms;
+        total_allocs += samples[i].allocations;
+        total_shadow_draws += samples[i].shadow_caster_draws;
+        total_shadow_updates += samples[i].shadow_views_updated;
+        total_material_binds += samples[i].material_binds;
+        total_material_switches += samples[i].material_switches;
+        total_state_issued += samples[i].state_calls_issued;
+        total_state_filtered += samples[i].state_calls_filtered;
+        total_meshlets += samples[i].meshlets_total;
+        total_meshlets_visible += samples[i].meshlets_visible;
+        total_occluded += samples[i].occluded_meshes;
+        if (samples[i].allocations > max_allocs) max_allocs = samples[i].allocations;
+    }
+    qsort(sorted, measured, sizeof(double), compare_double);
+
+    double p95 = percentile(sorted, measured, 95.0);
+
+    ShaderSystemState *shaders = &renderer->shader_system;
+    printf("Startup: %.1f ms to the first frame (%s shaders, %u from the cache, %u compiled)\n", startup_ms,
+           opt.serial_shaders ? "serial" : "parallel", shaders->cache_hits.load(), shaders->cache_misses.load());
+    printf("Frames: %u (warmup %u, dt %.4fs, vsync %s)\n", measured, opt.warmup, opt.dt, opt.vsync ? "on" : "off");
+    printf("CPU frame time (ms): avg %.3f | p50 %.3f | p90 %.3f | p95 %.3f | p99 %.3f | max %.3f\n",
+           total_ms / measured,
+           percentile(sorted, measured, 50.0),
+           percentile(sorted, measured, 90.0),
+           p95,
+           percentile(sorted, measured, 99.0),
+           sorted[measured - 1]);
+
+    Profiler *prof = &renderer->profiler;
+    if (prof->enabled && prof->gpu_frame_samples > 0) {
+        printf("GPU frame time (ms): avg %.3f | max %.3f (%u samples, %u disjoint)\n",
+               prof->gpu_frame_total_ms / prof->gpu_frame_samples, prof->gpu_frame_max_ms, prof->gpu_frame_samples, prof->disjoint_frames);
+        for (uint8_t i = 0; i < prof->pass_stat_count; ++i) {
+            ProfilerPassStats *pass = &prof->passes[i];
+            printf("  %-40ls avg %8.3f | max %8.3f\n", pass->name, pass->samples ? pass->total_ms / pass->samples : 0.0, pass->max_ms);
+        }
+    }
+
+    printf("Shadow caster draws: %.1f per frame, %.1f of %u views redrawn per frame\n",
+           (double)total_shadow_draws / measured, (double)total_shadow_updates / measured, renderer->shadow_view_count);
+
+    // Every material switch used to map a constant buffer and bind six textures
+    printf("Material binds: %.1f per frame, %.1f material switches (%.1f binds saved)\n",
+           (double)total_material_binds / measured, (double)total_material_switches / measured,
+           ((double)total_material_switches - (double)total_material_binds) / measured);
+
+    // Filtered are set calls that matched what was bound, they never reach the context
+    printf("State calls: %.1f issued per frame, %.1f filtered\n",
+           (double)total_state_issued / measured, (double)total_state_filtered / measured);
+
+    // Only meshes that were culled per meshlet count, not the ones drawn whole
+    printf("Meshlets: %.1f visible of %.1f per frame\n",
+           (double)total_meshlets_visible / measured, (double)total_meshlets / measured);
+
+    // Tested against the Hi-Z of a frame a few frames back, see occlusion.hpp
+    printf("Occluded meshes: %.1f per frame\n", (double)total_occluded / measured);
+
+    printf("Allocations: %llu total, %.2f per frame, %llu max in a frame\n",
+           (unsigned long long)total_allocs, (double)total_allocs / measured, (unsigned long long)max_allocs);
+
+    // Both halves over the whole run, warmup included
+    FrameArena *frame_arena = &renderer->frame_arena;
+    size_t frame_arena_peak = frame_arena->arenas[0].peak > frame_arena->arenas[1].peak ? frame_arena->arenas[0].peak : frame_arena->arenas[1].peak;
+    uint32_t frame_arena_failed = frame_arena->arenas[0].failed + frame_arena->arenas[1].failed;
+    printf("Frame arena: %llu bytes peak, %u pushes didn't fit\n", (unsigned long long)frame_arena_peak, frame_arena_failed);
+
+    // Startup and loading included, the peaks are the whole run's
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t t = 0; t < MEMORY_TAG_COUNT; ++t) {
+            MemoryPoolStats stats = memory_tracker::get_stats((MemoryTag)t, (MemoryDomain)d);
+            if (stats.peak > 0) {
+                printf("Memory %s %-14s: %8.2f MB in %u, %8.2f MB peak\n", d == MEMORY_DOMAIN_GPU ? "GPU" : "CPU", memory_tracker::tag_name((MemoryTag)t),
+                       stats.bytes / 1048576.0, stats.allocations, stats.peak / 1048576.0);
+            }
+        }
+    }
+
+    if (opt.csv_path) {
+        FILE *csv = fopen(opt.csv_path, "wb");
+        if (csv) {
+            fprintf(csv, "frame,cpu_ms,allocations,shadow_caster_draws,shadow_views_updated,material_binds,material_switches,state_calls_issued,state_calls_filtered,meshlets_total,meshlets_visible,occluded_meshes\n");
+            for (uint32_t i = 0; i < measured; ++i) {
+                fprintf(csv, "%u,%.4f,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", i, samples[i].cpu_ms, (unsigned long long)samples[i].allocations,
+                        samples[i].shadow_caster_draws, samples[i].shadow_views_updated, samples[i].material_binds, samples[i].material_switches,
+                        samples[i].state_calls_issued, samples[i].state_calls_filtered, samples[i].meshlets_total, samples[i].meshlets_visible, samples[i].occluded_meshes);
+            }
+            fclose(csv);
+        } else {
+            LOG("bench: Couldn't open %s for writing", opt.csv_path);
+        }
+    }
+
+    // --- Gates ------------------------------------------------------------- //
+    int result = 0;
+    if (opt.max_p95_ms >= 0.0 && p95 > opt.max_p95_ms) {
+        printf("FAIL: p95 frame time %.3f ms is over the %.3f ms budget\n", p95, opt.max_p95_ms);
+        result = 2;
+    }
+    if (opt.max_allocs_per_frame >= 0 && max_allocs > (uint64_t)opt.max_allocs_per_frame) {
+        printf("FAIL: %llu allocations in a frame, budget is %lld\n", (unsigned long long)max_allocs, (long long)opt.max_allocs_per_frame);
+        result = 2;
+    }
+    if (frame_arena_failed > 0) {
+        printf("FAIL: %u frame arena pushes didn't fit in %llu bytes\n", frame_arena_failed, (unsigned long long)ARENA_FRAME_RESERVE);
+        result = 2;
+    }
+
+    free(samples);
+    free(sorted);
+
+    application::shutdown();
+    delete path;
+
+    return result;
+}
+
+static bool parse_options(int argc, char *argv[], BenchOptions *out) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+
+        // Every option but the flags takes a value
+        if (strcmp(arg, "--vsync") == 0) {
+            out->vsync = true;
+            continue;
+        }
+        if (strcmp(arg, "--serial-shaders") == 0) {
+            out->serial_shaders = true;
+            continue;
+        }
+        if (strcmp(arg, "--no-shader-cache") == 0) {
+            out->no_shader_cache = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            LOG("bench: %s option requires a value", arg);
+            return false;
+        }
+        const char *value = argv[++i];
+
+        if (strcmp(arg, "--scene") == 0) {
+            out->scene_path = value;
+        } else if (strcmp(arg, "--synthetic") == 0) {
+            SyntheticSceneDesc *d = &out->synthetic_desc;
+            if (sscanf(value, "%u,%u,%u", &d->instance_count, &d->material_count, &d->light_count) != 3) {
+                LOG("bench: --synthetic expects instances,materials,lights");
+                return false;
+            }
+            out->synthetic = true;
+        } else if (strcmp(arg, "--seed") == 0) {
+            out->synthetic_desc.seed = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--replay") == 0) {
+            out->replay_path = value;
+        } else if (strcmp(arg, "--frames") == 0) {
+            out->frames = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--warmup") == 0) {
+            out->warmup = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--dt") == 0) {
+            out->dt = strtof(value, nullptr);
+        } else if (strcmp(arg, "--csv") == 0) {
+            out->csv_path = value;
+        } else if (strcmp(arg, "--max-p95") == 0) {
+            out->max_p95_ms = strtod(value, nullptr);
+        } else if (strcmp(arg, "--max-allocs") == 0) {
+            out->max_allocs_per_frame = strtoll(value, nullptr, 10);
+        } else if (strcmp(arg, "--state-lookups") == 0) {
+            out->state_lookups = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--range-churn") == 0) {
+            out->range_churn = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--meshlet-cull") == 0) {
+            out->meshlet_cull = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--occlusion") == 0) {
+            out->occlusion = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--async-loads") == 0) {
+            out->async_loads = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--jobs") == 0) {
+            out->jobs = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--pacing") == 0) {
+            out->pacing = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--arenas") == 0) {
+            out->arenas = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--memory") == 0) {
+            out->memory = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--streaming") == 0) {
+            out->streaming = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--assets") == 0) {
+            out->assets = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--pack") == 0) {
+            out->pack = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--scene-file") == 0) {
+            out->scene_file = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--scene-diff") == 0) {
+            out->scene_diff = (uint32_t)strtoul(value, nullptr, 10);
+        } else {
+            LOG("bench: Unknown option %s", arg);
+            return false;
+        }
+    }
+
+    if (out->frames == 0 || out->dt <= 0.0f) {
+        LOG("bench: --frames and --dt have to be positive");
+        return false;
+    }
+
+    return true;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(const double *sorted, uint32_t count, double p) {
+    // Nearest rank
+    uint32_t rank = (uint32_t)((p / 100.0) * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
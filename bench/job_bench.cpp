@@ -0,0 +1,235 @@
+#include "job_bench.hpp"
+
+#include "job_system.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Rounds of busy work per job, a few microseconds
+#define BENCH_JOB_ROUNDS 2000
+// Jobs that spawn the nested ones and wait on them
+#define BENCH_JOB_ROOTS 16
+#define BENCH_JOB_MAIN_HOPS 256
+// Every worker count runs the lot this many times, the best one is reported
+#define BENCH_JOB_REPEATS 3
+
+struct JobBench;
+
+struct BenchItem {
+    JobBench *bench;
+    uint32_t index;
+};
+
+struct JobBench {
+    JobSystem *system;
+    uint32_t count;
+    BenchItem *items;
+    uint64_t *serial;   // work(i) on one thread, what the jobs are timed against
+    uint64_t *batched;
+    uint64_t *nested;
+    uint64_t *first;
+    uint64_t *second;   // Reads first
+};
+
+static bool run_all(JobBench *bench);
+static void batch_job(void *data, uint32_t begin, uint32_t end);
+static void root_job(void *data);
+static void nested_job(void *data);
+static void first_job(void *data);
+static void second_job(void *data);
+static void hop_job(void *data);
+static void main_job(void *data);
+static uint64_t work(uint32_t index);
+
+void job_bench::run(uint32_t jobs) {
+    JobBench bench = {};
+    bench.count = jobs;
+    bench.items = (BenchItem *)malloc(jobs * sizeof(BenchItem));
+    bench.serial = (uint64_t *)malloc(jobs * sizeof(uint64_t));
+    bench.batched = (uint64_t *)malloc(jobs * sizeof(uint64_t));
+    bench.nested = (uint64_t *)malloc(jobs * sizeof(uint64_t));
+    bench.first = (uint64_t *)malloc(jobs * sizeof(uint64_t));
+    bench.second = (uint64_t *)malloc(jobs * sizeof(uint64_t));
+
+    bool is_ok = bench.items && bench.serial && bench.batched && bench.nested && bench.first && bench.second;
+    if (!is_ok) {
+        LOG("job_bench: Couldn't allocate %u jobs", jobs);
+    }
+
+    // The same work on this thread, once per way of running it
+    double serial_ms = 0.0;
+    if (is_ok) {
+        for (uint32_t i = 0; i < jobs; ++i) {
+            bench.items[i] = {&bench, i};
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < jobs; ++i) {
+            bench.serial[i] = work(i);
+        }
+        serial_ms = 3.0 * std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t max_workers = std::min(std::max(cores - 1, 1u), (uint32_t)JOB_SYSTEM_MAX_WORKERS);
+    if (is_ok) {
+        printf("Jobs: %u of each kind, %u cores, %.1f ms on one thread\n", jobs, cores, serial_ms);
+    }
+
+    for (uint32_t workers = 1; is_ok && workers <= max_workers; workers = workers < max_workers ? std::min(workers * 2, max_workers) : workers + 1) {
+        JobSystem *system = new JobSystem;
+        if (!job_system::initialize(system, workers)) {
+            LOG("job_bench: Couldn't start %u workers", workers);
+            delete system;
+            is_ok = false;
+            break;
+        }
+        bench.system = system;
+
+        double best_ms = 0.0;
+        for (uint32_t repeat = 0; is_ok && repeat < BENCH_JOB_REPEATS; ++repeat) {
+            auto start = std::chrono::steady_clock::now();
+            is_ok = run_all(&bench);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best_ms = repeat == 0 ? ms : std::min(best_ms, ms);
+        }
+
+        if (is_ok) {
+            printf("  %2u workers + main: %8.1f ms, %.2fx, %u of %u jobs stolen\n",
+                   workers, best_ms, serial_ms / best_ms, system->jobs_stolen.load(), system->jobs_run.load());
+        }
+
+        job_system::shutdown(system);
+        delete system;
+    }
+
+    free(bench.items);
+    free(bench.serial);
+    free(bench.batched);
+    free(bench.nested);
+    free(bench.first);
+    free(bench.second);
+}
+
+static bool run_all(JobBench *bench) {
+    JobSystem *system = bench->system;
+    uint32_t count = bench->count;
+    for (uint32_t i = 0; i < count; ++i) {
+        bench->batched[i] = 0;
+        bench->nested[i] = 0;
+        bench->first[i] = 0;
+        bench->second[i] = 0;
+    }
+
+    job_system::parallel_for(system, count, 16, batch_job, bench);
+
+    // Roots spread over the workers, every one waits on its own children
+    BenchItem roots[BENCH_JOB_ROOTS];
+    JobDecl root_jobs[BENCH_JOB_ROOTS];
+    for (uint32_t i = 0; i < BENCH_JOB_ROOTS; ++i) {
+        roots[i] = {bench, i};
+        root_jobs[i] = {root_job, &roots[i]};
+    }
+    JobCounter roots_done;
+    job_system::run(system, root_jobs, BENCH_JOB_ROOTS, &roots_done);
+
+    // Queued while the roots are still going, the second stage only starts once
+    // every job of the first is done
+    JobDecl *stage_jobs = (JobDecl *)malloc(count * sizeof(JobDecl));
+    if (!stage_jobs) {
+        LOG("job_bench: Couldn't allocate the stages");
+        job_system::wait(system, &roots_done);
+        return false;
+    }
+    JobCounter first_done;
+    JobCounter second_done;
+    for (uint32_t i = 0; i < count; ++i) {
+        stage_jobs[i] = {first_job, &bench->items[i]};
+    }
+    job_system::run(system, stage_jobs, count, &first_done);
+    for (uint32_t i = 0; i < count; ++i) {
+        stage_jobs[i] = {second_job, &bench->items[i]};
+    }
+    job_system::run_after(system, &first_done, stage_jobs, count, &second_done);
+
+    // Workers hand a job back to the main thread, waiting here runs it
+    uint32_t hop_count = std::min(count, (uint32_t)BENCH_JOB_MAIN_HOPS);
+    for (uint32_t i = 0; i < hop_count; ++i) {
+        stage_jobs[i] = {hop_job, &bench->items[i]};
+    }
+    JobCounter hops_done;
+    job_system::run(system, stage_jobs, hop_count, &hops_done);
+
+    job_system::wait(system, &roots_done);
+    job_system::wait(system, &second_done);
+    job_system::wait(system, &hops_done);
+    free(stage_jobs);
+
+    // Every hop queued its main thread job before it was done
+    job_system::run_main_jobs(system);
+    return true;
+}
+
+static void batch_job(void *data, uint32_t begin, uint32_t end) {
+    JobBench *bench = (JobBench *)data;
+    for (uint32_t i = begin; i < end; ++i) {
+        bench->batched[i] = work(i);
+    }
+}
+
+static void root_job(void *data) {
+    BenchItem *root = (BenchItem *)data;
+    JobBench *bench = root->bench;
+
+    // Every root takes a slice of the items, one job each
+    uint32_t begin = (uint32_t)((uint64_t)bench->count * root->index / BENCH_JOB_ROOTS);
+    uint32_t end = (uint32_t)((uint64_t)bench->count * (root->index + 1) / BENCH_JOB_ROOTS);
+    JobCounter children_done;
+    for (uint32_t i = begin; i < end; ++i) {
+        JobDecl job = {nested_job, &bench->items[i]};
+        job_system::run(bench->system, &job, 1, &children_done);
+    }
+    job_system::wait(bench->system, &children_done);
+}
+
+static void nested_job(void *data) {
+    BenchItem *item = (BenchItem *)data;
+    item->bench->nested[item->index] = work(item->index);
+}
+
+static void first_job(void *data) {
+    BenchItem *item = (BenchItem *)data;
+    item->bench->first[item->index] = work(item->index);
+}
+
+static void second_job(void *data) {
+    BenchItem *item = (BenchItem *)data;
+    JobBench *bench = item->bench;
+    bench->second[item->index] = bench->first[item->index] ^ bench->first[(item->index + 1) % bench->count];
+}
+
+static void hop_job(void *data) {
+    BenchItem *item = (BenchItem *)data;
+    JobDecl job = {main_job, item};
+    job_system::run_on_main(item->bench->system, &job, 1, nullptr);
+}
+
+static void main_job(void *) {
+    // Nothing to do, getting here is what's timed
+}
+
+static uint64_t work(uint32_t index) {
+    // splitmix64 chain, different per index
+    uint64_t x = index + 1;
+    for (uint32_t i = 0; i < BENCH_JOB_ROUNDS; ++i) {
+        x += 0x9E3779B97F4A7C15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        x ^= z ^ (z >> 31);
+    }
+    return x;
+}
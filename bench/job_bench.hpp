@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+namespace job_bench {
+
+// Runs n jobs of busy work through the job system four ways: parallel_for
+// batches, jobs that spawn jobs and wait on them, a second stage held back by
+// run_after until the first is done and jobs that hop to the main thread.
+// Starts with one worker and doubles up to every core, reports the time of
+// each against doing the same work on one thread. Only timing, the
+// job_system suite in tests checks the results and the order. CPU only, no
+// device needed.
+void run(uint32_t jobs);
+
+} // namespace job_bench
@@ -0,0 +1,71 @@
+#include "memory_bench.hpp"
+
+#include "job_system.hpp"
+#include "logger.hpp"
+#include "memory_tracker.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+// Any tag works, nothing else tracks CPU buffers
+#define BENCH_MEMORY_TAG MEMORY_TAG_BUFFERS
+#define BENCH_MEMORY_TRACKS 16
+#define BENCH_MEMORY_MAX_SIZE 65536
+
+static void thread_rounds(void *data, uint32_t begin, uint32_t end);
+static uint32_t next_random(uint32_t *state);
+
+void memory_bench::run(uint32_t rounds) {
+    JobSystem *system = new JobSystem;
+    if (!job_system::initialize(system, 0)) {
+        LOG("memory_bench: Couldn't start the job system");
+        delete system;
+        return;
+    }
+
+    // The same tracks and untracks alone and with every thread at the same counters
+    auto start = std::chrono::steady_clock::now();
+    thread_rounds(nullptr, 0, rounds);
+    double serial_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    memory_tracker::reset_peaks();
+    start = std::chrono::steady_clock::now();
+    job_system::parallel_for(system, rounds, 16, thread_rounds, nullptr);
+    double threaded_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    uint32_t worker_count = system->worker_count;
+    job_system::shutdown(system);
+    delete system;
+
+    double tracks = 2.0 * rounds * BENCH_MEMORY_TRACKS;
+    MemoryPoolStats stats = memory_tracker::get_stats(BENCH_MEMORY_TAG, MEMORY_DOMAIN_CPU);
+    printf("Memory: %u rounds of %u tracks and untracks\n", rounds, BENCH_MEMORY_TRACKS);
+    printf("  one thread       %8.2f ms | %6.1f ns per call\n", serial_ms, serial_ms * 1e6 / tracks);
+    printf("  %2u workers + main %6.2f ms | %6.1f ns per call | %llu bytes peak\n", worker_count, threaded_ms, threaded_ms * 1e6 / tracks,
+           (unsigned long long)stats.peak);
+    memory_tracker::dump();
+}
+
+static void thread_rounds(void *data, uint32_t begin, uint32_t end) {
+    (void)data;
+    uint64_t sizes[BENCH_MEMORY_TRACKS];
+    for (uint32_t round = begin; round < end; ++round) {
+        uint32_t rng = round * 2654435761u + 1;
+        for (uint32_t i = 0; i < BENCH_MEMORY_TRACKS; ++i) {
+            sizes[i] = 1 + next_random(&rng) % BENCH_MEMORY_MAX_SIZE;
+            memory_tracker::track(BENCH_MEMORY_TAG, MEMORY_DOMAIN_CPU, sizes[i]);
+        }
+        for (uint32_t i = 0; i < BENCH_MEMORY_TRACKS; ++i) {
+            memory_tracker::untrack(BENCH_MEMORY_TAG, MEMORY_DOMAIN_CPU, sizes[i]);
+        }
+    }
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace memory_bench {
+
+// Times n rounds of tracks and untracks on one thread, then on all of the job
+// system's threads at once, and dumps the tracker. Only timing, the
+// memory_tracker suite in tests checks the format sizes, budgets and peaks.
+// CPU only, no device needed.
+void run(uint32_t rounds);
+
+} // namespace memory_bench
@@ -0,0 +1,162 @@
+#include "meshlet_bench.hpp"
+
+#include "logger.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+
+#include <DirectXMath.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// 256 * 512 quads, about 260k triangles and 2-3k meshlets
+#define BENCH_RINGS 256
+#define BENCH_SEGMENTS 512
+
+static bool build_sphere(Vertex **out_vertices, uint32_t *out_vertex_count, uint32_t **out_indices, uint32_t *out_index_count);
+static float random_float(uint32_t *rng, float lo, float hi);
+static uint32_t next_random(uint32_t *state);
+
+void meshlet_bench::run(uint32_t views) {
+    Vertex *vertices = nullptr;
+    uint32_t *indices = nullptr;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    if (!build_sphere(&vertices, &vertex_count, &indices, &index_count)) {
+        LOG("meshlet_bench: Couldn't allocate the sphere");
+        return;
+    }
+
+    MeshletSet set;
+    auto start = std::chrono::steady_clock::now();
+    bool built = meshlet::build(vertices, vertex_count, indices, index_count, &set);
+    double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!built || set.count > MESHLET_MAX_PER_MESH) {
+        LOG("meshlet_bench: Couldn't build the meshlets");
+        free(vertices);
+        free(indices);
+        return;
+    }
+
+    uint32_t words = (set.count + 31) / 32;
+    uint32_t *visible_reference = (uint32_t *)malloc(words * sizeof(uint32_t));
+    uint32_t *visible_simd = (uint32_t *)malloc(words * sizeof(uint32_t));
+    MeshletDraw *draws = (MeshletDraw *)malloc(((set.count + 1) / 2) * sizeof(MeshletDraw));
+    if (!visible_reference || !visible_simd || !draws) {
+        LOG("meshlet_bench: Couldn't allocate the visibility scratch");
+        views = 0;
+    }
+
+    uint32_t rng = 0x9E3779B9u;
+    double reference_ms = 0.0;
+    double simd_ms = 0.0;
+    uint64_t visible_total = 0;
+    uint64_t index_total = 0;
+    uint64_t draw_total = 0;
+    for (uint32_t v = 0; v < views; ++v) {
+        // Outside the sphere, looking somewhere near it
+        float yaw = random_float(&rng, 0.0f, DirectX::XM_2PI);
+        float pitch = random_float(&rng, -1.4f, 1.4f);
+        float distance = random_float(&rng, 2.0f, 8.0f);
+        DirectX::XMVECTOR eye = DirectX::XMVectorSet(distance * cosf(pitch) * cosf(yaw), distance * sinf(pitch), distance * cosf(pitch) * sinf(yaw), 1.0f);
+        DirectX::XMVECTOR target = DirectX::XMVectorSet(random_float(&rng, -1.0f, 1.0f), random_float(&rng, -1.0f, 1.0f), random_float(&rng, -1.0f, 1.0f), 1.0f);
+        DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH(eye, target, DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(random_float(&rng, 0.6f, 1.4f), 16.0f / 9.0f, 0.1f, 100.0f);
+        DirectX::XMMATRIX world = DirectX::XMMatrixScaling(1.5f, 1.5f, 1.5f) * DirectX::XMMatrixRotationY(random_float(&rng, 0.0f, DirectX::XM_2PI));
+
+        DirectX::XMFLOAT4X4 world_matrix;
+        DirectX::XMFLOAT4X4 view_projection;
+        DirectX::XMFLOAT3 camera_position;
+        DirectX::XMStoreFloat4x4(&world_matrix, world);
+        DirectX::XMStoreFloat4x4(&view_projection, view * projection);
+        DirectX::XMStoreFloat3(&camera_position, eye);
+        MeshletCullView cull_view = meshlet::make_view(&world_matrix, &view_projection, camera_position);
+
+        start = std::chrono::steady_clock::now();
+        meshlet::cull_reference(&set, &cull_view, visible_reference);
+        reference_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        uint32_t simd_count = meshlet::cull_simd(&set, &cull_view, visible_simd);
+        simd_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        uint32_t draw_count = meshlet::build_draws(&set, visible_simd, draws);
+        for (uint32_t d = 0; d < draw_count; ++d) {
+            index_total += draws[d].index_count;
+        }
+        draw_total += draw_count;
+        visible_total += simd_count;
+    }
+
+    if (views > 0) {
+        double culled = (double)set.count * views;
+        printf("Meshlets: %u triangles in %u meshlets (%.1f each), built in %.2f ms\n",
+               index_count / 3, set.count, (double)index_count / 3 / set.count, build_ms);
+        printf("  cull reference %6.2f ns | simd %6.2f ns per meshlet (%.1fx)\n",
+               reference_ms * 1e6 / culled, simd_ms * 1e6 / culled, simd_ms > 0.0 ? reference_ms / simd_ms : 0.0);
+        printf("  %.1f%% of meshlets visible, %.1f%% of the indices drawn in %.1f draws per view\n",
+               100.0 * visible_total / culled, 100.0 * index_total / ((double)index_count * views), (double)draw_total / views);
+    }
+
+    meshlet::destroy(&set);
+    free(visible_reference);
+    free(visible_simd);
+    free(draws);
+    free(vertices);
+    free(indices);
+}
+
+// Clockwise from outside, the way the loaders leave glTF meshes
+static bool build_sphere(Vertex **out_vertices, uint32_t *out_vertex_count, uint32_t **out_indices, uint32_t *out_index_count) {
+    uint32_t vertex_count = (BENCH_RINGS + 1) * (BENCH_SEGMENTS + 1);
+    uint32_t index_count = BENCH_RINGS * BENCH_SEGMENTS * 6;
+    Vertex *vertices = (Vertex *)calloc(vertex_count, sizeof(Vertex));
+    uint32_t *indices = (uint32_t *)malloc(index_count * sizeof(uint32_t));
+    if (!vertices || !indices) {
+        free(vertices);
+        free(indices);
+        return false;
+    }
+
+    for (uint32_t r = 0; r <= BENCH_RINGS; ++r) {
+        float theta = DirectX::XM_PI * r / BENCH_RINGS;
+        for (uint32_t s = 0; s <= BENCH_SEGMENTS; ++s) {
+            float phi = DirectX::XM_2PI * s / BENCH_SEGMENTS;
+            Vertex *v = &vertices[r * (BENCH_SEGMENTS + 1) + s];
+            v->position = DirectX::XMFLOAT3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            v->normal = v->position;
+            v->texCoord = DirectX::XMFLOAT2((float)s / BENCH_SEGMENTS, (float)r / BENCH_RINGS);
+        }
+    }
+
+    uint32_t *out = indices;
+    for (uint32_t r = 0; r < BENCH_RINGS; ++r) {
+        for (uint32_t s = 0; s < BENCH_SEGMENTS; ++s) {
+            uint32_t a = r * (BENCH_SEGMENTS + 1) + s;
+            uint32_t b = a + BENCH_SEGMENTS + 1;
+            *out++ = a, *out++ = a + 1, *out++ = b;
+            *out++ = a + 1, *out++ = b + 1, *out++ = b;
+        }
+    }
+
+    *out_vertices = vertices;
+    *out_vertex_count = vertex_count;
+    *out_indices = indices;
+    *out_index_count = index_count;
+    return true;
+}
+
+static float random_float(uint32_t *rng, float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random(rng) & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace meshlet_bench {
+
+// Builds the meshlets of a finely tessellated sphere and culls them from n
+// random cameras, once with the reference and once with the SIMD path.
+// Reports the build time, ns per meshlet for both and how much is left to
+// draw. Only timing, the meshlet suite in tests checks that the two paths
+// agree. CPU only, no device needed.
+void run(uint32_t views);
+
+} // namespace meshlet_bench
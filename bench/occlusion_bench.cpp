@@ -0,0 +1,130 @@
+#include "occlusion_bench.hpp"
+
+#include "logger.hpp"
+#include "occlusion.hpp"
+
+#include <DirectXMath.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define BENCH_WALLS 48
+#define BENCH_FOV 1.0f
+#define BENCH_ASPECT (16.0f / 9.0f)
+#define BENCH_NEAR 0.1f
+#define BENCH_FAR 200.0f
+
+// View space, the camera sits at the origin looking down +z
+struct BenchWall {
+    float min_x, max_x;
+    float min_y, max_y;
+    float z;
+};
+
+struct BenchSphere {
+    DirectX::XMFLOAT3 center;
+    float radius;
+};
+
+static BenchWall g_walls[BENCH_WALLS];
+static float g_depth[HIZ_WIDTH * HIZ_HEIGHT];
+static HiZPyramid g_pyramid;
+
+static float wall_depth(float view_x_over_z, float view_y_over_z);
+static float project_depth(float view_z);
+static float random_float(uint32_t *rng, float lo, float hi);
+static uint32_t next_random(uint32_t *state);
+
+void occlusion_bench::run(uint32_t spheres) {
+    uint32_t rng = 0x9E3779B9u;
+
+    // No view matrix, the view projection is just the projection
+    DirectX::XMFLOAT4X4 view_projection;
+    DirectX::XMStoreFloat4x4(&view_projection, DirectX::XMMatrixPerspectiveFovLH(BENCH_FOV, BENCH_ASPECT, BENCH_NEAR, BENCH_FAR));
+    float scale_x = view_projection.m[0][0];
+    float scale_y = view_projection.m[1][1];
+
+    // Walls cover whole texels, so the texel centers give the exact farthest
+    // depth under each texel, like the GPU reduction would
+    for (uint32_t i = 0; i < BENCH_WALLS; ++i) {
+        BenchWall *wall = &g_walls[i];
+        wall->z = random_float(&rng, 5.0f, 60.0f);
+        uint32_t width = 8 + next_random(&rng) % (HIZ_WIDTH / 3);
+        uint32_t height = 8 + next_random(&rng) % (HIZ_HEIGHT / 3);
+        uint32_t x0 = next_random(&rng) % (HIZ_WIDTH - width);
+        uint32_t y0 = next_random(&rng) % (HIZ_HEIGHT - height);
+        wall->min_x = ((float)x0 / HIZ_WIDTH * 2.0f - 1.0f) / scale_x * wall->z;
+        wall->max_x = ((float)(x0 + width) / HIZ_WIDTH * 2.0f - 1.0f) / scale_x * wall->z;
+        wall->max_y = (1.0f - (float)y0 / HIZ_HEIGHT * 2.0f) / scale_y * wall->z;
+        wall->min_y = (1.0f - (float)(y0 + height) / HIZ_HEIGHT * 2.0f) / scale_y * wall->z;
+    }
+
+    for (uint32_t y = 0; y < HIZ_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < HIZ_WIDTH; ++x) {
+            float u = (x + 0.5f) / HIZ_WIDTH;
+            float v = (y + 0.5f) / HIZ_HEIGHT;
+            g_depth[y * HIZ_WIDTH + x] = wall_depth((u * 2.0f - 1.0f) / scale_x, (1.0f - v * 2.0f) / scale_y);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    occlusion::build(&g_pyramid, g_depth, HIZ_WIDTH * sizeof(float), &view_projection);
+    double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    BenchSphere *tests = (BenchSphere *)malloc(spheres * sizeof(BenchSphere));
+    if (!tests) {
+        LOG("occlusion_bench: Couldn't allocate the spheres");
+        return;
+    }
+    for (uint32_t i = 0; i < spheres; ++i) {
+        float z = random_float(&rng, 2.0f, 120.0f);
+        tests[i].center = DirectX::XMFLOAT3(random_float(&rng, -0.9f, 0.9f) * z, random_float(&rng, -0.5f, 0.5f) * z, z);
+        tests[i].radius = random_float(&rng, 0.2f, 3.0f);
+    }
+
+    uint32_t culled = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < spheres; ++i) {
+        culled += occlusion::is_occluded(&g_pyramid, tests[i].center, tests[i].radius);
+    }
+    double test_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    free(tests);
+
+    printf("Occlusion: %u walls, %u spheres, pyramid %ux%u with %u levels built in %.3f ms\n",
+           BENCH_WALLS, spheres, HIZ_WIDTH, HIZ_HEIGHT, g_pyramid.level_count, build_ms);
+    printf("  test %6.1f ns per sphere, %.1f%% culled\n",
+           spheres ? test_ms * 1e6 / spheres : 0.0, spheres ? 100.0 * culled / spheres : 0.0);
+}
+
+// Depth of the nearest wall along a view ray, the far plane when it hits none
+static float wall_depth(float view_x_over_z, float view_y_over_z) {
+    float nearest_z = BENCH_FAR;
+    for (uint32_t i = 0; i < BENCH_WALLS; ++i) {
+        const BenchWall *wall = &g_walls[i];
+        float x = view_x_over_z * wall->z;
+        float y = view_y_over_z * wall->z;
+        if (wall->z < nearest_z && x >= wall->min_x && x <= wall->max_x && y >= wall->min_y && y <= wall->max_y) {
+            nearest_z = wall->z;
+        }
+    }
+    return project_depth(nearest_z);
+}
+
+static float project_depth(float view_z) {
+    return (BENCH_FAR / (BENCH_FAR - BENCH_NEAR)) * (1.0f - BENCH_NEAR / view_z);
+}
+
+static float random_float(uint32_t *rng, float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random(rng) & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace occlusion_bench {
+
+// A view full of walls at different depths, traced straight into a Hi-Z
+// base level on the CPU, and n spheres scattered behind and between them.
+// Reports the pyramid build time, ns per sphere test and how many were
+// culled. Only timing, the occlusion suite in tests checks that nothing that
+// can be seen is culled. CPU only, no device needed.
+void run(uint32_t spheres);
+
+} // namespace occlusion_bench
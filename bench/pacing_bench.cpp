@@ -0,0 +1,85 @@
+#include "pacing_bench.hpp"
+
+#include "frame_pacer.hpp"
+
+#include <cstdio>
+
+#define BENCH_PACING_STEP (1.0f / 60.0f)
+// Frame number the hitch case stalls at, and for how long
+#define BENCH_PACING_HITCH_FRAME 10
+#define BENCH_PACING_HITCH_NS 500000000ull
+
+// Time only moves when a frame's cost or the limiter moves it
+struct FakeClock {
+    uint64_t now_ns;
+};
+
+struct PacingCase {
+    const char *name;
+    float max_fps;
+    uint64_t frame_ns;  // What a frame costs before the limiter
+    uint64_t jitter_ns; // Up to this much more, varying per frame
+    bool has_hitch;
+};
+
+static void run_case(const PacingCase *test, uint32_t frames, PacerStats *out_stats);
+static uint64_t fake_now(void *user_data);
+static void fake_sleep_until(void *user_data, uint64_t deadline_ns);
+static uint64_t frame_cost(const PacingCase *test, uint32_t frame);
+
+void pacing_bench::run(uint32_t frames) {
+    const PacingCase cases[] = {
+        {"120 Hz frames", 0.0f, 8333333, 0, false},
+        {"30 Hz frames", 0.0f, 33333333, 0, false},
+        {"uneven, limited to 60", 60.0f, 9000000, 6000000, false},
+        {"hitch", 0.0f, 16666666, 0, true},
+    };
+
+    printf("Pacing: %u frames per case, %.2f ms steps\n", frames, BENCH_PACING_STEP * 1000.0f);
+
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        PacerStats stats;
+        run_case(&cases[i], frames, &stats);
+        printf("  %-22s %6u steps, %.2f per frame (%u max), %8.1f ms dropped, %8.1f ms limited\n",
+               cases[i].name, stats.steps, stats.steps / (double)stats.frames, stats.max_steps_per_frame,
+               stats.dropped_ns / 1e6, stats.limiter_ns / 1e6);
+    }
+}
+
+static void run_case(const PacingCase *test, uint32_t frames, PacerStats *out_stats) {
+    FakeClock clock = {1000000000ull};
+    FramePacer pacer;
+    frame_pacer::initialize(&pacer, {fake_now, fake_sleep_until, &clock}, BENCH_PACING_STEP, test->max_fps, 0);
+
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        frame_pacer::begin_frame(&pacer);
+        clock.now_ns += frame_cost(test, frame);
+        frame_pacer::end_frame(&pacer);
+    }
+    *out_stats = pacer.stats;
+}
+
+static uint64_t fake_now(void *user_data) {
+    return ((FakeClock *)user_data)->now_ns;
+}
+
+static void fake_sleep_until(void *user_data, uint64_t deadline_ns) {
+    FakeClock *clock = (FakeClock *)user_data;
+    if (clock->now_ns < deadline_ns) {
+        clock->now_ns = deadline_ns;
+    }
+}
+
+static uint64_t frame_cost(const PacingCase *test, uint32_t frame) {
+    uint64_t cost = test->frame_ns;
+    if (test->jitter_ns > 0) {
+        // Same sequence every run
+        uint32_t x = (frame + 1) * 2654435761u;
+        x ^= x >> 15;
+        cost += x % test->jitter_ns;
+    }
+    if (test->has_hitch && frame == BENCH_PACING_HITCH_FRAME) {
+        cost += BENCH_PACING_HITCH_NS;
+    }
+    return cost;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pacing_bench {
+
+// Drives the frame pacer with a fake clock for n frames per case: frames
+// faster and slower than the fixed step, a limited frame rate with uneven
+// frame costs and a long hitch, and prints the steps, dropped and limited
+// time of each. Only numbers, the frame_pacer suite in tests checks that the
+// time adds up, the limiter and the step limit. CPU only, no device needed.
+void run(uint32_t frames);
+
+} // namespace pacing_bench
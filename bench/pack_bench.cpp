@@ -0,0 +1,156 @@
+#include "pack_bench.hpp"
+
+#include "arena.hpp"
+#include "asset_registry.hpp"
+#include "logger.hpp"
+#include "pack_file.hpp"
+#include "vfs.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#define BENCH_PACK_FILES 48
+#define BENCH_PACK_MAX_FILE_SIZE (64 * 1024)
+
+struct BenchFile {
+    char name[ASSET_PATH_MAX]; // What the pack knows it by
+    char path[ASSET_PATH_MAX]; // Where it is on disk
+    uint8_t *data;
+    size_t size;
+};
+
+static const char *s_words[] = {"albedo", "roughness", "metallic", "normal", "occlusion", "emissive", "mesh", "material", "texture", "scene"};
+
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng);
+static uint32_t next_random(uint32_t *state);
+
+void pack_bench::run(uint32_t reads) {
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "pack_bench";
+    std::filesystem::remove_all(dir, error);
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+        LOG("pack_bench: Couldn't create %s", dir.string().c_str());
+        return;
+    }
+
+    // Text, noise and long runs (like uncompressed image rows), some a few folders down
+    BenchFile *files = new BenchFile[BENCH_PACK_FILES];
+    uint32_t rng = 0x9ac4;
+    for (uint32_t i = 0; i < BENCH_PACK_FILES; ++i) {
+        BenchFile *file = &files[i];
+        snprintf(file->name, sizeof(file->name), i % 4 == 0 ? "assets/pack_bench/nested/deep/file_%u.bin" : "assets/pack_bench/file_%u.bin", i);
+        snprintf(file->path, sizeof(file->path), "%s/file_%u.bin", dir.generic_string().c_str(), i);
+        file->size = next_random(&rng) % BENCH_PACK_MAX_FILE_SIZE + 1;
+        file->data = new uint8_t[file->size];
+        fill(file->data, file->size, i % 3, &rng);
+
+        FILE *out = fopen(file->path, "wb");
+        if (out) {
+            fwrite(file->data, 1, file->size, out);
+            fclose(out);
+        }
+    }
+
+    std::string pack_path = (dir / ("bench" PACK_FILE_EXTENSION)).generic_string();
+    PackSource sources[BENCH_PACK_FILES];
+    for (uint32_t i = 0; i < BENCH_PACK_FILES; ++i) {
+        sources[i] = {files[i].name, files[i].path};
+    }
+    PackWriteStats stats = {};
+    if (!pack_file::write(pack_path.c_str(), sources, BENCH_PACK_FILES, &stats)) {
+        LOG("pack_bench: Couldn't write %s", pack_path.c_str());
+    }
+
+    // The same reads from the pack and from the loose files
+    Arena *scratch = arena::scratch();
+    uint32_t *picks = new uint32_t[reads];
+    for (uint32_t i = 0; i < reads; ++i) {
+        picks[i] = next_random(&rng) % BENCH_PACK_FILES;
+    }
+    double times_ms[2] = {};
+    uint64_t bytes[2] = {};
+    VfsStats pack_stats = {};
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+        bool is_packed = pass == 0;
+        if (is_packed && !vfs::mount(pack_path.c_str())) {
+            continue;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < reads; ++i) {
+            ArenaMarker marker = arena::get_marker(scratch);
+            const uint8_t *data = nullptr;
+            size_t size = 0;
+            const BenchFile *file = &files[picks[i]];
+            vfs::read(is_packed ? file->name : file->path, scratch, &data, &size);
+            bytes[pass] += size;
+            arena::rewind(scratch, marker);
+        }
+        times_ms[pass] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if (is_packed) {
+            pack_stats = vfs::get_stats();
+            vfs::unmount();
+        }
+    }
+
+    printf("Pack: %u files (%u compressed, %u shared), %llu -> %llu bytes\n", stats.files, stats.compressed, stats.shared,
+           (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out);
+    printf("  %u reads, %.3f us each from the pack (%llu bytes mapped, %llu decompressed), %.3f us loose\n", reads,
+           reads > 0 ? times_ms[0] * 1000.0 / reads : 0.0, (unsigned long long)pack_stats.bytes_mapped,
+           (unsigned long long)pack_stats.bytes_decompressed, reads > 0 ? times_ms[1] * 1000.0 / reads : 0.0);
+    printf("  %llu and %llu bytes read\n", (unsigned long long)bytes[0], (unsigned long long)bytes[1]);
+
+    delete[] picks;
+    for (uint32_t i = 0; i < BENCH_PACK_FILES; ++i) {
+        delete[] files[i].data;
+    }
+    delete[] files;
+    std::filesystem::remove_all(dir, error);
+}
+
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng) {
+    size_t i = 0;
+    while (i < size) {
+        switch (pattern) {
+            case 0: {
+                // Words, compresses about the way shaders and configs do
+                const char *word = s_words[next_random(rng) % (sizeof(s_words) / sizeof(s_words[0]))];
+                for (size_t c = 0; word[c] && i < size; ++c) {
+                    data[i++] = (uint8_t)word[c];
+                }
+                if (i < size) {
+                    data[i++] = ' ';
+                }
+                break;
+            }
+            case 1:
+                data[i++] = (uint8_t)next_random(rng);
+                break;
+            case 2: {
+                // Runs of a byte
+                uint8_t value = (uint8_t)next_random(rng);
+                for (uint32_t run = next_random(rng) % 64 + 1; run > 0 && i < size; --run) {
+                    data[i++] = value;
+                }
+                break;
+            }
+            default:
+                // A match right behind itself, copied byte by byte
+                data[i] = (uint8_t)(i % 3);
+                i++;
+                break;
+        }
+    }
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pack_bench {
+
+// Packs a directory of text, random and nested files, then times n random
+// reads from the pack through the vfs against the same files loose. Only
+// timing, the lz4 and pack_file suites in tests check the codec, the pack and
+// the reads. CPU only, no device needed.
+void run(uint32_t reads);
+
+} // namespace pack_bench
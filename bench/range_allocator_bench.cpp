@@ -0,0 +1,125 @@
+#include "range_allocator_bench.hpp"
+
+#include "range_allocator.hpp"
+#include "renderer.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+// A few hundred meshes loaded at once at most
+#define BENCH_MAX_LIVE 256
+// How often the fragmentation is sampled
+#define BENCH_SAMPLE_INTERVAL 1000
+
+static RangeAllocator g_allocator;
+static RangeAllocation g_live[BENCH_MAX_LIVE];
+static RangeMove g_moves[RANGE_ALLOCATOR_MAX_NODES];
+
+static uint32_t random_size(uint32_t *rng);
+static float fragmentation(const RangeAllocatorStats *stats);
+static uint32_t next_random(uint32_t *state);
+
+void range_allocator_bench::run(uint32_t operations) {
+    uint32_t capacity = GEOMETRY_ARENA_VERTICES;
+    range_allocator::initialize(&g_allocator, capacity);
+
+    uint32_t rng = 0x9E3779B9u;
+    uint32_t live_count = 0;
+    uint32_t allocations = 0;
+    uint32_t releases = 0;
+    uint32_t failures = 0;
+    uint32_t compactions = 0; // There was enough free space, just not in one piece
+    uint32_t compaction_moves = 0;
+    double allocate_ms = 0.0;
+    double release_ms = 0.0;
+    double fragmentation_total = 0.0;
+    float fragmentation_max = 0.0f;
+    uint32_t samples = 0;
+
+    for (uint32_t op = 0; op < operations; ++op) {
+        bool load = live_count == 0 || (live_count < BENCH_MAX_LIVE && next_random(&rng) % 100 < 55);
+        if (load) {
+            uint32_t size = random_size(&rng);
+
+            auto start = std::chrono::steady_clock::now();
+            RangeAllocation allocation = range_allocator::allocate(&g_allocator, size);
+            allocate_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            allocations++;
+
+            // What mesh::load does, compact and try again when the space is there
+            if (allocation.node == RANGE_ALLOCATOR_NONE && size <= g_allocator.free_units) {
+                compaction_moves += range_allocator::compact(&g_allocator, g_moves, RANGE_ALLOCATOR_MAX_NODES);
+                compactions++;
+                for (uint32_t i = 0; i < live_count; ++i) {
+                    g_live[i] = range_allocator::get(&g_allocator, g_live[i].node);
+                }
+                allocation = range_allocator::allocate(&g_allocator, size);
+            }
+
+            if (allocation.node == RANGE_ALLOCATOR_NONE) {
+                failures++;
+            } else {
+                g_live[live_count++] = allocation;
+            }
+        } else {
+            uint32_t index = next_random(&rng) % live_count;
+
+            auto start = std::chrono::steady_clock::now();
+            range_allocator::release(&g_allocator, g_live[index]);
+            release_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            releases++;
+
+            g_live[index] = g_live[--live_count];
+        }
+
+        if (op % BENCH_SAMPLE_INTERVAL == BENCH_SAMPLE_INTERVAL - 1) {
+            RangeAllocatorStats stats = range_allocator::get_stats(&g_allocator);
+            float f = fragmentation(&stats);
+            fragmentation_total += f;
+            fragmentation_max = f > fragmentation_max ? f : fragmentation_max;
+            samples++;
+        }
+    }
+
+    RangeAllocatorStats before = range_allocator::get_stats(&g_allocator);
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t move_count = range_allocator::compact(&g_allocator, g_moves, RANGE_ALLOCATOR_MAX_NODES);
+    double compact_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    RangeAllocatorStats after = range_allocator::get_stats(&g_allocator);
+
+    printf("Range allocator: %u operations, %u units, %u live at the end\n", operations, capacity, live_count);
+    printf("  allocate %6.1f ns | release %6.1f ns\n",
+           allocations ? allocate_ms * 1e6 / allocations : 0.0, releases ? release_ms * 1e6 / releases : 0.0);
+    printf("  failed allocations %u (out of space), %u compactions (%.1f ranges moved each)\n",
+           failures, compactions, compactions ? (double)compaction_moves / compactions : 0.0);
+    printf("  fragmentation avg %.1f%% | max %.1f%% (free space not in the largest block)\n",
+           samples ? 100.0 * fragmentation_total / samples : 0.0, 100.0 * fragmentation_max);
+    printf("  compact: %u ranges moved in %.3f ms, %u free blocks -> %u, largest free %u -> %u\n",
+           move_count, compact_ms, before.free_blocks, after.free_blocks, before.largest_free, after.largest_free);
+}
+
+// Log-uniform from a cube to a big scanned model, most meshes are small
+static uint32_t random_size(uint32_t *rng) {
+    uint32_t bits = 5 + next_random(rng) % 11;
+    uint32_t base = 1u << bits;
+    return base + next_random(rng) % base;
+}
+
+static float fragmentation(const RangeAllocatorStats *stats) {
+    if (stats->free_units == 0) {
+        return 0.0f;
+    }
+    return 1.0f - (float)stats->largest_free / (float)stats->free_units;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
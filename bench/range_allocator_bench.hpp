@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace range_allocator_bench {
+
+// Loads and unloads mesh sized ranges at random against a RangeAllocator the
+// size of the geometry arena, and reports the time per operation, how
+// fragmented the free space gets and what compact does about it. Only timing,
+// the range_allocator suite in tests checks the ranges. CPU only, no device needed.
+void run(uint32_t operations);
+
+} // namespace range_allocator_bench
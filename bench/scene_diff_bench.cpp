@@ -0,0 +1,109 @@
+#include "scene_diff_bench.hpp"
+
+#include "arena.hpp"
+#include "logger.hpp"
+#include "scene_diff.hpp"
+#include "scene_file.hpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+#define BENCH_DIFF_TEXTURES 60
+#define BENCH_DIFF_MATERIALS 30
+#define BENCH_DIFF_MESHES 40
+#define BENCH_DIFF_RUNS 5
+// Every this many instances the edited config moves one
+#define BENCH_DIFF_MOVE_EVERY 100
+
+static void generate(std::string *out, uint32_t instances, bool is_edited);
+static void append(std::string *out, const char *format, ...);
+static double best_ms(const SceneFile *old_file, const SceneFile *new_file, Arena *arena, SceneDiff *out_diff);
+
+void scene_diff_bench::run(uint32_t instances) {
+    Arena arena;
+    if (!arena::initialize(&arena, ARENA_SCRATCH_RESERVE)) {
+        return;
+    }
+
+    // A big config against itself and against an edit: one material and every
+    // BENCH_DIFF_MOVE_EVERY instance moved, one instance more at the front
+    std::string json;
+    std::string edited_json;
+    generate(&json, instances, false);
+    generate(&edited_json, instances, true);
+    SceneFile file = {};
+    SceneFile edited = {};
+    if (!scene_file::from_json(json.data(), json.size(), &arena, &file) || !scene_file::from_json(edited_json.data(), edited_json.size(), &arena, &edited)) {
+        LOG("scene_diff_bench: The generated configs didn't load");
+        arena::shutdown(&arena);
+        return;
+    }
+
+    SceneDiff same = {};
+    SceneDiff changed = {};
+    double same_ms = best_ms(&file, &file, &arena, &same);
+    double changed_ms = best_ms(&file, &edited, &arena, &changed);
+
+    printf("Scene diffs: %u instances\n", instances);
+    printf("  unchanged %.3f ms, edited %.3f ms (%u instances changed)\n", same_ms, changed_ms, changed.instances.changed_count);
+
+    arena::shutdown(&arena);
+}
+
+static void generate(std::string *out, uint32_t instances, bool is_edited) {
+    out->reserve((size_t)instances * 120 + 64 * 1024);
+    append(out, "{\"textures\": [");
+    for (uint32_t i = 0; i < BENCH_DIFF_TEXTURES; ++i) {
+        append(out, "%s{\"id\": %u, \"path\": \"assets/generated/texture_%u.png\"}", i ? ", " : "", i * 7 + 100, i);
+    }
+    append(out, "], \"materials\": [");
+    for (uint32_t i = 0; i < BENCH_DIFF_MATERIALS; ++i) {
+        float roughness = is_edited && i == BENCH_DIFF_MATERIALS / 2 ? 0.125f : 0.5f;
+        append(out, "%s{\"id\": %u, \"albedo_map\": %u, \"normal_map\": %u, \"roughness\": %g}", i ? ", " : "", i + 5000, (i * 2) * 7 + 100,
+               (i * 2 + 1) * 7 + 100, roughness);
+    }
+    append(out, "], \"meshes\": [");
+    for (uint32_t i = 0; i < BENCH_DIFF_MESHES; ++i) {
+        append(out, "%s{\"id\": %u, \"path\": \"assets/generated/mesh_%u.glb\"}", i ? ", " : "", i * 3 + 90000, i);
+    }
+    append(out, "], \"scenes\": [{\"meshes\": [\n");
+    if (is_edited) {
+        append(out, "{\"mesh_id\": 90000, \"material_id\": 5000, \"position\": [-1, -1, -1]},\n");
+    }
+    for (uint32_t i = 0; i < instances; ++i) {
+        float y = is_edited && i % BENCH_DIFF_MOVE_EVERY == 0 ? 10.0f : 0.0f;
+        append(out, "{\"mesh_id\": %u, \"material_id\": %u, \"position\": [%u, %g, %u], \"rotation\": [0, %u, 0]}%s\n", (i % BENCH_DIFF_MESHES) * 3 + 90000,
+               i % BENCH_DIFF_MATERIALS + 5000, i % 100, y, i / 100, i % 360, i + 1 < instances ? "," : "");
+    }
+    append(out, "]}]}\n");
+}
+
+static void append(std::string *out, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out->append(line, length > 0 ? (size_t)length : 0);
+}
+
+static double best_ms(const SceneFile *old_file, const SceneFile *new_file, Arena *arena, SceneDiff *out_diff) {
+    double best = -1.0;
+    for (uint32_t run = 0; run < BENCH_DIFF_RUNS; ++run) {
+        // The last run's diff is left on the arena for the caller
+        ArenaMarker marker = arena::get_marker(arena);
+        auto begin = std::chrono::steady_clock::now();
+        bool is_diffed = scene_diff::compute(old_file, new_file, arena, out_diff);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if (!is_diffed) {
+            return -1.0;
+        }
+        if (run + 1 < BENCH_DIFF_RUNS) {
+            arena::rewind(arena, marker);
+        }
+        best = best < 0.0 || ms < best ? ms : best;
+    }
+    return best;
+}
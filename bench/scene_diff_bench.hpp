@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace scene_diff_bench {
+
+// Times diffing a generated config of n instances against itself and against
+// a copy with some of it edited. Only timing, the scene_diff suite in tests
+// checks what each diff keeps, reloads and removes. CPU only, no device
+// needed. -1 ms when a diff failed.
+void run(uint32_t instances);
+
+} // namespace scene_diff_bench
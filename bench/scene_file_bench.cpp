@@ -0,0 +1,136 @@
+#include "scene_file_bench.hpp"
+
+#include "arena.hpp"
+#include "logger.hpp"
+#include "scene_file.hpp"
+#include "vfs.hpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#define BENCH_SCENE_TEXTURES 300
+#define BENCH_SCENE_MATERIALS 400
+#define BENCH_SCENE_MESHES 500
+#define BENCH_SCENE_SCENES 3
+// Best of, the first run pays for the page cache
+#define BENCH_SCENE_RUNS 5
+
+static void generate(std::string *out, uint32_t instances);
+static void append(std::string *out, const char *format, ...);
+static double best_ms(const char *path, bool is_read_only, Arena *arena, uint64_t *out_bytes);
+
+void scene_file_bench::run(uint32_t instances) {
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "scene_file_bench";
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+        LOG("scene_file_bench: Couldn't create %s", dir.string().c_str());
+        return;
+    }
+
+    Arena arena;
+    if (!arena::initialize(&arena, ARENA_SCRATCH_RESERVE)) {
+        return;
+    }
+
+    std::string json;
+    generate(&json, instances);
+
+    // The JSON as it's written by hand and the same scene compiled
+    std::string json_path = (dir / "scene.json").generic_string();
+    std::string scene_path = (dir / ("scene" SCENE_FILE_EXTENSION)).generic_string();
+    FILE *file = fopen(json_path.c_str(), "wb");
+    if (file) {
+        fwrite(json.data(), 1, json.size(), file);
+        fclose(file);
+    }
+    SceneFile compiled = {};
+    if (!scene_file::from_json(json.data(), json.size(), &arena, &compiled) || !scene_file::write(scene_path.c_str(), &compiled)) {
+        LOG("scene_file_bench: Couldn't compile %s", json_path.c_str());
+    }
+    arena::reset(&arena);
+
+    uint64_t json_bytes = 0;
+    uint64_t scene_bytes = 0;
+    double json_ms = best_ms(json_path.c_str(), false, &arena, &json_bytes);
+    double scene_ms = best_ms(scene_path.c_str(), false, &arena, &scene_bytes);
+    double read_ms = best_ms(scene_path.c_str(), true, &arena, nullptr);
+
+    printf("Scene files: %u instances, %llu bytes of JSON, %llu compiled\n", instances, (unsigned long long)json_bytes, (unsigned long long)scene_bytes);
+    printf("  JSON %.3f ms, compiled %.3f ms (%.3f ms of it the read), %.1fx\n", json_ms, scene_ms, read_ms, scene_ms > 0.0 ? json_ms / scene_ms : 0.0);
+
+    arena::shutdown(&arena);
+    std::filesystem::remove_all(dir, error);
+}
+
+static void generate(std::string *out, uint32_t instances) {
+    // Ids spread out far past a byte, the way an editor hands them out
+    out->reserve((size_t)instances * 160 + 1024 * 1024);
+    append(out, "{\n    \"textures\": [\n");
+    for (uint32_t i = 0; i < BENCH_SCENE_TEXTURES; ++i) {
+        append(out, "        {\"id\": %u, \"path\": \"assets/generated/texture_%u.png\", \"srgb\": %s}%s\n", i * 37 + 500, i,
+               i % 3 == 0 ? "true" : "false", i + 1 < BENCH_SCENE_TEXTURES ? "," : "");
+    }
+    append(out, "    ],\n    \"materials\": [\n");
+    for (uint32_t i = 0; i < BENCH_SCENE_MATERIALS; ++i) {
+        int map = (int)(i % BENCH_SCENE_TEXTURES) * 37 + 500;
+        append(out,
+               "        {\"id\": %u, \"albedo\": [%g, %g, %g], \"albedo_map\": %d, \"roughness\": %g, \"roughness_map\": -1, \"coat\": 0.0, "
+               "\"coat_map\": -1, \"metallic\": %g, \"metallic_map\": %d, \"normal_map\": %d, \"emission\": 0.0, \"emission_map\": -1}%s\n",
+               i * 1000 + 7, (i % 10) / 10.0, 0.5, 1.0 / (i + 1), map, (i % 7) / 7.0, (i % 2) * 1.0, i % 2 ? map : -1, map,
+               i + 1 < BENCH_SCENE_MATERIALS ? "," : "");
+    }
+    append(out, "    ],\n    \"meshes\": [\n");
+    for (uint32_t i = 0; i < BENCH_SCENE_MESHES; ++i) {
+        append(out, "        {\"id\": %u, \"path\": \"assets/generated/mesh_%u.glb\"}%s\n", 100000 + i * 3, i, i + 1 < BENCH_SCENE_MESHES ? "," : "");
+    }
+    append(out, "    ],\n    \"scenes\": [\n");
+    for (uint32_t s = 0; s < BENCH_SCENE_SCENES; ++s) {
+        uint32_t first = instances * s / BENCH_SCENE_SCENES;
+        uint32_t end = instances * (s + 1) / BENCH_SCENE_SCENES;
+        append(out, "        {\n            \"meshes\": [\n");
+        for (uint32_t i = first; i < end; ++i) {
+            append(out,
+                   "                {\"mesh_id\": %u, \"material_id\": %u, \"position\": [%g, %g, %g], \"rotation\": [0.0, %g, 0.0], \"scale\": [%g, %g, %g]}%s\n",
+                   100000 + (i % BENCH_SCENE_MESHES) * 3, (i % BENCH_SCENE_MATERIALS) * 1000 + 7, (double)(i % 100) * 2.5, (double)(i / 100 % 10),
+                   (double)(i / 1000) * -2.5, (double)(i % 360), 1.0 + (i % 3) * 0.25, 1.0, 1.0 + (i % 5) * 0.1, i + 1 < end ? "," : "");
+        }
+        append(out, "            ],\n            \"cameras\": [\n");
+        append(out, "                {\"fov\": %g, \"znear\": 0.1, \"zfar\": 1000.0, \"position\": [0.0, 5.0, -15.0], \"target\": [0.0, 0.0, 0.0]}\n", 45.0 + s);
+        append(out, "            ]\n        }%s\n", s + 1 < BENCH_SCENE_SCENES ? "," : "");
+    }
+    append(out, "    ]\n}\n");
+}
+
+static void append(std::string *out, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out->append(line, length > 0 ? (size_t)length : 0);
+}
+
+static double best_ms(const char *path, bool is_read_only, Arena *arena, uint64_t *out_bytes) {
+    double best = -1.0;
+    for (uint32_t run = 0; run < BENCH_SCENE_RUNS; ++run) {
+        auto begin = std::chrono::steady_clock::now();
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        SceneFile file = {};
+        bool is_loaded = is_read_only ? vfs::read(path, arena, &data, &size) : scene_file::read(path, arena, &file);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        arena::reset(arena);
+        if (!is_loaded) {
+            return -1.0;
+        }
+        best = best < 0.0 || ms < best ? ms : best;
+        if (out_bytes) {
+            *out_bytes = is_read_only ? size : (uint64_t)std::filesystem::file_size(path);
+        }
+    }
+    return best;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace scene_file_bench {
+
+// Times loading a generated scene config of n instances as JSON against
+// reading and opening the compiled scene file. Only timing, the scene_file
+// suite in tests checks the round trips, the defaults and the broken files.
+// CPU only, no device needed. -1 ms when a file didn't load.
+void run(uint32_t instances);
+
+} // namespace scene_file_bench
@@ -0,0 +1,142 @@
+#include "state_cache_bench.hpp"
+
+#include "math.hpp"
+#include "pipeline_system.hpp"
+#include "state_cache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// A typical set, most renderers end up with a couple dozen states
+#define BENCH_STATE_COUNT 24
+
+// What pipeline_system.cpp did before the state cache
+struct LinearStateSlot {
+    Id id;
+    uint64_t hash;
+};
+
+template <typename Desc>
+struct BenchStates {
+    Desc descs[BENCH_STATE_COUNT];
+    LinearStateSlot linear[MAX_BLEND_STATES];
+    StateCache<Desc, IUnknown, MAX_BLEND_STATES> cache;
+};
+
+static BenchStates<D3D11_BLEND_DESC> g_blend;
+static BenchStates<D3D11_RASTERIZER_DESC> g_raster;
+
+template <typename Desc>
+static void fill(BenchStates<Desc> *states);
+template <typename Desc>
+static Id linear_lookup(BenchStates<Desc> *states, const Desc *desc);
+template <typename Desc>
+static Id cached_lookup(BenchStates<Desc> *states, const Desc *desc);
+static uint32_t next_random(uint32_t *state);
+
+void state_cache_bench::run(uint32_t lookups_per_frame, uint32_t frames) {
+    for (uint32_t i = 0; i < BENCH_STATE_COUNT; ++i) {
+        D3D11_BLEND_DESC *blend = &g_blend.descs[i];
+        memset(blend, 0, sizeof(*blend));
+        blend->IndependentBlendEnable = i & 1;
+        for (int rt = 0; rt < 8; ++rt) {
+            blend->RenderTarget[rt].BlendEnable = (i >> 1) & 1;
+            blend->RenderTarget[rt].SrcBlend = (D3D11_BLEND)(1 + i % 8);
+            blend->RenderTarget[rt].DestBlend = (D3D11_BLEND)(1 + (i / 8) % 8);
+            blend->RenderTarget[rt].BlendOp = D3D11_BLEND_OP_ADD;
+            blend->RenderTarget[rt].SrcBlendAlpha = D3D11_BLEND_ONE;
+            blend->RenderTarget[rt].DestBlendAlpha = D3D11_BLEND_ZERO;
+            blend->RenderTarget[rt].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+            blend->RenderTarget[rt].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+        }
+
+        D3D11_RASTERIZER_DESC *raster = &g_raster.descs[i];
+        memset(raster, 0, sizeof(*raster));
+        raster->FillMode = (i & 1) ? D3D11_FILL_WIREFRAME : D3D11_FILL_SOLID;
+        raster->CullMode = (D3D11_CULL_MODE)(1 + (i >> 1) % 3);
+        raster->DepthBias = (INT)(i / 6);
+        raster->DepthClipEnable = TRUE;
+    }
+    fill(&g_blend);
+    fill(&g_raster);
+
+    // Same sequence for both paths
+    uint32_t rng = 0x9E3779B9u;
+    uint32_t sink = 0;
+    double linear_ms = 0.0;
+    double cached_ms = 0.0;
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        uint32_t frame_rng = rng;
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < lookups_per_frame; ++i) {
+            uint32_t index = next_random(&rng) % BENCH_STATE_COUNT;
+            sink += linear_lookup(&g_blend, &g_blend.descs[index]).id;
+            sink += linear_lookup(&g_raster, &g_raster.descs[index]).id;
+        }
+        auto middle = std::chrono::steady_clock::now();
+
+        rng = frame_rng;
+        for (uint32_t i = 0; i < lookups_per_frame; ++i) {
+            uint32_t index = next_random(&rng) % BENCH_STATE_COUNT;
+            sink += cached_lookup(&g_blend, &g_blend.descs[index]).id;
+            sink += cached_lookup(&g_raster, &g_raster.descs[index]).id;
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        linear_ms += std::chrono::duration<double, std::milli>(middle - start).count();
+        cached_ms += std::chrono::duration<double, std::milli>(end - middle).count();
+    }
+
+    double lookups = 2.0 * lookups_per_frame * frames;
+    printf("State lookups: %u per frame (blend + rasterizer), %u frames, %u states each\n", 2 * lookups_per_frame, frames, BENCH_STATE_COUNT);
+    printf("  linear scan  %8.4f ms per frame | %6.1f ns per lookup\n", linear_ms / frames, linear_ms * 1e6 / lookups);
+    printf("  state cache  %8.4f ms per frame | %6.1f ns per lookup\n", cached_ms / frames, cached_ms * 1e6 / lookups);
+    printf("  (checksum %u)\n", sink);
+}
+
+template <typename Desc>
+static void fill(BenchStates<Desc> *states) {
+    state_cache::initialize(&states->cache);
+    for (uint32_t i = 0; i < MAX_BLEND_STATES; ++i) {
+        states->linear[i].id = id::invalid();
+    }
+
+    // No objects, only the lookup is measured
+    for (uint8_t i = 0; i < BENCH_STATE_COUNT; ++i) {
+        states->linear[i].id.id = i;
+        states->linear[i].hash = hash_fnv1a_64(&states->descs[i], sizeof(Desc));
+        state_cache::add(&states->cache, &states->descs[i], hash_words_64(&states->descs[i], sizeof(Desc)), nullptr);
+    }
+}
+
+template <typename Desc>
+static Id linear_lookup(BenchStates<Desc> *states, const Desc *desc) {
+    uint64_t desc_hash = hash_fnv1a_64(desc, sizeof(Desc));
+    for (uint16_t i = 0; i < MAX_BLEND_STATES; ++i) {
+        LinearStateSlot *slot = &states->linear[i];
+        if (id::is_valid(slot->id) && slot->hash == desc_hash) {
+            return slot->id;
+        }
+    }
+    return id::invalid();
+}
+
+template <typename Desc>
+static Id cached_lookup(BenchStates<Desc> *states, const Desc *desc) {
+    // A create/release pair, what a per-draw state request costs
+    Id found = state_cache::acquire(&states->cache, desc, hash_words_64(desc, sizeof(Desc)));
+    state_cache::release(&states->cache, found);
+    return found;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace state_cache_bench {
+
+// Blend and rasterizer state lookups the way a renderer with per-draw state
+// would do them, through the old path (byte-wise FNV-1a and a linear scan of
+// every slot) and through the hashed StateCache. CPU only, no device needed.
+void run(uint32_t lookups_per_frame, uint32_t frames);
+
+} // namespace state_cache_bench
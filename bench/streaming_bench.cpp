@@ -0,0 +1,130 @@
+#include "streaming_bench.hpp"
+
+#include "mip_file.hpp"
+#include "texture_streamer.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#define BENCH_STREAM_TEXTURES 48
+#define BENCH_STREAM_MAX_LOADS 4
+#define BENCH_STREAM_LATENCY 4 // Frames a load takes at most
+#define BENCH_STREAM_FAIL_RATE 50 // One load in this many fails
+#define BENCH_STREAM_TAIL_SIZE 64 // Same as TEXTURE_STREAM_TAIL_SIZE
+
+struct PendingLoad {
+    uint32_t texture;
+    uint32_t frames_left;
+};
+
+struct SimulatedScene {
+    float positions[BENCH_STREAM_TEXTURES]; // Where each texture's object is along the camera's path
+    uint64_t tail_bytes;
+    uint64_t full_bytes;
+    PendingLoad loads[BENCH_STREAM_MAX_LOADS];
+    uint32_t load_count;
+};
+
+static bool add_texture(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, uint64_t *out_tail_bytes, uint64_t *out_full_bytes);
+static uint32_t next_random(uint32_t *state);
+
+void streaming_bench::run(uint32_t frames) {
+    // Objects strewn along a line, the camera goes back and forth over it and
+    // sees what's within 30 units, closer is bigger on screen. Up close it asks
+    // for more than the budget, far away less.
+    TextureStreamer *streamer = new TextureStreamer;
+    SimulatedScene *scene = new SimulatedScene;
+    *scene = {};
+    texture_streamer::initialize(streamer, 0, BENCH_STREAM_MAX_LOADS);
+    uint32_t rng = 0x5eed;
+    for (uint32_t i = 0; i < BENCH_STREAM_TEXTURES; ++i) {
+        uint32_t size = 256u << (next_random(&rng) % 5);
+        uint32_t height = next_random(&rng) % 4 == 0 ? size / 2 : size;
+        add_texture(streamer, i, size, height, &scene->tail_bytes, &scene->full_bytes);
+        scene->positions[i] = (float)(next_random(&rng) % 1000) / 10.0f;
+    }
+    texture_streamer::set_budget(streamer, scene->full_bytes / 4);
+
+    uint64_t peak_bytes = 0;
+    double update_ms = 0.0;
+    StreamRequest requests[STREAMER_MAX_TEXTURES];
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        // Uploads finish before the frame asks for more, like run_main_jobs
+        for (uint32_t l = 0; l < scene->load_count;) {
+            PendingLoad *load = &scene->loads[l];
+            if (--load->frames_left > 0) {
+                l++;
+                continue;
+            }
+            texture_streamer::complete(streamer, load->texture, next_random(&rng) % BENCH_STREAM_FAIL_RATE != 0);
+            *load = scene->loads[--scene->load_count];
+        }
+
+        if (frame == frames / 2) {
+            texture_streamer::set_budget(streamer, streamer->budget / 2);
+        }
+
+        texture_streamer::begin_frame(streamer);
+        float camera = 50.0f + 50.0f * sinf(frame * 0.01f);
+        for (uint32_t i = 0; i < BENCH_STREAM_TEXTURES; ++i) {
+            float distance = fabsf(scene->positions[i] - camera);
+            if (distance < 30.0f) {
+                texture_streamer::request(streamer, i, texture_streamer::footprint_mip(streamer, i, 16384.0f / (1.0f + distance)));
+            }
+        }
+
+        auto update_begin = std::chrono::steady_clock::now();
+        uint32_t count = texture_streamer::update(streamer, requests);
+        update_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - update_begin).count();
+
+        peak_bytes = streamer->resident_bytes > peak_bytes ? streamer->resident_bytes : peak_bytes;
+
+        for (uint32_t r = 0; r < count; ++r) {
+            if (requests[r].is_load) {
+                scene->loads[scene->load_count++] = {requests[r].texture, 1 + next_random(&rng) % BENCH_STREAM_LATENCY};
+            }
+        }
+    }
+
+    printf("Streaming: %u textures, %.2f MB at their tails, %.2f MB whole, %.2f MB budget (halved at frame %u)\n", BENCH_STREAM_TEXTURES,
+           scene->tail_bytes / (1024.0 * 1024.0), scene->full_bytes / (1024.0 * 1024.0), streamer->budget * 2 / (1024.0 * 1024.0), frames / 2);
+    printf("  %u frames, %.2f MB peak resident, %.2f MB asked for in the last, %.3f us per update\n", frames, peak_bytes / (1024.0 * 1024.0),
+           streamer->stats.wanted_bytes / (1024.0 * 1024.0), frames > 0 ? update_ms * 1000.0 / frames : 0.0);
+    printf("  %u loads (%.2f MB, %u failed, %u clamped), %u evictions (%.2f MB)\n", streamer->stats.loads, streamer->stats.bytes_loaded / (1024.0 * 1024.0),
+           streamer->stats.failed_loads, streamer->stats.clamped_loads, streamer->stats.evictions, streamer->stats.bytes_evicted / (1024.0 * 1024.0));
+
+    delete scene;
+    delete streamer;
+}
+
+static bool add_texture(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, uint64_t *out_tail_bytes, uint64_t *out_full_bytes) {
+    uint64_t mip_bytes[STREAMER_MAX_MIPS];
+    uint32_t mip_count = mip_file::get_mip_count(width, height);
+    uint32_t tail_mip = mip_count - 1;
+    for (uint32_t mip = 0; mip < mip_count; ++mip) {
+        uint32_t mip_width = width >> mip ? width >> mip : 1;
+        uint32_t mip_height = height >> mip ? height >> mip : 1;
+        mip_bytes[mip] = (uint64_t)mip_width * mip_height * 4;
+        if (mip < tail_mip && mip_width <= BENCH_STREAM_TAIL_SIZE && mip_height <= BENCH_STREAM_TAIL_SIZE) {
+            tail_mip = mip;
+        }
+    }
+
+    if (!texture_streamer::add(streamer, texture, width, height, mip_bytes, mip_count, tail_mip)) {
+        return false;
+    }
+    *out_tail_bytes += texture_streamer::get_bytes(streamer, texture, tail_mip);
+    *out_full_bytes += texture_streamer::get_bytes(streamer, texture, 0);
+    return true;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace streaming_bench {
+
+// Streams a scene of textures four times the budget for n frames with a moving
+// camera, slow and failing loads and the budget halved halfway, and times the
+// streamer's updates. Only timing, the mip_file and texture_streamer suites in
+// tests check the files, the LRU and the budget. CPU only, no device needed.
+void run(uint32_t frames);
+
+} // namespace streaming_bench
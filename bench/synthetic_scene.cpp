@@ -0,0 +1,183 @@
+#include "synthetic_scene.hpp"
+
+#include "id.hpp"
+#include "light.hpp"
+#include "logger.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+
+#include <DirectXMath.h>
+#include <cassert>
+#include <cmath>
+
+#define SPHERE_RINGS 16
+#define SPHERE_SEGMENTS 32
+#define SPHERE_VERTEX_COUNT ((SPHERE_RINGS + 1) * (SPHERE_SEGMENTS + 1))
+#define SPHERE_INDEX_COUNT (SPHERE_RINGS * SPHERE_SEGMENTS * 6)
+
+#define GRID_SPACING 2.5f
+#define LIGHT_DISTANCE 100.0f
+
+static MeshId create_sphere_mesh();
+static uint32_t next_random(uint32_t *state);
+static float random_range(uint32_t *state, float min, float max);
+
+bool synthetic_scene::generate(Scene *scene, const SyntheticSceneDesc *desc) {
+    assert(scene && desc && "synthetic_scene::generate: scene and desc pointers cannot be NULL");
+
+    // xorshift can't start from 0
+    uint32_t rng = desc->seed ? desc->seed : 0x9E3779B9u;
+
+    MeshId sphere = create_sphere_mesh();
+    if (id::is_invalid(sphere)) {
+        LOG("%s: Couldn't create the sphere mesh", __func__);
+        return false;
+    }
+
+    // Materials -- only values, no textures, so every material is a distinct bind
+    MaterialId materials[MAX_MATERIALS];
+    uint32_t material_count = 0;
+    for (uint32_t i = 0; i < desc->material_count && material_count < MAX_MATERIALS; ++i) {
+        DirectX::XMFLOAT3 albedo(random_range(&rng, 0.05f, 1.0f), random_range(&rng, 0.05f, 1.0f), random_range(&rng, 0.05f, 1.0f));
+        float metallic = random_range(&rng, 0.0f, 1.0f) > 0.5f ? 1.0f : 0.0f;
+        float roughness = random_range(&rng, 0.05f, 1.0f);
+        float coat = random_range(&rng, 0.0f, 1.0f) > 0.8f ? 1.0f : 0.0f;
+
+        MaterialId mat = material::create(albedo, id::invalid(), metallic, id::invalid(), roughness, id::invalid(), coat, id::invalid(), id::invalid(), 0.0f, id::invalid());
+        if (id::is_invalid(mat)) {
+            break;
+        }
+        materials[material_count++] = mat;
+    }
+
+    if (material_count == 0) {
+        LOG("%s: Couldn't create any materials", __func__);
+        return false;
+    }
+
+    // Instances on a square grid around the origin
+    uint32_t side = (uint32_t)ceilf(sqrtf((float)desc->instance_count));
+    float half_extent = (side - 1) * GRID_SPACING * 0.5f;
+    uint32_t instance_count = 0;
+    for (uint32_t i = 0; i < desc->instance_count; ++i) {
+        DirectX::XMFLOAT3 position((i % side) * GRID_SPACING - half_extent, 1.0f, (i / side) * GRID_SPACING - half_extent);
+        DirectX::XMFLOAT3 rotation(random_range(&rng, 0.0f, DirectX::XM_2PI), random_range(&rng, 0.0f, DirectX::XM_2PI), 0.0f);
+        float s = random_range(&rng, 0.6f, 1.2f);
+        DirectX::XMFLOAT3 scale(s, s, s);
+
+        // Random material per instance, so draws don't come sorted by material
+        MaterialId mat = materials[next_random(&rng) % material_count];
+        SceneId mesh = scene::add_mesh(scene, sphere, mat, position, rotation, scale);
+        if (id::is_invalid(mesh)) {
+            break;
+        }
+
+        // Every eighth instance goes on the dynamic shadow layer
+        scene::mesh_set_static(scene, mesh, i % 8 != 0);
+        instance_count++;
+    }
+
+    // One shadow casting sun, the rest are point and spot lights scattered
+    // over the grid so the clustered culling has something to chew on.
+    // Spot lights cast shadows too, they compete for the atlas.
+    uint32_t light_count = 0;
+    for (uint32_t i = 0; i < desc->light_count; ++i) {
+        DirectX::XMFLOAT3 color(random_range(&rng, 0.5f, 1.0f), random_range(&rng, 0.5f, 1.0f), random_range(&rng, 0.5f, 1.0f));
+        DirectX::XMFLOAT3 position;
+        DirectX::XMFLOAT3 target(0.0f, 0.0f, 0.0f);
+        LightId light;
+        bool cast_shadows = false;
+
+        if (i == 0) {
+            float azimuth = random_range(&rng, 0.0f, DirectX::XM_2PI);
+            float elevation = random_range(&rng, 0.5f, 1.4f);
+            position = DirectX::XMFLOAT3(
+                LIGHT_DISTANCE * cosf(elevation) * cosf(azimuth),
+                LIGHT_DISTANCE * sinf(elevation),
+                LIGHT_DISTANCE * cosf(elevation) * sinf(azimuth));
+            light = light::create(LIGHT_TYPE_DIRECTIONAL, color, 1.0f);
+            cast_shadows = true;
+        } else {
+            float extent = half_extent + GRID_SPACING;
+            position = DirectX::XMFLOAT3(random_range(&rng, -extent, extent), random_range(&rng, 2.0f, 4.0f), random_range(&rng, -extent, extent));
+            float range = random_range(&rng, 3.0f, 8.0f);
+
+            if (next_random(&rng) % 2) {
+                light = light::create_point(color, 20.0f, range);
+            } else {
+                target = DirectX::XMFLOAT3(position.x + random_range(&rng, -1.0f, 1.0f), 0.0f, position.z + random_range(&rng, -1.0f, 1.0f));
+                float outer = random_range(&rng, 0.3f, 0.8f);
+                light = light::create_spot(color, 40.0f, range * 1.5f, outer * 0.7f, outer);
+                cast_shadows = true;
+            }
+        }
+
+        if (id::is_invalid(light) || id::is_invalid(scene::add_light(scene, light, position, target, cast_shadows))) {
+            break;
+        }
+        light_count++;
+    }
+
+    if (instance_count < desc->instance_count || material_count < desc->material_count || light_count < desc->light_count) {
+        LOG("%s: Clamped to engine limits, got %u instances, %u materials, %u lights", __func__, instance_count, material_count, light_count);
+    }
+
+    return true;
+}
+
+static MeshId create_sphere_mesh() {
+    static Vertex vertices[SPHERE_VERTEX_COUNT];
+    static uint32_t indices[SPHERE_INDEX_COUNT];
+
+    uint32_t v = 0;
+    for (uint32_t r = 0; r <= SPHERE_RINGS; ++r) {
+        float theta = (float)r / SPHERE_RINGS * DirectX::XM_PI;
+        for (uint32_t s = 0; s <= SPHERE_SEGMENTS; ++s) {
+            float phi = (float)s / SPHERE_SEGMENTS * DirectX::XM_2PI;
+            DirectX::XMFLOAT3 p(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+
+            vertices[v].position = p;
+            vertices[v].normal = p;
+            vertices[v].texCoord = DirectX::XMFLOAT2((float)s / SPHERE_SEGMENTS, (float)r / SPHERE_RINGS);
+            vertices[v].tangent = DirectX::XMFLOAT4(-sinf(phi), 0.0f, cosf(phi), 1.0f);
+            v++;
+        }
+    }
+
+    // Clockwise winding when looking from the outside
+    uint32_t i = 0;
+    for (uint32_t r = 0; r < SPHERE_RINGS; ++r) {
+        for (uint32_t s = 0; s < SPHERE_SEGMENTS; ++s) {
+            uint32_t a = r * (SPHERE_SEGMENTS + 1) + s;
+            uint32_t b = a + 1;
+            uint32_t c = a + (SPHERE_SEGMENTS + 1);
+            uint32_t d = c + 1;
+
+            indices[i++] = a;
+            indices[i++] = b;
+            indices[i++] = d;
+            indices[i++] = a;
+            indices[i++] = d;
+            indices[i++] = c;
+        }
+    }
+
+    return mesh::load_from_data(vertices, SPHERE_VERTEX_COUNT, indices, SPHERE_INDEX_COUNT);
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32, good enough and identical on every platform
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float random_range(uint32_t *state, float min, float max) {
+    float t = (next_random(state) >> 8) * (1.0f / 16777216.0f);
+    return min + (max - min) * t;
+}
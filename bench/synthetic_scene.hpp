@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+struct Scene;
+
+struct SyntheticSceneDesc {
+    uint32_t instance_count;
+    uint32_t material_count;
+    uint32_t light_count;
+    uint32_t seed;
+};
+
+namespace synthetic_scene {
+
+// Fills the scene with a grid of spheres, each picking one of material_count
+// procedural materials, plus a shadow casting sun and light_count - 1 point/spot
+// lights. Counts are clamped to what the engine can hold. Same seed -> same scene.
+bool generate(Scene *scene, const SyntheticSceneDesc *desc);
+
+} // namespace synthetic_scene
@@ -1,21 +1,45 @@
 #include "application.hpp"
 
+#include "arena.hpp"
+#include "file_watcher.hpp"
+#include "frame_pacer.hpp"
 #include "id.hpp"
-#include "idmap.hpp"
 #include "input.hpp"
 #include "light.hpp"
 #include "logger.hpp"
 #include "material.hpp"
+#include "memory_tracker.hpp"
 #include "mesh.hpp"
+#include "render_snapshot.hpp"
 #include "renderer.hpp"
+#include "replay.hpp"
 #include "scene.hpp"
+#include "scene_diff.hpp"
+#include "scene_file.hpp"
 #include "texture.hpp"
+#include "vfs.hpp"
 
 #include <DirectXMath.h>
-#include <cJSON.h>
+#include <cstdio>
+#include <cstring>
 
 static AppState *pState = nullptr;
 
+static void pump_input();
+static void step(float dt);
+static void publish(float alpha);
+static void render_latest();
+static void render_thread_main();
+static void start_render_thread();
+static void stop_render_thread();
+static bool apply_config(const SceneFile *file, const SceneDiff *diff, Arena *arena);
+static MaterialId set_material(const SceneFileMaterial *mat, const Id *texture_ids, MaterialId existing);
+static Scene *get_config_scene(const LoadedConfig *loaded, uint32_t scene);
+static uint32_t find_scene(const SceneFile *file, uint32_t instance);
+static void watch_config(const char *path);
+static void poll_config();
+static void log_over_budget(void *user_data, MemoryTag tag, MemoryDomain domain, uint64_t bytes, uint64_t budget);
+
 // TEMP: Temp storage of some reused id's...
 SceneId main_mesh = id::invalid();
 SceneId default_cam = id::invalid();
@@ -33,6 +57,44 @@ bool application::initialize(ApplicationConfig config) {
     for (int i = 0; i < MAX_SCENES; ++i) {
         pState->scenes[i].id = id::invalid();
     }
+    pState->active_scene = nullptr;
+    pState->replay = nullptr;
+    pState->time = 0.0f;
+    pState->tick = 0;
+    pState->previous_camera.id = id::invalid();
+    pState->is_render_stopping.store(false);
+    pState->render_thread_done = nullptr;
+    pState->loaded_config = {};
+    pState->config_watcher.active = false;
+    render_snapshot::initialize(&pState->snapshots);
+    frame_pacer::initialize(&pState->pacer, frame_pacer::system_clock(), APP_FIXED_TIMESTEP, config.max_fps, 0);
+    frame_pacer::reset_present_stats(&pState->present_stats);
+
+    // Before anything allocates, so the first one over is caught
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t t = 0; t < MEMORY_TAG_COUNT; ++t) {
+            memory_tracker::set_budget((MemoryTag)t, (MemoryDomain)d, config.memory_budgets[d][t]);
+        }
+    }
+    memory_tracker::set_budget_callback(log_over_budget, nullptr);
+
+    // Initialize the jobs first, everything after can hand work to them
+    if (!job_system::initialize(&pState->jobs, config.job_threads)) {
+        LOG("Application error: Couldn't start the job system");
+        return false;
+    }
+
+    // A config is loaded into one while the other has the loaded one
+    if (!arena::initialize(&pState->loaded_config.arenas[0], APP_CONFIG_ARENA_RESERVE) ||
+        !arena::initialize(&pState->loaded_config.arenas[1], APP_CONFIG_ARENA_RESERVE)) {
+        LOG("Application error: Couldn't reserve the scene config arenas");
+        return false;
+    }
+
+    // Before anything loads, a missing pack only means loose files
+    if (config.pack_path) {
+        vfs::mount(config.pack_path);
+    }
 
     // Initialize the Window
     if (!window::create(config.window_title, config.window_width, config.window_height, &pState->window)) {
@@ -40,6 +102,13 @@ bool application::initialize(ApplicationConfig config) {
         return false;
     }
 
+    // Manual reset, start_render_thread resets it
+    pState->render_thread_done = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!pState->render_thread_done) {
+        LOG("Application error: Couldn't create the render thread's event");
+        return false;
+    }
+
     // Initialize the Input system
     if (!input::initialize(&pState->input)) {
         LOG("Application error: Couldn't initialize input system");
@@ -47,12 +116,39 @@ bool application::initialize(ApplicationConfig config) {
     }
 
     // Initialize the renderer
+    pState->renderer.serial_shaders = config.serial_shaders;
+    pState->renderer.shader_cache_enabled = !config.no_shader_cache;
+    pState->renderer.shader_hot_reload = config.shader_hot_reload;
+    pState->renderer.jobs = &pState->jobs;
+    pState->renderer.max_frames_in_flight = config.max_frames_in_flight;
+    pState->renderer.texture_stream_budget = config.texture_stream_budget;
+    pState->renderer.asset_content_hash = config.asset_content_hash;
     if (!renderer::initialize(&pState->renderer, &pState->window)) {
         LOG("Application error: Couldn't initialize renderer");
         return false;
     }
-
-    deserialize_config();
+    pState->renderer.present_interval = config.no_vsync ? 0 : 1;
+    // Cameras start out at 16:9, only a different size changes them
+    pState->camera_width = config.window_width;
+    pState->camera_height = config.window_height;
+
+    if (config.scene_path) {
+        if (!deserialize_config(config.scene_path)) {
+            LOG("Application error: Couldn't load scene config %s", config.scene_path);
+            return false;
+        }
+        if (config.config_hot_reload) {
+            watch_config(config.scene_path);
+        }
+    } else {
+        // Nothing to load, so just an empty scene with a camera looking at the origin
+        Id empty_scene = add_scene();
+        if (id::is_invalid(empty_scene)) {
+            LOG("Application error: Couldn't create an empty scene");
+            return false;
+        }
+        scene::add_camera(&pState->scenes[empty_scene.id], 45.0f, 0.1f, 500.0f, DirectX::XMFLOAT3(0.0f, 5.0f, -15.0f), DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+    }
 
     // HACK: Adding a directional light here to test
     LightId dir_light = light::create(LIGHT_TYPE_DIRECTIONAL, DirectX::XMFLOAT3(1, 1, 1), 1.0);
@@ -77,7 +173,18 @@ bool application::initialize(ApplicationConfig config) {
 
 void application::shutdown() {
     if (pState) {
+        memory_tracker::dump();
+        file_watcher::shutdown(&pState->config_watcher);
+        renderer::shutdown(&pState->renderer);
         window::destroy(&pState->window);
+        if (pState->render_thread_done) {
+            CloseHandle(pState->render_thread_done);
+        }
+        job_system::shutdown(&pState->jobs);
+        // Nothing loads anymore, stored files pointed into it
+        vfs::unmount();
+        arena::shutdown(&pState->loaded_config.arenas[0]);
+        arena::shutdown(&pState->loaded_config.arenas[1]);
 
         delete pState;
     }
@@ -87,7 +194,15 @@ void application::shutdown() {
 // TODO: move these away or something
 #define DEG2RAD (DirectX::XM_PI / 180.0f)
 static bool should_rotate = false;
-void application::update() {
+void application::update(float dt) {
+    pState->time += dt;
+
+    // Playing back a recorded path, input is ignored completely so runs are repeatable
+    if (pState->replay && !pState->replay->is_recording) {
+        replay::apply(pState->replay, pState->time, &pState->scenes[0]);
+        return;
+    }
+
     if (input::is_key_pressed(KEY_R)) {
         should_rotate = should_rotate ? false : true;
     }
@@ -136,203 +251,100 @@ void application::update() {
         float yaw = scene::camera_get_yaw(&pState->scenes[0], pState->scenes[0].active_cam->id);
         float pitch = scene::camera_get_pitch(&pState->scenes[0], pState->scenes[0].active_cam->id);
 
-        // Apply yaw
-        yaw += 0.8f * 0.01f;
+        // Apply yaw, per second so it's the same at any step length
+        yaw += 0.48f * dt;
 
         // Set the new yaw and pitch
         scene::camera_set_yaw_pitch(&pState->scenes[0], pState->scenes[0].active_cam->id, yaw, pitch);
     }
+
+    if (pState->replay) {
+        replay::record(pState->replay, pState->time, &pState->scenes[0]);
+    }
+}
+
+void application::frame(float dt) {
+    // A single step of exactly dt, nothing to interpolate
+    poll_config();
+    pump_input();
+    step(dt);
+    publish(1.0f);
+    render_latest();
 }
 
 void application::run() {
     if (!pState)
         return;
 
-    while (!window::should_close(&pState->window)) {
-        // TODO: Maybe this is better to be in a different "platform"
-        // namespace, or just completely in a different unit...
-        window::proc_messages();
+    bool is_threaded = pState->config.threaded_render;
+    if (is_threaded) {
+        start_render_thread();
+
+        // Without a limit the loop would spin publishing the same steps over
+        // and over, a snapshot per step is as much as there is to draw
+        if (pState->pacer.min_frame_ns == 0) {
+            pState->pacer.min_frame_ns = pState->pacer.step_ns;
+        }
+    }
 
-        update();
+    FramePacer *pacer = &pState->pacer;
+    while (!window::should_close(&pState->window)) {
+        uint32_t steps = frame_pacer::begin_frame(pacer);
+        poll_config();
+        pump_input();
+        for (uint32_t i = 0; i < steps; ++i) {
+            step(APP_FIXED_TIMESTEP);
+        }
+        publish(frame_pacer::get_alpha(pacer));
 
-        renderer::begin_frame(&pState->renderer, &pState->scenes[0]);
-        renderer::render(&pState->renderer, &pState->scenes[0]);
-        renderer::end_frame(&pState->renderer);
+        if (!is_threaded) {
+            render_latest();
+        }
+        frame_pacer::end_frame(pacer);
+    }
 
-        input::swap_buffers(&pState->input);
+    if (is_threaded) {
+        stop_render_thread();
     }
 
-    // Shutdown here...
+    frame_pacer::log_stats(pacer, &pState->present_stats);
     shutdown();
 }
 
-bool application::deserialize_config() {
-    // Load config file
-    FILE *cfg_file = fopen("assets/config.json", "rb");
-    if (!cfg_file) {
-        LOG("application::deserialize_config: Couldn't open the config file: config.json");
+bool application::deserialize_config(const char *path) {
+    // Into the arena the loaded config isn't in, that one is still diffed against
+    LoadedConfig *loaded = &pState->loaded_config;
+    Arena *arena = &loaded->arenas[loaded->current ^ 1];
+    arena::reset(arena);
+    SceneFile file = {};
+    if (!scene_file::read(path, arena, &file)) {
+        LOG("application::deserialize_config: Couldn't load the config file: %s", path);
         return false;
     }
 
-    fseek(cfg_file, 0, SEEK_END);
-    size_t length = ftell(cfg_file);
-    fseek(cfg_file, 0, SEEK_SET);
-    char *cfg = (char *)malloc(length + 1);
-    if (!cfg) {
-        LOG("application::deserialize_config: Something went wrong");
+    // Nothing loaded yet adds everything
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    SceneDiff diff = {};
+    if (!scene_diff::compute(loaded->is_loaded ? &loaded->file : nullptr, &file, scratch, &diff)) {
+        LOG("application::deserialize_config: Couldn't compare %s with what's loaded", path);
+        arena::rewind(scratch, marker);
         return false;
     }
-
-    fread(cfg, 1, length, cfg_file);
-    fclose(cfg_file);
-    cfg[length] = '\0';
-
-    // Map to keep track of the json id -> asset id
-    IdMap tex_map;
-    IdMap mesh_map;
-    IdMap mat_map;
-
-    // Parse JSON string
-    cJSON *root = cJSON_Parse(cfg);
-    assert(root);
-
-    // Parse textures
-    cJSON *textures = cJSON_GetObjectItem(root, "textures");
-    cJSON *tex = nullptr;
-    cJSON_ArrayForEach(tex, textures) {
-        int id = cJSON_GetObjectItem(tex, "id")->valueint;
-        const char *path = cJSON_GetObjectItem(tex, "path")->valuestring;
-        bool srgb = cJSON_GetObjectItem(tex, "srgb")->valueint;
-        TextureId tex_id = texture::load(path, srgb);
-        idmap::add(&tex_map, id, tex_id);
-    }
-
-    // Parse materials
-    cJSON *materials = cJSON_GetObjectItem(root, "materials");
-    cJSON *mat = nullptr;
-    cJSON_ArrayForEach(mat, materials) {
-        int id = cJSON_GetObjectItem(mat, "id")->valueint;
-        cJSON *albedo_color = cJSON_GetObjectItem(mat, "albedo");
-        float roughness = cJSON_GetObjectItem(mat, "roughness")->valuedouble;
-        float coat = cJSON_GetObjectItem(mat, "coat")->valuedouble;
-        float metallic = cJSON_GetObjectItem(mat, "metallic")->valuedouble;
-        float emission_intensity = cJSON_GetObjectItem(mat, "emission")->valuedouble;
-
-        DirectX::XMFLOAT3 albedo(
-            cJSON_GetArrayItem(albedo_color, 0)->valuedouble,
-            cJSON_GetArrayItem(albedo_color, 1)->valuedouble,
-            cJSON_GetArrayItem(albedo_color, 2)->valuedouble, );
-
-        // Get the texture values
-        int albedo_tex_value = cJSON_GetObjectItem(mat, "albedo_map")->valueint;
-        int metallic_tex_value = cJSON_GetObjectItem(mat, "metallic_map")->valueint;
-        int roughness_tex_value = cJSON_GetObjectItem(mat, "roughness_map")->valueint;
-        int coat_tex_value = cJSON_GetObjectItem(mat, "coat_map")->valueint;
-        int normal_tex_value = cJSON_GetObjectItem(mat, "normal_map")->valueint;
-        int emission_tex_value = cJSON_GetObjectItem(mat, "emission_map")->valueint;
-
-        // If the texture value is -1 (or less than 0), we fetch the appropriate default texture instead
-        Id albedo_tex = albedo_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, albedo_tex_value);
-        Id metallic_tex = metallic_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, metallic_tex_value);
-        Id roughness_tex = roughness_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, roughness_tex_value);
-        Id coat_tex = coat_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, coat_tex_value);
-        Id normal_tex = normal_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, normal_tex_value);
-        Id emission_tex = emission_tex_value < 0 ? id::invalid() : idmap::get(&tex_map, emission_tex_value);
-
-        Id mat_id = material::create(
-            albedo,
-            albedo_tex,
-            metallic,
-            metallic_tex,
-            roughness,
-            roughness_tex,
-            coat,
-            coat_tex,
-            normal_tex,
-            emission_intensity,
-            emission_tex);
-
-        idmap::add(&mat_map, id, mat_id);
-    }
-
-    // Parse meshes
-    cJSON *meshes = cJSON_GetObjectItem(root, "meshes");
-    cJSON *mesh = nullptr;
-    cJSON_ArrayForEach(mesh, meshes) {
-        int id = cJSON_GetObjectItem(mesh, "id")->valueint;
-        const char *path = cJSON_GetObjectItem(mesh, "path")->valuestring;
-        Id mesh_id = mesh::load(path);
-        idmap::add(&mesh_map, id, mesh_id);
-    }
-
-    // Parse scene with their instances
-    cJSON *scenes = cJSON_GetObjectItem(root, "scenes");
-    cJSON *scene = nullptr;
-    cJSON_ArrayForEach(scene, scenes) {
-        Id new_scene = add_scene();
-        if (id::is_invalid(new_scene)) {
-            LOG("application::deserialize_config: Couldn't create new scene");
-            free(cfg);
-            return false;
-        }
-
-        // Parse cameras
-        cJSON *cameras = cJSON_GetObjectItem(scene, "cameras");
-        cJSON *cam = nullptr;
-        cJSON_ArrayForEach(cam, cameras) {
-            cJSON *cam_pos = cJSON_GetObjectItem(cam, "position");
-            cJSON *cam_tar = cJSON_GetObjectItem(cam, "target");
-            float fov = cJSON_GetObjectItem(cam, "fov")->valuedouble;
-            float znear = cJSON_GetObjectItem(cam, "znear")->valuedouble;
-            float zfar = cJSON_GetObjectItem(cam, "zfar")->valuedouble;
-
-            DirectX::XMFLOAT3 cam_pos_vec(
-                (float)cJSON_GetArrayItem(cam_pos, 0)->valuedouble,
-                (float)cJSON_GetArrayItem(cam_pos, 1)->valuedouble,
-                (float)cJSON_GetArrayItem(cam_pos, 2)->valuedouble);
-            DirectX::XMFLOAT3 cam_pos_tar(
-                (float)cJSON_GetArrayItem(cam_tar, 0)->valuedouble,
-                (float)cJSON_GetArrayItem(cam_tar, 1)->valuedouble,
-                (float)cJSON_GetArrayItem(cam_tar, 2)->valuedouble);
-
-            scene::add_camera(&pState->scenes[new_scene.id], fov, znear, zfar, cam_pos_vec, cam_pos_tar);
-        }
-
-        // Parse mesh instances
-        cJSON *mesh_instances = cJSON_GetObjectItem(scene, "meshes");
-        cJSON *mi = nullptr;
-        cJSON_ArrayForEach(mi, mesh_instances) {
-            cJSON *m_pos = cJSON_GetObjectItem(mi, "position");
-            cJSON *m_rot = cJSON_GetObjectItem(mi, "rotation");
-            cJSON *m_scl = cJSON_GetObjectItem(mi, "scale");
-
-            DirectX::XMFLOAT3 mi_position(
-                cJSON_GetArrayItem(m_pos, 0)->valuedouble,
-                cJSON_GetArrayItem(m_pos, 1)->valuedouble,
-                cJSON_GetArrayItem(m_pos, 2)->valuedouble);
-
-            DirectX::XMFLOAT3 mi_rotation(
-                cJSON_GetArrayItem(m_rot, 0)->valuedouble,
-                cJSON_GetArrayItem(m_rot, 1)->valuedouble,
-                cJSON_GetArrayItem(m_rot, 2)->valuedouble);
-
-            DirectX::XMFLOAT3 mi_scale(
-                cJSON_GetArrayItem(m_scl, 0)->valuedouble,
-                cJSON_GetArrayItem(m_scl, 1)->valuedouble,
-                cJSON_GetArrayItem(m_scl, 2)->valuedouble);
-
-            scene::add_mesh(
-                &pState->scenes[new_scene.id],
-                idmap::get(&mesh_map, cJSON_GetObjectItem(mi, "mesh_id")->valueint),
-                idmap::get(&mat_map, cJSON_GetObjectItem(mi, "material_id")->valueint),
-                mi_position, mi_rotation, mi_scale);
-        }
+    if (loaded->is_loaded && scene_diff::is_empty(&diff)) {
+        arena::rewind(scratch, marker);
+        return true;
     }
 
-    free(cfg);
-    cJSON_Delete(root);
-
-    return true;
+    bool ok = apply_config(&file, &diff, arena);
+    if (ok && loaded->is_loaded) {
+        LOG("Application: Reloaded %s, changed %u/%u textures, %u/%u meshes, %u/%u materials and %u/%u instances, removed %u, %u, %u and %u",
+            path, diff.textures.changed_count, diff.textures.count, diff.meshes.changed_count, diff.meshes.count,
+            diff.materials.changed_count, diff.materials.count, diff.instances.changed_count, diff.instances.count,
+            diff.textures.removed_count, diff.meshes.removed_count, diff.materials.removed_count, diff.instances.removed_count);
+    }
+    arena::rewind(scratch, marker);
+    return ok;
 }
 
 Id application::add_scene() {
@@ -379,6 +391,100 @@ void application::set_active_scene(Id scene) {
     }
 }
 
+void application::set_replay(Replay *replay) {
+    assert(pState && "application::set_replay: Application has not been started properly, or is in a corrupted state");
+    pState->replay = replay;
+    pState->time = 0.0f;
+}
+
+Window *application::get_window() {
+    return &pState->window;
+}
+
+static void pump_input() {
+    // TODO: Maybe this is better to be in a different "platform"
+    // namespace, or just completely in a different unit...
+    window::proc_messages();
+    pState->snapshots.slots[pState->snapshots.back].input_ns = frame_pacer::now(&pState->pacer);
+
+    // The camera follows the window, the renderer resizes its targets once the snapshot gets there
+    Window *window = &pState->window;
+    Scene *scene = &pState->scenes[0];
+    if (window->width > 0 && window->height > 0 && (window->width != pState->camera_width || window->height != pState->camera_height)) {
+        if (scene->active_cam) {
+            scene::camera_set_active_aspect_ratio(scene, window->width / (float)window->height);
+        }
+        pState->camera_width = window->width;
+        pState->camera_height = window->height;
+    }
+}
+
+static void step(float dt) {
+    Scene *scene = &pState->scenes[0];
+    if (scene->active_cam) {
+        pState->previous_camera = *scene->active_cam;
+    } else {
+        pState->previous_camera.id = id::invalid();
+    }
+
+    application::update(dt);
+    pState->tick++;
+
+    // Whatever came in is used up by the first step, the others see no new input
+    input::swap_buffers(&pState->input);
+}
+
+static void publish(float alpha) {
+    Window *window = &pState->window;
+    RenderSnapshot *snapshot = render_snapshot::capture(&pState->snapshots, &pState->scenes[0]);
+    snapshot->tick = pState->tick;
+    snapshot->time = pState->time;
+    snapshot->width = window->width;
+    snapshot->height = window->height;
+    render_snapshot::interpolate_camera(snapshot, &pState->previous_camera, alpha);
+    render_snapshot::publish(&pState->snapshots);
+}
+
+static void render_latest() {
+    RenderSnapshot *snapshot = render_snapshot::acquire(&pState->snapshots);
+    if (!snapshot) {
+        return;
+    }
+
+    // 0 by 0 while minimized, the targets stay as they are
+    Renderer *renderer = &pState->renderer;
+    if (snapshot->width > 0 && snapshot->height > 0 && (snapshot->width != renderer->width || snapshot->height != renderer->height)) {
+        renderer::on_window_resize(renderer, snapshot->width, snapshot->height);
+    }
+
+    renderer::begin_frame(renderer, &snapshot->scene);
+    renderer::render(renderer, &snapshot->scene);
+    renderer::end_frame(renderer);
+
+    frame_pacer::record_present(&pState->present_stats, snapshot->input_ns, frame_pacer::now(&pState->pacer));
+}
+
+static void render_thread_main() {
+    job_system::acquire_main_thread(&pState->jobs);
+
+    // Draws the latest snapshot whenever there's a new one, older ones are skipped
+    uint32_t seen = 0;
+    for (;;) {
+        seen = render_snapshot::wait(&pState->snapshots, seen);
+        if (pState->is_render_stopping.load()) {
+            break;
+        }
+        render_latest();
+    }
+
+    job_system::release_main_thread(&pState->jobs);
+    SetEvent(pState->render_thread_done);
+}
+
+JobSystem *application::get_job_system() {
+    return &pState->jobs;
+}
+
 Renderer *application::get_renderer() {
     return &pState->renderer;
 }
@@ -386,3 +492,268 @@ Renderer *application::get_renderer() {
 Scene *application::get_scenes() {
     return pState->scenes;
 }
+
+static void log_over_budget(void *user_data, MemoryTag tag, MemoryDomain domain, uint64_t bytes, uint64_t budget) {
+    (void)user_data;
+    LOG("Application warning: %s %s went over budget, %.2f of %.2f MB", domain == MEMORY_DOMAIN_GPU ? "GPU" : "CPU",
+        memory_tracker::tag_name(tag), bytes / 1048576.0, budget / 1048576.0);
+}
+
+static void start_render_thread() {
+    // The render thread does all the device work from here on, main thread jobs included
+    pState->is_render_stopping.store(false);
+    ResetEvent(pState->render_thread_done);
+    job_system::release_main_thread(&pState->jobs);
+    pState->render_thread = std::thread(render_thread_main);
+}
+
+static void stop_render_thread() {
+    pState->is_render_stopping.store(true);
+    render_snapshot::interrupt(&pState->snapshots);
+
+    // Present can wait on this thread's messages (a resize, leaving
+    // fullscreen), so they're handled until the render thread is out
+    for (;;) {
+        DWORD result = MsgWaitForMultipleObjects(1, &pState->render_thread_done, FALSE, INFINITE, QS_ALLINPUT);
+        if (result != WAIT_OBJECT_0 + 1) {
+            break;
+        }
+        window::proc_messages();
+    }
+    pState->render_thread.join();
+    job_system::acquire_main_thread(&pState->jobs);
+}
+
+static bool apply_config(const SceneFile *file, const SceneDiff *diff, Arena *arena) {
+    LoadedConfig *loaded = &pState->loaded_config;
+    const SceneFile *old_file = &loaded->file;
+    const SceneFileHeader *header = file->header;
+
+    // What each index of the new file becomes, next to it in its arena
+    Id *texture_ids = ARENA_PUSH_ARRAY(arena, Id, header->texture_count);
+    Id *material_ids = ARENA_PUSH_ARRAY(arena, Id, header->material_count);
+    Id *mesh_ids = ARENA_PUSH_ARRAY(arena, Id, header->mesh_count);
+    SceneId *instance_ids = ARENA_PUSH_ARRAY(arena, SceneId, header->instance_count);
+    SceneId *scene_ids = ARENA_PUSH_ARRAY(arena, SceneId, header->scene_count);
+    if (!texture_ids || !material_ids || !mesh_ids || !instance_ids || !scene_ids) {
+        LOG("%s: No room for the ids of the config", __func__);
+        return false;
+    }
+
+    // Instances go first, nothing that's released below is drawn after
+    for (uint32_t r = 0; r < diff->instances.removed_count; ++r) {
+        uint32_t old = diff->instances.removed[r];
+        Scene *scene = get_config_scene(loaded, find_scene(old_file, old));
+        if (scene) {
+            scene::remove_mesh(scene, loaded->instance_ids[old]);
+        }
+    }
+
+    // Drawn with the fallback until the file is decoded, the scene shows up right away
+    // Loaded once however many ids name the same file
+    bool is_streamed = pState->config.texture_stream_budget > 0;
+    for (uint32_t i = 0; i < header->texture_count; ++i) {
+        const SceneFileTexture *tex = &file->textures[i];
+        texture_ids[i] = diff->textures.actions[i] == SCENE_DIFF_KEEP
+                             ? loaded->texture_ids[diff->textures.sources[i]]
+                             : texture::acquire(scene_file::get_string(file, tex->path_offset), tex->is_srgb != 0, is_streamed).id;
+    }
+
+    for (uint32_t i = 0; i < header->mesh_count; ++i) {
+        mesh_ids[i] = diff->meshes.actions[i] == SCENE_DIFF_KEEP
+                          ? loaded->mesh_ids[diff->meshes.sources[i]]
+                          : mesh::acquire(scene_file::get_string(file, file->meshes[i].path_offset)).id;
+    }
+
+    // Changed materials keep their ids, the instances using them don't notice
+    for (uint32_t i = 0; i < header->material_count; ++i) {
+        SceneDiffAction action = diff->materials.actions[i];
+        MaterialId existing = action == SCENE_DIFF_ADD ? id::invalid() : loaded->material_ids[diff->materials.sources[i]];
+        material_ids[i] = action == SCENE_DIFF_KEEP ? existing : set_material(&file->materials[i], texture_ids, existing);
+    }
+    for (uint32_t r = 0; r < diff->materials.removed_count; ++r) {
+        material::destroy(loaded->material_ids[diff->materials.removed[r]]);
+    }
+
+    // Scenes are kept by index, one that's gone keeps its cameras until a restart
+    uint32_t old_scene_count = loaded->is_loaded ? old_file->header->scene_count : 0;
+    for (uint32_t s = 0; s < header->scene_count; ++s) {
+        if (s < old_scene_count) {
+            scene_ids[s] = loaded->scene_ids[s];
+            continue;
+        }
+
+        const SceneFileScene *scene = &file->scenes[s];
+        scene_ids[s] = application::add_scene();
+        if (id::is_invalid(scene_ids[s])) {
+            LOG("%s: Couldn't create scene %u, it's left out", __func__, s);
+            continue;
+        }
+        for (uint32_t c = 0; c < scene->camera_count; ++c) {
+            const SceneFileCamera *cam = &file->cameras[scene->first_camera + c];
+            scene::add_camera(&pState->scenes[scene_ids[s].id], cam->fov, cam->znear, cam->zfar, DirectX::XMFLOAT3(cam->position), DirectX::XMFLOAT3(cam->target));
+        }
+    }
+    if (old_scene_count > header->scene_count) {
+        LOG("%s: %u scenes are gone from the config, their instances are removed", __func__, old_scene_count - header->scene_count);
+    }
+
+    for (uint32_t i = 0; i < header->instance_count; ++i) {
+        instance_ids[i] = id::invalid();
+    }
+    for (uint32_t s = 0; s < header->scene_count; ++s) {
+        const SceneFileScene *scene_range = &file->scenes[s];
+        Scene *scene = id::is_invalid(scene_ids[s]) ? nullptr : &pState->scenes[scene_ids[s].id];
+        uint32_t left_out = 0;
+        for (uint32_t i = 0; i < scene_range->instance_count; ++i) {
+            uint32_t index = scene_range->first_instance + i;
+            const SceneFileInstance *mi = &file->instances[index];
+            // One that didn't fit before gets another try
+            SceneDiffAction action = diff->instances.actions[index];
+            SceneId existing = action == SCENE_DIFF_ADD ? id::invalid() : loaded->instance_ids[diff->instances.sources[index]];
+            if (id::is_valid(existing)) {
+                instance_ids[index] = existing;
+                if (action == SCENE_DIFF_UPDATE && scene) {
+                    scene::mesh_set_position(scene, instance_ids[index], DirectX::XMFLOAT3(mi->position));
+                    scene::mesh_set_rotation(scene, instance_ids[index], DirectX::XMFLOAT3(mi->rotation));
+                    scene::mesh_set_scale(scene, instance_ids[index], DirectX::XMFLOAT3(mi->scale));
+                }
+                continue;
+            }
+
+            // Once it's full the rest aren't even tried
+            if (!scene || left_out > 0) {
+                left_out++;
+                continue;
+            }
+            instance_ids[index] = scene::add_mesh(
+                scene,
+                mesh_ids[mi->mesh],
+                mi->material == SCENE_FILE_NONE ? id::invalid() : material_ids[mi->material],
+                DirectX::XMFLOAT3(mi->position), DirectX::XMFLOAT3(mi->rotation), DirectX::XMFLOAT3(mi->scale));
+            left_out += id::is_invalid(instance_ids[index]);
+        }
+        if (left_out > 0) {
+            LOG("%s: %u mesh instances of scene %u didn't fit, a scene has room for %u", __func__, left_out, s, MAX_SCENE_MESHES);
+        }
+    }
+
+    // Nothing uses the old files anymore, each one goes when its last user gives it back
+    for (uint32_t i = 0; i < header->texture_count; ++i) {
+        if (diff->textures.actions[i] == SCENE_DIFF_RELOAD) {
+            texture::release(loaded->texture_ids[diff->textures.sources[i]]);
+        }
+    }
+    for (uint32_t r = 0; r < diff->textures.removed_count; ++r) {
+        texture::release(loaded->texture_ids[diff->textures.removed[r]]);
+    }
+    for (uint32_t i = 0; i < header->mesh_count; ++i) {
+        if (diff->meshes.actions[i] == SCENE_DIFF_RELOAD) {
+            mesh::release(loaded->mesh_ids[diff->meshes.sources[i]]);
+        }
+    }
+    for (uint32_t r = 0; r < diff->meshes.removed_count; ++r) {
+        mesh::release(loaded->mesh_ids[diff->meshes.removed[r]]);
+    }
+
+    loaded->file = *file;
+    loaded->texture_ids = texture_ids;
+    loaded->material_ids = material_ids;
+    loaded->mesh_ids = mesh_ids;
+    loaded->instance_ids = instance_ids;
+    loaded->scene_ids = scene_ids;
+    loaded->current ^= 1;
+    loaded->is_loaded = true;
+    return true;
+}
+
+static MaterialId set_material(const SceneFileMaterial *mat, const Id *texture_ids, MaterialId existing) {
+    // No texture falls back to the default one
+    Id maps[SCENE_FILE_MAP_COUNT];
+    for (uint32_t m = 0; m < SCENE_FILE_MAP_COUNT; ++m) {
+        maps[m] = mat->maps[m] == SCENE_FILE_NONE ? id::invalid() : texture_ids[mat->maps[m]];
+    }
+
+    if (id::is_valid(existing)) {
+        material::update(existing, DirectX::XMFLOAT3(mat->albedo), maps[SCENE_FILE_MAP_ALBEDO], mat->metallic, maps[SCENE_FILE_MAP_METALLIC],
+                         mat->roughness, maps[SCENE_FILE_MAP_ROUGHNESS], mat->coat, maps[SCENE_FILE_MAP_COAT], maps[SCENE_FILE_MAP_NORMAL],
+                         mat->emission, maps[SCENE_FILE_MAP_EMISSION]);
+        return existing;
+    }
+    return material::create(DirectX::XMFLOAT3(mat->albedo), maps[SCENE_FILE_MAP_ALBEDO], mat->metallic, maps[SCENE_FILE_MAP_METALLIC],
+                            mat->roughness, maps[SCENE_FILE_MAP_ROUGHNESS], mat->coat, maps[SCENE_FILE_MAP_COAT], maps[SCENE_FILE_MAP_NORMAL],
+                            mat->emission, maps[SCENE_FILE_MAP_EMISSION]);
+}
+
+static Scene *get_config_scene(const LoadedConfig *loaded, uint32_t scene) {
+    if (scene == SCENE_FILE_NONE || id::is_invalid(loaded->scene_ids[scene])) {
+        return nullptr;
+    }
+    return &pState->scenes[loaded->scene_ids[scene].id];
+}
+
+static uint32_t find_scene(const SceneFile *file, uint32_t instance) {
+    for (uint32_t s = 0; s < file->header->scene_count; ++s) {
+        const SceneFileScene *scene = &file->scenes[s];
+        if (instance >= scene->first_instance && instance - scene->first_instance < scene->instance_count) {
+            return s;
+        }
+    }
+    return SCENE_FILE_NONE;
+}
+
+static void watch_config(const char *path) {
+    // Edits to the loose file wouldn't be seen, reads go to the pack
+    VfsStat stat = {};
+    if (vfs::stat(path, &stat) && stat.is_packed) {
+        LOG("Application: %s is read from the pack, it isn't watched", path);
+        return;
+    }
+
+    // The directory it's in, the watcher reports the files in it
+    char directory[FILE_WATCHER_PATH_MAX];
+    snprintf(directory, sizeof(directory), "%s", path);
+    char *slash = strrchr(directory, '/');
+    char *backslash = strrchr(directory, '\\');
+    if (backslash > slash) {
+        slash = backslash;
+    }
+    if (slash) {
+        *slash = '\0';
+    } else {
+        snprintf(directory, sizeof(directory), ".");
+    }
+
+    file_watcher::normalize_path(path, pState->config_path, sizeof(pState->config_path));
+    if (!file_watcher::initialize(&pState->config_watcher, directory)) {
+        LOG("Application: Couldn't watch %s, it's only loaded once", path);
+    }
+}
+
+static void poll_config() {
+    char changed[16][FILE_WATCHER_PATH_MAX];
+    uint32_t changed_count = file_watcher::poll(&pState->config_watcher, changed, ARRAYSIZE(changed));
+    bool is_changed = false;
+    for (uint32_t i = 0; i < changed_count; ++i) {
+        is_changed |= strcmp(changed[i], pState->config_path) == 0;
+    }
+    if (!is_changed) {
+        return;
+    }
+
+    // The render thread reads the materials and finishes the loads, it waits while they change
+    bool is_threaded = pState->render_thread.joinable();
+    if (is_threaded) {
+        stop_render_thread();
+    }
+    // A broken save changes nothing, the next good one is diffed against what's loaded
+    if (!application::deserialize_config(pState->config.scene_path)) {
+        LOG("Application: Couldn't reload %s, keeping what's loaded", pState->config.scene_path);
+    }
+    if (is_threaded) {
+        // The snapshots the render thread has could still hold ids that were
+        // just released, a new one is what it picks up first
+        publish(1.0f);
+        start_render_thread();
+    }
+}
@@ -1,41 +1,133 @@
 #pragma once
 
+#include "arena.hpp"
+#include "file_watcher.hpp"
+#include "frame_pacer.hpp"
 #include "input.hpp"
+#include "job_system.hpp"
+#include "memory_tracker.hpp"
+#include "render_snapshot.hpp"
 #include "renderer.hpp"
+#include "replay.hpp"
+#include "scene_file.hpp"
 #include "window.hpp"
 
+#include <atomic>
+#include <thread>
+
 #define MAX_SCENES 6
+#define APP_FIXED_TIMESTEP (1.0f / 60.0f)
+// Each of the two arenas a scene config loads into, only what's used is committed
+#define APP_CONFIG_ARENA_RESERVE (256ull * 1024 * 1024)
 
 struct ApplicationConfig {
     const wchar_t *window_title;
     uint16_t window_width;
     uint16_t window_height;
     std::string *mesh_path;
+    // Scene config to load (JSON or compiled), if NULL an empty scene with a default camera is created
+    const char *scene_path;
+    // Compile shaders on the main thread instead of the job workers
+    bool serial_shaders;
+    // Always compile, skip the on-disk shader cache
+    bool no_shader_cache;
+    // Watch src/shaders and rebuild what changed
+    bool shader_hot_reload;
+    // Watch the scene config and apply what changed when it's saved, only
+    // the textures and meshes with a new file are loaded
+    bool config_hot_reload;
+    // Job worker threads, 0 uses every core but one
+    uint32_t job_threads;
+    // run() renders on a thread of its own while the main thread handles
+    // input and updates the scene. frame() always does both in turn.
+    bool threaded_render;
+    // CPU side frame limiter for run(), 0 doesn't limit (vsync still does)
+    float max_fps;
+    // Frames the driver may queue ahead of the GPU, 0 keeps the driver's default
+    uint32_t max_frames_in_flight;
+    // Present right away instead of waiting for the vertical blank
+    bool no_vsync;
+    // Bytes a tag may use before it's logged as over budget, 0 is no budget
+    uint64_t memory_budgets[MEMORY_DOMAIN_COUNT][MEMORY_TAG_COUNT];
+    // GPU bytes the scene's textures may keep resident, they're streamed in
+    // by the mip as they're seen. 0 loads every texture whole.
+    uint64_t texture_stream_budget;
+    // Also share textures and meshes between files with the same bytes, not
+    // just between the same paths. Every file is read once more to hash it.
+    bool asset_content_hash;
+    // Pack the assets are read from (see tools/pack.cpp), files it doesn't
+    // have still come from disk. NULL or missing reads everything from disk.
+    const char *pack_path;
+};
+
+// The scene config that's loaded and what each index of it became, the next
+// one is diffed against it (see scene_diff.hpp). A config loads into the
+// arena the loaded one isn't in, then they swap.
+struct LoadedConfig {
+    Arena arenas[2];
+    uint32_t current; // The arena the loaded config is in
+    bool is_loaded;
+
+    SceneFile file;
+    Id *texture_ids;
+    Id *material_ids;
+    Id *mesh_ids;
+    SceneId *instance_ids; // Invalid for the ones that didn't fit
+    SceneId *scene_ids;
 };
 
 struct AppState {
     ApplicationConfig config;
 
+    JobSystem jobs;
     Input input;
     Window window;
     Renderer renderer;
     Scene scenes[MAX_SCENES];
     Scene *active_scene;
+
+    LoadedConfig loaded_config;
+    FileWatcher config_watcher;
+    char config_path[FILE_WATCHER_PATH_MAX]; // Normalized, as the watcher reports it
+
+    // When set (and not recording) the camera is driven by the replay instead of input
+    Replay *replay;
+    float time;
+
+    // run() updates in APP_FIXED_TIMESTEP steps however long a frame takes
+    FramePacer pacer;
+    PresentStats present_stats;
+    // The active camera before the last step, the snapshot interpolates from it
+    SceneCamera previous_camera;
+
+    // Every update ends with a snapshot of scene 0 for the renderer
+    SnapshotBuffer snapshots;
+    uint64_t tick;
+    uint16_t camera_width; // Window size the camera's aspect ratio was set for
+    uint16_t camera_height;
+    std::thread render_thread;
+    std::atomic<bool> is_render_stopping;
+    HANDLE render_thread_done; // Set by the render thread on its way out
 };
 
 namespace application {
 
 bool initialize(ApplicationConfig config);
 void shutdown();
-void update();
+void update(float dt);
+void frame(float dt);
 void run();
 
-bool deserialize_config();
+// The JSON config or the scene file compiled from it (see scene_file.hpp).
+// Loading another one after the first only applies what's different.
+bool deserialize_config(const char *path);
+void set_replay(Replay *replay);
 
 Id add_scene();
 void set_active_scene(Id scene);
 
 Window *get_window();
+JobSystem *get_job_system();
 Renderer *get_renderer();
 Scene *get_scenes();
 
@@ -0,0 +1,163 @@
+#include "arena.hpp"
+
+#include "logger.hpp"
+#include "memory_tracker.hpp"
+
+#include <cassert>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Frees the thread's scratch arena when the thread goes away
+struct ScratchArena {
+    Arena arena;
+    bool is_initialized;
+    ~ScratchArena();
+};
+
+static thread_local ScratchArena t_scratch;
+
+static uint8_t *reserve_pages(size_t size);
+static bool commit_pages(uint8_t *address, size_t size);
+static void release_pages(uint8_t *base, size_t size);
+
+bool arena::initialize(Arena *arena, size_t reserve) {
+    assert(arena && "arena::initialize: Arena pointer cannot be NULL");
+
+    *arena = {};
+    reserve = (reserve + ARENA_COMMIT_SIZE - 1) & ~(size_t)(ARENA_COMMIT_SIZE - 1);
+    arena->base = reserve_pages(reserve);
+    if (!arena->base) {
+        LOG("%s: Couldn't reserve %llu bytes", __func__, (unsigned long long)reserve);
+        return false;
+    }
+    arena->reserved = reserve;
+    // Only what's committed counts, it grows with the pushes
+    memory_tracker::track(MEMORY_TAG_ARENAS, MEMORY_DOMAIN_CPU, 0);
+    return true;
+}
+
+void arena::shutdown(Arena *arena) {
+    if (arena->base) {
+        release_pages(arena->base, arena->reserved);
+        memory_tracker::untrack(MEMORY_TAG_ARENAS, MEMORY_DOMAIN_CPU, arena->committed);
+    }
+    *arena = {};
+}
+
+void *arena::push(Arena *arena, size_t size, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0 && "arena::push: Alignment has to be a power of two");
+
+    size_t start = (arena->offset + align - 1) & ~(align - 1);
+    if (!arena->base || start + size > arena->reserved || start + size < start) {
+        LOG("%s: %llu bytes don't fit, %llu of %llu used", __func__, (unsigned long long)size, (unsigned long long)arena->offset, (unsigned long long)arena->reserved);
+        arena->failed++;
+        return nullptr;
+    }
+
+    size_t end = start + size;
+    if (end > arena->committed) {
+        size_t commit_end = (end + ARENA_COMMIT_SIZE - 1) & ~(size_t)(ARENA_COMMIT_SIZE - 1);
+        if (commit_end > arena->reserved) {
+            commit_end = arena->reserved;
+        }
+        if (!commit_pages(arena->base + arena->committed, commit_end - arena->committed)) {
+            LOG("%s: Couldn't commit %llu bytes", __func__, (unsigned long long)(commit_end - arena->committed));
+            arena->failed++;
+            return nullptr;
+        }
+        memory_tracker::retrack(MEMORY_TAG_ARENAS, MEMORY_DOMAIN_CPU, arena->committed, commit_end);
+        arena->committed = commit_end;
+    }
+
+    arena->offset = end;
+    if (end > arena->peak) {
+        arena->peak = end;
+    }
+    return arena->base + start;
+}
+
+ArenaMarker arena::get_marker(const Arena *arena) {
+    return arena->offset;
+}
+
+void arena::rewind(Arena *arena, ArenaMarker marker) {
+    assert(marker <= arena->offset && "arena::rewind: Marker is past the offset, rewound in the wrong order?");
+    arena->offset = marker;
+}
+
+void arena::reset(Arena *arena) {
+    arena->offset = 0;
+}
+
+bool arena::frame_initialize(FrameArena *frame, size_t reserve) {
+    frame->index = 0;
+    if (!initialize(&frame->arenas[0], reserve)) {
+        return false;
+    }
+    if (!initialize(&frame->arenas[1], reserve)) {
+        shutdown(&frame->arenas[0]);
+        return false;
+    }
+    return true;
+}
+
+void arena::frame_shutdown(FrameArena *frame) {
+    shutdown(&frame->arenas[0]);
+    shutdown(&frame->arenas[1]);
+}
+
+Arena *arena::frame_begin(FrameArena *frame) {
+    frame->index ^= 1;
+    reset(&frame->arenas[frame->index]);
+    return &frame->arenas[frame->index];
+}
+
+Arena *arena::frame_current(FrameArena *frame) {
+    return &frame->arenas[frame->index];
+}
+
+Arena *arena::scratch() {
+    // A failed reserve leaves it empty, every push then fails instead
+    if (!t_scratch.is_initialized) {
+        t_scratch.is_initialized = true;
+        initialize(&t_scratch.arena, ARENA_SCRATCH_RESERVE);
+    }
+    return &t_scratch.arena;
+}
+
+ScratchArena::~ScratchArena() {
+    if (is_initialized) {
+        arena::shutdown(&arena);
+    }
+}
+
+static uint8_t *reserve_pages(size_t size) {
+#ifdef _WIN32
+    return (uint8_t *)VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void *base = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return base == MAP_FAILED ? nullptr : (uint8_t *)base;
+#endif
+}
+
+static bool commit_pages(uint8_t *address, size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void release_pages(uint8_t *base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, size);
+#endif
+}
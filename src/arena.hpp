@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Linear allocators: a push bumps an offset, nothing is freed on its own.
+// Take a marker, push whatever is needed, rewind to the marker when done.
+//
+// The address space is reserved up front and committed as the offset gets
+// there, so an arena never moves and big reserves cost nothing until used.
+// Rewinding keeps the pages committed, the next push doesn't fault them in
+// again.
+//
+// FrameArena is two of them, one per frame in turn: what the renderer pushes
+// during a frame stays good until the end of the next one.
+//
+// scratch is the calling thread's own arena for temporaries that don't leave
+// the function (or the ones it calls). Every push after a marker belongs to
+// whoever took it, so rewind before returning and don't hand scratch memory to
+// another thread or across a co_await.
+#define ARENA_COMMIT_SIZE (64 * 1024)
+#define ARENA_DEFAULT_ALIGN 16
+#define ARENA_FRAME_RESERVE (64ull * 1024 * 1024)
+#define ARENA_SCRATCH_RESERVE (1024ull * 1024 * 1024)
+
+struct Arena {
+    uint8_t *base;
+    size_t reserved;
+    size_t committed;
+    size_t offset;
+    size_t peak;     // Highest offset since initialize
+    uint32_t failed; // Pushes that didn't fit
+};
+
+typedef size_t ArenaMarker;
+
+struct FrameArena {
+    Arena arenas[2];
+    uint32_t index; // The one this frame pushes into
+};
+
+// Pushes room for count of type, NULL when it doesn't fit
+#define ARENA_PUSH_ARRAY(target, type, count) ((type *)arena::push((target), sizeof(type) * (size_t)(count), alignof(type)))
+
+namespace arena {
+
+bool initialize(Arena *arena, size_t reserve);
+void shutdown(Arena *arena);
+
+// align has to be a power of two. NULL when the reserve is used up, the
+// arena stays as it was.
+void *push(Arena *arena, size_t size, size_t align);
+ArenaMarker get_marker(const Arena *arena);
+void rewind(Arena *arena, ArenaMarker marker);
+void reset(Arena *arena);
+
+bool frame_initialize(FrameArena *frame, size_t reserve);
+void frame_shutdown(FrameArena *frame);
+// Moves on to the other arena and empties it, returns it
+Arena *frame_begin(FrameArena *frame);
+Arena *frame_current(FrameArena *frame);
+
+// Reserved on the thread's first call, released when the thread exits
+Arena *scratch();
+
+} // namespace arena
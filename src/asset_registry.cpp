@@ -0,0 +1,321 @@
+#include "asset_registry.hpp"
+
+#include "arena.hpp"
+#include "logger.hpp"
+#include "vfs.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ull
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4Full
+#define HASH_PRIME_3 0x165667B19E3779F9ull
+#define HASH_PRIME_4 0x85EBCA77C2B2AE63ull
+#define HASH_PRIME_5 0x27D4EB2F165667C5ull
+
+static uint64_t rotl(uint64_t x, uint32_t r);
+static uint64_t read_u64(const uint8_t *p);
+static uint32_t read_u32(const uint8_t *p);
+static uint64_t hash_round(uint64_t acc, uint64_t lane);
+static uint64_t merge_round(uint64_t acc, uint64_t lane);
+static AssetEntry *find_by_id(AssetRegistry *registry, AssetType type, Id id);
+
+void asset_registry::initialize(AssetRegistry *registry, bool hash_contents) {
+    *registry = {};
+    registry->hash_contents = hash_contents;
+}
+
+bool asset_registry::normalize_path(const char *path, char *out_path, size_t out_size) {
+    assert(path && out_path && out_size > 0 && "asset_registry::normalize_path: path and out_path cannot be NULL");
+
+    // Component by component, each one starts at a slash in out_path (except the first)
+    size_t length = 0;
+    bool is_absolute = path[0] == '/' || path[0] == '\\';
+    if (is_absolute) {
+        out_path[length++] = '/';
+    }
+
+    const char *p = path;
+    while (*p) {
+        while (*p == '/' || *p == '\\') {
+            p++;
+        }
+        const char *start = p;
+        while (*p && *p != '/' && *p != '\\') {
+            p++;
+        }
+        size_t part = (size_t)(p - start);
+        if (part == 0 || (part == 1 && start[0] == '.')) {
+            continue;
+        }
+
+        // Folds into the component before it, unless that's a .. too or there is none
+        if (part == 2 && start[0] == '.' && start[1] == '.') {
+            size_t root = is_absolute ? 1 : 0;
+            size_t last = length;
+            while (last > root && out_path[last - 1] != '/') {
+                last--;
+            }
+            bool is_parent = length - last == 2 && out_path[last] == '.' && out_path[last + 1] == '.';
+            if (length > last && out_path[length - 1] == ':') {
+                continue; // Nothing above a drive either
+            }
+            if (length > root && !is_parent) {
+                length = last > root ? last - 1 : root;
+                continue;
+            }
+            if (is_absolute && length == root) {
+                continue; // Nothing above the root
+            }
+        }
+
+        bool needs_slash = length > (is_absolute ? 1u : 0u);
+        if (length + needs_slash + part + 1 > out_size) {
+            return false;
+        }
+        if (needs_slash) {
+            out_path[length++] = '/';
+        }
+        for (size_t i = 0; i < part; ++i) {
+            char c = start[i];
+            out_path[length++] = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+        }
+    }
+
+    if (length == 0) {
+        if (out_size < 2) {
+            return false;
+        }
+        out_path[length++] = '.';
+    }
+    out_path[length] = '\0';
+    return true;
+}
+
+uint64_t asset_registry::hash_bytes(uint64_t seed, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t acc[4] = {seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1};
+        do {
+            for (uint32_t lane = 0; lane < 4; ++lane) {
+                acc[lane] = hash_round(acc[lane], read_u64(p + lane * 8));
+            }
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            h = merge_round(h, acc[lane]);
+        }
+    } else {
+        h = seed + HASH_PRIME_5;
+    }
+    h += (uint64_t)size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= hash_round(0, read_u64(p));
+        h = rotl(h, 27) * HASH_PRIME_1 + HASH_PRIME_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read_u32(p) * HASH_PRIME_1;
+        h = rotl(h, 23) * HASH_PRIME_2 + HASH_PRIME_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (uint64_t)*p * HASH_PRIME_5;
+        h = rotl(h, 11) * HASH_PRIME_1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t asset_registry::hash_file(const char *path, uint64_t *out_size) {
+    // Packed files were hashed the same way when they were packed
+    VfsStat stat = {};
+    if (vfs::stat(path, &stat) && stat.is_packed) {
+        if (out_size) {
+            *out_size = stat.size;
+        }
+        return stat.version ? stat.version : 1;
+    }
+
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    if (!vfs::read(path, scratch, &data, &size)) {
+        arena::rewind(scratch, marker);
+        return 0;
+    }
+    uint64_t h = hash_bytes(0, data, size);
+    arena::rewind(scratch, marker);
+
+    if (out_size) {
+        *out_size = size;
+    }
+    // 0 is what not hashed looks like
+    return h ? h : 1;
+}
+
+bool asset_registry::make_key(AssetRegistry *registry, AssetType type, uint8_t flags, const char *path, AssetKey *out_key) {
+    assert(path && out_key && "asset_registry::make_key: path and out_key cannot be NULL");
+
+    *out_key = {};
+    out_key->type = type;
+    out_key->flags = flags;
+    if (!normalize_path(path, out_key->path, sizeof(out_key->path))) {
+        LOG("%s: %s is too long to be kept track of", __func__, path);
+        return false;
+    }
+    out_key->path_hash = hash_bytes(0, out_key->path, strlen(out_key->path));
+
+    // Only needed when the path is new, a known one isn't read again
+    if (registry->hash_contents) {
+        for (uint32_t i = 0; i < ASSET_REGISTRY_MAX_ENTRIES; ++i) {
+            const AssetEntry *entry = &registry->entries[i];
+            if (entry->is_used && entry->key.type == type && entry->key.flags == flags &&
+                entry->key.path_hash == out_key->path_hash && strcmp(entry->key.path, out_key->path) == 0) {
+                return true;
+            }
+        }
+
+        uint64_t size = 0;
+        out_key->content_hash = hash_file(path, &size);
+        registry->stats.bytes_hashed += size;
+    }
+    return true;
+}
+
+bool asset_registry::acquire(AssetRegistry *registry, const AssetKey *key, AssetLoad *out_load) {
+    assert(key && out_load && "asset_registry::acquire: key and out_load cannot be NULL");
+
+    registry->stats.acquires++;
+
+    AssetEntry *same_content = nullptr;
+    for (uint32_t i = 0; i < ASSET_REGISTRY_MAX_ENTRIES; ++i) {
+        AssetEntry *entry = &registry->entries[i];
+        if (!entry->is_used || entry->key.type != key->type || entry->key.flags != key->flags) {
+            continue;
+        }
+        if (entry->key.path_hash == key->path_hash && strcmp(entry->key.path, key->path) == 0) {
+            entry->refcount++;
+            registry->stats.path_hits++;
+            *out_load = entry->load;
+            return true;
+        }
+        if (key->content_hash != 0 && entry->key.content_hash == key->content_hash && !same_content) {
+            same_content = entry;
+        }
+    }
+
+    if (!same_content) {
+        return false;
+    }
+
+    // The copy gets an entry of its own with the same resource, so next time it's found by its path
+    registry->stats.content_hits++;
+    *out_load = same_content->load;
+    if (!add(registry, key, same_content->load)) {
+        same_content->refcount++;
+    }
+    return true;
+}
+
+bool asset_registry::add(AssetRegistry *registry, const AssetKey *key, AssetLoad load) {
+    assert(key && "asset_registry::add: key cannot be NULL");
+
+    for (uint32_t i = 0; i < ASSET_REGISTRY_MAX_ENTRIES; ++i) {
+        AssetEntry *entry = &registry->entries[i];
+        if (!entry->is_used) {
+            entry->is_used = true;
+            entry->refcount = 1;
+            entry->key = *key;
+            entry->load = load;
+            registry->count++;
+            return true;
+        }
+    }
+
+    LOG("%s: No room for %s, it won't be shared", __func__, key->path);
+    return false;
+}
+
+bool asset_registry::release(AssetRegistry *registry, AssetType type, Id id) {
+    AssetEntry *entry = find_by_id(registry, type, id);
+    if (!entry) {
+        return true;
+    }
+
+    registry->stats.releases++;
+    assert(entry->refcount > 0 && "asset_registry::release: Entry in use without a reference");
+    if (--entry->refcount > 0) {
+        return false;
+    }
+
+    entry->is_used = false;
+    registry->count--;
+
+    // Copies of the same content share the resource, it goes with the last of them
+    if (find_by_id(registry, type, id)) {
+        return false;
+    }
+    registry->stats.freed++;
+    return true;
+}
+
+uint32_t asset_registry::get_refcount(const AssetRegistry *registry, AssetType type, Id id) {
+    uint32_t refcount = 0;
+    for (uint32_t i = 0; i < ASSET_REGISTRY_MAX_ENTRIES; ++i) {
+        const AssetEntry *entry = &registry->entries[i];
+        if (entry->is_used && entry->key.type == type && id::is_fresh(entry->load.id, id)) {
+            refcount += entry->refcount;
+        }
+    }
+    return refcount;
+}
+
+static uint64_t rotl(uint64_t x, uint32_t r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read_u64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t lane) {
+    acc += lane * HASH_PRIME_2;
+    acc = rotl(acc, 31);
+    return acc * HASH_PRIME_1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t lane) {
+    acc ^= hash_round(0, lane);
+    return acc * HASH_PRIME_1 + HASH_PRIME_4;
+}
+
+static AssetEntry *find_by_id(AssetRegistry *registry, AssetType type, Id id) {
+    for (uint32_t i = 0; i < ASSET_REGISTRY_MAX_ENTRIES; ++i) {
+        AssetEntry *entry = &registry->entries[i];
+        if (entry->is_used && entry->key.type == type && id::is_fresh(entry->load.id, id)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "async.hpp"
+#include "id.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Which files are loaded already and by how many. The scene config names the
+// same maps and meshes under several ids, texture::acquire and mesh::acquire
+// look the file up here first and hand out the resource it was loaded into
+// with one more reference. It's freed when the last reference is released.
+//
+// Keyed by the normalized path (lower case, forward slashes, . and .. folded)
+// and what the file is loaded as, the same image as sRGB and linear are two
+// resources. With hash_contents a path that isn't known yet is also hashed,
+// copies of a file under another name then share it too. That reads the file
+// once more on a miss, so it's off unless asked for.
+//
+// Only bookkeeping, nothing in here loads or frees anything.
+#define ASSET_REGISTRY_MAX_ENTRIES 128
+#define ASSET_PATH_MAX 260
+
+enum AssetType : uint8_t {
+    ASSET_TEXTURE,
+    ASSET_MESH,
+};
+
+// Loaded differently from the same file
+#define ASSET_FLAG_SRGB 0x1
+#define ASSET_FLAG_HDR 0x2
+#define ASSET_FLAG_STREAMED 0x4
+
+// What a file is looked up by, make_key fills it
+struct AssetKey {
+    uint8_t type;
+    uint8_t flags;
+    uint64_t path_hash;
+    uint64_t content_hash; // 0 when not hashed or not there
+    char path[ASSET_PATH_MAX]; // Normalized
+};
+
+struct AssetEntry {
+    bool is_used;
+    uint32_t refcount;
+    AssetKey key;
+    AssetLoad load; // Still awaitable while it's in flight
+};
+
+struct AssetRegistryStats {
+    uint32_t acquires; // Since initialize
+    uint32_t path_hits;
+    uint32_t content_hits;
+    uint32_t releases;
+    uint32_t freed;
+    uint64_t bytes_hashed;
+};
+
+struct AssetRegistry {
+    AssetEntry entries[ASSET_REGISTRY_MAX_ENTRIES];
+    uint32_t count; // Entries in use
+    bool hash_contents;
+    AssetRegistryStats stats;
+};
+
+namespace asset_registry {
+
+void initialize(AssetRegistry *registry, bool hash_contents);
+
+// False when it doesn't fit out_size
+bool normalize_path(const char *path, char *out_path, size_t out_size);
+// 64 bits, 32 bytes at a time (xxHash64's rounds)
+uint64_t hash_bytes(uint64_t seed, const void *data, size_t size);
+// Of the whole file through the vfs (the same as its content hash in a pack),
+// 0 when it can't be read
+uint64_t hash_file(const char *path, uint64_t *out_size);
+
+// False when the path is too long to be kept
+bool make_key(AssetRegistry *registry, AssetType type, uint8_t flags, const char *path, AssetKey *out_key);
+// True with the loaded file's AssetLoad and one more reference, false when
+// it has to be loaded (and then added)
+bool acquire(AssetRegistry *registry, const AssetKey *key, AssetLoad *out_load);
+// The first reference of a file that was just loaded
+bool add(AssetRegistry *registry, const AssetKey *key, AssetLoad load);
+// True when the caller has to free the resource: it was the last reference
+// or the resource wasn't loaded through the registry at all
+bool release(AssetRegistry *registry, AssetType type, Id id);
+// 0 when it isn't in the registry
+uint32_t get_refcount(const AssetRegistry *registry, AssetType type, Id id);
+
+} // namespace asset_registry
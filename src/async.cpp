@@ -0,0 +1,128 @@
+#include "async.hpp"
+
+#include <cassert>
+#include <thread>
+
+static void push_main(AsyncScheduler *scheduler, std::coroutine_handle<> coroutine);
+static void resume(void *user_data);
+
+void async::initialize(AsyncScheduler *scheduler, JobSystem *jobs) {
+    assert(scheduler && "async::initialize: Scheduler pointer cannot be NULL");
+    assert(jobs && "async::initialize: Job system pointer cannot be NULL");
+
+    scheduler->jobs = jobs;
+    scheduler->loads_in_flight = 0;
+    scheduler->loads_started = 0;
+    scheduler->loads_finished = 0;
+    for (uint32_t i = 0; i < ASYNC_MAX_LOADS; ++i) {
+        scheduler->loads[i].in_use = false;
+        scheduler->loads[i].generation = 0;
+        scheduler->loads[i].waiter = nullptr;
+    }
+}
+
+void async::wait_idle(AsyncScheduler *scheduler) {
+    while (scheduler->loads_in_flight > 0) {
+        if (job_system::run_main_jobs(scheduler->jobs) == 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+AsyncWorkerAwaiter async::to_worker(AsyncScheduler *scheduler) {
+    return {scheduler};
+}
+
+AsyncMainAwaiter async::to_main(AsyncScheduler *scheduler) {
+    return {scheduler};
+}
+
+bool async::has_room(const AsyncScheduler *scheduler) {
+    return scheduler->loads_in_flight < ASYNC_MAX_LOADS;
+}
+
+AssetLoad async::begin_load(AsyncScheduler *scheduler, Id id) {
+    assert(job_system::is_main_thread(scheduler->jobs) && "async::begin_load: Only on the main thread");
+
+    for (uint32_t i = 0; i < ASYNC_MAX_LOADS; ++i) {
+        AsyncLoadSlot *slot = &scheduler->loads[i];
+        if (!slot->in_use) {
+            slot->in_use = true;
+            slot->waiter = nullptr;
+            scheduler->loads_in_flight++;
+            scheduler->loads_started++;
+            return {id, scheduler, i, slot->generation};
+        }
+    }
+
+    assert(false && "async::begin_load: No room, check has_room first");
+    return finished(id);
+}
+
+void async::end_load(AsyncScheduler *scheduler, const AssetLoad *load) {
+    assert(job_system::is_main_thread(scheduler->jobs) && "async::end_load: Only on the main thread");
+    assert(!is_done(load) && "async::end_load: Load was ended already");
+
+    AsyncLoadSlot *slot = &scheduler->loads[load->slot];
+    slot->in_use = false;
+    slot->generation++;
+    scheduler->loads_in_flight--;
+    scheduler->loads_finished++;
+
+    // Queued instead of resumed, the loader is still on the stack
+    if (slot->waiter) {
+        push_main(scheduler, slot->waiter);
+        slot->waiter = nullptr;
+    }
+}
+
+AssetLoad async::finished(Id id) {
+    return {id, nullptr, ASYNC_NO_LOAD, 0};
+}
+
+bool async::is_done(const AssetLoad *load) {
+    if (load->slot == ASYNC_NO_LOAD) {
+        return true;
+    }
+
+    const AsyncLoadSlot *slot = &load->scheduler->loads[load->slot];
+    return !slot->in_use || slot->generation != load->generation;
+}
+
+bool AssetLoad::await_ready() const noexcept {
+    return async::is_done(this);
+}
+
+void AssetLoad::await_suspend(std::coroutine_handle<> waiter) noexcept {
+    assert(job_system::is_main_thread(scheduler->jobs) && "AssetLoad: Only awaited on the main thread");
+
+    AsyncLoadSlot *load_slot = &scheduler->loads[slot];
+    assert(!load_slot->waiter && "AssetLoad: Somebody is waiting on this load already");
+    load_slot->waiter = waiter;
+}
+
+bool AsyncWorkerAwaiter::await_ready() const noexcept {
+    return false;
+}
+
+void AsyncWorkerAwaiter::await_suspend(std::coroutine_handle<> coroutine) noexcept {
+    JobDecl job = {resume, coroutine.address()};
+    job_system::run(scheduler->jobs, &job, 1, nullptr);
+}
+
+bool AsyncMainAwaiter::await_ready() const noexcept {
+    return job_system::is_main_thread(scheduler->jobs);
+}
+
+void AsyncMainAwaiter::await_suspend(std::coroutine_handle<> coroutine) noexcept {
+    push_main(scheduler, coroutine);
+}
+
+static void push_main(AsyncScheduler *scheduler, std::coroutine_handle<> coroutine) {
+    JobDecl job = {resume, coroutine.address()};
+    job_system::run_on_main(scheduler->jobs, &job, 1, nullptr);
+}
+
+static void resume(void *user_data) {
+    std::coroutine_handle<>::from_address(user_data).resume();
+}
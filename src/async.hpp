@@ -0,0 +1,97 @@
+#pragma once
+
+#include "id.hpp"
+#include "job_system.hpp"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+
+// Asset loads are coroutines that hop between threads with co_await:
+//   co_await async::to_worker(scheduler); // decode, parse, anything without the device
+//   co_await async::to_main(scheduler);   // upload, resumed by job_system::run_main_jobs
+// The caller gets an AssetLoad back right away. Its id already points at a
+// placeholder (a fallback texture, an empty mesh) and the real resource is
+// patched into the same slot once the load is done, so whatever holds the id
+// never has to change it. Nothing in here touches the GPU.
+#define ASYNC_MAX_LOADS 64
+#define ASYNC_NO_LOAD UINT32_MAX
+#define ASYNC_PATH_MAX 260
+
+// Fire and forget: runs up to its first co_await right away, frees itself at the end
+struct AsyncTask {
+    struct promise_type {
+        AsyncTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+struct AsyncLoadSlot {
+    bool in_use;
+    uint32_t generation; // Bumped when the load is done, older AssetLoads see it as done
+    std::coroutine_handle<> waiter;
+};
+
+struct AsyncScheduler {
+    // Worker parts are jobs, main thread parts are main thread jobs
+    JobSystem *jobs;
+
+    // Main thread only
+    AsyncLoadSlot loads[ASYNC_MAX_LOADS];
+    uint32_t loads_in_flight;
+    uint32_t loads_started;
+    uint32_t loads_finished;
+};
+
+// What the load_async functions return. id can be used right away. co_await
+// it (from a coroutine on the main thread, one at a time) to go on once the
+// real resource is in, it gives back the id.
+struct AssetLoad {
+    Id id;
+    AsyncScheduler *scheduler;
+    uint32_t slot; // ASYNC_NO_LOAD when it was done before it was returned
+    uint32_t generation;
+
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> waiter) noexcept;
+    Id await_resume() const noexcept { return id; }
+};
+
+struct AsyncWorkerAwaiter {
+    AsyncScheduler *scheduler;
+
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> coroutine) noexcept;
+    void await_resume() const noexcept {}
+};
+
+struct AsyncMainAwaiter {
+    AsyncScheduler *scheduler;
+
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> coroutine) noexcept;
+    void await_resume() const noexcept {}
+};
+
+namespace async {
+
+// On the main thread of jobs, that's where to_main goes back to
+void initialize(AsyncScheduler *scheduler, JobSystem *jobs);
+// Runs the main thread jobs until every load is done
+void wait_idle(AsyncScheduler *scheduler);
+
+AsyncWorkerAwaiter to_worker(AsyncScheduler *scheduler);
+AsyncMainAwaiter to_main(AsyncScheduler *scheduler);
+
+// For the loaders. begin_load needs has_room, end_load wakes the waiter.
+bool has_room(const AsyncScheduler *scheduler);
+AssetLoad begin_load(AsyncScheduler *scheduler, Id id);
+void end_load(AsyncScheduler *scheduler, const AssetLoad *load);
+// A load that is done already, for the blocking fallbacks
+AssetLoad finished(Id id);
+bool is_done(const AssetLoad *load);
+
+} // namespace async
@@ -0,0 +1,344 @@
+#include "file_watcher.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define MAX_PATH_SEGMENTS 64
+// inotify only watches one directory per watch, one for each in the tree
+#define MAX_WATCHED_DIRECTORIES 64
+
+struct FileWatcherPlatform {
+#ifdef _WIN32
+    HANDLE handle;
+    OVERLAPPED overlapped;
+    // DWORD aligned, FILE_NOTIFY_INFORMATION needs it
+    DWORD buffer[FILE_WATCHER_BUFFER_SIZE / sizeof(DWORD)];
+#else
+    int fd;
+    // Relative to the watched directory, "" for itself. -1 is a free slot.
+    int watches[MAX_WATCHED_DIRECTORIES];
+    char subdirectories[MAX_WATCHED_DIRECTORIES][FILE_WATCHER_PATH_MAX];
+    alignas(8) char buffer[FILE_WATCHER_BUFFER_SIZE];
+#endif
+};
+
+static bool arm(FileWatcher *watcher);
+static void add_path(FileWatcher *watcher, const char *name, size_t name_length, char (*out_paths)[FILE_WATCHER_PATH_MAX], uint32_t max_paths, uint32_t *count);
+#ifndef _WIN32
+static bool watch_tree(FileWatcher *watcher, const char *subdirectory);
+#endif
+
+bool file_watcher::initialize(FileWatcher *watcher, const char *directory) {
+    assert(watcher && directory && "file_watcher::initialize: watcher and directory cannot be NULL");
+
+    watcher->active = false;
+    snprintf(watcher->directory, sizeof(watcher->directory), "%s", directory);
+    FileWatcherPlatform *platform = new FileWatcherPlatform;
+    watcher->platform = platform;
+
+#ifdef _WIN32
+    platform->handle = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (platform->handle == INVALID_HANDLE_VALUE) {
+        LOG("%s: Couldn't open %s for watching", __func__, directory);
+        delete platform;
+        watcher->platform = nullptr;
+        return false;
+    }
+
+    memset(&platform->overlapped, 0, sizeof(platform->overlapped));
+    platform->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!platform->overlapped.hEvent) {
+        LOG("%s: Couldn't create the event for %s", __func__, directory);
+        CloseHandle(platform->handle);
+        delete platform;
+        watcher->platform = nullptr;
+        return false;
+    }
+#else
+    platform->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (platform->fd < 0) {
+        LOG("%s: inotify_init1 failed (%s)", __func__, strerror(errno));
+        delete platform;
+        watcher->platform = nullptr;
+        return false;
+    }
+    for (uint32_t i = 0; i < MAX_WATCHED_DIRECTORIES; ++i) {
+        platform->watches[i] = -1;
+    }
+#endif
+
+    if (!arm(watcher)) {
+        LOG("%s: Couldn't start watching %s", __func__, directory);
+        watcher->active = true;
+        shutdown(watcher);
+        return false;
+    }
+
+    watcher->active = true;
+    return true;
+}
+
+void file_watcher::shutdown(FileWatcher *watcher) {
+    if (!watcher->active) {
+        return;
+    }
+    watcher->active = false;
+    FileWatcherPlatform *platform = watcher->platform;
+
+#ifdef _WIN32
+    // The pending read has to be done before the buffer goes away
+    CancelIo(platform->handle);
+    DWORD bytes = 0;
+    GetOverlappedResult(platform->handle, &platform->overlapped, &bytes, TRUE);
+    CloseHandle(platform->overlapped.hEvent);
+    CloseHandle(platform->handle);
+#else
+    close(platform->fd); // Drops the watches with it
+#endif
+
+    delete platform;
+    watcher->platform = nullptr;
+}
+
+uint32_t file_watcher::poll(FileWatcher *watcher, char (*out_paths)[FILE_WATCHER_PATH_MAX], uint32_t max_paths) {
+    if (!watcher->active) {
+        return 0;
+    }
+
+    uint32_t count = 0;
+    FileWatcherPlatform *platform = watcher->platform;
+
+#ifdef _WIN32
+    DWORD bytes = 0;
+    if (!GetOverlappedResult(platform->handle, &platform->overlapped, &bytes, FALSE)) {
+        if (GetLastError() != ERROR_IO_INCOMPLETE) {
+            arm(watcher);
+        }
+        return 0;
+    }
+
+    // 0 bytes means the buffer overflowed, nothing to go on
+    if (bytes > 0) {
+        const uint8_t *cursor = (const uint8_t *)platform->buffer;
+        for (;;) {
+            const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION *)cursor;
+            if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+                char name[FILE_WATCHER_PATH_MAX];
+                int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)),
+                                                 name, sizeof(name) - 1, nullptr, nullptr);
+                if (length > 0) {
+                    add_path(watcher, name, (size_t)length, out_paths, max_paths, &count);
+                }
+            }
+
+            if (info->NextEntryOffset == 0) {
+                break;
+            }
+            cursor += info->NextEntryOffset;
+        }
+    }
+
+    arm(watcher);
+#else
+    for (;;) {
+        ssize_t length = read(platform->fd, platform->buffer, sizeof(platform->buffer));
+        if (length <= 0) {
+            break; // EAGAIN, nothing (more) to read
+        }
+
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event *event = (const inotify_event *)(platform->buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            uint32_t slot = 0;
+            while (slot < MAX_WATCHED_DIRECTORIES && platform->watches[slot] != event->wd) {
+                slot++;
+            }
+            if (slot == MAX_WATCHED_DIRECTORIES) {
+                continue;
+            }
+            // The directory is gone (or moved away), its watch went with it
+            if (event->mask & IN_IGNORED) {
+                platform->watches[slot] = -1;
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+
+            char name[FILE_WATCHER_PATH_MAX];
+            const char *subdirectory = platform->subdirectories[slot];
+            int name_length = snprintf(name, sizeof(name), "%s%s%s", subdirectory, subdirectory[0] ? "/" : "", event->name);
+            if (name_length <= 0 || (size_t)name_length >= sizeof(name)) {
+                continue;
+            }
+
+            // A new directory gets watched too. Files written in it before
+            // the watch was there aren't reported.
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watch_tree(watcher, name);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                add_path(watcher, name, (size_t)name_length, out_paths, max_paths, &count);
+            }
+        }
+    }
+#endif
+
+    return count;
+}
+
+void file_watcher::normalize_path(const char *path, char *out_path, size_t out_size) {
+    assert(out_size > 0 && "file_watcher::normalize_path: Output buffer cannot be empty");
+
+    // Output length before each segment (and its separator), to go back up on ".."
+    size_t segment_starts[MAX_PATH_SEGMENTS];
+    bool segment_is_parent[MAX_PATH_SEGMENTS];
+    uint32_t segment_count = 0;
+    size_t length = 0;
+
+    if ((path[0] == '/' || path[0] == '\\') && out_size > 1) {
+        out_path[length++] = '/';
+    }
+
+    const char *cursor = path;
+    while (*cursor) {
+        while (*cursor == '/' || *cursor == '\\') {
+            cursor++;
+        }
+        const char *start = cursor;
+        while (*cursor && *cursor != '/' && *cursor != '\\') {
+            cursor++;
+        }
+        size_t segment_length = (size_t)(cursor - start);
+
+        if (segment_length == 0 || (segment_length == 1 && start[0] == '.')) {
+            continue;
+        }
+
+        bool is_parent = segment_length == 2 && start[0] == '.' && start[1] == '.';
+        if (is_parent && segment_count > 0 && !segment_is_parent[segment_count - 1]) {
+            length = segment_starts[--segment_count];
+            continue;
+        }
+
+        if (segment_count >= MAX_PATH_SEGMENTS) {
+            break;
+        }
+        segment_starts[segment_count] = length;
+        segment_is_parent[segment_count] = is_parent;
+        segment_count++;
+
+        if (length > 0 && out_path[length - 1] != '/' && length + 1 < out_size) {
+            out_path[length++] = '/';
+        }
+        for (size_t i = 0; i < segment_length && length + 1 < out_size; ++i) {
+#ifdef _WIN32
+            out_path[length++] = (char)tolower((unsigned char)start[i]);
+#else
+            out_path[length++] = start[i];
+#endif
+        }
+    }
+
+    out_path[length] = '\0';
+}
+
+static bool arm(FileWatcher *watcher) {
+#ifdef _WIN32
+    FileWatcherPlatform *platform = watcher->platform;
+    BOOL ok = ReadDirectoryChangesW(platform->handle, platform->buffer, sizeof(platform->buffer), TRUE,
+                                    FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+                                    nullptr, &platform->overlapped, nullptr);
+    return ok != 0;
+#else
+    return watch_tree(watcher, "");
+#endif
+}
+
+static void add_path(FileWatcher *watcher, const char *name, size_t name_length, char (*out_paths)[FILE_WATCHER_PATH_MAX], uint32_t max_paths, uint32_t *count) {
+    char joined[FILE_WATCHER_PATH_MAX * 2];
+    snprintf(joined, sizeof(joined), "%s/%.*s", watcher->directory, (int)name_length, name);
+
+    char path[FILE_WATCHER_PATH_MAX];
+    file_watcher::normalize_path(joined, path, sizeof(path));
+
+    // Editors tend to write a file more than once per save
+    for (uint32_t i = 0; i < *count; ++i) {
+        if (strcmp(out_paths[i], path) == 0) {
+            return;
+        }
+    }
+
+    if (*count < max_paths) {
+        strcpy(out_paths[(*count)++], path);
+    }
+}
+
+#ifndef _WIN32
+// Watches the subdirectory and everything below it, false when the
+// subdirectory itself couldn't be watched
+static bool watch_tree(FileWatcher *watcher, const char *subdirectory) {
+    FileWatcherPlatform *platform = watcher->platform;
+
+    char path[FILE_WATCHER_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s%s%s", watcher->directory, subdirectory[0] ? "/" : "", subdirectory);
+
+    int watch = inotify_add_watch(platform->fd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (watch < 0) {
+        return false;
+    }
+
+    // The same directory gives the same watch back, e.g. moved out and in again
+    uint32_t slot = 0;
+    while (slot < MAX_WATCHED_DIRECTORIES && platform->watches[slot] != watch) {
+        slot++;
+    }
+    if (slot == MAX_WATCHED_DIRECTORIES) {
+        slot = 0;
+        while (slot < MAX_WATCHED_DIRECTORIES && platform->watches[slot] != -1) {
+            slot++;
+        }
+    }
+    if (slot == MAX_WATCHED_DIRECTORIES) {
+        LOG("%s: Too many directories under %s, %s isn't watched", __func__, watcher->directory, subdirectory);
+        inotify_rm_watch(platform->fd, watch);
+        return false;
+    }
+    platform->watches[slot] = watch;
+    snprintf(platform->subdirectories[slot], FILE_WATCHER_PATH_MAX, "%s", subdirectory);
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return true;
+    }
+    while (const dirent *entry = readdir(dir)) {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char child[FILE_WATCHER_PATH_MAX];
+        int length = snprintf(child, sizeof(child), "%s%s%s", subdirectory, subdirectory[0] ? "/" : "", entry->d_name);
+        if (length > 0 && (size_t)length < sizeof(child)) {
+            watch_tree(watcher, child);
+        }
+    }
+    closedir(dir);
+    return true;
+}
+#endif
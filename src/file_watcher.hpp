@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define FILE_WATCHER_PATH_MAX 260
+#define FILE_WATCHER_BUFFER_SIZE 4096
+
+// Handles and the read buffer, in file_watcher.cpp with the platform headers
+struct FileWatcherPlatform;
+
+// Reports files that were written or moved into a directory or any directory
+// below it. Polled, never blocks: ReadDirectoryChangesW with an overlapped
+// read on Windows, inotify on Linux with a watch per directory (up to 64,
+// directories made later are watched from when they show up).
+struct FileWatcher {
+    char directory[FILE_WATCHER_PATH_MAX];
+    bool active;
+    FileWatcherPlatform *platform;
+};
+
+namespace file_watcher {
+
+bool initialize(FileWatcher *watcher, const char *directory);
+void shutdown(FileWatcher *watcher);
+
+// Files changed since the last poll as "directory/name" (normalized), each
+// one once. Anything past max_paths is dropped.
+uint32_t poll(FileWatcher *watcher, char (*out_paths)[FILE_WATCHER_PATH_MAX], uint32_t max_paths);
+
+// Forward slashes, no "." or "dir/.." segments (and lower case on Windows),
+// so two spellings of the same file compare equal
+void normalize_path(const char *path, char *out_path, size_t out_size);
+
+} // namespace file_watcher
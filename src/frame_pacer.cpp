@@ -0,0 +1,168 @@
+#include "frame_pacer.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+// The OS sleeps this much too long at worst, the rest is waited out yielding
+#define PACER_SPIN_NS 2000000ull
+
+static uint64_t system_now(void *user_data);
+static void system_sleep_until(void *user_data, uint64_t deadline_ns);
+static void add_interval(uint64_t interval_ns, uint32_t *count, uint64_t *sum_ns, double *sq_sum_ms, uint64_t *max_ns);
+static double jitter_ms(uint32_t count, uint64_t sum_ns, double sq_sum_ms);
+
+PacerClock frame_pacer::system_clock() {
+    return {system_now, system_sleep_until, nullptr};
+}
+
+void frame_pacer::initialize(FramePacer *pacer, PacerClock clock, float step_seconds, float max_fps, uint32_t max_steps) {
+    assert(pacer && "frame_pacer::initialize: Pacer pointer cannot be NULL");
+    assert(clock.now && clock.sleep_until && "frame_pacer::initialize: Clock needs now and sleep_until");
+    assert(step_seconds > 0.0f && "frame_pacer::initialize: Step has to be positive");
+
+    pacer->clock = clock;
+    pacer->step_ns = (uint64_t)(step_seconds * 1e9);
+    pacer->min_frame_ns = max_fps > 0.0f ? (uint64_t)(1e9 / max_fps) : 0;
+    pacer->max_steps = max_steps > 0 ? max_steps : PACER_DEFAULT_MAX_STEPS;
+    pacer->has_begun = false;
+    pacer->frame_begin_ns = 0;
+    pacer->accumulator_ns = 0;
+    pacer->next_frame_ns = 0;
+    pacer->alpha = 0.0f;
+    reset_stats(pacer);
+}
+
+void frame_pacer::reset_stats(FramePacer *pacer) {
+    pacer->stats = {};
+}
+
+uint32_t frame_pacer::begin_frame(FramePacer *pacer) {
+    uint64_t now = pacer->clock.now(pacer->clock.user_data);
+
+    // The first frame gets one step, there's nothing to measure it against yet
+    uint64_t elapsed = pacer->step_ns;
+    if (pacer->has_begun) {
+        elapsed = now - pacer->frame_begin_ns;
+        PacerStats *stats = &pacer->stats;
+        add_interval(elapsed, &stats->intervals, &stats->interval_sum_ns, &stats->interval_sq_sum_ms, &stats->interval_max_ns);
+    } else {
+        pacer->next_frame_ns = now;
+    }
+    pacer->has_begun = true;
+    pacer->frame_begin_ns = now;
+
+    pacer->accumulator_ns += elapsed;
+    uint64_t whole_steps = pacer->accumulator_ns / pacer->step_ns;
+    uint32_t steps = whole_steps < pacer->max_steps ? (uint32_t)whole_steps : pacer->max_steps;
+    pacer->accumulator_ns -= steps * pacer->step_ns;
+
+    // What's left past max_steps is dropped, all but the part of a step
+    if (pacer->accumulator_ns >= pacer->step_ns) {
+        uint64_t dropped = pacer->accumulator_ns - pacer->accumulator_ns % pacer->step_ns;
+        pacer->accumulator_ns -= dropped;
+        pacer->stats.dropped_ns += dropped;
+    }
+
+    pacer->alpha = (float)((double)pacer->accumulator_ns / (double)pacer->step_ns);
+
+    pacer->stats.frames++;
+    pacer->stats.steps += steps;
+    if (steps > pacer->stats.max_steps_per_frame) {
+        pacer->stats.max_steps_per_frame = steps;
+    }
+    return steps;
+}
+
+float frame_pacer::get_alpha(const FramePacer *pacer) {
+    return pacer->alpha;
+}
+
+void frame_pacer::end_frame(FramePacer *pacer) {
+    if (pacer->min_frame_ns == 0) {
+        return;
+    }
+
+    // Behind (the frame took longer), start over from now instead of rushing the next ones
+    uint64_t now = pacer->clock.now(pacer->clock.user_data);
+    pacer->next_frame_ns += pacer->min_frame_ns;
+    if (pacer->next_frame_ns < now) {
+        pacer->next_frame_ns = now;
+        return;
+    }
+
+    pacer->clock.sleep_until(pacer->clock.user_data, pacer->next_frame_ns);
+    pacer->stats.limiter_ns += pacer->next_frame_ns - now;
+}
+
+uint64_t frame_pacer::now(const FramePacer *pacer) {
+    return pacer->clock.now(pacer->clock.user_data);
+}
+
+void frame_pacer::record_present(PresentStats *stats, uint64_t input_ns, uint64_t present_ns) {
+    if (stats->presents > 0) {
+        add_interval(present_ns - stats->last_present_ns, &stats->intervals, &stats->interval_sum_ns, &stats->interval_sq_sum_ms, &stats->interval_max_ns);
+    }
+    stats->presents++;
+    stats->last_present_ns = present_ns;
+
+    uint64_t latency = present_ns > input_ns ? present_ns - input_ns : 0;
+    stats->latency_sum_ns += latency;
+    if (latency > stats->latency_max_ns) {
+        stats->latency_max_ns = latency;
+    }
+}
+
+void frame_pacer::reset_present_stats(PresentStats *stats) {
+    *stats = {};
+}
+
+void frame_pacer::log_stats(const FramePacer *pacer, const PresentStats *present) {
+    const PacerStats *stats = &pacer->stats;
+    if (stats->intervals > 0) {
+        LOG("frame_pacer: %u frames of %.2f ms (%.2f jitter, %.2f max), %.2f steps per frame (%u max), %.1f ms dropped, %.1f ms limited",
+            stats->frames, stats->interval_sum_ns / 1e6 / stats->intervals, jitter_ms(stats->intervals, stats->interval_sum_ns, stats->interval_sq_sum_ms),
+            stats->interval_max_ns / 1e6, stats->steps / (double)stats->frames, stats->max_steps_per_frame, stats->dropped_ns / 1e6, stats->limiter_ns / 1e6);
+    }
+
+    if (present && present->intervals > 0) {
+        LOG("frame_pacer: %u presents every %.2f ms (%.2f jitter, %.2f max), input to present %.2f ms (%.2f max)",
+            present->presents, present->interval_sum_ns / 1e6 / present->intervals, jitter_ms(present->intervals, present->interval_sum_ns, present->interval_sq_sum_ms),
+            present->interval_max_ns / 1e6, present->latency_sum_ns / 1e6 / present->presents, present->latency_max_ns / 1e6);
+    }
+}
+
+static uint64_t system_now(void *user_data) {
+    (void)user_data;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void system_sleep_until(void *user_data, uint64_t deadline_ns) {
+    uint64_t now = system_now(user_data);
+    if (now + PACER_SPIN_NS < deadline_ns) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline_ns - now - PACER_SPIN_NS));
+    }
+    while (system_now(user_data) < deadline_ns) {
+        std::this_thread::yield();
+    }
+}
+
+static void add_interval(uint64_t interval_ns, uint32_t *count, uint64_t *sum_ns, double *sq_sum_ms, uint64_t *max_ns) {
+    double ms = interval_ns / 1e6;
+    (*count)++;
+    *sum_ns += interval_ns;
+    *sq_sum_ms += ms * ms;
+    if (interval_ns > *max_ns) {
+        *max_ns = interval_ns;
+    }
+}
+
+static double jitter_ms(uint32_t count, uint64_t sum_ns, double sq_sum_ms) {
+    // Standard deviation of the intervals
+    double mean = sum_ns / 1e6 / count;
+    double variance = sq_sum_ms / count - mean * mean;
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
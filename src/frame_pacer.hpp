@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed timestep updates on a variable frame rate. Every frame the elapsed
+// time goes into an accumulator and comes out as whole steps, what's left is
+// the alpha to interpolate the last two steps with. A frame limiter can hold
+// frames to a minimum length on the CPU.
+//
+// Time comes from a PacerClock so the pacing can be driven by a fake clock
+// (the frame_pacer tests and the pacing bench do), system_clock is the real one.
+//
+// Too many steps in one frame (a hitch, a breakpoint) and the rest of the time
+// is dropped instead of caught up with.
+#define PACER_DEFAULT_MAX_STEPS 5
+
+// Nanoseconds since some point, never going back
+typedef uint64_t (*PacerNowFn)(void *user_data);
+// Returns once now is at deadline_ns or later
+typedef void (*PacerSleepFn)(void *user_data, uint64_t deadline_ns);
+
+struct PacerClock {
+    PacerNowFn now;
+    PacerSleepFn sleep_until;
+    void *user_data;
+};
+
+// Since initialize or the last reset_stats
+struct PacerStats {
+    uint32_t frames;
+    uint32_t steps;
+    uint32_t max_steps_per_frame;
+    uint64_t dropped_ns;    // Time past max_steps, never simulated
+    uint64_t limiter_ns;    // Time the limiter waited
+    // Begin to begin, the first frame has none
+    uint32_t intervals;
+    uint64_t interval_sum_ns;
+    double interval_sq_sum_ms; // For the jitter
+    uint64_t interval_max_ns;
+};
+
+// What made it to the screen, recorded by whoever presents
+struct PresentStats {
+    uint32_t presents;
+    uint64_t last_present_ns;
+    uint32_t intervals;
+    uint64_t interval_sum_ns;
+    double interval_sq_sum_ms;
+    uint64_t interval_max_ns;
+    // Input sampled to Present returned. The GPU queue and scanout come on
+    // top, the frames in flight limit bounds those.
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+};
+
+struct FramePacer {
+    PacerClock clock;
+    uint64_t step_ns;
+    uint64_t min_frame_ns; // 0 is no limit
+    uint32_t max_steps;
+
+    bool has_begun;
+    uint64_t frame_begin_ns;
+    uint64_t accumulator_ns;
+    uint64_t next_frame_ns;  // Where the limiter lets the next frame begin
+    float alpha;
+
+    PacerStats stats;
+};
+
+namespace frame_pacer {
+
+PacerClock system_clock();
+
+// max_fps 0 turns the limiter off, max_steps 0 uses PACER_DEFAULT_MAX_STEPS
+void initialize(FramePacer *pacer, PacerClock clock, float step_seconds, float max_fps, uint32_t max_steps);
+void reset_stats(FramePacer *pacer);
+
+// Returns how many fixed steps to run this frame, can be 0
+uint32_t begin_frame(FramePacer *pacer);
+// Between the state before the last step (0) and after it (1)
+float get_alpha(const FramePacer *pacer);
+// Waits out the rest of the frame when the limiter is on
+void end_frame(FramePacer *pacer);
+uint64_t now(const FramePacer *pacer);
+
+void record_present(PresentStats *stats, uint64_t input_ns, uint64_t present_ns);
+void reset_present_stats(PresentStats *stats);
+
+// One line each, present can be NULL
+void log_stats(const FramePacer *pacer, const PresentStats *present);
+
+} // namespace frame_pacer
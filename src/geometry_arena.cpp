@@ -0,0 +1,151 @@
+#include "geometry_arena.hpp"
+
+#include "logger.hpp"
+#include "memory_tracker.hpp"
+
+#include <cassert>
+
+static bool create_buffers(ID3D11Device *device, uint32_t vertex_bytes, uint32_t index_bytes,
+                           ID3D11Buffer **out_vertex_buffer, ID3D11Buffer **out_index_buffer);
+static void upload(ID3D11DeviceContext *context, ID3D11Buffer *buffer, uint32_t byte_offset, uint32_t byte_size, const void *data);
+static void copy_moved(ID3D11DeviceContext *context, ID3D11Buffer *dst, ID3D11Buffer *src, uint32_t stride,
+                       const RangeAllocator *allocator, const RangeMove *moves, uint32_t move_count);
+
+bool geometry_arena::initialize(GeometryArena *arena, ID3D11Device *device, uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity) {
+    assert(arena && device && "geometry_arena::initialize: Arena and device cannot be NULL");
+
+    arena->vertex_stride = vertex_stride;
+    if (!create_buffers(device, vertex_stride * vertex_capacity, sizeof(uint32_t) * index_capacity,
+                        arena->vertex_buffer_ptr.ReleaseAndGetAddressOf(), arena->index_buffer_ptr.ReleaseAndGetAddressOf())) {
+        LOG("%s: Couldn't create the geometry buffers", __func__);
+        return false;
+    }
+
+    range_allocator::initialize(&arena->vertices, vertex_capacity);
+    range_allocator::initialize(&arena->indices, index_capacity);
+    return true;
+}
+
+bool geometry_arena::allocate(GeometryArena *arena, ID3D11DeviceContext *context,
+                              const void *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count,
+                              RangeAllocation *out_vertices, RangeAllocation *out_indices) {
+    RangeAllocation vertex_range = range_allocator::allocate(&arena->vertices, vertex_count);
+    if (vertex_range.node == RANGE_ALLOCATOR_NONE) {
+        return false;
+    }
+
+    RangeAllocation index_range = range_allocator::allocate(&arena->indices, index_count);
+    if (index_range.node == RANGE_ALLOCATOR_NONE) {
+        range_allocator::release(&arena->vertices, vertex_range);
+        return false;
+    }
+
+    upload(context, arena->vertex_buffer_ptr.Get(), vertex_range.offset * arena->vertex_stride, vertex_count * arena->vertex_stride, vertices);
+    upload(context, arena->index_buffer_ptr.Get(), index_range.offset * sizeof(uint32_t), index_count * sizeof(uint32_t), indices);
+
+    *out_vertices = vertex_range;
+    *out_indices = index_range;
+    return true;
+}
+
+void geometry_arena::release(GeometryArena *arena, RangeAllocation vertices, RangeAllocation indices) {
+    range_allocator::release(&arena->vertices, vertices);
+    range_allocator::release(&arena->indices, indices);
+}
+
+bool geometry_arena::fits_after_compact(GeometryArena *arena, uint32_t vertex_count, uint32_t index_count) {
+    return vertex_count <= arena->vertices.free_units && index_count <= arena->indices.free_units;
+}
+
+bool geometry_arena::compact(GeometryArena *arena, ID3D11Device *device, ID3D11DeviceContext *context) {
+    // Ranges can't be copied within the same buffer when they overlap, and
+    // when packing they mostly do. So it all goes into fresh buffers.
+    Microsoft::WRL::ComPtr<ID3D11Buffer> vertex_buffer_ptr;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> index_buffer_ptr;
+    if (!create_buffers(device, arena->vertex_stride * arena->vertices.capacity, sizeof(uint32_t) * arena->indices.capacity,
+                        vertex_buffer_ptr.GetAddressOf(), index_buffer_ptr.GetAddressOf())) {
+        LOG("%s: Couldn't create the new geometry buffers, keeping the old ones", __func__);
+        return false;
+    }
+
+    RangeMove moves[RANGE_ALLOCATOR_MAX_NODES];
+    uint32_t move_count = range_allocator::compact(&arena->vertices, moves, RANGE_ALLOCATOR_MAX_NODES);
+    copy_moved(context, vertex_buffer_ptr.Get(), arena->vertex_buffer_ptr.Get(), arena->vertex_stride, &arena->vertices, moves, move_count);
+    uint32_t vertex_moves = move_count;
+
+    move_count = range_allocator::compact(&arena->indices, moves, RANGE_ALLOCATOR_MAX_NODES);
+    copy_moved(context, index_buffer_ptr.Get(), arena->index_buffer_ptr.Get(), sizeof(uint32_t), &arena->indices, moves, move_count);
+
+    arena->vertex_buffer_ptr = vertex_buffer_ptr;
+    arena->index_buffer_ptr = index_buffer_ptr;
+    // The old ones go with the last reference, they were as big as the new ones
+    memory_tracker::untrack(MEMORY_TAG_MESHES, MEMORY_DOMAIN_GPU, (uint64_t)arena->vertex_stride * arena->vertices.capacity);
+    memory_tracker::untrack(MEMORY_TAG_MESHES, MEMORY_DOMAIN_GPU, (uint64_t)sizeof(uint32_t) * arena->indices.capacity);
+
+    LOG("%s: Moved %u vertex and %u index ranges", __func__, vertex_moves, move_count);
+    return true;
+}
+
+static bool create_buffers(ID3D11Device *device, uint32_t vertex_bytes, uint32_t index_bytes,
+                           ID3D11Buffer **out_vertex_buffer, ID3D11Buffer **out_index_buffer) {
+    D3D11_BUFFER_DESC desc = {};
+    desc.ByteWidth = vertex_bytes;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    desc.CPUAccessFlags = 0;
+
+    HRESULT hr = device->CreateBuffer(&desc, nullptr, out_vertex_buffer);
+    if (FAILED(hr)) {
+        LOG("%s: Vertex buffer couldn't be created", __func__);
+        return false;
+    }
+
+    desc.ByteWidth = index_bytes;
+    desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+    hr = device->CreateBuffer(&desc, nullptr, out_index_buffer);
+    if (FAILED(hr)) {
+        LOG("%s: Index buffer couldn't be created", __func__);
+        (*out_vertex_buffer)->Release();
+        *out_vertex_buffer = nullptr;
+        return false;
+    }
+
+    memory_tracker::track(MEMORY_TAG_MESHES, MEMORY_DOMAIN_GPU, vertex_bytes);
+    memory_tracker::track(MEMORY_TAG_MESHES, MEMORY_DOMAIN_GPU, index_bytes);
+    return true;
+}
+
+static void upload(ID3D11DeviceContext *context, ID3D11Buffer *buffer, uint32_t byte_offset, uint32_t byte_size, const void *data) {
+    D3D11_BOX box = {};
+    box.left = byte_offset;
+    box.right = byte_offset + byte_size;
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+    context->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+}
+
+static void copy_moved(ID3D11DeviceContext *context, ID3D11Buffer *dst, ID3D11Buffer *src, uint32_t stride,
+                       const RangeAllocator *allocator, const RangeMove *moves, uint32_t move_count) {
+    D3D11_BOX box = {};
+    box.top = 0;
+    box.bottom = 1;
+    box.front = 0;
+    box.back = 1;
+
+    // Everything in front of the first gap stayed where it was, that's one copy
+    uint32_t kept = move_count > 0 ? moves[0].to : allocator->capacity - allocator->free_units;
+    if (kept > 0) {
+        box.left = 0;
+        box.right = kept * stride;
+        context->CopySubresourceRegion(dst, 0, 0, 0, 0, src, 0, &box);
+    }
+
+    for (uint32_t i = 0; i < move_count; ++i) {
+        box.left = moves[i].from * stride;
+        box.right = (moves[i].from + moves[i].size) * stride;
+        context->CopySubresourceRegion(dst, 0, moves[i].to * stride, 0, 0, src, 0, &box);
+    }
+}
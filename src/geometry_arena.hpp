@@ -0,0 +1,39 @@
+#pragma once
+
+#include "range_allocator.hpp"
+
+#include <cstdint>
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// One vertex buffer and one index buffer that every mesh lives in, so the
+// passes bind them once and draw with offsets. The ranges are handed out by
+// a RangeAllocator each, in vertices and in indices. Indices stay relative to
+// the mesh's first vertex, draws pass that as the base vertex.
+struct GeometryArena {
+    Microsoft::WRL::ComPtr<ID3D11Buffer> vertex_buffer_ptr;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> index_buffer_ptr;
+    uint32_t vertex_stride;
+
+    RangeAllocator vertices;
+    RangeAllocator indices;
+};
+
+namespace geometry_arena {
+
+bool initialize(GeometryArena *arena, ID3D11Device *device, uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity);
+
+// Reserves the ranges and uploads the data into them. Fails when either
+// buffer doesn't have a free range that big, nothing is kept then.
+bool allocate(GeometryArena *arena, ID3D11DeviceContext *context,
+              const void *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count,
+              RangeAllocation *out_vertices, RangeAllocation *out_indices);
+void release(GeometryArena *arena, RangeAllocation vertices, RangeAllocation indices);
+
+// True when the ranges would fit if the free space was in one piece
+bool fits_after_compact(GeometryArena *arena, uint32_t vertex_count, uint32_t index_count);
+// Packs every range to the front of new buffers (copied on the GPU) and drops
+// the old ones. Offsets change, read them again with range_allocator::get.
+bool compact(GeometryArena *arena, ID3D11Device *device, ID3D11DeviceContext *context);
+
+} // namespace geometry_arena
@@ -0,0 +1,468 @@
+#include "job_system.hpp"
+
+#include <cassert>
+
+// Which system the thread belongs to and its worker index, 0 is the main thread
+static thread_local JobSystem *t_system = nullptr;
+static thread_local uint32_t t_index = 0;
+
+static void worker_main(JobSystem *system, uint32_t index);
+static JobWorker *current_worker(JobSystem *system);
+static Job *allocate_job(JobSystem *system, JobWorker *worker);
+static void submit(JobSystem *system, Job *job);
+static void submit_after(JobSystem *system, JobCounter *dependency, Job *job);
+static Job *find_job(JobSystem *system, uint32_t index);
+static Job *pop_main(JobSystem *system);
+static void execute(JobSystem *system, Job *job);
+static void finish(JobSystem *system, JobCounter *counter);
+static void wake_one(JobSystem *system);
+static bool deque_push(JobDeque *deque, Job *job);
+static Job *deque_pop(JobDeque *deque);
+static Job *deque_steal(JobDeque *deque);
+static uint32_t next_random(uint32_t *state);
+
+bool job_system::initialize(JobSystem *system, uint32_t worker_count) {
+    assert(system && "job_system::initialize: System pointer cannot be NULL");
+
+    if (worker_count == 0) {
+        uint32_t cores = std::thread::hardware_concurrency();
+        worker_count = cores > 1 ? cores - 1 : 1;
+    }
+    if (worker_count > JOB_SYSTEM_MAX_WORKERS) {
+        worker_count = JOB_SYSTEM_MAX_WORKERS;
+    }
+
+    system->workers = new JobWorker[worker_count + 1];
+    for (uint32_t i = 0; i <= worker_count; ++i) {
+        JobWorker *worker = &system->workers[i];
+        worker->deque.top.store(0, std::memory_order_relaxed);
+        worker->deque.bottom.store(0, std::memory_order_relaxed);
+        for (uint32_t j = 0; j < JOB_SYSTEM_JOB_POOL; ++j) {
+            worker->pool[j].is_taken.store(false, std::memory_order_relaxed);
+        }
+        worker->next_job = 0;
+        worker->rng = 0x9E3779B9u * (i + 1);
+    }
+
+    system->worker_count = worker_count;
+    system->queued.store(0);
+    system->sleepers.store(0);
+    system->stopping.store(false);
+    system->main_head = 0;
+    system->main_count = 0;
+    system->jobs_run.store(0);
+    system->jobs_stolen.store(0);
+
+    t_system = system;
+    t_index = 0;
+
+    for (uint32_t i = 0; i < worker_count; ++i) {
+        system->threads[i] = std::thread(worker_main, system, i + 1);
+    }
+
+    return true;
+}
+
+void job_system::shutdown(JobSystem *system) {
+    {
+        std::lock_guard<std::mutex> lock(system->sleep_mutex);
+        system->stopping.store(true);
+    }
+    system->wake.notify_all();
+
+    for (uint32_t i = 0; i < system->worker_count; ++i) {
+        system->threads[i].join();
+    }
+    system->worker_count = 0;
+
+    delete[] system->workers;
+    system->workers = nullptr;
+    if (t_system == system) {
+        t_system = nullptr;
+    }
+}
+
+void job_system::run(JobSystem *system, const JobDecl *jobs, uint32_t count, JobCounter *counter) {
+    JobWorker *worker = current_worker(system);
+    if (counter) {
+        counter->value.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Job *job = allocate_job(system, worker);
+        job->fn = jobs[i].fn;
+        job->data = jobs[i].data;
+        job->counter = counter;
+        submit(system, job);
+    }
+}
+
+void job_system::run_after(JobSystem *system, JobCounter *dependency, const JobDecl *jobs, uint32_t count, JobCounter *counter) {
+    assert(dependency && "job_system::run_after: Dependency cannot be NULL");
+    if (count == 0) {
+        return;
+    }
+
+    JobWorker *worker = current_worker(system);
+    if (counter) {
+        counter->value.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Handed over one by one, a job run while allocating (see allocate_job)
+    // could otherwise wait forever on a slot that's only in a local list
+    for (uint32_t i = 0; i < count; ++i) {
+        Job *job = allocate_job(system, worker);
+        job->fn = jobs[i].fn;
+        job->data = jobs[i].data;
+        job->counter = counter;
+        submit_after(system, dependency, job);
+    }
+}
+
+void job_system::run_on_main(JobSystem *system, const JobDecl *jobs, uint32_t count, JobCounter *counter) {
+    JobWorker *worker = current_worker(system);
+    if (counter) {
+        counter->value.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Job *job = allocate_job(system, worker);
+        job->fn = jobs[i].fn;
+        job->data = jobs[i].data;
+        job->counter = counter;
+        job->is_main_thread = true;
+        submit(system, job);
+    }
+}
+
+uint32_t job_system::run_main_jobs(JobSystem *system) {
+    assert(is_main_thread(system) && "job_system::run_main_jobs: Only on the main thread");
+
+    uint32_t ran = 0;
+    while (Job *job = pop_main(system)) {
+        execute(system, job);
+        ran++;
+    }
+    return ran;
+}
+
+void job_system::wait(JobSystem *system, JobCounter *counter) {
+    current_worker(system);
+
+    while (counter->value.load(std::memory_order_acquire) != 0) {
+        Job *job = find_job(system, t_index);
+        if (!job && t_index == 0) {
+            job = pop_main(system);
+        }
+
+        if (job) {
+            execute(system, job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    // The last job takes the counter to 0 under the lock, it may not be out of it yet
+    std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+void job_system::parallel_for(JobSystem *system, uint32_t count, uint32_t batch_size, JobRangeFn fn, void *data) {
+    if (count == 0) {
+        return;
+    }
+    batch_size = batch_size > 0 ? batch_size : 1;
+
+    JobWorker *worker = current_worker(system);
+    JobCounter counter;
+    counter.value.store((count + batch_size - 1) / batch_size, std::memory_order_relaxed);
+
+    for (uint32_t begin = 0; begin < count; begin += batch_size) {
+        Job *job = allocate_job(system, worker);
+        job->range_fn = fn;
+        job->data = data;
+        job->begin = begin;
+        job->end = count - begin > batch_size ? begin + batch_size : count;
+        job->counter = &counter;
+        submit(system, job);
+    }
+
+    wait(system, &counter);
+}
+
+bool job_system::is_main_thread(const JobSystem *system) {
+    return t_system == system && t_index == 0;
+}
+
+void job_system::release_main_thread(JobSystem *system) {
+    assert(is_main_thread(system) && "job_system::release_main_thread: Not the main thread");
+    t_system = nullptr;
+}
+
+void job_system::acquire_main_thread(JobSystem *system) {
+    assert(!t_system && "job_system::acquire_main_thread: Thread is part of a job system already");
+    t_system = system;
+    t_index = 0;
+}
+
+static void worker_main(JobSystem *system, uint32_t index) {
+    t_system = system;
+    t_index = index;
+
+    // Spin a little before sleeping, a frame's jobs tend to come in bursts
+    uint32_t idle = 0;
+    while (!system->stopping.load(std::memory_order_acquire)) {
+        Job *job = find_job(system, index);
+        if (job) {
+            execute(system, job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+
+        // Whoever queues a job sees the sleeper and wakes it, or gets seen here
+        system->sleepers.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(system->sleep_mutex);
+            system->wake.wait(lock, [system] { return system->queued.load() > 0 || system->stopping.load(); });
+        }
+        system->sleepers.fetch_sub(1);
+    }
+}
+
+static JobWorker *current_worker(JobSystem *system) {
+    assert(t_system == system && "job_system: Only the main thread and the workers can use the jobs");
+    return &system->workers[t_index];
+}
+
+static Job *allocate_job(JobSystem *system, JobWorker *worker) {
+    for (;;) {
+        Job *job = &worker->pool[worker->next_job % JOB_SYSTEM_JOB_POOL];
+        if (!job->is_taken.load(std::memory_order_acquire)) {
+            worker->next_job++;
+            job->is_taken.store(true, std::memory_order_relaxed);
+            job->fn = nullptr;
+            job->range_fn = nullptr;
+            job->data = nullptr;
+            job->begin = 0;
+            job->end = 0;
+            job->counter = nullptr;
+            job->next = nullptr;
+            job->is_main_thread = false;
+            return job;
+        }
+
+        // Went all the way around the pool, help until the oldest job is done
+        Job *other = find_job(system, t_index);
+        if (!other && t_index == 0) {
+            other = pop_main(system);
+        }
+        if (other) {
+            execute(system, other);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void submit(JobSystem *system, Job *job) {
+    if (job->is_main_thread) {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(system->main_mutex);
+                if (system->main_count < JOB_SYSTEM_MAIN_QUEUE) {
+                    system->main_queue[(system->main_head + system->main_count) % JOB_SYSTEM_MAIN_QUEUE] = job;
+                    system->main_count++;
+                    return;
+                }
+            }
+
+            // Full, the main thread runs it now or it has to catch up first
+            if (job_system::is_main_thread(system)) {
+                execute(system, job);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // No room, slower but still correct
+    if (!deque_push(&current_worker(system)->deque, job)) {
+        execute(system, job);
+        return;
+    }
+
+    system->queued.fetch_add(1);
+    wake_one(system);
+}
+
+static void submit_after(JobSystem *system, JobCounter *dependency, Job *job) {
+    // Checked under the lock, the step to 0 is made under it too
+    {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->value.load(std::memory_order_acquire) != 0) {
+            job->next = dependency->dependents;
+            dependency->dependents = job;
+            return;
+        }
+    }
+
+    submit(system, job);
+}
+
+static Job *find_job(JobSystem *system, uint32_t index) {
+    JobWorker *self = &system->workers[index];
+    Job *job = deque_pop(&self->deque);
+    if (job) {
+        system->queued.fetch_sub(1);
+        return job;
+    }
+
+    uint32_t thread_count = system->worker_count + 1;
+    uint32_t start = next_random(&self->rng) % thread_count;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        uint32_t victim = (start + i) % thread_count;
+        if (victim == index) {
+            continue;
+        }
+
+        job = deque_steal(&system->workers[victim].deque);
+        if (job) {
+            system->queued.fetch_sub(1);
+            system->jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+static Job *pop_main(JobSystem *system) {
+    std::lock_guard<std::mutex> lock(system->main_mutex);
+    if (system->main_count == 0) {
+        return nullptr;
+    }
+
+    Job *job = system->main_queue[system->main_head];
+    system->main_head = (system->main_head + 1) % JOB_SYSTEM_MAIN_QUEUE;
+    system->main_count--;
+    return job;
+}
+
+static void execute(JobSystem *system, Job *job) {
+    // The slot is given back before the job runs. Jobs it runs while it waits
+    // (or while it looks for a free slot itself) can come around to it then.
+    Job run = {job->fn, job->range_fn, job->data, job->begin, job->end, job->counter, nullptr, false, {}};
+    job->is_taken.store(false, std::memory_order_release);
+
+    if (run.range_fn) {
+        run.range_fn(run.data, run.begin, run.end);
+    } else {
+        run.fn(run.data);
+    }
+    system->jobs_run.fetch_add(1, std::memory_order_relaxed);
+
+    finish(system, run.counter);
+}
+
+static void finish(JobSystem *system, JobCounter *counter) {
+    if (!counter) {
+        return;
+    }
+
+    // Not the last one, no need for the lock
+    uint32_t value = counter->value.load(std::memory_order_relaxed);
+    while (value > 1) {
+        if (counter->value.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+
+    // Maybe the last one. run_after looks at the value under the lock, so
+    // dependents are either taken here or never held back.
+    Job *dependents = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            dependents = counter->dependents;
+            counter->dependents = nullptr;
+        }
+    }
+
+    while (dependents) {
+        Job *next = dependents->next;
+        submit(system, dependents);
+        dependents = next;
+    }
+}
+
+static void wake_one(JobSystem *system) {
+    if (system->sleepers.load() > 0) {
+        // Taking the lock orders this after a sleeper's check of queued
+        { std::lock_guard<std::mutex> lock(system->sleep_mutex); }
+        system->wake.notify_one();
+    }
+}
+
+static bool deque_push(JobDeque *deque, Job *job) {
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    if (bottom - top >= JOB_SYSTEM_DEQUE_SIZE) {
+        return false;
+    }
+
+    deque->jobs[bottom & (JOB_SYSTEM_DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+    deque->bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+static Job *deque_pop(JobDeque *deque) {
+    // Claims the bottom slot first, a thief that comes after sees it's gone
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_seq_cst);
+
+    if (top > bottom) {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = deque->jobs[bottom & (JOB_SYSTEM_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // The last one, a thief may be after it too
+        if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+static Job *deque_steal(JobDeque *deque) {
+    int64_t top = deque->top.load(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_seq_cst);
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    // Lost to the owner or another thief when the top moved meanwhile
+    Job *job = deque->jobs[top & (JOB_SYSTEM_DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+    if (!deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+static uint32_t next_random(uint32_t *state) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
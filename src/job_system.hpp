@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Work stealing jobs over one worker thread per core (but the main thread's).
+// Every thread has its own Chase-Lev deque: it pushes and pops at the bottom
+// (newest first, still warm in the cache), idle threads steal from the top of
+// somebody else's. The main thread has a deque too, its jobs get stolen while
+// it does something else and it helps out whenever it waits.
+//
+// Jobs report to a counter. job_system::wait runs other jobs until the
+// counter is back to 0, and jobs can be held back until another counter is
+// done (run_after). Jobs that need the device (or anything else that's main
+// thread only) go through run_on_main and are run by run_main_jobs.
+//
+// Only the main thread (the one that called initialize, or took over with
+// acquire_main_thread) and the workers may submit jobs.
+#define JOB_SYSTEM_MAX_WORKERS 16
+// Queued jobs per thread, a power of two. When a deque is full the job runs
+// right away on the thread that submitted it.
+#define JOB_SYSTEM_DEQUE_SIZE 4096
+// Job storage per thread, a ring. Submitting waits (and helps) when the next
+// slot is still taken by a job that hasn't run.
+#define JOB_SYSTEM_JOB_POOL 4096
+#define JOB_SYSTEM_MAIN_QUEUE 1024
+
+typedef void (*JobFn)(void *data);
+// parallel_for's jobs get a range of the items
+typedef void (*JobRangeFn)(void *data, uint32_t begin, uint32_t end);
+
+struct Job;
+
+// Counts the jobs that aren't done yet. Zero initialized is ready to use, it
+// can be reused once it's back to 0.
+struct JobCounter {
+    std::atomic<uint32_t> value;
+    std::mutex mutex;          // Guards dependents, and the step to 0
+    Job *dependents = nullptr; // Held back by run_after
+};
+
+struct JobDecl {
+    JobFn fn;
+    void *data;
+};
+
+struct Job {
+    JobFn fn;
+    JobRangeFn range_fn;
+    void *data;
+    uint32_t begin;
+    uint32_t end;
+    JobCounter *counter; // Can be NULL
+    Job *next;           // In the list of a counter's dependents
+    bool is_main_thread;
+    std::atomic<bool> is_taken; // Pool slot in use
+};
+
+// Chase-Lev deque of jobs (with the fixes from Le et al. for weak memory).
+// The owner pushes and pops at the bottom, thieves take from the top.
+struct JobDeque {
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<Job *> jobs[JOB_SYSTEM_DEQUE_SIZE];
+};
+
+struct JobWorker {
+    JobDeque deque;
+    Job pool[JOB_SYSTEM_JOB_POOL];
+    uint32_t next_job; // Owner only
+    uint32_t rng;      // Owner only, picks whom to steal from first
+};
+
+struct JobSystem {
+    // 0 is the main thread, the rest are the worker threads
+    JobWorker *workers;
+    uint32_t worker_count;
+    std::thread threads[JOB_SYSTEM_MAX_WORKERS];
+
+    // Jobs that are in a deque, workers sleep while it's 0
+    std::atomic<int32_t> queued;
+    std::atomic<uint32_t> sleepers;
+    std::atomic<bool> stopping;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+
+    // Main thread jobs, ring buffer guarded by main_mutex
+    std::mutex main_mutex;
+    Job *main_queue[JOB_SYSTEM_MAIN_QUEUE];
+    uint32_t main_head;
+    uint32_t main_count;
+
+    // Stats, reset by whoever reads them
+    std::atomic<uint32_t> jobs_run;
+    std::atomic<uint32_t> jobs_stolen;
+};
+
+namespace job_system {
+
+// On the main thread. worker_count 0 starts one less than the core count
+// (at least one), at most JOB_SYSTEM_MAX_WORKERS.
+bool initialize(JobSystem *system, uint32_t worker_count);
+// Every counter has to be waited on before, queued jobs are dropped
+void shutdown(JobSystem *system);
+
+// counter (can be NULL) goes up by count right away and down as the jobs finish
+void run(JobSystem *system, const JobDecl *jobs, uint32_t count, JobCounter *counter);
+// Same, but the jobs only start once dependency is back to 0
+void run_after(JobSystem *system, JobCounter *dependency, const JobDecl *jobs, uint32_t count, JobCounter *counter);
+// Queued for the main thread, run by run_main_jobs (or a wait on the main thread)
+void run_on_main(JobSystem *system, const JobDecl *jobs, uint32_t count, JobCounter *counter);
+// Main thread, once a frame. Runs what's queued (and queued meanwhile), returns how many.
+uint32_t run_main_jobs(JobSystem *system);
+
+// Runs jobs until the counter is 0, the main thread runs main thread jobs too.
+// The counter can be destroyed once this returns.
+void wait(JobSystem *system, JobCounter *counter);
+
+// Splits [0, count) into batches of batch_size items, runs fn on every batch
+// and waits for all of them
+void parallel_for(JobSystem *system, uint32_t count, uint32_t batch_size, JobRangeFn fn, void *data);
+
+bool is_main_thread(const JobSystem *system);
+// Hands the main thread's part to another thread (the render thread): the
+// current one releases it, then the other one acquires it. Main thread jobs
+// queue up in between.
+void release_main_thread(JobSystem *system);
+void acquire_main_thread(JobSystem *system);
+
+} // namespace job_system
@@ -8,6 +8,8 @@ struct Renderer;
 
 enum LightType {
     LIGHT_TYPE_DIRECTIONAL,
+    LIGHT_TYPE_POINT,
+    LIGHT_TYPE_SPOT,
 };
 
 using LightId = Id;
@@ -18,9 +20,17 @@ struct Light {
     LightType type;
     DirectX::XMFLOAT3 color;
     float intensity;
+
+    // Point and spot lights only, the light has no effect past the range
+    float range;
+    // Spot lights only, half angles in radians
+    float spot_inner_angle;
+    float spot_outer_angle;
 };
 
 namespace light {
     LightId create(LightType type, DirectX::XMFLOAT3 color, float intensity);
+    LightId create_point(DirectX::XMFLOAT3 color, float intensity, float range);
+    LightId create_spot(DirectX::XMFLOAT3 color, float intensity, float range, float inner_angle, float outer_angle);
     Light *get(Renderer *renderer, LightId id);
 };
@@ -0,0 +1,232 @@
+#include "light_cluster.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define LIGHT_CLUSTER_SSE 1
+#include <xmmintrin.h>
+#else
+#define LIGHT_CLUSTER_SSE 0
+#endif
+
+static bool test_cluster(const LightClusterGrid *grid, uint32_t c, const ClusterLight *light);
+static void append_light(LightClusterList *list, uint32_t cluster, uint32_t light_index);
+
+void light_cluster::build_grid(LightClusterGrid *grid, float proj_x, float proj_y, float znear, float zfar) {
+    assert(grid && "light_cluster::build_grid: grid pointer cannot be NULL");
+    assert(znear > 0.0f && zfar > znear && "light_cluster::build_grid: Invalid depth range");
+
+    grid->proj_x = proj_x;
+    grid->proj_y = proj_y;
+    grid->znear = znear;
+    grid->zfar = zfar;
+
+    float log_ratio = logf(zfar / znear);
+    grid->z_scale = CLUSTER_GRID_Z / log_ratio;
+    grid->z_bias = -CLUSTER_GRID_Z * logf(znear) / log_ratio;
+
+    for (uint32_t z = 0; z < CLUSTER_GRID_Z; ++z) {
+        // Exponential slicing, so clusters stay roughly cube shaped in view space
+        float slice_near = znear * powf(zfar / znear, (float)z / CLUSTER_GRID_Z);
+        float slice_far = znear * powf(zfar / znear, (float)(z + 1) / CLUSTER_GRID_Z);
+
+        for (uint32_t y = 0; y < CLUSTER_GRID_Y; ++y) {
+            // Row 0 is the top of the screen
+            float ndc_top = 1.0f - 2.0f * (float)y / CLUSTER_GRID_Y;
+            float ndc_bottom = 1.0f - 2.0f * (float)(y + 1) / CLUSTER_GRID_Y;
+
+            for (uint32_t x = 0; x < CLUSTER_GRID_X; ++x) {
+                float ndc_left = -1.0f + 2.0f * (float)x / CLUSTER_GRID_X;
+                float ndc_right = -1.0f + 2.0f * (float)(x + 1) / CLUSTER_GRID_X;
+
+                // The tile's frustum corners at both slice depths, and their bounds.
+                // Unprojecting is just ndc * z / proj for a perspective projection.
+                float xs[4] = {
+                    ndc_left * slice_near / proj_x, ndc_right * slice_near / proj_x,
+                    ndc_left * slice_far / proj_x, ndc_right * slice_far / proj_x};
+                float ys[4] = {
+                    ndc_bottom * slice_near / proj_y, ndc_top * slice_near / proj_y,
+                    ndc_bottom * slice_far / proj_y, ndc_top * slice_far / proj_y};
+
+                float min_x = fminf(fminf(xs[0], xs[1]), fminf(xs[2], xs[3]));
+                float max_x = fmaxf(fmaxf(xs[0], xs[1]), fmaxf(xs[2], xs[3]));
+                float min_y = fminf(fminf(ys[0], ys[1]), fminf(ys[2], ys[3]));
+                float max_y = fmaxf(fmaxf(ys[0], ys[1]), fmaxf(ys[2], ys[3]));
+
+                uint32_t c = x + y * CLUSTER_GRID_X + z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+                grid->min_x[c] = min_x;
+                grid->min_y[c] = min_y;
+                grid->min_z[c] = slice_near;
+                grid->max_x[c] = max_x;
+                grid->max_y[c] = max_y;
+                grid->max_z[c] = slice_far;
+
+                float hx = (max_x - min_x) * 0.5f;
+                float hy = (max_y - min_y) * 0.5f;
+                float hz = (slice_far - slice_near) * 0.5f;
+                grid->center_x[c] = min_x + hx;
+                grid->center_y[c] = min_y + hy;
+                grid->center_z[c] = slice_near + hz;
+                grid->radius[c] = sqrtf(hx * hx + hy * hy + hz * hz);
+            }
+        }
+    }
+}
+
+bool light_cluster::grid_matches(const LightClusterGrid *grid, float proj_x, float proj_y, float znear, float zfar) {
+    return grid->proj_x == proj_x && grid->proj_y == proj_y && grid->znear == znear && grid->zfar == zfar;
+}
+
+uint32_t light_cluster::get_slice(const LightClusterGrid *grid, float view_z) {
+    if (view_z <= grid->znear) {
+        return 0;
+    }
+
+    int slice = (int)floorf(logf(view_z) * grid->z_scale + grid->z_bias);
+    if (slice < 0) return 0;
+    if (slice >= CLUSTER_GRID_Z) return CLUSTER_GRID_Z - 1;
+    return (uint32_t)slice;
+}
+
+void light_cluster::assign_reference(const LightClusterGrid *grid, const ClusterLight *lights, uint32_t light_count, LightClusterList *out_list) {
+    assert(grid && out_list && "light_cluster::assign_reference: grid and out_list pointers cannot be NULL");
+
+    memset(out_list->counts, 0, sizeof(out_list->counts));
+
+    for (uint32_t l = 0; l < light_count; ++l) {
+        for (uint32_t c = 0; c < CLUSTER_COUNT; ++c) {
+            if (test_cluster(grid, c, &lights[l])) {
+                append_light(out_list, c, lights[l].light_index);
+            }
+        }
+    }
+}
+
+#if LIGHT_CLUSTER_SSE
+void light_cluster::assign_simd(const LightClusterGrid *grid, const ClusterLight *lights, uint32_t light_count, LightClusterList *out_list) {
+    assert(grid && out_list && "light_cluster::assign_simd: grid and out_list pointers cannot be NULL");
+    static_assert((CLUSTER_GRID_X * CLUSTER_GRID_Y) % 4 == 0, "A slice has to be a multiple of 4 clusters for the SIMD path");
+
+    memset(out_list->counts, 0, sizeof(out_list->counts));
+
+    const __m128 zero = _mm_setzero_ps();
+    const uint32_t slice_size = CLUSTER_GRID_X * CLUSTER_GRID_Y;
+
+    for (uint32_t l = 0; l < light_count; ++l) {
+        const ClusterLight *light = &lights[l];
+
+        // Only the slices the light's depth range touches. One slice of margin on
+        // both ends, so the log() rounding can never drop a cluster the reference keeps.
+        uint32_t first_slice = light_cluster::get_slice(grid, light->position.z - light->range);
+        uint32_t last_slice = light_cluster::get_slice(grid, light->position.z + light->range);
+        first_slice = first_slice > 0 ? first_slice - 1 : 0;
+        last_slice = last_slice < CLUSTER_GRID_Z - 1 ? last_slice + 1 : CLUSTER_GRID_Z - 1;
+
+        const __m128 px = _mm_set1_ps(light->position.x);
+        const __m128 py = _mm_set1_ps(light->position.y);
+        const __m128 pz = _mm_set1_ps(light->position.z);
+        const __m128 range = _mm_set1_ps(light->range);
+        const __m128 range_sq = _mm_set1_ps(light->range * light->range);
+
+        const bool is_spot = light->type == CLUSTER_LIGHT_SPOT;
+        const __m128 dx = _mm_set1_ps(light->direction.x);
+        const __m128 dy = _mm_set1_ps(light->direction.y);
+        const __m128 dz = _mm_set1_ps(light->direction.z);
+        const __m128 cos_outer = _mm_set1_ps(light->cos_outer);
+        const __m128 sin_outer = _mm_set1_ps(light->sin_outer);
+
+        uint32_t begin = first_slice * slice_size;
+        uint32_t end = (last_slice + 1) * slice_size;
+        for (uint32_t c = begin; c < end; c += 4) {
+            // Sphere vs AABB: squared distance from the center to the box
+            __m128 ex = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&grid->min_x[c]), px), zero), _mm_sub_ps(px, _mm_loadu_ps(&grid->max_x[c])));
+            __m128 ey = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&grid->min_y[c]), py), zero), _mm_sub_ps(py, _mm_loadu_ps(&grid->max_y[c])));
+            __m128 ez = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&grid->min_z[c]), pz), zero), _mm_sub_ps(pz, _mm_loadu_ps(&grid->max_z[c])));
+            __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+            __m128 hit = _mm_cmple_ps(dist_sq, range_sq);
+
+            if (is_spot && _mm_movemask_ps(hit)) {
+                // Cone vs the cluster's bounding sphere
+                __m128 radius = _mm_loadu_ps(&grid->radius[c]);
+                __m128 vx = _mm_sub_ps(_mm_loadu_ps(&grid->center_x[c]), px);
+                __m128 vy = _mm_sub_ps(_mm_loadu_ps(&grid->center_y[c]), py);
+                __m128 vz = _mm_sub_ps(_mm_loadu_ps(&grid->center_z[c]), pz);
+                __m128 v_len_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+                __m128 v1_len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+                __m128 perp = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(v_len_sq, _mm_mul_ps(v1_len, v1_len)), zero));
+                __m128 closest = _mm_sub_ps(_mm_mul_ps(cos_outer, perp), _mm_mul_ps(v1_len, sin_outer));
+
+                __m128 culled = _mm_or_ps(
+                    _mm_or_ps(_mm_cmpgt_ps(closest, radius), _mm_cmpgt_ps(v1_len, _mm_add_ps(radius, range))),
+                    _mm_cmplt_ps(v1_len, _mm_sub_ps(zero, radius)));
+                hit = _mm_andnot_ps(culled, hit);
+            }
+
+            int mask = _mm_movemask_ps(hit);
+            while (mask) {
+                // Lowest set lane first, keeps the per-cluster order the same as the reference
+                int lane = 0;
+                while (!(mask & (1 << lane))) lane++;
+                append_light(out_list, c + lane, light->light_index);
+                mask &= ~(1 << lane);
+            }
+        }
+    }
+}
+#else
+void light_cluster::assign_simd(const LightClusterGrid *grid, const ClusterLight *lights, uint32_t light_count, LightClusterList *out_list) {
+    // No SSE on this target
+    assign_reference(grid, lights, light_count, out_list);
+}
+#endif
+
+uint32_t light_cluster::compare(const LightClusterList *a, const LightClusterList *b) {
+    uint32_t mismatches = 0;
+    for (uint32_t c = 0; c < CLUSTER_COUNT; ++c) {
+        if (a->counts[c] != b->counts[c] ||
+            memcmp(&a->indices[c * CLUSTER_MAX_LIGHTS], &b->indices[c * CLUSTER_MAX_LIGHTS], a->counts[c] * sizeof(uint32_t)) != 0) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static bool test_cluster(const LightClusterGrid *grid, uint32_t c, const ClusterLight *light) {
+    // Sphere vs AABB: squared distance from the center to the box
+    float ex = fmaxf(fmaxf(grid->min_x[c] - light->position.x, 0.0f), light->position.x - grid->max_x[c]);
+    float ey = fmaxf(fmaxf(grid->min_y[c] - light->position.y, 0.0f), light->position.y - grid->max_y[c]);
+    float ez = fmaxf(fmaxf(grid->min_z[c] - light->position.z, 0.0f), light->position.z - grid->max_z[c]);
+    float dist_sq = (ex * ex + ey * ey) + ez * ez;
+    if (!(dist_sq <= light->range * light->range)) {
+        return false;
+    }
+
+    if (light->type != CLUSTER_LIGHT_SPOT) {
+        return true;
+    }
+
+    // Cone vs the cluster's bounding sphere (closest point on the cone's side)
+    float radius = grid->radius[c];
+    float vx = grid->center_x[c] - light->position.x;
+    float vy = grid->center_y[c] - light->position.y;
+    float vz = grid->center_z[c] - light->position.z;
+    float v_len_sq = (vx * vx + vy * vy) + vz * vz;
+    float v1_len = (vx * light->direction.x + vy * light->direction.y) + vz * light->direction.z;
+    float perp = sqrtf(fmaxf(v_len_sq - v1_len * v1_len, 0.0f));
+    float closest = light->cos_outer * perp - v1_len * light->sin_outer;
+
+    bool angle_cull = closest > radius;
+    bool front_cull = v1_len > radius + light->range;
+    bool back_cull = v1_len < 0.0f - radius;
+    return !(angle_cull || front_cull || back_cull);
+}
+
+static void append_light(LightClusterList *list, uint32_t cluster, uint32_t light_index) {
+    uint32_t count = list->counts[cluster];
+    if (count < CLUSTER_MAX_LIGHTS) {
+        list->indices[cluster * CLUSTER_MAX_LIGHTS + count] = light_index;
+        list->counts[cluster] = count + 1;
+    }
+}
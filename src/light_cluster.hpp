@@ -0,0 +1,80 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+// Froxel grid: 16x9 tiles on screen, exponential slices in depth
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+// Fixed number of slots per cluster, lights past this are dropped for that cluster
+#define CLUSTER_MAX_LIGHTS 64
+
+enum ClusterLightType : uint32_t {
+    CLUSTER_LIGHT_POINT,
+    CLUSTER_LIGHT_SPOT,
+};
+
+// A local light in view space, as the culling sees it.
+// Same layout as the structured buffer the compute pass reads.
+struct ClusterLight {
+    DirectX::XMFLOAT3 position;
+    float range;
+    DirectX::XMFLOAT3 direction;
+    float cos_outer;
+    float sin_outer;
+    ClusterLightType type;
+    uint32_t light_index; // Index into the shading light buffer
+    float _padding;
+};
+
+// View space bounds of every cluster. Kept as SoA so the SIMD path can
+// test four clusters in one go. The bounding sphere is used for the cone test.
+struct LightClusterGrid {
+    float min_x[CLUSTER_COUNT];
+    float min_y[CLUSTER_COUNT];
+    float min_z[CLUSTER_COUNT];
+    float max_x[CLUSTER_COUNT];
+    float max_y[CLUSTER_COUNT];
+    float max_z[CLUSTER_COUNT];
+    float center_x[CLUSTER_COUNT];
+    float center_y[CLUSTER_COUNT];
+    float center_z[CLUSTER_COUNT];
+    float radius[CLUSTER_COUNT];
+
+    // What the grid was built from, so we know when to rebuild
+    float proj_x;
+    float proj_y;
+    float znear;
+    float zfar;
+
+    // slice = log(z) * z_scale + z_bias
+    float z_scale;
+    float z_bias;
+};
+
+struct LightClusterList {
+    uint32_t counts[CLUSTER_COUNT];
+    uint32_t indices[CLUSTER_COUNT * CLUSTER_MAX_LIGHTS];
+};
+
+namespace light_cluster {
+
+// proj_x and proj_y are the [0][0] and [1][1] entries of the (LH perspective) projection matrix
+void build_grid(LightClusterGrid *grid, float proj_x, float proj_y, float znear, float zfar);
+bool grid_matches(const LightClusterGrid *grid, float proj_x, float proj_y, float znear, float zfar);
+uint32_t get_slice(const LightClusterGrid *grid, float view_z);
+
+// Scalar version, tests every light against every cluster. Slow, but obviously
+// correct, so it's what the other paths are checked against.
+void assign_reference(const LightClusterGrid *grid, const ClusterLight *lights, uint32_t light_count, LightClusterList *out_list);
+
+// SSE version, only visits the depth slices a light can touch and tests four
+// clusters at a time. Produces the same lists as the reference.
+void assign_simd(const LightClusterGrid *grid, const ClusterLight *lights, uint32_t light_count, LightClusterList *out_list);
+
+// Returns the number of clusters whose lists differ
+uint32_t compare(const LightClusterList *a, const LightClusterList *b);
+
+} // namespace light_cluster
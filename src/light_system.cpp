@@ -17,18 +17,51 @@ LightId light::create(LightType type, DirectX::XMFLOAT3 color, float intensity)
     }
 
     if (l == nullptr) {
-        LOG("%s: Max meshes reached, adjust max mesh count.", __func__);
-        id::invalidate(&l->id);
+        LOG("%s: Max lights reached, adjust max light count.", __func__);
         return id::invalid();
     }
 
     l->type = type;
     l->color = color;
     l->intensity = intensity;
+    l->range = 0.0f;
+    l->spot_inner_angle = 0.0f;
+    l->spot_outer_angle = 0.0f;
 
     return l->id;
 }
 
+LightId light::create_point(DirectX::XMFLOAT3 color, float intensity, float range) {
+    LightId id = create(LIGHT_TYPE_POINT, color, intensity);
+    if (id::is_invalid(id)) {
+        return id;
+    }
+
+    Light *l = get(application::get_renderer(), id);
+    l->range = range;
+
+    return id;
+}
+
+LightId light::create_spot(DirectX::XMFLOAT3 color, float intensity, float range, float inner_angle, float outer_angle) {
+    LightId id = create(LIGHT_TYPE_SPOT, color, intensity);
+    if (id::is_invalid(id)) {
+        return id;
+    }
+
+    // The cluster cone test only holds up to 90 degree half angles
+    const float max_angle = DirectX::XM_PIDIV2 - 0.01f;
+    outer_angle = outer_angle < max_angle ? outer_angle : max_angle;
+    inner_angle = inner_angle < outer_angle ? inner_angle : outer_angle;
+
+    Light *l = get(application::get_renderer(), id);
+    l->range = range;
+    l->spot_inner_angle = inner_angle;
+    l->spot_outer_angle = outer_angle;
+
+    return id;
+}
+
 Light *light::get(Renderer *renderer, LightId id) {
     if (id::is_invalid(id)) {
         return nullptr;
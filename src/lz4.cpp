@@ -0,0 +1,192 @@
+#include "lz4.hpp"
+
+#include <cstring>
+
+#define LZ4_MIN_MATCH 4
+// The format wants the last 5 bytes as literals and no match starting in the last 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_FIND_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+// Misses before the search starts skipping ahead, incompressible data goes by fast
+#define LZ4_SKIP_TRIGGER 6
+
+static uint32_t read_u32(const uint8_t *p);
+static uint32_t hash_position(const uint8_t *p);
+static uint8_t *write_length(uint8_t *op, size_t length);
+
+size_t lz4::get_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t lz4::compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    // Positions + 1, 0 is empty
+    uint32_t table[1 << LZ4_HASH_BITS] = {};
+
+    uint8_t *op = dst;
+    uint8_t *end = dst + capacity;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    if (size > LZ4_MATCH_FIND_LIMIT) {
+        size_t match_find_limit = size - LZ4_MATCH_FIND_LIMIT;
+        size_t match_end = size - LZ4_LAST_LITERALS;
+        uint32_t misses = 1u << LZ4_SKIP_TRIGGER;
+
+        while (ip < match_find_limit) {
+            uint32_t h = hash_position(src + ip);
+            size_t ref = table[h];
+            table[h] = (uint32_t)(ip + 1);
+
+            if (ref == 0 || ip - (ref - 1) > LZ4_MAX_OFFSET || read_u32(src + ref - 1) != read_u32(src + ip)) {
+                ip += misses++ >> LZ4_SKIP_TRIGGER;
+                continue;
+            }
+            ref--;
+            misses = 1u << LZ4_SKIP_TRIGGER;
+
+            // Back over literals that match too, then forward as far as it goes
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t length = LZ4_MIN_MATCH;
+            while (ip + length < match_end && src[ref + length] == src[ip + length]) {
+                length++;
+            }
+
+            size_t literals = ip - anchor;
+            size_t worst = 1 + literals / 255 + 1 + literals + 2 + (length - LZ4_MIN_MATCH) / 255 + 1;
+            if ((size_t)(end - op) < worst) {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            size_t match_code = length - LZ4_MIN_MATCH;
+            *token = (uint8_t)(((literals < 15 ? literals : 15) << 4) | (match_code < 15 ? match_code : 15));
+            if (literals >= 15) {
+                op = write_length(op, literals - 15);
+            }
+            memcpy(op, src + anchor, literals);
+            op += literals;
+
+            size_t offset = ip - ref;
+            *op++ = (uint8_t)(offset & 0xFF);
+            *op++ = (uint8_t)(offset >> 8);
+            if (match_code >= 15) {
+                op = write_length(op, match_code - 15);
+            }
+
+            ip += length;
+            anchor = ip;
+            // The position right before the next search, matches often start there
+            if (ip - 2 < match_find_limit) {
+                table[hash_position(src + ip - 2)] = (uint32_t)(ip - 2 + 1);
+            }
+        }
+    }
+
+    // The rest as literals, a sequence without a match
+    size_t literals = size - anchor;
+    if ((size_t)(end - op) < 1 + literals / 255 + 1 + literals) {
+        return 0;
+    }
+    *op++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        op = write_length(op, literals - 15);
+    }
+    memcpy(op, src + anchor, literals);
+    op += literals;
+    return (size_t)(op - dst);
+}
+
+bool lz4::decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size) {
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b = 255;
+            while (b == 255) {
+                if (ip >= size) {
+                    return false;
+                }
+                b = src[ip++];
+                literals += b;
+            }
+        }
+        if (literals > size - ip || literals > raw_size - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        // Only the last sequence ends after its literals
+        if (ip == size) {
+            return op == raw_size;
+        }
+
+        if (size - ip < 2) {
+            return false;
+        }
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        size_t length = token & 15;
+        if (length == 15) {
+            uint8_t b = 255;
+            while (b == 255) {
+                if (ip >= size) {
+                    return false;
+                }
+                b = src[ip++];
+                length += b;
+            }
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > raw_size - op) {
+            return false;
+        }
+
+        // Closer than its length repeats what it's copying, every copy doubles
+        // what's already repeated so the next one can be twice as long
+        const uint8_t *match = dst + op - offset;
+        uint8_t *out = dst + op;
+        size_t left = length;
+        while (left > 0) {
+            size_t chunk = left < (size_t)(out - match) ? left : (size_t)(out - match);
+            memcpy(out, match, chunk);
+            out += chunk;
+            left -= chunk;
+        }
+        op += length;
+    }
+
+    return false;
+}
+
+static uint32_t read_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash_position(const uint8_t *p) {
+    return (read_u32(p) * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t *write_length(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format (no frame around it), what the asset packs compress with.
+// Greedy matching on a small hash table: compresses at a few hundred MB/s and
+// decompresses at memory speed, any LZ4 block decoder reads the output.
+namespace lz4 {
+
+// Enough room to compress size bytes whatever they are
+size_t get_bound(size_t size);
+// Bytes written to dst, 0 when it doesn't fit in capacity
+size_t compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+// Checks every length and offset against both buffers, false for a block
+// that's broken or doesn't come out at exactly raw_size bytes
+bool decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size);
+
+} // namespace lz4
@@ -4,6 +4,8 @@
 int main(int argc, char *argv[]) {
     // Default mesh's path
     std::string meshpath = "assets/cube.obj";
+    const char *scene_path = "assets/config.json";
+    const char *record_path = nullptr;
 
     for (int i = 1; i < argc; ++i) {
         std::string current_arg = argv[i];
@@ -16,6 +18,19 @@ int main(int argc, char *argv[]) {
                 LOG("Error: %s option requires a filepath.", current_arg.c_str());
                 return 1;
             }
+        } else if (current_arg == "--scene" || current_arg == "--record") {
+            // Scene config to load / file to record the camera path into (for the benchmark)
+            if (i + 1 < argc) {
+                if (current_arg == "--scene") {
+                    scene_path = argv[i + 1];
+                } else {
+                    record_path = argv[i + 1];
+                }
+                i++;
+            } else {
+                LOG("Error: %s option requires a filepath.", current_arg.c_str());
+                return 1;
+            }
         }
     }
 
@@ -24,9 +39,40 @@ int main(int argc, char *argv[]) {
     cfg.window_width = 1920;
     cfg.window_height = 1080;
     cfg.mesh_path = &meshpath;
+    cfg.scene_path = scene_path;
+    cfg.shader_hot_reload = true;
+    cfg.config_hot_reload = true;
+    cfg.threaded_render = true;
+    // Two frames queued is enough to keep the GPU busy, the third is only latency
+    cfg.max_frames_in_flight = 2;
+    // Warns well before a 2 GB card would start paging
+    cfg.memory_budgets[MEMORY_DOMAIN_GPU][MEMORY_TAG_TEXTURES] = 768ull * 1024 * 1024;
+    cfg.memory_budgets[MEMORY_DOMAIN_GPU][MEMORY_TAG_RENDER_TARGETS] = 512ull * 1024 * 1024;
+    cfg.memory_budgets[MEMORY_DOMAIN_GPU][MEMORY_TAG_MESHES] = 256ull * 1024 * 1024;
+    // Streamed mips only, the material arrays hold a copy of each on top
+    cfg.texture_stream_budget = 256ull * 1024 * 1024;
+    // Built with `xmake run pack assets assets.pack`, without it the loose files are read
+    cfg.pack_path = "assets.pack";
+
+    if (!application::initialize(cfg)) {
+        return 1;
+    }
+
+    // Recording is fed from application::update, the path is saved once the window closes
+    Replay *recording = nullptr;
+    if (record_path) {
+        recording = new Replay;
+        replay::clear(recording);
+        recording->is_recording = true;
+        application::set_replay(recording);
+    }
 
-    application::initialize(cfg);
     application::run();
 
+    if (recording) {
+        replay::save(recording, record_path);
+        delete recording;
+    }
+
     return 0;
 }
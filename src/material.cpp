@@ -3,11 +3,28 @@
 #include "application.hpp"
 #include "id.hpp"
 #include "logger.hpp"
+#include "memory_tracker.hpp"
 #include "mesh.hpp"
 #include "renderer.hpp"
+#include "shader_system.hpp"
 #include "texture.hpp"
+#include "texture_format.hpp"
 #include <cassert>
 
+static const ShaderFeatureDefine feature_defines[] = {
+    {MATERIAL_FEATURE_ALBEDO_MAP, "HAS_ALBEDO_MAP"},
+    {MATERIAL_FEATURE_METALLIC_MAP, "HAS_METALLIC_MAP"},
+    {MATERIAL_FEATURE_ROUGHNESS_MAP, "HAS_ROUGHNESS_MAP"},
+    {MATERIAL_FEATURE_MRAO_MAP, "HAS_MRAO_MAP"},
+    {MATERIAL_FEATURE_COAT_MAP, "HAS_COAT_MAP"},
+    {MATERIAL_FEATURE_NORMAL_MAP, "HAS_NORMAL_MAP"},
+    {MATERIAL_FEATURE_EMISSION, "HAS_EMISSION"},
+    {MATERIAL_FEATURE_EMISSION_MAP, "HAS_EMISSION_MAP"},
+};
+
+static void set_values(Renderer *renderer, Material *mat, DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture);
+static uint32_t place_texture(MaterialTable *table, Texture *tex);
+
 MaterialId material::create(DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture) {
     // Materials are kept in the renderer so fetching that here
     Renderer *renderer = application::get_renderer();
@@ -29,14 +46,212 @@ MaterialId material::create(DirectX::XMFLOAT3 albedo_color, Id albedo_texture, f
         return id::invalid();
     }
 
+    set_values(renderer, mat, albedo_color, albedo_texture, metallic_value, metallic_texture, roughness_value, roughness_texture, coat_value, coat_texture, normal_texture, emission_intensity, emission_texture);
+    return mat->id;
+}
+
+void material::update(MaterialId material_id, DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture) {
+    Renderer *renderer = application::get_renderer();
+    Material *mat = get(renderer, material_id);
+    if (!mat) {
+        return;
+    }
+
+    set_values(renderer, mat, albedo_color, albedo_texture, metallic_value, metallic_texture, roughness_value, roughness_texture, coat_value, coat_texture, normal_texture, emission_intensity, emission_texture);
+}
+
+void material::destroy(MaterialId material_id) {
+    Renderer *renderer = application::get_renderer();
+    Material *mat = get(renderer, material_id);
+    if (!mat) {
+        return;
+    }
+
+    // The next material in the slot gets the next generation, so the old ids don't find it
+    *mat = {};
+    id::invalidate(&mat->id);
+    mat->id.generation = material_id.generation;
+    id::gen_increment(&mat->id);
+
+    renderer->material_table_dirty = true;
+}
+
+Material *material::get(Renderer *renderer, MaterialId material_id) {
+    if (id::is_valid(material_id)) {
+        Material *m = &renderer->materials[material_id.id];
+        if (id::is_fresh(m->id, material_id)) {
+            return m;
+        }
+    }
+
+    return nullptr;
+}
+
+uint32_t material::get_features(Id albedo_texture, Id metallic_texture, Id roughness_texture, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture) {
+    uint32_t features = 0;
+    if (id::is_valid(albedo_texture)) features |= MATERIAL_FEATURE_ALBEDO_MAP;
+    if (id::is_valid(coat_texture)) features |= MATERIAL_FEATURE_COAT_MAP;
+    if (id::is_valid(normal_texture)) features |= MATERIAL_FEATURE_NORMAL_MAP;
+
+    // One texture for both is a packed map, sampled once
+    if (id::is_valid(metallic_texture) && id::is_fresh(metallic_texture, roughness_texture)) {
+        features |= MATERIAL_FEATURE_MRAO_MAP;
+    } else {
+        if (id::is_valid(metallic_texture)) features |= MATERIAL_FEATURE_METALLIC_MAP;
+        if (id::is_valid(roughness_texture)) features |= MATERIAL_FEATURE_ROUGHNESS_MAP;
+    }
+
+    // An emission map without intensity adds nothing
+    if (emission_intensity > 0.0f) {
+        features |= MATERIAL_FEATURE_EMISSION;
+        if (id::is_valid(emission_texture)) features |= MATERIAL_FEATURE_EMISSION_MAP;
+    }
+
+    return features;
+}
+
+const ShaderFeatureDefine *material::get_feature_defines(uint32_t *out_count) {
+    *out_count = ARRAYSIZE(feature_defines);
+    return feature_defines;
+}
+
+bool material::update_table(Renderer *renderer) {
+    if (!renderer->material_table_dirty) {
+        return true;
+    }
+    renderer->material_table_dirty = false;
+
+    MaterialTable *table = &renderer->material_table;
+    material_table::reset(table);
+
+    // Fallbacks go in first, anything that doesn't fit anymore uses them
+    Texture *amre_fallback = texture::get(renderer, renderer->amre_fallback_texture);
+    Texture *normal_fallback = texture::get(renderer, renderer->normal_fallback_texture);
+    uint32_t amre_fallback_slot = place_texture(table, amre_fallback);
+    uint32_t normal_fallback_slot = place_texture(table, normal_fallback);
+    if (amre_fallback_slot == MATERIAL_TEXTURE_SLOT_NONE || normal_fallback_slot == MATERIAL_TEXTURE_SLOT_NONE) {
+        LOG("%s: Couldn't place the fallback textures", __func__);
+        return false;
+    }
+
+    GPUMaterial gpu_materials[MAX_MATERIALS] = {};
+    for (uint32_t i = 0; i < MAX_MATERIALS; ++i) {
+        Material *mat = &renderer->materials[i];
+        if (id::is_invalid(mat->id)) {
+            continue;
+        }
+
+        GPUMaterial *gpu_mat = &gpu_materials[i];
+        gpu_mat->albedo_color = mat->albedo_color;
+        gpu_mat->metallic_value = mat->metallic_value;
+        gpu_mat->roughness_value = mat->roughness_value;
+        gpu_mat->coat_value = mat->coat_value;
+        gpu_mat->emission_intensity = mat->emission_intensity;
+        gpu_mat->features = mat->features;
+
+        // Compiles in the background, drawn with the generic pipeline until it's needed
+        shader::request_permutation(&renderer->shader_system, renderer->device.Get(), &renderer->opaque_permutations, mat->features);
+
+        // Same order as the texture_slots
+        Id textures[] = {
+            mat->albedo_texture,
+            mat->metallic_texture,
+            mat->roughness_texture,
+            mat->coat_texture,
+            mat->normal_texture,
+            mat->emission_texture,
+        };
+        static_assert(ARRAYSIZE(textures) == ARRAYSIZE(gpu_mat->texture_slots), "material::update_table: Texture slot count mismatch");
+
+        for (uint32_t t = 0; t < ARRAYSIZE(textures); ++t) {
+            uint32_t slot = place_texture(table, texture::get(renderer, textures[t]));
+            if (slot == MATERIAL_TEXTURE_SLOT_NONE) {
+                LOG("%s: No room for a texture of material %u, using the fallback", __func__, i);
+                slot = t == 4 ? normal_fallback_slot : amre_fallback_slot; // 4 is the normal map
+            }
+            gpu_mat->texture_slots[t] = slot;
+        }
+    }
+
+    renderer->context->UpdateSubresource(renderer->material_buffer.Get(), 0, nullptr, gpu_materials, 0, 0);
+
+    // (Re)build the arrays and copy every mip of every layer over
+    for (uint32_t b = 0; b < MATERIAL_TEXTURE_ARRAYS; ++b) {
+        if (renderer->material_arrays[b].Get()) {
+            D3D11_TEXTURE2D_DESC old_desc = {};
+            renderer->material_arrays[b]->GetDesc(&old_desc);
+            memory_tracker::untrack(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_GPU,
+                                    texture_format::texture_bytes(old_desc.Format, old_desc.Width, old_desc.Height, old_desc.ArraySize, old_desc.MipLevels, 1));
+        }
+        renderer->material_arrays[b].Reset();
+        renderer->material_array_srvs[b].Reset();
+        if (b >= table->bucket_count) {
+            continue;
+        }
+
+        TextureArrayBucket *bucket = &table->buckets[b];
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = bucket->desc.width;
+        desc.Height = bucket->desc.height;
+        desc.MipLevels = bucket->desc.mip_levels;
+        desc.ArraySize = bucket->layer_count;
+        desc.Format = (DXGI_FORMAT)bucket->desc.format;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+        HRESULT hr = renderer->device->CreateTexture2D(&desc, nullptr, renderer->material_arrays[b].GetAddressOf());
+        if (FAILED(hr)) {
+            LOG("%s: Couldn't create material texture array %u", __func__, b);
+            return false;
+        }
+        memory_tracker::track(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_GPU, texture_format::texture_bytes(desc.Format, desc.Width, desc.Height, desc.ArraySize, desc.MipLevels, 1));
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+        srv_desc.Format = desc.Format;
+        srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+        srv_desc.Texture2DArray.MipLevels = desc.MipLevels;
+        srv_desc.Texture2DArray.ArraySize = desc.ArraySize;
+        hr = renderer->device->CreateShaderResourceView(renderer->material_arrays[b].Get(), &srv_desc, renderer->material_array_srvs[b].GetAddressOf());
+        if (FAILED(hr)) {
+            LOG("%s: Couldn't create the SRV of material texture array %u", __func__, b);
+            return false;
+        }
+
+        for (uint32_t layer = 0; layer < bucket->layer_count; ++layer) {
+            Texture *tex = texture::get(renderer, bucket->layers[layer]);
+            for (uint32_t mip = 0; mip < desc.MipLevels; ++mip) {
+                renderer->context->CopySubresourceRegion(
+                    renderer->material_arrays[b].Get(), D3D11CalcSubresource(mip, layer, desc.MipLevels), 0, 0, 0,
+                    tex->texture.Get(), D3D11CalcSubresource(mip, 0, tex->mip_levels), nullptr);
+            }
+        }
+    }
+
+    return true;
+}
+
+void material::bind_table(Renderer *renderer) {
+    ID3D11ShaderResourceView *srvs[MATERIAL_TEXTURE_ARRAYS + 1];
+    for (uint32_t i = 0; i < MATERIAL_TEXTURE_ARRAYS; ++i) {
+        srvs[i] = renderer->material_array_srvs[i].Get();
+    }
+    srvs[MATERIAL_TEXTURE_ARRAYS] = renderer->material_srv.Get();
+
+    state_tracker::set_srvs(&renderer->state_tracker, SHADER_STAGE_PS, 16, ARRAYSIZE(srvs), srvs);
+    renderer->material_binds++;
+}
+
+static void set_values(Renderer *renderer, Material *mat, DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture) {
     // Material values
     mat->albedo_color = albedo_color;
     mat->metallic_value = metallic_value;
     mat->roughness_value = roughness_value;
     mat->coat_value = coat_value;
     mat->emission_intensity = emission_intensity;
+    mat->features = get_features(albedo_texture, metallic_texture, roughness_texture, coat_texture, normal_texture, emission_intensity, emission_texture);
 
-    // Material textures
+    // Material textures, the fallbacks are only sampled by the generic pipelines
     mat->albedo_texture = id::is_invalid(albedo_texture) ? renderer->amre_fallback_texture : albedo_texture;
     mat->metallic_texture = id::is_invalid(metallic_texture) ? renderer->amre_fallback_texture : metallic_texture;
     mat->roughness_texture = id::is_invalid(roughness_texture) ? renderer->amre_fallback_texture : roughness_texture;
@@ -44,53 +259,16 @@ MaterialId material::create(DirectX::XMFLOAT3 albedo_color, Id albedo_texture, f
     mat->normal_texture = id::is_invalid(normal_texture) ? renderer->normal_fallback_texture : normal_texture;
     mat->emission_texture = id::is_invalid(emission_texture) ? renderer->amre_fallback_texture : emission_texture;
 
-    return mat->id;
-}
-
-Material *material::get(Renderer *renderer, MaterialId material_id) {
-    if (id::is_valid(material_id)) {
-        Material *m = &renderer->materials[material_id.id];
-        if (id::is_fresh(m->id, material_id)) {
-            return m;
-        }
-    }
-
-    return nullptr;
+    // Picked up by material::update_table before the next frame
+    renderer->material_table_dirty = true;
 }
 
-void material::bind(Renderer *renderer, Material *material, uint8_t start_cb, uint8_t start_tex) {
-    D3D11_MAPPED_SUBRESOURCE mappedResource;
-    HRESULT hr = renderer->context->Map(renderer->pCBPerMaterial.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-    if (FAILED(hr)) {
-        LOG("%s: Failed to map per material constant buffer", __func__);
-        return;
+static uint32_t place_texture(MaterialTable *table, Texture *tex) {
+    // Only plain 2D textures can go in an array
+    if (!tex || tex->is_cubemap || tex->array_size != 1 || tex->msaa_samples > 1) {
+        return MATERIAL_TEXTURE_SLOT_NONE;
     }
 
-    CBPerMaterial *cb_ptr = (CBPerMaterial *)mappedResource.pData;
-    cb_ptr->albedo_color = material->albedo_color;
-    cb_ptr->emission_intensity = material->emission_intensity;
-    cb_ptr->metallic_value = material->metallic_value;
-    cb_ptr->roughness_value = material->roughness_value;
-    cb_ptr->coat_value = material->coat_value;
-
-    renderer->context->Unmap(renderer->pCBPerMaterial.Get(), 0);
-    renderer->context->PSSetConstantBuffers((UINT)start_cb, 1, renderer->pCBPerMaterial.GetAddressOf());
-
-    // Look up the texture based on the id
-    Texture *albedo_tex = texture::get(renderer, material->albedo_texture);
-    Texture *metallic_tex = texture::get(renderer, material->metallic_texture);
-    Texture *roughness_tex = texture::get(renderer, material->roughness_texture);
-    Texture *coat_tex = texture::get(renderer, material->coat_texture);
-    Texture *normal_tex = texture::get(renderer, material->normal_texture);
-    Texture *emission_tex = texture::get(renderer, material->emission_texture);
-
-    ID3D11ShaderResourceView *srvs[] = {
-        albedo_tex->srv.Get(),
-        metallic_tex->srv.Get(),
-        roughness_tex->srv.Get(),
-        coat_tex->srv.Get(),
-        normal_tex->srv.Get(),
-        emission_tex->srv.Get(),
-    };
-    renderer->context->PSSetShaderResources((UINT)start_tex, ARRAYSIZE(srvs), srvs);
+    TextureArrayDesc desc = {(uint32_t)tex->width, (uint32_t)tex->height, (uint32_t)tex->format, tex->mip_levels};
+    return material_table::add_texture(table, &desc, tex->id);
 }
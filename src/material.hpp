@@ -4,6 +4,7 @@
 #include <DirectXMath.h>
 
 struct Renderer;
+struct ShaderFeatureDefine;
 
 using MaterialId = Id;
 
@@ -13,8 +14,25 @@ enum MRAO_Bits {
     AMBIENT_OCCLUSION_BIT = 1 << 2,
 };
 
+// What a material actually uses, picks the shader permutation it's drawn with.
+// Must match the HAS_* defines in material.hlsli.
+enum MaterialFeature : uint32_t {
+    MATERIAL_FEATURE_ALBEDO_MAP = 1 << 0,
+    MATERIAL_FEATURE_METALLIC_MAP = 1 << 1,
+    MATERIAL_FEATURE_ROUGHNESS_MAP = 1 << 2,
+    // Metallic and roughness share a texture: roughness in G, metallic in B (AO in R isn't used yet)
+    MATERIAL_FEATURE_MRAO_MAP = 1 << 3,
+    MATERIAL_FEATURE_COAT_MAP = 1 << 4,
+    MATERIAL_FEATURE_NORMAL_MAP = 1 << 5,
+    MATERIAL_FEATURE_EMISSION = 1 << 6,
+    MATERIAL_FEATURE_EMISSION_MAP = 1 << 7,
+
+    MATERIAL_FEATURE_ALL = (1 << 8) - 1
+};
+
 struct Material {
     MaterialId id;
+    uint32_t features; // MaterialFeature bits
 
     DirectX::XMFLOAT3 albedo_color;
     float emission_intensity;
@@ -37,7 +55,20 @@ struct Material {
 namespace material {
 
 MaterialId create(DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture);
+// Same values as create, the material keeps its id (and its slot in the table)
+void update(MaterialId material_id, DirectX::XMFLOAT3 albedo_color, Id albedo_texture, float metallic_value, Id metallic_texture, float roughness_value, Id roughness_texture, float coat_value, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture);
+void destroy(MaterialId material_id);
 Material *get(Renderer *renderer, MaterialId material_id);
-void bind(Renderer *renderer, Material *material, uint8_t start_cb, uint8_t start_tex);
+uint32_t get_features(Id albedo_texture, Id metallic_texture, Id roughness_texture, Id coat_texture, Id normal_texture, float emission_intensity, Id emission_texture);
+// The define of every feature bit, for the shader permutations
+const ShaderFeatureDefine *get_feature_defines(uint32_t *out_count);
+
+// Packs every material into the material buffer and their textures into the
+// texture arrays, and queues the shader permutations the materials need.
+// Only does work after a material was created.
+bool update_table(Renderer *renderer);
+// Binds the texture arrays and the material buffer to the pixel shader
+// (t16-t32, see material.hlsli). Draws then pick their material by index.
+void bind_table(Renderer *renderer);
 
 } // namespace material
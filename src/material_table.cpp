@@ -0,0 +1,66 @@
+#include "material_table.hpp"
+
+#include <cassert>
+
+static bool desc_equal(const TextureArrayDesc *a, const TextureArrayDesc *b);
+static uint32_t make_slot(uint32_t array, uint32_t layer);
+
+void material_table::reset(MaterialTable *table) {
+    assert(table && "material_table::reset: Table pointer cannot be NULL");
+    table->bucket_count = 0;
+}
+
+uint32_t material_table::add_texture(MaterialTable *table, const TextureArrayDesc *desc, Id texture) {
+    assert(table && desc && "material_table::add_texture: Table and desc cannot be NULL");
+
+    // Same texture used by another material (or another slot of the same one)
+    TextureArrayBucket *bucket = nullptr;
+    for (uint32_t b = 0; b < table->bucket_count; ++b) {
+        TextureArrayBucket *candidate = &table->buckets[b];
+        if (!desc_equal(&candidate->desc, desc)) {
+            continue;
+        }
+
+        for (uint32_t l = 0; l < candidate->layer_count; ++l) {
+            if (candidate->layers[l].id == texture.id && candidate->layers[l].generation == texture.generation) {
+                return make_slot(b, l);
+            }
+        }
+        bucket = candidate;
+        break;
+    }
+
+    // First texture with this desc opens a new array
+    if (!bucket) {
+        if (table->bucket_count >= MATERIAL_TEXTURE_ARRAYS) {
+            return MATERIAL_TEXTURE_SLOT_NONE;
+        }
+        bucket = &table->buckets[table->bucket_count++];
+        bucket->desc = *desc;
+        bucket->layer_count = 0;
+    }
+
+    if (bucket->layer_count >= MATERIAL_ARRAY_MAX_LAYERS) {
+        return MATERIAL_TEXTURE_SLOT_NONE;
+    }
+
+    uint32_t layer = bucket->layer_count++;
+    bucket->layers[layer] = texture;
+    return make_slot((uint32_t)(bucket - table->buckets), layer);
+}
+
+uint32_t material_table::get_slot_array(uint32_t slot) {
+    return slot >> 16;
+}
+
+uint32_t material_table::get_slot_layer(uint32_t slot) {
+    return slot & 0xFFFF;
+}
+
+static bool desc_equal(const TextureArrayDesc *a, const TextureArrayDesc *b) {
+    return a->width == b->width && a->height == b->height && a->format == b->format && a->mip_levels == b->mip_levels;
+}
+
+static uint32_t make_slot(uint32_t array, uint32_t layer) {
+    return (array << 16) | layer;
+}
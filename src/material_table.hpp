@@ -0,0 +1,48 @@
+#pragma once
+
+#include "id.hpp"
+
+#include <cstdint>
+
+// Material textures are packed into a handful of Texture2DArrays, one per
+// size/format/mip count. Materials point at their textures with slots, the
+// array in the high 16 bits and the layer in it in the low 16 bits, so any
+// material can be drawn without binding its own textures. Streamed textures
+// take the size of their most detailed resident mip, so there are a few more
+// sizes around than there are in the source images.
+#define MATERIAL_TEXTURE_ARRAYS 16
+#define MATERIAL_ARRAY_MAX_LAYERS 64
+#define MATERIAL_TEXTURE_SLOT_NONE UINT32_MAX
+
+// What textures need to share to end up in the same array
+struct TextureArrayDesc {
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // DXGI_FORMAT, as a number so this stays API free
+    uint32_t mip_levels;
+};
+
+struct TextureArrayBucket {
+    TextureArrayDesc desc;
+    uint32_t layer_count;
+    Id layers[MATERIAL_ARRAY_MAX_LAYERS]; // Texture in each layer
+};
+
+struct MaterialTable {
+    TextureArrayBucket buckets[MATERIAL_TEXTURE_ARRAYS];
+    uint32_t bucket_count;
+};
+
+namespace material_table {
+
+void reset(MaterialTable *table);
+
+// Finds or places the texture, returns its slot or MATERIAL_TEXTURE_SLOT_NONE
+// when there is no array left for its desc or the array is full. A texture
+// that is already in the table keeps its slot.
+uint32_t add_texture(MaterialTable *table, const TextureArrayDesc *desc, Id texture);
+
+uint32_t get_slot_array(uint32_t slot);
+uint32_t get_slot_layer(uint32_t slot);
+
+} // namespace material_table
@@ -1,5 +1,7 @@
 #include "math.hpp"
 
+#include <cstring>
+
 #define FNV_PRIME_64 1099511628211ULL
 #define FNV_OFFSET_64 14695981039346656037ULL
 
@@ -13,3 +15,39 @@ uint64_t hash_fnv1a_64(const void *key, size_t length) {
     }
     return hash;
 }
+
+#define WORD_HASH_PRIME_64 0x9E3779B97F4A7C15ULL
+
+static uint64_t mix_64(uint64_t h) {
+    // Murmur3 finalizer, every input bit reaches every output bit
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_words_64(const void *key, size_t length) {
+    uint64_t hash = FNV_OFFSET_64 ^ (length * WORD_HASH_PRIME_64);
+    const uint8_t *p = (const uint8_t *)key;
+
+    // memcpy for the loads, the key doesn't have to be 8 byte aligned
+    size_t words = length / sizeof(uint64_t);
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        memcpy(&word, p + i * sizeof(uint64_t), sizeof(word));
+        hash = (hash ^ word) * WORD_HASH_PRIME_64;
+        hash ^= hash >> 32;
+    }
+
+    uint64_t tail = 0;
+    size_t tail_length = length % sizeof(uint64_t);
+    if (tail_length > 0) {
+        memcpy(&tail, p + words * sizeof(uint64_t), tail_length);
+        hash = (hash ^ tail) * WORD_HASH_PRIME_64;
+        hash ^= hash >> 32;
+    }
+
+    return mix_64(hash);
+}
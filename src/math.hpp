@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 uint64_t hash_fnv1a_64(const void *key, uint64_t length);
+// 8 bytes per step instead of 1, for fixed size keys like the D3D state descs
+uint64_t hash_words_64(const void *key, size_t length);
@@ -0,0 +1,130 @@
+#include "memory_tracker.hpp"
+
+#include "logger.hpp"
+
+#include <atomic>
+#include <cassert>
+
+struct MemoryPool {
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> peak;
+    std::atomic<uint64_t> budget;
+    std::atomic<uint32_t> allocations;
+};
+
+static MemoryPool s_pools[MEMORY_DOMAIN_COUNT][MEMORY_TAG_COUNT];
+static MemoryBudgetFn s_budget_callback = nullptr;
+static void *s_budget_user_data = nullptr;
+
+static const char *s_tag_names[MEMORY_TAG_COUNT] = {"textures", "render targets", "meshes", "buffers", "arenas"};
+static const char *s_domain_names[MEMORY_DOMAIN_COUNT] = {"cpu", "gpu"};
+
+static MemoryPool *get_pool(MemoryTag tag, MemoryDomain domain);
+static void add_bytes(MemoryPool *pool, MemoryTag tag, MemoryDomain domain, uint64_t bytes);
+
+void memory_tracker::track(MemoryTag tag, MemoryDomain domain, uint64_t bytes) {
+    MemoryPool *pool = get_pool(tag, domain);
+    pool->allocations.fetch_add(1, std::memory_order_relaxed);
+    add_bytes(pool, tag, domain, bytes);
+}
+
+void memory_tracker::untrack(MemoryTag tag, MemoryDomain domain, uint64_t bytes) {
+    MemoryPool *pool = get_pool(tag, domain);
+    uint64_t previous = pool->bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    uint32_t allocations = pool->allocations.fetch_sub(1, std::memory_order_relaxed);
+    assert(previous >= bytes && allocations > 0 && "memory_tracker::untrack: More untracked than was tracked");
+    (void)previous;
+    (void)allocations;
+}
+
+void memory_tracker::retrack(MemoryTag tag, MemoryDomain domain, uint64_t old_bytes, uint64_t new_bytes) {
+    MemoryPool *pool = get_pool(tag, domain);
+    if (new_bytes >= old_bytes) {
+        add_bytes(pool, tag, domain, new_bytes - old_bytes);
+    } else {
+        uint64_t previous = pool->bytes.fetch_sub(old_bytes - new_bytes, std::memory_order_relaxed);
+        assert(previous >= old_bytes - new_bytes && "memory_tracker::retrack: More untracked than was tracked");
+        (void)previous;
+    }
+}
+
+void memory_tracker::set_budget(MemoryTag tag, MemoryDomain domain, uint64_t budget) {
+    get_pool(tag, domain)->budget.store(budget, std::memory_order_relaxed);
+}
+
+void memory_tracker::set_budget_callback(MemoryBudgetFn callback, void *user_data) {
+    s_budget_callback = callback;
+    s_budget_user_data = user_data;
+}
+
+MemoryPoolStats memory_tracker::get_stats(MemoryTag tag, MemoryDomain domain) {
+    MemoryPool *pool = get_pool(tag, domain);
+    MemoryPoolStats stats = {};
+    stats.bytes = pool->bytes.load(std::memory_order_relaxed);
+    stats.peak = pool->peak.load(std::memory_order_relaxed);
+    stats.budget = pool->budget.load(std::memory_order_relaxed);
+    stats.allocations = pool->allocations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint64_t memory_tracker::get_total(MemoryDomain domain) {
+    uint64_t total = 0;
+    for (uint32_t t = 0; t < MEMORY_TAG_COUNT; ++t) {
+        total += s_pools[domain][t].bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void memory_tracker::reset_peaks() {
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t t = 0; t < MEMORY_TAG_COUNT; ++t) {
+            s_pools[d][t].peak.store(s_pools[d][t].bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+}
+
+void memory_tracker::dump() {
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t t = 0; t < MEMORY_TAG_COUNT; ++t) {
+            MemoryPoolStats stats = get_stats((MemoryTag)t, (MemoryDomain)d);
+            if (stats.peak == 0) {
+                continue;
+            }
+
+            if (stats.budget > 0) {
+                LOG("memory_tracker: %s %s %.2f MB in %u (%.2f MB peak), %.2f MB budget%s",
+                    s_domain_names[d], s_tag_names[t], stats.bytes / 1048576.0, stats.allocations, stats.peak / 1048576.0,
+                    stats.budget / 1048576.0, stats.peak > stats.budget ? ", went over" : "");
+            } else {
+                LOG("memory_tracker: %s %s %.2f MB in %u (%.2f MB peak)",
+                    s_domain_names[d], s_tag_names[t], stats.bytes / 1048576.0, stats.allocations, stats.peak / 1048576.0);
+            }
+        }
+    }
+    LOG("memory_tracker: %.2f MB cpu, %.2f MB gpu", get_total(MEMORY_DOMAIN_CPU) / 1048576.0, get_total(MEMORY_DOMAIN_GPU) / 1048576.0);
+}
+
+const char *memory_tracker::tag_name(MemoryTag tag) {
+    assert(tag < MEMORY_TAG_COUNT && "memory_tracker::tag_name: Unknown tag");
+    return s_tag_names[tag];
+}
+
+static MemoryPool *get_pool(MemoryTag tag, MemoryDomain domain) {
+    assert(tag < MEMORY_TAG_COUNT && domain < MEMORY_DOMAIN_COUNT && "memory_tracker: Unknown tag or domain");
+    return &s_pools[domain][tag];
+}
+
+static void add_bytes(MemoryPool *pool, MemoryTag tag, MemoryDomain domain, uint64_t bytes) {
+    uint64_t previous = pool->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    uint64_t current = previous + bytes;
+
+    uint64_t peak = pool->peak.load(std::memory_order_relaxed);
+    while (current > peak && !pool->peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+    }
+
+    // Only the track that crosses it, not every one after
+    uint64_t budget = pool->budget.load(std::memory_order_relaxed);
+    if (budget > 0 && previous <= budget && current > budget && s_budget_callback) {
+        s_budget_callback(s_budget_user_data, tag, domain, current, budget);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+// Bytes in use per subsystem, CPU and GPU apart. Whoever allocates tracks
+// what it got and untracks it when it's freed, the tracker only counts: one
+// pool per tag and domain with its current bytes, high-water mark and budget.
+// GPU sizes are worked out from the resource's description
+// (texture_format::texture_bytes), the driver may pad them some.
+//
+// Any thread can track and untrack. Budgets and the callback are meant to be
+// set up once at startup.
+enum MemoryTag : uint8_t {
+    MEMORY_TAG_TEXTURES,       // Loaded images, IBL maps, material arrays
+    MEMORY_TAG_RENDER_TARGETS, // Anything bound as a render target or depth, the swapchain, readbacks
+    MEMORY_TAG_MESHES,         // Geometry buffers, meshlets
+    MEMORY_TAG_BUFFERS,        // Structured buffers (lights, clusters, materials)
+    MEMORY_TAG_ARENAS,         // Committed arena pages
+    MEMORY_TAG_COUNT
+};
+
+enum MemoryDomain : uint8_t {
+    MEMORY_DOMAIN_CPU,
+    MEMORY_DOMAIN_GPU,
+    MEMORY_DOMAIN_COUNT
+};
+
+struct MemoryPoolStats {
+    uint64_t bytes;
+    uint64_t peak;        // Highest bytes since startup or reset_peaks
+    uint64_t budget;      // 0 is no budget
+    uint32_t allocations; // Tracked and not untracked yet
+};
+
+// Called by the track that takes a pool over its budget (not again until it
+// went back under), on whatever thread that was
+typedef void (*MemoryBudgetFn)(void *user_data, MemoryTag tag, MemoryDomain domain, uint64_t bytes, uint64_t budget);
+
+namespace memory_tracker {
+
+void track(MemoryTag tag, MemoryDomain domain, uint64_t bytes);
+void untrack(MemoryTag tag, MemoryDomain domain, uint64_t bytes);
+// A tracked allocation grew or shrank in place (arenas committing pages)
+void retrack(MemoryTag tag, MemoryDomain domain, uint64_t old_bytes, uint64_t new_bytes);
+
+void set_budget(MemoryTag tag, MemoryDomain domain, uint64_t budget);
+void set_budget_callback(MemoryBudgetFn callback, void *user_data);
+
+MemoryPoolStats get_stats(MemoryTag tag, MemoryDomain domain);
+uint64_t get_total(MemoryDomain domain);
+// Peaks start over from the current bytes, to measure a part of a run
+void reset_peaks();
+// One line per pool that ever had anything in it, then the totals
+void dump();
+const char *tag_name(MemoryTag tag);
+
+} // namespace memory_tracker
@@ -1,15 +1,20 @@
 #include "mesh.hpp"
 
 #include "application.hpp"
+#include "arena.hpp"
+#include "asset_registry.hpp"
+#include "geometry_arena.hpp"
 #include "logger.hpp"
 #include "renderer.hpp"
+#include "state_tracker.hpp"
+#include "vfs.hpp"
 #include <DirectXMath.h>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <d3d11.h>
 #include <string>
 #include <unordered_map>
-#include <vector>
 
 #define CGLTF_IMPLEMENTATION
 #include <cgltf.h>
@@ -30,14 +35,15 @@ struct TripletHasher {
     }
 };
 
+static bool allocate_geometry(Renderer *renderer, Mesh *m, const Vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count);
+static bool read_gltf(const char *filename, Arena *arena, Vertex **out_vertices, uint32_t *out_vertex_count, uint32_t **out_indices, uint32_t *out_index_count);
+static AsyncTask load_task(Renderer *renderer, AssetLoad load, const char *filename);
+static cgltf_result gltf_file_read(const cgltf_memory_options *memory_options, const cgltf_file_options *file_options, const char *path, cgltf_size *size, void **data);
+static void gltf_file_release(const cgltf_memory_options *memory_options, const cgltf_file_options *file_options, void *data);
+
 MeshId mesh::load(const char *filename) {
     Renderer *renderer = application::get_renderer();
 
-    // Get the device through the application from the renderer
-    // This way it doesn't need to be passed in and for these
-    // loaders it's more ergonomic not to have to do that IMHO.
-    ID3D11Device *device = renderer->device.Get();
-
     // Check if we can find an empty slot for our mesh
     // by linear search (which for this size is probably the best)
     Mesh *m = nullptr;
@@ -55,156 +61,42 @@ MeshId mesh::load(const char *filename) {
         return id::invalid();
     }
 
-    // Parse glTF model
-    cgltf_options opts = {};
-    cgltf_data *gltf_data = NULL;
-    cgltf_result res = cgltf_parse_file(&opts, filename, &gltf_data);
-    if (res != cgltf_result_success) {
-        LOG("mesh::load: Failed to load and parse glTF file: %s", filename);
-        return id::invalid();
-    }
-
-    // Throw in an extra validation provided by the lib
-    if (cgltf_validate(gltf_data) != cgltf_result_success) {
-        LOG("mesh::load: glTF model failed validation");
-        cgltf_free(gltf_data);
-        return id::invalid();
-    }
-
-    // For now, pick the very first primitive
-    cgltf_primitive *primitive = &gltf_data->meshes->primitives[0];
-
-    const cgltf_accessor *pos = cgltf_find_accessor(primitive, cgltf_attribute_type_position, 0);
-    const cgltf_accessor *nor = cgltf_find_accessor(primitive, cgltf_attribute_type_normal, 0);
-    const cgltf_accessor *uvs = cgltf_find_accessor(primitive, cgltf_attribute_type_texcoord, 0);
-    const cgltf_accessor *tan = cgltf_find_accessor(primitive, cgltf_attribute_type_tangent, 0);
-
-    // Accessor separately for the indices
-    const cgltf_accessor *ind = primitive->indices;
-    size_t index_count = ind->count;
-
-    // Make sure all the required attribute types are present
-    // NOTE: Normals could be calculated by smoothing or similar though...
-    if (!pos || !nor || !uvs) {
-        LOG("mesh::load: glTF model is missing one of the required attribute types (position, normal, uv)");
-        cgltf_free(gltf_data);
+    // Only needed until it's in the geometry arena
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    Vertex *vertices = nullptr;
+    uint32_t *indices = nullptr;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    if (!read_gltf(filename, scratch, &vertices, &vertex_count, &indices, &index_count)) {
+        arena::rewind(scratch, marker);
+        id::invalidate(&m->id);
         return id::invalid();
     }
 
-    // Now that we made sure we have everything we need, let's load in the binary data
-    if (cgltf_load_buffers(&opts, gltf_data, filename) != cgltf_result_success) {
-        LOG("mesh::load: Failed to load buffer data for glTF file: %s", filename);
-        cgltf_free(gltf_data);
-        return id::invalid();
-    }
-
-    // Use vectors so I don't have to free them at the end
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    vertices.resize(pos->count);
-    indices.resize(index_count);
-
-    // Loop through all the unique vertices and interleave them into our own array
-    for (cgltf_size i = 0; i < pos->count; ++i) {
-        float vp[3];
-        float vn[3];
-        float vt[2];
-        float vtan[4];
-
-        cgltf_accessor_read_float(pos, i, vp, 3);
-        cgltf_accessor_read_float(nor, i, vn, 3);
-        cgltf_accessor_read_float(uvs, i, vt, 2);
-
-        // NOTE: Negative here is to flip to LH from RH
-        if (tan) {
-            cgltf_accessor_read_float(tan, i, vtan, 4);
-            vertices[i].tangent.x = vtan[0];
-            vertices[i].tangent.y = vtan[1];
-            vertices[i].tangent.z = -vtan[2];
-            vertices[i].tangent.w = -vtan[3];
-        }
-
-        vertices[i].position.x = vp[0];
-        vertices[i].position.y = vp[1];
-        vertices[i].position.z = -vp[2];
-
-        vertices[i].normal.x = vn[0];
-        vertices[i].normal.y = vn[1];
-        vertices[i].normal.z = -vn[2];
-
-        vertices[i].texCoord.x = vt[0];
-        vertices[i].texCoord.y = vt[1];
-    }
-
-    // Now we copy the indices (maybe later I can do memcpy)
-    for (cgltf_size i = 0; i < index_count; i += 3) {
-        // NOTE: We flip the winding to be LH, because glTF is RH
-        uint32_t i0 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 0));
-        uint32_t i1 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 1));
-        uint32_t i2 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 2));
-
-        indices[i + 0] = i0;
-        indices[i + 1] = i2;
-        indices[i + 2] = i1;
-    }
-
-    cgltf_free(gltf_data);
-
     // TODO: Calculate Tangents if they are missing!
 
-    m->vertexStride = sizeof(Vertex);
     m->indexCount = index_count;
+    compute_bounds(m, vertices, vertex_count);
 
-    // Create Vertex Buffer
-    D3D11_BUFFER_DESC bufferDesc = {};
-    bufferDesc.ByteWidth = UINT(sizeof(Vertex) * vertices.size());
-    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
-    bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    bufferDesc.CPUAccessFlags = 0;
-
-    D3D11_SUBRESOURCE_DATA initData = {};
-    initData.pSysMem = vertices.data();
-
-    HRESULT hr = device->CreateBuffer(
-        &bufferDesc,
-        &initData,
-        m->pVertexBuffer.GetAddressOf());
-
-    if (FAILED(hr)) {
-        LOG("mesh::load: Vertex buffer couldn't be created.");
+    if (!allocate_geometry(renderer, m, vertices, vertex_count, indices, index_count)) {
+        LOG("mesh::load: No room in the geometry arena for %s", filename);
+        arena::rewind(scratch, marker);
+        id::invalidate(&m->id);
         return id::invalid();
     }
 
-    // Reuse the vertex buffer description for index description
-    bufferDesc.ByteWidth = UINT(sizeof(uint32_t) * m->indexCount);
-    bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Maybe D3D11_USAGE_IMMUTABLE
-    bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    bufferDesc.CPUAccessFlags = 0;
-
-    // Reuse subresource data as well
-    initData.pSysMem = indices.data();
-
-    hr = device->CreateBuffer(
-        &bufferDesc,
-        &initData,
-        m->pIndexBuffer.GetAddressOf());
-
-    if (FAILED(hr)) {
-        LOG("mesh::load: Index buffer couldn't be created.");
-        return id::invalid();
+    if (!meshlet::build(vertices, vertex_count, indices, index_count, &m->meshlets)) {
+        LOG("mesh::load: Couldn't build the meshlets of %s, it won't be culled per meshlet", filename);
     }
 
+    arena::rewind(scratch, marker);
     return m->id;
 }
 
 MeshId mesh::load_from_data(Vertex *vertices, uint32_t vertex_count, uint32_t *indices, uint32_t index_count) {
     Renderer *renderer = application::get_renderer();
 
-    // Get the device through the application from the renderer
-    // This way it doesn't need to be passed in and for these
-    // loaders it's more ergonomic not to have to do that IMHO.
-    ID3D11Device *device = renderer->device.Get();
-
     // Check if we can find an empty slot for our mesh
     // by linear search (which for this size is probably the best)
     Mesh *m = nullptr;
@@ -222,46 +114,57 @@ MeshId mesh::load_from_data(Vertex *vertices, uint32_t vertex_count, uint32_t *i
         return id::invalid();
     }
 
-    // Create Vertex Buffer
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = UINT(sizeof(*vertices) * vertex_count);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        desc.CPUAccessFlags = 0;
+    if (!allocate_geometry(renderer, m, vertices, vertex_count, indices, index_count)) {
+        LOG("%s: No room in the geometry arena", __func__);
+        id::invalidate(&m->id);
+        return id::invalid();
+    }
 
-        D3D11_SUBRESOURCE_DATA initData = {};
-        initData.pSysMem = vertices;
+    m->indexCount = index_count;
+    compute_bounds(m, vertices, vertex_count);
 
-        HRESULT hr = device->CreateBuffer(&desc, &initData, m->pVertexBuffer.GetAddressOf());
-        if (FAILED(hr)) {
-            LOG("%s: Vertex buffer couldn't be created.", __func__);
-            return id::invalid();
-        }
+    if (!meshlet::build(vertices, vertex_count, indices, index_count, &m->meshlets)) {
+        LOG("%s: Couldn't build the meshlets, the mesh won't be culled per meshlet", __func__);
     }
 
-    // Create index buffer
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.ByteWidth = UINT(sizeof(*indices) * index_count);
-        desc.Usage = D3D11_USAGE_DEFAULT;
-        desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        desc.CPUAccessFlags = 0;
+    return m->id;
+}
+
+AssetLoad mesh::load_async(const char *filename) {
+    Renderer *renderer = application::get_renderer();
+    AsyncScheduler *scheduler = &renderer->asset_scheduler;
 
-        D3D11_SUBRESOURCE_DATA init_data = {};
-        init_data.pSysMem = indices;
+    if (!async::has_room(scheduler)) {
+        LOG("mesh::load_async: Too many loads in flight, loading %s right away", filename);
+        return async::finished(load(filename));
+    }
 
-        HRESULT hr = device->CreateBuffer(&desc, &init_data, m->pIndexBuffer.GetAddressOf());
-        if (FAILED(hr)) {
-            LOG("%s: Index buffer couldn't be created.", __func__);
-            return id::invalid();
+    Mesh *m = nullptr;
+    Mesh *meshes = renderer->meshes;
+    for (uint8_t i = 0; i < MAX_MESHES; ++i) {
+        if (id::is_invalid(meshes[i].id)) {
+            m = &meshes[i];
+            m->id.id = i;
+            break;
         }
     }
 
-    m->vertexStride = sizeof(*vertices);
-    m->indexCount = index_count;
+    if (m == nullptr) {
+        LOG("mesh::load_async: Max meshes reached, adjust max mesh count.");
+        return async::finished(id::invalid());
+    }
 
-    return m->id;
+    // Empty until the load is done, draws nothing and has no bounds
+    m->vertex_range.node = RANGE_ALLOCATOR_NONE;
+    m->index_range.node = RANGE_ALLOCATOR_NONE;
+    m->indexCount = 0;
+    m->bounds_center = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+    m->bounds_radius = 0.0f;
+    m->meshlets = {};
+
+    AssetLoad load = async::begin_load(scheduler, m->id);
+    load_task(renderer, load, filename);
+    return load;
 }
 
 // Id mesh::load_obj(const char *filename) {
@@ -411,9 +314,42 @@ void mesh::destroy(MeshId mesh_id) {
     Renderer *renderer = application::get_renderer();
     assert(renderer && "mesh::destroy: Something went wrong, the renderer couldn't be retrieved");
 
-    if (id::is_fresh(renderer->meshes[mesh_id.id].id, mesh_id)) {
-        id::invalidate(&renderer->meshes[mesh_id.id].id);
-        delete &renderer->meshes[mesh_id.id];
+    if (id::is_valid(mesh_id) && mesh_id.id < MAX_MESHES && id::is_fresh(renderer->meshes[mesh_id.id].id, mesh_id)) {
+        Mesh *m = &renderer->meshes[mesh_id.id];
+        geometry_arena::release(&renderer->geometry_arena, m->vertex_range, m->index_range);
+        meshlet::destroy(&m->meshlets);
+        m->vertex_range.node = RANGE_ALLOCATOR_NONE;
+        m->index_range.node = RANGE_ALLOCATOR_NONE;
+
+        // The next mesh in the slot gets the next generation, so a load of this one doesn't fill it
+        id::invalidate(&m->id);
+        m->id.generation = mesh_id.generation;
+        id::gen_increment(&m->id);
+    }
+}
+
+AssetLoad mesh::acquire(const char *filename) {
+    Renderer *renderer = application::get_renderer();
+    AssetRegistry *registry = &renderer->asset_registry;
+
+    AssetKey key;
+    AssetLoad load;
+    bool is_keyed = asset_registry::make_key(registry, ASSET_MESH, 0, filename, &key);
+    if (is_keyed && asset_registry::acquire(registry, &key, &load)) {
+        return load;
+    }
+
+    load = load_async(filename);
+    if (is_keyed && id::is_valid(load.id)) {
+        asset_registry::add(registry, &key, load);
+    }
+    return load;
+}
+
+void mesh::release(MeshId mesh_id) {
+    Renderer *renderer = application::get_renderer();
+    if (asset_registry::release(&renderer->asset_registry, ASSET_MESH, mesh_id)) {
+        destroy(mesh_id);
     }
 }
 
@@ -427,30 +363,279 @@ Mesh *mesh::get(Renderer *renderer, MeshId mesh_id) {
     return nullptr;
 }
 
-void mesh::draw(ID3D11DeviceContext *context, Mesh *mesh) {
-    if (!mesh || !mesh->pVertexBuffer) {
+void mesh::bind_geometry(Renderer *renderer) {
+    GeometryArena *arena = &renderer->geometry_arena;
+    state_tracker::set_vertex_buffer(&renderer->state_tracker, arena->vertex_buffer_ptr.Get(), arena->vertex_stride, 0);
+    state_tracker::set_index_buffer(&renderer->state_tracker, arena->index_buffer_ptr.Get(), DXGI_FORMAT_R32_UINT, 0);
+    state_tracker::set_topology(&renderer->state_tracker, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void mesh::draw(StateTracker *tracker, Mesh *mesh) {
+    if (!mesh || mesh->index_range.node == RANGE_ALLOCATOR_NONE) {
+        return;
+    }
+
+    // The buffers are bound by bind_geometry, only the draw goes out here
+    state_tracker::draw_indexed(tracker, mesh->indexCount, mesh->index_range.offset, (INT)mesh->vertex_range.offset);
+}
+
+void mesh::draw_ranges(StateTracker *tracker, Mesh *mesh, const MeshletDraw *draws, uint32_t draw_count) {
+    if (!mesh || mesh->index_range.node == RANGE_ALLOCATOR_NONE) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < draw_count; ++i) {
+        state_tracker::draw_indexed(tracker, draws[i].index_count, mesh->index_range.offset + draws[i].index_offset, (INT)mesh->vertex_range.offset);
+    }
+}
+
+bool mesh::defragment(Renderer *renderer) {
+    if (!geometry_arena::compact(&renderer->geometry_arena, renderer->device.Get(), renderer->context.Get())) {
+        return false;
+    }
+
+    // Same nodes, new offsets
+    for (uint8_t i = 0; i < MAX_MESHES; ++i) {
+        Mesh *m = &renderer->meshes[i];
+        if (id::is_valid(m->id) && m->index_range.node != RANGE_ALLOCATOR_NONE) {
+            m->vertex_range = range_allocator::get(&renderer->geometry_arena.vertices, m->vertex_range.node);
+            m->index_range = range_allocator::get(&renderer->geometry_arena.indices, m->index_range.node);
+        }
+    }
+
+    // The old buffers may still be bound, the new ones get bound by the next pass
+    return true;
+}
+
+void mesh::compute_bounds(Mesh *mesh, const Vertex *vertices, uint32_t vertex_count) {
+    assert(mesh && "mesh::compute_bounds: Mesh pointer cannot be NULL");
+
+    mesh->bounds_center = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mesh->bounds_radius = 0.0f;
+    if (!vertices || vertex_count == 0) {
         return;
     }
 
-    // Set the vertex buffer
-    UINT offset = 0;
-    context->IASetVertexBuffers(
-        0, // Start slot
-        1, // Number of buffers
-        mesh->pVertexBuffer.GetAddressOf(),
-        &mesh->vertexStride,
-        &offset);
+    // Center of the AABB, then the farthest vertex from it. Not the tightest
+    // sphere, but good enough for culling.
+    DirectX::XMFLOAT3 min = vertices[0].position;
+    DirectX::XMFLOAT3 max = vertices[0].position;
+    for (uint32_t i = 1; i < vertex_count; ++i) {
+        const DirectX::XMFLOAT3 *p = &vertices[i].position;
+        min.x = fminf(min.x, p->x);
+        min.y = fminf(min.y, p->y);
+        min.z = fminf(min.z, p->z);
+        max.x = fmaxf(max.x, p->x);
+        max.y = fmaxf(max.y, p->y);
+        max.z = fmaxf(max.z, p->z);
+    }
+
+    DirectX::XMFLOAT3 center((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+    float radius_sq = 0.0f;
+    for (uint32_t i = 0; i < vertex_count; ++i) {
+        float dx = vertices[i].position.x - center.x;
+        float dy = vertices[i].position.y - center.y;
+        float dz = vertices[i].position.z - center.z;
+        radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+    }
+
+    mesh->bounds_center = center;
+    mesh->bounds_radius = sqrtf(radius_sq);
+}
+
+static bool allocate_geometry(Renderer *renderer, Mesh *m, const Vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count) {
+    GeometryArena *arena = &renderer->geometry_arena;
+    ID3D11DeviceContext *context = renderer->context.Get();
+
+    m->vertex_range.node = RANGE_ALLOCATOR_NONE;
+    m->index_range.node = RANGE_ALLOCATOR_NONE;
+    if (geometry_arena::allocate(arena, context, vertices, vertex_count, indices, index_count, &m->vertex_range, &m->index_range)) {
+        return true;
+    }
 
-    // Set index buffer...
-    context->IASetIndexBuffer(
-        mesh->pIndexBuffer.Get(),
-        DXGI_FORMAT_R32_UINT,
-        0);
+    // Enough space, just not in one piece
+    if (!geometry_arena::fits_after_compact(arena, vertex_count, index_count) || !mesh::defragment(renderer)) {
+        return false;
+    }
+    return geometry_arena::allocate(arena, context, vertices, vertex_count, indices, index_count, &m->vertex_range, &m->index_range);
+}
 
-    // Set the primitive topology
-    // TODO: Do I need this here if I set this in my passes?
-    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+static bool read_gltf(const char *filename, Arena *arena, Vertex **out_vertices, uint32_t *out_vertex_count, uint32_t **out_indices, uint32_t *out_index_count) {
+    // Parse glTF model, the .gltf and its buffers come through the vfs onto the arena
+    cgltf_options opts = {};
+    opts.file.read = gltf_file_read;
+    opts.file.release = gltf_file_release;
+    opts.file.user_data = arena;
+    cgltf_data *gltf_data = NULL;
+    cgltf_result res = cgltf_parse_file(&opts, filename, &gltf_data);
+    if (res != cgltf_result_success) {
+        LOG("mesh::read_gltf: Failed to load and parse glTF file: %s", filename);
+        return false;
+    }
+
+    // Throw in an extra validation provided by the lib
+    if (cgltf_validate(gltf_data) != cgltf_result_success) {
+        LOG("mesh::read_gltf: glTF model failed validation");
+        cgltf_free(gltf_data);
+        return false;
+    }
+
+    // For now, pick the very first primitive
+    cgltf_primitive *primitive = &gltf_data->meshes->primitives[0];
+
+    const cgltf_accessor *pos = cgltf_find_accessor(primitive, cgltf_attribute_type_position, 0);
+    const cgltf_accessor *nor = cgltf_find_accessor(primitive, cgltf_attribute_type_normal, 0);
+    const cgltf_accessor *uvs = cgltf_find_accessor(primitive, cgltf_attribute_type_texcoord, 0);
+    const cgltf_accessor *tan = cgltf_find_accessor(primitive, cgltf_attribute_type_tangent, 0);
+
+    // Accessor separately for the indices
+    const cgltf_accessor *ind = primitive->indices;
+    size_t index_count = ind->count;
+
+    // Make sure all the required attribute types are present
+    // NOTE: Normals could be calculated by smoothing or similar though...
+    if (!pos || !nor || !uvs) {
+        LOG("mesh::read_gltf: glTF model is missing one of the required attribute types (position, normal, uv)");
+        cgltf_free(gltf_data);
+        return false;
+    }
+
+    // Now that we made sure we have everything we need, let's load in the binary data
+    if (cgltf_load_buffers(&opts, gltf_data, filename) != cgltf_result_success) {
+        LOG("mesh::read_gltf: Failed to load buffer data for glTF file: %s", filename);
+        cgltf_free(gltf_data);
+        return false;
+    }
+
+    // The caller rewinds the arena when it's done with them
+    Vertex *vertices = ARENA_PUSH_ARRAY(arena, Vertex, pos->count);
+    uint32_t *indices = ARENA_PUSH_ARRAY(arena, uint32_t, index_count);
+    if (!vertices || !indices) {
+        LOG("mesh::read_gltf: No room for the %llu vertices of %s", (unsigned long long)pos->count, filename);
+        cgltf_free(gltf_data);
+        return false;
+    }
+
+    // Loop through all the unique vertices and interleave them into our own array
+    for (cgltf_size i = 0; i < pos->count; ++i) {
+        float vp[3];
+        float vn[3];
+        float vt[2];
+        float vtan[4];
+
+        cgltf_accessor_read_float(pos, i, vp, 3);
+        cgltf_accessor_read_float(nor, i, vn, 3);
+        cgltf_accessor_read_float(uvs, i, vt, 2);
+
+        // NOTE: Negative here is to flip to LH from RH
+        if (tan) {
+            cgltf_accessor_read_float(tan, i, vtan, 4);
+            vertices[i].tangent.x = vtan[0];
+            vertices[i].tangent.y = vtan[1];
+            vertices[i].tangent.z = -vtan[2];
+            vertices[i].tangent.w = -vtan[3];
+        } else {
+            vertices[i].tangent = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        vertices[i].position.x = vp[0];
+        vertices[i].position.y = vp[1];
+        vertices[i].position.z = -vp[2];
+
+        vertices[i].normal.x = vn[0];
+        vertices[i].normal.y = vn[1];
+        vertices[i].normal.z = -vn[2];
+
+        vertices[i].texCoord.x = vt[0];
+        vertices[i].texCoord.y = vt[1];
+    }
+
+    // Now we copy the indices (maybe later I can do memcpy)
+    for (cgltf_size i = 0; i < index_count; i += 3) {
+        // NOTE: We flip the winding to be LH, because glTF is RH
+        uint32_t i0 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 0));
+        uint32_t i1 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 1));
+        uint32_t i2 = static_cast<uint32_t>(cgltf_accessor_read_index(ind, i + 2));
+
+        indices[i + 0] = i0;
+        indices[i + 1] = i2;
+        indices[i + 2] = i1;
+    }
+
+    cgltf_free(gltf_data);
+
+    *out_vertices = vertices;
+    *out_vertex_count = (uint32_t)pos->count;
+    *out_indices = indices;
+    *out_index_count = (uint32_t)index_count;
+    return true;
+}
+
+static AsyncTask load_task(Renderer *renderer, AssetLoad load, const char *filename) {
+    AsyncScheduler *scheduler = load.scheduler;
+
+    // filename is only good until the first co_await
+    char path[ASYNC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s", filename);
+
+    co_await async::to_worker(scheduler);
+
+    // Everything but the upload happens here. The data goes along to the main
+    // thread, so it's in an arena of the load's own instead of the worker's scratch.
+    Arena load_arena;
+    Vertex *vertices = nullptr;
+    uint32_t *indices = nullptr;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    Mesh loaded = {};
+    bool is_read = arena::initialize(&load_arena, ARENA_SCRATCH_RESERVE) &&
+                   read_gltf(path, &load_arena, &vertices, &vertex_count, &indices, &index_count);
+    if (is_read) {
+        mesh::compute_bounds(&loaded, vertices, vertex_count);
+        if (!meshlet::build(vertices, vertex_count, indices, index_count, &loaded.meshlets)) {
+            LOG("mesh::load_async: Couldn't build the meshlets of %s, it won't be culled per meshlet", path);
+        }
+    }
+
+    co_await async::to_main(scheduler);
+
+    // Only filled while the slot still holds our empty mesh
+    Mesh *m = mesh::get(renderer, load.id);
+    if (!is_read) {
+        LOG("mesh::load_async: Couldn't read %s, the mesh stays empty", path);
+    } else if (!m || m->index_range.node != RANGE_ALLOCATOR_NONE || m->indexCount != 0) {
+        LOG("mesh::load_async: %s was destroyed while loading", path);
+    } else if (!allocate_geometry(renderer, m, vertices, vertex_count, indices, index_count)) {
+        LOG("mesh::load_async: No room in the geometry arena for %s, the mesh stays empty", path);
+    } else {
+        m->indexCount = index_count;
+        m->bounds_center = loaded.bounds_center;
+        m->bounds_radius = loaded.bounds_radius;
+        m->meshlets = loaded.meshlets;
+        loaded.meshlets = {};
+    }
+
+    meshlet::destroy(&loaded.meshlets);
+    arena::shutdown(&load_arena);
+    async::end_load(scheduler, &load);
+}
+
+static cgltf_result gltf_file_read(const cgltf_memory_options *memory_options, const cgltf_file_options *file_options, const char *path, cgltf_size *size, void **data) {
+    (void)memory_options;
+    const uint8_t *file_data = nullptr;
+    size_t file_size = 0;
+    if (!vfs::read(path, (Arena *)file_options->user_data, &file_data, &file_size)) {
+        return cgltf_result_file_not_found;
+    }
+    // cgltf only reads it, the cast is for its signature
+    *data = (void *)file_data;
+    *size = file_size;
+    return cgltf_result_success;
+}
 
-    // Draw
-    context->DrawIndexed(mesh->indexCount, 0, 0);
+static void gltf_file_release(const cgltf_memory_options *memory_options, const cgltf_file_options *file_options, void *data) {
+    // On the arena or in the pack, the caller rewinds
+    (void)memory_options;
+    (void)file_options;
+    (void)data;
 }
@@ -1,12 +1,14 @@
 #pragma once
 
+#include "async.hpp"
 #include "id.hpp"
+#include "meshlet.hpp"
+#include "range_allocator.hpp"
 #include <DirectXMath.h>
 #include <cstdint>
-#include <d3d11.h>
-#include <wrl/client.h>
 
 struct Renderer;
+struct StateTracker;
 
 using MeshId = Id;
 
@@ -20,21 +22,45 @@ struct Vertex {
 struct Mesh {
     MeshId id;
 
-    Microsoft::WRL::ComPtr<ID3D11Buffer> pVertexBuffer;
-    Microsoft::WRL::ComPtr<ID3D11Buffer> pIndexBuffer;
+    // Where the mesh lives in the renderer's geometry arena. The vertex offset
+    // is the base vertex of the draw, the indices are relative to it.
+    RangeAllocation vertex_range;
+    RangeAllocation index_range;
     uint32_t indexCount;
-    UINT vertexStride;
+
+    // Local space bounding sphere
+    DirectX::XMFLOAT3 bounds_center;
+    float bounds_radius;
+
+    // Empty when the build failed, the mesh is drawn whole then
+    MeshletSet meshlets;
 };
 
 namespace mesh {
 
 MeshId load(const char *filename);
+// Returns right away with an empty mesh in the slot, the file is read (and its
+// meshlets built) on a worker and the geometry uploaded in job_system::run_main_jobs
+AssetLoad load_async(const char *filename);
 bool load_obj(const char *filename);
 bool load_gltf(const char *filename);
 MeshId load_from_data(Vertex *vertices, uint32_t vertex_count, uint32_t *indices, uint32_t index_count);
+// load_async the first time a file is asked for, the same mesh with one more
+// reference after that (see asset_registry.hpp). Give each one back with release.
+AssetLoad acquire(const char *filename);
+// Destroys the mesh with its last reference
+void release(MeshId mesh_id);
+// Frees the mesh right away, however many hold it. Its ids are stale after.
 void destroy(MeshId mesh_id);
 Mesh *get(Renderer *renderer, MeshId mesh_id);
-void bind(Renderer *renderer, Mesh *mesh);
-void draw(ID3D11DeviceContext *context, Mesh *mesh);
+// Binds the shared geometry buffers, once per pass before the draws
+void bind_geometry(Renderer *renderer);
+void draw(StateTracker *tracker, Mesh *mesh);
+// Parts of the mesh, offsets from the start of its indices (see meshlet::build_draws)
+void draw_ranges(StateTracker *tracker, Mesh *mesh, const MeshletDraw *draws, uint32_t draw_count);
+// Packs the geometry arena so its free space is in one piece. The loaders
+// do this on their own when a mesh only fits that way.
+bool defragment(Renderer *renderer);
+void compute_bounds(Mesh *mesh, const Vertex *vertices, uint32_t vertex_count);
 
 } // namespace mesh
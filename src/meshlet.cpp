@@ -0,0 +1,422 @@
+#include "meshlet.hpp"
+
+#include "arena.hpp"
+#include "memory_tracker.hpp"
+#include "mesh.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define MESHLET_SSE 1
+#include <xmmintrin.h>
+#else
+#define MESHLET_SSE 0
+#endif
+
+#define BOUNDS_ARRAYS 8
+
+static uint32_t partition(const uint32_t *indices, uint32_t triangle_count, uint32_t vertex_count, Meshlet *out_meshlets);
+static void compute_bounds(const Vertex *vertices, const uint32_t *indices, MeshletSet *set, uint32_t m);
+static bool test_meshlet(const MeshletSet *set, const MeshletCullView *view, uint32_t m);
+static size_t get_block_bytes(uint32_t count, size_t *out_meshlet_bytes);
+
+bool meshlet::build(const Vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count, MeshletSet *out_set) {
+    assert(vertices && indices && out_set && "meshlet::build: Pointers cannot be NULL");
+
+    memset(out_set, 0, sizeof(*out_set));
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count == 0 || vertex_count == 0) {
+        return false;
+    }
+
+    // A meshlet only ends early when the next triangle brings it past 64
+    // vertices, so there are at least 21 triangles in every one but the last
+    uint32_t max_meshlets = triangle_count / ((MESHLET_MAX_VERTICES - 2) / 3) + 1;
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    Meshlet *partitioned = ARENA_PUSH_ARRAY(scratch, Meshlet, max_meshlets);
+    if (!partitioned) {
+        return false;
+    }
+    uint32_t count = partition(indices, triangle_count, vertex_count, partitioned);
+    if (count == 0) {
+        arena::rewind(scratch, marker);
+        return false;
+    }
+
+    // Meshlets and bounds in one block
+    uint32_t padded = (count + 3) & ~3u;
+    size_t meshlet_bytes = 0;
+    size_t block_bytes = get_block_bytes(count, &meshlet_bytes);
+    uint8_t *block = (uint8_t *)malloc(block_bytes);
+    if (!block) {
+        arena::rewind(scratch, marker);
+        return false;
+    }
+    memory_tracker::track(MEMORY_TAG_MESHES, MEMORY_DOMAIN_CPU, block_bytes);
+
+    out_set->count = count;
+    out_set->meshlets = (Meshlet *)block;
+    memcpy(out_set->meshlets, partitioned, count * sizeof(Meshlet));
+    arena::rewind(scratch, marker);
+
+    float *bounds = (float *)(block + meshlet_bytes);
+    float **arrays[BOUNDS_ARRAYS] = {&out_set->center_x, &out_set->center_y, &out_set->center_z, &out_set->radius,
+                                     &out_set->axis_x, &out_set->axis_y, &out_set->axis_z, &out_set->cutoff};
+    for (uint32_t i = 0; i < BOUNDS_ARRAYS; ++i) {
+        *arrays[i] = bounds + i * padded;
+    }
+
+    for (uint32_t m = 0; m < count; ++m) {
+        compute_bounds(vertices, indices, out_set, m);
+    }
+
+    // The padding lanes are masked off, a zero sphere at the origin is as good as anything
+    for (uint32_t m = count; m < padded; ++m) {
+        out_set->center_x[m] = out_set->center_y[m] = out_set->center_z[m] = out_set->radius[m] = 0.0f;
+        out_set->axis_x[m] = out_set->axis_y[m] = out_set->axis_z[m] = 0.0f;
+        out_set->cutoff[m] = MESHLET_NO_CONE;
+    }
+
+    return true;
+}
+
+void meshlet::destroy(MeshletSet *set) {
+    // Everything lives in the block the meshlets start
+    if (set->meshlets) {
+        size_t meshlet_bytes = 0;
+        memory_tracker::untrack(MEMORY_TAG_MESHES, MEMORY_DOMAIN_CPU, get_block_bytes(set->count, &meshlet_bytes));
+    }
+    free(set->meshlets);
+    memset(set, 0, sizeof(*set));
+}
+
+MeshletCullView meshlet::make_view(const DirectX::XMFLOAT4X4 *world, const DirectX::XMFLOAT4X4 *view_projection, DirectX::XMFLOAT3 camera_position) {
+    const DirectX::XMFLOAT4X4 &w = *world;
+    const DirectX::XMFLOAT4X4 &vp = *view_projection;
+    MeshletCullView view = {};
+
+    // Local to clip, the planes come straight out of its columns (Gribb/Hartmann)
+    float m[4][4];
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            m[r][c] = w.m[r][0] * vp.m[0][c] + w.m[r][1] * vp.m[1][c] + w.m[r][2] * vp.m[2][c] + w.m[r][3] * vp.m[3][c];
+        }
+    }
+    for (int r = 0; r < 4; ++r) {
+        view.planes[0][r] = m[r][3] + m[r][0]; // Left
+        view.planes[1][r] = m[r][3] - m[r][0]; // Right
+        view.planes[2][r] = m[r][3] + m[r][1]; // Bottom
+        view.planes[3][r] = m[r][3] - m[r][1]; // Top
+        view.planes[4][r] = m[r][2];           // Near
+        view.planes[5][r] = m[r][3] - m[r][2]; // Far
+    }
+    for (int p = 0; p < 6; ++p) {
+        float *plane = view.planes[p];
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        float inv_length = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int i = 0; i < 4; ++i) {
+            plane[i] *= inv_length;
+        }
+    }
+
+    // Camera into local space: p_local = (p_world - translation) * inverse(upper 3x3)
+    float a[3][3] = {{w.m[0][0], w.m[0][1], w.m[0][2]}, {w.m[1][0], w.m[1][1], w.m[1][2]}, {w.m[2][0], w.m[2][1], w.m[2][2]}};
+    float cofactor[3][3];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            int r0 = (r + 1) % 3, r1 = (r + 2) % 3;
+            int c0 = (c + 1) % 3, c1 = (c + 2) % 3;
+            cofactor[r][c] = a[r0][c0] * a[r1][c1] - a[r0][c1] * a[r1][c0];
+        }
+    }
+    float det = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+
+    float d[3] = {camera_position.x - w.m[3][0], camera_position.y - w.m[3][1], camera_position.z - w.m[3][2]};
+    float local[3] = {0.0f, 0.0f, 0.0f};
+    if (fabsf(det) > 1e-12f) {
+        // inverse = transpose(cofactor) / det, and d is a row vector
+        for (int c = 0; c < 3; ++c) {
+            local[c] = (d[0] * cofactor[c][0] + d[1] * cofactor[c][1] + d[2] * cofactor[c][2]) / det;
+        }
+    }
+    view.camera_position = DirectX::XMFLOAT3(local[0], local[1], local[2]);
+
+    // Rows are the scaled axes
+    float s0 = sqrtf(a[0][0] * a[0][0] + a[0][1] * a[0][1] + a[0][2] * a[0][2]);
+    float s1 = sqrtf(a[1][0] * a[1][0] + a[1][1] * a[1][1] + a[1][2] * a[1][2]);
+    float s2 = sqrtf(a[2][0] * a[2][0] + a[2][1] * a[2][1] + a[2][2] * a[2][2]);
+    float s_min = fminf(s0, fminf(s1, s2));
+    float s_max = fmaxf(s0, fmaxf(s1, s2));
+    view.cone_culling = det > 0.0f && s_max <= s_min * 1.001f;
+
+    return view;
+}
+
+uint32_t meshlet::cull_reference(const MeshletSet *set, const MeshletCullView *view, uint32_t *out_visible) {
+    memset(out_visible, 0, ((set->count + 31) / 32) * sizeof(uint32_t));
+
+    uint32_t visible_count = 0;
+    for (uint32_t m = 0; m < set->count; ++m) {
+        if (test_meshlet(set, view, m)) {
+            out_visible[m / 32] |= 1u << (m % 32);
+            visible_count++;
+        }
+    }
+    return visible_count;
+}
+
+#if MESHLET_SSE
+uint32_t meshlet::cull_simd(const MeshletSet *set, const MeshletCullView *view, uint32_t *out_visible) {
+    memset(out_visible, 0, ((set->count + 31) / 32) * sizeof(uint32_t));
+
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; ++p) {
+        for (int i = 0; i < 4; ++i) {
+            planes[p][i] = _mm_set1_ps(view->planes[p][i]);
+        }
+    }
+    const __m128 cam_x = _mm_set1_ps(view->camera_position.x);
+    const __m128 cam_y = _mm_set1_ps(view->camera_position.y);
+    const __m128 cam_z = _mm_set1_ps(view->camera_position.z);
+    const __m128 zero = _mm_setzero_ps();
+
+    uint32_t visible_count = 0;
+    for (uint32_t m = 0; m < set->count; m += 4) {
+        __m128 cx = _mm_load_ps(&set->center_x[m]);
+        __m128 cy = _mm_load_ps(&set->center_y[m]);
+        __m128 cz = _mm_load_ps(&set->center_z[m]);
+        __m128 radius = _mm_load_ps(&set->radius[m]);
+        __m128 neg_radius = _mm_sub_ps(zero, radius);
+
+        // Same order of operations as test_meshlet, so the results match bit for bit
+        __m128 visible = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], cx), _mm_mul_ps(planes[p][1], cy)), _mm_mul_ps(planes[p][2], cz)), planes[p][3]);
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, neg_radius));
+        }
+
+        if (view->cone_culling && _mm_movemask_ps(visible)) {
+            __m128 dx = _mm_sub_ps(cx, cam_x);
+            __m128 dy = _mm_sub_ps(cy, cam_y);
+            __m128 dz = _mm_sub_ps(cz, cam_z);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_load_ps(&set->axis_x[m])), _mm_mul_ps(dy, _mm_load_ps(&set->axis_y[m]))),
+                                      _mm_mul_ps(dz, _mm_load_ps(&set->axis_z[m])));
+            __m128 backfacing = _mm_cmpge_ps(along, _mm_add_ps(_mm_mul_ps(_mm_load_ps(&set->cutoff[m]), length), radius));
+            visible = _mm_andnot_ps(backfacing, visible);
+        }
+
+        // Drop the padding lanes
+        uint32_t mask = (uint32_t)_mm_movemask_ps(visible);
+        uint32_t lanes = set->count - m < 4 ? set->count - m : 4;
+        mask &= (1u << lanes) - 1;
+
+        // m is a multiple of 4, the 4 bits never straddle two words
+        out_visible[m / 32] |= mask << (m % 32);
+        visible_count += (uint32_t)std::popcount(mask);
+    }
+    return visible_count;
+}
+#else
+uint32_t meshlet::cull_simd(const MeshletSet *set, const MeshletCullView *view, uint32_t *out_visible) {
+    // No SSE on this target
+    return cull_reference(set, view, out_visible);
+}
+#endif
+
+uint32_t meshlet::build_draws(const MeshletSet *set, const uint32_t *visible, MeshletDraw *out_draws) {
+    uint32_t draw_count = 0;
+    bool open = false;
+    for (uint32_t m = 0; m < set->count; ++m) {
+        if (!(visible[m / 32] & (1u << (m % 32)))) {
+            open = false;
+            continue;
+        }
+
+        // Meshlets are consecutive in the index buffer, a visible neighbour just extends the draw
+        const Meshlet *meshlet = &set->meshlets[m];
+        if (open) {
+            out_draws[draw_count - 1].index_count += meshlet->triangle_count * 3;
+        } else {
+            out_draws[draw_count].index_offset = meshlet->index_offset;
+            out_draws[draw_count].index_count = meshlet->triangle_count * 3;
+            draw_count++;
+            open = true;
+        }
+    }
+    return draw_count;
+}
+
+// Cuts the triangles in order, a meshlet ends when the next triangle would
+// bring it past the vertex or triangle limit
+static uint32_t partition(const uint32_t *indices, uint32_t triangle_count, uint32_t vertex_count, Meshlet *out_meshlets) {
+    // Which meshlet (+1) last used each vertex, so nothing has to be cleared between meshlets
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    uint32_t *last_meshlet = ARENA_PUSH_ARRAY(scratch, uint32_t, vertex_count);
+    if (!last_meshlet) {
+        return 0;
+    }
+    memset(last_meshlet, 0, vertex_count * sizeof(uint32_t));
+
+    uint32_t count = 0;
+    uint32_t meshlet_vertices = 0;
+    Meshlet *current = nullptr;
+    for (uint32_t t = 0; t < triangle_count; ++t) {
+        const uint32_t *tri = &indices[t * 3];
+        if (tri[0] >= vertex_count || tri[1] >= vertex_count || tri[2] >= vertex_count) {
+            // Out of range index, the mesh is broken
+            arena::rewind(scratch, marker);
+            return 0;
+        }
+
+        uint32_t tag = count; // Tag of the current meshlet, count + 1 once it's open
+        uint32_t new_vertices = 0;
+        if (current) {
+            new_vertices += last_meshlet[tri[0]] != tag;
+            new_vertices += last_meshlet[tri[1]] != tag && tri[1] != tri[0];
+            new_vertices += last_meshlet[tri[2]] != tag && tri[2] != tri[0] && tri[2] != tri[1];
+        }
+
+        if (!current || meshlet_vertices + new_vertices > MESHLET_MAX_VERTICES || current->triangle_count == MESHLET_MAX_TRIANGLES) {
+            current = &out_meshlets[count++];
+            current->index_offset = t * 3;
+            current->triangle_count = 0;
+            meshlet_vertices = 0;
+            tag = count;
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            if (last_meshlet[tri[i]] != tag) {
+                last_meshlet[tri[i]] = tag;
+                meshlet_vertices++;
+            }
+        }
+        current->triangle_count++;
+    }
+
+    arena::rewind(scratch, marker);
+    return count;
+}
+
+static void compute_bounds(const Vertex *vertices, const uint32_t *indices, MeshletSet *set, uint32_t m) {
+    const Meshlet *meshlet = &set->meshlets[m];
+    const uint32_t *tris = &indices[meshlet->index_offset];
+    uint32_t index_count = meshlet->triangle_count * 3;
+
+    // Sphere around the center of the AABB, like the mesh bounds
+    DirectX::XMFLOAT3 lo = vertices[tris[0]].position;
+    DirectX::XMFLOAT3 hi = lo;
+    for (uint32_t i = 1; i < index_count; ++i) {
+        const DirectX::XMFLOAT3 &p = vertices[tris[i]].position;
+        lo.x = fminf(lo.x, p.x), lo.y = fminf(lo.y, p.y), lo.z = fminf(lo.z, p.z);
+        hi.x = fmaxf(hi.x, p.x), hi.y = fmaxf(hi.y, p.y), hi.z = fmaxf(hi.z, p.z);
+    }
+    float cx = (lo.x + hi.x) * 0.5f;
+    float cy = (lo.y + hi.y) * 0.5f;
+    float cz = (lo.z + hi.z) * 0.5f;
+    float radius_sq = 0.0f;
+    for (uint32_t i = 0; i < index_count; ++i) {
+        const DirectX::XMFLOAT3 &p = vertices[tris[i]].position;
+        float dx = p.x - cx, dy = p.y - cy, dz = p.z - cz;
+        radius_sq = fmaxf(radius_sq, dx * dx + dy * dy + dz * dz);
+    }
+    set->center_x[m] = cx;
+    set->center_y[m] = cy;
+    set->center_z[m] = cz;
+    set->radius[m] = sqrtf(radius_sq);
+
+    // Facing normals, the way the rasterizer sees them (clockwise is the front,
+    // so cross(p1 - p0, p2 - p0) points at the viewer)
+    float normals[MESHLET_MAX_TRIANGLES][3];
+    uint32_t normal_count = 0;
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (uint32_t t = 0; t < meshlet->triangle_count; ++t) {
+        const DirectX::XMFLOAT3 &p0 = vertices[tris[t * 3 + 0]].position;
+        const DirectX::XMFLOAT3 &p1 = vertices[tris[t * 3 + 1]].position;
+        const DirectX::XMFLOAT3 &p2 = vertices[tris[t * 3 + 2]].position;
+        float e1x = p1.x - p0.x, e1y = p1.y - p0.y, e1z = p1.z - p0.z;
+        float e2x = p2.x - p0.x, e2y = p2.y - p0.y, e2z = p2.z - p0.z;
+        float nx = e1y * e2z - e1z * e2y;
+        float ny = e1z * e2x - e1x * e2z;
+        float nz = e1x * e2y - e1y * e2x;
+        float length = sqrtf(nx * nx + ny * ny + nz * nz);
+        float e1_length = sqrtf(e1x * e1x + e1y * e1y + e1z * e1z);
+        float e2_length = sqrtf(e2x * e2x + e2y * e2y + e2z * e2z);
+        if (length <= 1e-5f * e1_length * e2_length) {
+            // Slivers, their normal is mostly rounding error and they don't cover pixels anyway
+            continue;
+        }
+
+        float *n = normals[normal_count++];
+        n[0] = nx / length, n[1] = ny / length, n[2] = nz / length;
+        ax += n[0], ay += n[1], az += n[2];
+    }
+
+    set->axis_x[m] = set->axis_y[m] = set->axis_z[m] = 0.0f;
+    set->cutoff[m] = MESHLET_NO_CONE;
+
+    float axis_length = sqrtf(ax * ax + ay * ay + az * az);
+    if (normal_count == 0 || axis_length <= 1e-6f) {
+        return;
+    }
+    ax /= axis_length, ay /= axis_length, az /= axis_length;
+
+    float min_dot = 1.0f;
+    for (uint32_t i = 0; i < normal_count; ++i) {
+        min_dot = fminf(min_dot, normals[i][0] * ax + normals[i][1] * ay + normals[i][2] * az);
+    }
+
+    // Normals more than 90 degrees apart, some triangle always faces the camera
+    if (min_dot <= 0.0f) {
+        return;
+    }
+
+    // The meshlet faces away when the direction to it is within 90 degrees minus
+    // the cone's and the sphere's angles from the axis. sin(a + b) <= sin(a) + sin(b)
+    // keeps that conservative without the cosines: dot(c - cam, axis) >= sin(a) * |c - cam| + r
+    set->axis_x[m] = ax;
+    set->axis_y[m] = ay;
+    set->axis_z[m] = az;
+    set->cutoff[m] = sqrtf(1.0f - min_dot * min_dot) + 1e-4f;
+}
+
+static bool test_meshlet(const MeshletSet *set, const MeshletCullView *view, uint32_t m) {
+    float cx = set->center_x[m];
+    float cy = set->center_y[m];
+    float cz = set->center_z[m];
+    float radius = set->radius[m];
+    float neg_radius = 0.0f - radius;
+
+    for (int p = 0; p < 6; ++p) {
+        const float *plane = view->planes[p];
+        float distance = plane[0] * cx + plane[1] * cy + plane[2] * cz + plane[3];
+        if (!(distance >= neg_radius)) {
+            return false;
+        }
+    }
+
+    if (view->cone_culling) {
+        float dx = cx - view->camera_position.x;
+        float dy = cy - view->camera_position.y;
+        float dz = cz - view->camera_position.z;
+        float length = sqrtf(dx * dx + dy * dy + dz * dz);
+        float along = dx * set->axis_x[m] + dy * set->axis_y[m] + dz * set->axis_z[m];
+        if (along >= set->cutoff[m] * length + radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t get_block_bytes(uint32_t count, size_t *out_meshlet_bytes) {
+    // Bounds arrays padded to whole SIMD lanes, after the meshlets
+    uint32_t padded = (count + 3) & ~3u;
+    *out_meshlet_bytes = (count * sizeof(Meshlet) + 15) & ~(size_t)15;
+    return *out_meshlet_bytes + BOUNDS_ARRAYS * padded * sizeof(float);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+// Meshlets are runs of consecutive triangles of a mesh's index buffer, cut
+// so each has at most 64 unique vertices and 124 triangles. Big meshes get
+// culled per meshlet instead of all or nothing:
+//  - frustum, with a bounding sphere per meshlet
+//  - backfacing, with a normal cone per meshlet. When every triangle faces
+//    away from the camera the whole meshlet is dropped.
+// Visible meshlets that are next to each other become one draw.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// Meshes with more than this are drawn whole, it's the size of the visibility scratch
+#define MESHLET_MAX_PER_MESH 8192
+// Cutoff for meshlets whose normals spread too far for a cone, the test never passes
+#define MESHLET_NO_CONE 2.0f
+
+struct Vertex;
+
+struct Meshlet {
+    uint32_t index_offset; // From the start of the mesh's indices
+    uint32_t triangle_count;
+};
+
+// The bounds are SoA so four meshlets get culled at once, padded to a
+// multiple of 4. Everything is in the mesh's local space.
+struct MeshletSet {
+    uint32_t count;
+    Meshlet *meshlets;
+
+    float *center_x;
+    float *center_y;
+    float *center_z;
+    float *radius;
+    // Average normal, and the sine of the widest angle from it to a triangle's normal
+    float *axis_x;
+    float *axis_y;
+    float *axis_z;
+    float *cutoff;
+};
+
+// A camera brought into a mesh's local space
+struct MeshletCullView {
+    float planes[6][4]; // Normalized, inside is positive
+    DirectX::XMFLOAT3 camera_position;
+    // Only with a uniform, unmirrored scale, the cones don't survive anything else
+    bool cone_culling;
+};
+
+// Consecutive visible meshlets, in indices from the start of the mesh's indices
+struct MeshletDraw {
+    uint32_t index_offset;
+    uint32_t index_count;
+};
+
+namespace meshlet {
+
+// Both allocate, free with destroy. Fails (and leaves set empty) for a mesh
+// without triangles or when out of memory.
+bool build(const Vertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count, MeshletSet *out_set);
+void destroy(MeshletSet *set);
+
+MeshletCullView make_view(const DirectX::XMFLOAT4X4 *world, const DirectX::XMFLOAT4X4 *view_projection, DirectX::XMFLOAT3 camera_position);
+
+// One bit per meshlet in out_visible ((count + 31) / 32 words), returns how
+// many are visible. The reference does one meshlet at a time and is what the
+// SIMD version gets checked against, they set the same bits.
+uint32_t cull_reference(const MeshletSet *set, const MeshletCullView *view, uint32_t *out_visible);
+uint32_t cull_simd(const MeshletSet *set, const MeshletCullView *view, uint32_t *out_visible);
+
+// Merges the visible meshlets into draws, returns the draw count. out_draws
+// needs room for (count + 1) / 2, the most there can be.
+uint32_t build_draws(const MeshletSet *set, const uint32_t *visible, MeshletDraw *out_draws);
+
+} // namespace meshlet
@@ -0,0 +1,251 @@
+#include "mip_file.hpp"
+
+#include "logger.hpp"
+#include "shader_cache.hpp"
+#include "vfs.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// Bump when the layout or the filtering changes, old files are baked again
+#define MIP_FILE_VERSION 1
+#define MIP_FILE_MAGIC 0x5350494Du // "MIPS"
+
+struct SrgbTable {
+    float to_linear[256];
+};
+
+// Textures bake on several workers, two of them can write the same key at once
+static std::atomic<uint32_t> temp_counter{0};
+
+static SrgbTable make_srgb_table();
+static uint8_t linear_to_srgb(float linear);
+static void downsample(const uint8_t *src, uint32_t src_width, uint32_t src_height, uint8_t *dst, uint32_t dst_width, uint32_t dst_height, bool is_srgb);
+
+uint32_t mip_file::get_mip_count(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t count = 1;
+    while (size > 1 && count < MIP_FILE_MAX_MIPS) {
+        size >>= 1;
+        count++;
+    }
+    return count;
+}
+
+uint64_t mip_file::make_key(const char *source_path, bool is_srgb) {
+    // From the pack the content hash stands in for the time, it's just as new when the image changes
+    VfsStat stat = {};
+    if (!vfs::stat(source_path, &stat)) {
+        return 0;
+    }
+
+    uint32_t version = MIP_FILE_VERSION;
+    uint8_t srgb = is_srgb ? 1 : 0;
+    uint64_t h = shader_cache::hash(SHADER_HASH_SEED, &version, sizeof(version));
+    h = shader_cache::hash(h, source_path, strlen(source_path));
+    h = shader_cache::hash(h, &srgb, sizeof(srgb));
+    h = shader_cache::hash(h, &stat.size, sizeof(stat.size));
+    return shader_cache::hash(h, &stat.version, sizeof(stat.version));
+}
+
+void mip_file::get_path(const char *dir, uint64_t key, char *out_path, size_t out_size) {
+    snprintf(out_path, out_size, "%s/%016llx.mips", dir, (unsigned long long)key);
+}
+
+bool mip_file::build_mips(const uint8_t *pixels, uint32_t width, uint32_t height, bool is_srgb, Arena *arena, uint8_t **out_levels, uint32_t *out_mip_count) {
+    assert(pixels && out_levels && out_mip_count && "mip_file::build_mips: pixels and outputs cannot be NULL");
+
+    uint32_t mip_count = get_mip_count(width, height);
+    out_levels[0] = (uint8_t *)pixels;
+    for (uint32_t mip = 1; mip < mip_count; ++mip) {
+        uint32_t src_width = width >> (mip - 1) ? width >> (mip - 1) : 1;
+        uint32_t src_height = height >> (mip - 1) ? height >> (mip - 1) : 1;
+        uint32_t dst_width = width >> mip ? width >> mip : 1;
+        uint32_t dst_height = height >> mip ? height >> mip : 1;
+
+        out_levels[mip] = ARENA_PUSH_ARRAY(arena, uint8_t, (size_t)dst_width * dst_height * 4);
+        if (!out_levels[mip]) {
+            LOG("%s: No room for mip %u of a %ux%u image", __func__, mip, width, height);
+            return false;
+        }
+        downsample(out_levels[mip - 1], src_width, src_height, out_levels[mip], dst_width, dst_height, is_srgb);
+    }
+
+    *out_mip_count = mip_count;
+    return true;
+}
+
+bool mip_file::write(const char *path, uint64_t key, uint32_t width, uint32_t height, bool is_srgb, uint8_t *const *levels, uint32_t mip_count) {
+    assert(mip_count > 0 && mip_count <= MIP_FILE_MAX_MIPS && "mip_file::write: Mip count out of range");
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+        if (error) {
+            LOG("%s: Couldn't create the directory of %s", __func__, path);
+            return false;
+        }
+    }
+
+    // Smallest mip first, right after the header
+    MipFileHeader header = {};
+    header.magic = MIP_FILE_MAGIC;
+    header.version = MIP_FILE_VERSION;
+    header.key = key;
+    header.width = width;
+    header.height = height;
+    header.is_srgb = is_srgb ? 1 : 0;
+    header.mip_count = mip_count;
+    uint64_t offset = sizeof(MipFileHeader);
+    for (uint32_t i = mip_count; i-- > 0;) {
+        MipFileLevel *level = &header.levels[i];
+        level->offset = offset;
+        level->width = width >> i ? width >> i : 1;
+        level->height = height >> i ? height >> i : 1;
+        level->size = level->width * level->height * 4;
+        offset += level->size;
+    }
+
+    char temp_path[MIP_FILE_PATH_MAX + 16];
+    snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", path, temp_counter.fetch_add(1));
+
+    // Written next to it and renamed, same as the shader cache
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        LOG("%s: Couldn't open %s for writing", __func__, temp_path);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = mip_count; written && i-- > 0;) {
+        written = fwrite(levels[i], 1, header.levels[i].size, file) == header.levels[i].size;
+    }
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        LOG("%s: Couldn't write %s", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    // rename doesn't replace on Windows
+    remove(path);
+    if (rename(temp_path, path) != 0) {
+        LOG("%s: Couldn't move %s into place", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool mip_file::read_header(const char *path, uint64_t key, MipFileHeader *out_header) {
+    assert(out_header && "mip_file::read_header: out_header cannot be NULL");
+
+    // Not there is the usual miss, no need to log
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    bool is_read = fread(out_header, sizeof(MipFileHeader), 1, file) == 1;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fclose(file);
+
+    if (!is_read || out_header->magic != MIP_FILE_MAGIC || out_header->version != MIP_FILE_VERSION || out_header->key != key ||
+        out_header->mip_count == 0 || out_header->mip_count > MIP_FILE_MAX_MIPS) {
+        LOG("%s: %s is not a valid mip file", __func__, path);
+        return false;
+    }
+
+    // Mip 0 is the last one in the file, a shorter file was cut off while writing
+    const MipFileLevel *last = &out_header->levels[0];
+    if (length < 0 || (uint64_t)length != last->offset + last->size) {
+        LOG("%s: %s is truncated", __func__, path);
+        return false;
+    }
+
+    return true;
+}
+
+bool mip_file::read_mips(const char *path, const MipFileHeader *header, uint32_t first_mip, uint32_t end_mip, Arena *arena, uint8_t **out_levels) {
+    assert(first_mip < end_mip && end_mip <= header->mip_count && "mip_file::read_mips: Mip range out of range");
+
+    // end_mip - 1 is the first one in the file, first_mip the last
+    uint64_t start = header->levels[end_mip - 1].offset;
+    uint64_t size = header->levels[first_mip].offset + header->levels[first_mip].size - start;
+    uint8_t *data = ARENA_PUSH_ARRAY(arena, uint8_t, size);
+    if (!data) {
+        LOG("%s: No room for %llu bytes of %s", __func__, (unsigned long long)size, path);
+        return false;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        LOG("%s: Couldn't open %s", __func__, path);
+        return false;
+    }
+
+    bool is_read = fseek(file, (long)start, SEEK_SET) == 0 && fread(data, 1, size, file) == size;
+    fclose(file);
+    if (!is_read) {
+        LOG("%s: Couldn't read mips %u to %u of %s", __func__, first_mip, end_mip - 1, path);
+        return false;
+    }
+
+    for (uint32_t mip = first_mip; mip < end_mip; ++mip) {
+        out_levels[mip] = data + (header->levels[mip].offset - start);
+    }
+    return true;
+}
+
+static SrgbTable make_srgb_table() {
+    SrgbTable table;
+    for (uint32_t i = 0; i < 256; ++i) {
+        float c = i / 255.0f;
+        table.to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+}
+
+static uint8_t linear_to_srgb(float linear) {
+    float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+    c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+    return (uint8_t)(c * 255.0f + 0.5f);
+}
+
+static void downsample(const uint8_t *src, uint32_t src_width, uint32_t src_height, uint8_t *dst, uint32_t dst_width, uint32_t dst_height, bool is_srgb) {
+    static const SrgbTable srgb = make_srgb_table();
+
+    // 2x2 boxes, an odd last row or column is clamped into the box before it
+    for (uint32_t y = 0; y < dst_height; ++y) {
+        uint32_t y0 = y * 2 < src_height ? y * 2 : src_height - 1;
+        uint32_t y1 = y * 2 + 1 < src_height ? y * 2 + 1 : src_height - 1;
+        for (uint32_t x = 0; x < dst_width; ++x) {
+            uint32_t x0 = x * 2 < src_width ? x * 2 : src_width - 1;
+            uint32_t x1 = x * 2 + 1 < src_width ? x * 2 + 1 : src_width - 1;
+            const uint8_t *p[4] = {
+                src + ((size_t)y0 * src_width + x0) * 4,
+                src + ((size_t)y0 * src_width + x1) * 4,
+                src + ((size_t)y1 * src_width + x0) * 4,
+                src + ((size_t)y1 * src_width + x1) * 4,
+            };
+
+            uint8_t *out = dst + ((size_t)y * dst_width + x) * 4;
+            for (uint32_t c = 0; c < 4; ++c) {
+                // Alpha is linear either way
+                if (is_srgb && c < 3) {
+                    float sum = srgb.to_linear[p[0][c]] + srgb.to_linear[p[1][c]] + srgb.to_linear[p[2][c]] + srgb.to_linear[p[3][c]];
+                    out[c] = linear_to_srgb(sum * 0.25f);
+                } else {
+                    out[c] = (uint8_t)((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// A streamed texture on disk: every mip of an RGBA8 image, baked once from the
+// source image and kept in MIP_FILE_DIR keyed by the source's path, size and
+// modification time. The mips are stored smallest first, the tail is one
+// read at the front of the file and each more detailed mip comes right after
+// the ones already loaded.
+#define MIP_FILE_DIR "texture_cache"
+#define MIP_FILE_MAX_MIPS 16
+#define MIP_FILE_PATH_MAX 260
+
+struct MipFileLevel {
+    uint64_t offset; // From the start of the file
+    uint32_t width;
+    uint32_t height;
+    uint32_t size; // Tightly packed rows of width * 4 bytes
+    uint32_t padding;
+};
+
+struct MipFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t is_srgb;
+    uint32_t mip_count;
+    MipFileLevel levels[MIP_FILE_MAX_MIPS]; // By mip, 0 is the full size
+};
+
+namespace mip_file {
+
+uint32_t get_mip_count(uint32_t width, uint32_t height);
+// Of the baked file of a source image, 0 when the source isn't there (loose or in the pack)
+uint64_t make_key(const char *source_path, bool is_srgb);
+// <dir>/<16 hex digits>.mips
+void get_path(const char *dir, uint64_t key, char *out_path, size_t out_size);
+
+// Box filters each mip from the one above it, in linear space for sRGB.
+// out_levels[0] is pixels itself, the others are pushed on the arena.
+bool build_mips(const uint8_t *pixels, uint32_t width, uint32_t height, bool is_srgb, Arena *arena, uint8_t **out_levels, uint32_t *out_mip_count);
+bool write(const char *path, uint64_t key, uint32_t width, uint32_t height, bool is_srgb, uint8_t *const *levels, uint32_t mip_count);
+
+// False for a missing file or one baked from another version of the source
+bool read_header(const char *path, uint64_t key, MipFileHeader *out_header);
+// Reads mips first_mip up to (not including) end_mip with a single read,
+// out_levels is indexed by mip
+bool read_mips(const char *path, const MipFileHeader *header, uint32_t first_mip, uint32_t end_mip, Arena *arena, uint8_t **out_levels);
+
+} // namespace mip_file
@@ -0,0 +1,129 @@
+#include "occlusion.hpp"
+
+#include <cassert>
+#include <cstring>
+
+static void reduce_level(HiZPyramid *pyramid, uint32_t level);
+
+void occlusion::build(HiZPyramid *pyramid, const float *depth, uint32_t row_pitch, const DirectX::XMFLOAT4X4 *view_projection) {
+    assert(pyramid && depth && view_projection && "occlusion::build: Pointers cannot be NULL");
+
+    pyramid->level_offset[0] = 0;
+    pyramid->level_width[0] = HIZ_WIDTH;
+    pyramid->level_height[0] = HIZ_HEIGHT;
+    for (uint32_t y = 0; y < HIZ_HEIGHT; ++y) {
+        memcpy(&pyramid->depth[y * HIZ_WIDTH], (const uint8_t *)depth + (size_t)y * row_pitch, HIZ_WIDTH * sizeof(float));
+    }
+
+    // Halving rounds up, a texel past an odd edge just covers less
+    uint32_t level = 1;
+    while (level < HIZ_MAX_LEVELS && (pyramid->level_width[level - 1] > 1 || pyramid->level_height[level - 1] > 1)) {
+        pyramid->level_offset[level] = pyramid->level_offset[level - 1] + pyramid->level_width[level - 1] * pyramid->level_height[level - 1];
+        pyramid->level_width[level] = (pyramid->level_width[level - 1] + 1) / 2;
+        pyramid->level_height[level] = (pyramid->level_height[level - 1] + 1) / 2;
+        assert(pyramid->level_offset[level] + pyramid->level_width[level] * pyramid->level_height[level] <= HIZ_TEXEL_COUNT &&
+               "occlusion::build: HIZ_TEXEL_COUNT is too small for the pyramid");
+
+        reduce_level(pyramid, level);
+        level++;
+    }
+
+    pyramid->level_count = level;
+    pyramid->view_projection = *view_projection;
+    pyramid->is_valid = true;
+}
+
+bool occlusion::is_occluded(const HiZPyramid *pyramid, DirectX::XMFLOAT3 center, float radius) {
+    if (!pyramid->is_valid) {
+        return false;
+    }
+
+    // Screen rect and nearest depth of the sphere's box, it holds the sphere
+    // so both are on the safe side
+    const float(*m)[4] = pyramid->view_projection.m;
+    float min_u = 1.0f, max_u = 0.0f;
+    float min_v = 1.0f, max_v = 0.0f;
+    float nearest = 1.0f;
+    for (uint32_t corner = 0; corner < 8; ++corner) {
+        float x = center.x + ((corner & 1) ? radius : -radius);
+        float y = center.y + ((corner & 2) ? radius : -radius);
+        float z = center.z + ((corner & 4) ? radius : -radius);
+
+        float clip_x = x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0];
+        float clip_y = x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1];
+        float clip_z = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+        float clip_w = x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3];
+
+        // Reaches behind the camera, the rect would be meaningless
+        if (clip_w <= 1e-5f) {
+            return false;
+        }
+
+        float inv_w = 1.0f / clip_w;
+        float u = clip_x * inv_w * 0.5f + 0.5f;
+        float v = 0.5f - clip_y * inv_w * 0.5f;
+        float depth = clip_z * inv_w;
+        min_u = u < min_u ? u : min_u;
+        max_u = u > max_u ? u : max_u;
+        min_v = v < min_v ? v : min_v;
+        max_v = v > max_v ? v : max_v;
+        nearest = depth < nearest ? depth : nearest;
+    }
+
+    // Crossing the near plane, or all of it off screen where there's no depth to test against
+    if (nearest <= 0.0f || max_u < 0.0f || min_u > 1.0f || max_v < 0.0f || min_v > 1.0f) {
+        return false;
+    }
+
+    // Base level texels the rect touches
+    uint32_t x0 = min_u <= 0.0f ? 0 : (uint32_t)(min_u * HIZ_WIDTH);
+    uint32_t x1 = max_u >= 1.0f ? HIZ_WIDTH - 1 : (uint32_t)(max_u * HIZ_WIDTH);
+    uint32_t y0 = min_v <= 0.0f ? 0 : (uint32_t)(min_v * HIZ_HEIGHT);
+    uint32_t y1 = max_v >= 1.0f ? HIZ_HEIGHT - 1 : (uint32_t)(max_v * HIZ_HEIGHT);
+    x0 = x0 < HIZ_WIDTH ? x0 : HIZ_WIDTH - 1;
+    y0 = y0 < HIZ_HEIGHT ? y0 : HIZ_HEIGHT - 1;
+
+    // Coarsest level where the rect is at most 2x2 texels
+    uint32_t level = 0;
+    while (level + 1 < pyramid->level_count && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+
+    const float *texels = &pyramid->depth[pyramid->level_offset[level]];
+    uint32_t width = pyramid->level_width[level];
+    float farthest = 0.0f;
+    for (uint32_t y = y0 >> level; y <= y1 >> level; ++y) {
+        for (uint32_t x = x0 >> level; x <= x1 >> level; ++x) {
+            float d = texels[y * width + x];
+            farthest = d > farthest ? d : farthest;
+        }
+    }
+
+    return nearest > farthest;
+}
+
+static void reduce_level(HiZPyramid *pyramid, uint32_t level) {
+    const float *src = &pyramid->depth[pyramid->level_offset[level - 1]];
+    float *dst = &pyramid->depth[pyramid->level_offset[level]];
+    uint32_t src_width = pyramid->level_width[level - 1];
+    uint32_t src_height = pyramid->level_height[level - 1];
+    uint32_t width = pyramid->level_width[level];
+    uint32_t height = pyramid->level_height[level];
+
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t sy0 = y * 2;
+        uint32_t sy1 = sy0 + 1 < src_height ? sy0 + 1 : sy0;
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t sx0 = x * 2;
+            uint32_t sx1 = sx0 + 1 < src_width ? sx0 + 1 : sx0;
+
+            float a = src[sy0 * src_width + sx0];
+            float b = src[sy0 * src_width + sx1];
+            float c = src[sy1 * src_width + sx0];
+            float d = src[sy1 * src_width + sx1];
+            float ab = a > b ? a : b;
+            float cd = c > d ? c : d;
+            dst[y * width + x] = ab > cd ? ab : cd;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+// Hi-Z pyramid of a past frame's depth. The GPU reduces the depth buffer to
+// the base level (the farthest depth under each texel), it's read back a few
+// frames later and the rest of the levels are built here. Instances get
+// tested against it with the view projection of the frame the depth is from,
+// so an instance that was hidden then is skipped now. Only the camera passes
+// use it, what the camera can't see can still cast a shadow into view.
+#define HIZ_WIDTH 256
+#define HIZ_HEIGHT 128
+#define HIZ_MAX_LEVELS 9 // 256x128 down to 1x1
+#define HIZ_TEXEL_COUNT (HIZ_WIDTH * HIZ_HEIGHT * 4 / 3 + HIZ_MAX_LEVELS)
+
+struct HiZPyramid {
+    float depth[HIZ_TEXEL_COUNT]; // Every level after each other, row major
+    uint32_t level_offset[HIZ_MAX_LEVELS];
+    uint32_t level_width[HIZ_MAX_LEVELS];
+    uint32_t level_height[HIZ_MAX_LEVELS];
+    uint32_t level_count;
+
+    DirectX::XMFLOAT4X4 view_projection; // Of the frame the depth is from
+    bool is_valid;
+};
+
+namespace occlusion {
+
+// depth is the HIZ_WIDTH x HIZ_HEIGHT base level, row_pitch is in bytes (a
+// mapped staging texture's pitch works as is). Depth is 0 at the near plane.
+void build(HiZPyramid *pyramid, const float *depth, uint32_t row_pitch, const DirectX::XMFLOAT4X4 *view_projection);
+
+// True only when the whole sphere is behind the depth. What the pyramid can't
+// say anything about (off screen, through the near plane, no pyramid yet) is visible.
+bool is_occluded(const HiZPyramid *pyramid, DirectX::XMFLOAT3 center, float radius);
+
+} // namespace occlusion
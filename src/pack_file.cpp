@@ -0,0 +1,316 @@
+#include "pack_file.hpp"
+
+#include "asset_registry.hpp"
+#include "logger.hpp"
+#include "lz4.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Bump when the layout changes, older packs don't open
+#define PACK_FILE_VERSION 1
+#define PACK_FILE_MAGIC 0x4B434150u // "PACK"
+// Compressed files don't get mapped, they only need what a copy out likes
+#define PACK_FILE_COMPRESSED_ALIGNMENT 16
+
+struct PackBuildEntry {
+    PackEntry entry;
+    uint32_t source;
+    char name[ASSET_PATH_MAX];
+};
+
+// Two packers writing the same pack at once don't share a temp file
+static std::atomic<uint32_t> temp_counter{0};
+
+static int build_entry_compare(const void *a, const void *b);
+static bool read_source(const char *path, Arena *arena, uint8_t **out_data, size_t *out_size);
+static bool write_zeros(FILE *file, uint64_t *offset, uint64_t end);
+static uint64_t align_up(uint64_t offset, uint64_t alignment);
+
+bool pack_file::open(PackFile *pack, const uint8_t *data, size_t size) {
+    assert(pack && data && "pack_file::open: pack and data cannot be NULL");
+
+    *pack = {};
+    if (size < sizeof(PackHeader)) {
+        return false;
+    }
+    const PackHeader *header = (const PackHeader *)data;
+    uint64_t names_end = sizeof(PackHeader) + (uint64_t)header->entry_count * sizeof(PackEntry) + header->names_size;
+    if (header->magic != PACK_FILE_MAGIC || header->version != PACK_FILE_VERSION || header->file_size != size ||
+        names_end > header->data_offset || header->data_offset > size) {
+        return false;
+    }
+
+    const PackEntry *entries = (const PackEntry *)(data + sizeof(PackHeader));
+    const char *names = (const char *)(entries + header->entry_count);
+    if (header->names_size > 0 && names[header->names_size - 1] != '\0') {
+        return false;
+    }
+
+    // Out of order would break the binary search, out of bounds anything reading it
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const PackEntry *entry = &entries[i];
+        if (entry->name_offset >= header->names_size || entry->offset < header->data_offset || entry->offset > size ||
+            entry->stored_size > size - entry->offset || entry->compression > PACK_COMPRESSION_LZ4 ||
+            (entry->compression == PACK_COMPRESSION_NONE && entry->stored_size != entry->size) ||
+            (i > 0 && entries[i - 1].path_hash > entry->path_hash)) {
+            return false;
+        }
+    }
+
+    pack->data = data;
+    pack->size = size;
+    pack->header = header;
+    pack->entries = entries;
+    pack->names = names;
+    return true;
+}
+
+const PackEntry *pack_file::find(const PackFile *pack, const char *path) {
+    if (!pack->header) {
+        return nullptr;
+    }
+
+    char normalized[ASSET_PATH_MAX];
+    if (!asset_registry::normalize_path(path, normalized, sizeof(normalized))) {
+        return nullptr;
+    }
+    uint64_t hash = asset_registry::hash_bytes(0, normalized, strlen(normalized));
+
+    // First entry with the hash, then past any others with the same one
+    uint32_t low = 0;
+    uint32_t high = pack->header->entry_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (pack->entries[mid].path_hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (uint32_t i = low; i < pack->header->entry_count && pack->entries[i].path_hash == hash; ++i) {
+        if (strcmp(get_name(pack, &pack->entries[i]), normalized) == 0) {
+            return &pack->entries[i];
+        }
+    }
+    return nullptr;
+}
+
+const char *pack_file::get_name(const PackFile *pack, const PackEntry *entry) {
+    return pack->names + entry->name_offset;
+}
+
+bool pack_file::read(const PackFile *pack, const PackEntry *entry, Arena *arena, const uint8_t **out_data) {
+    assert(pack && entry && out_data && "pack_file::read: pack, entry and out_data cannot be NULL");
+
+    const uint8_t *stored = pack->data + entry->offset;
+    if (entry->compression == PACK_COMPRESSION_NONE) {
+        *out_data = stored;
+        return true;
+    }
+
+    uint8_t *data = (uint8_t *)arena::push(arena, (size_t)entry->size, ARENA_DEFAULT_ALIGN);
+    if (!data) {
+        LOG("%s: No room for the %llu bytes of %s", __func__, (unsigned long long)entry->size, get_name(pack, entry));
+        return false;
+    }
+    if (!lz4::decompress(stored, entry->stored_size, data, entry->size)) {
+        LOG("%s: %s is corrupt", __func__, get_name(pack, entry));
+        return false;
+    }
+    *out_data = data;
+    return true;
+}
+
+bool pack_file::write(const char *out_path, const PackSource *sources, uint32_t count, PackWriteStats *out_stats) {
+    assert(out_path && (sources || count == 0) && "pack_file::write: out_path and sources cannot be NULL");
+
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    PackBuildEntry *builds = ARENA_PUSH_ARRAY(scratch, PackBuildEntry, count);
+    if (!builds) {
+        arena::rewind(scratch, marker);
+        return false;
+    }
+
+    uint64_t names_size = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        PackBuildEntry *build = &builds[i];
+        *build = {};
+        build->source = i;
+        if (!asset_registry::normalize_path(sources[i].name, build->name, sizeof(build->name))) {
+            LOG("%s: %s is too long to be packed", __func__, sources[i].name);
+            arena::rewind(scratch, marker);
+            return false;
+        }
+        size_t length = strlen(build->name);
+        build->entry.path_hash = asset_registry::hash_bytes(0, build->name, length);
+        names_size += length + 1;
+    }
+
+    qsort(builds, count, sizeof(PackBuildEntry), build_entry_compare);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i > 0 && build_entry_compare(&builds[i - 1], &builds[i]) == 0) {
+            LOG("%s: %s is in there twice", __func__, builds[i].name);
+            arena::rewind(scratch, marker);
+            return false;
+        }
+    }
+
+    uint32_t name_offset = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        builds[i].entry.name_offset = name_offset;
+        name_offset += (uint32_t)strlen(builds[i].name) + 1;
+    }
+
+    char temp_path[ASSET_PATH_MAX + 16];
+    snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", out_path, temp_counter.fetch_add(1));
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        LOG("%s: Couldn't open %s for writing", __func__, temp_path);
+        arena::rewind(scratch, marker);
+        return false;
+    }
+
+    // The front is written last, once the offsets are known
+    PackHeader header = {};
+    header.magic = PACK_FILE_MAGIC;
+    header.version = PACK_FILE_VERSION;
+    header.entry_count = count;
+    header.names_size = (uint32_t)names_size;
+    uint64_t offset = 0;
+    header.data_offset = sizeof(PackHeader) + (uint64_t)count * sizeof(PackEntry) + names_size;
+    bool is_written = write_zeros(file, &offset, header.data_offset);
+
+    PackWriteStats stats = {};
+    for (uint32_t i = 0; i < count && is_written; ++i) {
+        PackEntry *entry = &builds[i].entry;
+        const char *path = sources[builds[i].source].path;
+        ArenaMarker file_marker = arena::get_marker(scratch);
+
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        if (!read_source(path, scratch, &data, &size)) {
+            is_written = false;
+            break;
+        }
+        entry->size = size;
+        entry->content_hash = asset_registry::hash_bytes(0, data, size);
+        stats.files++;
+        stats.bytes_in += size;
+
+        const PackEntry *same = nullptr;
+        for (uint32_t j = 0; j < i && !same; ++j) {
+            const PackEntry *other = &builds[j].entry;
+            same = other->content_hash == entry->content_hash && other->size == entry->size ? other : nullptr;
+        }
+        if (same) {
+            entry->offset = same->offset;
+            entry->stored_size = same->stored_size;
+            entry->compression = same->compression;
+            stats.shared++;
+            arena::rewind(scratch, file_marker);
+            continue;
+        }
+
+        // Worth it when it saves an eighth, images mostly come compressed already
+        size_t bound = lz4::get_bound(size);
+        uint8_t *compressed = ARENA_PUSH_ARRAY(scratch, uint8_t, bound);
+        size_t compressed_size = compressed ? lz4::compress(data, size, compressed, bound) : 0;
+        bool is_compressed = compressed_size > 0 && compressed_size <= size - size / 8;
+
+        const uint8_t *stored = is_compressed ? compressed : data;
+        entry->compression = is_compressed ? PACK_COMPRESSION_LZ4 : PACK_COMPRESSION_NONE;
+        entry->stored_size = is_compressed ? compressed_size : size;
+        is_written = write_zeros(file, &offset, align_up(offset, is_compressed ? PACK_FILE_COMPRESSED_ALIGNMENT : PACK_FILE_ALIGNMENT));
+        entry->offset = offset;
+        is_written = is_written && fwrite(stored, 1, entry->stored_size, file) == entry->stored_size;
+        offset += entry->stored_size;
+        stats.compressed += is_compressed ? 1 : 0;
+
+        arena::rewind(scratch, file_marker);
+    }
+
+    header.file_size = offset;
+    is_written = is_written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = 0; i < count && is_written; ++i) {
+        is_written = fwrite(&builds[i].entry, sizeof(PackEntry), 1, file) == 1;
+    }
+    for (uint32_t i = 0; i < count && is_written; ++i) {
+        size_t length = strlen(builds[i].name) + 1;
+        is_written = fwrite(builds[i].name, 1, length, file) == length;
+    }
+    is_written = fclose(file) == 0 && is_written;
+    arena::rewind(scratch, marker);
+
+    if (!is_written) {
+        LOG("%s: Couldn't write %s", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    // rename doesn't replace on Windows
+    remove(out_path);
+    if (rename(temp_path, out_path) != 0) {
+        LOG("%s: Couldn't move %s into place", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    stats.bytes_out = offset;
+    if (out_stats) {
+        *out_stats = stats;
+    }
+    return true;
+}
+
+static int build_entry_compare(const void *a, const void *b) {
+    const PackBuildEntry *x = (const PackBuildEntry *)a;
+    const PackBuildEntry *y = (const PackBuildEntry *)b;
+    if (x->entry.path_hash != y->entry.path_hash) {
+        return x->entry.path_hash < y->entry.path_hash ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+static bool read_source(const char *path, Arena *arena, uint8_t **out_data, size_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        LOG("pack_file::write: Couldn't open %s", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length >= 0 ? ARENA_PUSH_ARRAY(arena, uint8_t, length) : nullptr;
+    bool is_read = data && fread(data, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    if (!is_read) {
+        LOG("pack_file::write: Couldn't read %s", path);
+        return false;
+    }
+
+    *out_data = data;
+    *out_size = (size_t)length;
+    return true;
+}
+
+static bool write_zeros(FILE *file, uint64_t *offset, uint64_t end) {
+    static const uint8_t zeros[PACK_FILE_ALIGNMENT] = {};
+    while (*offset < end) {
+        size_t chunk = end - *offset < sizeof(zeros) ? (size_t)(end - *offset) : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, file) != chunk) {
+            return false;
+        }
+        *offset += chunk;
+    }
+    return true;
+}
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
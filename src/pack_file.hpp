@@ -0,0 +1,80 @@
+#pragma once
+
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Many asset files in one: a header, the table of contents sorted by the hash
+// of each file's normalized path (see asset_registry::normalize_path), the
+// names, then the data. The front of the file is everything a lookup needs,
+// one read or one mapping and no seeks. Files LZ4 shrinks by an eighth or
+// more are stored compressed, the rest as they are and PACK_FILE_ALIGNMENT
+// aligned, so a mapped pack hands them out without a copy. Files with the
+// same bytes are stored once.
+#define PACK_FILE_ALIGNMENT 4096
+#define PACK_FILE_EXTENSION ".pack"
+
+enum PackCompression : uint32_t {
+    PACK_COMPRESSION_NONE,
+    PACK_COMPRESSION_LZ4,
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count; // The entries right after the header
+    uint32_t names_size;  // The names right after the entries, each 0 terminated
+    uint64_t data_offset;
+    uint64_t file_size;
+};
+
+struct PackEntry {
+    uint64_t path_hash;
+    uint64_t content_hash; // Of the uncompressed bytes
+    uint64_t offset;       // From the start of the pack
+    uint64_t stored_size;
+    uint64_t size; // Uncompressed
+    uint32_t name_offset;
+    uint32_t compression;
+};
+
+// A pack in memory (read whole or mapped), open only points into it
+struct PackFile {
+    const uint8_t *data;
+    size_t size;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const char *names;
+};
+
+struct PackSource {
+    const char *name; // What it's looked up by, normalized when it's packed
+    const char *path; // Where to read it from now
+};
+
+struct PackWriteStats {
+    uint32_t files;
+    uint32_t compressed;
+    uint32_t shared; // Same bytes as a file before it
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+namespace pack_file {
+
+// Checks the header and every entry against the size, false for anything
+// that isn't a whole pack of this version
+bool open(PackFile *pack, const uint8_t *data, size_t size);
+// Binary search on the path's hash, NULL when it isn't in the pack
+const PackEntry *find(const PackFile *pack, const char *path);
+const char *get_name(const PackFile *pack, const PackEntry *entry);
+// Stored files point into the pack, compressed ones are decompressed onto the
+// arena (ARENA_DEFAULT_ALIGN aligned)
+bool read(const PackFile *pack, const PackEntry *entry, Arena *arena, const uint8_t **out_data);
+
+// Reads every source and writes the pack next to out_path, then moves it
+// into place. out_stats can be NULL.
+bool write(const char *out_path, const PackSource *sources, uint32_t count, PackWriteStats *out_stats);
+
+} // namespace pack_file
@@ -4,6 +4,14 @@
 #include "math.hpp"
 #include "shader_system.hpp"
 
+#include <cstring>
+
+// Keys are compared and hashed as bytes, these copy a desc into a zeroed one
+// field by field so the padding is always the same
+static D3D11_RASTERIZER_DESC make_key(const D3D11_RASTERIZER_DESC *desc);
+static D3D11_DEPTH_STENCIL_DESC make_key(const D3D11_DEPTH_STENCIL_DESC *desc);
+static D3D11_BLEND_DESC make_key(const D3D11_BLEND_DESC *desc);
+
 // bool shader::system_initialize(ShaderSystemState *state) {
 //     // Invalidate all modules
 //     for (int i = 0; i < MAX_SHADER_MODULES; ++i) {
@@ -25,128 +33,112 @@
 //     return true;
 // }
 
+bool pipeline::system_initialize(PipelineSystemState *state) {
+    state_cache::initialize(&state->rasterizer_states);
+    state_cache::initialize(&state->depth_stencil_states);
+    state_cache::initialize(&state->blend_states);
+
+    for (int i = 0; i < MAX_PIPELINES; ++i) {
+        state->pipelines[i].id = id::invalid();
+    }
+
+    return true;
+}
+
 RasterizerStateId pipeline::create_rasterizer_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_RASTERIZER_DESC *desc) {
-    uint64_t desc_hash = hash_fnv1a_64(desc, sizeof(D3D11_RASTERIZER_DESC));
-
-    // TODO: Potentially I could deduplicate this search part with
-    // a common base that contains id and hash and that way I don't
-    // have to write this ~200,000,000 times.
-
-    // Linear search compare if we find the same hash in the state
-    // in which case we don't recreate it.
-    // At the same time we keep track of the first free slot in case
-    // it is needed.
-    uint16_t free_index = MAX_RASTER_STATES;
-    for (uint16_t i = 0; i < MAX_RASTER_STATES; ++i) {
-        RasterizerState *rstate = &state->rasterizer_states[i];
-        if (id::is_valid(rstate->id) && rstate->hash == desc_hash) {
-            // We found an already existing rasterizer state with the same description
-            return rstate->id;
-        }
+    D3D11_RASTERIZER_DESC key = make_key(desc);
+    uint64_t key_hash = hash_words_64(&key, sizeof(key));
 
-        // If this is not found, we keep track of the first slot
-        if (free_index == MAX_RASTER_STATES && id::is_invalid(rstate->id)) {
-            free_index = i;
-        }
+    RasterizerStateId found = state_cache::acquire(&state->rasterizer_states, &key, key_hash);
+    if (id::is_valid(found)) {
+        return found;
     }
 
-    // If we get here, we couldn't find a matching description
-    // So we check if we found an empty slot
-    if (free_index == MAX_RASTER_STATES) {
+    if (state->rasterizer_states.count >= MAX_RASTER_STATES) {
         LOG("%s: No more free slots for Rasterizer States", __func__);
         return id::invalid();
     }
 
-    RasterizerState *rstate = &state->rasterizer_states[free_index];
-    HRESULT hr = device->CreateRasterizerState(desc, rstate->state_ptr.GetAddressOf());
+    Microsoft::WRL::ComPtr<ID3D11RasterizerState> rstate;
+    HRESULT hr = device->CreateRasterizerState(&key, rstate.GetAddressOf());
     if (FAILED(hr)) {
         LOG("%s: Failed to create Rasterizer State", __func__);
         return id::invalid();
     }
 
-    rstate->id.id = free_index;
-    rstate->hash = desc_hash;
-    return rstate->id;
+    return state_cache::add(&state->rasterizer_states, &key, key_hash, rstate.Get());
 }
 
 DepthStencilStateId pipeline::create_depth_stencil_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_DEPTH_STENCIL_DESC *desc) {
-    uint64_t desc_hash = hash_fnv1a_64(desc, sizeof(D3D11_DEPTH_STENCIL_DESC));
-
-    // TODO: Potentially I could deduplicate this search part with
-    // a common base that contains id and hash and that way I don't
-    // have to write this ~200,000,000 times.
-
-    uint16_t free_index = MAX_DEPTH_STENCIL_STATES;
-    for (uint16_t i = 0; i < MAX_DEPTH_STENCIL_STATES; ++i) {
-        DepthStencilState *dsstate = &state->depth_stencil_states[i];
-        if (id::is_valid(dsstate->id) && dsstate->hash == desc_hash) {
-            // We found an already existing rasterizer state with the same description
-            return dsstate->id;
-        }
+    D3D11_DEPTH_STENCIL_DESC key = make_key(desc);
+    uint64_t key_hash = hash_words_64(&key, sizeof(key));
 
-        // If this is not found, we keep track of the first slot
-        if (free_index == MAX_DEPTH_STENCIL_STATES && id::is_invalid(dsstate->id)) {
-            free_index = i;
-        }
+    DepthStencilStateId found = state_cache::acquire(&state->depth_stencil_states, &key, key_hash);
+    if (id::is_valid(found)) {
+        return found;
     }
 
-    // If we get here, we couldn't find a matching description
-    // So we check if we found an empty slot
-    if (free_index == MAX_DEPTH_STENCIL_STATES) {
+    if (state->depth_stencil_states.count >= MAX_DEPTH_STENCIL_STATES) {
         LOG("%s: No more free slots for Depth Stencil States", __func__);
         return id::invalid();
     }
 
-    DepthStencilState *dsstate = &state->depth_stencil_states[free_index];
-    HRESULT hr = device->CreateDepthStencilState(desc, dsstate->state_ptr.GetAddressOf());
+    Microsoft::WRL::ComPtr<ID3D11DepthStencilState> dsstate;
+    HRESULT hr = device->CreateDepthStencilState(&key, dsstate.GetAddressOf());
     if (FAILED(hr)) {
         LOG("%s: Failed to create Depth Stencil State", __func__);
         return id::invalid();
     }
 
-    dsstate->id.id = free_index;
-    dsstate->hash = desc_hash;
-    return dsstate->id;
+    return state_cache::add(&state->depth_stencil_states, &key, key_hash, dsstate.Get());
 }
 
 BlendStateId pipeline::create_blend_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_BLEND_DESC *desc) {
-    uint64_t desc_hash = hash_fnv1a_64(desc, sizeof(D3D11_BLEND_DESC));
-
-    // TODO: Potentially I could deduplicate this search part with
-    // a common base that contains id and hash and that way I don't
-    // have to write this ~200,000,000 times.
-
-    uint16_t free_index = MAX_BLEND_STATES;
-    for (uint16_t i = 0; i < MAX_BLEND_STATES; ++i) {
-        BlendState *bstate = &state->blend_states[i];
-        if (id::is_valid(bstate->id) && bstate->hash == desc_hash) {
-            // We found an already existing rasterizer state with the same description
-            return bstate->id;
-        }
+    D3D11_BLEND_DESC key = make_key(desc);
+    uint64_t key_hash = hash_words_64(&key, sizeof(key));
 
-        // If this is not found, we keep track of the first slot
-        if (free_index == MAX_BLEND_STATES && id::is_invalid(bstate->id)) {
-            free_index = i;
-        }
+    BlendStateId found = state_cache::acquire(&state->blend_states, &key, key_hash);
+    if (id::is_valid(found)) {
+        return found;
     }
 
-    // If we get here, we couldn't find a matching description
-    // So we check if we found an empty slot
-    if (free_index == MAX_BLEND_STATES) {
+    if (state->blend_states.count >= MAX_BLEND_STATES) {
         LOG("%s: No more free slots for Blend States", __func__);
         return id::invalid();
     }
 
-    BlendState *bstate = &state->blend_states[free_index];
-    HRESULT hr = device->CreateBlendState(desc, bstate->state_ptr.GetAddressOf());
+    Microsoft::WRL::ComPtr<ID3D11BlendState> bstate;
+    HRESULT hr = device->CreateBlendState(&key, bstate.GetAddressOf());
     if (FAILED(hr)) {
         LOG("%s: Failed to create Blend State", __func__);
         return id::invalid();
     }
 
-    bstate->id.id = free_index;
-    bstate->hash = desc_hash;
-    return bstate->id;
+    return state_cache::add(&state->blend_states, &key, key_hash, bstate.Get());
+}
+
+void pipeline::release_rasterizer_state(PipelineSystemState *state, RasterizerStateId state_id) {
+    state_cache::release(&state->rasterizer_states, state_id);
+}
+
+void pipeline::release_depth_stencil_state(PipelineSystemState *state, DepthStencilStateId state_id) {
+    state_cache::release(&state->depth_stencil_states, state_id);
+}
+
+void pipeline::release_blend_state(PipelineSystemState *state, BlendStateId state_id) {
+    state_cache::release(&state->blend_states, state_id);
+}
+
+ID3D11RasterizerState *pipeline::get_rasterizer_state(PipelineSystemState *state, RasterizerStateId state_id) {
+    return state_cache::get(&state->rasterizer_states, state_id);
+}
+
+ID3D11DepthStencilState *pipeline::get_depth_stencil_state(PipelineSystemState *state, DepthStencilStateId state_id) {
+    return state_cache::get(&state->depth_stencil_states, state_id);
+}
+
+ID3D11BlendState *pipeline::get_blend_state(PipelineSystemState *state, BlendStateId state_id) {
+    return state_cache::get(&state->blend_states, state_id);
 }
 
 bool pipeline::create_pipeline(PipelineSystemState *state, ID3D11Device *device, const PipelineDesc *desc, PipelineId *out_pipeline) {
@@ -250,3 +242,45 @@ void pipeline::bind_pipeline(PipelineSystemState *state, ID3D11DeviceContext *co
     }
 
 }
+
+static D3D11_RASTERIZER_DESC make_key(const D3D11_RASTERIZER_DESC *desc) {
+    // No padding in this one, all 4 byte members
+    static_assert(sizeof(D3D11_RASTERIZER_DESC) == 10 * sizeof(UINT), "make_key: D3D11_RASTERIZER_DESC has padding");
+    D3D11_RASTERIZER_DESC key;
+    memcpy(&key, desc, sizeof(key));
+    return key;
+}
+
+static D3D11_DEPTH_STENCIL_DESC make_key(const D3D11_DEPTH_STENCIL_DESC *desc) {
+    D3D11_DEPTH_STENCIL_DESC key;
+    memset(&key, 0, sizeof(key));
+    key.DepthEnable = desc->DepthEnable;
+    key.DepthWriteMask = desc->DepthWriteMask;
+    key.DepthFunc = desc->DepthFunc;
+    key.StencilEnable = desc->StencilEnable;
+    key.StencilReadMask = desc->StencilReadMask;
+    key.StencilWriteMask = desc->StencilWriteMask;
+    key.FrontFace = desc->FrontFace;
+    key.BackFace = desc->BackFace;
+    return key;
+}
+
+static D3D11_BLEND_DESC make_key(const D3D11_BLEND_DESC *desc) {
+    D3D11_BLEND_DESC key;
+    memset(&key, 0, sizeof(key));
+    key.AlphaToCoverageEnable = desc->AlphaToCoverageEnable;
+    key.IndependentBlendEnable = desc->IndependentBlendEnable;
+    for (int i = 0; i < 8; ++i) {
+        D3D11_RENDER_TARGET_BLEND_DESC *target = &key.RenderTarget[i];
+        const D3D11_RENDER_TARGET_BLEND_DESC *source = &desc->RenderTarget[i];
+        target->BlendEnable = source->BlendEnable;
+        target->SrcBlend = source->SrcBlend;
+        target->DestBlend = source->DestBlend;
+        target->BlendOp = source->BlendOp;
+        target->SrcBlendAlpha = source->SrcBlendAlpha;
+        target->DestBlendAlpha = source->DestBlendAlpha;
+        target->BlendOpAlpha = source->BlendOpAlpha;
+        target->RenderTargetWriteMask = source->RenderTargetWriteMask;
+    }
+    return key;
+}
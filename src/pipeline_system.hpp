@@ -2,6 +2,7 @@
 
 #include "id.hpp"
 #include "shader_system.hpp"
+#include "state_cache.hpp"
 
 using PipelineId = Id;
 using RasterizerStateId = Id;
@@ -13,23 +14,9 @@ using BlendStateId = Id;
 #define MAX_DEPTH_STENCIL_STATES 32
 #define MAX_BLEND_STATES 32
 
-struct RasterizerState {
-    RasterizerStateId id;
-    uint64_t hash;
-    Microsoft::WRL::ComPtr<ID3D11RasterizerState> state_ptr;
-};
-
-struct DepthStencilState {
-    DepthStencilStateId id;
-    uint64_t hash;
-    Microsoft::WRL::ComPtr<ID3D11DepthStencilState> state_ptr;
-};
-
-struct BlendState {
-    BlendStateId id;
-    uint64_t hash;
-    Microsoft::WRL::ComPtr<ID3D11BlendState> state_ptr;
-};
+using RasterizerStateCache = StateCache<D3D11_RASTERIZER_DESC, ID3D11RasterizerState, MAX_RASTER_STATES>;
+using DepthStencilStateCache = StateCache<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState, MAX_DEPTH_STENCIL_STATES>;
+using BlendStateCache = StateCache<D3D11_BLEND_DESC, ID3D11BlendState, MAX_BLEND_STATES>;
 
 enum PipelineType {
     PIPELINE_TYPE_GRAPHICS,
@@ -75,18 +62,29 @@ struct PipelineDesc {
 struct PipelineSystemState {
     ShaderSystemState *shader_system;
 
-    RasterizerState rasterizer_states[MAX_RASTER_STATES];
-    DepthStencilState depth_stencil_states[MAX_DEPTH_STENCIL_STATES];
-    BlendState blend_states[MAX_BLEND_STATES];
+    RasterizerStateCache rasterizer_states;
+    DepthStencilStateCache depth_stencil_states;
+    BlendStateCache blend_states;
 
     Pipeline pipelines[MAX_PIPELINES];
 };
 
 namespace pipeline {
 
+bool system_initialize(PipelineSystemState *state);
+
+// Same desc gives the same state. Every create takes a reference and every
+// release gives one back, the state is destroyed with the last reference.
 RasterizerStateId create_rasterizer_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_RASTERIZER_DESC *desc);
 DepthStencilStateId create_depth_stencil_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_DEPTH_STENCIL_DESC *desc);
 BlendStateId create_blend_state(PipelineSystemState *state, ID3D11Device *device, const D3D11_BLEND_DESC *desc);
+void release_rasterizer_state(PipelineSystemState *state, RasterizerStateId state_id);
+void release_depth_stencil_state(PipelineSystemState *state, DepthStencilStateId state_id);
+void release_blend_state(PipelineSystemState *state, BlendStateId state_id);
+
+ID3D11RasterizerState *get_rasterizer_state(PipelineSystemState *state, RasterizerStateId state_id);
+ID3D11DepthStencilState *get_depth_stencil_state(PipelineSystemState *state, DepthStencilStateId state_id);
+ID3D11BlendState *get_blend_state(PipelineSystemState *state, BlendStateId state_id);
 
 bool create_pipeline(PipelineSystemState *state, ID3D11Device *device, const PipelineDesc *desc, PipelineId *out_pipeline);
 Pipeline *get_pipeline(PipelineSystemState *state, PipelineId pipeline_id);
@@ -0,0 +1,205 @@
+#include "profiler.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+#include <cwchar>
+
+static bool collect_frame(Profiler *profiler, ID3D11DeviceContext *context, ProfilerFrameQueries *frame, bool wait);
+static ProfilerPassStats *find_or_add_pass(Profiler *profiler, const wchar_t *name);
+
+bool profiler::initialize(Profiler *profiler, ID3D11Device *device) {
+    assert(profiler && device && "profiler::initialize: profiler and device pointers cannot be NULL");
+
+    D3D11_QUERY_DESC disjoint_desc = {D3D11_QUERY_TIMESTAMP_DISJOINT, 0};
+    D3D11_QUERY_DESC timestamp_desc = {D3D11_QUERY_TIMESTAMP, 0};
+
+    for (int i = 0; i < PROFILER_FRAME_LATENCY; ++i) {
+        ProfilerFrameQueries *frame = &profiler->frames[i];
+
+        HRESULT hr = device->CreateQuery(&disjoint_desc, frame->disjoint.GetAddressOf());
+        hr |= device->CreateQuery(&timestamp_desc, frame->frame_begin.GetAddressOf());
+        hr |= device->CreateQuery(&timestamp_desc, frame->frame_end.GetAddressOf());
+        for (int p = 0; p < PROFILER_MAX_PASSES; ++p) {
+            hr |= device->CreateQuery(&timestamp_desc, frame->pass_begin[p].GetAddressOf());
+            hr |= device->CreateQuery(&timestamp_desc, frame->pass_end[p].GetAddressOf());
+        }
+
+        if (FAILED(hr)) {
+            LOG("%s: Couldn't create timestamp queries", __func__);
+            return false;
+        }
+
+        frame->pass_count = 0;
+        frame->is_pending = false;
+    }
+
+    profiler->frame_index = 0;
+    profiler->open_count = 0;
+    profiler->in_frame = false;
+    reset_stats(profiler);
+
+    profiler->enabled = true;
+    return true;
+}
+
+void profiler::reset_stats(Profiler *profiler) {
+    profiler->pass_stat_count = 0;
+    profiler->gpu_frame_total_ms = 0.0;
+    profiler->gpu_frame_max_ms = 0.0;
+    profiler->gpu_frame_samples = 0;
+    profiler->disjoint_frames = 0;
+}
+
+void profiler::begin_frame(Profiler *profiler, ID3D11DeviceContext *context) {
+    if (!profiler->enabled) {
+        return;
+    }
+
+    ProfilerFrameQueries *frame = &profiler->frames[profiler->frame_index % PROFILER_FRAME_LATENCY];
+
+    // The slot we're about to reuse was issued PROFILER_FRAME_LATENCY frames ago,
+    // so this should (almost) never have to wait.
+    if (frame->is_pending) {
+        collect_frame(profiler, context, frame, true);
+    }
+
+    frame->pass_count = 0;
+    profiler->open_count = 0;
+    profiler->in_frame = true;
+
+    context->Begin(frame->disjoint.Get());
+    context->End(frame->frame_begin.Get());
+}
+
+void profiler::end_frame(Profiler *profiler, ID3D11DeviceContext *context) {
+    if (!profiler->enabled || !profiler->in_frame) {
+        return;
+    }
+
+    ProfilerFrameQueries *frame = &profiler->frames[profiler->frame_index % PROFILER_FRAME_LATENCY];
+
+    // Close anything left open so the pairs are always valid
+    while (profiler->open_count > 0) {
+        end_pass(profiler, context);
+    }
+
+    context->End(frame->frame_end.Get());
+    context->End(frame->disjoint.Get());
+
+    frame->is_pending = true;
+    profiler->in_frame = false;
+    profiler->frame_index++;
+}
+
+void profiler::begin_pass(Profiler *profiler, ID3D11DeviceContext *context, const wchar_t *name) {
+    if (!profiler->enabled || !profiler->in_frame) {
+        return;
+    }
+
+    ProfilerFrameQueries *frame = &profiler->frames[profiler->frame_index % PROFILER_FRAME_LATENCY];
+    if (frame->pass_count >= PROFILER_MAX_PASSES || profiler->open_count >= PROFILER_MAX_DEPTH) {
+        return;
+    }
+
+    uint8_t index = frame->pass_count++;
+    frame->pass_names[index] = name;
+    profiler->open_passes[profiler->open_count++] = index;
+
+    context->End(frame->pass_begin[index].Get());
+}
+
+void profiler::end_pass(Profiler *profiler, ID3D11DeviceContext *context) {
+    if (!profiler->enabled || !profiler->in_frame || profiler->open_count == 0) {
+        return;
+    }
+
+    ProfilerFrameQueries *frame = &profiler->frames[profiler->frame_index % PROFILER_FRAME_LATENCY];
+    uint8_t index = profiler->open_passes[--profiler->open_count];
+
+    context->End(frame->pass_end[index].Get());
+}
+
+void profiler::flush(Profiler *profiler, ID3D11DeviceContext *context) {
+    if (!profiler->enabled) {
+        return;
+    }
+
+    // Oldest first, so the stats are accumulated in frame order
+    for (uint32_t i = 0; i < PROFILER_FRAME_LATENCY; ++i) {
+        ProfilerFrameQueries *frame = &profiler->frames[(profiler->frame_index + i) % PROFILER_FRAME_LATENCY];
+        if (frame->is_pending) {
+            collect_frame(profiler, context, frame, true);
+        }
+    }
+}
+
+static bool collect_frame(Profiler *profiler, ID3D11DeviceContext *context, ProfilerFrameQueries *frame, bool wait) {
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+    HRESULT hr;
+    do {
+        hr = context->GetData(frame->disjoint.Get(), &disjoint, sizeof(disjoint), 0);
+    } while (hr == S_FALSE && wait);
+
+    if (hr != S_OK) {
+        return false;
+    }
+
+    frame->is_pending = false;
+
+    // Clocks changed mid-frame (power state etc.), the timestamps are garbage
+    if (disjoint.Disjoint) {
+        profiler->disjoint_frames++;
+        return true;
+    }
+
+    double to_ms = 1000.0 / (double)disjoint.Frequency;
+
+    UINT64 frame_begin = 0, frame_end = 0;
+    context->GetData(frame->frame_begin.Get(), &frame_begin, sizeof(UINT64), 0);
+    context->GetData(frame->frame_end.Get(), &frame_end, sizeof(UINT64), 0);
+
+    double frame_ms = (double)(frame_end - frame_begin) * to_ms;
+    profiler->gpu_frame_total_ms += frame_ms;
+    if (frame_ms > profiler->gpu_frame_max_ms) profiler->gpu_frame_max_ms = frame_ms;
+    profiler->gpu_frame_samples++;
+
+    for (uint8_t i = 0; i < frame->pass_count; ++i) {
+        UINT64 begin = 0, end = 0;
+        context->GetData(frame->pass_begin[i].Get(), &begin, sizeof(UINT64), 0);
+        context->GetData(frame->pass_end[i].Get(), &end, sizeof(UINT64), 0);
+
+        ProfilerPassStats *stats = find_or_add_pass(profiler, frame->pass_names[i]);
+        if (!stats) {
+            continue;
+        }
+
+        double pass_ms = end > begin ? (double)(end - begin) * to_ms : 0.0;
+        stats->total_ms += pass_ms;
+        if (pass_ms > stats->max_ms) stats->max_ms = pass_ms;
+        stats->samples++;
+    }
+
+    return true;
+}
+
+static ProfilerPassStats *find_or_add_pass(Profiler *profiler, const wchar_t *name) {
+    // Names are string literals from the event macros, but compare them anyway
+    // in case two call sites share a name.
+    for (uint8_t i = 0; i < profiler->pass_stat_count; ++i) {
+        if (profiler->passes[i].name == name || wcscmp(profiler->passes[i].name, name) == 0) {
+            return &profiler->passes[i];
+        }
+    }
+
+    if (profiler->pass_stat_count >= PROFILER_MAX_PASSES) {
+        return nullptr;
+    }
+
+    ProfilerPassStats *stats = &profiler->passes[profiler->pass_stat_count++];
+    stats->name = name;
+    stats->total_ms = 0.0;
+    stats->max_ms = 0.0;
+    stats->samples = 0;
+    return stats;
+}
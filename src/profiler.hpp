@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#define PROFILER_MAX_PASSES 32
+#define PROFILER_MAX_DEPTH 8
+// Timestamps are read back this many frames later, so we never stall on the GPU
+#define PROFILER_FRAME_LATENCY 4
+
+struct ProfilerFrameQueries {
+    Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+    Microsoft::WRL::ComPtr<ID3D11Query> frame_begin;
+    Microsoft::WRL::ComPtr<ID3D11Query> frame_end;
+    Microsoft::WRL::ComPtr<ID3D11Query> pass_begin[PROFILER_MAX_PASSES];
+    Microsoft::WRL::ComPtr<ID3D11Query> pass_end[PROFILER_MAX_PASSES];
+    const wchar_t *pass_names[PROFILER_MAX_PASSES];
+    uint8_t pass_count;
+    bool is_pending;
+};
+
+// Accumulated timings of a single named pass
+struct ProfilerPassStats {
+    const wchar_t *name;
+    double total_ms;
+    double max_ms;
+    uint32_t samples;
+};
+
+struct Profiler {
+    bool enabled;
+    bool in_frame;
+
+    ProfilerFrameQueries frames[PROFILER_FRAME_LATENCY];
+    uint32_t frame_index;
+
+    // Stack of open passes, so nested events still pair up
+    uint8_t open_passes[PROFILER_MAX_DEPTH];
+    uint8_t open_count;
+
+    ProfilerPassStats passes[PROFILER_MAX_PASSES];
+    uint8_t pass_stat_count;
+
+    double gpu_frame_total_ms;
+    double gpu_frame_max_ms;
+    uint32_t gpu_frame_samples;
+    uint32_t disjoint_frames;
+};
+
+namespace profiler {
+
+bool initialize(Profiler *profiler, ID3D11Device *device);
+void reset_stats(Profiler *profiler);
+
+void begin_frame(Profiler *profiler, ID3D11DeviceContext *context);
+void end_frame(Profiler *profiler, ID3D11DeviceContext *context);
+void begin_pass(Profiler *profiler, ID3D11DeviceContext *context, const wchar_t *name);
+void end_pass(Profiler *profiler, ID3D11DeviceContext *context);
+
+// Blocks until every frame in flight has been resolved
+void flush(Profiler *profiler, ID3D11DeviceContext *context);
+
+} // namespace profiler
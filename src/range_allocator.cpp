@@ -0,0 +1,328 @@
+#include "range_allocator.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+static void mapping(uint32_t size, uint32_t *out_fl, uint32_t *out_sl);
+static uint16_t find_free(RangeAllocator *allocator, uint32_t size);
+static uint16_t find_in_bin(RangeAllocator *allocator, uint32_t size);
+static void insert_free(RangeAllocator *allocator, uint16_t node);
+static void remove_free(RangeAllocator *allocator, uint16_t node);
+static uint16_t take_node(RangeAllocator *allocator);
+static void give_node(RangeAllocator *allocator, uint16_t node);
+
+void range_allocator::initialize(RangeAllocator *allocator, uint32_t capacity) {
+    assert(allocator && "range_allocator::initialize: Allocator cannot be NULL");
+    assert(capacity > 0 && capacity <= (1u << 31) && "range_allocator::initialize: Capacity has to be in (0, 2^31]");
+
+    allocator->capacity = capacity;
+    allocator->free_units = capacity;
+    allocator->allocation_count = 0;
+    allocator->fl_bitmap = 0;
+    memset(allocator->sl_bitmap, 0, sizeof(allocator->sl_bitmap));
+    memset(allocator->bins, 0xFF, sizeof(allocator->bins));
+
+    // Popped from the back, so node 0 goes first
+    allocator->unused_count = RANGE_ALLOCATOR_MAX_NODES;
+    for (uint32_t i = 0; i < RANGE_ALLOCATOR_MAX_NODES; ++i) {
+        allocator->unused_nodes[i] = (uint16_t)(RANGE_ALLOCATOR_MAX_NODES - 1 - i);
+    }
+
+    uint16_t node = take_node(allocator);
+    RangeAllocatorNode *n = &allocator->nodes[node];
+    n->offset = 0;
+    n->size = capacity;
+    n->prev_physical = RANGE_ALLOCATOR_NONE;
+    n->next_physical = RANGE_ALLOCATOR_NONE;
+    n->used = false;
+    allocator->first_node = node;
+    insert_free(allocator, node);
+}
+
+RangeAllocation range_allocator::allocate(RangeAllocator *allocator, uint32_t size) {
+    RangeAllocation allocation = {0, 0, RANGE_ALLOCATOR_NONE};
+    if (size == 0 || size > allocator->free_units) {
+        return allocation;
+    }
+
+    uint16_t node = find_free(allocator, size);
+    if (node == RANGE_ALLOCATOR_NONE) {
+        return allocation;
+    }
+    remove_free(allocator, node);
+
+    // The rest goes back as its own block. Without a node for it the whole
+    // block is handed out, a little waste is better than failing.
+    RangeAllocatorNode *n = &allocator->nodes[node];
+    if (n->size > size && allocator->unused_count > 0) {
+        uint16_t rest = take_node(allocator);
+        RangeAllocatorNode *r = &allocator->nodes[rest];
+        r->offset = n->offset + size;
+        r->size = n->size - size;
+        r->used = false;
+        r->prev_physical = node;
+        r->next_physical = n->next_physical;
+        if (n->next_physical != RANGE_ALLOCATOR_NONE) {
+            allocator->nodes[n->next_physical].prev_physical = rest;
+        }
+        n->next_physical = rest;
+        n->size = size;
+        insert_free(allocator, rest);
+    }
+
+    n->used = true;
+    allocator->free_units -= n->size;
+    allocator->allocation_count++;
+
+    allocation.offset = n->offset;
+    allocation.size = n->size;
+    allocation.node = node;
+    return allocation;
+}
+
+void range_allocator::release(RangeAllocator *allocator, RangeAllocation allocation) {
+    if (allocation.node == RANGE_ALLOCATOR_NONE) {
+        return;
+    }
+    assert(allocation.node < RANGE_ALLOCATOR_MAX_NODES && "range_allocator::release: Node out of range");
+
+    uint16_t node = allocation.node;
+    RangeAllocatorNode *n = &allocator->nodes[node];
+    assert(n->used && "range_allocator::release: Allocation was already released");
+
+    n->used = false;
+    allocator->free_units += n->size;
+    allocator->allocation_count--;
+
+    // Merge with the free neighbours, the block before takes over
+    uint16_t prev = n->prev_physical;
+    if (prev != RANGE_ALLOCATOR_NONE && !allocator->nodes[prev].used) {
+        remove_free(allocator, prev);
+        RangeAllocatorNode *p = &allocator->nodes[prev];
+        p->size += n->size;
+        p->next_physical = n->next_physical;
+        if (n->next_physical != RANGE_ALLOCATOR_NONE) {
+            allocator->nodes[n->next_physical].prev_physical = prev;
+        }
+        give_node(allocator, node);
+        node = prev;
+        n = p;
+    }
+
+    uint16_t next = n->next_physical;
+    if (next != RANGE_ALLOCATOR_NONE && !allocator->nodes[next].used) {
+        remove_free(allocator, next);
+        RangeAllocatorNode *x = &allocator->nodes[next];
+        n->size += x->size;
+        n->next_physical = x->next_physical;
+        if (x->next_physical != RANGE_ALLOCATOR_NONE) {
+            allocator->nodes[x->next_physical].prev_physical = node;
+        }
+        give_node(allocator, next);
+    }
+
+    insert_free(allocator, node);
+}
+
+RangeAllocation range_allocator::get(const RangeAllocator *allocator, uint16_t node) {
+    RangeAllocation allocation = {0, 0, RANGE_ALLOCATOR_NONE};
+    if (node < RANGE_ALLOCATOR_MAX_NODES && allocator->nodes[node].used) {
+        allocation.offset = allocator->nodes[node].offset;
+        allocation.size = allocator->nodes[node].size;
+        allocation.node = node;
+    }
+    return allocation;
+}
+
+uint32_t range_allocator::compact(RangeAllocator *allocator, RangeMove *out_moves, uint32_t max_moves) {
+    assert(max_moves >= allocator->allocation_count && "range_allocator::compact: Not enough room for the moves");
+
+    uint32_t move_count = 0;
+    uint32_t cursor = 0;
+    uint16_t last_used = RANGE_ALLOCATOR_NONE;
+    uint16_t first_used = RANGE_ALLOCATOR_NONE;
+
+    // Walk by offset, the used blocks get packed and relinked, the free ones go back to the pool
+    uint16_t node = allocator->first_node;
+    while (node != RANGE_ALLOCATOR_NONE) {
+        RangeAllocatorNode *n = &allocator->nodes[node];
+        uint16_t next = n->next_physical;
+
+        if (n->used) {
+            if (n->offset != cursor && move_count < max_moves) {
+                out_moves[move_count++] = {node, n->offset, cursor, n->size};
+            }
+            n->offset = cursor;
+            cursor += n->size;
+
+            n->prev_physical = last_used;
+            if (last_used != RANGE_ALLOCATOR_NONE) {
+                allocator->nodes[last_used].next_physical = node;
+            } else {
+                first_used = node;
+            }
+            last_used = node;
+        } else {
+            give_node(allocator, node);
+        }
+
+        node = next;
+    }
+
+    allocator->fl_bitmap = 0;
+    memset(allocator->sl_bitmap, 0, sizeof(allocator->sl_bitmap));
+    memset(allocator->bins, 0xFF, sizeof(allocator->bins));
+
+    // Released at least one node above whenever there's free space, so this can't run out
+    uint16_t tail = RANGE_ALLOCATOR_NONE;
+    if (cursor < allocator->capacity) {
+        tail = take_node(allocator);
+        RangeAllocatorNode *t = &allocator->nodes[tail];
+        t->offset = cursor;
+        t->size = allocator->capacity - cursor;
+        t->used = false;
+        t->prev_physical = last_used;
+        t->next_physical = RANGE_ALLOCATOR_NONE;
+        insert_free(allocator, tail);
+    }
+
+    if (last_used != RANGE_ALLOCATOR_NONE) {
+        allocator->nodes[last_used].next_physical = tail;
+        allocator->first_node = first_used;
+    } else {
+        allocator->first_node = tail;
+    }
+
+    return move_count;
+}
+
+RangeAllocatorStats range_allocator::get_stats(const RangeAllocator *allocator) {
+    RangeAllocatorStats stats = {};
+    stats.free_units = allocator->free_units;
+    stats.used_units = allocator->capacity - allocator->free_units;
+    stats.allocations = allocator->allocation_count;
+
+    for (uint16_t node = allocator->first_node; node != RANGE_ALLOCATOR_NONE; node = allocator->nodes[node].next_physical) {
+        const RangeAllocatorNode *n = &allocator->nodes[node];
+        if (!n->used) {
+            stats.free_blocks++;
+            if (n->size > stats.largest_free) {
+                stats.largest_free = n->size;
+            }
+        }
+    }
+
+    return stats;
+}
+
+// Bin of a block size. Below 16 every size has a bin of its own (level 0),
+// above that each power of two is split into 16 steps.
+static void mapping(uint32_t size, uint32_t *out_fl, uint32_t *out_sl) {
+    if (size < RANGE_ALLOCATOR_SL_COUNT) {
+        *out_fl = 0;
+        *out_sl = size;
+        return;
+    }
+
+    uint32_t top_bit = (uint32_t)std::bit_width(size) - 1;
+    *out_fl = top_bit - RANGE_ALLOCATOR_SL_LOG2 + 1;
+    *out_sl = (size >> (top_bit - RANGE_ALLOCATOR_SL_LOG2)) - RANGE_ALLOCATOR_SL_COUNT;
+}
+
+static uint16_t find_free(RangeAllocator *allocator, uint32_t size) {
+    // Round up to the start of the next bin, everything in that one is big enough
+    uint32_t rounded = size;
+    if (size >= RANGE_ALLOCATOR_SL_COUNT) {
+        uint32_t top_bit = (uint32_t)std::bit_width(size) - 1;
+        rounded += (1u << (top_bit - RANGE_ALLOCATOR_SL_LOG2)) - 1;
+    }
+
+    uint32_t fl, sl;
+    mapping(rounded, &fl, &sl);
+    if (fl >= RANGE_ALLOCATOR_FL_COUNT) {
+        return find_in_bin(allocator, size);
+    }
+
+    uint32_t sl_map = allocator->sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        // Nothing in this level, take the smallest bin of the next level that has anything
+        uint32_t fl_map = fl + 1 < 32 ? allocator->fl_bitmap & (~0u << (fl + 1)) : 0;
+        if (fl_map == 0) {
+            return find_in_bin(allocator, size);
+        }
+        fl = (uint32_t)std::countr_zero(fl_map);
+        sl_map = allocator->sl_bitmap[fl];
+    }
+    sl = (uint32_t)std::countr_zero(sl_map);
+
+    return allocator->bins[fl * RANGE_ALLOCATOR_SL_COUNT + sl];
+}
+
+// Nothing in the bins above, but the size's own bin can still hold a block that
+// fits. After a compact that's the only block left, and it has to be found.
+static uint16_t find_in_bin(RangeAllocator *allocator, uint32_t size) {
+    uint32_t fl, sl;
+    mapping(size, &fl, &sl);
+    if (fl >= RANGE_ALLOCATOR_FL_COUNT) {
+        return RANGE_ALLOCATOR_NONE;
+    }
+
+    uint16_t node = allocator->bins[fl * RANGE_ALLOCATOR_SL_COUNT + sl];
+    while (node != RANGE_ALLOCATOR_NONE && allocator->nodes[node].size < size) {
+        node = allocator->nodes[node].next_free;
+    }
+    return node;
+}
+
+static void insert_free(RangeAllocator *allocator, uint16_t node) {
+    RangeAllocatorNode *n = &allocator->nodes[node];
+    uint32_t fl, sl;
+    mapping(n->size, &fl, &sl);
+    uint32_t bin = fl * RANGE_ALLOCATOR_SL_COUNT + sl;
+
+    n->prev_free = RANGE_ALLOCATOR_NONE;
+    n->next_free = allocator->bins[bin];
+    if (n->next_free != RANGE_ALLOCATOR_NONE) {
+        allocator->nodes[n->next_free].prev_free = node;
+    }
+    allocator->bins[bin] = node;
+
+    allocator->fl_bitmap |= 1u << fl;
+    allocator->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(RangeAllocator *allocator, uint16_t node) {
+    RangeAllocatorNode *n = &allocator->nodes[node];
+    uint32_t fl, sl;
+    mapping(n->size, &fl, &sl);
+    uint32_t bin = fl * RANGE_ALLOCATOR_SL_COUNT + sl;
+
+    if (n->prev_free != RANGE_ALLOCATOR_NONE) {
+        allocator->nodes[n->prev_free].next_free = n->next_free;
+    } else {
+        allocator->bins[bin] = n->next_free;
+    }
+    if (n->next_free != RANGE_ALLOCATOR_NONE) {
+        allocator->nodes[n->next_free].prev_free = n->prev_free;
+    }
+
+    if (allocator->bins[bin] == RANGE_ALLOCATOR_NONE) {
+        allocator->sl_bitmap[fl] &= ~(1u << sl);
+        if (allocator->sl_bitmap[fl] == 0) {
+            allocator->fl_bitmap &= ~(1u << fl);
+        }
+    }
+}
+
+static uint16_t take_node(RangeAllocator *allocator) {
+    assert(allocator->unused_count > 0 && "range_allocator: Out of nodes");
+    uint16_t node = allocator->unused_nodes[--allocator->unused_count];
+    allocator->nodes[node].used = false;
+    return node;
+}
+
+static void give_node(RangeAllocator *allocator, uint16_t node) {
+    allocator->nodes[node].used = false;
+    allocator->unused_nodes[allocator->unused_count++] = node;
+}
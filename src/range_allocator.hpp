@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+// Hands out ranges of a fixed size space (vertices or indices of a shared
+// buffer, it doesn't care what the units are). Nothing here touches the memory
+// itself, it only does the bookkeeping.
+//
+// It's a TLSF (two level segregated fit) allocator: free blocks are kept in
+// bins by the position of their highest bit (first level), split into 16 linear
+// steps (second level). A bitmap per level finds a bin with a big enough block
+// in constant time. Requests are rounded up to the next bin so any block in
+// the bin found fits. Only when nothing is left above is the request's own bin
+// searched. Freed blocks are merged with free neighbours right away.
+//
+// Blocks are nodes in a fixed pool, linked by offset (physical) and per bin.
+// Every allocation takes at most one extra node, for the remainder.
+#define RANGE_ALLOCATOR_SL_LOG2 4
+#define RANGE_ALLOCATOR_SL_COUNT (1 << RANGE_ALLOCATOR_SL_LOG2)
+#define RANGE_ALLOCATOR_FL_COUNT (32 - RANGE_ALLOCATOR_SL_LOG2 + 1)
+#define RANGE_ALLOCATOR_BIN_COUNT (RANGE_ALLOCATOR_FL_COUNT * RANGE_ALLOCATOR_SL_COUNT)
+#define RANGE_ALLOCATOR_MAX_NODES 1024
+#define RANGE_ALLOCATOR_NONE 0xFFFF
+
+struct RangeAllocatorNode {
+    uint32_t offset;
+    uint32_t size;
+    // Neighbours by offset, NONE at either end
+    uint16_t prev_physical;
+    uint16_t next_physical;
+    // Neighbours in the bin, only while free
+    uint16_t prev_free;
+    uint16_t next_free;
+    bool used;
+};
+
+struct RangeAllocation {
+    uint32_t offset;
+    uint32_t size; // Can be a bit more than asked for when the pool is out of nodes
+    uint16_t node; // NONE when the allocation failed
+};
+
+// An allocation that compact moved somewhere else
+struct RangeMove {
+    uint16_t node;
+    uint32_t from;
+    uint32_t to;
+    uint32_t size;
+};
+
+struct RangeAllocatorStats {
+    uint32_t used_units;
+    uint32_t free_units;
+    uint32_t largest_free;
+    uint32_t free_blocks;
+    uint32_t allocations;
+};
+
+struct RangeAllocator {
+    uint32_t capacity;
+    uint32_t free_units;
+    uint32_t allocation_count;
+
+    // Bit per first level with anything free, then bit per bin in that level
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[RANGE_ALLOCATOR_FL_COUNT];
+    uint16_t bins[RANGE_ALLOCATOR_BIN_COUNT];
+
+    RangeAllocatorNode nodes[RANGE_ALLOCATOR_MAX_NODES];
+    // Stack of the nodes that aren't a block right now
+    uint16_t unused_nodes[RANGE_ALLOCATOR_MAX_NODES];
+    uint32_t unused_count;
+    // Block at offset 0
+    uint16_t first_node;
+};
+
+namespace range_allocator {
+
+void initialize(RangeAllocator *allocator, uint32_t capacity);
+// node is NONE when there's no free block that big
+RangeAllocation allocate(RangeAllocator *allocator, uint32_t size);
+void release(RangeAllocator *allocator, RangeAllocation allocation);
+// Where an allocation is now, for after compact
+RangeAllocation get(const RangeAllocator *allocator, uint16_t node);
+
+// Moves every allocation down so all the free space is one block at the end.
+// Allocations keep their node, the moves (in offset order, so copying them one
+// after the other never overwrites a range that still has to move) go to
+// out_moves, which needs room for every allocation. Returns the move count.
+uint32_t compact(RangeAllocator *allocator, RangeMove *out_moves, uint32_t max_moves);
+
+RangeAllocatorStats get_stats(const RangeAllocator *allocator);
+
+} // namespace range_allocator
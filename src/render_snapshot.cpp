@@ -0,0 +1,109 @@
+#include "render_snapshot.hpp"
+
+#include <DirectXMath.h>
+#include <cassert>
+
+static void resolve_matrices(Scene *scene);
+
+void render_snapshot::initialize(SnapshotBuffer *buffer) {
+    assert(buffer && "render_snapshot::initialize: Buffer pointer cannot be NULL");
+
+    for (uint32_t i = 0; i < RENDER_SNAPSHOT_COUNT; ++i) {
+        scene::initialize(&buffer->slots[i].scene);
+        buffer->slots[i].tick = 0;
+        buffer->slots[i].time = 0.0f;
+        buffer->slots[i].input_ns = 0;
+        buffer->slots[i].width = 0;
+        buffer->slots[i].height = 0;
+    }
+
+    buffer->back = 0;
+    buffer->front = 2;
+    buffer->has_front = false;
+    buffer->middle.store(1);
+    buffer->published.store(0);
+}
+
+RenderSnapshot *render_snapshot::capture(SnapshotBuffer *buffer, Scene *scene) {
+    // Resolved in the simulation's scene, the next copy doesn't redo what didn't move
+    resolve_matrices(scene);
+
+    RenderSnapshot *snapshot = &buffer->slots[buffer->back];
+    snapshot->scene = *scene;
+    if (scene->active_cam) {
+        snapshot->scene.active_cam = &snapshot->scene.cameras[scene->active_cam - scene->cameras];
+    }
+    return snapshot;
+}
+
+void render_snapshot::publish(SnapshotBuffer *buffer) {
+    // Release so the snapshot is visible to whoever swaps it out next
+    uint32_t previous = buffer->middle.exchange(buffer->back | RENDER_SNAPSHOT_FRESH, std::memory_order_acq_rel);
+    buffer->back = previous & ~RENDER_SNAPSHOT_FRESH;
+
+    buffer->published.fetch_add(1, std::memory_order_release);
+    buffer->published.notify_one();
+}
+
+void render_snapshot::interpolate_camera(RenderSnapshot *snapshot, const SceneCamera *previous, float alpha) {
+    Scene *scene = &snapshot->scene;
+    SceneCamera *cam = scene->active_cam;
+    if (!cam || alpha >= 1.0f || id::is_invalid(previous->id) || previous->id.id != cam->id.id || previous->id.generation != cam->id.generation) {
+        return;
+    }
+
+    // Orbit cameras, the position follows from the target and yaw, pitch and distance
+    DirectX::XMVECTOR previous_target = DirectX::XMLoadFloat3(&previous->target);
+    DirectX::XMFLOAT3 target;
+    DirectX::XMStoreFloat3(&target, DirectX::XMVectorLerp(previous_target, DirectX::XMLoadFloat3(&cam->target), alpha));
+    float distance = previous->distance + (cam->distance - previous->distance) * alpha;
+    float yaw = previous->yaw + (cam->yaw - previous->yaw) * alpha;
+    float pitch = previous->pitch + (cam->pitch - previous->pitch) * alpha;
+
+    scene::camera_set_target(scene, cam->id, target);
+    cam->distance = distance;
+    scene::camera_set_yaw_pitch(scene, cam->id, yaw, pitch);
+    scene::camera_get_view_projection_matrix(cam);
+}
+
+RenderSnapshot *render_snapshot::acquire(SnapshotBuffer *buffer) {
+    if (buffer->middle.load(std::memory_order_relaxed) & RENDER_SNAPSHOT_FRESH) {
+        uint32_t latest = buffer->middle.exchange(buffer->front, std::memory_order_acq_rel);
+        buffer->front = latest & ~RENDER_SNAPSHOT_FRESH;
+        buffer->has_front = true;
+    }
+
+    if (!buffer->has_front) {
+        return nullptr;
+    }
+    return &buffer->slots[buffer->front];
+}
+
+uint32_t render_snapshot::wait(SnapshotBuffer *buffer, uint32_t seen) {
+    buffer->published.wait(seen, std::memory_order_acquire);
+    return buffer->published.load(std::memory_order_acquire);
+}
+
+void render_snapshot::interrupt(SnapshotBuffer *buffer) {
+    buffer->published.fetch_add(1, std::memory_order_release);
+    buffer->published.notify_all();
+}
+
+static void resolve_matrices(Scene *scene) {
+    // The getters update whatever is dirty
+    for (uint32_t i = 0; i < MAX_SCENE_MESHES; ++i) {
+        if (!id::is_invalid(scene->meshes[i].id)) {
+            scene::mesh_get_world_matrix(scene, scene->meshes[i].id);
+        }
+    }
+    for (uint32_t i = 0; i < MAX_SCENE_CAMERAS; ++i) {
+        if (!id::is_invalid(scene->cameras[i].id)) {
+            scene::camera_get_view_projection_matrix(&scene->cameras[i]);
+        }
+    }
+    for (uint32_t i = 0; i < MAX_SCENE_LIGHTS; ++i) {
+        if (!id::is_invalid(scene->lights[i].id)) {
+            scene::light_get_view_projection_matrix(scene, scene->lights[i].id);
+        }
+    }
+}
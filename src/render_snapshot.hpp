@@ -0,0 +1,62 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+// What the render side draws a frame from: a copy of the scene (camera, mesh
+// instances, lights) as the simulation left it at the end of a tick, with
+// every matrix already resolved. The simulation keeps changing its own Scene
+// meanwhile, the two never share memory.
+//
+// Snapshots go through a triple buffer. The simulation writes the back one,
+// the renderer draws the front one and the middle one is swapped with either
+// of them with a single atomic exchange, so neither side ever waits on the
+// other. When the simulation is faster the renderer skips to the latest one.
+#define RENDER_SNAPSHOT_COUNT 3
+// Set in middle when the simulation published since the renderer last looked
+#define RENDER_SNAPSHOT_FRESH 0x80000000u
+
+struct RenderSnapshot {
+    Scene scene;       // active_cam points into this copy
+    uint64_t tick;     // Simulation tick it was taken at
+    float time;
+    uint64_t input_ns; // When the input it reflects was read, for the latency
+    uint16_t width;    // Window size at the time, the renderer resizes to it
+    uint16_t height;
+};
+
+struct SnapshotBuffer {
+    RenderSnapshot slots[RENDER_SNAPSHOT_COUNT];
+    uint32_t back;  // Simulation only
+    uint32_t front; // Renderer only
+    bool has_front; // Renderer only, false until the first publish came through
+    std::atomic<uint32_t> middle;
+    // Bumped on every publish, the render thread waits on it
+    std::atomic<uint32_t> published;
+};
+
+namespace render_snapshot {
+
+void initialize(SnapshotBuffer *buffer);
+
+// Simulation side. capture copies the scene into the back snapshot
+// (resolving its dirty matrices first), the rest of it is filled in by the
+// caller and publish hands it over.
+RenderSnapshot *capture(SnapshotBuffer *buffer, Scene *scene);
+void publish(SnapshotBuffer *buffer);
+// Puts the active camera alpha of the way from previous to where it is, for
+// fixed timestep updates. Does nothing when previous is another camera.
+void interpolate_camera(RenderSnapshot *snapshot, const SceneCamera *previous, float alpha);
+
+// Render side. The latest snapshot, the same one as last time when nothing
+// new was published, NULL before the first publish. Stays valid (and only
+// the renderer's) until the next acquire.
+RenderSnapshot *acquire(SnapshotBuffer *buffer);
+// Blocks until publish has been called more often than seen, returns the new count
+uint32_t wait(SnapshotBuffer *buffer, uint32_t seen);
+// Wakes up a wait without publishing anything
+void interrupt(SnapshotBuffer *buffer);
+
+} // namespace render_snapshot
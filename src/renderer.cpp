@@ -1,14 +1,22 @@
 #include "renderer.hpp"
 
-#include "application.hpp"
+#include "file_watcher.hpp"
 #include "id.hpp"
+#include "light_cluster.hpp"
 #include "logger.hpp"
+#include "memory_tracker.hpp"
 #include "mesh.hpp"
+#include "pipeline_system.hpp"
+#include "profiler.hpp"
 #include "scene.hpp"
 #include "shader_system.hpp"
 #include "texture.hpp"
+#include "texture_format.hpp"
 
 #include <DirectXMath.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <d3dcommon.h>
 #include <d3dcompiler.h>
 #include <dxgiformat.h>
@@ -27,18 +35,31 @@
 
 #define UNUSED(x) (void)(x)
 
+// GPU timings per pass ride along on the debug events, so every annotated
+// pass shows up in the profiler (when it's enabled) in any build.
+#define BEGIN_PROFILER_PASS(renderer, lname)                                             \
+    if ((renderer) && (renderer)->profiler.enabled) {                                    \
+        profiler::begin_pass(&(renderer)->profiler, (renderer)->context.Get(), lname); \
+    }
+#define END_PROFILER_PASS(renderer)                                               \
+    if ((renderer) && (renderer)->profiler.enabled) {                             \
+        profiler::end_pass(&(renderer)->profiler, (renderer)->context.Get()); \
+    }
+
 #ifdef _DEBUG
 #define BEGIN_D3D11_EVENT(renderer, lname)         \
     if ((renderer) && (renderer)->annotation) {    \
         (renderer)->annotation->BeginEvent(lname); \
-    }
+    }                                              \
+    BEGIN_PROFILER_PASS(renderer, lname)
 #define END_D3D11_EVENT(renderer)               \
+    END_PROFILER_PASS(renderer)                 \
     if ((renderer) && (renderer)->annotation) { \
         (renderer)->annotation->EndEvent();     \
     }
 #else
-#define BEGIN_D3D11_EVENT(renderer, lname) UNUSED(renderer)
-#define END_D3D11_EVENT(renderer) UNUSED(renderer)
+#define BEGIN_D3D11_EVENT(renderer, lname) BEGIN_PROFILER_PASS(renderer, lname)
+#define END_D3D11_EVENT(renderer) END_PROFILER_PASS(renderer)
 #endif
 
 #ifdef _DEBUG
@@ -59,16 +80,29 @@
 #define SET_D3D11_OBJECT_NAME(resource, name)
 #endif
 
+// Casters this far in front of a cascade (towards the light) still cast into it
+#define SHADOW_CASTER_DISTANCE 50.0f
+
 // Static functions
 static bool setup_storage_state(Renderer *renderer);
 static bool create_device(ID3D11Device1 **device, ID3D11DeviceContext1 **context, D3D_FEATURE_LEVEL *out_feature_level);
-static bool create_swapchain(ID3D11Device1 *device, HWND hwnd, IDXGISwapChain3 **swapchain);
+static bool create_swapchain(ID3D11Device1 *device, HWND hwnd, uint32_t max_frames_in_flight, IDXGISwapChain3 **swapchain);
 static bool create_default_shaders(Renderer *renderer);
 static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device);
+static ID3D11RasterizerState *get_rasterizer_state(Renderer *renderer, RasterizerState state);
+static ID3D11DepthStencilState *get_depth_stencil_state(Renderer *renderer, DepthStencilState state);
+static ID3D11BlendState *get_blend_state(Renderer *renderer, BlendState state);
 static bool resolve_msaa_texture(ID3D11DeviceContext *context, Texture *src, Texture *dst);
 
 static bool create_shadow_pass(Renderer *renderer, PipelineId *out_pipeline);
 static void render_shadow_pass(Renderer *renderer, Scene *scene, Texture *shadow_atlas);
+static void draw_scene_mesh(Renderer *renderer, int scene_mesh_index, Mesh *gpu_mesh);
+static void build_opaque_queue(Renderer *renderer, Scene *scene);
+static void update_streaming(Renderer *renderer, Scene *scene);
+static int draw_item_compare(const void *a, const void *b);
+
+static bool create_structured_buffer(ID3D11Device *device, uint32_t stride, uint32_t count, bool dynamic, bool unordered_access,
+                                     ID3D11Buffer **out_buffer, ID3D11ShaderResourceView **out_srv, ID3D11UnorderedAccessView **out_uav);
 
 static bool create_fallback_textures(Renderer *renderer);
 
@@ -79,20 +113,34 @@ bool renderer::initialize(Renderer *renderer, Window *pWindow) {
         return false;
     }
     renderer->pWindow = pWindow;
+    renderer->width = pWindow->width;
+    renderer->height = pWindow->height;
+
+    // The profiler is opt-in (the benchmark turns it on)
+    renderer->profiler.enabled = false;
+    renderer->present_interval = 1;
 
     if (!setup_storage_state(renderer)) {
         LOG("%s: Failed to setup storage state for renderer", __func__);
         return false;
     }
 
+    if (!arena::frame_initialize(&renderer->frame_arena, ARENA_FRAME_RESERVE)) {
+        LOG("%s: Couldn't reserve the frame arena", __func__);
+        return false;
+    }
+    renderer->opaque_queue = nullptr;
+    renderer->opaque_count = 0;
+
     // Create the device
     if (!create_device(renderer->device.GetAddressOf(), renderer->context.GetAddressOf(), &renderer->featureLevel)) {
         LOG("%s: Device creation failed", __func__);
         return false;
     }
+    state_tracker::initialize(&renderer->state_tracker, renderer->context.Get());
 
     // Create the swapchain
-    if (!create_swapchain(renderer->device.Get(), pWindow->hwnd, renderer->swapchain.GetAddressOf())) {
+    if (!create_swapchain(renderer->device.Get(), pWindow->hwnd, renderer->max_frames_in_flight, renderer->swapchain.GetAddressOf())) {
         LOG("%s: Swapchain creation failed", __func__);
         return false;
     }
@@ -116,6 +164,13 @@ bool renderer::initialize(Renderer *renderer, Window *pWindow) {
         return false;
     }
 
+    // Create the buffers the meshes get loaded into
+    if (!geometry_arena::initialize(&renderer->geometry_arena, renderer->device.Get(), sizeof(Vertex), GEOMETRY_ARENA_VERTICES, GEOMETRY_ARENA_INDICES)) {
+        LOG("%s: Failed to create the geometry arena", __func__);
+        return false;
+    }
+    renderer->meshlet_culling = true;
+
     // Create fallback textures
     if (!create_fallback_textures(renderer)) {
         LOG("%s: Failed to create fallback textures", __func__);
@@ -144,19 +199,38 @@ bool renderer::initialize(Renderer *renderer, Window *pWindow) {
         return false;
     }
 
-    // PerMaterial Constant Buffer
-    CBDesc.ByteWidth = sizeof(CBPerMaterial);
-    hr = renderer->device->CreateBuffer(&CBDesc, nullptr, renderer->pCBPerMaterial.GetAddressOf());
-    if (FAILED(hr)) {
-        LOG("Renderer error: Failed to create constant buffer for per material data");
+    // Material buffer, filled by material::update_table
+    if (!create_structured_buffer(renderer->device.Get(), sizeof(GPUMaterial), MAX_MATERIALS, false, false,
+                                  renderer->material_buffer.GetAddressOf(), renderer->material_srv.GetAddressOf(), nullptr)) {
+        LOG("Renderer error: Failed to create the material buffer");
         return false;
     }
+    material_table::reset(&renderer->material_table);
+    renderer->material_table_dirty = true;
 
     // Initialize the Shader System
     if (!shader::system_initialize(&renderer->shader_system)) {
         LOG("%s: Failed to initialize shader system", __func__);
         return false;
     }
+    renderer->shader_system.use_cache = renderer->shader_cache_enabled;
+
+    // Every create_module_from_file below only queues the compile, the
+    // pipelines are built once their modules are in (at the latest on first use)
+    if (!renderer->serial_shaders) {
+        shader::set_job_system(&renderer->shader_system, renderer->jobs);
+    }
+
+    async::initialize(&renderer->asset_scheduler, renderer->jobs);
+    static_assert(MAX_TEXTURES <= STREAMER_MAX_TEXTURES, "renderer: The texture streamer is addressed by texture slot");
+    texture_streamer::initialize(&renderer->texture_streamer, renderer->texture_stream_budget, TEXTURE_STREAM_MAX_LOADS);
+    static_assert(MAX_TEXTURES + MAX_MESHES <= ASSET_REGISTRY_MAX_ENTRIES, "renderer: Every texture and mesh has to fit in the asset registry");
+    asset_registry::initialize(&renderer->asset_registry, renderer->asset_content_hash);
+
+    renderer->shader_watcher.active = false;
+    if (renderer->shader_hot_reload && !file_watcher::initialize(&renderer->shader_watcher, "src/shaders")) {
+        LOG("%s: Shader hot reload is off, couldn't watch src/shaders", __func__);
+    }
 
     // Create default shaders
     if (!create_default_shaders(renderer)) {
@@ -197,6 +271,18 @@ bool renderer::initialize(Renderer *renderer, Window *pWindow) {
         return false;
     }
 
+    // Light buffer and cluster lists, used by both rendering methods
+    if (!create_light_culling(renderer)) {
+        LOG("%s: Couldn't create light culling", __func__);
+        return false;
+    }
+
+    // Hi-Z reduction and readback for occlusion culling, used by both rendering methods
+    if (!create_occlusion_culling(renderer)) {
+        LOG("%s: Couldn't create occlusion culling", __func__);
+        return false;
+    }
+
 #if (RENDERING_METHOD == RENDERING_METHOD_DEFERRED)
     // Create pipeline for G-Buffer
     renderer->gbuffer_pipeline = create_gbuffer_pipeline(renderer);
@@ -291,13 +377,33 @@ bool renderer::initialize(Renderer *renderer, Window *pWindow) {
     // Generate the BRDF LUT
     generate_BRDF_LUT(renderer);
 
+    // Everything above bound straight on the context
+    state_tracker::reset(&renderer->state_tracker);
+
     UNUSED(resolve_msaa_texture);
 
     return true;
 }
 
 void renderer::shutdown(Renderer *renderer) {
-    (void)renderer;
+    file_watcher::shutdown(&renderer->shader_watcher);
+
+    // Loads still in flight finish their uploads first
+    async::wait_idle(&renderer->asset_scheduler);
+
+    // Not logged at the end of initialize, the compiles may still be running then
+    shader::wait_all(&renderer->shader_system);
+    LOG("%s: Shaders: %u from the cache, %u compiled", __func__, renderer->shader_system.cache_hits.load(), renderer->shader_system.cache_misses.load());
+    const TextureStreamerStats *stream_stats = &renderer->texture_streamer.stats;
+    LOG("%s: Texture streaming: %u loads (%llu bytes), %u evictions (%llu bytes), %u clamped to the budget", __func__,
+        stream_stats->loads, (unsigned long long)stream_stats->bytes_loaded, stream_stats->evictions, (unsigned long long)stream_stats->bytes_evicted, stream_stats->clamped_loads);
+    const AssetRegistryStats *asset_stats = &renderer->asset_registry.stats;
+    LOG("%s: Assets: %u acquired, %u shared by path and %u by content (%llu bytes hashed), %u freed", __func__,
+        asset_stats->acquires, asset_stats->path_hits, asset_stats->content_hits, (unsigned long long)asset_stats->bytes_hashed, asset_stats->freed);
+
+    shader::set_job_system(&renderer->shader_system, nullptr);
+
+    arena::frame_shutdown(&renderer->frame_arena);
 }
 
 PipelineId renderer::create_tonemap_shader_pipeline(Renderer *renderer) {
@@ -593,6 +699,21 @@ PipelineId renderer::create_gbuffer_pipeline(Renderer *renderer) {
         return id::invalid();
     }
 
+    // Variants per material features, compiled as materials show up
+    uint32_t feature_count;
+    ShaderPermutationDesc permutation_desc = {};
+    permutation_desc.ps_path = L"src/shaders/gbuffer.ps.hlsl";
+    permutation_desc.ps_entry_point = "main";
+    permutation_desc.input_desc = pbr_input_desc;
+    permutation_desc.input_count = ARRAYSIZE(pbr_input_desc);
+    permutation_desc.feature_mask = MATERIAL_FEATURE_ALL;
+    permutation_desc.features = material::get_feature_defines(&feature_count);
+    permutation_desc.feature_count = feature_count;
+    if (!shader::initialize_permutations(&renderer->opaque_permutations, &permutation_desc, gbuffer_vs, gbuffer_pipeline)) {
+        LOG("%s: Couldn't set up the G-buffer permutations", __func__);
+        return id::invalid();
+    }
+
     // Create RTV's for the G-Buffer.
     // Should these just be part of the pipeline and be bound with it?
     // Albedo (RGB) + Roughness (A)
@@ -626,34 +747,6 @@ PipelineId renderer::create_gbuffer_pipeline(Renderer *renderer) {
 }
 
 PipelineId renderer::create_lighting_pass_pipeline(Renderer *renderer) {
-    ID3D11Device *device = renderer->device.Get();
-
-    // Create structured buffer for lights
-    {
-        D3D11_BUFFER_DESC desc = {};
-        desc.Usage = D3D11_USAGE_DYNAMIC;
-        desc.ByteWidth = sizeof(CBLight) * MAX_LIGHTS;
-        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-        desc.StructureByteStride = sizeof(CBLight);
-
-        HRESULT hr = device->CreateBuffer(&desc, nullptr, renderer->light_buffer.GetAddressOf());
-        assert(SUCCEEDED(hr) && "Failed to create structured buffer");
-    }
-
-    // Create resource view for structured buffer
-    {
-        D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
-        desc.Format = DXGI_FORMAT_UNKNOWN;
-        desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
-        desc.Buffer.ElementOffset = 0;
-        desc.Buffer.NumElements = MAX_LIGHTS;
-
-        HRESULT hr = device->CreateShaderResourceView(renderer->light_buffer.Get(), &desc, renderer->light_srv.GetAddressOf());
-        assert(SUCCEEDED(hr) && "Failed to create SRV for structured buffer");
-    }
-
     ShaderId lighting_pass_ps = shader::create_module_from_file(
         &renderer->shader_system,
         renderer->device.Get(),
@@ -753,6 +846,25 @@ PipelineId renderer::create_forward_plus_opaque(Renderer *renderer) {
         fp_opaque_input_desc,
         ARRAYSIZE(fp_opaque_input_desc));
 
+    if (id::is_invalid(fp_opaque_pipeline)) {
+        return id::invalid();
+    }
+
+    // Variants per material features, the coat map isn't used here (yet)
+    uint32_t feature_count;
+    ShaderPermutationDesc permutation_desc = {};
+    permutation_desc.ps_path = L"src/shaders/fp_opaque.ps.hlsl";
+    permutation_desc.ps_entry_point = "main";
+    permutation_desc.input_desc = fp_opaque_input_desc;
+    permutation_desc.input_count = ARRAYSIZE(fp_opaque_input_desc);
+    permutation_desc.feature_mask = MATERIAL_FEATURE_ALL & ~MATERIAL_FEATURE_COAT_MAP;
+    permutation_desc.features = material::get_feature_defines(&feature_count);
+    permutation_desc.feature_count = feature_count;
+    if (!shader::initialize_permutations(&renderer->opaque_permutations, &permutation_desc, fp_opaque_vs, fp_opaque_pipeline)) {
+        LOG("%s: Couldn't set up the Forward+ permutations", __func__);
+        return id::invalid();
+    }
+
     return fp_opaque_pipeline;
 }
 
@@ -776,8 +888,199 @@ bool renderer::create_post_process_pipeline(Renderer *renderer, PipelineId *out_
     return true;
 }
 
+bool renderer::create_light_culling(Renderer *renderer) {
+    ID3D11Device *device = renderer->device.Get();
+
+    // Shading lights, directional ones first then point/spot
+    if (!create_structured_buffer(device, sizeof(CBLight), MAX_LIGHTS, true, false,
+                                  renderer->light_buffer.GetAddressOf(), renderer->light_srv.GetAddressOf(), nullptr)) {
+        LOG("%s: Couldn't create the light buffer", __func__);
+        return false;
+    }
+
+    // Inputs of the culling compute pass
+    if (!create_structured_buffer(device, sizeof(GPUClusterBounds), CLUSTER_COUNT, true, false,
+                                  renderer->cluster_bounds_buffer.GetAddressOf(), renderer->cluster_bounds_srv.GetAddressOf(), nullptr) ||
+        !create_structured_buffer(device, sizeof(ClusterLight), MAX_SCENE_LIGHTS, true, false,
+                                  renderer->cluster_light_buffer.GetAddressOf(), renderer->cluster_light_srv.GetAddressOf(), nullptr)) {
+        LOG("%s: Couldn't create the cluster input buffers", __func__);
+        return false;
+    }
+
+    // Per cluster light lists. Written either by the compute pass or
+    // uploaded from the CPU, so they are default usage with a UAV.
+    if (!create_structured_buffer(device, sizeof(uint32_t), CLUSTER_COUNT, false, true,
+                                  renderer->cluster_count_buffer.GetAddressOf(), renderer->cluster_count_srv.GetAddressOf(), renderer->cluster_count_uav.GetAddressOf()) ||
+        !create_structured_buffer(device, sizeof(uint32_t), CLUSTER_COUNT * CLUSTER_MAX_LIGHTS, false, true,
+                                  renderer->cluster_index_buffer.GetAddressOf(), renderer->cluster_index_srv.GetAddressOf(), renderer->cluster_index_uav.GetAddressOf())) {
+        LOG("%s: Couldn't create the cluster light lists", __func__);
+        return false;
+    }
+
+    // Constant buffers
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = sizeof(CBClusterConstants);
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        HRESULT hr = device->CreateBuffer(&desc, nullptr, renderer->cluster_cb_ptr.GetAddressOf());
+        if (FAILED(hr)) {
+            LOG("%s: Failed to create constant buffer for the clusters", __func__);
+            return false;
+        }
+
+        desc.ByteWidth = sizeof(CBLightCulling);
+        hr = device->CreateBuffer(&desc, nullptr, renderer->light_culling_cb_ptr.GetAddressOf());
+        if (FAILED(hr)) {
+            LOG("%s: Failed to create constant buffer for light culling", __func__);
+            return false;
+        }
+    }
+
+    // Force a grid rebuild on the first frame
+    renderer->cluster_grid.proj_x = 0.0f;
+    renderer->directional_light_count = 0;
+    renderer->local_light_count = 0;
+
+    // The compute path needs structured buffer UAVs (FL 11.0). If it's not there or
+    // the shader doesn't compile we fall back to assigning the lights on the CPU.
+    renderer->gpu_light_culling = false;
+    renderer->light_cluster_shader = id::invalid();
+    if (renderer->featureLevel >= D3D_FEATURE_LEVEL_11_0) {
+        ShaderId light_cluster_cs = shader::create_module_from_file(
+            &renderer->shader_system,
+            device,
+            L"src/shaders/light_cluster.cs.hlsl",
+            SHADER_STAGE_CS,
+            "main");
+
+        if (id::is_valid(light_cluster_cs)) {
+            ShaderId light_cluster_modules[] = {light_cluster_cs};
+            renderer->light_cluster_shader = shader::create_pipeline(
+                &renderer->shader_system,
+                device,
+                light_cluster_modules,
+                ARRAYSIZE(light_cluster_modules),
+                nullptr, 0);
+        }
+
+        renderer->gpu_light_culling = id::is_valid(renderer->light_cluster_shader);
+    }
+
+    if (!renderer->gpu_light_culling) {
+        LOG("%s: Light culling runs on the CPU", __func__);
+    }
+
+    return true;
+}
+
+bool renderer::create_occlusion_culling(Renderer *renderer) {
+    ID3D11Device *device = renderer->device.Get();
+
+    renderer->occlusion_culling = false;
+    renderer->hiz_shader = id::invalid();
+    renderer->hiz_texture = id::invalid();
+    renderer->hiz_frame_index = 0;
+    renderer->hiz_pyramid.is_valid = false;
+    renderer->occluded_meshes = 0;
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        renderer->mesh_occluded[i] = false;
+    }
+
+    // The reduction writes a texture UAV (FL 11.0). Without it everything is drawn.
+    if (renderer->featureLevel < D3D_FEATURE_LEVEL_11_0) {
+        LOG("%s: Occlusion culling needs feature level 11.0, it's off", __func__);
+        return true;
+    }
+
+    renderer->hiz_texture = texture::create(HIZ_WIDTH, HIZ_HEIGHT, DXGI_FORMAT_R32_FLOAT, D3D11_BIND_UNORDERED_ACCESS, false, nullptr, 0, 1, 1, 1, false);
+    if (id::is_invalid(renderer->hiz_texture)) {
+        LOG("%s: Couldn't create the Hi-Z texture", __func__);
+        return false;
+    }
+
+    // Staging copies the CPU maps once the GPU is done with them
+    {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = HIZ_WIDTH;
+        desc.Height = HIZ_HEIGHT;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R32_FLOAT;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+        for (uint32_t i = 0; i < HIZ_FRAME_LATENCY; ++i) {
+            HRESULT hr = device->CreateTexture2D(&desc, nullptr, renderer->hiz_readbacks[i].staging.GetAddressOf());
+            if (FAILED(hr)) {
+                LOG("%s: Failed to create a Hi-Z readback texture", __func__);
+                return false;
+            }
+            memory_tracker::track(MEMORY_TAG_RENDER_TARGETS, MEMORY_DOMAIN_GPU, texture_format::texture_bytes(desc.Format, desc.Width, desc.Height, 1, 1, 1));
+            renderer->hiz_readbacks[i].is_pending = false;
+        }
+    }
+
+    // Constant buffer
+    {
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = sizeof(CBHiZ);
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        HRESULT hr = device->CreateBuffer(&desc, nullptr, renderer->hiz_cb_ptr.GetAddressOf());
+        if (FAILED(hr)) {
+            LOG("%s: Failed to create constant buffer for the Hi-Z reduction", __func__);
+            return false;
+        }
+    }
+
+    // Forward+ depth is multisampled
+#if (RENDERING_METHOD == RENDERING_METHOD_FORWARD_PLUS)
+    const char *defines[] = {"HIZ_MSAA"};
+    uint32_t define_count = ARRAYSIZE(defines);
+#else
+    const char *const *defines = nullptr;
+    uint32_t define_count = 0;
+#endif
+    ShaderId hiz_cs = shader::create_module_from_file_with_defines(
+        &renderer->shader_system,
+        device,
+        L"src/shaders/hiz_reduce.cs.hlsl",
+        SHADER_STAGE_CS,
+        "main",
+        defines,
+        define_count);
+
+    if (id::is_valid(hiz_cs)) {
+        ShaderId hiz_modules[] = {hiz_cs};
+        renderer->hiz_shader = shader::create_pipeline(
+            &renderer->shader_system,
+            device,
+            hiz_modules,
+            ARRAYSIZE(hiz_modules),
+            nullptr, 0);
+    }
+
+    renderer->occlusion_culling = id::is_valid(renderer->hiz_shader);
+    if (!renderer->occlusion_culling) {
+        LOG("%s: Couldn't create the Hi-Z shader, occlusion culling is off", __func__);
+    }
+
+    return true;
+}
+
 void renderer::begin_frame(Renderer *renderer, Scene *scene) {
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
+
+    profiler::begin_frame(&renderer->profiler, context);
+    state_tracker::reset_stats(tracker);
+    arena::frame_begin(&renderer->frame_arena);
 
     // Clear backbuffer RTV
     float clear_color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
@@ -803,37 +1106,60 @@ void renderer::begin_frame(Renderer *renderer, Scene *scene) {
     context->Unmap(renderer->pCBPerFrame.Get(), 0);
 
     // Bind the per frame constants to both the vertex and pixel stages
-    context->VSSetConstantBuffers(0, 1, renderer->pCBPerFrame.GetAddressOf());
-    context->PSSetConstantBuffers(0, 1, renderer->pCBPerFrame.GetAddressOf());
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_VS, 0, 1, renderer->pCBPerFrame.GetAddressOf());
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_PS, 0, 1, renderer->pCBPerFrame.GetAddressOf());
     /* ------------------------------------------------------------------------------- */
 
     // Set viewport to window size
     D3D11_VIEWPORT viewport = {};
-    viewport.Width = static_cast<float>(renderer->pWindow->width);
-    viewport.Height = static_cast<float>(renderer->pWindow->height);
+    viewport.Width = static_cast<float>(renderer->width);
+    viewport.Height = static_cast<float>(renderer->height);
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    renderer->context->RSSetViewports(1, &viewport);
+    state_tracker::set_viewport(tracker, &viewport);
 
     // TEMP: Leaving this here for now, as I'm not changing this ever...?
-    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    state_tracker::set_topology(tracker, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-    // HACK: Inefficiently unbinding all SRV inputs
-    ID3D11ShaderResourceView *nullSRVs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {nullptr};
-    context->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, nullSRVs);
+    // Unbind last frame's inputs, only the slots that may still be bound are sent
+    state_tracker::unbind_srvs(tracker, SHADER_STAGE_PS);
 }
 
 void renderer::end_frame(Renderer *renderer) {
-    renderer->swapchain->Present(1, 0);
+    profiler::end_frame(&renderer->profiler, renderer->context.Get());
+    renderer->swapchain->Present(renderer->present_interval, 0);
 }
 
 void renderer::render(Renderer *renderer, Scene *scene) {
+    // Saved shaders rebuild in the background, finished ones are swapped in
+    // here so a frame never mixes two versions
+    char changed[16][FILE_WATCHER_PATH_MAX];
+    uint32_t changed_count = file_watcher::poll(&renderer->shader_watcher, changed, ARRAYSIZE(changed));
+    for (uint32_t i = 0; i < changed_count; ++i) {
+        shader::reload_changed(&renderer->shader_system, changed[i]);
+    }
+    shader::apply_reloads(&renderer->shader_system);
+
+    // Main thread jobs, assets that finished decoding are uploaded into their placeholders
+    job_system::run_main_jobs(renderer->jobs);
+
+    // New materials land in the material table before anything draws with them
+    material::update_table(renderer);
+    renderer->material_binds = 0;
+    renderer->material_switches = 0;
+
     Texture *shadow_atlas = texture::get(renderer, renderer->shadow_atlas);
     render_shadow_pass(renderer, scene, shadow_atlas);
+    render_light_culling(renderer, scene);
+    cull_occluded(renderer, scene);
+    cull_meshlets(renderer, scene);
+    build_opaque_queue(renderer, scene);
+    update_streaming(renderer, scene);
 
 #if (RENDERING_METHOD == RENDERING_METHOD_FORWARD_PLUS)
     // Forward+ rendering
     render_depth_prepass(renderer, scene);
+    render_hiz(renderer, scene, texture::get(renderer, renderer->z_depth));
     render_forward_plus_opaque(renderer, scene);
 #endif
 
@@ -849,6 +1175,7 @@ void renderer::render(Renderer *renderer, Scene *scene) {
     Texture *brdf_lut = texture::get(renderer, renderer->brdf_lut);
 
     render_gbuffer(renderer, scene, gbuffer_a, gbuffer_b, gbuffer_c, depth);
+    render_hiz(renderer, scene, depth);
     render_lighting_pass(renderer, scene, gbuffer_a, gbuffer_b, gbuffer_c, depth, irradiance_map, prefilter_map, brdf_lut, shadow_atlas, renderer->light_srv.Get(), scene_color);
 #endif
 
@@ -883,17 +1210,313 @@ void renderer::render(Renderer *renderer, Scene *scene) {
     render_post_process(renderer, pp0, swap_tex);
 }
 
+void renderer::render_light_culling(Renderer *renderer, Scene *scene) {
+    BEGIN_D3D11_EVENT(renderer, L"Light Culling");
+
+    ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
+    SceneCamera *cam = scene->active_cam;
+
+    DirectX::XMFLOAT4X4 view = scene::camera_get_view_matrix(cam);
+    DirectX::XMFLOAT4X4 projection = scene::camera_get_projection_matrix(cam);
+    DirectX::XMMATRIX view_matrix = DirectX::XMLoadFloat4x4(&view);
+
+    // The grid only depends on the projection, so it's rebuilt when that changes
+    LightClusterGrid *grid = &renderer->cluster_grid;
+    if (!light_cluster::grid_matches(grid, projection._11, projection._22, cam->base.znear, cam->base.zfar)) {
+        light_cluster::build_grid(grid, projection._11, projection._22, cam->base.znear, cam->base.zfar);
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        if (SUCCEEDED(context->Map(renderer->cluster_bounds_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+            GPUClusterBounds *bounds = (GPUClusterBounds *)mapped.pData;
+            for (uint32_t i = 0; i < CLUSTER_COUNT; ++i) {
+                bounds[i].min_radius = DirectX::XMFLOAT4(grid->min_x[i], grid->min_y[i], grid->min_z[i], grid->radius[i]);
+                bounds[i].max = DirectX::XMFLOAT4(grid->max_x[i], grid->max_y[i], grid->max_z[i], 0.0f);
+            }
+            context->Unmap(renderer->cluster_bounds_buffer.Get(), 0);
+        }
+    }
+
+    // Fill the light buffer: directional lights go first as they apply
+    // everywhere, point/spot lights after them.
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    if (FAILED(context->Map(renderer->light_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        LOG("%s: Couldn't map the light buffer", __func__);
+        END_D3D11_EVENT(renderer);
+        return;
+    }
+    CBLight *gpu_lights = (CBLight *)mapped.pData;
+
+    uint32_t light_count = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < MAX_SCENE_LIGHTS && light_count < MAX_LIGHTS; ++i) {
+            LightInstance *light_inst = &scene->lights[i];
+            if (id::is_invalid(light_inst->id) || !light_inst->enabled) continue;
+
+            Light *light = light::get(renderer, light_inst->light_id);
+            if (!light) continue;
+
+            bool is_directional = light->type == LIGHT_TYPE_DIRECTIONAL;
+            if (is_directional != (pass == 0)) continue;
+
+            CBLight *gpu_light = &gpu_lights[light_count];
+            gpu_light->direction = scene::light_get_direction(light_inst);
+            gpu_light->intensity = light->intensity;
+            gpu_light->shadow_view_start = light_inst->shadowmap_index == SHADOWMAP_INDEX_NONE ? 0 : light_inst->shadowmap_index;
+            gpu_light->shadow_view_count = light_inst->shadowmap_count;
+            gpu_light->position = light_inst->position;
+            gpu_light->range = light->range;
+            gpu_light->color = light->color;
+            gpu_light->type = (uint32_t)light->type;
+            gpu_light->spot_cos_outer = cosf(light->spot_outer_angle);
+            // Keep the smoothstep edges apart
+            gpu_light->spot_cos_inner = MAX(cosf(light->spot_inner_angle), gpu_light->spot_cos_outer + 1e-4f);
+
+            if (!is_directional) {
+                ClusterLight *cluster_light = &renderer->cluster_lights[light_count - renderer->directional_light_count];
+
+                DirectX::XMVECTOR position = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&light_inst->position), view_matrix);
+                DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(
+                    DirectX::XMVector3TransformNormal(DirectX::XMLoadFloat3(&gpu_light->direction), view_matrix));
+                DirectX::XMStoreFloat3(&cluster_light->position, position);
+                DirectX::XMStoreFloat3(&cluster_light->direction, direction);
+                cluster_light->range = light->range;
+                cluster_light->cos_outer = gpu_light->spot_cos_outer;
+                cluster_light->sin_outer = sinf(light->spot_outer_angle);
+                cluster_light->type = light->type == LIGHT_TYPE_SPOT ? CLUSTER_LIGHT_SPOT : CLUSTER_LIGHT_POINT;
+                cluster_light->light_index = light_count;
+            }
+
+            light_count++;
+        }
+
+        if (pass == 0) {
+            renderer->directional_light_count = light_count;
+        }
+    }
+    renderer->local_light_count = light_count - renderer->directional_light_count;
+
+    context->Unmap(renderer->light_buffer.Get(), 0);
+
+    // Constants for the shading passes
+    if (SUCCEEDED(context->Map(renderer->cluster_cb_ptr.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        CBClusterConstants *constants = (CBClusterConstants *)mapped.pData;
+        constants->grid_size[0] = CLUSTER_GRID_X;
+        constants->grid_size[1] = CLUSTER_GRID_Y;
+        constants->grid_size[2] = CLUSTER_GRID_Z;
+        constants->directional_light_count = renderer->directional_light_count;
+        constants->screen_size[0] = (float)renderer->width;
+        constants->screen_size[1] = (float)renderer->height;
+        constants->z_scale = grid->z_scale;
+        constants->z_bias = grid->z_bias;
+        context->Unmap(renderer->cluster_cb_ptr.Get(), 0);
+    }
+
+    if (renderer->gpu_light_culling) {
+        // Upload the view space lights
+        if (SUCCEEDED(context->Map(renderer->cluster_light_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+            memcpy(mapped.pData, renderer->cluster_lights, sizeof(ClusterLight) * renderer->local_light_count);
+            context->Unmap(renderer->cluster_light_buffer.Get(), 0);
+        }
+
+        if (SUCCEEDED(context->Map(renderer->light_culling_cb_ptr.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+            CBLightCulling *constants = (CBLightCulling *)mapped.pData;
+            constants->light_count = renderer->local_light_count;
+            constants->cluster_count = CLUSTER_COUNT;
+            context->Unmap(renderer->light_culling_cb_ptr.Get(), 0);
+        }
+
+        ShaderPipeline *light_cluster_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->light_cluster_shader);
+        shader::bind_pipeline(&renderer->shader_system, context, light_cluster_pipeline);
+
+        ID3D11ShaderResourceView *srvs[] = {renderer->cluster_bounds_srv.Get(), renderer->cluster_light_srv.Get()};
+        ID3D11UnorderedAccessView *uavs[] = {renderer->cluster_count_uav.Get(), renderer->cluster_index_uav.Get()};
+        state_tracker::set_srvs(tracker, SHADER_STAGE_CS, 0, ARRAYSIZE(srvs), srvs);
+        state_tracker::set_cs_uavs(tracker, 0, ARRAYSIZE(uavs), uavs);
+        state_tracker::set_constant_buffers(tracker, SHADER_STAGE_CS, 0, 1, renderer->light_culling_cb_ptr.GetAddressOf());
+
+        // One group per cluster
+        state_tracker::dispatch(tracker, CLUSTER_COUNT, 1, 1);
+
+        ID3D11ShaderResourceView *nullSRVs[ARRAYSIZE(srvs)] = {nullptr};
+        ID3D11UnorderedAccessView *nullUAVs[ARRAYSIZE(uavs)] = {nullptr};
+        state_tracker::set_srvs(tracker, SHADER_STAGE_CS, 0, ARRAYSIZE(nullSRVs), nullSRVs);
+        state_tracker::set_cs_uavs(tracker, 0, ARRAYSIZE(nullUAVs), nullUAVs);
+    } else {
+        LightClusterList *list = &renderer->cluster_list;
+        light_cluster::assign_simd(grid, renderer->cluster_lights, renderer->local_light_count, list);
+
+        context->UpdateSubresource(renderer->cluster_count_buffer.Get(), 0, nullptr, list->counts, 0, 0);
+        context->UpdateSubresource(renderer->cluster_index_buffer.Get(), 0, nullptr, list->indices, 0, 0);
+    }
+
+    END_D3D11_EVENT(renderer);
+}
+
+void renderer::cull_occluded(Renderer *renderer, Scene *scene) {
+    ID3D11DeviceContext *context = renderer->context.Get();
+
+    renderer->occluded_meshes = 0;
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        renderer->mesh_occluded[i] = false;
+    }
+
+    // Turned off, the pyramid would be stale when it's turned back on
+    if (!renderer->occlusion_culling) {
+        renderer->hiz_pyramid.is_valid = false;
+        return;
+    }
+
+    // Oldest readback first, once one isn't ready the newer ones aren't either.
+    // The newest one that's ready ends up in the pyramid.
+    for (uint32_t i = 0; i < HIZ_FRAME_LATENCY; ++i) {
+        HiZReadback *readback = &renderer->hiz_readbacks[(renderer->hiz_frame_index + i) % HIZ_FRAME_LATENCY];
+        if (!readback->is_pending) {
+            continue;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped = {};
+        if (FAILED(context->Map(readback->staging.Get(), 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped))) {
+            break;
+        }
+        occlusion::build(&renderer->hiz_pyramid, (const float *)mapped.pData, mapped.RowPitch, &readback->view_projection);
+        context->Unmap(readback->staging.Get(), 0);
+        readback->is_pending = false;
+    }
+
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        SceneMesh *mesh = &scene->meshes[i];
+        if (id::is_invalid(mesh->id))
+            continue;
+
+        DirectX::XMFLOAT3 center;
+        float radius;
+        if (!scene::mesh_get_world_bounds(scene, mesh->id, &center, &radius)) {
+            continue;
+        }
+
+        if (occlusion::is_occluded(&renderer->hiz_pyramid, center, radius)) {
+            renderer->mesh_occluded[i] = true;
+            renderer->occluded_meshes++;
+        }
+    }
+}
+
+void renderer::cull_meshlets(Renderer *renderer, Scene *scene) {
+    SceneCamera *cam = scene->active_cam;
+    DirectX::XMFLOAT4X4 view_projection = scene::camera_get_view_projection_matrix(cam);
+    uint32_t visible[MESHLET_MAX_PER_MESH / 32];
+
+    renderer->meshlets_total = 0;
+    renderer->meshlets_visible = 0;
+    uint32_t draw_total = 0;
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        renderer->meshlet_draw_count[i] = MESHLET_DRAW_WHOLE;
+
+        // Hidden behind a past frame's depth, nothing to draw
+        if (renderer->mesh_occluded[i]) {
+            renderer->meshlet_draw_count[i] = 0;
+            continue;
+        }
+
+        SceneMesh *mesh = &scene->meshes[i];
+        if (id::is_invalid(mesh->id))
+            continue;
+
+        Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
+        if (!gpu_mesh) {
+            continue;
+        }
+
+        const MeshletSet *set = &gpu_mesh->meshlets;
+        if (!renderer->meshlet_culling || set->count == 0 || set->count > MESHLET_MAX_PER_MESH) {
+            continue;
+        }
+
+        // At most every other meshlet starts a draw, without room for that the mesh goes whole
+        if (draw_total + (set->count + 1) / 2 > MAX_MESHLET_DRAWS) {
+            continue;
+        }
+
+        DirectX::XMFLOAT4X4 world = scene::mesh_get_world_matrix(scene, mesh->id);
+        MeshletCullView view = meshlet::make_view(&world, &view_projection, cam->position);
+        renderer->meshlets_total += set->count;
+        renderer->meshlets_visible += meshlet::cull_simd(set, &view, visible);
+
+        renderer->meshlet_draw_start[i] = draw_total;
+        renderer->meshlet_draw_count[i] = meshlet::build_draws(set, visible, &renderer->meshlet_draws[draw_total]);
+        draw_total += renderer->meshlet_draw_count[i];
+    }
+}
+
+void renderer::render_hiz(Renderer *renderer, Scene *scene, Texture *depth) {
+    if (!renderer->occlusion_culling) {
+        return;
+    }
+
+    BEGIN_D3D11_EVENT(renderer, L"Hi-Z Reduction");
+
+    ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
+    Texture *hiz = texture::get(renderer, renderer->hiz_texture);
+
+    // The depth is read as an SRV, it can't stay bound as the depth target
+    state_tracker::set_render_targets(tracker, 0, nullptr, nullptr);
+
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    if (FAILED(context->Map(renderer->hiz_cb_ptr.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        LOG("%s: Couldn't map the Hi-Z constants", __func__);
+        END_D3D11_EVENT(renderer);
+        return;
+    }
+    CBHiZ *constants = (CBHiZ *)mapped.pData;
+    constants->source_size[0] = (uint32_t)depth->width;
+    constants->source_size[1] = (uint32_t)depth->height;
+    constants->target_size[0] = HIZ_WIDTH;
+    constants->target_size[1] = HIZ_HEIGHT;
+    constants->sample_count = depth->msaa_samples;
+    context->Unmap(renderer->hiz_cb_ptr.Get(), 0);
+
+    ShaderPipeline *hiz_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->hiz_shader);
+    shader::bind_pipeline(&renderer->shader_system, context, hiz_pipeline);
+
+    ID3D11ShaderResourceView *srvs[] = {depth->srv.Get()};
+    ID3D11UnorderedAccessView *uavs[] = {hiz->uav[0].Get()};
+    state_tracker::set_srvs(tracker, SHADER_STAGE_CS, 0, ARRAYSIZE(srvs), srvs);
+    state_tracker::set_cs_uavs(tracker, 0, ARRAYSIZE(uavs), uavs);
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_CS, 0, 1, renderer->hiz_cb_ptr.GetAddressOf());
+
+    // One thread per Hi-Z texel
+    state_tracker::dispatch(tracker, (HIZ_WIDTH + 7) / 8, (HIZ_HEIGHT + 7) / 8, 1);
+
+    ID3D11ShaderResourceView *nullSRVs[ARRAYSIZE(srvs)] = {nullptr};
+    ID3D11UnorderedAccessView *nullUAVs[ARRAYSIZE(uavs)] = {nullptr};
+    state_tracker::set_srvs(tracker, SHADER_STAGE_CS, 0, ARRAYSIZE(nullSRVs), nullSRVs);
+    state_tracker::set_cs_uavs(tracker, 0, ARRAYSIZE(nullUAVs), nullUAVs);
+
+    // Copied out now, mapped by cull_occluded once the GPU got there. When all
+    // the copies are still in flight the oldest one gets overwritten.
+    HiZReadback *readback = &renderer->hiz_readbacks[renderer->hiz_frame_index];
+    context->CopyResource(readback->staging.Get(), hiz->texture.Get());
+    readback->view_projection = scene::camera_get_view_projection_matrix(scene->active_cam);
+    readback->is_pending = true;
+    renderer->hiz_frame_index = (renderer->hiz_frame_index + 1) % HIZ_FRAME_LATENCY;
+
+    END_D3D11_EVENT(renderer);
+}
+
 void renderer::render_gbuffer(Renderer *renderer, Scene *scene,
                               Texture *rt0, Texture *rt1, Texture *rt2, Texture *depth) {
     BEGIN_D3D11_EVENT(renderer, L"G-buffer Pass (Deferred)");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     const float clear_color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
     // Bind pipeline states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_DEFAULT].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_DEFAULT), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Bind the the render targets and depth and clear them
     ID3D11RenderTargetView *rtvs[] = {rt0->rtv[0].Get(), rt1->rtv[0].Get(), rt2->rtv[0].Get()};
@@ -901,14 +1524,16 @@ void renderer::render_gbuffer(Renderer *renderer, Scene *scene,
     context->ClearRenderTargetView(rtvs[1], clear_color);
     context->ClearRenderTargetView(rtvs[2], clear_color);
     context->ClearDepthStencilView(depth->dsv.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-    context->OMSetRenderTargets(ARRAYSIZE(rtvs), rtvs, depth->dsv.Get());
+    state_tracker::set_render_targets(tracker, ARRAYSIZE(rtvs), rtvs, depth->dsv.Get());
 
-    // Bind the shader
-    ShaderPipeline *gbuffer_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->gbuffer_pipeline);
-    shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), gbuffer_pipeline);
+    // The shader is picked per material below
+    ShaderPipeline *bound_pipeline = nullptr;
 
     // Bind the samplers
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+
+    // Every material at once, draws pick theirs through the per object buffer
+    material::bind_table(renderer);
 
     // Set up the viewport
     D3D11_VIEWPORT vp = {};
@@ -916,50 +1541,46 @@ void renderer::render_gbuffer(Renderer *renderer, Scene *scene,
     vp.Height = static_cast<float>(rt0->height);
     vp.MinDepth = 0.0f;
     vp.MaxDepth = 1.0f;
-    context->RSSetViewports(1, &vp);
+    state_tracker::set_viewport(tracker, &vp);
+
+    // Every mesh is in the same buffers, bound once for the pass
+    mesh::bind_geometry(renderer);
 
     // Render meshes
+    // Already culled and sorted, see build_opaque_queue
     MaterialId current_material_bound = id::invalid();
-    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+    for (uint32_t q = 0; q < renderer->opaque_count; ++q) {
+        const DrawItem *item = &renderer->opaque_queue[q];
+        int i = item->scene_mesh;
         SceneMesh *mesh = &scene->meshes[i];
+        Material *mat = &renderer->materials[item->material];
 
-        if (id::is_invalid(mesh->id))
-            continue;
+        // Used to be a constant buffer update and six textures
+        if (mat->id.id != current_material_bound.id) {
+            renderer->material_switches++;
+            current_material_bound = mat->id;
 
-        // If the material id is different from the currently bound
-        // bind the new one.
-        if (mesh->material_id.id != current_material_bound.id) {
-            // Get the material
-            Material *mat = material::get(renderer, mesh->material_id);
-            if (!mat) {
-                LOG("%s: Warning! Material couldn't be fetched", __func__);
-                continue;
+            // Only the maps the material has are sampled
+            ShaderPipeline *pipeline = shader::get_permutation_pipeline(&renderer->shader_system, renderer->device.Get(), &renderer->opaque_permutations, mat->features);
+            if (pipeline != bound_pipeline) {
+                shader::bind_pipeline(&renderer->shader_system, context, pipeline);
+                bound_pipeline = pipeline;
             }
-
-            // Bind the material's values and textures
-            material::bind(renderer, mat, 1, 0);
-
-            // Update the currently bound material
-            current_material_bound = mat->id;
         }
 
-        // Lookup the mesh gpu resource through the mesh_id
         Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
-        if (!gpu_mesh) {
-            continue;
-        }
 
         // Bind mesh instance
         scene::bind_mesh_instance(renderer, scene, mesh->id, 1);
 
-        // Draw the mesh
-        mesh::draw(renderer->context.Get(), gpu_mesh);
+        // Draw what's left after meshlet culling
+        draw_scene_mesh(renderer, i, gpu_mesh);
     }
 
     // Unbind RTV's as the output of the Gbuffer will definitely
     // be used as shader resources
     ID3D11RenderTargetView *nullRTVs[ARRAYSIZE(rtvs)] = {nullptr};
-    renderer->context->OMSetRenderTargets(_countof(nullRTVs), nullRTVs, nullptr);
+    state_tracker::set_render_targets(tracker, _countof(nullRTVs), nullRTVs, nullptr);
 
     END_D3D11_EVENT(renderer);
 }
@@ -970,43 +1591,26 @@ void renderer::render_lighting_pass(Renderer *renderer, Scene *scene, Texture *g
     BEGIN_D3D11_EVENT(renderer, L"Lighting Pass (Deferred)");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     const float clear_color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
     // Bind pipeline states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_NONE].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_NONE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_NONE), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_NONE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Clear and Bind the RTV
     context->ClearRenderTargetView(rt->rtv[0].Get(), clear_color);
-    context->OMSetRenderTargets(1, rt->rtv[0].GetAddressOf(), nullptr);
+    state_tracker::set_render_targets(tracker, 1, rt->rtv[0].GetAddressOf(), nullptr);
 
     // Bind the shader pipeline
     ShaderPipeline *lighting_pass_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->lighting_pass_pipeline);
     shader::bind_pipeline(&renderer->shader_system, context, lighting_pass_pipeline);
 
     // Bind the samplers
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
-    // Update the lights buffer
-    D3D11_MAPPED_SUBRESOURCE mapped = {};
-    context->Map(renderer->light_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-
-    CBLight *gpu_lights = reinterpret_cast<CBLight *>(mapped.pData);
-    for (int i = 0; i < MAX_SCENE_LIGHTS; ++i) {
-        LightInstance *light_inst = &scene->lights[i];
-        if (id::is_invalid(light_inst->id)) continue;
-
-        Light *light = light::get(renderer, light_inst->light_id);
-        if (!light) continue;
-
-        gpu_lights[i].direction = scene::light_get_direction(light_inst);
-        gpu_lights[i].intensity = light->intensity;
-        gpu_lights[i].view_projection_matrix = scene::light_get_view_projection_matrix(scene, light_inst->id);
-        gpu_lights[i].uv_rect = DirectX::XMFLOAT4(0, 0, 1, 1);
-    }
-
-    context->Unmap(renderer->light_buffer.Get(), 0);
+    UNUSED(scene);
 
     // Bind the SRV's including the gbuffer outputs and the IBL textures
     ID3D11ShaderResourceView *srvs[] = {
@@ -1017,16 +1621,26 @@ void renderer::render_lighting_pass(Renderer *renderer, Scene *scene, Texture *g
         irradiance_map->srv.Get(),
         prefilter_map->srv.Get(),
         brdf_lut->srv.Get(),
+    };
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, ARRAYSIZE(srvs), srvs);
+
+    // Shadows, lights, the cluster lists and the shadow views (see lighting.hlsli)
+    ID3D11ShaderResourceView *light_srvs[] = {
         shadow_atlas->srv.Get(),
         lights,
+        renderer->cluster_count_srv.Get(),
+        renderer->cluster_index_srv.Get(),
+        renderer->shadow_view_srv.Get(),
     };
-    context->PSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 11, ARRAYSIZE(light_srvs), light_srvs);
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_PS, 4, 1, renderer->cluster_cb_ptr.GetAddressOf());
 
-    context->Draw(3, 0);
+    state_tracker::draw(tracker, 3, 0);
 
     // Unbind SRVs
-    ID3D11ShaderResourceView *nullSRVs[1] = {nullptr};
-    context->PSSetShaderResources(0, 1, nullSRVs);
+    ID3D11ShaderResourceView *nullSRVs[ARRAYSIZE(light_srvs)] = {nullptr};
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, nullSRVs);
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 11, ARRAYSIZE(nullSRVs), nullSRVs);
 
     END_D3D11_EVENT(renderer);
 }
@@ -1035,12 +1649,13 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
     BEGIN_D3D11_EVENT(renderer, L"Bloom Pass");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     float clear_color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
     // Bind the states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_NONE].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_NONE), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Set up constant buffer for bloom
     BloomConstants bloom_constants = {};
@@ -1053,10 +1668,10 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
     context->Map(renderer->bloom_cb_ptr.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
     memcpy(mapped.pData, &bloom_constants, sizeof(BloomConstants));
     context->Unmap(renderer->bloom_cb_ptr.Get(), 0);
-    context->PSSetConstantBuffers(1, 1, renderer->bloom_cb_ptr.GetAddressOf());
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_PS, 1, 1, renderer->bloom_cb_ptr.GetAddressOf());
 
     // Bind sampler state
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
     D3D11_VIEWPORT viewport = {};
 
@@ -1064,7 +1679,7 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
     {
         // Bind the render target and clear it
         context->ClearRenderTargetView(bloom_mips[0]->rtv[0].Get(), clear_color);
-        context->OMSetRenderTargets(1, bloom_mips[0]->rtv[0].GetAddressOf(), nullptr);
+        state_tracker::set_render_targets(tracker, 1, bloom_mips[0]->rtv[0].GetAddressOf(), nullptr);
 
         // Bind shader pipeline for threshold
         ShaderPipeline *threshold_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->bloom_threshold_shader);
@@ -1075,12 +1690,12 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
         viewport.Height = (float)bloom_mips[0]->height;
         viewport.MinDepth = 0.0f;
         viewport.MaxDepth = 1.0f;
-        context->RSSetViewports(1, &viewport);
+        state_tracker::set_viewport(tracker, &viewport);
 
         // Bind the scene color buffer as the starting point
-        context->PSSetShaderResources(0, 1, color_buffer->srv.GetAddressOf());
+        state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, color_buffer->srv.GetAddressOf());
 
-        context->Draw(3, 0);
+        state_tracker::draw(tracker, 3, 0);
     }
 
     // --- Downsample chain ---
@@ -1101,24 +1716,24 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
 
             // Update the bound render target and clear it
             context->ClearRenderTargetView(current_mip->rtv[0].Get(), clear_color);
-            context->OMSetRenderTargets(1, current_mip->rtv[0].GetAddressOf(), nullptr);
+            state_tracker::set_render_targets(tracker, 1, current_mip->rtv[0].GetAddressOf(), nullptr);
 
             // Update the viewport to the new size
             viewport.Width = (float)current_mip->width;
             viewport.Height = (float)current_mip->height;
-            context->RSSetViewports(1, &viewport);
+            state_tracker::set_viewport(tracker, &viewport);
 
             // Bind the previous mip as the input
-            context->PSSetShaderResources(0, 1, bloom_mips[i - 1]->srv.GetAddressOf());
+            state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, bloom_mips[i - 1]->srv.GetAddressOf());
 
-            context->Draw(3, 0);
+            state_tracker::draw(tracker, 3, 0);
         }
     }
 
     // --- Upsample chain ---
     {
         // Switch to additive blending here for the upsample chain
-        context->OMSetBlendState(renderer->blend_states[BLEND_ADDITIVE].Get(), nullptr, 0xFFFFFFFF);
+        state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_ADDITIVE), nullptr, 0xFFFFFFFF);
 
         // Bind the appropriate shader pipeline for the upsample
         ShaderPipeline *upsample_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->bloom_upsample_shader);
@@ -1129,7 +1744,7 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
 
             // Unbind the current mip from input
             ID3D11ShaderResourceView *nullSRVs[1] = {nullptr};
-            context->PSSetShaderResources(0, 1, nullSRVs);
+            state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, nullSRVs);
 
             // Update texel size for the current target mip
             bloom_constants.texel_size[0] = 1.0f / current_mip->width;
@@ -1146,18 +1761,18 @@ void renderer::render_bloom_pass(Renderer *renderer, Texture *color_buffer, Text
             context->Unmap(renderer->bloom_cb_ptr.Get(), 0);
 
             // Update the bound render target and DON'T clear it, so it can blend additively
-            context->OMSetRenderTargets(1, current_mip->rtv[0].GetAddressOf(), nullptr);
+            state_tracker::set_render_targets(tracker, 1, current_mip->rtv[0].GetAddressOf(), nullptr);
 
             // Update the viewport to the new size
             viewport.Width = (float)current_mip->width;
             viewport.Height = (float)current_mip->height;
-            context->RSSetViewports(1, &viewport);
+            state_tracker::set_viewport(tracker, &viewport);
 
             // Bind the previous mip as the input
-            context->PSSetShaderResources(0, 1, bloom_mips[i + 1]->srv.GetAddressOf());
+            state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, bloom_mips[i + 1]->srv.GetAddressOf());
 
             SET_D3D11_MARKER(renderer, L"Upsample Draw Call");
-            context->Draw(3, 0);
+            state_tracker::draw(tracker, 3, 0);
         }
     }
 
@@ -1169,6 +1784,7 @@ void renderer::render_fxaa_pass(Renderer *renderer) {
 
     // For convenience but could be useful to bypass some dereferencing as well
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     ID3D11ShaderResourceView *scene_srv = renderer->textures[renderer->scene_color.id].srv.Get();
 
     Texture *fxaa_texture = &renderer->textures[renderer->fxaa_color.id];
@@ -1183,50 +1799,51 @@ void renderer::render_fxaa_pass(Renderer *renderer) {
     context->Unmap(renderer->fxaa_cb_ptr.Get(), 0);
 
     context->ClearRenderTargetView(fxaa_texture->rtv[0].Get(), clear_color);
-    context->OMSetRenderTargets(1, fxaa_texture->rtv[0].GetAddressOf(), nullptr);
+    state_tracker::set_render_targets(tracker, 1, fxaa_texture->rtv[0].GetAddressOf(), nullptr);
 
     ShaderPipeline *fxaa_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->fxaa_shader);
     shader::bind_pipeline(&renderer->shader_system, context, fxaa_pipeline);
 
     // Unbind the depth stencil state
-    renderer->context->OMSetDepthStencilState(nullptr, 0);
+    state_tracker::set_depth_stencil_state(tracker, nullptr, 0);
 
     ID3D11ShaderResourceView *srvs[] = {scene_srv};
-    renderer->context->PSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, ARRAYSIZE(srvs), srvs);
 
-    context->PSSetConstantBuffers(1, 1, renderer->fxaa_cb_ptr.GetAddressOf());
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_PS, 1, 1, renderer->fxaa_cb_ptr.GetAddressOf());
 
     D3D11_VIEWPORT viewport = {};
     viewport.Width = (float)fxaa_texture->width;
     viewport.Height = (float)fxaa_texture->height;
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    context->RSSetViewports(1, &viewport);
+    state_tracker::set_viewport(tracker, &viewport);
 
-    context->Draw(3, 0);
+    state_tracker::draw(tracker, 3, 0);
 }
 
 void renderer::render_tonemap_pass(Renderer *renderer, Texture *scene_color, Texture *bloom_texture, Texture *out_rt) {
     BEGIN_D3D11_EVENT(renderer, L"Tonemap Pass");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     float clear_color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 
     // Bind the states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_NONE].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_NONE), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Clear and bind the the render target, no depth
     context->ClearRenderTargetView(out_rt->rtv[0].Get(), clear_color);
-    context->OMSetRenderTargets(1, out_rt->rtv[0].GetAddressOf(), nullptr);
+    state_tracker::set_render_targets(tracker, 1, out_rt->rtv[0].GetAddressOf(), nullptr);
 
     // Bind the shader for the tonemap pass
     ShaderPipeline *tonemap_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->tonemap_shader);
     shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), tonemap_pipeline);
 
     // Bind the sampler state
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
     // Set the viewport
     D3D11_VIEWPORT viewport = {};
@@ -1234,17 +1851,17 @@ void renderer::render_tonemap_pass(Renderer *renderer, Texture *scene_color, Tex
     viewport.Height = (float)out_rt->height;
     viewport.MinDepth = 0.0f;
     viewport.MaxDepth = 1.0f;
-    renderer->context->RSSetViewports(1, &viewport);
+    state_tracker::set_viewport(tracker, &viewport);
 
     // Bind the SRV's for the scene buffer and the bloom pass output
     ID3D11ShaderResourceView *srvs[] = {
         scene_color->srv.Get(),
         bloom_texture->srv.Get(),
     };
-    context->PSSetShaderResources(0, ARRAYSIZE(srvs), srvs);
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, ARRAYSIZE(srvs), srvs);
 
     // Draw the triangle
-    context->Draw(3, 0);
+    state_tracker::draw(tracker, 3, 0);
 
     END_D3D11_EVENT(renderer)
 }
@@ -1253,33 +1870,34 @@ void renderer::render_skybox(Renderer *renderer, Texture *skybox, Texture *depth
     BEGIN_D3D11_EVENT(renderer, L"Skybox");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
 
     // Bind the states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_LESS_EQUAL_NO_WRITE].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_FRONTFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_LESS_EQUAL_NO_WRITE), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_FRONTFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Unbind previous SRVs
     // TODO: This slot 3 is hardcoded but if I change the location of the depth in the lighting pass
     // this won't be correct anymore...
     ID3D11ShaderResourceView *null_srv = nullptr;
-    context->PSSetShaderResources(3, 1, &null_srv);
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 3, 1, &null_srv);
 
     // Bind the render target and depth without clearing
-    context->OMSetRenderTargets(1, rt->rtv[0].GetAddressOf(), depth->dsv.Get());
+    state_tracker::set_render_targets(tracker, 1, rt->rtv[0].GetAddressOf(), depth->dsv.Get());
 
     // Bind the skybox shader
     ShaderPipeline *skybox_shader = shader::get_pipeline(&renderer->shader_system, renderer->skybox_shader);
     shader::bind_pipeline(&renderer->shader_system, context, skybox_shader);
 
     // Bind the samplers
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
     // Bind the environment map as a texture
-    context->PSSetShaderResources(0, 1, skybox->srv.GetAddressOf());
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, skybox->srv.GetAddressOf());
 
     // Draw cube hardcoded into vertex shader
-    context->Draw(36, 0);
+    state_tracker::draw(tracker, 36, 0);
 
     END_D3D11_EVENT(renderer)
 }
@@ -1288,39 +1906,35 @@ void renderer::render_depth_prepass(Renderer *renderer, Scene *scene) {
     BEGIN_D3D11_EVENT(renderer, L"Depth Prepass (Forward+)");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
 
     // Bind the states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_DEFAULT].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_DISABLE_WRITE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_DEFAULT), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_DISABLE_WRITE), nullptr, 0xFFFFFFFF);
 
     // Bind and clear the depth buffer (no color for this one)
     Texture *depth = texture::get(renderer, renderer->z_depth);
-    renderer->context->OMSetRenderTargets(0, nullptr, depth->dsv.Get());
-    renderer->context->ClearDepthStencilView(depth->dsv.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+    state_tracker::set_render_targets(tracker, 0, nullptr, depth->dsv.Get());
+    context->ClearDepthStencilView(depth->dsv.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
     // Bind the shader pipeline
     ShaderPipeline *zpass_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->zpass_pipeline);
-    shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), zpass_pipeline);
+    shader::bind_pipeline(&renderer->shader_system, context, zpass_pipeline);
 
-    // Render meshes
-    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
-        SceneMesh *mesh = &scene->meshes[i];
+    mesh::bind_geometry(renderer);
 
-        if (id::is_invalid(mesh->id))
-            continue;
-
-        // Lookup the mesh gpu resource through the mesh_id
+    // The same draws as the opaque pass, so the depth matches it exactly
+    for (uint32_t q = 0; q < renderer->opaque_count; ++q) {
+        int i = renderer->opaque_queue[q].scene_mesh;
+        SceneMesh *mesh = &scene->meshes[i];
         Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
-        if (!gpu_mesh) {
-            continue;
-        }
 
         // Bind mesh instance
         scene::bind_mesh_instance(renderer, scene, mesh->id, 1);
 
-        // Draw the mesh
-        mesh::draw(renderer->context.Get(), gpu_mesh);
+        // Draw what's left after meshlet culling
+        draw_scene_mesh(renderer, i, gpu_mesh);
     }
 
     END_D3D11_EVENT(renderer)
@@ -1330,26 +1944,26 @@ void renderer::render_forward_plus_opaque(Renderer *renderer, Scene *scene) {
     BEGIN_D3D11_EVENT(renderer, L"Opaque Pass (Forward+)");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
 
     // Bind pipeline states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_READ_ONLY].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_READ_ONLY), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Bind the the render target and depth
     // also clear the color only
     Texture *scene_rt = texture::get(renderer, renderer->scene_color);
     Texture *depth = texture::get(renderer, renderer->z_depth);
     float clear_color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
-    context->OMSetRenderTargets(1, scene_rt->rtv[0].GetAddressOf(), depth->dsv.Get());
+    state_tracker::set_render_targets(tracker, 1, scene_rt->rtv[0].GetAddressOf(), depth->dsv.Get());
     context->ClearRenderTargetView(scene_rt->rtv[0].Get(), clear_color);
 
-    // Bind the shader
-    ShaderPipeline *fp_opaque_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->fp_opaque_pipeline);
-    shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), fp_opaque_pipeline);
+    // The shader is picked per material below
+    ShaderPipeline *bound_pipeline = nullptr;
 
     // Bind the samplers
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
     // Fetch the environment map textures and bind them
     Texture *irradiance_tex = texture::get(renderer, renderer->irradiance_cubemap);
@@ -1357,46 +1971,61 @@ void renderer::render_forward_plus_opaque(Renderer *renderer, Scene *scene) {
     Texture *brdf_lut_tex = texture::get(renderer, renderer->brdf_lut);
     ID3D11ShaderResourceView *env_srvs[] = {irradiance_tex->srv.Get(), prefilter_tex->srv.Get(), brdf_lut_tex->srv.Get()};
     if (prefilter_tex && irradiance_tex && brdf_lut_tex) {
-        renderer->context->PSSetShaderResources(0, ARRAYSIZE(env_srvs), env_srvs);
+        state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, ARRAYSIZE(env_srvs), env_srvs);
     }
 
+    // Shadows, lights, the cluster lists and the shadow views (see lighting.hlsli)
+    Texture *shadow_atlas = texture::get(renderer, renderer->shadow_atlas);
+    ID3D11ShaderResourceView *light_srvs[] = {
+        shadow_atlas->srv.Get(),
+        renderer->light_srv.Get(),
+        renderer->cluster_count_srv.Get(),
+        renderer->cluster_index_srv.Get(),
+        renderer->shadow_view_srv.Get(),
+    };
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 11, ARRAYSIZE(light_srvs), light_srvs);
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_PS, 4, 1, renderer->cluster_cb_ptr.GetAddressOf());
+
+    // Every material at once, draws pick theirs through the per object buffer
+    material::bind_table(renderer);
+
+    mesh::bind_geometry(renderer);
+
     // Loop through our meshes from our selected scene
+    // Already culled and sorted, see build_opaque_queue
     MaterialId current_material_bound = id::invalid();
-    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+    for (uint32_t q = 0; q < renderer->opaque_count; ++q) {
+        const DrawItem *item = &renderer->opaque_queue[q];
+        int i = item->scene_mesh;
         SceneMesh *mesh = &scene->meshes[i];
-        if (id::is_invalid(mesh->id))
-            continue;
-
-        // If the material id is different from the currently bound
-        // bind the new one.
-        if (mesh->material_id.id != current_material_bound.id) {
-            // Get the material
-            Material *mat = material::get(renderer, mesh->material_id);
-            if (!mat) {
-                LOG("%s: Warning! Material couldn't be fetched", __func__);
-                continue;
-            }
-
-            // Bind the material's values and textures
-            material::bind(renderer, mat, 1, ARRAYSIZE(env_srvs));
+        Material *mat = &renderer->materials[item->material];
 
-            // Update the currently bound material
+        // Used to be a constant buffer update and six textures
+        if (mat->id.id != current_material_bound.id) {
+            renderer->material_switches++;
             current_material_bound = mat->id;
+
+            // Only the maps the material has are sampled
+            ShaderPipeline *pipeline = shader::get_permutation_pipeline(&renderer->shader_system, renderer->device.Get(), &renderer->opaque_permutations, mat->features);
+            if (pipeline != bound_pipeline) {
+                shader::bind_pipeline(&renderer->shader_system, context, pipeline);
+                bound_pipeline = pipeline;
+            }
         }
 
-        // Lookup the mesh gpu resource through the mesh_id
         Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
-        if (!gpu_mesh) {
-            continue;
-        }
 
         // Bind mesh instance
         scene::bind_mesh_instance(renderer, scene, mesh->id, 1);
 
-        // Draw the mesh
-        mesh::draw(renderer->context.Get(), gpu_mesh);
+        // Draw what's left after meshlet culling
+        draw_scene_mesh(renderer, i, gpu_mesh);
     }
 
+    // The shadow atlas is a depth target again next frame
+    ID3D11ShaderResourceView *nullSRVs[ARRAYSIZE(light_srvs)] = {nullptr};
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 11, ARRAYSIZE(nullSRVs), nullSRVs);
+
     END_D3D11_EVENT(renderer);
 }
 
@@ -1404,35 +2033,36 @@ void renderer::render_post_process(Renderer *renderer, Texture *in_tex, Texture
     BEGIN_D3D11_EVENT(renderer, L"Post Pass");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
     float clear_color[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 
     // Bind pipeline states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_NONE].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_OPAQUE].Get(), nullptr, 0xFFFFFFFF);
+    state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_NONE), 0);
+    state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_OPAQUE), nullptr, 0xFFFFFFFF);
 
     // Clear and bind the the render target, no depth
     context->ClearRenderTargetView(out_tex->rtv[0].Get(), clear_color);
-    context->OMSetRenderTargets(1, out_tex->rtv[0].GetAddressOf(), nullptr);
+    state_tracker::set_render_targets(tracker, 1, out_tex->rtv[0].GetAddressOf(), nullptr);
 
     // Bind shader pipeline
     ShaderPipeline *post_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->post_shader);
     shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), post_pipeline);
 
     // Bind the samplers
-    context->PSSetSamplers(0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
+    state_tracker::set_samplers(tracker, SHADER_STAGE_PS, 0, 1, renderer->sampler_states[SAMPLER_LINEAR_CLAMP].GetAddressOf());
 
     // Bind the the input map as a texture
-    context->PSSetShaderResources(0, 1, in_tex->srv.GetAddressOf());
+    state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, in_tex->srv.GetAddressOf());
 
     // Draw the triangle
-    context->Draw(3, 0);
+    state_tracker::draw(tracker, 3, 0);
 
     END_D3D11_EVENT(renderer);
 }
 
 void renderer::bind_render_target(Renderer *renderer, ID3D11RenderTargetView *rtv, ID3D11DepthStencilView *dsv) {
-    renderer->context->OMSetRenderTargets(1, &rtv, dsv);
+    state_tracker::set_render_targets(&renderer->state_tracker, 1, &rtv, dsv);
 }
 
 void renderer::clear_render_target(Renderer *renderer, ID3D11RenderTargetView *rtv, ID3D11DepthStencilView *dsv, float *clear_color) {
@@ -1829,6 +2459,8 @@ void renderer::on_window_resize(Renderer *renderer, uint16_t width, uint16_t hei
 
     // Resize the backbuffer/swapchain
     texture::resize_swapchain(renderer->swapchain_texture, renderer->device.Get(), renderer->context.Get(), renderer->swapchain.Get(), width, height);
+    // That unbinds the targets on the context directly
+    state_tracker::reset(&renderer->state_tracker);
 
     // Resize scene color and depth buffers
     texture::resize(renderer->scene_color, width, height);
@@ -1859,11 +2491,11 @@ void renderer::on_window_resize(Renderer *renderer, uint16_t width, uint16_t hei
     vp.MaxDepth = 1.0f;
     vp.TopLeftX = 0;
     vp.TopLeftY = 0;
-    renderer->context->RSSetViewports(1, &vp);
+    state_tracker::set_viewport(&renderer->state_tracker, &vp);
 
-    // Tell the camera about the new aspect ratio
-    Scene *scenes = application::get_scenes();
-    scene::camera_set_active_aspect_ratio(&scenes[0], width / (float)height);
+    // The camera's aspect ratio is the simulation's, it follows the window itself
+    renderer->width = width;
+    renderer->height = height;
 }
 
 ID3D11Device *renderer::get_device(Renderer *renderer) {
@@ -1884,6 +2516,7 @@ static bool setup_storage_state(Renderer *renderer) {
     // Invalidate all textures
     for (uint8_t i = 0; i < MAX_TEXTURES; ++i) {
         id::invalidate(&renderer->textures[i].id);
+        renderer->textures[i].gpu_bytes = 0;
     }
 
     // Invalidate all Lights
@@ -1966,7 +2599,7 @@ static bool create_device(ID3D11Device1 **device, ID3D11DeviceContext1 **context
     return true;
 }
 
-static bool create_swapchain(ID3D11Device1 *device, HWND hwnd, IDXGISwapChain3 **swapchain) {
+static bool create_swapchain(ID3D11Device1 *device, HWND hwnd, uint32_t max_frames_in_flight, IDXGISwapChain3 **swapchain) {
     // Get the DXGI Device from the device we had created
     Microsoft::WRL::ComPtr<IDXGIDevice> dxgi_device;
     HRESULT hr = device->QueryInterface(IID_PPV_ARGS(dxgi_device.GetAddressOf()));
@@ -2021,6 +2654,15 @@ static bool create_swapchain(ID3D11Device1 *device, HWND hwnd, IDXGISwapChain3 *
         return false;
     }
 
+    // Fewer frames queued up ahead of the GPU is less input latency, the driver defaults to 3
+    if (max_frames_in_flight > 0) {
+        Microsoft::WRL::ComPtr<IDXGIDevice1> dxgi_device1;
+        hr = dxgi_device.As(&dxgi_device1);
+        if (FAILED(hr) || FAILED(dxgi_device1->SetMaximumFrameLatency(max_frames_in_flight))) {
+            LOG("%s: Couldn't limit the frames in flight to %u, keeping the default", __func__, max_frames_in_flight);
+        }
+    }
+
     return true;
 }
 
@@ -2042,32 +2684,37 @@ static bool create_default_shaders(Renderer *renderer) {
 }
 
 static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
+    // Rasterizer, depth stencil and blend states go through the pipeline system,
+    // descs that come out the same share one state
+    PipelineSystemState *states = &renderer->pipeline_system;
+    pipeline::system_initialize(states);
+
     // --- Rasterizer States ---
     {
         CD3D11_RASTERIZER_DESC base(D3D11_DEFAULT);
         {
 
             CD3D11_RASTERIZER_DESC desc = base;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_SOLID_BACKFACE]);
+            renderer->rasterizer_states[RASTER_SOLID_BACKFACE] = pipeline::create_rasterizer_state(states, device, &desc);
         }
 
         {
             CD3D11_RASTERIZER_DESC desc = base;
             desc.CullMode = D3D11_CULL_FRONT;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_SOLID_FRONTFACE]);
+            renderer->rasterizer_states[RASTER_SOLID_FRONTFACE] = pipeline::create_rasterizer_state(states, device, &desc);
         }
 
         {
             CD3D11_RASTERIZER_DESC desc = base;
             desc.CullMode = D3D11_CULL_NONE;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_SOLID_NONE]);
+            renderer->rasterizer_states[RASTER_SOLID_NONE] = pipeline::create_rasterizer_state(states, device, &desc);
         }
 
         {
             CD3D11_RASTERIZER_DESC desc = base;
             desc.FillMode = D3D11_FILL_WIREFRAME;
             desc.CullMode = D3D11_CULL_NONE;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_WIREFRAME]);
+            renderer->rasterizer_states[RASTER_WIREFRAME] = pipeline::create_rasterizer_state(states, device, &desc);
         }
 
         {
@@ -2075,13 +2722,13 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
             desc.DepthBias = 1000;
             desc.SlopeScaledDepthBias = 2.0f;
             desc.DepthBiasClamp = 0.0f;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_SHADOW_DEPTH_BIAS]);
+            renderer->rasterizer_states[RASTER_SHADOW_DEPTH_BIAS] = pipeline::create_rasterizer_state(states, device, &desc);
         }
 
         {
             CD3D11_RASTERIZER_DESC desc = base;
             desc.FrontCounterClockwise = TRUE;
-            device->CreateRasterizerState(&desc, &renderer->rasterizer_states[RASTER_REVERSE_Z]);
+            renderer->rasterizer_states[RASTER_REVERSE_Z] = pipeline::create_rasterizer_state(states, device, &desc);
         }
     }
 
@@ -2090,41 +2737,47 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
         CD3D11_DEPTH_STENCIL_DESC base(D3D11_DEFAULT);
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_DEFAULT]);
+            renderer->depth_states[DEPTH_DEFAULT] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
 
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
             desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
             desc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_READ_ONLY]);
+            renderer->depth_states[DEPTH_READ_ONLY] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
 
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
             desc.DepthEnable = FALSE;
             desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_NONE]);
+            renderer->depth_states[DEPTH_NONE] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
 
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
             desc.DepthFunc = D3D11_COMPARISON_GREATER;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_REVERSE_Z]);
+            renderer->depth_states[DEPTH_REVERSE_Z] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
 
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
             desc.DepthFunc = D3D11_COMPARISON_EQUAL;
             desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_EQUAL_ONLY]);
+            renderer->depth_states[DEPTH_EQUAL_ONLY] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
 
         {
             CD3D11_DEPTH_STENCIL_DESC desc = base;
             desc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
             desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-            device->CreateDepthStencilState(&desc, &renderer->depth_states[DEPTH_LESS_EQUAL_NO_WRITE]);
+            renderer->depth_states[DEPTH_LESS_EQUAL_NO_WRITE] = pipeline::create_depth_stencil_state(states, device, &desc);
+        }
+
+        {
+            CD3D11_DEPTH_STENCIL_DESC desc = base;
+            desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+            renderer->depth_states[DEPTH_ALWAYS] = pipeline::create_depth_stencil_state(states, device, &desc);
         }
     }
 
@@ -2133,7 +2786,7 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
         CD3D11_BLEND_DESC base(D3D11_DEFAULT);
         {
             CD3D11_BLEND_DESC desc = base;
-            device->CreateBlendState(&desc, &renderer->blend_states[BLEND_OPAQUE]);
+            renderer->blend_states[BLEND_OPAQUE] = pipeline::create_blend_state(states, device, &desc);
         }
 
         {
@@ -2145,7 +2798,7 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
             desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
             desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
             desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-            device->CreateBlendState(&desc, &renderer->blend_states[BLEND_ALPHA]);
+            renderer->blend_states[BLEND_ALPHA] = pipeline::create_blend_state(states, device, &desc);
         }
 
         {
@@ -2157,7 +2810,7 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
             desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
             desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
             desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-            device->CreateBlendState(&desc, &renderer->blend_states[BLEND_ADDITIVE]);
+            renderer->blend_states[BLEND_ADDITIVE] = pipeline::create_blend_state(states, device, &desc);
         }
 
         {
@@ -2169,14 +2822,14 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
             desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
             desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
             desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-            device->CreateBlendState(&desc, &renderer->blend_states[BLEND_PREMULTIPLIED_ALPHA]);
+            renderer->blend_states[BLEND_PREMULTIPLIED_ALPHA] = pipeline::create_blend_state(states, device, &desc);
         }
 
         {
             CD3D11_BLEND_DESC desc = base;
             desc.RenderTarget[0].BlendEnable = FALSE;
             desc.RenderTarget[0].RenderTargetWriteMask = 0;
-            device->CreateBlendState(&desc, &renderer->blend_states[BLEND_DISABLE_WRITE]);
+            renderer->blend_states[BLEND_DISABLE_WRITE] = pipeline::create_blend_state(states, device, &desc);
         }
     }
 
@@ -2244,9 +2897,40 @@ static bool create_pipeline_states(Renderer *renderer, ID3D11Device *device) {
         }
     }
 
+    for (uint32_t i = 0; i < RASTER_STATE_COUNT; ++i) {
+        if (id::is_invalid(renderer->rasterizer_states[i])) {
+            LOG("%s: Failed to create rasterizer state %u", __func__, i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < DEPTH_STATE_COUNT; ++i) {
+        if (id::is_invalid(renderer->depth_states[i])) {
+            LOG("%s: Failed to create depth stencil state %u", __func__, i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < BLEND_STATE_COUNT; ++i) {
+        if (id::is_invalid(renderer->blend_states[i])) {
+            LOG("%s: Failed to create blend state %u", __func__, i);
+            return false;
+        }
+    }
+
     return true;
 }
 
+static ID3D11RasterizerState *get_rasterizer_state(Renderer *renderer, RasterizerState state) {
+    return pipeline::get_rasterizer_state(&renderer->pipeline_system, renderer->rasterizer_states[state]);
+}
+
+static ID3D11DepthStencilState *get_depth_stencil_state(Renderer *renderer, DepthStencilState state) {
+    return pipeline::get_depth_stencil_state(&renderer->pipeline_system, renderer->depth_states[state]);
+}
+
+static ID3D11BlendState *get_blend_state(Renderer *renderer, BlendState state) {
+    return pipeline::get_blend_state(&renderer->pipeline_system, renderer->blend_states[state]);
+}
+
 static bool resolve_msaa_texture(ID3D11DeviceContext *context, Texture *src, Texture *dst) {
     context->ResolveSubresource(
         dst->texture.Get(), 0,
@@ -2257,18 +2941,25 @@ static bool resolve_msaa_texture(ID3D11DeviceContext *context, Texture *src, Tex
 }
 
 static bool create_shadow_pass(Renderer *renderer, PipelineId *out_pipeline) {
-    // Create shadow pass atlas
-    renderer->shadow_atlas = texture::create(
-        1024, 1024,
-        DXGI_FORMAT_D24_UNORM_S8_UINT,
-        D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE,
-        true,
-        nullptr, 0,
-        1, 1, 1, false);
+    // Create shadow pass atlas, plus a second one that keeps the static casters of every tile
+    TextureId *atlases[] = {&renderer->shadow_atlas, &renderer->shadow_static_atlas};
+    for (uint32_t i = 0; i < ARRAYSIZE(atlases); ++i) {
+        *atlases[i] = texture::create(
+            SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE,
+            DXGI_FORMAT_D24_UNORM_S8_UINT,
+            D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE,
+            true,
+            nullptr, 0,
+            1, 1, 1, false);
 
-    if (id::is_invalid(renderer->shadow_atlas)) {
-        LOG("%s: Couldn't create shadow atlas", __func__);
-        return false;
+        if (id::is_invalid(*atlases[i])) {
+            LOG("%s: Couldn't create shadow atlas", __func__);
+            return false;
+        }
+
+        // Only cleared once, tiles are cleared by themselves when they get redrawn
+        Texture *atlas = texture::get(renderer, *atlases[i]);
+        renderer->context->ClearDepthStencilView(atlas->dsv.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
     }
 
     // Set up constant buffer for lights
@@ -2286,6 +2977,19 @@ static bool create_shadow_pass(Renderer *renderer, PipelineId *out_pipeline) {
         }
     }
 
+    // Views the shading passes sample the atlas with
+    if (!create_structured_buffer(renderer->device.Get(), sizeof(GPUShadowView), MAX_SHADOW_VIEWS, true, false,
+                                  renderer->shadow_view_buffer.GetAddressOf(), renderer->shadow_view_srv.GetAddressOf(), nullptr)) {
+        LOG("%s: Couldn't create the shadow view buffer", __func__);
+        return false;
+    }
+
+    shadow_atlas::initialize(&renderer->shadow_allocator, SHADOW_ATLAS_SIZE);
+    memset(renderer->shadow_entries, 0, sizeof(renderer->shadow_entries));
+    renderer->shadow_distance = 100.0f;
+    renderer->shadow_split_lambda = 0.75f;
+    renderer->shadow_view_count = 0;
+
     // Create shader module (VS) for the shadow pass
     // pixel shader will be null
     ShaderId shadowpass_vs = shader::create_module_from_file(
@@ -2323,95 +3027,447 @@ static bool create_shadow_pass(Renderer *renderer, PipelineId *out_pipeline) {
         return false;
     }
 
+    // Fullscreen passes that restore and clear single tiles
+    ShaderId restore_ps = shader::create_module_from_file(
+        &renderer->shader_system,
+        renderer->device.Get(),
+        L"src/shaders/shadow_restore.ps.hlsl",
+        SHADER_STAGE_PS,
+        "main");
+    ShaderId clear_ps = shader::create_module_from_file(
+        &renderer->shader_system,
+        renderer->device.Get(),
+        L"src/shaders/shadow_restore.ps.hlsl",
+        SHADER_STAGE_PS,
+        "clear");
+
+    if (id::is_invalid(restore_ps) || id::is_invalid(clear_ps)) {
+        LOG("%s: Failed to create shadow restore pixel shaders", __func__);
+        return false;
+    }
+
+    ShaderId restore_modules[] = {renderer->fullscreen_triangle_vs, restore_ps};
+    renderer->shadow_restore_shader = shader::create_pipeline(
+        &renderer->shader_system,
+        renderer->device.Get(),
+        restore_modules,
+        ARRAYSIZE(restore_modules),
+        nullptr, 0);
+
+    ShaderId clear_modules[] = {renderer->fullscreen_triangle_vs, clear_ps};
+    renderer->shadow_clear_shader = shader::create_pipeline(
+        &renderer->shader_system,
+        renderer->device.Get(),
+        clear_modules,
+        ARRAYSIZE(clear_modules),
+        nullptr, 0);
+
+    if (id::is_invalid(renderer->shadow_restore_shader) || id::is_invalid(renderer->shadow_clear_shader)) {
+        LOG("%s: Failed to create shadow restore pipelines", __func__);
+        return false;
+    }
+
     return true;
 }
 
+// A view that asked for a tile this frame
+struct ShadowViewRequest {
+    uint32_t light_index;
+    uint32_t cascade; // Cascade index, 0 for spot lights
+    bool perspective; // Spot light frustum instead of a cascade
+    ShadowAtlasEntry *entry;
+};
+
 static void render_shadow_pass(Renderer *renderer, Scene *scene, Texture *shadow_atlas) {
     BEGIN_D3D11_EVENT(renderer, L"Shadow Pass");
 
     ID3D11DeviceContext *context = renderer->context.Get();
+    StateTracker *tracker = &renderer->state_tracker;
+    Texture *static_atlas = texture::get(renderer, renderer->shadow_static_atlas);
+
+    // What the cascades get fit to
+    SceneCamera *cam = scene->active_cam;
+    DirectX::XMFLOAT4X4 view = scene::camera_get_view_matrix(cam);
+    DirectX::XMFLOAT4X4 projection = scene::camera_get_projection_matrix(cam);
+    ShadowCameraDesc camera_desc = {};
+    DirectX::XMStoreFloat4x4(&camera_desc.inv_view_matrix, DirectX::XMMatrixInverse(nullptr, DirectX::XMLoadFloat4x4(&view)));
+    camera_desc.fov_y = DirectX::XMConvertToRadians(cam->base.fov);
+    camera_desc.aspect_ratio = cam->base.aspect_ratio;
+    camera_desc.znear = cam->base.znear;
+    camera_desc.zfar = MIN(cam->base.zfar, renderer->shadow_distance);
+
+    DirectX::XMFLOAT4X4 camera_view_projection;
+    DirectX::XMStoreFloat4x4(&camera_view_projection, DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection)));
+
+    float splits[SHADOW_CASCADE_COUNT + 1];
+    shadow_cascades::compute_splits(camera_desc.znear, camera_desc.zfar, SHADOW_CASCADE_COUNT, renderer->shadow_split_lambda, splits);
+
+    // Ask for a tile for every view, sized by how much of the screen it covers
+    ShadowAtlas *allocator = &renderer->shadow_allocator;
+    ShadowViewRequest requests[MAX_SHADOW_VIEWS];
+    uint32_t request_count = 0;
+    shadow_atlas::begin_requests(renderer->shadow_entries, MAX_SHADOW_VIEWS);
 
-    // Bind the states
-    context->OMSetDepthStencilState(renderer->depth_states[DEPTH_DEFAULT].Get(), 0);
-    context->RSSetState(renderer->rasterizer_states[RASTER_SOLID_BACKFACE].Get());
-    context->OMSetBlendState(renderer->blend_states[BLEND_DISABLE_WRITE].Get(), nullptr, 0xFFFFFFFF);
+    for (uint32_t i = 0; i < MAX_SCENE_LIGHTS; ++i) {
+        LightInstance *light_inst = &scene->lights[i];
+        light_inst->shadowmap_index = SHADOWMAP_INDEX_NONE;
+        light_inst->shadowmap_count = 0;
+        if (id::is_invalid(light_inst->id) || !light_inst->enabled || !light_inst->cast_shadows) {
+            continue;
+        }
 
-    // Bind and clear the depth buffer (no color for this one)
-    renderer->context->OMSetRenderTargets(0, nullptr, shadow_atlas->dsv.Get());
-    renderer->context->ClearDepthStencilView(shadow_atlas->dsv.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+        Light *light = light::get(renderer, light_inst->light_id);
+        if (!light) {
+            continue;
+        }
+
+        // Same light keeps the same keys, so it finds its tiles (and their cache) again
+        uint64_t key = 1 + (((uint64_t)light_inst->id.id << 16) | ((uint64_t)light_inst->id.generation << 8));
+
+        if (light->type == LIGHT_TYPE_DIRECTIONAL) {
+            // Cascades always win over spot lights, the near ones most of all
+            for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT && request_count < MAX_SHADOW_VIEWS; ++c) {
+                uint32_t size = c < 2 ? SHADOW_ATLAS_SIZE / 2u : SHADOW_ATLAS_SIZE / 4u;
+                uint32_t level = shadow_atlas::get_level_for_size(allocator, size);
+                ShadowAtlasEntry *entry = shadow_atlas::request(renderer->shadow_entries, MAX_SHADOW_VIEWS, key + c, 1000.0f - c, level);
+                if (entry) {
+                    requests[request_count++] = {i, c, false, entry};
+                }
+            }
+        } else if (light->type == LIGHT_TYPE_SPOT && request_count < MAX_SHADOW_VIEWS) {
+            // Nothing to shadow if the light can't reach anything on screen
+            if (!shadow_cascades::sphere_in_frustum(&camera_view_projection, light_inst->position, light->range)) {
+                continue;
+            }
+
+            // Rough fraction of the screen height the light's range covers
+            DirectX::XMFLOAT3 p = light_inst->position;
+            DirectX::XMFLOAT4X4 inv_view = camera_desc.inv_view_matrix;
+            float dx = p.x - inv_view._41;
+            float dy = p.y - inv_view._42;
+            float dz = p.z - inv_view._43;
+            float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+            float coverage = light->range * projection._22 / MAX(distance, light->range);
+
+            uint32_t size = (uint32_t)(coverage * renderer->height);
+            size = MIN(MAX(size, SHADOW_ATLAS_SIZE / 16u), SHADOW_ATLAS_SIZE / 4u);
+            uint32_t level = shadow_atlas::get_level_for_size(allocator, size);
+            ShadowAtlasEntry *entry = shadow_atlas::request(renderer->shadow_entries, MAX_SHADOW_VIEWS, key, coverage, level);
+            if (entry) {
+                requests[request_count++] = {i, 0, true, entry};
+            }
+        }
+    }
+
+    shadow_atlas::resolve(allocator, renderer->shadow_entries, MAX_SHADOW_VIEWS);
+
+    // World bounds of every caster, they're the same for each view
+    DirectX::XMFLOAT3 caster_centers[MAX_SCENE_MESHES];
+    float caster_radii[MAX_SCENE_MESHES];
+    bool caster_valid[MAX_SCENE_MESHES];
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        SceneMesh *mesh = &scene->meshes[i];
+        caster_valid[i] = id::is_valid(mesh->id) && scene::mesh_get_world_bounds(scene, mesh->id, &caster_centers[i], &caster_radii[i]);
+    }
+
+    renderer->shadow_view_count = 0;
+    renderer->shadow_caster_draws = 0;
+    renderer->shadow_views_updated = 0;
 
-    // Bind the shader pipeline
     ShaderPipeline *shadowpass_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->shadowpass_shader);
-    shader::bind_pipeline(&renderer->shader_system, renderer->context.Get(), shadowpass_pipeline);
+    ShaderPipeline *restore_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->shadow_restore_shader);
+    ShaderPipeline *clear_pipeline = shader::get_pipeline(&renderer->shader_system, renderer->shadow_clear_shader);
+    state_tracker::set_blend_state(tracker, get_blend_state(renderer, BLEND_DISABLE_WRITE), nullptr, 0xFFFFFFFF);
+    state_tracker::set_constant_buffers(tracker, SHADER_STAGE_VS, 2, 1, renderer->shadowpass_cb_ptr.GetAddressOf());
+    mesh::bind_geometry(renderer);
 
-    // Map the constant buffer
     D3D11_MAPPED_SUBRESOURCE mapped;
-    renderer->context->VSSetConstantBuffers(2, 1, renderer->shadowpass_cb_ptr.GetAddressOf());
+    GPUShadowView gpu_views[MAX_SHADOW_VIEWS];
+    for (uint32_t r = 0; r < request_count; ++r) {
+        ShadowViewRequest *request = &requests[r];
+        LightInstance *light_inst = &scene->lights[request->light_index];
+
+        // A cascade that lost its tile takes the ones after it along, the
+        // shading would otherwise pick a farther cascade for its range
+        if (request->entry->node == SHADOW_ATLAS_NODE_NONE ||
+            (request->cascade > 0 && light_inst->shadowmap_count != request->cascade)) {
+            continue;
+        }
 
-    // HACK: Hardcoding tile props
-    const uint32_t tile_width = 1024;
-    const uint32_t tile_height = 1024;
-    const uint32_t tiles_x = shadow_atlas->width / tile_width;
-    const uint32_t tiles_y = shadow_atlas->height / tile_height;
-    const uint32_t total_tiles = tiles_x * tiles_y;
+        uint32_t tile_x;
+        uint32_t tile_y;
+        uint32_t tile_size;
+        shadow_atlas::get_node_rect(allocator, request->entry->node, &tile_x, &tile_y, &tile_size);
+
+        ShadowCascade shadow_view = {};
+        if (request->perspective) {
+            Light *light = light::get(renderer, light_inst->light_id);
+            shadow_view.view_matrix = scene::light_get_view_matrix(scene, light_inst->id);
+            shadow_view.view_projection_matrix = scene::light_get_view_projection_matrix(scene, light_inst->id);
+            shadow_view.split_far = FLT_MAX;
+            // Texel size halfway down the cone, good enough for the normal offset
+            shadow_view.texel_size = 2.0f * tanf(light->spot_outer_angle) * light->range * 0.5f / (float)tile_size;
+        } else {
+            DirectX::XMFLOAT3 light_direction = scene::light_get_direction(light_inst);
+            shadow_cascades::fit(&camera_desc, splits[request->cascade], splits[request->cascade + 1], light_direction,
+                                 tile_size, SHADOW_CASTER_DISTANCE, &shadow_view);
+        }
 
-    // Loop through the scene lights and render
-    for (uint32_t i = 0; i < MAX_SCENE_LIGHTS; ++i) {
-        // If we have no more space on the shadow atlas, we break
-        if (i >= total_tiles) {
-            break;
+        // Casters that can reach the view, split into the static and dynamic layer
+        bool caster_visible[MAX_SCENE_MESHES];
+        uint64_t view_hash = shadow_atlas::hash(SHADOW_HASH_SEED, &shadow_view.view_projection_matrix, sizeof(shadow_view.view_projection_matrix));
+        uint64_t static_hash = SHADOW_HASH_SEED;
+        uint64_t dynamic_hash = SHADOW_HASH_SEED;
+        for (int m = 0; m < MAX_SCENE_MESHES; ++m) {
+            caster_visible[m] = caster_valid[m] &&
+                                (request->perspective
+                                     ? shadow_cascades::sphere_in_frustum(&shadow_view.view_projection_matrix, caster_centers[m], caster_radii[m])
+                                     : shadow_cascades::sphere_visible(&shadow_view, caster_centers[m], caster_radii[m]));
+            if (!caster_visible[m]) {
+                continue;
+            }
+
+            // The index count changes when an async load fills in the mesh
+            SceneMesh *mesh = &scene->meshes[m];
+            Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
+            uint32_t index_count = gpu_mesh ? gpu_mesh->indexCount : 0;
+            uint32_t caster_state[] = {(uint32_t)m, mesh->id.generation, mesh->transform_version, mesh->mesh_id.id, mesh->mesh_id.generation, index_count};
+            if (mesh->is_static) {
+                static_hash = shadow_atlas::hash(static_hash, caster_state, sizeof(caster_state));
+            } else {
+                dynamic_hash = shadow_atlas::hash(dynamic_hash, caster_state, sizeof(caster_state));
+            }
         }
 
-        // Grab the light instance
-        Id light_instance_id = scene->lights[i].id;
-        if (id::is_invalid(light_instance_id)) {
+        if (light_inst->shadowmap_count == 0) {
+            light_inst->shadowmap_index = renderer->shadow_view_count;
+        }
+        light_inst->shadowmap_count++;
+
+        GPUShadowView *gpu_view = &gpu_views[renderer->shadow_view_count++];
+        gpu_view->view_projection_matrix = shadow_view.view_projection_matrix;
+        gpu_view->uv_rect = DirectX::XMFLOAT4(
+            (float)tile_x / shadow_atlas->width, (float)tile_y / shadow_atlas->height,
+            (float)tile_size / shadow_atlas->width, (float)tile_size / shadow_atlas->height);
+        gpu_view->split_far = shadow_view.split_far;
+        gpu_view->texel_size = shadow_view.texel_size;
+
+        ShadowUpdate update = shadow_atlas::update_cache(&request->entry->cache, view_hash, static_hash, dynamic_hash);
+        if (update == SHADOW_UPDATE_NONE) {
             continue;
         }
+        renderer->shadow_views_updated++;
 
-        // FIXME: Not testing for whether this light should cast shadows or not
-
-        // Calculate the tiles
-        uint32_t tile_x = i % tiles_x;
-        uint32_t tile_y = i / tiles_x;
+        D3D11_VIEWPORT vp = {};
+        vp.TopLeftX = (float)tile_x;
+        vp.TopLeftY = (float)tile_y;
+        vp.Width = (float)tile_size;
+        vp.Height = (float)tile_size;
+        vp.MinDepth = 0.0f;
+        vp.MaxDepth = 1.0f;
+        state_tracker::set_viewport(tracker, &vp);
 
         context->Map(renderer->shadowpass_cb_ptr.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
         CBShadowPass *constants = (CBShadowPass *)mapped.pData;
-        constants->view_projection_matrix = scene::light_get_view_projection_matrix(scene, light_instance_id);
+        constants->view_projection_matrix = shadow_view.view_projection_matrix;
         context->Unmap(renderer->shadowpass_cb_ptr.Get(), 0);
 
-        // Set up the viewport for this light
-        D3D11_VIEWPORT vp = {};
-        vp.TopLeftX = tile_x * tile_width;
-        vp.TopLeftY = tile_y * tile_height;
-        vp.Width = static_cast<float>(tile_width);
-        vp.Height = static_cast<float>(tile_height);
-        vp.MinDepth = 0.0f;
-        vp.MaxDepth = 1.0f;
-        context->RSSetViewports(1, &vp);
-
-        // Render meshes
-        for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
-            SceneMesh *mesh = &scene->meshes[i];
-            if (id::is_invalid(mesh->id))
-                continue;
+        // Static layer, only when the light or a static caster changed
+        if (update == SHADOW_UPDATE_FULL) {
+            state_tracker::set_render_targets(tracker, 0, nullptr, static_atlas->dsv.Get());
+
+            state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_ALWAYS), 0);
+            state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_NONE));
+            shader::bind_pipeline(&renderer->shader_system, context, clear_pipeline);
+            state_tracker::draw(tracker, 3, 0);
+
+            state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_DEFAULT), 0);
+            state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+            shader::bind_pipeline(&renderer->shader_system, context, shadowpass_pipeline);
+            for (int m = 0; m < MAX_SCENE_MESHES; ++m) {
+                SceneMesh *mesh = &scene->meshes[m];
+                if (!caster_visible[m] || !mesh->is_static) {
+                    continue;
+                }
+
+                scene::bind_mesh_instance(renderer, scene, mesh->id, 1);
+                mesh::draw(tracker, mesh::get(renderer, mesh->mesh_id));
+                renderer->shadow_caster_draws++;
+            }
+        }
 
-            // Lookup the mesh gpu resource through the mesh_id
-            Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
-            if (!gpu_mesh) {
+        // Copy the static layer over, then draw the dynamic casters on top
+        state_tracker::set_render_targets(tracker, 0, nullptr, shadow_atlas->dsv.Get());
+
+        state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_ALWAYS), 0);
+        state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_NONE));
+        shader::bind_pipeline(&renderer->shader_system, context, restore_pipeline);
+        state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, static_atlas->srv.GetAddressOf());
+        state_tracker::draw(tracker, 3, 0);
+
+        // The static atlas may be a depth target again for the next view
+        ID3D11ShaderResourceView *null_srv = nullptr;
+        state_tracker::set_srvs(tracker, SHADER_STAGE_PS, 0, 1, &null_srv);
+
+        state_tracker::set_depth_stencil_state(tracker, get_depth_stencil_state(renderer, DEPTH_DEFAULT), 0);
+        state_tracker::set_rasterizer_state(tracker, get_rasterizer_state(renderer, RASTER_SOLID_BACKFACE));
+        shader::bind_pipeline(&renderer->shader_system, context, shadowpass_pipeline);
+        for (int m = 0; m < MAX_SCENE_MESHES; ++m) {
+            SceneMesh *mesh = &scene->meshes[m];
+            if (!caster_visible[m] || mesh->is_static) {
                 continue;
             }
 
-            // Bind mesh instance
             scene::bind_mesh_instance(renderer, scene, mesh->id, 1);
-
-            // Draw the mesh
-            mesh::draw(renderer->context.Get(), gpu_mesh);
+            mesh::draw(tracker, mesh::get(renderer, mesh->mesh_id));
+            renderer->shadow_caster_draws++;
         }
     }
 
+    // Upload the views for the shading passes
+    if (renderer->shadow_view_count > 0 &&
+        SUCCEEDED(context->Map(renderer->shadow_view_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        memcpy(mapped.pData, gpu_views, renderer->shadow_view_count * sizeof(GPUShadowView));
+        context->Unmap(renderer->shadow_view_buffer.Get(), 0);
+    }
+
     END_D3D11_EVENT(renderer)
 }
 
+static void draw_scene_mesh(Renderer *renderer, int scene_mesh_index, Mesh *gpu_mesh) {
+    uint32_t draw_count = renderer->meshlet_draw_count[scene_mesh_index];
+    if (draw_count == MESHLET_DRAW_WHOLE) {
+        mesh::draw(&renderer->state_tracker, gpu_mesh);
+        return;
+    }
+
+    const MeshletDraw *draws = &renderer->meshlet_draws[renderer->meshlet_draw_start[scene_mesh_index]];
+    mesh::draw_ranges(&renderer->state_tracker, gpu_mesh, draws, draw_count);
+}
+
+static void build_opaque_queue(Renderer *renderer, Scene *scene) {
+    renderer->opaque_count = 0;
+    renderer->opaque_queue = ARENA_PUSH_ARRAY(arena::frame_current(&renderer->frame_arena), DrawItem, MAX_SCENE_MESHES);
+    if (!renderer->opaque_queue) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_SCENE_MESHES; ++i) {
+        SceneMesh *mesh = &scene->meshes[i];
+        if (id::is_invalid(mesh->id))
+            continue;
+
+        Material *mat = material::get(renderer, mesh->material_id);
+        if (!mat) {
+            LOG("%s: Warning! Material couldn't be fetched", __func__);
+            continue;
+        }
+
+        // Every meshlet culled leaves nothing to draw
+        Mesh *gpu_mesh = mesh::get(renderer, mesh->mesh_id);
+        if (!gpu_mesh || renderer->meshlet_draw_count[i] == 0) {
+            continue;
+        }
+
+        DrawItem *item = &renderer->opaque_queue[renderer->opaque_count++];
+        item->key = (mat->features << 8) | mat->id.id;
+        item->scene_mesh = (uint16_t)i;
+        item->material = mat->id.id;
+    }
+
+    // Shader variant first, then material. The rest stays in scene order.
+    qsort(renderer->opaque_queue, renderer->opaque_count, sizeof(DrawItem), draw_item_compare);
+}
+
+static void update_streaming(Renderer *renderer, Scene *scene) {
+    TextureStreamer *streamer = &renderer->texture_streamer;
+    texture_streamer::begin_frame(streamer);
+
+    // Each visible draw asks for the mip its bounds cover on screen, for every texture of its material
+    SceneCamera *cam = scene->active_cam;
+    float pixels_per_unit = renderer->height / (2.0f * tanf(DirectX::XMConvertToRadians(cam->base.fov) * 0.5f));
+    DirectX::XMVECTOR eye = DirectX::XMLoadFloat3(&cam->position);
+    for (uint32_t q = 0; q < renderer->opaque_count; ++q) {
+        const DrawItem *item = &renderer->opaque_queue[q];
+        DirectX::XMFLOAT3 center;
+        float radius;
+        if (!scene::mesh_get_world_bounds(scene, scene->meshes[item->scene_mesh].id, &center, &radius)) {
+            continue;
+        }
+
+        // Inside the bounds is as close as it gets
+        float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&center), eye)));
+        float pixels = distance > radius ? 2.0f * radius * pixels_per_unit / distance : FLT_MAX;
+
+        const Material *mat = &renderer->materials[item->material];
+        Id textures[] = {mat->albedo_texture, mat->metallic_texture, mat->roughness_texture, mat->coat_texture, mat->normal_texture, mat->emission_texture};
+        for (uint32_t t = 0; t < ARRAYSIZE(textures); ++t) {
+            if (id::is_valid(textures[t])) {
+                texture_streamer::request(streamer, textures[t].id, texture_streamer::footprint_mip(streamer, textures[t].id, pixels));
+            }
+        }
+    }
+
+    StreamRequest requests[STREAMER_MAX_TEXTURES];
+    uint32_t count = texture_streamer::update(streamer, requests);
+    texture::stream(renderer, requests, count);
+}
+
+static int draw_item_compare(const void *a, const void *b) {
+    const DrawItem *item_a = (const DrawItem *)a;
+    const DrawItem *item_b = (const DrawItem *)b;
+    if (item_a->key != item_b->key) {
+        return item_a->key < item_b->key ? -1 : 1;
+    }
+    return (int)item_a->scene_mesh - (int)item_b->scene_mesh;
+}
+
+static bool create_structured_buffer(ID3D11Device *device, uint32_t stride, uint32_t count, bool dynamic, bool unordered_access,
+                                     ID3D11Buffer **out_buffer, ID3D11ShaderResourceView **out_srv, ID3D11UnorderedAccessView **out_uav) {
+    D3D11_BUFFER_DESC desc = {};
+    desc.Usage = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+    desc.ByteWidth = stride * count;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | (unordered_access ? D3D11_BIND_UNORDERED_ACCESS : 0);
+    desc.CPUAccessFlags = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    desc.StructureByteStride = stride;
+
+    HRESULT hr = device->CreateBuffer(&desc, nullptr, out_buffer);
+    if (FAILED(hr)) {
+        LOG("%s: Failed to create structured buffer", __func__);
+        return false;
+    }
+    memory_tracker::track(MEMORY_TAG_BUFFERS, MEMORY_DOMAIN_GPU, desc.ByteWidth);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+    srv_desc.Format = DXGI_FORMAT_UNKNOWN;
+    srv_desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srv_desc.Buffer.ElementOffset = 0;
+    srv_desc.Buffer.NumElements = count;
+
+    hr = device->CreateShaderResourceView(*out_buffer, &srv_desc, out_srv);
+    if (FAILED(hr)) {
+        LOG("%s: Failed to create SRV for structured buffer", __func__);
+        return false;
+    }
+
+    if (unordered_access) {
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
+        uav_desc.Format = DXGI_FORMAT_UNKNOWN;
+        uav_desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+        uav_desc.Buffer.FirstElement = 0;
+        uav_desc.Buffer.NumElements = count;
+
+        hr = device->CreateUnorderedAccessView(*out_buffer, &uav_desc, out_uav);
+        if (FAILED(hr)) {
+            LOG("%s: Failed to create UAV for structured buffer", __func__);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static bool create_fallback_textures(Renderer *renderer) {
     // Create fallback texture for albedo, metallic, roughness, and emission
     {
@@ -1,11 +1,26 @@
 #pragma once
 
+#include "arena.hpp"
+#include "asset_registry.hpp"
+#include "async.hpp"
+#include "file_watcher.hpp"
+#include "geometry_arena.hpp"
 #include "light.hpp"
+#include "light_cluster.hpp"
 #include "material.hpp"
+#include "material_table.hpp"
 #include "mesh.hpp"
+#include "mip_file.hpp"
+#include "occlusion.hpp"
+#include "pipeline_system.hpp"
+#include "profiler.hpp"
 #include "scene.hpp"
 #include "shader_system.hpp"
+#include "shadow_atlas.hpp"
+#include "shadow_cascades.hpp"
+#include "state_tracker.hpp"
 #include "texture.hpp"
+#include "texture_streamer.hpp"
 #include "window.hpp"
 
 #include <DirectXMath.h>
@@ -17,7 +32,24 @@
 #define MAX_MESHES 32
 #define MAX_MATERIALS 32
 #define MAX_TEXTURES 64
-#define MAX_LIGHTS 32
+// Mip loads the texture streamer has in flight at once
+#define TEXTURE_STREAM_MAX_LOADS 4
+#define MAX_LIGHTS 254
+
+// Shared by every mesh: 24 MB of vertices, 8 MB of indices
+#define GEOMETRY_ARENA_VERTICES (1 << 19)
+#define GEOMETRY_ARENA_INDICES (1 << 21)
+
+// Visible meshlet ranges of all scene meshes together, rebuilt every frame
+#define MAX_MESHLET_DRAWS 16384
+// Meshlet draw count of a scene mesh that is drawn whole
+#define MESHLET_DRAW_WHOLE UINT32_MAX
+
+// The Hi-Z depth is read back this many frames later, so the CPU never waits on it
+#define HIZ_FRAME_LATENCY 3
+
+// Tiles are handed out by the quadtree in shadow_atlas.hpp
+#define SHADOW_ATLAS_SIZE 4096
 
 struct alignas(16) CBPerFrame {
     DirectX::XMFLOAT4X4 view_matrix;
@@ -37,15 +69,21 @@ struct alignas(16) CBSkybox {
 struct alignas(16) CBPerObject {
     DirectX::XMFLOAT4X4 worldMatrix;
     DirectX::XMFLOAT4X4 worldInvTrans;
+    uint32_t material_index; // Into the material buffer
+    uint32_t _padding[3];
 };
 
-struct alignas(16) CBPerMaterial {
+// One entry of the material buffer, see material.hlsli
+struct GPUMaterial {
     DirectX::XMFLOAT3 albedo_color;
     float metallic_value;
     float roughness_value;
     float coat_value;
     float emission_intensity;
-    float _padding[1];
+    // Slots in the material texture arrays: albedo, metallic, roughness, coat, normal, emission
+    uint32_t texture_slots[6];
+    uint32_t features; // MaterialFeature bits
+    uint32_t _padding[2];
 };
 
 struct FSVertex {
@@ -85,8 +123,65 @@ struct alignas(16) CBShadowPass {
 struct CBLight {
     DirectX::XMFLOAT3 direction;
     float intensity;
+    DirectX::XMFLOAT3 position;
+    float range;
+    DirectX::XMFLOAT3 color;
+    uint32_t type;
+    float spot_cos_inner;
+    float spot_cos_outer;
+    uint32_t shadow_view_start; // Into the shadow view buffer
+    uint32_t shadow_view_count; // 0 means no shadows
+};
+
+// A cascade of a directional light, or a spot light's frustum
+struct GPUShadowView {
     DirectX::XMFLOAT4X4 view_projection_matrix;
     DirectX::XMFLOAT4 uv_rect;
+    float split_far;
+    float texel_size;
+    float padding[2];
+};
+
+struct alignas(16) CBClusterConstants {
+    uint32_t grid_size[3];
+    uint32_t directional_light_count;
+    float screen_size[2];
+    float z_scale;
+    float z_bias;
+};
+
+struct alignas(16) CBLightCulling {
+    uint32_t light_count;
+    uint32_t cluster_count;
+    uint32_t padding[2];
+};
+
+struct alignas(16) CBHiZ {
+    uint32_t source_size[2];
+    uint32_t target_size[2];
+    uint32_t sample_count;
+    uint32_t padding[3];
+};
+
+// Cluster bounds as the culling compute shader reads them
+struct GPUClusterBounds {
+    DirectX::XMFLOAT4 min_radius;
+    DirectX::XMFLOAT4 max;
+};
+
+// An opaque camera pass draw, the queue is sorted by key so draws sharing a
+// shader variant and material end up next to each other
+struct DrawItem {
+    uint32_t key; // Material features, then the material slot
+    uint16_t scene_mesh;
+    uint16_t material;
+};
+
+// One frame's Hi-Z base level on its way back to the CPU
+struct HiZReadback {
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+    DirectX::XMFLOAT4X4 view_projection; // Of the frame the depth is from
+    bool is_pending;
 };
 
 enum RasterizerState {
@@ -107,6 +202,7 @@ enum DepthStencilState {
     DEPTH_REVERSE_Z,
     DEPTH_EQUAL_ONLY,
     DEPTH_LESS_EQUAL_NO_WRITE,
+    DEPTH_ALWAYS,
 
     DEPTH_STATE_COUNT
 };
@@ -134,6 +230,17 @@ enum SamplerState {
 
 struct Renderer {
     ShaderSystemState shader_system;
+    // Set before initialize. Shaders compile on the job workers unless it's
+    // set, pipelines are waited on when first used.
+    bool serial_shaders;
+    bool shader_cache_enabled;
+    // Rebuilds shaders when their files are saved, also set before initialize
+    bool shader_hot_reload;
+    FileWatcher shader_watcher;
+    // Set before initialize. load_async decodes on its workers, the uploads
+    // and the other main thread jobs run in render.
+    JobSystem *jobs;
+    AsyncScheduler asset_scheduler;
 
     // Graphics Context
     Microsoft::WRL::ComPtr<ID3D11Device1> device;
@@ -141,28 +248,66 @@ struct Renderer {
     Microsoft::WRL::ComPtr<IDXGISwapChain3> swapchain;
     Microsoft::WRL::ComPtr<ID3DUserDefinedAnnotation> annotation;
     D3D_FEATURE_LEVEL featureLevel;
+    // The passes bind through this, it drops the state changes that change nothing
+    StateTracker state_tracker;
+    // Sync interval for Present, 0 disables vsync (benchmarks)
+    UINT present_interval;
+    // Set before initialize, how many frames the driver queues at most (0 is its default)
+    uint32_t max_frames_in_flight;
 
     TextureId swapchain_texture;
 
     Microsoft::WRL::ComPtr<ID3D11Buffer> pCBPerObject;
     Microsoft::WRL::ComPtr<ID3D11Buffer> pCBPerFrame;
-    Microsoft::WRL::ComPtr<ID3D11Buffer> pCBPerMaterial;
 
     // Blend states
     Microsoft::WRL::ComPtr<ID3D11BlendState> pDefaultBS;
     Microsoft::WRL::ComPtr<ID3D11BlendState> pAdditiveBS;
 
+    // Files loaded through texture::acquire and mesh::acquire, each one once
+    AssetRegistry asset_registry;
+    bool asset_content_hash; // Set before initialize, see asset_registry.hpp
+
     Mesh meshes[MAX_MESHES];
+    // Every mesh's vertices and indices, see mesh::bind_geometry
+    GeometryArena geometry_arena;
     Material materials[MAX_MATERIALS];
 
+    // Every material's values and textures, bound once per pass instead of per material
+    MaterialTable material_table;
+    bool material_table_dirty; // A material was created, changed or destroyed since the last rebuild
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> material_arrays[MATERIAL_TEXTURE_ARRAYS];
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> material_array_srvs[MATERIAL_TEXTURE_ARRAYS];
+    Microsoft::WRL::ComPtr<ID3D11Buffer> material_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> material_srv;
+    uint32_t material_binds;    // Last frame, material table binds
+    uint32_t material_switches; // Last frame, each used to be a material bind of its own
+
+    // Whatever only lives for a frame or two, emptied in begin_frame (see arena.hpp)
+    FrameArena frame_arena;
+    // In the frame arena, built after culling for the opaque camera passes
+    DrawItem *opaque_queue;
+    uint32_t opaque_count;
+
     Texture textures[MAX_TEXTURES];
     TextureId amre_fallback_texture;
     TextureId normal_fallback_texture;
 
+    // Mips of the textures from texture::load_streamed, asked for by the
+    // visible materials every frame (see texture_streamer.hpp)
+    TextureStreamer texture_streamer;
+    uint64_t texture_stream_budget; // Set before initialize, GPU bytes
+    MipFileHeader texture_stream_headers[MAX_TEXTURES];
+    char texture_stream_paths[MAX_TEXTURES][MIP_FILE_PATH_MAX];
+
     Light lights[MAX_LIGHTS];
 
     /** @brief Pointer to the current window */
     Window *pWindow = NULL;
+    // Size the targets are made for. Frames read this and not the window,
+    // the window can change size on another thread.
+    uint16_t width;
+    uint16_t height;
 
     ShaderId fullscreen_triangle_vs;
     PipelineId pbr_shader;
@@ -197,6 +342,8 @@ struct Renderer {
 
     // G-Buffer
     PipelineId gbuffer_pipeline;
+    // Material variants of the G-buffer or the Forward+ opaque pixel shader, whichever is used
+    ShaderPermutationSet opaque_permutations;
     Microsoft::WRL::ComPtr<ID3D11Buffer> gbuffer_cb_ptr;
     TextureId gbuffer_rt0;
     TextureId gbuffer_rt1;
@@ -207,6 +354,47 @@ struct Renderer {
     Microsoft::WRL::ComPtr<ID3D11Buffer> light_buffer;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> light_srv;
 
+    // Clustered light culling (used by both the lighting pass and Forward+)
+    PipelineId light_cluster_shader;
+    bool gpu_light_culling;
+    uint32_t directional_light_count;
+    uint32_t local_light_count;
+    ClusterLight cluster_lights[MAX_SCENE_LIGHTS];
+    LightClusterGrid cluster_grid;
+    LightClusterList cluster_list; // CPU fallback output
+    Microsoft::WRL::ComPtr<ID3D11Buffer> cluster_bounds_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cluster_bounds_srv;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> cluster_light_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cluster_light_srv;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> cluster_count_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cluster_count_srv;
+    Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> cluster_count_uav;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> cluster_index_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cluster_index_srv;
+    Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> cluster_index_uav;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> cluster_cb_ptr;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> light_culling_cb_ptr;
+
+    // Meshlets culled against the active camera, the camera passes draw what's left.
+    // Shadows draw whole meshes, the cones only hold for the camera.
+    bool meshlet_culling;
+    MeshletDraw meshlet_draws[MAX_MESHLET_DRAWS];
+    uint32_t meshlet_draw_start[MAX_SCENE_MESHES];
+    uint32_t meshlet_draw_count[MAX_SCENE_MESHES]; // Per scene mesh, or MESHLET_DRAW_WHOLE
+    uint32_t meshlets_total;   // Last frame
+    uint32_t meshlets_visible; // Last frame
+
+    // Hi-Z occlusion culling, see occlusion.hpp. Like the meshlets only for the camera passes.
+    bool occlusion_culling;
+    PipelineId hiz_shader;
+    TextureId hiz_texture;
+    Microsoft::WRL::ComPtr<ID3D11Buffer> hiz_cb_ptr;
+    HiZReadback hiz_readbacks[HIZ_FRAME_LATENCY];
+    uint32_t hiz_frame_index; // Readback the next reduction goes into
+    HiZPyramid hiz_pyramid;
+    bool mesh_occluded[MAX_SCENE_MESHES];
+    uint32_t occluded_meshes; // Last frame
+
     // Depth prepass (Forward+)
     PipelineId zpass_pipeline;
     TextureId z_depth;
@@ -220,16 +408,32 @@ struct Renderer {
     TextureId ping_pong_color1;
     PipelineId post_shader;
 
-    // Pipeline States
-    Microsoft::WRL::ComPtr<ID3D11RasterizerState> rasterizer_states[RASTER_STATE_COUNT];
-    Microsoft::WRL::ComPtr<ID3D11DepthStencilState> depth_states[DEPTH_STATE_COUNT];
-    Microsoft::WRL::ComPtr<ID3D11BlendState> blend_states[BLEND_STATE_COUNT];
+    // Pipeline States, the ids are into pipeline_system
+    PipelineSystemState pipeline_system;
+    RasterizerStateId rasterizer_states[RASTER_STATE_COUNT];
+    DepthStencilStateId depth_states[DEPTH_STATE_COUNT];
+    BlendStateId blend_states[BLEND_STATE_COUNT];
     Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler_states[SAMPLER_STATE_COUNT];
 
     // Shadow Pass
     TextureId shadow_atlas;
+    TextureId shadow_static_atlas; // Static casters only, restored into shadow_atlas
     PipelineId shadowpass_shader;
+    PipelineId shadow_restore_shader;
+    PipelineId shadow_clear_shader;
     Microsoft::WRL::ComPtr<ID3D11Buffer> shadowpass_cb_ptr;
+    float shadow_distance;     // Cascades cover the view up to this far
+    float shadow_split_lambda; // 0 uniform, 1 logarithmic splits
+    ShadowAtlas shadow_allocator;
+    ShadowAtlasEntry shadow_entries[MAX_SHADOW_VIEWS];
+    uint32_t shadow_view_count;
+    uint32_t shadow_caster_draws;  // Last frame, all views together
+    uint32_t shadow_views_updated; // Last frame, views that weren't left cached
+    Microsoft::WRL::ComPtr<ID3D11Buffer> shadow_view_buffer;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadow_view_srv;
+
+    // GPU timings, only used when enabled (benchmarks)
+    Profiler profiler;
 };
 
 namespace renderer {
@@ -247,11 +451,17 @@ PipelineId create_lighting_pass_pipeline(Renderer *renderer);
 PipelineId create_depth_prepass(Renderer *renderer);
 PipelineId create_forward_plus_opaque(Renderer *renderer);
 bool create_post_process_pipeline(Renderer *renderer, PipelineId *out_pipeline);
+bool create_light_culling(Renderer *renderer);
+bool create_occlusion_culling(Renderer *renderer);
 
 void begin_frame(Renderer *renderer, Scene *scene);
 void end_frame(Renderer *renderer);
 void render(Renderer *renderer, Scene *scene);
 
+void render_light_culling(Renderer *renderer, Scene *scene);
+void cull_occluded(Renderer *renderer, Scene *scene);
+void cull_meshlets(Renderer *renderer, Scene *scene);
+void render_hiz(Renderer *renderer, Scene *scene, Texture *depth);
 void render_gbuffer(Renderer *renderer, Scene *scene, Texture *rt0, Texture *rt1, Texture *rt2, Texture *depth);
 void render_lighting_pass(Renderer *renderer, Scene *scene, Texture *gbuffer_a, Texture *gbuffer_b, Texture *gbuffer_c, Texture *depth, Texture *irradiance_map, Texture *prefilter_map, Texture *brdf_lut, Texture *shadow_atlas, ID3D11ShaderResourceView *lights, Texture *rt);
 void render_bloom_pass(Renderer *renderer, Texture *color_buffer, Texture **bloom_mips, uint32_t mip_count);
@@ -0,0 +1,207 @@
+#include "replay.hpp"
+
+#include "logger.hpp"
+#include "scene.hpp"
+
+#include <DirectXMath.h>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#define REPLAY_FILE_MAGIC "pbr-replay"
+#define REPLAY_FILE_VERSION 1
+
+void replay::clear(Replay *replay) {
+    assert(replay && "replay::clear: replay pointer cannot be NULL");
+    replay->key_count = 0;
+    replay->is_recording = false;
+}
+
+bool replay::load(Replay *replay, const char *path) {
+    assert(replay && "replay::load: replay pointer cannot be NULL");
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        LOG("%s: Couldn't open replay file: %s", __func__, path);
+        return false;
+    }
+
+    clear(replay);
+
+    // Header is just the magic and the version on the first line
+    char magic[16] = {};
+    int version = 0;
+    if (fscanf(file, "%15s %d", magic, &version) != 2 || strcmp(magic, REPLAY_FILE_MAGIC) != 0) {
+        LOG("%s: %s is not a replay file", __func__, path);
+        fclose(file);
+        return false;
+    }
+
+    if (version != REPLAY_FILE_VERSION) {
+        LOG("%s: Unsupported replay version %d in %s", __func__, version, path);
+        fclose(file);
+        return false;
+    }
+
+    // One key per line: time yaw pitch distance target.x target.y target.z
+    ReplayKey key;
+    while (fscanf(file, "%f %f %f %f %f %f %f", &key.time, &key.yaw, &key.pitch, &key.distance, &key.target.x, &key.target.y, &key.target.z) == 7) {
+        if (replay->key_count >= MAX_REPLAY_KEYS) {
+            LOG("%s: Replay %s has more than %d keys, the rest is ignored", __func__, path, MAX_REPLAY_KEYS);
+            break;
+        }
+
+        // Keys have to be in order for the sampling to work
+        if (replay->key_count > 0 && key.time < replay->keys[replay->key_count - 1].time) {
+            LOG("%s: Replay %s has out of order keys", __func__, path);
+            fclose(file);
+            clear(replay);
+            return false;
+        }
+
+        replay->keys[replay->key_count++] = key;
+    }
+
+    fclose(file);
+
+    if (replay->key_count == 0) {
+        LOG("%s: Replay %s has no keys", __func__, path);
+        return false;
+    }
+
+    return true;
+}
+
+bool replay::save(const Replay *replay, const char *path) {
+    assert(replay && "replay::save: replay pointer cannot be NULL");
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        LOG("%s: Couldn't open replay file for writing: %s", __func__, path);
+        return false;
+    }
+
+    fprintf(file, "%s %d\n", REPLAY_FILE_MAGIC, REPLAY_FILE_VERSION);
+    for (uint32_t i = 0; i < replay->key_count; ++i) {
+        const ReplayKey *k = &replay->keys[i];
+        // %.9g round trips floats exactly, so playback is bit identical
+        fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", k->time, k->yaw, k->pitch, k->distance, k->target.x, k->target.y, k->target.z);
+    }
+
+    fclose(file);
+    return true;
+}
+
+void replay::generate_orbit(Replay *replay, float duration, float revolutions, float distance, float pitch, DirectX::XMFLOAT3 target) {
+    assert(replay && "replay::generate_orbit: replay pointer cannot be NULL");
+    clear(replay);
+
+    // A key every 1/10th of a second is plenty, sampling interpolates between them
+    uint32_t count = (uint32_t)(duration * 10.0f) + 1;
+    if (count > MAX_REPLAY_KEYS) count = MAX_REPLAY_KEYS;
+    if (count < 2) count = 2;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        float t = (float)i / (float)(count - 1);
+        ReplayKey *k = &replay->keys[i];
+        k->time = t * duration;
+        k->yaw = t * revolutions * DirectX::XM_2PI;
+        k->pitch = pitch;
+        k->distance = distance;
+        k->target = target;
+    }
+    replay->key_count = count;
+}
+
+void replay::record(Replay *replay, float time, Scene *scene) {
+    assert(replay && scene && "replay::record: replay and scene pointers cannot be NULL");
+
+    if (!replay->is_recording || !scene->active_cam) {
+        return;
+    }
+
+    if (replay->key_count >= MAX_REPLAY_KEYS) {
+        LOG("%s: Replay is full, stopping the recording", __func__);
+        replay->is_recording = false;
+        return;
+    }
+
+    const SceneCamera *cam = scene->active_cam;
+    ReplayKey *k = &replay->keys[replay->key_count++];
+    k->time = time;
+    k->yaw = cam->yaw;
+    k->pitch = cam->pitch;
+    k->distance = cam->distance;
+    k->target = cam->target;
+}
+
+bool replay::sample(const Replay *replay, float time, ReplayKey *out_key) {
+    assert(replay && out_key && "replay::sample: replay and out_key pointers cannot be NULL");
+
+    if (replay->key_count == 0) {
+        return false;
+    }
+
+    const ReplayKey *first = &replay->keys[0];
+    const ReplayKey *last = &replay->keys[replay->key_count - 1];
+    if (time <= first->time) {
+        *out_key = *first;
+        return true;
+    }
+    if (time >= last->time) {
+        *out_key = *last;
+        return true;
+    }
+
+    // Binary search for the first key past the time
+    uint32_t lo = 0;
+    uint32_t hi = replay->key_count - 1;
+    while (lo + 1 < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (replay->keys[mid].time <= time) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const ReplayKey *a = &replay->keys[lo];
+    const ReplayKey *b = &replay->keys[hi];
+    float span = b->time - a->time;
+    float t = span > 0.0f ? (time - a->time) / span : 0.0f;
+
+    out_key->time = time;
+    out_key->yaw = a->yaw + (b->yaw - a->yaw) * t;
+    out_key->pitch = a->pitch + (b->pitch - a->pitch) * t;
+    out_key->distance = a->distance + (b->distance - a->distance) * t;
+    out_key->target.x = a->target.x + (b->target.x - a->target.x) * t;
+    out_key->target.y = a->target.y + (b->target.y - a->target.y) * t;
+    out_key->target.z = a->target.z + (b->target.z - a->target.z) * t;
+
+    return true;
+}
+
+float replay::get_duration(const Replay *replay) {
+    assert(replay && "replay::get_duration: replay pointer cannot be NULL");
+    return replay->key_count > 0 ? replay->keys[replay->key_count - 1].time : 0.0f;
+}
+
+void replay::apply(const Replay *replay, float time, Scene *scene) {
+    assert(replay && scene && "replay::apply: replay and scene pointers cannot be NULL");
+
+    if (!scene->active_cam) {
+        return;
+    }
+
+    ReplayKey key;
+    if (!sample(replay, time, &key)) {
+        return;
+    }
+
+    // Order matters here: yaw/pitch rebuilds the position from target and distance
+    Id cam_id = scene->active_cam->id;
+    scene::camera_set_target(scene, cam_id, key.target);
+    scene::camera_set_distance(scene, cam_id, key.distance);
+    scene::camera_set_yaw_pitch(scene, cam_id, key.yaw, key.pitch);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+#define MAX_REPLAY_KEYS 8192
+
+struct Scene;
+
+// A single sample of the orbit camera. The orbit camera is fully described
+// by its target and yaw/pitch/distance, so that is all we record.
+struct ReplayKey {
+    float time;
+    float yaw;
+    float pitch;
+    float distance;
+    DirectX::XMFLOAT3 target;
+};
+
+struct Replay {
+    ReplayKey keys[MAX_REPLAY_KEYS];
+    uint32_t key_count;
+    bool is_recording;
+};
+
+namespace replay {
+
+void clear(Replay *replay);
+bool load(Replay *replay, const char *path);
+bool save(const Replay *replay, const char *path);
+
+// Builds a simple orbit around the target, used when no recorded path was given
+void generate_orbit(Replay *replay, float duration, float revolutions, float distance, float pitch, DirectX::XMFLOAT3 target);
+
+// Records the active camera of the scene at the given time
+void record(Replay *replay, float time, Scene *scene);
+
+// Samples the path at the given time (clamped to the ends, linearly interpolated)
+bool sample(const Replay *replay, float time, ReplayKey *out_key);
+float get_duration(const Replay *replay);
+
+// Drives the active camera of the scene from the path
+void apply(const Replay *replay, float time, Scene *scene);
+
+} // namespace replay
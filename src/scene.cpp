@@ -3,10 +3,12 @@
 #include "application.hpp"
 #include "light.hpp"
 #include "logger.hpp"
+#include "mesh.hpp"
 #include "renderer.hpp"
 
 #include <DirectXMath.h>
 #include <cassert>
+#include <cmath>
 
 bool scene::initialize(Scene *out_scene) {
     assert(out_scene && "scene::initialize: out_scene CANNOT be NULL");
@@ -53,6 +55,8 @@ Id scene::add_mesh(Scene *scene, Id mesh_id, Id material_id, DirectX::XMFLOAT3 p
     sm->rotation = rotation;
     sm->scale = scale;
     sm->is_dirty = true;
+    sm->is_static = true;
+    sm->transform_version = 0;
 
     // Compute the world matrix so we have it in cache based on defaults
     mesh_get_world_matrix(scene, mesh_id);
@@ -61,6 +65,23 @@ Id scene::add_mesh(Scene *scene, Id mesh_id, Id material_id, DirectX::XMFLOAT3 p
     return sm->id;
 }
 
+void scene::remove_mesh(Scene *scene, SceneId scene_mesh_id) {
+    assert(scene && "scene::remove_mesh: Scene pointer cannot be NULL");
+
+    if (id::is_invalid(scene_mesh_id) || scene_mesh_id.id >= MAX_SCENE_MESHES) {
+        return;
+    }
+    SceneMesh *sm = &scene->meshes[scene_mesh_id.id];
+    if (!id::is_fresh(sm->id, scene_mesh_id)) {
+        return;
+    }
+
+    // The next mesh in the slot gets the next generation, the static shadows see a different caster
+    id::invalidate(&sm->id);
+    sm->id.generation = scene_mesh_id.generation;
+    id::gen_increment(&sm->id);
+}
+
 SceneId scene::add_camera(Scene *scene, float fov, float znear, float zfar, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 target) {
     assert(scene && "scene::add_camera: scene pointer cannot be NULL");
 
@@ -146,7 +167,8 @@ InstanceId scene::add_light(Scene *scene, Id light_id, DirectX::XMFLOAT3 positio
     light->enabled = true;
     light->position = position;
     light->target = target;
-    light->shadowmap_index = 1;
+    light->shadowmap_index = SHADOWMAP_INDEX_NONE;
+    light->shadowmap_count = 0;
     light->cast_shadows = cast_shadows;
 
     light->is_view_dirty = true;
@@ -170,9 +192,10 @@ void scene::bind_mesh_instance(Renderer *renderer, Scene *scene, Id mesh_instanc
     CBPerObject *perObjectPtr = (CBPerObject *)map.pData;
     perObjectPtr->worldMatrix = scene::mesh_get_world_matrix(scene, mesh_instance_id);
     perObjectPtr->worldInvTrans = scene::mesh_get_world_inv_transpose_matrix(scene, mesh_instance_id);
+    perObjectPtr->material_index = scene->meshes[mesh_instance_id.id].material_id.id;
 
     renderer->context->Unmap(renderer->pCBPerObject.Get(), 0);
-    renderer->context->VSSetConstantBuffers((UINT)start_slot, 1, renderer->pCBPerObject.GetAddressOf());
+    state_tracker::set_constant_buffers(&renderer->state_tracker, SHADER_STAGE_VS, (UINT)start_slot, 1, renderer->pCBPerObject.GetAddressOf());
 }
 
 DirectX::XMFLOAT3 scene::mesh_get_rotation(Scene *scene, SceneId scene_mesh_id) {
@@ -265,6 +288,29 @@ DirectX::XMFLOAT4X4 scene::mesh_get_world_inv_transpose_matrix(Scene *scene, Sce
     return sm->world_inv_transpose;
 }
 
+bool scene::mesh_get_world_bounds(Scene *scene, SceneId scene_mesh_id, DirectX::XMFLOAT3 *out_center, float *out_radius) {
+    assert(scene && out_center && out_radius && "scene::mesh_get_world_bounds: Pointers cannot be NULL");
+
+    SceneMesh *sm = &scene->meshes[scene_mesh_id.id];
+    if (id::is_stale(sm->id, scene_mesh_id)) {
+        return false;
+    }
+
+    Mesh *mesh = mesh::get(application::get_renderer(), sm->mesh_id);
+    if (!mesh) {
+        return false;
+    }
+
+    // Rotation doesn't change the radius, only the largest scale axis does
+    DirectX::XMFLOAT4X4 world = mesh_get_world_matrix(scene, scene_mesh_id);
+    DirectX::XMVECTOR center = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&mesh->bounds_center), DirectX::XMLoadFloat4x4(&world));
+    float scale = std::fmax(std::fabs(sm->scale.x), std::fmax(std::fabs(sm->scale.y), std::fabs(sm->scale.z)));
+
+    DirectX::XMStoreFloat3(out_center, center);
+    *out_radius = mesh->bounds_radius * scale;
+    return true;
+}
+
 DirectX::XMFLOAT4X4 scene::camera_get_view_projection_matrix(SceneCamera *camera) {
     assert(camera && "scene::camera_get_view_projection_matrix: Camera pointer cannot be NULL");
 
@@ -418,7 +464,7 @@ DirectX::XMFLOAT4X4 scene::light_get_projection_matrix(Scene *scene, Id light_id
         Renderer *renderer = application::get_renderer();
 
         // Fetch the light
-        Light *light = light::get(renderer, light_id);
+        Light *light = light::get(renderer, light_instance->light_id);
         if (!light) {
             return DirectX::XMFLOAT4X4{
                 1, 0, 0, 0,
@@ -435,6 +481,15 @@ DirectX::XMFLOAT4X4 scene::light_get_projection_matrix(Scene *scene, Id light_id
                     500.0f, 500.0f,
                     0.1f, 200.0f);
                 break;
+            case LIGHT_TYPE_SPOT:
+                projection_matrix = DirectX::XMMatrixPerspectiveFovLH(
+                    light->spot_outer_angle * 2.0f, 1.0f,
+                    0.1f, std::fmax(light->range, 0.2f));
+                break;
+            case LIGHT_TYPE_POINT:
+                // No single projection covers a point light, they don't cast shadows (yet)
+                projection_matrix = DirectX::XMMatrixIdentity();
+                break;
         }
 
         DirectX::XMStoreFloat4x4(&light_instance->projection_matrix, projection_matrix);
@@ -475,7 +530,7 @@ DirectX::XMFLOAT4X4 scene::light_get_view_projection_matrix(Scene *scene, Id lig
         Renderer *renderer = application::get_renderer();
 
         // Fetch the light
-        Light *light = light::get(renderer, light_id);
+        Light *light = light::get(renderer, light_instance->light_id);
         if (!light) {
             return DirectX::XMFLOAT4X4{
                 1, 0, 0, 0,
@@ -492,6 +547,15 @@ DirectX::XMFLOAT4X4 scene::light_get_view_projection_matrix(Scene *scene, Id lig
                     50.0f, 50.0f,
                     0.1f, 200.0f);
                 break;
+            case LIGHT_TYPE_SPOT:
+                projection_matrix = DirectX::XMMatrixPerspectiveFovLH(
+                    light->spot_outer_angle * 2.0f, 1.0f,
+                    0.1f, std::fmax(light->range, 0.2f));
+                break;
+            case LIGHT_TYPE_POINT:
+                // No single projection covers a point light, they don't cast shadows (yet)
+                projection_matrix = DirectX::XMMatrixIdentity();
+                break;
         }
 
         DirectX::XMStoreFloat4x4(&light_instance->projection_matrix, projection_matrix);
@@ -518,6 +582,7 @@ void scene::mesh_set_position(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3
     if (id::is_fresh(sm->id, scene_mesh_id)) {
         sm->position = position;
         sm->is_dirty = true;
+        sm->transform_version++;
     }
 }
 
@@ -530,6 +595,7 @@ void scene::mesh_set_rotation(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3
     if (id::is_fresh(sm->id, scene_mesh_id)) {
         sm->rotation = rotation;
         sm->is_dirty = true;
+        sm->transform_version++;
     }
 }
 
@@ -542,6 +608,17 @@ void scene::mesh_set_scale(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3 sca
     if (id::is_fresh(sm->id, scene_mesh_id)) {
         sm->scale = scale;
         sm->is_dirty = true;
+        sm->transform_version++;
+    }
+}
+
+void scene::mesh_set_static(Scene *scene, Id scene_mesh_id, bool is_static) {
+    assert(scene && "scene::mesh_set_static: Scene pointer cannot be NULL");
+    assert(scene_mesh_id.id < MAX_SCENE_MESHES && "scene::mesh_set_static: Incorrect Scene Mesh Id");
+
+    SceneMesh *sm = &scene->meshes[scene_mesh_id.id];
+    if (id::is_fresh(sm->id, scene_mesh_id)) {
+        sm->is_static = is_static;
     }
 }
 
@@ -5,10 +5,13 @@
 
 #include <DirectXMath.h>
 
-#define MAX_SCENE_LIGHTS 8
-#define MAX_SCENE_MESHES 6
+#define MAX_SCENE_LIGHTS 254
+#define MAX_SCENE_MESHES 128
 #define MAX_SCENE_CAMERAS 4
 
+// Light instance has no tile in the shadow atlas
+#define SHADOWMAP_INDEX_NONE UINT32_MAX
+
 struct Renderer;
 
 using SceneId = Id;
@@ -26,6 +29,11 @@ struct SceneMesh {
     DirectX::XMFLOAT4X4 world_matrix;
     DirectX::XMFLOAT4X4 world_inv_transpose;
     bool is_dirty;
+
+    // Static meshes are cached in the shadow maps, moving one still works
+    // but redraws the static shadows of every light that sees it
+    bool is_static;
+    uint32_t transform_version; // Bumped on every transform change
 };
 
 struct SceneCamera {
@@ -63,7 +71,8 @@ struct LightInstance {
     bool is_projection_dirty;
     bool is_view_projection_dirty;
 
-    uint32_t shadowmap_index;
+    uint32_t shadowmap_index; // First shadow view of the light
+    uint32_t shadowmap_count;
     bool cast_shadows;
 };
 
@@ -85,11 +94,15 @@ bool initialize(Scene *out_scene);
 SceneId add_mesh(Scene *scene, Id mesh_id, Id material_id, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 rotation, DirectX::XMFLOAT3 scale);
 SceneId add_camera(Scene *scene, float fov, float znear, float zfar, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 target);
 InstanceId add_light(Scene *scene, Id light_id, DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 target, bool cast_shadows);
+// The mesh and material stay loaded, they aren't the instance's
+void remove_mesh(Scene *scene, SceneId scene_mesh_id);
 
 void bind_mesh_instance(Renderer *renderer, Scene *scene, SceneId mesh_instance_id, uint8_t start_slot);
 DirectX::XMFLOAT3 mesh_get_rotation(Scene *scene, SceneId scene_mesh_id);
 DirectX::XMFLOAT4X4 mesh_get_world_matrix(Scene *scene, SceneId scene_mesh_id);
 DirectX::XMFLOAT4X4 mesh_get_world_inv_transpose_matrix(Scene *scene, SceneId scene_mesh_id);
+// World space bounding sphere, false if the mesh instance or its mesh is gone
+bool mesh_get_world_bounds(Scene *scene, SceneId scene_mesh_id, DirectX::XMFLOAT3 *out_center, float *out_radius);
 
 DirectX::XMFLOAT4X4 camera_get_view_projection_matrix(SceneCamera *camera);
 DirectX::XMFLOAT4X4 camera_get_view_matrix(SceneCamera *camera);
@@ -108,6 +121,7 @@ DirectX::XMFLOAT4X4 light_get_view_projection_matrix(Scene *scene, Id light_id);
 void mesh_set_position(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3 position);
 void mesh_set_rotation(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3 rotation);
 void mesh_set_scale(Scene *scene, Id scene_mesh_id, DirectX::XMFLOAT3 scale);
+void mesh_set_static(Scene *scene, Id scene_mesh_id, bool is_static);
 
 void camera_set_active(Scene *scene, Id scene_cam_id);
 void camera_set_active_aspect_ratio(Scene *scene, float aspect_ratio);
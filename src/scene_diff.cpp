@@ -0,0 +1,354 @@
+#include "scene_diff.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+// An old index by its JSON id
+struct OldId {
+    int32_t json_id;
+    uint32_t index;
+};
+
+// What an instance is matched on
+struct InstanceKey {
+    uint32_t scene;
+    int32_t mesh;     // JSON ids
+    int32_t material; // -1 without one
+    uint32_t index;
+    const SceneFileInstance *instance;
+};
+
+static bool begin_list(Arena *arena, uint32_t count, uint32_t old_count, SceneDiffList *out_list, uint8_t **out_taken);
+static void end_list(SceneDiffList *list, uint32_t old_count, const uint8_t *taken);
+static OldId *sort_ids(const void *items, size_t stride, uint32_t count, Arena *arena);
+static uint32_t find_old(const OldId *ids, uint32_t count, int32_t json_id);
+static int old_id_compare(const void *a, const void *b);
+static bool is_same_material(const SceneFile *old_file, const SceneFileMaterial *old_mat, const SceneFile *new_file, const SceneFileMaterial *new_mat, const SceneDiffList *textures);
+static InstanceKey *sort_instances(const SceneFile *file, Arena *arena, uint32_t *out_count);
+static void pair_instances(const InstanceKey *old_keys, uint32_t old_count, const InstanceKey *new_keys, uint32_t new_count, bool is_exact,
+                           const SceneDiffList *meshes, SceneDiffList *instances, uint8_t *taken);
+static uint32_t drop_paired(InstanceKey *keys, uint32_t count, const uint8_t *taken, const SceneDiffList *instances);
+static int instance_exact_compare(const void *a, const void *b);
+static int instance_order_compare(const void *a, const void *b);
+static int compare_keys(const InstanceKey *a, const InstanceKey *b);
+static int compare_transforms(const SceneFileInstance *a, const SceneFileInstance *b);
+static int32_t get_texture_json_id(const SceneFile *file, uint32_t texture);
+
+bool scene_diff::compute(const SceneFile *old_file, const SceneFile *new_file, Arena *arena, SceneDiff *out_diff) {
+    assert(new_file && arena && out_diff && "scene_diff::compute: new_file, arena and out_diff cannot be NULL");
+
+    // Nothing loaded is a file with nothing in it
+    *out_diff = {};
+    SceneFileHeader empty_header = {};
+    SceneFile empty = {};
+    empty.header = &empty_header;
+    old_file = old_file ? old_file : &empty;
+    const SceneFileHeader *old_header = old_file->header;
+    const SceneFileHeader *new_header = new_file->header;
+
+    uint8_t *taken = nullptr;
+    OldId *old_ids = nullptr;
+
+    // Textures, a new file or flag is a new texture
+    SceneDiffList *textures = &out_diff->textures;
+    old_ids = sort_ids(old_file->textures, sizeof(SceneFileTexture), old_header->texture_count, arena);
+    if (!begin_list(arena, new_header->texture_count, old_header->texture_count, textures, &taken) || !old_ids) {
+        LOG("%s: No room for the texture changes", __func__);
+        return false;
+    }
+    for (uint32_t i = 0; i < textures->count; ++i) {
+        const SceneFileTexture *tex = &new_file->textures[i];
+        uint32_t old = find_old(old_ids, old_header->texture_count, tex->json_id);
+        if (old == SCENE_FILE_NONE) {
+            continue;
+        }
+        const SceneFileTexture *old_tex = &old_file->textures[old];
+        bool is_same = old_tex->is_srgb == tex->is_srgb &&
+                       strcmp(scene_file::get_string(old_file, old_tex->path_offset), scene_file::get_string(new_file, tex->path_offset)) == 0;
+        textures->actions[i] = is_same ? SCENE_DIFF_KEEP : SCENE_DIFF_RELOAD;
+        textures->sources[i] = old;
+        taken[old] = 1;
+    }
+    end_list(textures, old_header->texture_count, taken);
+
+    // Meshes, the same for their file
+    SceneDiffList *meshes = &out_diff->meshes;
+    old_ids = sort_ids(old_file->meshes, sizeof(SceneFileMesh), old_header->mesh_count, arena);
+    if (!begin_list(arena, new_header->mesh_count, old_header->mesh_count, meshes, &taken) || !old_ids) {
+        LOG("%s: No room for the mesh changes", __func__);
+        return false;
+    }
+    for (uint32_t i = 0; i < meshes->count; ++i) {
+        const SceneFileMesh *mesh = &new_file->meshes[i];
+        uint32_t old = find_old(old_ids, old_header->mesh_count, mesh->json_id);
+        if (old == SCENE_FILE_NONE) {
+            continue;
+        }
+        bool is_same = strcmp(scene_file::get_string(old_file, old_file->meshes[old].path_offset), scene_file::get_string(new_file, mesh->path_offset)) == 0;
+        meshes->actions[i] = is_same ? SCENE_DIFF_KEEP : SCENE_DIFF_RELOAD;
+        meshes->sources[i] = old;
+        taken[old] = 1;
+    }
+    end_list(meshes, old_header->mesh_count, taken);
+
+    // Materials are changed in place, also when a texture they use was reloaded
+    SceneDiffList *materials = &out_diff->materials;
+    old_ids = sort_ids(old_file->materials, sizeof(SceneFileMaterial), old_header->material_count, arena);
+    if (!begin_list(arena, new_header->material_count, old_header->material_count, materials, &taken) || !old_ids) {
+        LOG("%s: No room for the material changes", __func__);
+        return false;
+    }
+    for (uint32_t i = 0; i < materials->count; ++i) {
+        const SceneFileMaterial *mat = &new_file->materials[i];
+        uint32_t old = find_old(old_ids, old_header->material_count, mat->json_id);
+        if (old == SCENE_FILE_NONE) {
+            continue;
+        }
+        bool is_same = is_same_material(old_file, &old_file->materials[old], new_file, mat, textures);
+        materials->actions[i] = is_same ? SCENE_DIFF_KEEP : SCENE_DIFF_UPDATE;
+        materials->sources[i] = old;
+        taken[old] = 1;
+    }
+    end_list(materials, old_header->material_count, taken);
+
+    // Instances, both sides sorted the same way and walked together. The ones
+    // that didn't move are paired first, so adding one in front of the others
+    // doesn't move them all down. What's left is paired in order, those moved.
+    // An instance of a reloaded mesh is a new one, the old one goes.
+    SceneDiffList *instances = &out_diff->instances;
+    uint32_t old_key_count = 0;
+    uint32_t new_key_count = 0;
+    InstanceKey *old_keys = sort_instances(old_file, arena, &old_key_count);
+    InstanceKey *new_keys = sort_instances(new_file, arena, &new_key_count);
+    if (!begin_list(arena, new_header->instance_count, old_header->instance_count, instances, &taken) || !old_keys || !new_keys) {
+        LOG("%s: No room for the instance changes", __func__);
+        return false;
+    }
+    pair_instances(old_keys, old_key_count, new_keys, new_key_count, true, meshes, instances, taken);
+    old_key_count = drop_paired(old_keys, old_key_count, taken, nullptr);
+    new_key_count = drop_paired(new_keys, new_key_count, nullptr, instances);
+    qsort(old_keys, old_key_count, sizeof(InstanceKey), instance_order_compare);
+    qsort(new_keys, new_key_count, sizeof(InstanceKey), instance_order_compare);
+    pair_instances(old_keys, old_key_count, new_keys, new_key_count, false, meshes, instances, taken);
+    end_list(instances, old_header->instance_count, taken);
+
+    return true;
+}
+
+bool scene_diff::is_empty(const SceneDiff *diff) {
+    const SceneDiffList *lists[] = {&diff->textures, &diff->materials, &diff->meshes, &diff->instances};
+    for (const SceneDiffList *list : lists) {
+        if (list->changed_count > 0 || list->removed_count > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool begin_list(Arena *arena, uint32_t count, uint32_t old_count, SceneDiffList *out_list, uint8_t **out_taken) {
+    *out_list = {};
+    out_list->count = count;
+    out_list->actions = ARENA_PUSH_ARRAY(arena, SceneDiffAction, count);
+    out_list->sources = ARENA_PUSH_ARRAY(arena, uint32_t, count);
+    out_list->removed = ARENA_PUSH_ARRAY(arena, uint32_t, old_count);
+    *out_taken = ARENA_PUSH_ARRAY(arena, uint8_t, old_count);
+    if ((count && (!out_list->actions || !out_list->sources)) || (old_count && (!out_list->removed || !*out_taken))) {
+        return false;
+    }
+
+    // Added until an old one is found
+    for (uint32_t i = 0; i < count; ++i) {
+        out_list->actions[i] = SCENE_DIFF_ADD;
+        out_list->sources[i] = SCENE_FILE_NONE;
+    }
+    if (old_count) {
+        memset(*out_taken, 0, old_count);
+    }
+    return true;
+}
+
+static void end_list(SceneDiffList *list, uint32_t old_count, const uint8_t *taken) {
+    for (uint32_t i = 0; i < list->count; ++i) {
+        list->changed_count += list->actions[i] != SCENE_DIFF_KEEP;
+    }
+    for (uint32_t i = 0; i < old_count; ++i) {
+        if (!taken[i]) {
+            list->removed[list->removed_count++] = i;
+        }
+    }
+}
+
+static OldId *sort_ids(const void *items, size_t stride, uint32_t count, Arena *arena) {
+    OldId *ids = ARENA_PUSH_ARRAY(arena, OldId, count);
+    if (!ids) {
+        return nullptr;
+    }
+
+    // Every item starts with its JSON id
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t json_id;
+        memcpy(&json_id, (const uint8_t *)items + stride * i, sizeof(json_id));
+        ids[i] = {json_id, i};
+    }
+    qsort(ids, count, sizeof(OldId), old_id_compare);
+    return ids;
+}
+
+static uint32_t find_old(const OldId *ids, uint32_t count, int32_t json_id) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (ids[mid].json_id < json_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < count && ids[low].json_id == json_id ? ids[low].index : SCENE_FILE_NONE;
+}
+
+static int old_id_compare(const void *a, const void *b) {
+    const OldId *x = (const OldId *)a;
+    const OldId *y = (const OldId *)b;
+    if (x->json_id != y->json_id) {
+        return (x->json_id > y->json_id) - (x->json_id < y->json_id);
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static bool is_same_material(const SceneFile *old_file, const SceneFileMaterial *old_mat, const SceneFile *new_file, const SceneFileMaterial *new_mat, const SceneDiffList *textures) {
+    if (memcmp(old_mat->albedo, new_mat->albedo, sizeof(new_mat->albedo)) != 0 || old_mat->metallic != new_mat->metallic ||
+        old_mat->roughness != new_mat->roughness || old_mat->coat != new_mat->coat || old_mat->emission != new_mat->emission) {
+        return false;
+    }
+
+    // The same texture by id, and still the same texture
+    for (uint32_t m = 0; m < SCENE_FILE_MAP_COUNT; ++m) {
+        uint32_t map = new_mat->maps[m];
+        if (get_texture_json_id(old_file, old_mat->maps[m]) != get_texture_json_id(new_file, map)) {
+            return false;
+        }
+        if (map != SCENE_FILE_NONE && textures->actions[map] != SCENE_DIFF_KEEP) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static InstanceKey *sort_instances(const SceneFile *file, Arena *arena, uint32_t *out_count) {
+    const SceneFileHeader *header = file->header;
+    *out_count = 0;
+    InstanceKey *keys = ARENA_PUSH_ARRAY(arena, InstanceKey, header->instance_count);
+    if (!keys) {
+        return nullptr;
+    }
+
+    // Instances outside every scene aren't drawn, they don't match anything either
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < header->scene_count; ++s) {
+        const SceneFileScene *scene = &file->scenes[s];
+        for (uint32_t i = 0; i < scene->instance_count; ++i) {
+            uint32_t index = scene->first_instance + i;
+            const SceneFileInstance *instance = &file->instances[index];
+            int32_t material = instance->material == SCENE_FILE_NONE ? -1 : file->materials[instance->material].json_id;
+            keys[count++] = {s, file->meshes[instance->mesh].json_id, material, index, instance};
+        }
+    }
+    qsort(keys, count, sizeof(InstanceKey), instance_exact_compare);
+    *out_count = count;
+    return keys;
+}
+
+static void pair_instances(const InstanceKey *old_keys, uint32_t old_count, const InstanceKey *new_keys, uint32_t new_count, bool is_exact,
+                           const SceneDiffList *meshes, SceneDiffList *instances, uint8_t *taken) {
+    uint32_t o = 0;
+    uint32_t n = 0;
+    while (o < old_count && n < new_count) {
+        int order = compare_keys(&old_keys[o], &new_keys[n]);
+        if (order == 0 && is_exact) {
+            order = compare_transforms(old_keys[o].instance, new_keys[n].instance);
+        }
+        if (order < 0) {
+            o++;
+            continue;
+        }
+        if (order > 0) {
+            n++;
+            continue;
+        }
+
+        const InstanceKey *old_key = &old_keys[o++];
+        const InstanceKey *new_key = &new_keys[n++];
+        if (meshes->actions[new_key->instance->mesh] != SCENE_DIFF_KEEP) {
+            continue;
+        }
+        instances->actions[new_key->index] = is_exact ? SCENE_DIFF_KEEP : SCENE_DIFF_UPDATE;
+        instances->sources[new_key->index] = old_key->index;
+        taken[old_key->index] = 1;
+    }
+}
+
+static uint32_t drop_paired(InstanceKey *keys, uint32_t count, const uint8_t *taken, const SceneDiffList *instances) {
+    // Old ones by taken, new ones by their action
+    uint32_t left = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        bool is_paired = taken ? taken[keys[i].index] != 0 : instances->actions[keys[i].index] != SCENE_DIFF_ADD;
+        if (!is_paired) {
+            keys[left++] = keys[i];
+        }
+    }
+    return left;
+}
+
+static int instance_exact_compare(const void *a, const void *b) {
+    const InstanceKey *x = (const InstanceKey *)a;
+    const InstanceKey *y = (const InstanceKey *)b;
+    int order = compare_keys(x, y);
+    if (order == 0) {
+        order = compare_transforms(x->instance, y->instance);
+    }
+    if (order != 0) {
+        return order;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int instance_order_compare(const void *a, const void *b) {
+    const InstanceKey *x = (const InstanceKey *)a;
+    const InstanceKey *y = (const InstanceKey *)b;
+    int order = compare_keys(x, y);
+    if (order != 0) {
+        return order;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compare_keys(const InstanceKey *a, const InstanceKey *b) {
+    if (a->scene != b->scene) {
+        return (a->scene > b->scene) - (a->scene < b->scene);
+    }
+    if (a->mesh != b->mesh) {
+        return (a->mesh > b->mesh) - (a->mesh < b->mesh);
+    }
+    return (a->material > b->material) - (a->material < b->material);
+}
+
+static int compare_transforms(const SceneFileInstance *a, const SceneFileInstance *b) {
+    // Any order does as long as the same bytes compare equal
+    int order = memcmp(a->position, b->position, sizeof(a->position));
+    if (order == 0) {
+        order = memcmp(a->rotation, b->rotation, sizeof(a->rotation));
+    }
+    if (order == 0) {
+        order = memcmp(a->scale, b->scale, sizeof(a->scale));
+    }
+    return order;
+}
+
+static int32_t get_texture_json_id(const SceneFile *file, uint32_t texture) {
+    return texture == SCENE_FILE_NONE ? -1 : file->textures[texture].json_id;
+}
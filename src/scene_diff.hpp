@@ -0,0 +1,49 @@
+#pragma once
+
+#include "arena.hpp"
+#include "scene_file.hpp"
+
+#include <cstdint>
+
+// What changed between two scene files, for applying a new config on top of
+// the loaded one without loading everything again. Textures, materials and
+// meshes are matched by their JSON id. Instances have no id, within a scene
+// they're matched by their mesh and material: one that's still where it was
+// is kept, the rest of that mesh and material are paired in order and moved.
+// Adding or removing one doesn't touch the others. Cameras are left out,
+// input drives them once they're loaded.
+//
+// Only compares the two files, nothing is loaded or changed.
+
+enum SceneDiffAction : uint8_t {
+    SCENE_DIFF_KEEP,   // The same as the old one, nothing to do
+    SCENE_DIFF_UPDATE, // Materials with new values, instances that moved: changed in place
+    SCENE_DIFF_RELOAD, // Textures and meshes with a new file or flag: the new one loaded, the old one released
+    SCENE_DIFF_ADD,    // Not in the old file
+};
+
+// One kind of thing in the new file against the old one
+struct SceneDiffList {
+    SceneDiffAction *actions; // Per new index
+    uint32_t *sources;        // Per new index, the old index it came from (SCENE_FILE_NONE when added)
+    uint32_t count;
+    uint32_t *removed; // Old indices nothing came from, ascending
+    uint32_t removed_count;
+    uint32_t changed_count; // Anything but kept
+};
+
+struct SceneDiff {
+    SceneDiffList textures;
+    SceneDiffList materials;
+    SceneDiffList meshes;
+    SceneDiffList instances;
+};
+
+namespace scene_diff {
+
+// old_file can be NULL when nothing is loaded yet, everything is added then.
+// The lists are pushed on the arena, false when they don't fit.
+bool compute(const SceneFile *old_file, const SceneFile *new_file, Arena *arena, SceneDiff *out_diff);
+bool is_empty(const SceneDiff *diff);
+
+} // namespace scene_diff
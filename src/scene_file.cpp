@@ -0,0 +1,634 @@
+#include "scene_file.hpp"
+
+#include "logger.hpp"
+#include "vfs.hpp"
+
+#include <atomic>
+#include <cJSON.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Bump when the layout changes, older files don't open
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_MAGIC 0x454E4353u // "SCNE"
+// Of every array in the block, and of the block itself
+#define SCENE_FILE_ALIGNMENT 8
+
+// What a JSON id resolved to
+struct JsonId {
+    int32_t json_id;
+    uint32_t index;
+};
+
+struct JsonIds {
+    JsonId *ids;
+    uint32_t count;
+    int32_t first_missing; // What the first one without an id gets, the rest count up from it
+};
+
+static const char *s_map_names[SCENE_FILE_MAP_COUNT] = {"albedo_map", "metallic_map", "roughness_map", "coat_map", "normal_map", "emission_map"};
+
+// Two writers of the same file at once don't share a temp file
+static std::atomic<uint32_t> temp_counter{0};
+
+static bool collect_ids(const cJSON *array, bool needs_path, const char *what, Arena *arena, JsonIds *out_ids, uint64_t *strings_size);
+static uint32_t find_id(const JsonIds *ids, int32_t json_id);
+static int32_t get_id(const cJSON *object, int32_t *next_missing);
+static int json_id_compare(const void *a, const void *b);
+static const cJSON *get_array(const cJSON *object, const char *name);
+static const char *get_path(const cJSON *object);
+static int32_t get_int(const cJSON *object, const char *name, int32_t fallback);
+static float get_float(const cJSON *object, const char *name, float fallback);
+static float to_float(const cJSON *number);
+static void get_float3(const cJSON *object, const char *name, float x, float y, float z, float *out);
+static bool get_flag(const cJSON *object, const char *name);
+static void add_float(cJSON *object, const char *name, float value);
+static void add_float3(cJSON *object, const char *name, const float *v);
+static double get_shortest(float value);
+static bool is_array_in_bounds(uint64_t offset, uint64_t count, size_t element_size, size_t size);
+static uint64_t align_up(uint64_t offset, uint64_t alignment);
+static bool write_file(const char *path, const void *data, size_t size);
+
+bool scene_file::open(SceneFile *file, const uint8_t *data, size_t size) {
+    assert(file && data && "scene_file::open: file and data cannot be NULL");
+
+    *file = {};
+    if (size < sizeof(SceneFileHeader) || (uintptr_t)data % SCENE_FILE_ALIGNMENT != 0) {
+        return false;
+    }
+    const SceneFileHeader *header = (const SceneFileHeader *)data;
+    if (header->magic != SCENE_FILE_MAGIC || header->version != SCENE_FILE_VERSION || header->file_size != size ||
+        !is_array_in_bounds(header->textures_offset, header->texture_count, sizeof(SceneFileTexture), size) ||
+        !is_array_in_bounds(header->materials_offset, header->material_count, sizeof(SceneFileMaterial), size) ||
+        !is_array_in_bounds(header->meshes_offset, header->mesh_count, sizeof(SceneFileMesh), size) ||
+        !is_array_in_bounds(header->scenes_offset, header->scene_count, sizeof(SceneFileScene), size) ||
+        !is_array_in_bounds(header->cameras_offset, header->camera_count, sizeof(SceneFileCamera), size) ||
+        !is_array_in_bounds(header->instances_offset, header->instance_count, sizeof(SceneFileInstance), size) ||
+        !is_array_in_bounds(header->strings_offset, header->strings_size, 1, size)) {
+        return false;
+    }
+
+    SceneFile f = {};
+    f.data = data;
+    f.size = size;
+    f.header = header;
+    f.textures = (const SceneFileTexture *)(data + header->textures_offset);
+    f.materials = (const SceneFileMaterial *)(data + header->materials_offset);
+    f.meshes = (const SceneFileMesh *)(data + header->meshes_offset);
+    f.scenes = (const SceneFileScene *)(data + header->scenes_offset);
+    f.cameras = (const SceneFileCamera *)(data + header->cameras_offset);
+    f.instances = (const SceneFileInstance *)(data + header->instances_offset);
+    f.strings = (const char *)(data + header->strings_offset);
+    if (header->strings_size > 0 && f.strings[header->strings_size - 1] != '\0') {
+        return false;
+    }
+
+    // Every index has to land, whatever loads it only looks them up
+    for (uint32_t i = 0; i < header->texture_count; ++i) {
+        if (f.textures[i].path_offset >= header->strings_size) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->mesh_count; ++i) {
+        if (f.meshes[i].path_offset >= header->strings_size) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->material_count; ++i) {
+        for (uint32_t m = 0; m < SCENE_FILE_MAP_COUNT; ++m) {
+            uint32_t map = f.materials[i].maps[m];
+            if (map != SCENE_FILE_NONE && map >= header->texture_count) {
+                return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < header->scene_count; ++i) {
+        const SceneFileScene *scene = &f.scenes[i];
+        if ((uint64_t)scene->first_camera + scene->camera_count > header->camera_count ||
+            (uint64_t)scene->first_instance + scene->instance_count > header->instance_count) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->instance_count; ++i) {
+        const SceneFileInstance *instance = &f.instances[i];
+        if (instance->mesh >= header->mesh_count || (instance->material != SCENE_FILE_NONE && instance->material >= header->material_count)) {
+            return false;
+        }
+    }
+
+    *file = f;
+    return true;
+}
+
+bool scene_file::read(const char *path, Arena *arena, SceneFile *out_file) {
+    assert(path && arena && out_file && "scene_file::read: path, arena and out_file cannot be NULL");
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    if (!vfs::read(path, arena, &data, &size)) {
+        LOG("%s: Couldn't read %s", __func__, path);
+        return false;
+    }
+
+    uint32_t magic = 0;
+    if (size >= sizeof(magic)) {
+        memcpy(&magic, data, sizeof(magic));
+    }
+    if (magic != SCENE_FILE_MAGIC) {
+        return from_json((const char *)data, size, arena, out_file);
+    }
+    if (!open(out_file, data, size)) {
+        LOG("%s: %s isn't a scene file of this version, compile it again", __func__, path);
+        return false;
+    }
+    return true;
+}
+
+const char *scene_file::get_string(const SceneFile *file, uint32_t offset) {
+    return file->strings + offset;
+}
+
+bool scene_file::from_json(const char *text, size_t length, Arena *arena, SceneFile *out_file) {
+    assert(text && arena && out_file && "scene_file::from_json: text, arena and out_file cannot be NULL");
+
+    cJSON *root = cJSON_ParseWithLength(text, length);
+    if (!root) {
+        const char *error = cJSON_GetErrorPtr();
+        LOG("%s: Not valid JSON, at byte %llu", __func__, (unsigned long long)(error ? error - text : 0));
+        return false;
+    }
+
+    // Counts and ids first, the block is pushed once at its exact size
+    const cJSON *textures = get_array(root, "textures");
+    const cJSON *materials = get_array(root, "materials");
+    const cJSON *meshes = get_array(root, "meshes");
+    const cJSON *scenes = get_array(root, "scenes");
+    uint64_t strings_size = 0;
+    JsonIds texture_ids = {};
+    JsonIds material_ids = {};
+    JsonIds mesh_ids = {};
+    if (!collect_ids(textures, true, "textures", arena, &texture_ids, &strings_size) ||
+        !collect_ids(materials, false, "materials", arena, &material_ids, &strings_size) ||
+        !collect_ids(meshes, true, "meshes", arena, &mesh_ids, &strings_size)) {
+        cJSON_Delete(root);
+        return false;
+    }
+
+    uint32_t scene_count = 0;
+    uint32_t camera_count = 0;
+    uint32_t instance_count = 0;
+    const cJSON *scene = nullptr;
+    cJSON_ArrayForEach(scene, scenes) {
+        scene_count++;
+        camera_count += (uint32_t)cJSON_GetArraySize(get_array(scene, "cameras"));
+        const cJSON *instance = nullptr;
+        cJSON_ArrayForEach(instance, get_array(scene, "meshes")) {
+            int32_t mesh_id = get_int(instance, "mesh_id", -1);
+            if (find_id(&mesh_ids, mesh_id) == SCENE_FILE_NONE) {
+                LOG("%s: Mesh %d isn't there, its instance is left out", __func__, mesh_id);
+                continue;
+            }
+            instance_count++;
+        }
+    }
+
+    SceneFileHeader header = {};
+    header.magic = SCENE_FILE_MAGIC;
+    header.version = SCENE_FILE_VERSION;
+    header.texture_count = texture_ids.count;
+    header.material_count = material_ids.count;
+    header.mesh_count = mesh_ids.count;
+    header.scene_count = scene_count;
+    header.camera_count = camera_count;
+    header.instance_count = instance_count;
+    header.strings_size = (uint32_t)strings_size;
+    uint64_t offset = sizeof(SceneFileHeader);
+    header.textures_offset = offset;
+    offset = align_up(offset + (uint64_t)texture_ids.count * sizeof(SceneFileTexture), SCENE_FILE_ALIGNMENT);
+    header.materials_offset = offset;
+    offset = align_up(offset + (uint64_t)material_ids.count * sizeof(SceneFileMaterial), SCENE_FILE_ALIGNMENT);
+    header.meshes_offset = offset;
+    offset = align_up(offset + (uint64_t)mesh_ids.count * sizeof(SceneFileMesh), SCENE_FILE_ALIGNMENT);
+    header.scenes_offset = offset;
+    offset = align_up(offset + (uint64_t)scene_count * sizeof(SceneFileScene), SCENE_FILE_ALIGNMENT);
+    header.cameras_offset = offset;
+    offset = align_up(offset + (uint64_t)camera_count * sizeof(SceneFileCamera), SCENE_FILE_ALIGNMENT);
+    header.instances_offset = offset;
+    offset = align_up(offset + (uint64_t)instance_count * sizeof(SceneFileInstance), SCENE_FILE_ALIGNMENT);
+    header.strings_offset = offset;
+    header.file_size = align_up(offset + strings_size, SCENE_FILE_ALIGNMENT);
+
+    uint8_t *data = (uint8_t *)arena::push(arena, (size_t)header.file_size, SCENE_FILE_ALIGNMENT);
+    if (!data) {
+        LOG("%s: No room for %llu bytes of scene", __func__, (unsigned long long)header.file_size);
+        cJSON_Delete(root);
+        return false;
+    }
+    // Padding included, the same JSON always makes the same bytes
+    memset(data, 0, (size_t)header.file_size);
+    memcpy(data, &header, sizeof(header));
+
+    SceneFileTexture *out_textures = (SceneFileTexture *)(data + header.textures_offset);
+    SceneFileMaterial *out_materials = (SceneFileMaterial *)(data + header.materials_offset);
+    SceneFileMesh *out_meshes = (SceneFileMesh *)(data + header.meshes_offset);
+    SceneFileScene *out_scenes = (SceneFileScene *)(data + header.scenes_offset);
+    SceneFileCamera *out_cameras = (SceneFileCamera *)(data + header.cameras_offset);
+    SceneFileInstance *out_instances = (SceneFileInstance *)(data + header.instances_offset);
+    char *out_strings = (char *)(data + header.strings_offset);
+    uint32_t string_offset = 0;
+
+    // Same order as collect_ids kept them, so the index is the count so far and
+    // the ones without an id get the same ones again
+    uint32_t index = 0;
+    int32_t next_missing = texture_ids.first_missing;
+    const cJSON *item = nullptr;
+    cJSON_ArrayForEach(item, textures) {
+        const char *path = get_path(item);
+        if (!path) {
+            continue;
+        }
+        SceneFileTexture *texture = &out_textures[index];
+        texture->json_id = get_id(item, &next_missing);
+        texture->path_offset = string_offset;
+        texture->is_srgb = get_flag(item, "srgb") ? 1 : 0;
+        memcpy(out_strings + string_offset, path, strlen(path) + 1);
+        string_offset += (uint32_t)strlen(path) + 1;
+        index++;
+    }
+
+    index = 0;
+    next_missing = mesh_ids.first_missing;
+    cJSON_ArrayForEach(item, meshes) {
+        const char *path = get_path(item);
+        if (!path) {
+            continue;
+        }
+        SceneFileMesh *mesh = &out_meshes[index];
+        mesh->json_id = get_id(item, &next_missing);
+        mesh->path_offset = string_offset;
+        memcpy(out_strings + string_offset, path, strlen(path) + 1);
+        string_offset += (uint32_t)strlen(path) + 1;
+        index++;
+    }
+
+    index = 0;
+    next_missing = material_ids.first_missing;
+    cJSON_ArrayForEach(item, materials) {
+        SceneFileMaterial *material = &out_materials[index];
+        material->json_id = get_id(item, &next_missing);
+        get_float3(item, "albedo", 1.0f, 1.0f, 1.0f, material->albedo);
+        material->metallic = get_float(item, "metallic", 0.0f);
+        material->roughness = get_float(item, "roughness", 1.0f);
+        material->coat = get_float(item, "coat", 0.0f);
+        material->emission = get_float(item, "emission", 0.0f);
+        for (uint32_t m = 0; m < SCENE_FILE_MAP_COUNT; ++m) {
+            // Negative is the default texture
+            int32_t texture_id = get_int(item, s_map_names[m], -1);
+            material->maps[m] = texture_id < 0 ? SCENE_FILE_NONE : find_id(&texture_ids, texture_id);
+            if (texture_id >= 0 && material->maps[m] == SCENE_FILE_NONE) {
+                LOG("%s: Texture %d of material %d isn't there, it's left out", __func__, texture_id, material->json_id);
+            }
+        }
+        index++;
+    }
+
+    uint32_t scene_index = 0;
+    uint32_t camera_index = 0;
+    uint32_t instance_index = 0;
+    cJSON_ArrayForEach(scene, scenes) {
+        SceneFileScene *out_scene = &out_scenes[scene_index++];
+        out_scene->first_camera = camera_index;
+        out_scene->first_instance = instance_index;
+
+        const cJSON *camera = nullptr;
+        cJSON_ArrayForEach(camera, get_array(scene, "cameras")) {
+            SceneFileCamera *out_camera = &out_cameras[camera_index++];
+            out_camera->fov = get_float(camera, "fov", 45.0f);
+            out_camera->znear = get_float(camera, "znear", 0.1f);
+            out_camera->zfar = get_float(camera, "zfar", 1000.0f);
+            get_float3(camera, "position", 0.0f, 0.0f, -10.0f, out_camera->position);
+            get_float3(camera, "target", 0.0f, 0.0f, 0.0f, out_camera->target);
+        }
+
+        const cJSON *instance = nullptr;
+        cJSON_ArrayForEach(instance, get_array(scene, "meshes")) {
+            uint32_t mesh = find_id(&mesh_ids, get_int(instance, "mesh_id", -1));
+            if (mesh == SCENE_FILE_NONE) {
+                continue;
+            }
+            SceneFileInstance *out_instance = &out_instances[instance_index++];
+            int32_t material_id = get_int(instance, "material_id", -1);
+            out_instance->mesh = mesh;
+            out_instance->material = material_id < 0 ? SCENE_FILE_NONE : find_id(&material_ids, material_id);
+            if (material_id >= 0 && out_instance->material == SCENE_FILE_NONE) {
+                LOG("%s: Material %d isn't there, its instance gets the default one", __func__, material_id);
+            }
+            get_float3(instance, "position", 0.0f, 0.0f, 0.0f, out_instance->position);
+            get_float3(instance, "rotation", 0.0f, 0.0f, 0.0f, out_instance->rotation);
+            get_float3(instance, "scale", 1.0f, 1.0f, 1.0f, out_instance->scale);
+        }
+
+        out_scene->camera_count = camera_index - out_scene->first_camera;
+        out_scene->instance_count = instance_index - out_scene->first_instance;
+    }
+    cJSON_Delete(root);
+
+    bool is_open = open(out_file, data, (size_t)header.file_size);
+    assert(is_open && "scene_file::from_json: Built a block that doesn't open");
+    return is_open;
+}
+
+bool scene_file::to_json(const SceneFile *file, Arena *arena, char **out_text, size_t *out_size) {
+    assert(file && file->header && arena && out_text && out_size && "scene_file::to_json: file, arena and outputs cannot be NULL");
+
+    // Same layout as the configs written by hand
+    const SceneFileHeader *header = file->header;
+    cJSON *root = cJSON_CreateObject();
+    cJSON *scenes = cJSON_AddArrayToObject(root, "scenes");
+    for (uint32_t s = 0; s < header->scene_count; ++s) {
+        const SceneFileScene *scene = &file->scenes[s];
+        cJSON *out_scene = cJSON_CreateObject();
+        cJSON_AddItemToArray(scenes, out_scene);
+
+        cJSON *instances = cJSON_AddArrayToObject(out_scene, "meshes");
+        for (uint32_t i = 0; i < scene->instance_count; ++i) {
+            const SceneFileInstance *instance = &file->instances[scene->first_instance + i];
+            cJSON *out_instance = cJSON_CreateObject();
+            cJSON_AddItemToArray(instances, out_instance);
+            cJSON_AddNumberToObject(out_instance, "mesh_id", file->meshes[instance->mesh].json_id);
+            cJSON_AddNumberToObject(out_instance, "material_id", instance->material == SCENE_FILE_NONE ? -1 : file->materials[instance->material].json_id);
+            add_float3(out_instance, "position", instance->position);
+            add_float3(out_instance, "rotation", instance->rotation);
+            add_float3(out_instance, "scale", instance->scale);
+        }
+
+        cJSON *cameras = cJSON_AddArrayToObject(out_scene, "cameras");
+        for (uint32_t c = 0; c < scene->camera_count; ++c) {
+            const SceneFileCamera *camera = &file->cameras[scene->first_camera + c];
+            cJSON *out_camera = cJSON_CreateObject();
+            cJSON_AddItemToArray(cameras, out_camera);
+            add_float(out_camera, "fov", camera->fov);
+            add_float(out_camera, "znear", camera->znear);
+            add_float(out_camera, "zfar", camera->zfar);
+            add_float3(out_camera, "position", camera->position);
+            add_float3(out_camera, "target", camera->target);
+        }
+    }
+
+    cJSON *meshes = cJSON_AddArrayToObject(root, "meshes");
+    for (uint32_t i = 0; i < header->mesh_count; ++i) {
+        cJSON *out_mesh = cJSON_CreateObject();
+        cJSON_AddItemToArray(meshes, out_mesh);
+        cJSON_AddNumberToObject(out_mesh, "id", file->meshes[i].json_id);
+        cJSON_AddStringToObject(out_mesh, "path", get_string(file, file->meshes[i].path_offset));
+    }
+
+    cJSON *textures = cJSON_AddArrayToObject(root, "textures");
+    for (uint32_t i = 0; i < header->texture_count; ++i) {
+        cJSON *out_texture = cJSON_CreateObject();
+        cJSON_AddItemToArray(textures, out_texture);
+        cJSON_AddNumberToObject(out_texture, "id", file->textures[i].json_id);
+        cJSON_AddStringToObject(out_texture, "path", get_string(file, file->textures[i].path_offset));
+        cJSON_AddBoolToObject(out_texture, "srgb", file->textures[i].is_srgb != 0);
+    }
+
+    cJSON *materials = cJSON_AddArrayToObject(root, "materials");
+    for (uint32_t i = 0; i < header->material_count; ++i) {
+        const SceneFileMaterial *material = &file->materials[i];
+        cJSON *out_material = cJSON_CreateObject();
+        cJSON_AddItemToArray(materials, out_material);
+        cJSON_AddNumberToObject(out_material, "id", material->json_id);
+        add_float3(out_material, "albedo", material->albedo);
+        add_float(out_material, "roughness", material->roughness);
+        add_float(out_material, "coat", material->coat);
+        add_float(out_material, "metallic", material->metallic);
+        add_float(out_material, "emission", material->emission);
+        for (uint32_t m = 0; m < SCENE_FILE_MAP_COUNT; ++m) {
+            uint32_t map = material->maps[m];
+            cJSON_AddNumberToObject(out_material, s_map_names[m], map == SCENE_FILE_NONE ? -1 : file->textures[map].json_id);
+        }
+    }
+
+    char *printed = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (!printed) {
+        LOG("%s: Couldn't print the scene", __func__);
+        return false;
+    }
+    size_t size = strlen(printed);
+    char *text = ARENA_PUSH_ARRAY(arena, char, size);
+    if (text) {
+        memcpy(text, printed, size);
+    }
+    cJSON_free(printed);
+    if (!text) {
+        LOG("%s: No room for %llu bytes of JSON", __func__, (unsigned long long)size);
+        return false;
+    }
+
+    *out_text = text;
+    *out_size = size;
+    return true;
+}
+
+bool scene_file::write(const char *path, const SceneFile *file) {
+    assert(path && file && file->data && "scene_file::write: path and file cannot be NULL");
+    return write_file(path, file->data, file->size);
+}
+
+bool scene_file::write_json(const char *path, const SceneFile *file) {
+    assert(path && file && "scene_file::write_json: path and file cannot be NULL");
+
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    char *text = nullptr;
+    size_t size = 0;
+    bool is_written = to_json(file, scratch, &text, &size) && write_file(path, text, size);
+    arena::rewind(scratch, marker);
+    return is_written;
+}
+
+static bool collect_ids(const cJSON *array, bool needs_path, const char *what, Arena *arena, JsonIds *out_ids, uint64_t *strings_size) {
+    *out_ids = {};
+    uint32_t count = (uint32_t)cJSON_GetArraySize(array);
+    if (count == 0) {
+        return true;
+    }
+    out_ids->ids = ARENA_PUSH_ARRAY(arena, JsonId, count);
+    if (!out_ids->ids) {
+        LOG("scene_file::from_json: No room for the ids of %u %s", count, what);
+        return false;
+    }
+
+    // The ones without an id get the ids past the highest one there is, in order
+    int64_t highest = -1;
+    uint32_t missing = 0;
+    const cJSON *item = nullptr;
+    cJSON_ArrayForEach(item, array) {
+        if (needs_path && !get_path(item)) {
+            continue;
+        }
+        const cJSON *id = cJSON_GetObjectItemCaseSensitive(item, "id");
+        if (cJSON_IsNumber(id)) {
+            highest = id->valueint > highest ? id->valueint : highest;
+        } else {
+            missing++;
+        }
+    }
+    if (highest + missing > INT32_MAX) {
+        LOG("scene_file::from_json: %u of the %s have no id and there are none left past %lld", missing, what, (long long)highest);
+        return false;
+    }
+    out_ids->first_missing = (int32_t)(highest + 1);
+
+    // Without a path there's nothing to load, it's left out like any id that isn't there
+    int32_t next_missing = out_ids->first_missing;
+    cJSON_ArrayForEach(item, array) {
+        const char *path = get_path(item);
+        if (needs_path && !path) {
+            LOG("scene_file::from_json: One of the %s has no path, it's left out", what);
+            continue;
+        }
+        uint32_t index = out_ids->count++;
+        out_ids->ids[index] = {get_id(item, &next_missing), index};
+        *strings_size += needs_path ? strlen(path) + 1 : 0;
+    }
+
+    qsort(out_ids->ids, out_ids->count, sizeof(JsonId), json_id_compare);
+    for (uint32_t i = 1; i < out_ids->count; ++i) {
+        if (out_ids->ids[i - 1].json_id == out_ids->ids[i].json_id) {
+            LOG("scene_file::from_json: Two of the %s have id %d", what, out_ids->ids[i].json_id);
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t find_id(const JsonIds *ids, int32_t json_id) {
+    uint32_t low = 0;
+    uint32_t high = ids->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (ids->ids[mid].json_id < json_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low < ids->count && ids->ids[low].json_id == json_id ? ids->ids[low].index : SCENE_FILE_NONE;
+}
+
+// The one it has or the next one for those without
+static int32_t get_id(const cJSON *object, int32_t *next_missing) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, "id");
+    return cJSON_IsNumber(item) ? item->valueint : (*next_missing)++;
+}
+
+static int json_id_compare(const void *a, const void *b) {
+    int32_t x = ((const JsonId *)a)->json_id;
+    int32_t y = ((const JsonId *)b)->json_id;
+    return (x > y) - (x < y);
+}
+
+static const cJSON *get_array(const cJSON *object, const char *name) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsArray(item) ? item : nullptr;
+}
+
+static const char *get_path(const cJSON *object) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, "path");
+    return cJSON_IsString(item) && item->valuestring[0] != '\0' ? item->valuestring : nullptr;
+}
+
+static int32_t get_int(const cJSON *object, const char *name, int32_t fallback) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsNumber(item) ? item->valueint : fallback;
+}
+
+static float get_float(const cJSON *object, const char *name, float fallback) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsNumber(item) ? to_float(item) : fallback;
+}
+
+static void get_float3(const cJSON *object, const char *name, float x, float y, float z, float *out) {
+    // Any component that's missing keeps its default
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    const float fallback[3] = {x, y, z};
+    for (int i = 0; i < 3; ++i) {
+        const cJSON *component = cJSON_IsArray(item) ? cJSON_GetArrayItem(item, i) : nullptr;
+        out[i] = cJSON_IsNumber(component) ? to_float(component) : fallback[i];
+    }
+}
+
+static float to_float(const cJSON *number) {
+    // cJSON prints -0 as 0, read it that way already so a round trip doesn't change it
+    return (float)number->valuedouble + 0.0f;
+}
+
+static bool get_flag(const cJSON *object, const char *name) {
+    // true/false or a number, valueint is 0 for both bools
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return cJSON_IsTrue(item) || (cJSON_IsNumber(item) && item->valueint != 0);
+}
+
+static void add_float(cJSON *object, const char *name, float value) {
+    cJSON_AddNumberToObject(object, name, get_shortest(value));
+}
+
+static void add_float3(cJSON *object, const char *name, const float *v) {
+    cJSON *array = cJSON_AddArrayToObject(object, name);
+    for (int i = 0; i < 3; ++i) {
+        cJSON_AddItemToArray(array, cJSON_CreateNumber(get_shortest(v[i])));
+    }
+}
+
+static double get_shortest(float value) {
+    // 0.1f as a double prints as 0.10000000149011612, the fewest digits that
+    // read back as the same float print as 0.1
+    char text[32];
+    for (int precision = 6; precision < 9; ++precision) {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (strtof(text, nullptr) == value) {
+            return strtod(text, nullptr);
+        }
+    }
+    return value;
+}
+
+static bool is_array_in_bounds(uint64_t offset, uint64_t count, size_t element_size, size_t size) {
+    return offset % (element_size > 1 ? sizeof(uint32_t) : 1) == 0 && offset <= size && count <= (size - offset) / element_size;
+}
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static bool write_file(const char *path, const void *data, size_t size) {
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", path, temp_counter.fetch_add(1));
+
+    // Written next to it and renamed, same as the mip files
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        LOG("scene_file::write: Couldn't open %s for writing", temp_path);
+        return false;
+    }
+    bool is_written = fwrite(data, 1, size, file) == size;
+    is_written = fclose(file) == 0 && is_written;
+    if (!is_written) {
+        LOG("scene_file::write: Couldn't write %s", temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    // rename doesn't replace on Windows
+    remove(path);
+    if (rename(temp_path, path) != 0) {
+        LOG("scene_file::write: Couldn't move %s into place", temp_path);
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
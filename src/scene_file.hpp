@@ -0,0 +1,131 @@
+#pragma once
+
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// A scene config compiled to one flat block: a header with the count and
+// offset of every array, the arrays, then the asset paths. References between
+// them are indices into the arrays, so loading is a read and open, which only
+// checks the block and points into it. The JSON ids are kept for going back
+// to JSON (and for telling what changed), nothing looks them up at load.
+//
+// from_json builds the same block from the JSON config, missing fields get
+// the defaults below instead of failing. Ids can be any int but negative,
+// a negative reference is none. Ones without an id get the ids past the
+// highest one in their array, in the order they're in.
+#define SCENE_FILE_EXTENSION ".scene"
+// A material without the texture, an instance without the material
+#define SCENE_FILE_NONE UINT32_MAX
+
+enum SceneFileMap : uint32_t {
+    SCENE_FILE_MAP_ALBEDO,
+    SCENE_FILE_MAP_METALLIC,
+    SCENE_FILE_MAP_ROUGHNESS,
+    SCENE_FILE_MAP_COAT,
+    SCENE_FILE_MAP_NORMAL,
+    SCENE_FILE_MAP_EMISSION,
+    SCENE_FILE_MAP_COUNT,
+};
+
+struct SceneFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    uint32_t texture_count;
+    uint32_t material_count;
+    uint32_t mesh_count;
+    uint32_t scene_count;
+    uint32_t camera_count;
+    uint32_t instance_count;
+    uint32_t strings_size; // Each path 0 terminated
+    uint32_t padding;
+    // From the start of the file
+    uint64_t textures_offset;
+    uint64_t materials_offset;
+    uint64_t meshes_offset;
+    uint64_t scenes_offset;
+    uint64_t cameras_offset;
+    uint64_t instances_offset;
+    uint64_t strings_offset;
+};
+
+struct SceneFileTexture {
+    int32_t json_id;
+    uint32_t path_offset; // Into the strings
+    uint32_t is_srgb;     // Default 0
+};
+
+struct SceneFileMaterial {
+    int32_t json_id;
+    float albedo[3];                     // Default 1, 1, 1
+    float metallic;                      // Default 0
+    float roughness;                     // Default 1
+    float coat;                          // Default 0
+    float emission;                      // Default 0
+    uint32_t maps[SCENE_FILE_MAP_COUNT]; // Texture indices, default SCENE_FILE_NONE
+};
+
+struct SceneFileMesh {
+    int32_t json_id;
+    uint32_t path_offset;
+};
+
+struct SceneFileScene {
+    uint32_t first_camera;
+    uint32_t camera_count;
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+struct SceneFileCamera {
+    float fov;         // Default 45
+    float znear;       // Default 0.1
+    float zfar;        // Default 1000
+    float position[3]; // Default 0, 0, -10
+    float target[3];
+};
+
+struct SceneFileInstance {
+    uint32_t mesh;
+    uint32_t material; // SCENE_FILE_NONE draws it with the default one
+    float position[3];
+    float rotation[3]; // Degrees
+    float scale[3];    // Default 1, 1, 1
+};
+
+// Points into the block it was opened from
+struct SceneFile {
+    const uint8_t *data;
+    size_t size;
+    const SceneFileHeader *header;
+    const SceneFileTexture *textures;
+    const SceneFileMaterial *materials;
+    const SceneFileMesh *meshes;
+    const SceneFileScene *scenes;
+    const SceneFileCamera *cameras;
+    const SceneFileInstance *instances;
+    const char *strings;
+};
+
+namespace scene_file {
+
+// Checks every count, offset and index against the size, false for anything
+// that isn't a whole scene file of this version. data has to be 8 byte aligned.
+bool open(SceneFile *file, const uint8_t *data, size_t size);
+// Either kind through the vfs, the block is pushed on the arena (or is in the pack)
+bool read(const char *path, Arena *arena, SceneFile *out_file);
+const char *get_string(const SceneFile *file, uint32_t offset);
+
+// The block is pushed on the arena. Instances of a mesh that isn't there are
+// dropped, a texture or material that isn't there is left out.
+bool from_json(const char *text, size_t length, Arena *arena, SceneFile *out_file);
+// Pushed on the arena, not 0 terminated
+bool to_json(const SceneFile *file, Arena *arena, char **out_text, size_t *out_size);
+
+// Binary next to the path then moved into place
+bool write(const char *path, const SceneFile *file);
+bool write_json(const char *path, const SceneFile *file);
+
+} // namespace scene_file
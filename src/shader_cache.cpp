@@ -0,0 +1,367 @@
+#include "shader_cache.hpp"
+
+#include "file_watcher.hpp"
+#include "logger.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+// Bump when the file layout or anything else that goes into the key changes
+#define SHADER_CACHE_VERSION 1
+#define SHADER_CACHE_MAGIC 0x43485353u // "SSHC"
+
+struct ShaderCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;
+    uint64_t checksum; // Of the bytecode, catches half written files
+};
+
+// Modules compile on several threads, two of them can store the same key at once
+static std::atomic<uint32_t> temp_counter{0};
+
+struct TextBuffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static char *read_file(const char *path, size_t *out_size);
+static bool append(TextBuffer *buffer, const char *data, size_t size);
+static bool resolve_file(const char *path, uint32_t depth, TextBuffer *buffer, ShaderSource *source);
+static bool append_line_directive(TextBuffer *buffer, uint32_t line, const char *path);
+static bool parse_include(const char *line, size_t length, char *out_name, size_t out_size);
+
+bool shader_cache::resolve_source(const char *path, ShaderSource *out_source) {
+    assert(path && out_source && "shader_cache::resolve_source: path and out_source cannot be NULL");
+
+    memset(out_source, 0, sizeof(ShaderSource));
+    TextBuffer buffer = {};
+    if (!resolve_file(path, 0, &buffer, out_source) || !append(&buffer, "", 1)) {
+        free(buffer.data);
+        return false;
+    }
+
+    // Size without the terminator
+    out_source->text = buffer.data;
+    out_source->size = buffer.size - 1;
+    return true;
+}
+
+void shader_cache::free_source(ShaderSource *source) {
+    free(source->text);
+    source->text = nullptr;
+    source->size = 0;
+    source->include_count = 0;
+}
+
+uint64_t shader_cache::make_key(const ShaderSource *source, const char *entry_point, const char *target, uint32_t flags, const char *const *defines, uint32_t define_count) {
+    uint32_t version = SHADER_CACHE_VERSION;
+    uint64_t h = hash(SHADER_HASH_SEED, &version, sizeof(version));
+    h = hash(h, source->text, source->size);
+
+    // Terminators too, so "ab" + "c" and "a" + "bc" differ
+    h = hash(h, entry_point, strlen(entry_point) + 1);
+    h = hash(h, target, strlen(target) + 1);
+    h = hash(h, &flags, sizeof(flags));
+
+    // Defines change the output just as much as the source does
+    for (uint32_t i = 0; i < define_count; ++i) {
+        h = hash(h, defines[i], strlen(defines[i]) + 1);
+    }
+    return h;
+}
+
+uint64_t shader_cache::hash(uint64_t h, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t shader_cache::hash_path(const char *path) {
+    char normalized[SHADER_PATH_MAX];
+    file_watcher::normalize_path(path, normalized, sizeof(normalized));
+    return hash(SHADER_HASH_SEED, normalized, strlen(normalized));
+}
+
+uint32_t shader_cache::get_dependencies(const char *path, const ShaderSource *source, uint64_t *out_hashes, uint32_t max_hashes) {
+    uint32_t count = 0;
+    if (count < max_hashes) {
+        out_hashes[count++] = hash_path(path);
+    }
+    for (uint32_t i = 0; source && i < source->include_count && count < max_hashes; ++i) {
+        out_hashes[count++] = hash_path(source->includes[i]);
+    }
+    return count;
+}
+
+bool shader_cache::depends_on(const uint64_t *dependencies, uint32_t dependency_count, uint64_t path_hash) {
+    for (uint32_t i = 0; i < dependency_count; ++i) {
+        if (dependencies[i] == path_hash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void shader_cache::get_path(const char *dir, uint64_t key, char *out_path, size_t out_size) {
+    snprintf(out_path, out_size, "%s/%016llx.dxbc", dir, (unsigned long long)key);
+}
+
+bool shader_cache::load(const char *dir, uint64_t key, ShaderCacheBlob *out_blob) {
+    assert(out_blob && "shader_cache::load: out_blob cannot be NULL");
+
+    char path[SHADER_PATH_MAX];
+    get_path(dir, key, path, sizeof(path));
+
+    // Not there is the usual miss, no need to log
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SHADER_CACHE_MAGIC ||
+        header.version != SHADER_CACHE_VERSION || header.key != key || header.size == 0) {
+        LOG("%s: %s is not a valid cache entry", __func__, path);
+        fclose(file);
+        return false;
+    }
+
+    void *data = malloc(header.size);
+    if (!data || fread(data, 1, header.size, file) != header.size || hash(SHADER_HASH_SEED, data, header.size) != header.checksum) {
+        LOG("%s: %s is truncated or corrupt", __func__, path);
+        free(data);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+    out_blob->data = data;
+    out_blob->size = header.size;
+    return true;
+}
+
+bool shader_cache::store(const char *dir, uint64_t key, const void *data, size_t size) {
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (error) {
+        LOG("%s: Couldn't create the shader cache directory %s", __func__, dir);
+        return false;
+    }
+
+    char path[SHADER_PATH_MAX];
+    char temp_path[SHADER_PATH_MAX + 16];
+    get_path(dir, key, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.%u.tmp", path, temp_counter.fetch_add(1));
+
+    // Written next to it and renamed, so a crash never leaves a half entry behind
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        LOG("%s: Couldn't open %s for writing", __func__, temp_path);
+        return false;
+    }
+
+    ShaderCacheHeader header = {SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, key, size, hash(SHADER_HASH_SEED, data, size)};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        LOG("%s: Couldn't write %s", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    // rename doesn't replace on Windows
+    remove(path);
+    if (rename(temp_path, path) != 0) {
+        LOG("%s: Couldn't move %s into place", __func__, temp_path);
+        remove(temp_path);
+        return false;
+    }
+
+    return true;
+}
+
+void shader_cache::free_blob(ShaderCacheBlob *blob) {
+    free(blob->data);
+    blob->data = nullptr;
+    blob->size = 0;
+}
+
+static char *read_file(const char *path, size_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        fclose(file);
+        return nullptr;
+    }
+
+    char *data = (char *)malloc((size_t)length + 1);
+    if (!data || fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        fclose(file);
+        return nullptr;
+    }
+
+    fclose(file);
+    data[length] = '\0';
+    *out_size = (size_t)length;
+    return data;
+}
+
+static bool append(TextBuffer *buffer, const char *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+
+        char *grown = (char *)realloc(buffer->data, capacity);
+        if (!grown) {
+            return false;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return true;
+}
+
+static bool resolve_file(const char *path, uint32_t depth, TextBuffer *buffer, ShaderSource *source) {
+    if (depth > MAX_SHADER_INCLUDE_DEPTH) {
+        LOG("shader_cache::resolve_source: Includes nested too deep at %s, is there a cycle?", path);
+        return false;
+    }
+
+    size_t size = 0;
+    char *text = read_file(path, &size);
+    if (!text) {
+        LOG("shader_cache::resolve_source: Couldn't read %s", path);
+        return false;
+    }
+
+    // Includes are relative to the including file, like D3D_COMPILE_STANDARD_FILE_INCLUDE
+    size_t dir_length = 0;
+    for (size_t i = 0; path[i]; ++i) {
+        if (path[i] == '/' || path[i] == '\\') {
+            dir_length = i + 1;
+        }
+    }
+
+    bool ok = true;
+    size_t line_start = 0;
+    uint32_t line = 0;
+    while (ok && line_start < size) {
+        line++;
+        size_t line_end = line_start;
+        while (line_end < size && text[line_end] != '\n') {
+            line_end++;
+        }
+        if (line_end < size) {
+            line_end++; // Keep the newline with the line
+        }
+
+        char name[SHADER_PATH_MAX];
+        if (!parse_include(text + line_start, line_end - line_start, name, sizeof(name))) {
+            ok = append(buffer, text + line_start, line_end - line_start);
+            line_start = line_end;
+            continue;
+        }
+
+        char include_path[SHADER_PATH_MAX];
+        int written = snprintf(include_path, sizeof(include_path), "%.*s%s", (int)dir_length, path, name);
+        if (written < 0 || (size_t)written >= sizeof(include_path)) {
+            LOG("shader_cache::resolve_source: Include path too long in %s", path);
+            ok = false;
+            break;
+        }
+
+        // Remember every dependency once
+        bool known = false;
+        for (uint32_t i = 0; i < source->include_count; ++i) {
+            known |= strcmp(source->includes[i], include_path) == 0;
+        }
+        if (!known) {
+            if (source->include_count >= MAX_SHADER_INCLUDES) {
+                LOG("shader_cache::resolve_source: More than %d includes in %s", MAX_SHADER_INCLUDES, path);
+                ok = false;
+                break;
+            }
+            strcpy(source->includes[source->include_count++], include_path);
+        }
+
+        // The compiler gets the pasted text, #line keeps its errors pointing at the file they're in
+        ok = append_line_directive(buffer, 1, include_path) && resolve_file(include_path, depth + 1, buffer, source) &&
+             append(buffer, "\n", 1) && append_line_directive(buffer, line + 1, path);
+        line_start = line_end;
+    }
+
+    free(text);
+    return ok;
+}
+
+static bool append_line_directive(TextBuffer *buffer, uint32_t line, const char *path) {
+    char directive[SHADER_PATH_MAX + 32];
+    int written = snprintf(directive, sizeof(directive), "#line %u \"%s\"\n", line, path);
+    if (written < 0 || (size_t)written >= sizeof(directive)) {
+        return false;
+    }
+
+    // Backslashes would be escapes in the string
+    for (int i = 0; i < written; ++i) {
+        if (directive[i] == '\\') {
+            directive[i] = '/';
+        }
+    }
+    return append(buffer, directive, (size_t)written);
+}
+
+static bool parse_include(const char *line, size_t length, char *out_name, size_t out_size) {
+    size_t i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+        i++;
+    }
+
+    static const char directive[] = "#include";
+    size_t directive_length = sizeof(directive) - 1;
+    if (length - i < directive_length || strncmp(line + i, directive, directive_length) != 0) {
+        return false;
+    }
+    i += directive_length;
+
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+        i++;
+    }
+    if (i >= length || (line[i] != '"' && line[i] != '<')) {
+        return false;
+    }
+
+    char close = line[i] == '"' ? '"' : '>';
+    size_t start = ++i;
+    while (i < length && line[i] != close) {
+        i++;
+    }
+    if (i >= length || i - start >= out_size) {
+        return false;
+    }
+
+    memcpy(out_name, line + start, i - start);
+    out_name[i - start] = '\0';
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compiled shaders are kept on disk, keyed by a hash of everything that goes
+// into the compile: the source with its #includes pulled in, the entry point,
+// the target and the flags. An unchanged shader is loaded instead of compiled.
+#define SHADER_CACHE_DIR "shader_cache"
+#define SHADER_PATH_MAX 260
+#define MAX_SHADER_INCLUDES 16
+#define MAX_SHADER_INCLUDE_DEPTH 8
+#define SHADER_HASH_SEED 0xcbf29ce484222325ull
+
+// A shader file with every #include "..." pasted in where it was included.
+// Not a real preprocessor, macros and #if are left alone, but every byte the
+// compiler could look at is in there. This is what gets compiled, #line
+// directives keep the errors on the right file and line.
+struct ShaderSource {
+    char *text;
+    size_t size;
+
+    // Every file that was pulled in, relative to the working directory
+    char includes[MAX_SHADER_INCLUDES][SHADER_PATH_MAX];
+    uint32_t include_count;
+};
+
+// Bytecode loaded from the cache, owned by the caller (shader_cache::free_blob)
+struct ShaderCacheBlob {
+    void *data;
+    size_t size;
+};
+
+namespace shader_cache {
+
+bool resolve_source(const char *path, ShaderSource *out_source);
+void free_source(ShaderSource *source);
+
+// Defines are names set to 1, in the order they're passed to the compiler
+uint64_t make_key(const ShaderSource *source, const char *entry_point, const char *target, uint32_t flags, const char *const *defines, uint32_t define_count);
+// FNV-1a, start from SHADER_HASH_SEED
+uint64_t hash(uint64_t h, const void *data, size_t size);
+
+// Hash of the path after file_watcher::normalize_path, two spellings of the
+// same file hash the same
+uint64_t hash_path(const char *path);
+// The file and every include it pulled in (source may be NULL when it
+// couldn't be resolved), for hot reload to match the watcher's paths against
+uint32_t get_dependencies(const char *path, const ShaderSource *source, uint64_t *out_hashes, uint32_t max_hashes);
+bool depends_on(const uint64_t *dependencies, uint32_t dependency_count, uint64_t path_hash);
+
+// The file a key is stored in, <dir>/<16 hex digits>.dxbc
+void get_path(const char *dir, uint64_t key, char *out_path, size_t out_size);
+
+bool load(const char *dir, uint64_t key, ShaderCacheBlob *out_blob);
+bool store(const char *dir, uint64_t key, const void *data, size_t size);
+void free_blob(ShaderCacheBlob *blob);
+
+} // namespace shader_cache
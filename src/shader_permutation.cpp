@@ -0,0 +1,73 @@
+#include "shader_permutation.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+
+bool shader_permutation::initialize(ShaderVariantCache *cache, uint32_t feature_mask, const ShaderFeatureDefine *features, uint32_t feature_count, Id fallback) {
+    assert(cache && "shader_permutation::initialize: cache cannot be NULL");
+
+    // SPECIALIZED takes a define too
+    if (feature_count + 1 > MAX_SHADER_DEFINES) {
+        LOG("%s: Too many features for a permutation set", __func__);
+        return false;
+    }
+
+    cache->feature_mask = feature_mask;
+    cache->features = features;
+    cache->feature_count = feature_count;
+    cache->fallback = fallback;
+    cache->count = 0;
+    return true;
+}
+
+uint32_t shader_permutation::make_key(const ShaderVariantCache *cache, uint32_t features) {
+    return features & cache->feature_mask;
+}
+
+uint32_t shader_permutation::get_defines(const ShaderVariantCache *cache, uint32_t key, const char **out_defines, uint32_t max_defines) {
+    uint32_t count = 0;
+    if (count < max_defines) {
+        out_defines[count++] = SHADER_SPECIALIZED_DEFINE;
+    }
+
+    for (uint32_t i = 0; i < cache->feature_count && count < max_defines; ++i) {
+        const ShaderFeatureDefine *feature = &cache->features[i];
+        if (key & feature->bit) {
+            out_defines[count++] = feature->name;
+        }
+    }
+    return count;
+}
+
+int32_t shader_permutation::find(const ShaderVariantCache *cache, uint32_t key) {
+    for (uint32_t i = 0; i < cache->count; ++i) {
+        if (cache->keys[i] == key) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+Id shader_permutation::request(ShaderVariantCache *cache, uint32_t features, ShaderVariantBuildFn build, void *user_data) {
+    uint32_t key = make_key(cache, features);
+    int32_t index = find(cache, key);
+    if (index >= 0) {
+        return cache->pipelines[index];
+    }
+
+    if (cache->count >= MAX_SHADER_PERMUTATIONS) {
+        return cache->fallback;
+    }
+
+    const char *defines[MAX_SHADER_DEFINES];
+    uint32_t define_count = get_defines(cache, key, defines, MAX_SHADER_DEFINES);
+
+    // A variant that can't be built is still remembered (as invalid), so it isn't retried every draw
+    Id pipeline = build(defines, define_count, key, user_data);
+
+    cache->keys[cache->count] = key;
+    cache->pipelines[cache->count] = pipeline;
+    cache->count++;
+    return pipeline;
+}
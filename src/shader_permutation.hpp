@@ -0,0 +1,52 @@
+#pragma once
+
+#include "id.hpp"
+
+#include <cstdint>
+
+// A pipeline specialized by feature bits. Every combination of the bits the
+// shader cares about is its own pixel shader, compiled with SPECIALIZED and
+// the define of each set bit. The generic pipeline (no defines) handles
+// everything and is used when a variant isn't there.
+// This is only the bookkeeping, building the variants is up to the caller
+// (ShaderPermutationSet in shader_system.hpp), so it doesn't need D3D.
+#define MAX_SHADER_PERMUTATIONS 16
+#define MAX_SHADER_DEFINES 16
+#define SHADER_SPECIALIZED_DEFINE "SPECIALIZED"
+
+struct ShaderFeatureDefine {
+    uint32_t bit;
+    const char *name;
+};
+
+struct ShaderVariantCache {
+    // Bits the shader reacts to, features outside of it share a variant
+    uint32_t feature_mask;
+    const ShaderFeatureDefine *features;
+    uint32_t feature_count;
+    Id fallback; // The generic pipeline
+
+    // Keys are the masked feature bits
+    uint32_t keys[MAX_SHADER_PERMUTATIONS];
+    Id pipelines[MAX_SHADER_PERMUTATIONS];
+    uint32_t count;
+};
+
+// Builds the pipeline of a new variant, invalid when it couldn't
+typedef Id (*ShaderVariantBuildFn)(const char *const *defines, uint32_t define_count, uint32_t key, void *user_data);
+
+namespace shader_permutation {
+
+bool initialize(ShaderVariantCache *cache, uint32_t feature_mask, const ShaderFeatureDefine *features, uint32_t feature_count, Id fallback);
+
+uint32_t make_key(const ShaderVariantCache *cache, uint32_t features);
+// SPECIALIZED and the define of every bit in key, returns how many were written
+uint32_t get_defines(const ShaderVariantCache *cache, uint32_t key, const char **out_defines, uint32_t max_defines);
+// Index in the variant cache, -1 when it hasn't been requested yet
+int32_t find(const ShaderVariantCache *cache, uint32_t key);
+
+// Builds the variant for the features when it's new. Gives the fallback when
+// the cache is full.
+Id request(ShaderVariantCache *cache, uint32_t features, ShaderVariantBuildFn build, void *user_data);
+
+} // namespace shader_permutation
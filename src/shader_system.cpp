@@ -1,8 +1,13 @@
 #include "shader_system.hpp"
 
 #include "id.hpp"
+#include "job_system.hpp"
 #include "logger.hpp"
+#include "shader_cache.hpp"
+
+#include <cassert>
 #include <cstring>
+#include <cwchar>
 #include <d3dcompiler.h>
 
 // Just testing something for branch prediction
@@ -14,11 +19,28 @@
 #define UNLIKELY(x) (x)
 #endif
 
+static void compile_module_job(void *user_data);
+static bool compile_module(ShaderCompileJob *job, ShaderModuleCode *out_code);
+static bool resolve_pipeline(ShaderSystemState *state, ShaderPipeline *pipeline);
+static void queue_reload(ShaderSystemState *state, ShaderModule *module);
+static Id build_permutation(const char *const *defines, uint32_t define_count, uint32_t key, void *user_data);
+
+// What build_permutation gets from request_permutation
+struct PermutationBuild {
+    ShaderSystemState *state;
+    ID3D11Device *device;
+    ShaderPermutationSet *set;
+};
+
 bool shader::system_initialize(ShaderSystemState *state) {
     // Invalidate all modules
     for (int i = 0; i < MAX_SHADER_MODULES; ++i) {
         ShaderModule *module = &state->shader_modules[i];
         module->id = id::invalid();
+        module->status.store(SHADER_MODULE_FAILED, std::memory_order_relaxed);
+        module->reload_status.store(SHADER_RELOAD_NONE, std::memory_order_relaxed);
+        module->reload_again = false;
+        module->dependency_count = 0;
         module->vs_bytecode_ptr = nullptr;
     }
 
@@ -26,16 +48,47 @@ bool shader::system_initialize(ShaderSystemState *state) {
     for (int i = 0; i < MAX_SHADER_PIPELINES; ++i) {
         ShaderPipeline *pipeline = &state->shader_pipelines[i];
         pipeline->id = id::invalid();
+        pipeline->resolved = false;
+        pipeline->input_count = 0;
 
         for (int j = 0; j < SHADER_STAGE_COUNT; ++j) {
             pipeline->stage[j] = id::invalid();
         }
     }
 
+    state->jobs = nullptr;
+    state->device = nullptr;
+    state->use_cache = true;
+    state->cache_hits = 0;
+    state->cache_misses = 0;
+
     return true;
 }
 
+void shader::set_job_system(ShaderSystemState *state, JobSystem *jobs) {
+    if (state->jobs && state->jobs != jobs) {
+        job_system::wait(state->jobs, &state->compiles);
+    }
+    state->jobs = jobs;
+}
+
+void shader::wait_all(ShaderSystemState *state) {
+    if (state->jobs) {
+        job_system::wait(state->jobs, &state->compiles);
+    }
+}
+
 ShaderId shader::create_module_from_file(ShaderSystemState *state, ID3D11Device *device, const wchar_t *path, ShaderStage stage, const char *entry_point) {
+    return create_module_from_file_with_defines(state, device, path, stage, entry_point, nullptr, 0);
+}
+
+ShaderId shader::create_module_from_file_with_defines(ShaderSystemState *state, ID3D11Device *device, const wchar_t *path, ShaderStage stage, const char *entry_point,
+                                                      const char *const *defines, uint32_t define_count) {
+    if (define_count > MAX_SHADER_DEFINES) {
+        LOG("%s: Too many defines (%u), adjust max count.", __func__, define_count);
+        return id::invalid();
+    }
+
     // Linear search for an available module slot
     ShaderModule *module = nullptr;
     for (uint8_t i = 0; i < MAX_SHADER_MODULES; ++i) {
@@ -52,77 +105,32 @@ ShaderId shader::create_module_from_file(ShaderSystemState *state, ID3D11Device
         return id::invalid();
     }
 
-    UINT compileFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-    compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-
-    HRESULT hr = E_FAIL;
-    Microsoft::WRL::ComPtr<ID3DBlob> error_blob_ptr;
-    Microsoft::WRL::ComPtr<ID3DBlob> shader_blob_ptr;
-
-    // Targets for different shader stages
-    static const char *shader_target[SHADER_STAGE_COUNT] = {"vs_5_0", "ps_5_0", "cs_5_0"};
-
-    // Compile the file from file using d3dcompiler
-    hr = D3DCompileFromFile(
-        path,
-        NULL,
-        D3D_COMPILE_STANDARD_FILE_INCLUDE,
-        entry_point,
-        shader_target[stage],
-        compileFlags,
-        0,
-        shader_blob_ptr.GetAddressOf(),
-        error_blob_ptr.GetAddressOf());
-
-    if (FAILED(hr)) {
-        if (error_blob_ptr) {
-            LOG("%s: Shader module failed to compile from file: %ls. Error: %s", __func__, path, (char *)error_blob_ptr->GetBufferPointer());
-        }
-        return id::invalid();
+    // The slot is taken on this thread, only the build happens on a worker
+    module->stage = stage;
+    module->status.store(SHADER_MODULE_PENDING, std::memory_order_relaxed);
+
+    ShaderCompileJob *job = &state->compile_jobs[module->id.id];
+    job->state = state;
+    job->device = device;
+    job->module = module;
+    swprintf(job->path, SHADER_PATH_MAX, L"%ls", path);
+    snprintf(job->entry_point, sizeof(job->entry_point), "%s", entry_point);
+    for (uint32_t i = 0; i < define_count; ++i) {
+        snprintf(job->defines[i], SHADER_DEFINE_LENGTH, "%s", defines[i]);
     }
+    job->define_count = define_count;
+    job->reload = false;
 
-    switch (stage) {
-        case SHADER_STAGE_VS: {
-            hr = device->CreateVertexShader(
-                shader_blob_ptr->GetBufferPointer(),
-                shader_blob_ptr->GetBufferSize(),
-                nullptr,
-                module->vs.GetAddressOf());
-            
-            // Copy the bytecode -- we'll need it for input layout
-            module->vs_bytecode_ptr = shader_blob_ptr;
-        } break;
-
-        case SHADER_STAGE_PS: {
-            hr = device->CreatePixelShader(
-                shader_blob_ptr->GetBufferPointer(),
-                shader_blob_ptr->GetBufferSize(),
-                nullptr,
-                module->ps.GetAddressOf());
-        } break;
-
-        case SHADER_STAGE_CS: {
-            hr = device->CreateComputeShader(
-                shader_blob_ptr->GetBufferPointer(),
-                shader_blob_ptr->GetBufferSize(),
-                nullptr,
-                module->cs.GetAddressOf());
-        } break;
-
-        default:
-            LOG("%s: Unknown shader stage", __func__);
-            return id::invalid();
+    if (state->jobs) {
+        JobDecl decl = {compile_module_job, job};
+        job_system::run(state->jobs, &decl, 1, &state->compiles);
+        return module->id;
     }
 
-    // Check if the shader was successfully created or not
-    if (FAILED(hr)) {
-        LOG("%s: Shader creation failed for file: %ls", __func__, path);
+    compile_module_job(job);
+    if (module->status.load(std::memory_order_relaxed) != SHADER_MODULE_READY) {
         return id::invalid();
     }
-
-    module->stage = stage;
     return module->id;
 }
 
@@ -184,11 +192,17 @@ ShaderId shader::create_module_from_bytecode(ShaderSystemState *state, ID3D11Dev
     }
 
     module->stage = stage;
+    module->status.store(SHADER_MODULE_READY, std::memory_order_release);
     return module->id;
     
 }
 
 PipelineId shader::create_pipeline(ShaderSystemState *state, ID3D11Device *device, ShaderId *shader_modules, uint8_t shader_module_count, const D3D11_INPUT_ELEMENT_DESC *input_desc, uint16_t input_count) {
+    if (input_count > MAX_PIPELINE_INPUTS) {
+        LOG("%s: Too many input elements (%u), adjust max count.", __func__, input_count);
+        return id::invalid();
+    }
+
     // Linear search for an available pipeline slot
     ShaderPipeline *pipeline = nullptr;
     for (uint8_t i = 0; i < MAX_SHADER_PIPELINES; ++i) {
@@ -205,13 +219,9 @@ PipelineId shader::create_pipeline(ShaderSystemState *state, ID3D11Device *devic
         return id::invalid();
     }
 
-    // Want to keep track of vertex shader module being in
-    // the mix, because only then do I want to create input element
-    // if it's passsed in.
-    ID3DBlob *vs_bytecode = nullptr;
-
     // Should I inspect the shader modules' validity here?
     // Anyway, this is to get them into the array
+    bool modules_pending = false;
     for (int i = 0; i < shader_module_count; ++i) {
         ShaderModule *sm = &state->shader_modules[shader_modules[i].id];
         if (id::is_stale(sm->id, shader_modules[i])) {
@@ -220,34 +230,40 @@ PipelineId shader::create_pipeline(ShaderSystemState *state, ID3D11Device *devic
             return id::invalid();
         }
 
-        // Store the id to the shader module
+        // Store the id to the shader module (the stage is known before it's built)
         pipeline->stage[sm->stage] = sm->id;
 
-        // Check if the module is a vertex module
-        if (sm->stage == SHADER_STAGE_VS) {
-            vs_bytecode = sm->vs_bytecode_ptr.Get();
+        if (sm->status.load(std::memory_order_acquire) == SHADER_MODULE_PENDING) {
+            modules_pending = true;
         }
     }
 
-    if (vs_bytecode && input_desc && input_count > 0) {
-        HRESULT hr = device->CreateInputLayout(
-            input_desc,
-            input_count,
-            vs_bytecode->GetBufferPointer(),
-            vs_bytecode->GetBufferSize(),
-            pipeline->input_layout_ptr.GetAddressOf());
+    pipeline->input_count = input_desc ? input_count : 0;
+    for (uint16_t i = 0; i < pipeline->input_count; ++i) {
+        pipeline->input_desc[i] = input_desc[i];
+    }
+    pipeline->resolved = false;
+    state->device = device;
 
-        if (FAILED(hr)) {
-            LOG("%s: Couldn't create an input layout for the vertex shader in the pipeline", __func__);
-            id::invalidate(&pipeline->id);
-            return id::invalid();
-        }
+    // Built with the modules later, get_pipeline is where it's first needed
+    if (modules_pending) {
+        return pipeline->id;
+    }
+
+    if (!resolve_pipeline(state, pipeline)) {
+        id::invalidate(&pipeline->id);
+        return id::invalid();
     }
 
     return pipeline->id;
 }
 
 void shader::bind_pipeline(ShaderSystemState *state, ID3D11DeviceContext *context, ShaderPipeline *pipeline) {
+    if (UNLIKELY(!pipeline)) {
+        unbind_pipeline(context);
+        return;
+    }
+
     // Vertex Shader
     if (ShaderModule *vs_mod = get_module(state, pipeline->stage[SHADER_STAGE_VS])) {
         context->VSSetShader(vs_mod->vs.Get(), nullptr, 0);
@@ -286,10 +302,18 @@ ShaderModule *shader::get_module(ShaderSystemState *state, ShaderId shader_id) {
         return nullptr;
     }
 
-    if (LIKELY(id::is_fresh(state->shader_modules[shader_id.id].id, shader_id))) {
-        return &state->shader_modules[shader_id.id];
+    ShaderModule *module = &state->shader_modules[shader_id.id];
+    if (UNLIKELY(id::is_stale(module->id, shader_id))) {
+        return nullptr;
+    }
+
+    if (UNLIKELY(module->status.load(std::memory_order_acquire) != SHADER_MODULE_READY)) {
+        module->status.wait(SHADER_MODULE_PENDING, std::memory_order_acquire);
+        if (module->status.load(std::memory_order_acquire) != SHADER_MODULE_READY) {
+            return nullptr;
+        }
     }
-    return nullptr;
+    return module;
 }
 
 ShaderPipeline *shader::get_pipeline(ShaderSystemState *state, PipelineId pipeline_id) {
@@ -297,8 +321,401 @@ ShaderPipeline *shader::get_pipeline(ShaderSystemState *state, PipelineId pipeli
         return nullptr;
     }
 
-    if (LIKELY(id::is_fresh(state->shader_pipelines[pipeline_id.id].id, pipeline_id))) {
-        return &state->shader_pipelines[pipeline_id.id];
+    ShaderPipeline *pipeline = &state->shader_pipelines[pipeline_id.id];
+    if (UNLIKELY(id::is_stale(pipeline->id, pipeline_id))) {
+        return nullptr;
+    }
+
+    // First use of a pipeline created while its modules were compiling
+    if (UNLIKELY(!pipeline->resolved) && !resolve_pipeline(state, pipeline)) {
+        id::invalidate(&pipeline->id);
+        return nullptr;
+    }
+    return pipeline;
+}
+
+bool shader::is_pipeline_ready(ShaderSystemState *state, PipelineId pipeline_id) {
+    if (id::is_invalid(pipeline_id)) {
+        return true;
+    }
+
+    ShaderPipeline *pipeline = &state->shader_pipelines[pipeline_id.id];
+    if (id::is_stale(pipeline->id, pipeline_id) || pipeline->resolved) {
+        return true;
+    }
+
+    for (int i = 0; i < SHADER_STAGE_COUNT; ++i) {
+        if (id::is_invalid(pipeline->stage[i])) {
+            continue;
+        }
+        ShaderModule *module = &state->shader_modules[pipeline->stage[i].id];
+        if (module->status.load(std::memory_order_acquire) == SHADER_MODULE_PENDING) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t shader::reload_changed(ShaderSystemState *state, const char *path) {
+    uint64_t path_hash = shader_cache::hash_path(path);
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < MAX_SHADER_MODULES; ++i) {
+        ShaderModule *module = &state->shader_modules[i];
+        if (id::is_invalid(module->id) || module->status.load(std::memory_order_acquire) != SHADER_MODULE_READY) {
+            continue;
+        }
+
+        if (!shader_cache::depends_on(module->dependencies, module->dependency_count, path_hash)) {
+            continue;
+        }
+
+        // Still building the previous change, goes again once that's applied
+        if (module->reload_status.load(std::memory_order_acquire) == SHADER_RELOAD_PENDING) {
+            module->reload_again = true;
+        } else {
+            queue_reload(state, module);
+        }
+        count++;
+    }
+
+    return count;
+}
+
+uint32_t shader::apply_reloads(ShaderSystemState *state) {
+    uint32_t applied = 0;
+    for (uint32_t i = 0; i < MAX_SHADER_MODULES; ++i) {
+        ShaderModule *module = &state->shader_modules[i];
+        uint8_t reload_status = module->reload_status.load(std::memory_order_acquire);
+        if (id::is_invalid(module->id) || reload_status == SHADER_RELOAD_NONE || reload_status == SHADER_RELOAD_PENDING) {
+            continue;
+        }
+
+        ShaderCompileJob *job = &state->compile_jobs[i];
+        ShaderModuleCode *code = &module->reload;
+        bool swap = reload_status == SHADER_RELOAD_READY;
+
+        // A new vertex shader needs new input layouts, all of them are made
+        // before anything is swapped so a bad one leaves everything as it was
+        Microsoft::WRL::ComPtr<ID3D11InputLayout> layouts[MAX_SHADER_PIPELINES];
+        for (uint32_t p = 0; swap && module->stage == SHADER_STAGE_VS && p < MAX_SHADER_PIPELINES; ++p) {
+            ShaderPipeline *pipeline = &state->shader_pipelines[p];
+            if (id::is_invalid(pipeline->id) || !pipeline->resolved || pipeline->input_count == 0 ||
+                id::is_stale(pipeline->stage[SHADER_STAGE_VS], module->id)) {
+                continue;
+            }
+
+            HRESULT hr = state->device->CreateInputLayout(
+                pipeline->input_desc,
+                pipeline->input_count,
+                code->vs_bytecode_ptr->GetBufferPointer(),
+                code->vs_bytecode_ptr->GetBufferSize(),
+                layouts[p].GetAddressOf());
+            if (FAILED(hr)) {
+                LOG("%s: The new %ls doesn't match the input layout of pipeline %u", __func__, job->path, p);
+                swap = false;
+            }
+        }
+
+        if (swap) {
+            module->vs = code->vs;
+            module->ps = code->ps;
+            module->cs = code->cs;
+            module->vs_bytecode_ptr = code->vs_bytecode_ptr;
+            memcpy(module->dependencies, code->dependencies, code->dependency_count * sizeof(uint64_t));
+            module->dependency_count = code->dependency_count;
+
+            for (uint32_t p = 0; p < MAX_SHADER_PIPELINES; ++p) {
+                if (layouts[p]) {
+                    state->shader_pipelines[p].input_layout_ptr = layouts[p];
+                }
+            }
+
+            LOG("%s: Reloaded %ls (%s)", __func__, job->path, job->entry_point);
+            applied++;
+        } else {
+            LOG("%s: Keeping the previous version of %ls (%s)", __func__, job->path, job->entry_point);
+        }
+
+        code->vs.Reset();
+        code->ps.Reset();
+        code->cs.Reset();
+        code->vs_bytecode_ptr.Reset();
+        module->reload_status.store(SHADER_RELOAD_NONE, std::memory_order_relaxed);
+
+        if (module->reload_again) {
+            queue_reload(state, module);
+        }
+    }
+
+    return applied;
+}
+
+bool shader::initialize_permutations(ShaderPermutationSet *set, const ShaderPermutationDesc *desc, ShaderId vs, PipelineId fallback) {
+    assert(set && desc && "shader::initialize_permutations: set and desc cannot be NULL");
+
+    if (desc->input_count > MAX_PIPELINE_INPUTS) {
+        LOG("%s: Too many inputs for a permutation set", __func__);
+        return false;
+    }
+    if (!shader_permutation::initialize(&set->variants, desc->feature_mask, desc->features, desc->feature_count, fallback)) {
+        return false;
+    }
+
+    // Input desc is copied, the caller's array is usually on the stack
+    set->desc = *desc;
+    for (uint16_t i = 0; i < desc->input_count; ++i) {
+        set->input_desc[i] = desc->input_desc[i];
+    }
+    set->desc.input_desc = set->input_desc;
+    set->vs = vs;
+    return true;
+}
+
+PipelineId shader::request_permutation(ShaderSystemState *state, ID3D11Device *device, ShaderPermutationSet *set, uint32_t features) {
+    PermutationBuild build = {state, device, set};
+    return shader_permutation::request(&set->variants, features, build_permutation, &build);
+}
+
+ShaderPipeline *shader::get_permutation_pipeline(ShaderSystemState *state, ID3D11Device *device, ShaderPermutationSet *set, uint32_t features) {
+    // Don't wait on a variant that is still compiling, the generic one draws the same thing
+    PipelineId variant = request_permutation(state, device, set, features);
+    ShaderPipeline *pipeline = nullptr;
+    if (is_pipeline_ready(state, variant)) {
+        pipeline = get_pipeline(state, variant);
+    }
+    if (!pipeline) {
+        pipeline = get_pipeline(state, set->variants.fallback);
+    }
+    return pipeline;
+}
+
+static void compile_module_job(void *user_data) {
+    ShaderCompileJob *job = (ShaderCompileJob *)user_data;
+    ShaderModule *module = job->module;
+
+    // The module stays as it is while it's in use, apply_reloads swaps it
+    if (job->reload) {
+        bool built = compile_module(job, &module->reload);
+        module->reload_status.store(built ? SHADER_RELOAD_READY : SHADER_RELOAD_FAILED, std::memory_order_release);
+        return;
+    }
+
+    ShaderModuleCode code;
+    bool built = compile_module(job, &code);
+    if (built) {
+        module->vs = code.vs;
+        module->ps = code.ps;
+        module->cs = code.cs;
+        module->vs_bytecode_ptr = code.vs_bytecode_ptr;
+        memcpy(module->dependencies, code.dependencies, code.dependency_count * sizeof(uint64_t));
+        module->dependency_count = code.dependency_count;
+    }
+
+    module->status.store(built ? SHADER_MODULE_READY : SHADER_MODULE_FAILED, std::memory_order_release);
+    module->status.notify_all();
+}
+
+// Runs on a job worker when there's a job system. Only writes out_code, the device is
+// free-threaded and the cache counters are atomic.
+static bool compile_module(ShaderCompileJob *job, ShaderModuleCode *out_code) {
+    ShaderSystemState *state = job->state;
+    const wchar_t *path = job->path;
+    ShaderStage stage = job->module->stage;
+
+    UINT compileFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#ifdef _DEBUG
+    compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+    HRESULT hr = E_FAIL;
+    Microsoft::WRL::ComPtr<ID3DBlob> error_blob_ptr;
+    Microsoft::WRL::ComPtr<ID3DBlob> shader_blob_ptr;
+
+    // Targets for different shader stages
+    static const char *shader_target[SHADER_STAGE_COUNT] = {"vs_5_0", "ps_5_0", "cs_5_0"};
+
+    // The source with its includes pasted in is both the cache key and what
+    // gets compiled, so the two can't see different files
+    char narrow_path[SHADER_PATH_MAX];
+    snprintf(narrow_path, sizeof(narrow_path), "%ls", path);
+    ShaderSource source;
+    bool resolved = shader_cache::resolve_source(narrow_path, &source);
+
+    // Hot reload watches the same files that go into the key
+    out_code->dependency_count = shader_cache::get_dependencies(narrow_path, resolved ? &source : nullptr, out_code->dependencies, MAX_SHADER_DEPENDENCIES);
+    if (!resolved) {
+        LOG("%s: Couldn't read %ls or one of its includes", __func__, path);
+        return false;
+    }
+
+    bool use_cache = state->use_cache;
+    uint64_t cache_key = 0;
+    if (use_cache) {
+        const char *defines[MAX_SHADER_DEFINES];
+        for (uint32_t i = 0; i < job->define_count; ++i) {
+            defines[i] = job->defines[i];
+        }
+        cache_key = shader_cache::make_key(&source, job->entry_point, shader_target[stage], compileFlags, defines, job->define_count);
+    }
+
+    D3D_SHADER_MACRO macros[MAX_SHADER_DEFINES + 1] = {};
+    for (uint32_t i = 0; i < job->define_count; ++i) {
+        macros[i] = {job->defines[i], "1"};
+    }
+
+    ShaderCacheBlob cached = {};
+    if (use_cache && shader_cache::load(SHADER_CACHE_DIR, cache_key, &cached)) {
+        hr = D3DCreateBlob(cached.size, shader_blob_ptr.GetAddressOf());
+        if (SUCCEEDED(hr)) {
+            memcpy(shader_blob_ptr->GetBufferPointer(), cached.data, cached.size);
+            state->cache_hits++;
+        }
+        shader_cache::free_blob(&cached);
+    }
+
+    if (!shader_blob_ptr) {
+        // No include handler, there's nothing left to include
+        hr = D3DCompile(
+            source.text,
+            source.size,
+            narrow_path,
+            macros,
+            nullptr,
+            job->entry_point,
+            shader_target[stage],
+            compileFlags,
+            0,
+            shader_blob_ptr.GetAddressOf(),
+            error_blob_ptr.GetAddressOf());
+
+        if (FAILED(hr)) {
+            if (error_blob_ptr) {
+                LOG("%s: Shader module failed to compile from file: %ls. Error: %s", __func__, path, (char *)error_blob_ptr->GetBufferPointer());
+            }
+            shader_cache::free_source(&source);
+            return false;
+        }
+        state->cache_misses++;
+
+        // Reflection data stays in the DXBC (nothing is stripped), so the blob is all there is to keep
+        if (use_cache) {
+            shader_cache::store(SHADER_CACHE_DIR, cache_key, shader_blob_ptr->GetBufferPointer(), shader_blob_ptr->GetBufferSize());
+        }
+    }
+    shader_cache::free_source(&source);
+
+    ID3D11Device *device = job->device;
+    switch (stage) {
+        case SHADER_STAGE_VS: {
+            hr = device->CreateVertexShader(
+                shader_blob_ptr->GetBufferPointer(),
+                shader_blob_ptr->GetBufferSize(),
+                nullptr,
+                out_code->vs.ReleaseAndGetAddressOf());
+            
+            // Copy the bytecode -- we'll need it for input layout
+            out_code->vs_bytecode_ptr = shader_blob_ptr;
+        } break;
+
+        case SHADER_STAGE_PS: {
+            hr = device->CreatePixelShader(
+                shader_blob_ptr->GetBufferPointer(),
+                shader_blob_ptr->GetBufferSize(),
+                nullptr,
+                out_code->ps.ReleaseAndGetAddressOf());
+        } break;
+
+        case SHADER_STAGE_CS: {
+            hr = device->CreateComputeShader(
+                shader_blob_ptr->GetBufferPointer(),
+                shader_blob_ptr->GetBufferSize(),
+                nullptr,
+                out_code->cs.ReleaseAndGetAddressOf());
+        } break;
+
+        default:
+            LOG("%s: Unknown shader stage", __func__);
+            return false;
+    }
+
+    // Check if the shader was successfully created or not
+    if (FAILED(hr)) {
+        LOG("%s: Shader creation failed for file: %ls", __func__, path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool resolve_pipeline(ShaderSystemState *state, ShaderPipeline *pipeline) {
+    // Want to keep track of vertex shader module being in
+    // the mix, because only then do I want to create input element
+    // if it's passsed in.
+    ID3DBlob *vs_bytecode = nullptr;
+
+    for (int i = 0; i < SHADER_STAGE_COUNT; ++i) {
+        if (id::is_invalid(pipeline->stage[i])) {
+            continue;
+        }
+
+        // Waits for the module when it's still compiling
+        ShaderModule *sm = shader::get_module(state, pipeline->stage[i]);
+        if (!sm) {
+            LOG("%s: A shader module of pipeline %u failed to build", __func__, pipeline->id.id);
+            return false;
+        }
+
+        // Check if the module is a vertex module
+        if (sm->stage == SHADER_STAGE_VS) {
+            vs_bytecode = sm->vs_bytecode_ptr.Get();
+        }
+    }
+
+    if (vs_bytecode && pipeline->input_count > 0) {
+        HRESULT hr = state->device->CreateInputLayout(
+            pipeline->input_desc,
+            pipeline->input_count,
+            vs_bytecode->GetBufferPointer(),
+            vs_bytecode->GetBufferSize(),
+            pipeline->input_layout_ptr.GetAddressOf());
+
+        if (FAILED(hr)) {
+            LOG("%s: Couldn't create an input layout for the vertex shader in the pipeline", __func__);
+            return false;
+        }
+    }
+
+    pipeline->resolved = true;
+    return true;
+}
+
+static void queue_reload(ShaderSystemState *state, ShaderModule *module) {
+    ShaderCompileJob *job = &state->compile_jobs[module->id.id];
+    job->reload = true;
+    module->reload_again = false;
+    module->reload_status.store(SHADER_RELOAD_PENDING, std::memory_order_relaxed);
+
+    if (state->jobs) {
+        JobDecl decl = {compile_module_job, job};
+        job_system::run(state->jobs, &decl, 1, &state->compiles);
+    } else {
+        compile_module_job(job);
+    }
+}
+
+static Id build_permutation(const char *const *defines, uint32_t define_count, uint32_t key, void *user_data) {
+    PermutationBuild *build = (PermutationBuild *)user_data;
+    ShaderPermutationSet *set = build->set;
+
+    PipelineId pipeline = id::invalid();
+    ShaderId ps = shader::create_module_from_file_with_defines(build->state, build->device, set->desc.ps_path, SHADER_STAGE_PS, set->desc.ps_entry_point, defines, define_count);
+    if (id::is_valid(ps)) {
+        ShaderId modules[] = {set->vs, ps};
+        pipeline = shader::create_pipeline(build->state, build->device, modules, ARRAYSIZE(modules), set->input_desc, set->desc.input_count);
+    }
+    if (id::is_invalid(pipeline)) {
+        LOG("%s: Couldn't create the %ls variant for features 0x%x", __func__, set->desc.ps_path, key);
     }
-    return nullptr;
+    return pipeline;
 }
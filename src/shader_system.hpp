@@ -1,8 +1,12 @@
 #pragma once
 
 #include "id.hpp"
+#include "shader_cache.hpp"
+#include "job_system.hpp"
+#include "shader_permutation.hpp"
 
 #include <WRL/client.h>
+#include <atomic>
 #include <d3d11.h>
 
 enum ShaderStage {
@@ -12,12 +16,42 @@ enum ShaderStage {
     SHADER_STAGE_COUNT
 };
 
+// Modules from files may still be compiling on the job workers
+enum ShaderModuleStatus : uint8_t {
+    SHADER_MODULE_PENDING,
+    SHADER_MODULE_READY,
+    SHADER_MODULE_FAILED,
+};
+
+// Hot reload of a module that is already in use
+enum ShaderReloadStatus : uint8_t {
+    SHADER_RELOAD_NONE,
+    SHADER_RELOAD_PENDING,
+    SHADER_RELOAD_READY,
+    SHADER_RELOAD_FAILED,
+};
+
 using ShaderId = Id;
 using PipelineId = Id;
 
+// The file and every include, see shader_cache::get_dependencies
+#define MAX_SHADER_DEPENDENCIES (MAX_SHADER_INCLUDES + 1)
+
+// What a build of a module file produces
+struct ShaderModuleCode {
+    Microsoft::WRL::ComPtr<ID3D11VertexShader> vs;
+    Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
+    Microsoft::WRL::ComPtr<ID3D11ComputeShader> cs;
+    Microsoft::WRL::ComPtr<ID3DBlob> vs_bytecode_ptr;
+    uint64_t dependencies[MAX_SHADER_DEPENDENCIES];
+    uint32_t dependency_count;
+};
+
 struct ShaderModule {
     ShaderId id;
     ShaderStage stage;
+    // Written last by the compile job, everything below is only safe to touch once it's not pending
+    std::atomic<uint8_t> status;
 
     Microsoft::WRL::ComPtr<ID3D11VertexShader> vs;
     Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
@@ -25,34 +59,134 @@ struct ShaderModule {
 
     // Bytecode blob for the vertex shader in case it's needed for input layout
     Microsoft::WRL::ComPtr<ID3DBlob> vs_bytecode_ptr;
+
+    uint64_t dependencies[MAX_SHADER_DEPENDENCIES];
+    uint32_t dependency_count;
+
+    // A rebuild after one of the files changed. Built on a worker, swapped in
+    // by apply_reloads between frames, thrown away when it failed.
+    std::atomic<uint8_t> reload_status;
+    bool reload_again; // Changed again while it was building
+    ShaderModuleCode reload;
 };
 
+#define MAX_PIPELINE_INPUTS 8
+
 struct ShaderPipeline {
     PipelineId id;
     Id stage[SHADER_STAGE_COUNT];
     Microsoft::WRL::ComPtr<ID3D11InputLayout> input_layout_ptr;
+
+    // The input layout needs the vertex shader bytecode, so a pipeline over
+    // modules that are still compiling keeps its desc around until first use.
+    // SemanticName pointers are kept as is, they're string literals anyway.
+    bool resolved;
+    D3D11_INPUT_ELEMENT_DESC input_desc[MAX_PIPELINE_INPUTS];
+    uint16_t input_count;
+};
+
+#define SHADER_DEFINE_LENGTH 32
+
+// Everything a worker needs to build a module, one per module slot
+struct ShaderCompileJob {
+    struct ShaderSystemState *state;
+    ID3D11Device *device;
+    ShaderModule *module;
+    wchar_t path[SHADER_PATH_MAX];
+    char entry_point[64];
+    // Each one is defined as 1
+    char defines[MAX_SHADER_DEFINES][SHADER_DEFINE_LENGTH];
+    uint32_t define_count;
+    bool reload; // Builds into module->reload instead of the module
 };
 
-#define MAX_SHADER_MODULES 64
-#define MAX_SHADER_PIPELINES 32
+// Room for the material permutations (shader_permutation.hpp) on top of the fixed pipelines
+#define MAX_SHADER_MODULES 128
+#define MAX_SHADER_PIPELINES 64
 
 struct ShaderSystemState {
     ShaderModule shader_modules[MAX_SHADER_MODULES];
     ShaderPipeline shader_pipelines[MAX_SHADER_PIPELINES];
+    ShaderCompileJob compile_jobs[MAX_SHADER_MODULES];
+
+    // When set, modules from files compile on its workers and their ids are
+    // handed out right away. Pipelines over them resolve the first time
+    // they're fetched.
+    JobSystem *jobs;
+    // Compiles and reloads that haven't finished
+    JobCounter compiles;
+    // Device for the input layouts of pipelines that resolve later
+    ID3D11Device *device;
+    bool use_cache;
+
+    // Modules from files, loaded from the bytecode cache vs compiled
+    std::atomic<uint32_t> cache_hits;
+    std::atomic<uint32_t> cache_misses;
+};
+
+// The pixel shader of a pipeline compiled per material features, see
+// shader_permutation.hpp for how the variants are picked
+struct ShaderPermutationDesc {
+    const wchar_t *ps_path;
+    const char *ps_entry_point;
+    const D3D11_INPUT_ELEMENT_DESC *input_desc;
+    uint16_t input_count;
+    // Bits the shader reacts to, features outside of it share a variant
+    uint32_t feature_mask;
+    const ShaderFeatureDefine *features;
+    uint32_t feature_count;
+};
+
+struct ShaderPermutationSet {
+    ShaderPermutationDesc desc;
+    D3D11_INPUT_ELEMENT_DESC input_desc[MAX_PIPELINE_INPUTS];
+    ShaderId vs; // Features only change the pixel shader
+    ShaderVariantCache variants;
 };
 
 namespace shader {
 
 bool system_initialize(ShaderSystemState *state);
-
+// NULL compiles on the calling thread again, pending modules are waited on first
+void set_job_system(ShaderSystemState *state, JobSystem *jobs);
+void wait_all(ShaderSystemState *state);
+
+// Goes through the bytecode cache in shader_cache.hpp, only compiles when the
+// source, an include, the entry point or the flags changed.
+// With a job system this returns before the module is built, so a broken
+// shader only shows up (in the log) once a pipeline using it is fetched.
 ShaderId create_module_from_file(ShaderSystemState *state, ID3D11Device *device, const wchar_t *path, ShaderStage stage, const char *entry_point);
+// Same, with every name in defines set to 1 (part of the cache key)
+ShaderId create_module_from_file_with_defines(ShaderSystemState *state, ID3D11Device *device, const wchar_t *path, ShaderStage stage, const char *entry_point,
+                                              const char *const *defines, uint32_t define_count);
 ShaderId create_module_from_bytecode(ShaderSystemState *state, ID3D11Device *device, ShaderStage stage, const void *bytecode, size_t bytecode_size);
 PipelineId create_pipeline(ShaderSystemState *state, ID3D11Device *device, ShaderId *shader_modules, uint8_t shader_module_count, const D3D11_INPUT_ELEMENT_DESC *input_desc, uint16_t input_count);
 
+// A NULL pipeline (one whose shaders failed) unbinds everything
 void bind_pipeline(ShaderSystemState *state, ID3D11DeviceContext *context, ShaderPipeline *pipeline);
 void unbind_pipeline(ID3D11DeviceContext *context);
 
+// Both block while the module(s) behind the id are still compiling
 ShaderModule *get_module(ShaderSystemState *state, ShaderId shader_id);
 ShaderPipeline *get_pipeline(ShaderSystemState *state, PipelineId pipeline_id);
+// True when get_pipeline wouldn't have to wait (it may still fail)
+bool is_pipeline_ready(ShaderSystemState *state, PipelineId pipeline_id);
+
+// Hot reload: queues a rebuild of every module that was built from path
+// (or includes it), returns how many. Modules that failed their first build
+// aren't picked up again, their pipelines are gone.
+uint32_t reload_changed(ShaderSystemState *state, const char *path);
+// Call between frames. Swaps in the rebuilt modules along with new input
+// layouts for the pipelines that use them. A module that failed to rebuild
+// keeps its previous version.
+uint32_t apply_reloads(ShaderSystemState *state);
+
+bool initialize_permutations(ShaderPermutationSet *set, const ShaderPermutationDesc *desc, ShaderId vs, PipelineId fallback);
+// Queues the variant for the features when it's new (see set_job_system).
+// Gives the fallback when the cache is full.
+PipelineId request_permutation(ShaderSystemState *state, ID3D11Device *device, ShaderPermutationSet *set, uint32_t features);
+// Requests and fetches it. Gives the generic pipeline while the variant is
+// still compiling or when it failed, so this never waits on a compile.
+ShaderPipeline *get_permutation_pipeline(ShaderSystemState *state, ID3D11Device *device, ShaderPermutationSet *set, uint32_t features);
 
 } // namespace shader
@@ -3,21 +3,22 @@ TextureCube ibl_irradiance_tex : register(t0);
 TextureCube ibl_prefilter_tex  : register(t1);
 Texture2D ibl_brdf_lut         : register(t2);
 
-// Material Textures
-Texture2D albedo_tex    : register(t3);
-Texture2D metallic_tex  : register(t4);
-Texture2D roughness_tex : register(t5);
-Texture2D normal_tex    : register(t6);
-Texture2D emission_tex  : register(t7);
+// Material values and textures (t16-t32)
+#include "material.hlsli"
+
+// Lights, clusters, the shadow atlas and its views (t11-t15, b4)
+#include "lighting.hlsli"
 
 // Sampler for textures
 SamplerState linear_sampler : register(s0);
 
-cbuffer PerMaterialConstants : register(b0) {
-    float3 albedo_color;
-    float metallic_value;
-    float roughness_value;
-    float emission_intensity;
+cbuffer PerFrameConstants : register(b0) {
+    row_major float4x4 view_matrix;
+    row_major float4x4 projection_matrix;
+    row_major float4x4 view_projection_matrix;
+    row_major float4x4 inv_view_projection_matrix;
+    float3 camera_position;
+    float _padding;
 };
 
 struct VS_Output {
@@ -27,11 +28,9 @@ struct VS_Output {
     float3 world_position  : WORLD_POSITION;
     float3 camera_position : CAMERA_POS;
     float3x3 TBN           : TBN;
+    nointerpolation uint material_index : MATERIAL_INDEX;
 };
 
-#define PI 3.14159265359
-#define INV_PI (1 / PI)
-
 float3 FresnelSchlick(float cosTheta, float3 F0) {
     return F0 + (1.0f - F0) * pow(1.0f - cosTheta, 5.0f);
 }
@@ -66,19 +65,6 @@ float3 GammaCorrect(float3 color) {
     return pow(color, 1.0 / 2.2);
 }
 
-float D_GGX(float NdotH, float roughness) {
-    float a2 = roughness * roughness * roughness * roughness;
-    float f = (NdotH * a2 - NdotH) * NdotH + 1.0;
-    return a2 / (PI * f * f);
-}
-
-float3 F_Schlick(float cosTheta, float3 F0, float3 F90) {
-    float f = saturate(1.0 - cosTheta);
-    float f2 = f * f;
-    float fresnel = f2 * f2 * f; // pow(1.0f - cosTheta, 5.0f) for ~2 less instructions
-    return F0 + (F90 - F0) * fresnel;
-}
-
 // This already contains the G / (4 N·V N·L) term
 float G_SmithGGXCorrelated(float NdotV, float NdotL, float roughness) {
     float a2 = roughness * roughness * roughness * roughness;
@@ -94,10 +80,6 @@ float V_SmithGGXCorrelatedFast(float NoV, float NoL, float roughness) {
     return 0.5 / (GGXV + GGXL);
 }
 
-float Fd_Lambert() {
-    return INV_PI;
-}
-
 float3 Fd_Burley(float NdotL, float NdotV, float LdotH, float roughness) {
     float F90 = 0.5 + 2.0 * roughness * LdotH * LdotH;
     float3 FL = F_Schlick(NdotL, float3(1.0, 1.0, 1.0), float3(F90, F90, F90));
@@ -115,16 +97,16 @@ float4 main(VS_Output input) : SV_TARGET {
     float cc_roughness = 0.01;
     /*-----------------------------------------------------------*/
 
-    float2 uv = input.uv;
+    MaterialData mat = materials[input.material_index];
 
     // ===========================================================
-    // Sample Textures
+    // Sample Textures (only the maps this permutation has)
     // ===========================================================
-    float3 albedo = albedo_color * albedo_tex.Sample(linear_sampler, uv).rgb;
-    float metallic = metallic_value * metallic_tex.Sample(linear_sampler, uv).r;
-    float roughness = roughness_value * roughness_tex.Sample(linear_sampler, uv).r;
-    float3 emission = emission_intensity * emission_tex.Sample(linear_sampler, uv).rgb;
-    float3 normal = normal_tex.Sample(linear_sampler, uv).xyz;
+    MaterialSample surface = sample_material(linear_sampler, mat, input.uv);
+    float3 albedo = surface.albedo;
+    float metallic = surface.metallic;
+    float roughness = surface.roughness;
+    float3 emission = surface.emission;
 
     // Base reflectance
     float3 F0 = lerp(float3(0.04f, 0.04f, 0.04f), albedo, metallic);
@@ -132,7 +114,7 @@ float4 main(VS_Output input) : SV_TARGET {
     // View vector
     float3 V = normalize(input.camera_position - input.world_position);
     // Base normal
-    float3 N = normalize(mul(normal * 2.0f - 1.0f, input.TBN));
+    float3 N = normalize(mul(surface.normal, input.TBN));
     // Reflection vector
     float3 R = reflect(-V, N);
 
@@ -173,7 +155,14 @@ float4 main(VS_Output input) : SV_TARGET {
     /*-----------------------------------------------------------*/
 
     float3 ibl_lighting = exp2(ibl_exposure_ev) * (diffuse_ibl + specular_ibl + specular_coat);
-    float3 Lo = emission + ibl_lighting;
+
+    // ===========================================================
+    // Direct lighting (directional + clustered point/spot lights)
+    // ===========================================================
+    float view_z = mul(float4(input.world_position, 1.0), view_matrix).z;
+    float3 direct_lighting = compute_direct_lighting(linear_sampler, input.world_position, view_z, input.position.xy, N, V, albedo, metallic, max(roughness, 0.04), NdotV, F0);
+
+    float3 Lo = emission + direct_lighting + ibl_lighting;
 
     return float4(Lo, 1.0f);
 }
@@ -1,14 +1,17 @@
 cbuffer PerFrameConstants : register(b0) {
+    row_major float4x4 view_matrix;
+    row_major float4x4 projection_matrix;
     row_major float4x4 view_projection_matrix;
+    row_major float4x4 inv_view_projection_matrix;
     float3 camera_position;
+    float _padding;
 };
 
 cbuffer PerObjectConstants : register(b1) {
     row_major float4x4 world_matrix;
-    row_major float3x3 world_inv_transpose_matrix;
-    float _pad0;
-    float _pad1;
-    float _pad2;
+    row_major float4x4 world_inv_transpose;
+    uint material_index;
+    uint3 _pad;
 };
 
 struct VS_Input {
@@ -25,9 +28,11 @@ struct VS_Output {
     float3 world_position  : WORLD_POSITION;
     float3 camera_position : CAMERA_POS;
     float3x3 TBN           : TBN;
+    nointerpolation uint material_index : MATERIAL_INDEX;
 };
 
 VS_Output main(VS_Input input) {
+    float3x3 world_inv_transpose_matrix = (float3x3)world_inv_transpose;
     float4 world_position = mul(float4(input.position, 1.0f), world_matrix);
     float3 world_normal = normalize(mul(input.normal, world_inv_transpose_matrix));
     float3 world_tangent = normalize(mul(input.tangent.xyz, world_inv_transpose_matrix));
@@ -40,6 +45,7 @@ VS_Output main(VS_Input input) {
     output.world_position = world_position.xyz;
     output.camera_position = camera_position;
     output.TBN = float3x3(world_tangent, world_bitangent, world_normal);
+    output.material_index = material_index;
 
     return output;
 };
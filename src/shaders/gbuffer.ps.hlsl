@@ -1,10 +1,5 @@
-// Textures
-Texture2D albedoTexture : register(t0);
-Texture2D metallicTexture : register(t1);
-Texture2D roughnessTexture : register(t2);
-Texture2D coatTexture : register(t3);
-Texture2D normalTexture : register(t4);
-Texture2D emissionTexture : register(t5);
+// Material values and textures (t16-t32)
+#include "material.hlsli"
 
 // Samplers
 SamplerState linearSampler : register(s0);
@@ -18,14 +13,6 @@ cbuffer PerFrameConstants : register(b0) {
     float _padding;
 };
 
-cbuffer PerMaterialConstants : register(b1) {
-    float3 albedoColor;
-    float metallicValue;
-    float roughnessValue;
-    float coatValue;
-    float emissionIntensity;
-};
-
 // Incoming data from vertex shader
 struct VSOutput {
     float4 clipSpacePosition : SV_POSITION;
@@ -33,6 +20,7 @@ struct VSOutput {
     float3 worldPosition     : POSITION_WS;
     float3 worldNormal       : NORMAL_WS;
     float4 worldTangent      : TANGENT_WS;   // Stores handedness in w component
+    nointerpolation uint materialIndex : MATERIAL_INDEX;
 };
 
 // Output with multiple targets
@@ -43,14 +31,9 @@ struct PSOutput {
 };
 
 PSOutput main(VSOutput input) {
-    float2 uv = input.texCoord;
-
-    float3 albedoTex = albedoTexture.Sample(linearSampler, uv).rgb;
-    float3 normalTex = normalTexture.Sample(linearSampler, uv).xyz * 2.0 - 1.0; // Decode from [0,1] to [-1,1]
-
-    float roughness = roughnessValue * roughnessTexture.Sample(linearSampler, uv).r;
-    float metallic = metallicValue * metallicTexture.Sample(linearSampler, uv).r;
-    float coat = coatValue * coatTexture.Sample(linearSampler, uv).r;
+    // Only the maps this permutation has are sampled
+    MaterialData mat = materials[input.materialIndex];
+    MaterialSample surface = sample_material(linearSampler, mat, input.texCoord);
 
     // Reconstruct TBN matrix for normal mapping
     float3 N = normalize(input.worldNormal);
@@ -59,18 +42,18 @@ PSOutput main(VSOutput input) {
     float3x3 TBN = float3x3(T, B, N);
 
     // Transform normal from tangent space to world space
-    float3 worldNormalMap = normalize(mul(normalTex, TBN));
+    float3 worldNormalMap = normalize(mul(surface.normal, TBN));
 
     // Encode world normal for storage
     float3 encodedNormal = worldNormalMap * 0.5 + 0.5;
 
     PSOutput output;
     // Albedo (RGB) + Roughness (A)
-    output.rt0 = float4(albedoColor * albedoTex, roughness);
+    output.rt0 = float4(surface.albedo, surface.roughness);
     // World-space normal (RGB)
-    output.rt1 = float4(encodedNormal, coat);
+    output.rt1 = float4(encodedNormal, surface.coat);
     // Emission color (RGB) + Metallic (A)
-    output.rt2 = float4(emissionIntensity * emissionTexture.Sample(linearSampler, uv).rgb, metallic);
+    output.rt2 = float4(surface.emission, surface.metallic);
 
     return output;
 }
@@ -9,10 +9,9 @@ cbuffer PerFrameConstants : register(b0) {
 
 cbuffer PerObjectConstants : register(b1) {
     row_major float4x4 worldMatrix;
-    row_major float3x3 worldInvTranspose;
-    float _padding0;
-    float _padding1;
-    float _padding2;
+    row_major float4x4 worldInvTranspose4x4;
+    uint materialIndex;
+    uint3 _padding;
 };
 
 struct VSInput {
@@ -28,6 +27,7 @@ struct VSOutput {
     float3 worldPosition        : POSITION_WS;
     float3 worldNormal          : NORMAL_WS;
     float4 worldTangent         : TANGENT_WS;   // Stores handedness in w component
+    nointerpolation uint materialIndex : MATERIAL_INDEX;
 };
 
 float4x4 inverse(float4x4 m) {
@@ -70,6 +70,7 @@ float4x4 inverse(float4x4 m) {
 }
 
 VSOutput main(VSInput input) {
+    float3x3 worldInvTranspose = (float3x3)worldInvTranspose4x4;
     float4 worldPos = mul(float4(input.position, 1.0f), worldMatrix);
     float3 transformedTangent = normalize(mul(input.tangent.xyz, worldInvTranspose));
     float3x3 world_inverse_transpose = transpose((float3x3)inverse(worldMatrix));
@@ -80,6 +81,7 @@ VSOutput main(VSInput input) {
     output.worldPosition = worldPos.xyz;
     output.worldNormal = normalize(mul(input.normal, worldInvTranspose));
     output.worldTangent = float4(transformedTangent, -input.tangent.w);
+    output.materialIndex = materialIndex;
 
     return output;
 }
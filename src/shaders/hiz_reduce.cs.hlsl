@@ -0,0 +1,47 @@
+// Reduces the scene depth to the base level of the Hi-Z pyramid, the farthest
+// depth under each texel. It's read back a few frames later and the coarser
+// levels are built on the CPU, see occlusion.hpp.
+// HIZ_MSAA reads the multisampled Forward+ depth, every sample counts.
+
+#define THREAD_COUNT 8
+
+#if defined(HIZ_MSAA)
+Texture2DMS<float> depth_texture : register(t0);
+#else
+Texture2D<float> depth_texture : register(t0);
+#endif
+
+RWTexture2D<float> hiz_texture : register(u0);
+
+cbuffer HiZConstants : register(b0) {
+    uint2 source_size;
+    uint2 target_size;
+    uint sample_count;
+    uint3 _padding;
+};
+
+[numthreads(THREAD_COUNT, THREAD_COUNT, 1)]
+void main(uint3 id : SV_DispatchThreadID) {
+    if (any(id.xy >= target_size)) {
+        return;
+    }
+
+    // Rounded out to whole pixels, neighbouring texels may share an edge pixel
+    uint2 first = id.xy * source_size / target_size;
+    uint2 last = min(((id.xy + 1) * source_size + target_size - 1) / target_size, source_size);
+
+    float farthest = 0.0;
+    for (uint y = first.y; y < last.y; ++y) {
+        for (uint x = first.x; x < last.x; ++x) {
+#if defined(HIZ_MSAA)
+            for (uint s = 0; s < sample_count; ++s) {
+                farthest = max(farthest, depth_texture.Load(int2(x, y), s));
+            }
+#else
+            farthest = max(farthest, depth_texture.Load(int3(x, y, 0)));
+#endif
+        }
+    }
+
+    hiz_texture[id.xy] = farthest;
+}
@@ -0,0 +1,94 @@
+// Assigns point/spot lights to the froxel clusters.
+// One thread group per cluster, the threads split the light list between them.
+// Same tests as light_cluster::assign_reference on the CPU.
+
+// Must match CLUSTER_MAX_LIGHTS in light_cluster.hpp
+#define CLUSTER_MAX_LIGHTS 64
+#define THREAD_COUNT 64
+
+#define CLUSTER_LIGHT_POINT 0
+#define CLUSTER_LIGHT_SPOT 1
+
+struct ClusterBounds {
+    float4 min_radius; // xyz: min corner, w: bounding sphere radius
+    float4 max;        // xyz: max corner
+};
+
+struct ClusterLight {
+    float3 position;
+    float range;
+    float3 direction;
+    float cos_outer;
+    float sin_outer;
+    uint type;
+    uint light_index;
+    float _padding;
+};
+
+StructuredBuffer<ClusterBounds> cluster_bounds : register(t0);
+StructuredBuffer<ClusterLight> cluster_lights : register(t1);
+
+RWStructuredBuffer<uint> cluster_light_counts : register(u0);
+RWStructuredBuffer<uint> cluster_light_indices : register(u1);
+
+cbuffer LightCullingConstants : register(b0) {
+    uint light_count;
+    uint cluster_count;
+    uint2 _padding;
+};
+
+groupshared uint gs_light_count;
+
+bool test_cluster(ClusterBounds bounds, ClusterLight light) {
+    // Sphere vs AABB
+    float3 e = max(max(bounds.min_radius.xyz - light.position, 0.0), light.position - bounds.max.xyz);
+    if (dot(e, e) > light.range * light.range) {
+        return false;
+    }
+
+    if (light.type != CLUSTER_LIGHT_SPOT) {
+        return true;
+    }
+
+    // Cone vs the cluster's bounding sphere
+    float radius = bounds.min_radius.w;
+    float3 v = (bounds.min_radius.xyz + bounds.max.xyz) * 0.5 - light.position;
+    float v_len_sq = dot(v, v);
+    float v1_len = dot(v, light.direction);
+    float closest = light.cos_outer * sqrt(max(v_len_sq - v1_len * v1_len, 0.0)) - v1_len * light.sin_outer;
+
+    bool angle_cull = closest > radius;
+    bool front_cull = v1_len > radius + light.range;
+    bool back_cull = v1_len < -radius;
+    return !(angle_cull || front_cull || back_cull);
+}
+
+[numthreads(THREAD_COUNT, 1, 1)]
+void main(uint3 group_id : SV_GroupID, uint thread_index : SV_GroupIndex) {
+    uint cluster = group_id.x;
+    if (cluster >= cluster_count) {
+        return;
+    }
+
+    if (thread_index == 0) {
+        gs_light_count = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    ClusterBounds bounds = cluster_bounds[cluster];
+    for (uint i = thread_index; i < light_count; i += THREAD_COUNT) {
+        ClusterLight light = cluster_lights[i];
+        if (test_cluster(bounds, light)) {
+            uint slot;
+            InterlockedAdd(gs_light_count, 1, slot);
+            if (slot < CLUSTER_MAX_LIGHTS) {
+                cluster_light_indices[cluster * CLUSTER_MAX_LIGHTS + slot] = light.light_index;
+            }
+        }
+    }
+
+    GroupMemoryBarrierWithGroupSync();
+    if (thread_index == 0) {
+        cluster_light_counts[cluster] = min(gs_light_count, CLUSTER_MAX_LIGHTS);
+    }
+}
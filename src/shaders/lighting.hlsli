@@ -0,0 +1,227 @@
+#ifndef LIGHTING_HLSLI
+#define LIGHTING_HLSLI
+
+// Shared direct lighting for the deferred lighting pass and the Forward+ opaque pass.
+// Directional lights are at the front of the light buffer and apply everywhere,
+// point/spot lights come from the per-cluster lists built by the light culling pass.
+
+#define LIGHT_TYPE_DIRECTIONAL 0
+#define LIGHT_TYPE_POINT 1
+#define LIGHT_TYPE_SPOT 2
+
+// Must match CLUSTER_MAX_LIGHTS in light_cluster.hpp
+#define CLUSTER_MAX_LIGHTS 64
+
+#ifndef PI
+#define PI 3.14159265359
+#endif
+#ifndef INV_PI
+#define INV_PI (1 / PI)
+#endif
+
+struct Light {
+    float3 direction;
+    float intensity;
+    float3 position;
+    float range;
+    float3 color;
+    uint type;
+    float spot_cos_inner;
+    float spot_cos_outer;
+    uint shadow_view_start;
+    uint shadow_view_count; // 0 means no shadow
+};
+
+// A cascade of a directional light, or a spot light's frustum
+struct ShadowView {
+    row_major float4x4 view_projection_matrix;
+    float4 uv_rect; // Tile of the view in the atlas
+    float split_far; // Cascades are picked by view depth, spot lights have a single view
+    float texel_size;
+    float2 _padding;
+};
+
+Texture2D shadow_atlas : register(t11);
+StructuredBuffer<Light> lights : register(t12);
+StructuredBuffer<uint> cluster_light_counts : register(t13);
+StructuredBuffer<uint> cluster_light_indices : register(t14);
+StructuredBuffer<ShadowView> shadow_views : register(t15);
+
+cbuffer ClusterConstants : register(b4) {
+    uint3 cluster_grid_size;
+    uint directional_light_count;
+    float2 screen_size;
+    float cluster_z_scale;
+    float cluster_z_bias;
+};
+
+float D_GGX(float NdotH, float roughness) {
+    float a2 = roughness * roughness * roughness * roughness;
+    float f = (NdotH * a2 - NdotH) * NdotH + 1.0;
+    return a2 / (PI * f * f);
+}
+
+float3 F_Schlick(float cosTheta, float3 F0, float3 F90) {
+    float f = saturate(1.0 - cosTheta);
+    float f2 = f * f;
+    float fresnel = f2 * f2 * f; // pow(1.0f - cosTheta, 5.0f) for ~2 less instructions
+    return F0 + (F90 - F0) * fresnel;
+}
+
+// This already contains the G / (4 N·V N·L) term
+float G_smith_ggx_correlated(float NdotV, float NdotL, float roughness) {
+    float a2 = roughness * roughness * roughness * roughness;
+    float GGXL = NdotV * sqrt((-NdotL * a2 + NdotL) * NdotL + a2);
+    float GGXV = NdotL * sqrt((-NdotV * a2 + NdotV) * NdotV + a2);
+    return 0.5 / (GGXV + GGXL);
+}
+
+float Fd_Lambert() {
+    return INV_PI;
+}
+
+float sample_shadow(SamplerState samp, float4 lightspace_pos, float4 uv_rect) {
+    // Perspective divide
+    float3 ndc = lightspace_pos.xyz / lightspace_pos.w;
+
+    // Check if fragment is outside light frustum
+    if (ndc.x < -1.0 || ndc.x > 1.0 || ndc.y < -1.0 || ndc.y > 1.0 || ndc.z < 0.0 || ndc.z > 1.0) {
+        return 1.0; // No shadow (fully lit) if outside frustum
+    }
+
+    // Convert to [0,1] range
+    float2 shadow_uv = ndc.xy * 0.5f + 0.5f;
+    // Flip Y coordinate for Direct3D
+    shadow_uv.y = 1.0f - shadow_uv.y;
+
+    // Map to the specific light's region in the shadow atlas
+    shadow_uv = shadow_uv * uv_rect.zw + uv_rect.xy;
+
+    // Current fragment depth
+    float current_depth = ndc.z;
+
+    // PCF (Percentage Closer Filtering) with bias
+    float shadow = 0.0;
+    float bias = 0.0005; // Adjust based on your scene scale
+    float2 atlas_size;
+    shadow_atlas.GetDimensions(atlas_size.x, atlas_size.y);
+    float2 texel_size = 1.0 / atlas_size;
+
+    // Tiles are packed tight, don't let the filter read the neighbours
+    float2 uv_min = uv_rect.xy + texel_size * 0.5;
+    float2 uv_max = uv_rect.xy + uv_rect.zw - texel_size * 0.5;
+
+    [unroll]
+    for (int y = -1; y <= 1; ++y) {
+        [unroll]
+        for (int x = -1; x <= 1; ++x) {
+            float2 offset = float2(x, y) * texel_size;
+            float shadow_depth = shadow_atlas.Sample(samp, clamp(shadow_uv + offset, uv_min, uv_max)).r;
+
+            // Compare depths with bias
+            shadow += (current_depth - bias > shadow_depth) ? 0.0 : 1.0;
+        }
+    }
+
+    return shadow / 9.0;
+}
+
+float compute_shadow(SamplerState samp, Light light, float3 world_position, float3 N, float view_z) {
+    // First view that reaches this far
+    uint last = light.shadow_view_start + light.shadow_view_count;
+    for (uint v = light.shadow_view_start; v < last; ++v) {
+        ShadowView shadow_view = shadow_views[v];
+        if (view_z <= shadow_view.split_far) {
+            // Push the lookup out along the normal by about a texel against acne
+            float3 offset_position = world_position + N * shadow_view.texel_size * 1.5;
+            float4 lightspace_pos = mul(float4(offset_position, 1.0), shadow_view.view_projection_matrix);
+            return sample_shadow(samp, lightspace_pos, shadow_view.uv_rect);
+        }
+    }
+
+    // Past the shadow distance
+    return 1.0;
+}
+
+uint get_cluster_index(float2 screen_position, float view_z) {
+    uint2 tile = uint2(screen_position / screen_size * float2(cluster_grid_size.xy));
+    tile = min(tile, cluster_grid_size.xy - 1);
+
+    // Exponential depth slices, same as light_cluster::get_slice
+    int slice = int(floor(log(max(view_z, 1e-4)) * cluster_z_scale + cluster_z_bias));
+    uint z = (uint)clamp(slice, 0, int(cluster_grid_size.z) - 1);
+
+    return tile.x + tile.y * cluster_grid_size.x + z * cluster_grid_size.x * cluster_grid_size.y;
+}
+
+float3 evaluate_brdf(float3 L, float3 N, float3 V, float3 albedo, float metallic, float roughness, float NdotV, float3 F0) {
+    float3 H = normalize(V + L);
+
+    float NdotL = saturate(dot(N, L));
+    float NdotH = saturate(dot(N, H));
+    float LdotH = saturate(dot(L, H));
+
+    float D = D_GGX(NdotH, roughness);
+    float3 F = F_Schlick(LdotH, F0, float3(1.0, 1.0, 1.0));
+    float G = G_smith_ggx_correlated(NdotV, NdotL, roughness);
+    float3 Fr = (D * G) * F;
+    float3 Fd = albedo * Fd_Lambert();
+
+    return ((1.0 - metallic) * Fd + Fr) * NdotL;
+}
+
+// Smooth window so the light reaches exactly zero at its range
+float distance_attenuation(float distance, float range) {
+    float ratio = distance / range;
+    float ratio4 = ratio * ratio * ratio * ratio;
+    float window = saturate(1.0 - ratio4);
+    return (window * window) / (distance * distance + 1.0);
+}
+
+float3 compute_direct_lighting(SamplerState samp, float3 world_position, float view_z, float2 screen_position,
+                               float3 N, float3 V, float3 albedo, float metallic, float roughness, float NdotV, float3 F0) {
+    float3 direct_lighting = float3(0.0, 0.0, 0.0);
+
+    // Directional lights, with cascaded shadows from the atlas
+    for (uint i = 0; i < directional_light_count; ++i) {
+        Light light = lights[i];
+        float3 L = normalize(-light.direction);
+
+        float shadow = 1.0;
+        if (light.shadow_view_count > 0) {
+            shadow = compute_shadow(samp, light, world_position, N, view_z);
+        }
+
+        direct_lighting += evaluate_brdf(L, N, V, albedo, metallic, roughness, NdotV, F0) * light.color * light.intensity * shadow;
+    }
+
+    // Point and spot lights touching this cluster
+    uint cluster = get_cluster_index(screen_position, view_z);
+    uint count = cluster_light_counts[cluster];
+    uint base = cluster * CLUSTER_MAX_LIGHTS;
+
+    for (uint j = 0; j < count; ++j) {
+        Light light = lights[cluster_light_indices[base + j]];
+
+        float3 to_light = light.position - world_position;
+        float distance = length(to_light);
+        float3 L = to_light / max(distance, 1e-4);
+
+        float attenuation = distance_attenuation(distance, light.range);
+        if (light.type == LIGHT_TYPE_SPOT) {
+            float cos_angle = dot(-L, light.direction);
+            attenuation *= smoothstep(light.spot_cos_outer, light.spot_cos_inner, cos_angle);
+        }
+        if (attenuation > 0.0 && light.shadow_view_count > 0) {
+            attenuation *= compute_shadow(samp, light, world_position, N, view_z);
+        }
+
+        if (attenuation > 0.0) {
+            direct_lighting += evaluate_brdf(L, N, V, albedo, metallic, roughness, NdotV, F0) * light.color * light.intensity * attenuation;
+        }
+    }
+
+    return direct_lighting;
+}
+
+#endif // LIGHTING_HLSLI
@@ -11,17 +11,8 @@ TextureCube irradiance_tex : register(t4);
 TextureCube prefilter_map : register(t5);
 Texture2D brdf_lut : register(t6);
 
-// Shadow Atlas
-Texture2D shadow_atlas : register(t7);
-
-// Lights array
-struct Light {
-    float3 direction;
-    float intensity;
-    row_major float4x4 light_vp_matrix;
-    float4 uv_rect;
-};
-StructuredBuffer<Light> lights : register(t8);
+// Lights, clusters, the shadow atlas and its views (t11-t15, b4)
+#include "lighting.hlsli"
 
 // Sampler for textures
 SamplerState samp : register(s0);
@@ -40,74 +31,6 @@ struct PSInput {
     float2 uv : TEXCOORD0;
 };
 
-#define PI 3.14159265359
-#define INV_PI (1 / PI)
-
-float D_GGX(float NdotH, float roughness) {
-    float a2 = roughness * roughness * roughness * roughness;
-    float f = (NdotH * a2 - NdotH) * NdotH + 1.0;
-    return a2 / (PI * f * f);
-}
-
-float3 F_Schlick(float cosTheta, float3 F0, float3 F90) {
-    float f = saturate(1.0 - cosTheta);
-    float f2 = f * f;
-    float fresnel = f2 * f2 * f; // pow(1.0f - cosTheta, 5.0f) for ~2 less instructions
-    return F0 + (F90 - F0) * fresnel;
-}
-
-// This already contains the G / (4 N·V N·L) term
-float G_smith_ggx_correlated(float NdotV, float NdotL, float roughness) {
-    float a2 = roughness * roughness * roughness * roughness;
-    float GGXL = NdotV * sqrt((-NdotL * a2 + NdotL) * NdotL + a2);
-    float GGXV = NdotL * sqrt((-NdotV * a2 + NdotV) * NdotV + a2);
-    return 0.5 / (GGXV + GGXL);
-}
-
-float Fd_Lambert() {
-    return INV_PI;
-}
-
-float compute_shadow(Texture2D shadow_atlas, SamplerState samp, float4 lightspace_pos, float4 uv_rect) {
-    // Perspective divide
-    float3 ndc = lightspace_pos.xyz / lightspace_pos.w;
-
-    // Check if fragment is outside light frustum
-    if (ndc.x < -1.0 || ndc.x > 1.0 || ndc.y < -1.0 || ndc.y > 1.0 || ndc.z < 0.0 || ndc.z > 1.0) {
-        return 0.0; // No shadow (fully lit) if outside frustum
-    }
-
-    // Convert to [0,1] range
-    float2 shadow_uv = ndc.xy * 0.5f + 0.5f;
-    // Flip Y coordinate for Direct3D
-    shadow_uv.y = 1.0f - shadow_uv.y;
-
-    // Map to the specific light's region in the shadow atlas
-    shadow_uv = shadow_uv * uv_rect.zw + uv_rect.xy;
-
-    // Current fragment depth
-    float current_depth = ndc.z;
-
-    // PCF (Percentage Closer Filtering) with bias
-    float shadow = 0.0;
-    float bias = 0.0005;             // Adjust based on your scene scale
-    float texel_size = 1.0 / 1024.0; // Should match your shadow atlas resolution
-
-    [unroll]
-    for (int y = -1; y <= 1; ++y) {
-        [unroll]
-        for (int x = -1; x <= 1; ++x) {
-            float2 offset = float2(x, y) * texel_size;
-            float shadow_depth = shadow_atlas.Sample(samp, shadow_uv + offset).r;
-
-            // Compare depths with bias
-            shadow += (current_depth - bias > shadow_depth) ? 0.0 : 1.0;
-        }
-    }
-
-    return shadow / 9.0;
-}
-
 float4 main(PSInput input) : SV_TARGET {
     // Some hardcoded value for now for coat
     // float clear_coat = 0.0;
@@ -155,35 +78,8 @@ float4 main(PSInput input) : SV_TARGET {
     // =======================================================
     // DIRECT LIGHTING
     // =======================================================
-    float3 direct_lighting = float3(0, 0, 0);
-    // HACK: Hardcoded max lights...
-    for (int i = 0; i < 1; ++i) {
-        Light light = lights[i];
-
-        float3 L = normalize(-light.direction);
-        float3 H = normalize(V + L);
-
-        float NdotL = saturate(dot(normal, L));
-        float NdotH = saturate(dot(normal, H));
-        float LdotH = saturate(dot(L, H));
-
-        // Evaluate BRDF
-        float D = D_GGX(NdotH, roughness);
-        float3 F = F_Schlick(LdotH, F0, float3(1.0, 1.0, 1.0));
-        float G = G_smith_ggx_correlated(NdotV, NdotL, roughness);
-        float3 Fr = (D * G) * F;
-        float3 Fd = albedo * Fd_Lambert();
-        float3 BRDF = (1.0 - metallic) * Fd + Fr;
-
-        // Shadow computation with atlas UV mapping
-        float4 lightspace_pos = mul(float4(world_position, 1.0), light.light_vp_matrix);
-        float shadow = compute_shadow(shadow_atlas, samp, lightspace_pos, light.uv_rect);
-
-        // Apply lighting only if fragment is facing the light
-        if (NdotL > 0.0) {
-            direct_lighting += BRDF * float3(1.0, 1.0, 1.0) * light.intensity * NdotL * shadow;
-        }
-    }
+    float view_z = mul(float4(world_position, 1.0), view_matrix).z;
+    float3 direct_lighting = compute_direct_lighting(samp, world_position, view_z, input.pos.xy, normal, V, albedo, metallic, roughness, NdotV, F0);
 
     // =======================================================
     // INDIRECT LIGHTING
@@ -0,0 +1,125 @@
+// Material table shared by the G-buffer and Forward+ passes (see material::bind_table).
+// Values of every material in one buffer, textures in arrays grouped by
+// size and format, addressed by slot: array in the high 16 bits, layer in the low 16.
+
+// Must match MATERIAL_TEXTURE_ARRAYS in material_table.hpp
+#define MATERIAL_TEXTURE_ARRAYS 16
+
+// Permutations (shader_permutation.hpp) define SPECIALIZED and the HAS_* of
+// the maps the material has, the generic shader samples all of them.
+// Must match MaterialFeature in material.hpp.
+#ifndef SPECIALIZED
+#define HAS_ALBEDO_MAP 1
+#define HAS_METALLIC_MAP 1
+#define HAS_ROUGHNESS_MAP 1
+#define HAS_MRAO_MAP 1
+#define HAS_COAT_MAP 1
+#define HAS_NORMAL_MAP 1
+#define HAS_EMISSION 1
+#define HAS_EMISSION_MAP 1
+#endif
+#define MATERIAL_FEATURE_MRAO_MAP (1 << 3)
+
+struct MaterialData {
+    float3 albedo_color;
+    float metallic_value;
+    float roughness_value;
+    float coat_value;
+    float emission_intensity;
+    uint albedo_texture;
+    uint metallic_texture;
+    uint roughness_texture;
+    uint coat_texture;
+    uint normal_texture;
+    uint emission_texture;
+    uint features;
+    uint2 _padding;
+};
+
+Texture2DArray material_textures[MATERIAL_TEXTURE_ARRAYS] : register(t16);
+StructuredBuffer<MaterialData> materials : register(t32);
+
+float4 sample_material_texture(SamplerState samp, uint slot, float2 uv, float2 uv_ddx, float2 uv_ddy) {
+    float3 coord = float3(uv, slot & 0xFFFF);
+
+    // SM5 only indexes resource arrays with literals, so branch to one.
+    // Gradients come from outside the branch.
+    switch (slot >> 16) {
+        case 0: return material_textures[0].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 1: return material_textures[1].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 2: return material_textures[2].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 3: return material_textures[3].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 4: return material_textures[4].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 5: return material_textures[5].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 6: return material_textures[6].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 7: return material_textures[7].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 8: return material_textures[8].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 9: return material_textures[9].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 10: return material_textures[10].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 11: return material_textures[11].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 12: return material_textures[12].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 13: return material_textures[13].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        case 14: return material_textures[14].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+        default: return material_textures[15].SampleGrad(samp, coord, uv_ddx, uv_ddy);
+    }
+}
+
+struct MaterialSample {
+    float3 albedo;
+    float metallic;
+    float roughness;
+    float coat;
+    float3 normal; // Tangent space
+    float3 emission;
+};
+
+MaterialSample sample_material(SamplerState samp, MaterialData mat, float2 uv) {
+    float2 uv_ddx = ddx(uv);
+    float2 uv_ddy = ddy(uv);
+
+    MaterialSample s;
+    s.albedo = mat.albedo_color;
+    s.metallic = mat.metallic_value;
+    s.roughness = mat.roughness_value;
+    s.coat = mat.coat_value;
+    s.normal = float3(0.0, 0.0, 1.0);
+    s.emission = float3(0.0, 0.0, 0.0);
+
+#if HAS_ALBEDO_MAP
+    s.albedo *= sample_material_texture(samp, mat.albedo_texture, uv, uv_ddx, uv_ddy).rgb;
+#endif
+
+    // Packed maps are one fetch for both, the generic shader has to check
+#if HAS_MRAO_MAP
+    if (mat.features & MATERIAL_FEATURE_MRAO_MAP) {
+        float4 mrao = sample_material_texture(samp, mat.metallic_texture, uv, uv_ddx, uv_ddy);
+        s.roughness *= mrao.g;
+        s.metallic *= mrao.b;
+    } else
+#endif
+    {
+#if HAS_METALLIC_MAP
+        s.metallic *= sample_material_texture(samp, mat.metallic_texture, uv, uv_ddx, uv_ddy).r;
+#endif
+#if HAS_ROUGHNESS_MAP
+        s.roughness *= sample_material_texture(samp, mat.roughness_texture, uv, uv_ddx, uv_ddy).r;
+#endif
+    }
+
+#if HAS_COAT_MAP
+    s.coat *= sample_material_texture(samp, mat.coat_texture, uv, uv_ddx, uv_ddy).r;
+#endif
+
+#if HAS_NORMAL_MAP
+    s.normal = sample_material_texture(samp, mat.normal_texture, uv, uv_ddx, uv_ddy).xyz * 2.0 - 1.0; // Decode from [0,1] to [-1,1]
+#endif
+
+#if HAS_EMISSION
+    s.emission = mat.emission_intensity;
+#if HAS_EMISSION_MAP
+    s.emission *= sample_material_texture(samp, mat.emission_texture, uv, uv_ddx, uv_ddy).rgb;
+#endif
+#endif
+
+    return s;
+}
@@ -0,0 +1,19 @@
+// Fullscreen passes over a single shadow atlas tile (the viewport picks the tile).
+// main copies the cached static casters into the atlas before the dynamic ones
+// are drawn on top, clear resets a tile of the static atlas.
+
+Texture2D<float> static_atlas : register(t0);
+
+struct VS_Output {
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+float main(VS_Output input) : SV_Depth {
+    // Same texel in both atlases, no filtering
+    return static_atlas.Load(int3(input.position.xy, 0));
+}
+
+float clear(VS_Output input) : SV_Depth {
+    return 1.0;
+}
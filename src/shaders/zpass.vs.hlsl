@@ -1,6 +1,10 @@
 cbuffer PerFrameConstants : register(b0) {
+    row_major float4x4 viewMatrix;
+    row_major float4x4 projectionMatrix;
     row_major float4x4 viewProjectionMatrix;
+    row_major float4x4 invViewProjectionMatrix;
     float3 cameraPosition;
+    float _padding;
 };
 
 cbuffer PerObjectConstants : register(b1) {
@@ -0,0 +1,278 @@
+#include "shadow_atlas.hpp"
+
+#include <cassert>
+
+static uint32_t level_offset(uint32_t level);
+static uint16_t get_parent(uint16_t node);
+static uint16_t get_first_child(uint16_t node);
+static uint16_t find_free_node(const ShadowAtlas *atlas, uint32_t level);
+static void evict(ShadowAtlas *atlas, ShadowAtlasEntry *entry);
+
+void shadow_atlas::initialize(ShadowAtlas *atlas, uint32_t size) {
+    assert(atlas && "shadow_atlas::initialize: Atlas pointer cannot be NULL");
+    assert(size >= (1u << (SHADOW_ATLAS_LEVELS - 1)) && "shadow_atlas::initialize: Atlas is too small for the tree");
+
+    atlas->size = size;
+    for (uint32_t i = 0; i < SHADOW_ATLAS_NODE_COUNT; ++i) {
+        atlas->nodes[i] = SHADOW_NODE_FREE;
+    }
+}
+
+uint16_t shadow_atlas::alloc(ShadowAtlas *atlas, uint32_t level) {
+    assert(level < SHADOW_ATLAS_LEVELS && "shadow_atlas::alloc: Level out of range");
+
+    // Best fit: a free node of the right size
+    uint16_t node = find_free_node(atlas, level);
+    if (node != SHADOW_ATLAS_NODE_NONE) {
+        atlas->nodes[node] = SHADOW_NODE_USED;
+        return node;
+    }
+
+    // Otherwise split the smallest free block that is bigger
+    for (int32_t l = (int32_t)level - 1; l >= 0; --l) {
+        node = find_free_node(atlas, (uint32_t)l);
+        if (node == SHADOW_ATLAS_NODE_NONE) {
+            continue;
+        }
+
+        for (uint32_t split_level = (uint32_t)l; split_level < level; ++split_level) {
+            atlas->nodes[node] = SHADOW_NODE_SPLIT;
+            uint16_t child = get_first_child(node);
+            for (uint16_t c = 0; c < 4; ++c) {
+                atlas->nodes[child + c] = SHADOW_NODE_FREE;
+            }
+            node = child;
+        }
+
+        atlas->nodes[node] = SHADOW_NODE_USED;
+        return node;
+    }
+
+    return SHADOW_ATLAS_NODE_NONE;
+}
+
+void shadow_atlas::release(ShadowAtlas *atlas, uint16_t node) {
+    assert(node < SHADOW_ATLAS_NODE_COUNT && atlas->nodes[node] == SHADOW_NODE_USED && "shadow_atlas::release: Node is not allocated");
+
+    atlas->nodes[node] = SHADOW_NODE_FREE;
+
+    // Merge back up while all four siblings are free
+    while (node != 0) {
+        uint16_t parent = get_parent(node);
+        uint16_t first = get_first_child(parent);
+        for (uint16_t c = 0; c < 4; ++c) {
+            if (atlas->nodes[first + c] != SHADOW_NODE_FREE) {
+                return;
+            }
+        }
+        atlas->nodes[parent] = SHADOW_NODE_FREE;
+        node = parent;
+    }
+}
+
+uint32_t shadow_atlas::get_level(uint16_t node) {
+    uint32_t level = 0;
+    while (level + 1 < SHADOW_ATLAS_LEVELS && node >= level_offset(level + 1)) {
+        level++;
+    }
+    return level;
+}
+
+uint32_t shadow_atlas::get_level_size(const ShadowAtlas *atlas, uint32_t level) {
+    return atlas->size >> level;
+}
+
+uint32_t shadow_atlas::get_level_for_size(const ShadowAtlas *atlas, uint32_t size) {
+    uint32_t level = 0;
+    while (level + 1 < SHADOW_ATLAS_LEVELS && get_level_size(atlas, level + 1) >= size) {
+        level++;
+    }
+    return level;
+}
+
+void shadow_atlas::get_node_rect(const ShadowAtlas *atlas, uint16_t node, uint32_t *out_x, uint32_t *out_y, uint32_t *out_size) {
+    uint32_t level = get_level(node);
+    uint32_t index = node - level_offset(level);
+    uint32_t size = get_level_size(atlas, level);
+
+    // Index within the level is a morton code, two bits per level (x low, y high)
+    uint32_t x = 0;
+    uint32_t y = 0;
+    for (uint32_t bit = 0; bit < level; ++bit) {
+        x |= ((index >> (2 * bit)) & 1) << bit;
+        y |= ((index >> (2 * bit + 1)) & 1) << bit;
+    }
+
+    *out_x = x * size;
+    *out_y = y * size;
+    *out_size = size;
+}
+
+void shadow_atlas::begin_requests(ShadowAtlasEntry *entries, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        entries[i].requested = false;
+    }
+}
+
+ShadowAtlasEntry *shadow_atlas::request(ShadowAtlasEntry *entries, uint32_t count, uint64_t key, float priority, uint32_t desired_level) {
+    assert(key != 0 && "shadow_atlas::request: Key 0 is reserved for unused entries");
+
+    ShadowAtlasEntry *entry = nullptr;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (entries[i].key == key) {
+            entry = &entries[i];
+            break;
+        }
+    }
+
+    // New view, take an unused entry
+    if (!entry) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (entries[i].key == 0) {
+                entry = &entries[i];
+                entry->key = key;
+                entry->node = SHADOW_ATLAS_NODE_NONE;
+                entry->level = 0;
+                entry->cache.valid = false;
+                break;
+            }
+        }
+    }
+
+    if (!entry) {
+        return nullptr;
+    }
+
+    entry->priority = priority;
+    entry->desired_level = (uint8_t)(desired_level < SHADOW_ATLAS_LEVELS ? desired_level : SHADOW_ATLAS_LEVELS - 1);
+    entry->requested = true;
+    return entry;
+}
+
+void shadow_atlas::resolve(ShadowAtlas *atlas, ShadowAtlasEntry *entries, uint32_t count) {
+    assert(count <= MAX_SHADOW_VIEWS && "shadow_atlas::resolve: Too many entries");
+
+    // Views that went away give their tiles back
+    uint32_t order[MAX_SHADOW_VIEWS];
+    uint32_t order_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        ShadowAtlasEntry *entry = &entries[i];
+        if (entry->key == 0) {
+            continue;
+        }
+        if (!entry->requested) {
+            evict(atlas, entry);
+            entry->key = 0;
+            continue;
+        }
+
+        // Insertion sort by priority, highest first, stable for equal ones
+        uint32_t j = order_count++;
+        while (j > 0 && entries[order[j - 1]].priority < entry->priority) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (uint32_t i = 0; i < order_count; ++i) {
+        ShadowAtlasEntry *entry = &entries[order[i]];
+
+        // Small changes in size don't move the tile, so its cache survives
+        if (entry->node != SHADOW_ATLAS_NODE_NONE) {
+            int32_t diff = (int32_t)entry->level - (int32_t)entry->desired_level;
+            if (diff >= -1 && diff <= 1) {
+                continue;
+            }
+            evict(atlas, entry);
+        }
+
+        uint32_t evict_from = order_count;
+        for (uint32_t level = entry->desired_level; level < SHADOW_ATLAS_LEVELS; ++level) {
+            uint16_t node = shadow_atlas::alloc(atlas, level);
+
+            // Take space from lower priority views, lowest first
+            while (node == SHADOW_ATLAS_NODE_NONE && evict_from > i + 1) {
+                ShadowAtlasEntry *victim = &entries[order[--evict_from]];
+                if (victim->node != SHADOW_ATLAS_NODE_NONE) {
+                    evict(atlas, victim);
+                    node = shadow_atlas::alloc(atlas, level);
+                }
+            }
+
+            if (node != SHADOW_ATLAS_NODE_NONE) {
+                entry->node = node;
+                entry->level = (uint8_t)level;
+                break;
+            }
+        }
+    }
+}
+
+ShadowUpdate shadow_atlas::update_cache(ShadowCacheState *cache, uint64_t view_hash, uint64_t static_hash, uint64_t dynamic_hash) {
+    if (!cache->valid || cache->view_hash != view_hash || cache->static_hash != static_hash) {
+        cache->view_hash = view_hash;
+        cache->static_hash = static_hash;
+        cache->dynamic_hash = dynamic_hash;
+        cache->valid = true;
+        return SHADOW_UPDATE_FULL;
+    }
+
+    // Static layer is still good, only the dynamic casters moved (or left)
+    if (cache->dynamic_hash != dynamic_hash) {
+        cache->dynamic_hash = dynamic_hash;
+        return SHADOW_UPDATE_DYNAMIC;
+    }
+
+    return SHADOW_UPDATE_NONE;
+}
+
+uint64_t shadow_atlas::hash(uint64_t h, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint32_t level_offset(uint32_t level) {
+    // 1 + 4 + ... + 4^(level-1)
+    return ((1u << (2 * level)) - 1) / 3;
+}
+
+static uint16_t get_parent(uint16_t node) {
+    uint32_t level = shadow_atlas::get_level(node);
+    uint32_t index = node - level_offset(level);
+    return (uint16_t)(level_offset(level - 1) + index / 4);
+}
+
+static uint16_t get_first_child(uint16_t node) {
+    uint32_t level = shadow_atlas::get_level(node);
+    uint32_t index = node - level_offset(level);
+    return (uint16_t)(level_offset(level + 1) + index * 4);
+}
+
+static uint16_t find_free_node(const ShadowAtlas *atlas, uint32_t level) {
+    // Only nodes under a split parent are part of the tree, anything
+    // below a free or used node is leftover state
+    uint32_t first = level_offset(level);
+    uint32_t last = level_offset(level + 1);
+    for (uint32_t node = first; node < last; ++node) {
+        if (atlas->nodes[node] != SHADOW_NODE_FREE) {
+            continue;
+        }
+        if (level == 0 || atlas->nodes[get_parent((uint16_t)node)] == SHADOW_NODE_SPLIT) {
+            return (uint16_t)node;
+        }
+    }
+    return SHADOW_ATLAS_NODE_NONE;
+}
+
+static void evict(ShadowAtlas *atlas, ShadowAtlasEntry *entry) {
+    if (entry->node != SHADOW_ATLAS_NODE_NONE) {
+        shadow_atlas::release(atlas, entry->node);
+    }
+    entry->node = SHADOW_ATLAS_NODE_NONE;
+    entry->cache.valid = false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Quadtree over the shadow atlas. Level 0 is the whole atlas, every level
+// below splits a node into four, down to SHADOW_ATLAS_MIN_TILE sized tiles.
+#define SHADOW_ATLAS_LEVELS 5
+#define SHADOW_ATLAS_NODE_COUNT 341 // 1 + 4 + 16 + 64 + 256
+#define SHADOW_ATLAS_NODE_NONE UINT16_MAX
+#define MAX_SHADOW_VIEWS 64
+
+#define SHADOW_HASH_SEED 0xcbf29ce484222325ull
+
+enum ShadowAtlasNodeState : uint8_t {
+    SHADOW_NODE_FREE,
+    SHADOW_NODE_SPLIT,
+    SHADOW_NODE_USED,
+};
+
+struct ShadowAtlas {
+    uint32_t size; // Texels per side
+    ShadowAtlasNodeState nodes[SHADOW_ATLAS_NODE_COUNT];
+};
+
+// What a shadow view's tile holds, so it can be left alone when nothing changed
+struct ShadowCacheState {
+    uint64_t view_hash;    // View-projection of the light
+    uint64_t static_hash;  // Static casters in the frustum and their transforms
+    uint64_t dynamic_hash; // Same for the dynamic casters
+    bool valid;            // The static layer matches view_hash and static_hash
+};
+
+enum ShadowUpdate {
+    SHADOW_UPDATE_NONE,    // Tile is up to date
+    SHADOW_UPDATE_DYNAMIC, // Restore the static layer, redraw the dynamic casters
+    SHADOW_UPDATE_FULL,    // Redraw the static layer too
+};
+
+// One shadow view (a cascade or a spot light) that wants space on the atlas
+struct ShadowAtlasEntry {
+    uint64_t key;          // Owner, 0 means the entry is unused
+    float priority;        // Higher priority gets its size first
+    uint8_t desired_level; // Level it would like this frame
+    uint8_t level;         // Level of the tile it has
+    uint16_t node;         // SHADOW_ATLAS_NODE_NONE when it has no tile
+    bool requested;        // Still wanted this frame
+    ShadowCacheState cache;
+};
+
+namespace shadow_atlas {
+
+void initialize(ShadowAtlas *atlas, uint32_t size);
+
+// Returns a node at the given level, or SHADOW_ATLAS_NODE_NONE when it's full.
+// Prefers space in nodes that are already split, so big blocks stay whole.
+uint16_t alloc(ShadowAtlas *atlas, uint32_t level);
+void release(ShadowAtlas *atlas, uint16_t node);
+
+uint32_t get_level(uint16_t node);
+uint32_t get_level_size(const ShadowAtlas *atlas, uint32_t level);
+// Smallest level whose tiles are at least size texels, clamped to the tree
+uint32_t get_level_for_size(const ShadowAtlas *atlas, uint32_t size);
+void get_node_rect(const ShadowAtlas *atlas, uint16_t node, uint32_t *out_x, uint32_t *out_y, uint32_t *out_size);
+
+// Per frame: begin, request every view that wants a shadow, then resolve.
+// Resolve frees the tiles of views that weren't requested, then hands out
+// tiles by priority. A view keeps its tile while the desired size is within
+// a level of it. When the atlas is full, lower priority views give up theirs
+// and fall back to smaller sizes or no shadow at all.
+void begin_requests(ShadowAtlasEntry *entries, uint32_t count);
+ShadowAtlasEntry *request(ShadowAtlasEntry *entries, uint32_t count, uint64_t key, float priority, uint32_t desired_level);
+void resolve(ShadowAtlas *atlas, ShadowAtlasEntry *entries, uint32_t count);
+
+// Decides what has to be redrawn in a view's tile and remembers the new state
+ShadowUpdate update_cache(ShadowCacheState *cache, uint64_t view_hash, uint64_t static_hash, uint64_t dynamic_hash);
+
+// FNV-1a, start from SHADOW_HASH_SEED
+uint64_t hash(uint64_t h, const void *data, size_t size);
+
+} // namespace shadow_atlas
@@ -0,0 +1,134 @@
+#include "shadow_cascades.hpp"
+
+#include <cassert>
+#include <cmath>
+
+void shadow_cascades::compute_splits(float znear, float zfar, uint32_t count, float lambda, float *out_splits) {
+    assert(out_splits && count > 0 && "shadow_cascades::compute_splits: Invalid output");
+    assert(znear > 0.0f && zfar > znear && "shadow_cascades::compute_splits: Invalid depth range");
+
+    out_splits[0] = znear;
+    for (uint32_t i = 1; i < count; ++i) {
+        float p = (float)i / (float)count;
+        float log_split = znear * powf(zfar / znear, p);
+        float uniform_split = znear + (zfar - znear) * p;
+        out_splits[i] = lambda * log_split + (1.0f - lambda) * uniform_split;
+    }
+    out_splits[count] = zfar;
+}
+
+void shadow_cascades::compute_slice_sphere(float tan_half_fov_y, float aspect_ratio, float split_near, float split_far, float *out_center_z, float *out_radius) {
+    // Squared distance from the view axis to a corner, per unit of depth
+    float k2 = tan_half_fov_y * tan_half_fov_y * (1.0f + aspect_ratio * aspect_ratio);
+    float near2 = split_near * split_near * k2;
+    float far2 = split_far * split_far * k2;
+
+    // Center on the axis that is equally far from the near and far corners
+    float center_z = 0.5f * (split_near + split_far) + 0.5f * (far2 - near2) / (split_far - split_near);
+
+    // Wide slices: the far corners alone decide the sphere
+    if (center_z > split_far) {
+        center_z = split_far;
+    }
+
+    float dz = split_far - center_z;
+    *out_center_z = center_z;
+    *out_radius = sqrtf(dz * dz + far2);
+}
+
+void shadow_cascades::fit(const ShadowCameraDesc *camera, float split_near, float split_far, DirectX::XMFLOAT3 light_direction,
+                          uint32_t resolution, float caster_distance, ShadowCascade *out_cascade) {
+    assert(camera && out_cascade && "shadow_cascades::fit: camera and out_cascade cannot be NULL");
+    assert(resolution > 0 && "shadow_cascades::fit: resolution must be positive");
+
+    float center_z;
+    float radius;
+    compute_slice_sphere(tanf(camera->fov_y * 0.5f), camera->aspect_ratio, split_near, split_far, &center_z, &radius);
+
+    // The radius only depends on the projection, rounding it up keeps the
+    // texel size exactly the same from frame to frame
+    radius = ceilf(radius * 16.0f) / 16.0f;
+
+    DirectX::XMMATRIX inv_view = DirectX::XMLoadFloat4x4(&camera->inv_view_matrix);
+    DirectX::XMVECTOR center = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(0.0f, 0.0f, center_z, 1.0f), inv_view);
+
+    // Light looks at the sphere from outside of it, far enough back to catch casters in front
+    DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&light_direction));
+    DirectX::XMVECTOR eye = DirectX::XMVectorSubtract(center, DirectX::XMVectorScale(direction, radius + caster_distance));
+
+    // Straight down lights would make the usual up vector degenerate
+    DirectX::XMVECTOR up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    if (fabsf(DirectX::XMVectorGetY(direction)) > 0.99f) {
+        up = DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+    }
+
+    float depth_far = caster_distance + 2.0f * radius;
+    DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH(eye, center, up);
+    DirectX::XMMATRIX projection = DirectX::XMMatrixOrthographicOffCenterLH(-radius, radius, -radius, radius, 0.0f, depth_far);
+
+    // Snap to texels: move the projection so the world origin lands on a texel
+    // corner. The light's rotation is fixed, so every texel is now stable.
+    DirectX::XMMATRIX view_projection = DirectX::XMMatrixMultiply(view, projection);
+    DirectX::XMVECTOR origin = DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), view_projection);
+    float half_resolution = (float)resolution * 0.5f;
+    float origin_x = DirectX::XMVectorGetX(origin) * half_resolution;
+    float origin_y = DirectX::XMVectorGetY(origin) * half_resolution;
+
+    DirectX::XMFLOAT4X4 snapped;
+    DirectX::XMStoreFloat4x4(&snapped, projection);
+    snapped.m[3][0] += (roundf(origin_x) - origin_x) / half_resolution;
+    snapped.m[3][1] += (roundf(origin_y) - origin_y) / half_resolution;
+    projection = DirectX::XMLoadFloat4x4(&snapped);
+
+    DirectX::XMStoreFloat4x4(&out_cascade->view_matrix, view);
+    DirectX::XMStoreFloat4x4(&out_cascade->view_projection_matrix, DirectX::XMMatrixMultiply(view, projection));
+    DirectX::XMStoreFloat3(&out_cascade->center, center);
+    out_cascade->split_near = split_near;
+    out_cascade->split_far = split_far;
+    out_cascade->radius = radius;
+    out_cascade->depth_far = depth_far;
+    out_cascade->texel_size = 2.0f * radius / (float)resolution;
+}
+
+bool shadow_cascades::sphere_visible(const ShadowCascade *cascade, DirectX::XMFLOAT3 center, float radius) {
+    DirectX::XMMATRIX view = DirectX::XMLoadFloat4x4(&cascade->view_matrix);
+    DirectX::XMVECTOR p = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&center), view);
+
+    float extent = cascade->radius + radius;
+    float x = DirectX::XMVectorGetX(p);
+    float y = DirectX::XMVectorGetY(p);
+    float z = DirectX::XMVectorGetZ(p);
+
+    // NOTE: Doesn't test against the snapping offset, it's less than a texel
+    if (fabsf(x) > extent || fabsf(y) > extent) {
+        return false;
+    }
+
+    // Behind the light (clipped anyway) or past the far plane
+    return z + radius >= 0.0f && z - radius <= cascade->depth_far;
+}
+
+bool shadow_cascades::sphere_in_frustum(const DirectX::XMFLOAT4X4 *view_projection, DirectX::XMFLOAT3 center, float radius) {
+    const DirectX::XMFLOAT4X4 &m = *view_projection;
+
+    // Planes straight out of the matrix columns (Gribb/Hartmann)
+    float planes[6][4];
+    for (int r = 0; r < 4; ++r) {
+        planes[0][r] = m.m[r][3] + m.m[r][0]; // Left
+        planes[1][r] = m.m[r][3] - m.m[r][0]; // Right
+        planes[2][r] = m.m[r][3] + m.m[r][1]; // Bottom
+        planes[3][r] = m.m[r][3] - m.m[r][1]; // Top
+        planes[4][r] = m.m[r][2];             // Near
+        planes[5][r] = m.m[r][3] - m.m[r][2]; // Far
+    }
+
+    for (int p = 0; p < 6; ++p) {
+        float *plane = planes[p];
+        float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        float distance = plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3];
+        if (distance < -radius * length) {
+            return false;
+        }
+    }
+    return true;
+}
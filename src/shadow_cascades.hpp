@@ -0,0 +1,63 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+
+#define SHADOW_CASCADE_COUNT 4
+
+// One slice of the camera frustum covered by an orthographic shadow map.
+// The projection is fit to the bounding sphere of the slice, so it doesn't
+// change size when the camera rotates, and its origin is snapped to whole
+// shadow map texels, so the shadow edges don't swim when the camera moves.
+struct ShadowCascade {
+    DirectX::XMFLOAT4X4 view_matrix;
+    DirectX::XMFLOAT4X4 view_projection_matrix;
+
+    // View space depth range of the camera this cascade covers
+    float split_near;
+    float split_far;
+
+    // Bounding sphere of the slice in world space
+    DirectX::XMFLOAT3 center;
+    float radius;
+
+    // Light space depth of the far plane (casters behind the light are pulled in
+    // by placing the near plane caster_distance in front of the sphere)
+    float depth_far;
+    // Size of one shadow map texel in world units
+    float texel_size;
+};
+
+// What the fitting needs to know about the camera
+struct ShadowCameraDesc {
+    DirectX::XMFLOAT4X4 inv_view_matrix;
+    float fov_y; // Radians
+    float aspect_ratio;
+    float znear;
+    float zfar;
+};
+
+namespace shadow_cascades {
+
+// Writes count + 1 split distances between znear and zfar. lambda blends between
+// uniform (0) and logarithmic (1) splits, the "practical split scheme".
+void compute_splits(float znear, float zfar, uint32_t count, float lambda, float *out_splits);
+
+// Bounding sphere of the frustum slice between split_near and split_far, in view space.
+// The center always lies on the view axis, only its depth is returned.
+void compute_slice_sphere(float tan_half_fov_y, float aspect_ratio, float split_near, float split_far, float *out_center_z, float *out_radius);
+
+// Fits a cascade to the split, looking down light_direction. resolution is the
+// shadow map tile size in texels.
+void fit(const ShadowCameraDesc *camera, float split_near, float split_far, DirectX::XMFLOAT3 light_direction,
+         uint32_t resolution, float caster_distance, ShadowCascade *out_cascade);
+
+// True if a sphere can cast a shadow into the cascade. Only the sides and the far
+// plane cull, anything between the light and the cascade still casts.
+bool sphere_visible(const ShadowCascade *cascade, DirectX::XMFLOAT3 center, float radius);
+
+// Sphere against the six planes of a view-projection (row vectors, D3D depth range).
+// Conservative, spheres near the corners can pass.
+bool sphere_in_frustum(const DirectX::XMFLOAT4X4 *view_projection, DirectX::XMFLOAT3 center, float radius);
+
+} // namespace shadow_cascades
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "id.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+// Deduplicates immutable state objects (rasterizer, depth stencil, blend) by
+// their desc, with a reference count so unused ones can be released.
+//
+// The hash table is open addressing with linear probing over entry indices,
+// the entries never move so their ids stay valid when the table is rebuilt.
+// A matching hash is always confirmed by comparing the whole desc. That's a
+// memcmp, so descs with padding have to be zeroed before they're filled in.
+#define STATE_CACHE_EMPTY 0xFF
+#define STATE_CACHE_TOMBSTONE 0xFE
+
+// One reference on a state object, what ComPtr would do for the cache without
+// needing <wrl/client.h>, so the cache builds (and is tested) anywhere
+template <typename Object>
+struct StateRef {
+    Object *ptr = nullptr;
+
+    StateRef() = default;
+    StateRef(const StateRef &) = delete;
+    StateRef &operator=(const StateRef &) = delete;
+    ~StateRef() { Reset(); }
+
+    StateRef &operator=(Object *object) {
+        if (object) {
+            object->AddRef();
+        }
+        Reset();
+        ptr = object;
+        return *this;
+    }
+    void Reset() {
+        Object *old = ptr;
+        ptr = nullptr;
+        if (old) {
+            old->Release();
+        }
+    }
+    Object *Get() const { return ptr; }
+};
+
+template <typename Desc, typename Object, uint32_t Capacity>
+struct StateCache {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "StateCache: Capacity has to be a power of two");
+    static_assert(Capacity < STATE_CACHE_TOMBSTONE, "StateCache: Entry indices have to fit in the table");
+
+    using DescType = Desc;
+    using ObjectType = Object;
+    static constexpr uint32_t CAPACITY = Capacity;
+    // Twice the entries, so the table is at most half full and probes stay short
+    static constexpr uint32_t TABLE_SIZE = Capacity * 2;
+
+    struct Entry {
+        Id id;
+        uint32_t ref_count;
+        uint64_t hash;
+        Desc desc;
+        StateRef<Object> object_ptr;
+    };
+
+    Entry entries[Capacity];
+    uint8_t table[TABLE_SIZE];
+    uint32_t count;
+    uint32_t tombstone_count;
+};
+
+namespace state_cache {
+
+template <typename Cache>
+void initialize(Cache *cache) {
+    for (uint32_t i = 0; i < Cache::CAPACITY; ++i) {
+        cache->entries[i].id = id::invalid();
+        cache->entries[i].ref_count = 0;
+        cache->entries[i].object_ptr.Reset();
+    }
+    memset(cache->table, STATE_CACHE_EMPTY, sizeof(cache->table));
+    cache->count = 0;
+    cache->tombstone_count = 0;
+}
+
+// Table slot of the entry with this desc, -1 when it isn't cached
+template <typename Cache>
+int32_t find_slot(const Cache *cache, const typename Cache::DescType *desc, uint64_t hash) {
+    uint32_t mask = Cache::TABLE_SIZE - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    for (uint32_t probe = 0; probe < Cache::TABLE_SIZE; ++probe, slot = (slot + 1) & mask) {
+        uint8_t index = cache->table[slot];
+        if (index == STATE_CACHE_EMPTY) {
+            return -1;
+        }
+        if (index == STATE_CACHE_TOMBSTONE) {
+            continue;
+        }
+
+        const typename Cache::Entry *entry = &cache->entries[index];
+        if (entry->hash == hash && memcmp(&entry->desc, desc, sizeof(*desc)) == 0) {
+            return (int32_t)slot;
+        }
+    }
+    return -1;
+}
+
+template <typename Cache>
+void insert_slot(Cache *cache, uint8_t index) {
+    uint32_t mask = Cache::TABLE_SIZE - 1;
+    uint32_t slot = (uint32_t)cache->entries[index].hash & mask;
+    while (cache->table[slot] != STATE_CACHE_EMPTY && cache->table[slot] != STATE_CACHE_TOMBSTONE) {
+        slot = (slot + 1) & mask;
+    }
+
+    if (cache->table[slot] == STATE_CACHE_TOMBSTONE) {
+        cache->tombstone_count--;
+    }
+    cache->table[slot] = index;
+}
+
+// Takes a reference on the state with this desc, invalid when it isn't cached
+template <typename Cache>
+Id acquire(Cache *cache, const typename Cache::DescType *desc, uint64_t hash) {
+    int32_t slot = find_slot(cache, desc, hash);
+    if (slot < 0) {
+        return id::invalid();
+    }
+
+    typename Cache::Entry *entry = &cache->entries[cache->table[slot]];
+    entry->ref_count++;
+    return entry->id;
+}
+
+// Caches a state that acquire didn't find, with one reference. Invalid when full.
+template <typename Cache>
+Id add(Cache *cache, const typename Cache::DescType *desc, uint64_t hash, typename Cache::ObjectType *object) {
+    assert(find_slot(cache, desc, hash) < 0 && "state_cache::add: The desc is already cached");
+
+    if (cache->count >= Cache::CAPACITY) {
+        return id::invalid();
+    }
+
+    // Creating a state is rare (and goes to the device), a scan for the free entry is fine
+    uint8_t index = 0;
+    while (id::is_valid(cache->entries[index].id)) {
+        index++;
+    }
+
+    typename Cache::Entry *entry = &cache->entries[index];
+    entry->id.id = index;
+    entry->ref_count = 1;
+    entry->hash = hash;
+    memcpy(&entry->desc, desc, sizeof(*desc));
+    entry->object_ptr = object;
+    cache->count++;
+
+    insert_slot(cache, index);
+    return entry->id;
+}
+
+template <typename Cache>
+typename Cache::ObjectType *get(Cache *cache, Id state_id) {
+    if (id::is_invalid(state_id) || state_id.id >= Cache::CAPACITY) {
+        return nullptr;
+    }
+
+    typename Cache::Entry *entry = &cache->entries[state_id.id];
+    if (id::is_stale(entry->id, state_id)) {
+        return nullptr;
+    }
+    return entry->object_ptr.Get();
+}
+
+// Gives back a reference, the state is destroyed with the last one.
+// Returns how many references are left.
+template <typename Cache>
+uint32_t release(Cache *cache, Id state_id) {
+    if (id::is_invalid(state_id) || state_id.id >= Cache::CAPACITY) {
+        return 0;
+    }
+
+    typename Cache::Entry *entry = &cache->entries[state_id.id];
+    if (id::is_stale(entry->id, state_id) || entry->ref_count == 0) {
+        return 0;
+    }
+
+    if (--entry->ref_count > 0) {
+        return entry->ref_count;
+    }
+
+    int32_t slot = find_slot(cache, &entry->desc, entry->hash);
+    assert(slot >= 0 && "state_cache::release: Cached state is missing from the table");
+    cache->table[slot] = STATE_CACHE_TOMBSTONE;
+    cache->tombstone_count++;
+    cache->count--;
+
+    // Generation goes up so ids to the old state don't resolve to the next one
+    entry->object_ptr.Reset();
+    entry->id.id = INVALID_ID;
+    id::gen_increment(&entry->id);
+
+    // Tombstones only get reused by inserts, rebuild before probes get long
+    if (cache->tombstone_count > Cache::CAPACITY / 2) {
+        memset(cache->table, STATE_CACHE_EMPTY, sizeof(cache->table));
+        cache->tombstone_count = 0;
+        for (uint32_t i = 0; i < Cache::CAPACITY; ++i) {
+            if (id::is_valid(cache->entries[i].id)) {
+                insert_slot(cache, (uint8_t)i);
+            }
+        }
+    }
+
+    return 0;
+}
+
+} // namespace state_cache
@@ -0,0 +1,437 @@
+#include "state_tracker.hpp"
+
+#include <cassert>
+#include <cstring>
+
+template <typename T>
+using IssueSlotsFn = void (*)(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, T *const *values);
+
+template <typename T>
+static T *unknown();
+static bool is_redundant(StateTracker *tracker, bool unchanged);
+template <typename T, uint32_t N>
+static void reset_slots(StateSlots<T, N> *slots);
+template <typename T, uint32_t N>
+static bool write_slots(StateSlots<T, N> *slots, UINT start_slot, UINT count, T *const *values);
+template <typename T, uint32_t N>
+static uint32_t flush_slots(StateSlots<T, N> *slots, ID3D11DeviceContext *context, ShaderStage stage, IssueSlotsFn<T> issue);
+static void forget_srvs(StateTracker *tracker);
+static void issue_srvs(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11ShaderResourceView *const *srvs);
+static void issue_constant_buffers(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11Buffer *const *buffers);
+static void issue_samplers(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11SamplerState *const *samplers);
+
+void state_tracker::initialize(StateTracker *tracker, ID3D11DeviceContext *context) {
+    assert(tracker && "state_tracker::initialize: Tracker pointer cannot be NULL");
+
+    tracker->context = context;
+    reset(tracker);
+    reset_stats(tracker);
+}
+
+void state_tracker::reset(StateTracker *tracker) {
+    for (uint32_t i = 0; i < SHADER_STAGE_COUNT; ++i) {
+        reset_slots(&tracker->stages[i].srvs);
+        reset_slots(&tracker->stages[i].cbs);
+        reset_slots(&tracker->stages[i].samplers);
+    }
+
+    tracker->depth_stencil_state = unknown<ID3D11DepthStencilState>();
+    tracker->stencil_ref = 0;
+    tracker->rasterizer_state = unknown<ID3D11RasterizerState>();
+    tracker->blend_state = unknown<ID3D11BlendState>();
+    for (int i = 0; i < 4; ++i) {
+        tracker->blend_factor[i] = 1.0f;
+    }
+    tracker->sample_mask = 0xFFFFFFFF;
+
+    // No real viewport is negative, the first one always goes through
+    memset(&tracker->viewport, 0, sizeof(tracker->viewport));
+    tracker->viewport.Width = -1.0f;
+    tracker->topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    tracker->vertex_buffer = unknown<ID3D11Buffer>();
+    tracker->vertex_stride = 0;
+    tracker->vertex_offset = 0;
+    tracker->index_buffer = unknown<ID3D11Buffer>();
+    tracker->index_format = DXGI_FORMAT_UNKNOWN;
+    tracker->index_offset = 0;
+
+    for (uint32_t i = 0; i < STATE_TRACKER_RTV_SLOTS; ++i) {
+        tracker->rtvs[i] = unknown<ID3D11RenderTargetView>();
+    }
+    tracker->rtv_count = 0;
+    tracker->dsv = unknown<ID3D11DepthStencilView>();
+    for (uint32_t i = 0; i < STATE_TRACKER_UAV_SLOTS; ++i) {
+        tracker->cs_uavs[i] = unknown<ID3D11UnorderedAccessView>();
+    }
+}
+
+void state_tracker::reset_stats(StateTracker *tracker) {
+    memset(&tracker->stats, 0, sizeof(tracker->stats));
+}
+
+void state_tracker::set_depth_stencil_state(StateTracker *tracker, ID3D11DepthStencilState *state, UINT stencil_ref) {
+    if (is_redundant(tracker, tracker->depth_stencil_state == state && tracker->stencil_ref == stencil_ref)) {
+        return;
+    }
+
+    tracker->depth_stencil_state = state;
+    tracker->stencil_ref = stencil_ref;
+    if (tracker->context) {
+        tracker->context->OMSetDepthStencilState(state, stencil_ref);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_rasterizer_state(StateTracker *tracker, ID3D11RasterizerState *state) {
+    if (is_redundant(tracker, tracker->rasterizer_state == state)) {
+        return;
+    }
+
+    tracker->rasterizer_state = state;
+    if (tracker->context) {
+        tracker->context->RSSetState(state);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_blend_state(StateTracker *tracker, ID3D11BlendState *state, const float *blend_factor, UINT sample_mask) {
+    static const float default_factor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    if (!blend_factor) {
+        blend_factor = default_factor;
+    }
+
+    bool unchanged = tracker->blend_state == state && tracker->sample_mask == sample_mask &&
+                     memcmp(tracker->blend_factor, blend_factor, sizeof(tracker->blend_factor)) == 0;
+    if (is_redundant(tracker, unchanged)) {
+        return;
+    }
+
+    tracker->blend_state = state;
+    memcpy(tracker->blend_factor, blend_factor, sizeof(tracker->blend_factor));
+    tracker->sample_mask = sample_mask;
+    if (tracker->context) {
+        tracker->context->OMSetBlendState(state, tracker->blend_factor, sample_mask);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_viewport(StateTracker *tracker, const D3D11_VIEWPORT *viewport) {
+    if (is_redundant(tracker, memcmp(&tracker->viewport, viewport, sizeof(*viewport)) == 0)) {
+        return;
+    }
+
+    tracker->viewport = *viewport;
+    if (tracker->context) {
+        tracker->context->RSSetViewports(1, viewport);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_topology(StateTracker *tracker, D3D11_PRIMITIVE_TOPOLOGY topology) {
+    if (is_redundant(tracker, tracker->topology == topology)) {
+        return;
+    }
+
+    tracker->topology = topology;
+    if (tracker->context) {
+        tracker->context->IASetPrimitiveTopology(topology);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_vertex_buffer(StateTracker *tracker, ID3D11Buffer *buffer, UINT stride, UINT offset) {
+    bool unchanged = tracker->vertex_buffer == buffer && tracker->vertex_stride == stride && tracker->vertex_offset == offset;
+    if (is_redundant(tracker, unchanged)) {
+        return;
+    }
+
+    tracker->vertex_buffer = buffer;
+    tracker->vertex_stride = stride;
+    tracker->vertex_offset = offset;
+    if (tracker->context) {
+        tracker->context->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_index_buffer(StateTracker *tracker, ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset) {
+    bool unchanged = tracker->index_buffer == buffer && tracker->index_format == format && tracker->index_offset == offset;
+    if (is_redundant(tracker, unchanged)) {
+        return;
+    }
+
+    tracker->index_buffer = buffer;
+    tracker->index_format = format;
+    tracker->index_offset = offset;
+    if (tracker->context) {
+        tracker->context->IASetIndexBuffer(buffer, format, offset);
+    }
+    tracker->stats.issued++;
+}
+
+void state_tracker::set_render_targets(StateTracker *tracker, UINT count, ID3D11RenderTargetView *const *rtvs, ID3D11DepthStencilView *dsv) {
+    assert(count <= STATE_TRACKER_RTV_SLOTS && "state_tracker::set_render_targets: Too many render targets");
+
+    bool unchanged = count == tracker->rtv_count && dsv == tracker->dsv &&
+                     (count == 0 || memcmp(tracker->rtvs, rtvs, count * sizeof(*rtvs)) == 0);
+    if (is_redundant(tracker, unchanged)) {
+        return;
+    }
+
+    flush(tracker);
+    if (tracker->context) {
+        tracker->context->OMSetRenderTargets(count, rtvs, dsv);
+    }
+    tracker->stats.issued++;
+
+    bool binds_output = dsv != nullptr;
+    for (uint32_t i = 0; i < STATE_TRACKER_RTV_SLOTS; ++i) {
+        tracker->rtvs[i] = i < count ? rtvs[i] : nullptr;
+        binds_output |= tracker->rtvs[i] != nullptr;
+    }
+    tracker->rtv_count = count;
+    tracker->dsv = dsv;
+
+    // The runtime unbinds inputs and UAVs of the same resources, only a NULL target is harmless
+    if (binds_output) {
+        forget_srvs(tracker);
+        for (uint32_t i = 0; i < STATE_TRACKER_UAV_SLOTS; ++i) {
+            if (tracker->cs_uavs[i]) {
+                tracker->cs_uavs[i] = unknown<ID3D11UnorderedAccessView>();
+            }
+        }
+    }
+}
+
+void state_tracker::set_cs_uavs(StateTracker *tracker, UINT start_slot, UINT count, ID3D11UnorderedAccessView *const *uavs) {
+    assert(start_slot + count <= STATE_TRACKER_UAV_SLOTS && "state_tracker::set_cs_uavs: Slots out of range");
+
+    if (is_redundant(tracker, memcmp(&tracker->cs_uavs[start_slot], uavs, count * sizeof(*uavs)) == 0)) {
+        return;
+    }
+
+    flush(tracker);
+    if (tracker->context) {
+        tracker->context->CSSetUnorderedAccessViews(start_slot, count, uavs, nullptr);
+    }
+    tracker->stats.issued++;
+
+    bool binds_output = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        tracker->cs_uavs[start_slot + i] = uavs[i];
+        binds_output |= uavs[i] != nullptr;
+    }
+
+    if (binds_output) {
+        forget_srvs(tracker);
+        for (uint32_t i = 0; i < STATE_TRACKER_RTV_SLOTS; ++i) {
+            if (tracker->rtvs[i]) {
+                tracker->rtvs[i] = unknown<ID3D11RenderTargetView>();
+            }
+        }
+        if (tracker->dsv) {
+            tracker->dsv = unknown<ID3D11DepthStencilView>();
+        }
+    }
+}
+
+void state_tracker::set_srvs(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11ShaderResourceView *const *srvs) {
+    assert(start_slot + count <= STATE_TRACKER_SRV_SLOTS && "state_tracker::set_srvs: Slots out of range");
+    is_redundant(tracker, !write_slots(&tracker->stages[stage].srvs, start_slot, count, srvs));
+}
+
+void state_tracker::set_constant_buffers(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11Buffer *const *buffers) {
+    assert(start_slot + count <= STATE_TRACKER_CB_SLOTS && "state_tracker::set_constant_buffers: Slots out of range");
+    is_redundant(tracker, !write_slots(&tracker->stages[stage].cbs, start_slot, count, buffers));
+}
+
+void state_tracker::set_samplers(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11SamplerState *const *samplers) {
+    assert(start_slot + count <= STATE_TRACKER_SAMPLER_SLOTS && "state_tracker::set_samplers: Slots out of range");
+    is_redundant(tracker, !write_slots(&tracker->stages[stage].samplers, start_slot, count, samplers));
+}
+
+void state_tracker::unbind_srvs(StateTracker *tracker, ShaderStage stage) {
+    StateSlots<ID3D11ShaderResourceView, STATE_TRACKER_SRV_SLOTS> *slots = &tracker->stages[stage].srvs;
+
+    // Only the range that can have something in it, not all 128 slots
+    uint32_t first = STATE_TRACKER_SRV_SLOTS;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < STATE_TRACKER_SRV_SLOTS; ++i) {
+        if (slots->pending[i] || slots->bound[i]) {
+            first = first < i ? first : i;
+            last = i;
+        }
+    }
+    if (is_redundant(tracker, first == STATE_TRACKER_SRV_SLOTS)) {
+        return;
+    }
+
+    write_slots(slots, first, last - first + 1, (ID3D11ShaderResourceView *const *)nullptr);
+    tracker->stats.issued += flush_slots(slots, tracker->context, stage, issue_srvs);
+}
+
+void state_tracker::flush(StateTracker *tracker) {
+    for (uint32_t i = 0; i < SHADER_STAGE_COUNT; ++i) {
+        StateTrackerStage *stage = &tracker->stages[i];
+        tracker->stats.issued += flush_slots(&stage->srvs, tracker->context, (ShaderStage)i, issue_srvs);
+        tracker->stats.issued += flush_slots(&stage->cbs, tracker->context, (ShaderStage)i, issue_constant_buffers);
+        tracker->stats.issued += flush_slots(&stage->samplers, tracker->context, (ShaderStage)i, issue_samplers);
+    }
+}
+
+void state_tracker::draw(StateTracker *tracker, UINT vertex_count, UINT start_vertex) {
+    flush(tracker);
+    if (tracker->context) {
+        tracker->context->Draw(vertex_count, start_vertex);
+    }
+}
+
+void state_tracker::draw_indexed(StateTracker *tracker, UINT index_count, UINT start_index, INT base_vertex) {
+    flush(tracker);
+    if (tracker->context) {
+        tracker->context->DrawIndexed(index_count, start_index, base_vertex);
+    }
+}
+
+void state_tracker::dispatch(StateTracker *tracker, UINT x, UINT y, UINT z) {
+    flush(tracker);
+    if (tracker->context) {
+        tracker->context->Dispatch(x, y, z);
+    }
+}
+
+template <typename T>
+static T *unknown() {
+    return reinterpret_cast<T *>(STATE_TRACKER_UNKNOWN);
+}
+
+// Counts the request, true when it can be dropped
+static bool is_redundant(StateTracker *tracker, bool unchanged) {
+    tracker->stats.requests++;
+    if (unchanged) {
+        tracker->stats.filtered++;
+    }
+    return unchanged;
+}
+
+template <typename T, uint32_t N>
+static void reset_slots(StateSlots<T, N> *slots) {
+    for (uint32_t i = 0; i < N; ++i) {
+        slots->pending[i] = nullptr;
+        slots->bound[i] = unknown<T>();
+    }
+    slots->dirty_begin = N;
+    slots->dirty_end = 0;
+}
+
+// NULL values unbind the whole range. False when it's what's already bound.
+template <typename T, uint32_t N>
+static bool write_slots(StateSlots<T, N> *slots, UINT start_slot, UINT count, T *const *values) {
+    bool changed = false;
+    for (UINT i = 0; i < count; ++i) {
+        T *value = values ? values[i] : nullptr;
+        UINT slot = start_slot + i;
+        changed |= slots->pending[slot] != value || slots->bound[slot] != value;
+        slots->pending[slot] = value;
+    }
+
+    if (changed) {
+        slots->dirty_begin = start_slot < slots->dirty_begin ? start_slot : slots->dirty_begin;
+        slots->dirty_end = start_slot + count > slots->dirty_end ? start_slot + count : slots->dirty_end;
+    }
+    return changed;
+}
+
+// Sends the pending slots that differ from the bound ones, returns the number of calls
+template <typename T, uint32_t N>
+static uint32_t flush_slots(StateSlots<T, N> *slots, ID3D11DeviceContext *context, ShaderStage stage, IssueSlotsFn<T> issue) {
+    uint32_t calls = 0;
+    uint32_t slot = slots->dirty_begin;
+    while (slot < slots->dirty_end) {
+        if (slots->pending[slot] == slots->bound[slot]) {
+            slot++;
+            continue;
+        }
+
+        // Resending a couple of unchanged slots is cheaper than another call
+        uint32_t first = slot;
+        uint32_t last = slot;
+        for (uint32_t next = slot + 1; next < slots->dirty_end && next <= last + STATE_TRACKER_MERGE_GAP + 1; ++next) {
+            if (slots->pending[next] != slots->bound[next]) {
+                last = next;
+            }
+        }
+
+        uint32_t count = last - first + 1;
+        if (context) {
+            issue(context, stage, first, count, &slots->pending[first]);
+        }
+        memcpy(&slots->bound[first], &slots->pending[first], count * sizeof(T *));
+        calls++;
+        slot = last + 1;
+    }
+
+    slots->dirty_begin = N;
+    slots->dirty_end = 0;
+    return calls;
+}
+
+static void forget_srvs(StateTracker *tracker) {
+    for (uint32_t s = 0; s < SHADER_STAGE_COUNT; ++s) {
+        StateSlots<ID3D11ShaderResourceView, STATE_TRACKER_SRV_SLOTS> *slots = &tracker->stages[s].srvs;
+        for (uint32_t i = 0; i < STATE_TRACKER_SRV_SLOTS; ++i) {
+            if (slots->bound[i]) {
+                slots->bound[i] = unknown<ID3D11ShaderResourceView>();
+            }
+        }
+    }
+}
+
+static void issue_srvs(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11ShaderResourceView *const *srvs) {
+    switch (stage) {
+        case SHADER_STAGE_VS:
+            context->VSSetShaderResources(start_slot, count, srvs);
+            break;
+        case SHADER_STAGE_PS:
+            context->PSSetShaderResources(start_slot, count, srvs);
+            break;
+        case SHADER_STAGE_CS:
+            context->CSSetShaderResources(start_slot, count, srvs);
+            break;
+        default:
+            break;
+    }
+}
+
+static void issue_constant_buffers(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11Buffer *const *buffers) {
+    switch (stage) {
+        case SHADER_STAGE_VS:
+            context->VSSetConstantBuffers(start_slot, count, buffers);
+            break;
+        case SHADER_STAGE_PS:
+            context->PSSetConstantBuffers(start_slot, count, buffers);
+            break;
+        case SHADER_STAGE_CS:
+            context->CSSetConstantBuffers(start_slot, count, buffers);
+            break;
+        default:
+            break;
+    }
+}
+
+static void issue_samplers(ID3D11DeviceContext *context, ShaderStage stage, UINT start_slot, UINT count, ID3D11SamplerState *const *samplers) {
+    switch (stage) {
+        case SHADER_STAGE_VS:
+            context->VSSetSamplers(start_slot, count, samplers);
+            break;
+        case SHADER_STAGE_PS:
+            context->PSSetSamplers(start_slot, count, samplers);
+            break;
+        case SHADER_STAGE_CS:
+            context->CSSetSamplers(start_slot, count, samplers);
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "shader_system.hpp"
+
+#include <cstdint>
+#include <d3d11.h>
+
+// Sits between the passes and the device context and drops state changes that
+// change nothing. It keeps a shadow copy of what's bound:
+//  - depth, raster and blend states, viewport, topology and the mesh buffers
+//    are compared and set right away
+//  - SRVs, constant buffers and samplers (VS, PS and CS) only go to a pending
+//    copy, the next draw or dispatch sends the slots that changed. Nearby
+//    changed slots go out together, as one call per range.
+//
+// Binding a render target, depth target or UAV makes the runtime unbind any
+// SRV of the same resource behind our back, so the SRVs that were bound are
+// forgotten then (and sent again next time) instead of being compared.
+//
+// Everything that binds per frame has to go through here, or call reset after.
+// With a NULL context nothing is sent anywhere, the shadow state and the
+// counters still work the same.
+#define STATE_TRACKER_SRV_SLOTS D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT
+#define STATE_TRACKER_CB_SLOTS D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+#define STATE_TRACKER_SAMPLER_SLOTS D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+#define STATE_TRACKER_UAV_SLOTS D3D11_PS_CS_UAV_REGISTER_COUNT
+#define STATE_TRACKER_RTV_SLOTS D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT
+// Changed slots at most this far apart are sent in the same call
+#define STATE_TRACKER_MERGE_GAP 2
+// Shadow value for "could be anything", never the address of a real object
+#define STATE_TRACKER_UNKNOWN UINTPTR_MAX
+
+template <typename T, uint32_t N>
+struct StateSlots {
+    T *pending[N]; // What the next draw wants
+    T *bound[N];   // What the context has
+    // Slots written since the last flush, [begin, end)
+    uint32_t dirty_begin;
+    uint32_t dirty_end;
+};
+
+struct StateTrackerStage {
+    StateSlots<ID3D11ShaderResourceView, STATE_TRACKER_SRV_SLOTS> srvs;
+    StateSlots<ID3D11Buffer, STATE_TRACKER_CB_SLOTS> cbs;
+    StateSlots<ID3D11SamplerState, STATE_TRACKER_SAMPLER_SLOTS> samplers;
+};
+
+struct StateTrackerStats {
+    uint32_t requests; // set_* calls made to the tracker
+    uint32_t filtered; // ...that didn't change anything
+    uint32_t issued;   // Calls that went to the context
+};
+
+struct StateTracker {
+    ID3D11DeviceContext *context;
+
+    StateTrackerStage stages[SHADER_STAGE_COUNT];
+
+    ID3D11DepthStencilState *depth_stencil_state;
+    UINT stencil_ref;
+    ID3D11RasterizerState *rasterizer_state;
+    ID3D11BlendState *blend_state;
+    float blend_factor[4];
+    UINT sample_mask;
+    D3D11_VIEWPORT viewport;
+    D3D11_PRIMITIVE_TOPOLOGY topology;
+
+    ID3D11Buffer *vertex_buffer;
+    UINT vertex_stride;
+    UINT vertex_offset;
+    ID3D11Buffer *index_buffer;
+    DXGI_FORMAT index_format;
+    UINT index_offset;
+
+    ID3D11RenderTargetView *rtvs[STATE_TRACKER_RTV_SLOTS];
+    UINT rtv_count;
+    ID3D11DepthStencilView *dsv;
+    ID3D11UnorderedAccessView *cs_uavs[STATE_TRACKER_UAV_SLOTS];
+
+    StateTrackerStats stats;
+};
+
+namespace state_tracker {
+
+void initialize(StateTracker *tracker, ID3D11DeviceContext *context);
+// Forget everything, the next set of each state is always sent. For when
+// something used the context directly.
+void reset(StateTracker *tracker);
+void reset_stats(StateTracker *tracker);
+
+void set_depth_stencil_state(StateTracker *tracker, ID3D11DepthStencilState *state, UINT stencil_ref);
+void set_rasterizer_state(StateTracker *tracker, ID3D11RasterizerState *state);
+// NULL blend_factor is all ones, like the context
+void set_blend_state(StateTracker *tracker, ID3D11BlendState *state, const float *blend_factor, UINT sample_mask);
+void set_viewport(StateTracker *tracker, const D3D11_VIEWPORT *viewport);
+void set_topology(StateTracker *tracker, D3D11_PRIMITIVE_TOPOLOGY topology);
+// Slot 0 only, that's all a mesh has
+void set_vertex_buffer(StateTracker *tracker, ID3D11Buffer *buffer, UINT stride, UINT offset);
+void set_index_buffer(StateTracker *tracker, ID3D11Buffer *buffer, DXGI_FORMAT format, UINT offset);
+
+// Outputs are sent right away, after the pending inputs (so an explicit
+// unbind of an SRV still comes before its resource is bound as a target)
+void set_render_targets(StateTracker *tracker, UINT count, ID3D11RenderTargetView *const *rtvs, ID3D11DepthStencilView *dsv);
+void set_cs_uavs(StateTracker *tracker, UINT start_slot, UINT count, ID3D11UnorderedAccessView *const *uavs);
+
+// Pending until the next draw, dispatch or flush
+void set_srvs(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11ShaderResourceView *const *srvs);
+void set_constant_buffers(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11Buffer *const *buffers);
+void set_samplers(StateTracker *tracker, ShaderStage stage, UINT start_slot, UINT count, ID3D11SamplerState *const *samplers);
+// Unbinds every SRV of the stage that may be bound, with one call
+void unbind_srvs(StateTracker *tracker, ShaderStage stage);
+
+void flush(StateTracker *tracker);
+void draw(StateTracker *tracker, UINT vertex_count, UINT start_vertex);
+void draw_indexed(StateTracker *tracker, UINT index_count, UINT start_index, INT base_vertex);
+void dispatch(StateTracker *tracker, UINT x, UINT y, UINT z);
+
+} // namespace state_tracker
@@ -1,10 +1,17 @@
 #include "texture.hpp"
 
 #include "application.hpp"
+#include "arena.hpp"
+#include "asset_registry.hpp"
 #include "id.hpp"
 #include "logger.hpp"
+#include "memory_tracker.hpp"
 #include "mesh.hpp"
+#include "mip_file.hpp"
 #include "renderer.hpp"
+#include "texture_format.hpp"
+#include "texture_streamer.hpp"
+#include "vfs.hpp"
 
 #include <comdef.h>
 
@@ -21,16 +28,29 @@ struct FormatBindingInfo {
 
 static bool create_texture_internal(ID3D11Device *device, Texture *texture, uint32_t width, uint32_t height, uint32_t mip_levels, uint32_t array_size, DXGI_FORMAT format, uint32_t bind_flags, bool is_cubemap, bool generate_srv, uint32_t msaa_samples, const void *data, uint32_t row_pitch);
 static FormatBindingInfo get_format_binding_info(DXGI_FORMAT format);
+static AssetLoad load_async_internal(const char *filename, bool is_srgb, bool is_hdr);
+static AsyncTask load_task(Renderer *renderer, AssetLoad load, const char *filename, bool is_srgb, bool is_hdr);
+static Texture *create_placeholder(Renderer *renderer);
+static AsyncTask stream_load_task(Renderer *renderer, AssetLoad load, const char *filename, bool is_srgb);
+static AsyncTask stream_in_task(Renderer *renderer, AssetLoad load, uint32_t first_mip, uint32_t end_mip);
+static bool get_mip_file(const char *source, bool is_srgb, char *out_path, size_t out_size, MipFileHeader *out_header);
+static uint32_t get_tail_mip(const MipFileHeader *header);
+static bool upload_mips(Renderer *renderer, Texture *texture, const MipFileHeader *header, uint32_t first_mip, uint8_t *const *levels);
+static void track_gpu_bytes(Texture *texture, MemoryTag tag, uint64_t bytes);
+static MemoryTag get_memory_tag(uint32_t bind_flags);
+static void *decode_image(const char *filename, bool is_hdr, int *out_width, int *out_height);
 
 TextureId texture::load(const char *filename, bool is_srgb) {
     // stbi_set_flip_vertically_on_load(1);
 
-    int h, w, c;
-    uint8_t *image_data = stbi_load(filename, &w, &h, &c, 4);
+    int h, w;
+    uint8_t *image_data = (uint8_t *)decode_image(filename, false, &w, &h);
     if (!image_data) {
         LOG("texture::load: stbi_load didn't return with expected data");
         return id::invalid();
     }
+    uint64_t decoded_bytes = (uint64_t)w * h * 4;
+    memory_tracker::track(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
 
     // Create the texture
     TextureId new_tex = create(w, h,
@@ -44,18 +64,21 @@ TextureId texture::load(const char *filename, bool is_srgb) {
                                1,
                                false);
 
+    memory_tracker::untrack(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
     stbi_image_free(image_data);
 
     return new_tex;
 }
 
 TextureId texture::load_hdr(const char *filename) {
-    int h, w, c;
-    float *hdr_data = stbi_loadf(filename, &w, &h, &c, 4);
+    int h, w;
+    float *hdr_data = (float *)decode_image(filename, true, &w, &h);
     if (!hdr_data) {
         LOG("texture::load_hdr: stbi_load didn't return with expected data");
         return id::invalid();
     }
+    uint64_t decoded_bytes = (uint64_t)w * h * 4 * sizeof(float);
+    memory_tracker::track(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
 
     // Create the texture
     TextureId new_tex = create(w, h,
@@ -69,11 +92,117 @@ TextureId texture::load_hdr(const char *filename) {
                                1,
                                false);
 
+    memory_tracker::untrack(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
     stbi_image_free(hdr_data);
 
     return new_tex;
 }
 
+AssetLoad texture::load_async(const char *filename, bool is_srgb) {
+    return load_async_internal(filename, is_srgb, false);
+}
+
+AssetLoad texture::load_hdr_async(const char *filename) {
+    return load_async_internal(filename, false, true);
+}
+
+AssetLoad texture::load_streamed(const char *filename, bool is_srgb) {
+    Renderer *renderer = application::get_renderer();
+    AsyncScheduler *scheduler = &renderer->asset_scheduler;
+
+    if (!async::has_room(scheduler)) {
+        LOG("texture::load_streamed: Too many loads in flight, loading all of %s right away", filename);
+        return async::finished(texture::load(filename, is_srgb));
+    }
+
+    Texture *t = create_placeholder(renderer);
+    if (t == nullptr) {
+        LOG("texture::load_streamed: Max textures reached, adjust max texture count.");
+        return async::finished(id::invalid());
+    }
+
+    AssetLoad load = async::begin_load(scheduler, t->id);
+    stream_load_task(renderer, load, filename, is_srgb);
+    return load;
+}
+
+AssetLoad texture::acquire(const char *filename, bool is_srgb, bool is_streamed) {
+    Renderer *renderer = application::get_renderer();
+    AssetRegistry *registry = &renderer->asset_registry;
+
+    uint8_t flags = (is_srgb ? ASSET_FLAG_SRGB : 0) | (is_streamed ? ASSET_FLAG_STREAMED : 0);
+    AssetKey key;
+    AssetLoad load;
+    bool is_keyed = asset_registry::make_key(registry, ASSET_TEXTURE, flags, filename, &key);
+    if (is_keyed && asset_registry::acquire(registry, &key, &load)) {
+        return load;
+    }
+
+    load = is_streamed ? load_streamed(filename, is_srgb) : load_async(filename, is_srgb);
+    if (is_keyed && id::is_valid(load.id)) {
+        asset_registry::add(registry, &key, load);
+    }
+    return load;
+}
+
+void texture::release(TextureId id) {
+    Renderer *renderer = application::get_renderer();
+    if (asset_registry::release(&renderer->asset_registry, ASSET_TEXTURE, id)) {
+        destroy(id);
+    }
+}
+
+void texture::destroy(TextureId id) {
+    Renderer *renderer = application::get_renderer();
+    Texture *t = get(renderer, id);
+    if (!t || !id::is_fresh(t->id, id)) {
+        return;
+    }
+
+    // Drops a mip load in flight as well, it finds the texture gone when it's done
+    texture_streamer::remove(&renderer->texture_streamer, id.id);
+    if (t->gpu_bytes > 0) {
+        memory_tracker::untrack(get_memory_tag(t->bind_flags), MEMORY_DOMAIN_GPU, t->gpu_bytes);
+    }
+
+    // The next texture in the slot gets the next generation, so the old ids don't find it
+    *t = {};
+    id::invalidate(&t->id);
+    t->id.generation = id.generation;
+    id::gen_increment(&t->id);
+
+    // Materials still pointing at it get the fallback
+    renderer->material_table_dirty = true;
+}
+
+void texture::stream(Renderer *renderer, const StreamRequest *requests, uint32_t count) {
+    AsyncScheduler *scheduler = &renderer->asset_scheduler;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const StreamRequest *request = &requests[i];
+        Texture *t = &renderer->textures[request->texture];
+        const MipFileHeader *header = &renderer->texture_stream_headers[request->texture];
+        uint32_t resident_mip = header->mip_count - t->mip_levels;
+
+        // The streamer counts it gone already, the copy keeps the smaller mips
+        if (!request->is_load) {
+            if (upload_mips(renderer, t, header, request->mip, nullptr)) {
+                renderer->material_table_dirty = true;
+            } else {
+                LOG("%s: Couldn't drop mips of texture %u, they stay resident", __func__, request->texture);
+            }
+            continue;
+        }
+
+        if (!async::has_room(scheduler)) {
+            texture_streamer::complete(&renderer->texture_streamer, request->texture, false);
+            continue;
+        }
+        AssetLoad load = async::begin_load(scheduler, t->id);
+        stream_in_task(renderer, load, request->mip, resident_mip);
+    }
+}
+
 TextureId texture::load_from_data(uint8_t *image_data, uint16_t width, uint16_t height) {
     Renderer *renderer = application::get_renderer();
 
@@ -121,6 +250,7 @@ TextureId texture::load_from_data(uint8_t *image_data, uint16_t width, uint16_t
         stbi_image_free(image_data);
         return id::invalid();
     }
+    track_gpu_bytes(t, MEMORY_TAG_TEXTURES, texture_format::texture_bytes(desc.Format, desc.Width, desc.Height, 1, 1, 1));
 
     // Create SRV for the texture as we are treating this
     // as shader resource only for now
@@ -248,6 +378,11 @@ TextureId texture::create_from_backbuffer(ID3D11Device1 *device, IDXGISwapChain3
     t->is_cubemap = false; // Backbuffers are never cubemaps
     t->bind_flags = desc.BindFlags;
 
+    // Every buffer of the swapchain, not only the one we got
+    DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {};
+    swapchain->GetDesc1(&swapchain_desc);
+    track_gpu_bytes(t, MEMORY_TAG_RENDER_TARGETS, texture_format::texture_bytes(desc.Format, desc.Width, desc.Height, swapchain_desc.BufferCount, 1, desc.SampleDesc.Count));
+
     return t->id;
 }
 
@@ -305,6 +440,10 @@ bool texture::resize_swapchain(TextureId texture_id, ID3D11Device1 *device, ID3D
     swapchain_texture->width = width;
     swapchain_texture->height = height;
 
+    DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {};
+    swapchain->GetDesc1(&swapchain_desc);
+    track_gpu_bytes(swapchain_texture, MEMORY_TAG_RENDER_TARGETS, texture_format::texture_bytes(bb_desc.Format, bb_desc.Width, bb_desc.Height, swapchain_desc.BufferCount, 1, bb_desc.SampleDesc.Count));
+
     return true;
 }
 
@@ -410,6 +549,7 @@ static bool create_texture_internal(ID3D11Device *device, Texture *texture, uint
         LOG("%s: Failed to create Texture2D. HRESULT: 0x%lX. Message: %s", __func__, hr, err_msg);
         return false;
     }
+    track_gpu_bytes(texture, get_memory_tag(bind_flags), texture_format::texture_bytes(desc.Format, width, height, array_size, mip_levels, msaa_samples));
 
     if (generate_srv && (bind_flags & D3D11_BIND_SHADER_RESOURCE)) {
         D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
@@ -540,7 +680,9 @@ bool texture::export_to_file(TextureId texture, const char *filename) {
     const int height = (int)staging_desc.Height;
     const int comp = 3;
 
-    float *rgb_data = (float *)malloc(sizeof(float) * width * height * comp);
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    float *rgb_data = ARENA_PUSH_ARRAY(scratch, float, width * height * comp);
     if (!rgb_data) {
         LOG("%s: Couldn't allocate data structure for texture", __func__);
         return false;
@@ -557,7 +699,7 @@ bool texture::export_to_file(TextureId texture, const char *filename) {
             D3D11_MAPPED_SUBRESOURCE mapped = {};
             hr = context->Map(staging_texture.Get(), 0, D3D11_MAP_READ, 0, &mapped);
             if (FAILED(hr)) {
-                free(rgb_data);
+                arena::rewind(scratch, marker);
                 return false;
             }
 
@@ -585,6 +727,7 @@ bool texture::export_to_file(TextureId texture, const char *filename) {
         hr = context->Map(staging_texture.Get(), 0, D3D11_MAP_READ, 0, &mapped);
         if (FAILED(hr)) {
             LOG("%s: Failed to map staging texture", __func__);
+            arena::rewind(scratch, marker);
             return false;
         }
 
@@ -606,7 +749,7 @@ bool texture::export_to_file(TextureId texture, const char *filename) {
         stbi_write_hdr(full_name, width, height, comp, rgb_data);
     }
 
-    free(rgb_data);
+    arena::rewind(scratch, marker);
 
     return true;
 }
@@ -621,3 +764,325 @@ static FormatBindingInfo get_format_binding_info(DXGI_FORMAT format) {
             return {format, format, format};
     }
 }
+
+static AssetLoad load_async_internal(const char *filename, bool is_srgb, bool is_hdr) {
+    Renderer *renderer = application::get_renderer();
+    AsyncScheduler *scheduler = &renderer->asset_scheduler;
+
+    if (!async::has_room(scheduler)) {
+        LOG("texture::load_async: Too many loads in flight, loading %s right away", filename);
+        return async::finished(is_hdr ? texture::load_hdr(filename) : texture::load(filename, is_srgb));
+    }
+
+    Texture *t = create_placeholder(renderer);
+    if (t == nullptr) {
+        LOG("texture::load_async: Max textures reached, adjust max texture count.");
+        return async::finished(id::invalid());
+    }
+
+    AssetLoad load = async::begin_load(scheduler, t->id);
+    load_task(renderer, load, filename, is_srgb, is_hdr);
+    return load;
+}
+
+static AsyncTask load_task(Renderer *renderer, AssetLoad load, const char *filename, bool is_srgb, bool is_hdr) {
+    AsyncScheduler *scheduler = load.scheduler;
+
+    // filename is only good until the first co_await
+    char path[ASYNC_PATH_MAX];
+    snprintf(path, sizeof(path), "%s", filename);
+
+    co_await async::to_worker(scheduler);
+
+    int h = 0, w = 0;
+    void *pixels = decode_image(path, is_hdr, &w, &h);
+    uint64_t decoded_bytes = pixels ? (uint64_t)w * h * 4 * (is_hdr ? sizeof(float) : 1) : 0;
+    if (pixels) {
+        memory_tracker::track(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
+    }
+
+    co_await async::to_main(scheduler);
+
+    // Only patched while the slot still holds our placeholder
+    Texture *t = texture::get(renderer, load.id);
+    Texture *fallback = texture::get(renderer, renderer->amre_fallback_texture);
+    if (!pixels) {
+        LOG("texture::load_async: Couldn't decode %s, keeping the fallback", path);
+    } else if (!t || !id::is_fresh(t->id, load.id) || t->texture.Get() != fallback->texture.Get()) {
+        LOG("texture::load_async: %s was destroyed while loading", path);
+    } else {
+        DXGI_FORMAT format = is_hdr ? DXGI_FORMAT_R32G32B32A32_FLOAT : (is_srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM);
+        uint32_t row_pitch = is_hdr ? (uint32_t)(w * 4 * sizeof(float)) : (uint32_t)(w * 4);
+
+        Texture loaded = {};
+        loaded.id = load.id;
+        if (create_texture_internal(renderer->device.Get(), &loaded, w, h, 1, 1, format, D3D11_BIND_SHADER_RESOURCE, false, true, 1, pixels, row_pitch)) {
+            loaded.width = w;
+            loaded.height = h;
+            loaded.format = format;
+            loaded.mip_levels = 1;
+            loaded.array_size = 1;
+            loaded.is_cubemap = false;
+            loaded.bind_flags = D3D11_BIND_SHADER_RESOURCE;
+            loaded.has_srv = true;
+            loaded.msaa_samples = 1;
+            *t = loaded;
+
+            // The material arrays hold a copy of the placeholder
+            renderer->material_table_dirty = true;
+        } else {
+            LOG("texture::load_async: Couldn't create %s on the GPU, keeping the fallback", path);
+        }
+    }
+
+    if (pixels) {
+        memory_tracker::untrack(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
+    }
+    stbi_image_free(pixels);
+    async::end_load(scheduler, &load);
+}
+
+static Texture *create_placeholder(Renderer *renderer) {
+    // The placeholder shares the fallback's resources, it's replaced as a whole later
+    Texture *t = nullptr;
+    for (uint8_t i = 0; i < MAX_TEXTURES; ++i) {
+        if (id::is_invalid(renderer->textures[i].id)) {
+            t = &renderer->textures[i];
+            t->id.id = i;
+            break;
+        }
+    }
+
+    if (t == nullptr) {
+        return nullptr;
+    }
+
+    TextureId id = t->id;
+    *t = *texture::get(renderer, renderer->amre_fallback_texture);
+    t->id = id;
+    t->gpu_bytes = 0; // The fallback's, tracked with it
+    return t;
+}
+
+static AsyncTask stream_load_task(Renderer *renderer, AssetLoad load, const char *filename, bool is_srgb) {
+    AsyncScheduler *scheduler = load.scheduler;
+
+    // filename is only good until the first co_await
+    char source[ASYNC_PATH_MAX];
+    snprintf(source, sizeof(source), "%s", filename);
+
+    co_await async::to_worker(scheduler);
+
+    // The tail goes along to the main thread, so an arena of the load's own
+    Arena load_arena;
+    char path[MIP_FILE_PATH_MAX];
+    MipFileHeader header = {};
+    uint8_t *levels[MIP_FILE_MAX_MIPS] = {};
+    uint32_t tail_mip = 0;
+    bool is_read = arena::initialize(&load_arena, ARENA_SCRATCH_RESERVE) &&
+                   get_mip_file(source, is_srgb, path, sizeof(path), &header);
+    if (is_read) {
+        tail_mip = get_tail_mip(&header);
+        is_read = mip_file::read_mips(path, &header, tail_mip, header.mip_count, &load_arena, levels);
+    }
+
+    co_await async::to_main(scheduler);
+
+    // Only patched while the slot still holds our placeholder
+    Texture *t = texture::get(renderer, load.id);
+    Texture *fallback = texture::get(renderer, renderer->amre_fallback_texture);
+    if (!is_read) {
+        LOG("texture::load_streamed: Couldn't read the mips of %s, keeping the fallback", source);
+    } else if (!t || !id::is_fresh(t->id, load.id) || t->texture.Get() != fallback->texture.Get()) {
+        LOG("texture::load_streamed: %s was destroyed while loading", source);
+    } else {
+        Texture loaded = {};
+        loaded.id = load.id;
+        if (upload_mips(renderer, &loaded, &header, tail_mip, levels)) {
+            uint64_t mip_bytes[MIP_FILE_MAX_MIPS];
+            for (uint32_t mip = 0; mip < header.mip_count; ++mip) {
+                mip_bytes[mip] = header.levels[mip].size;
+            }
+
+            // Without the streamer it still works, at its tail
+            if (texture_streamer::add(&renderer->texture_streamer, load.id.id, header.width, header.height, mip_bytes, header.mip_count, tail_mip)) {
+                renderer->texture_stream_headers[load.id.id] = header;
+                snprintf(renderer->texture_stream_paths[load.id.id], MIP_FILE_PATH_MAX, "%s", path);
+            } else {
+                LOG("texture::load_streamed: %s stays at %ux%u", source, loaded.width, loaded.height);
+            }
+            *t = loaded;
+
+            // The material arrays hold a copy of the placeholder
+            renderer->material_table_dirty = true;
+        } else {
+            LOG("texture::load_streamed: Couldn't create %s on the GPU, keeping the fallback", source);
+        }
+    }
+
+    arena::shutdown(&load_arena);
+    async::end_load(scheduler, &load);
+}
+
+static AsyncTask stream_in_task(Renderer *renderer, AssetLoad load, uint32_t first_mip, uint32_t end_mip) {
+    AsyncScheduler *scheduler = load.scheduler;
+
+    // Copied while on the main thread, the renderer's are only touched there
+    MipFileHeader header = renderer->texture_stream_headers[load.id.id];
+    char path[MIP_FILE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s", renderer->texture_stream_paths[load.id.id]);
+
+    co_await async::to_worker(scheduler);
+
+    Arena load_arena;
+    uint8_t *levels[MIP_FILE_MAX_MIPS] = {};
+    bool is_read = arena::initialize(&load_arena, ARENA_SCRATCH_RESERVE) &&
+                   mip_file::read_mips(path, &header, first_mip, end_mip, &load_arena, levels);
+
+    co_await async::to_main(scheduler);
+
+    // Nothing evicts a texture while it loads, it still has the mips it had
+    Texture *t = texture::get(renderer, load.id);
+    bool is_alive = t && id::is_fresh(t->id, load.id);
+    bool is_loaded = false;
+    if (!is_read) {
+        LOG("texture::stream: Couldn't read mips %u to %u of %s", first_mip, end_mip - 1, path);
+    } else if (!is_alive) {
+        LOG("texture::stream: %s was destroyed while loading", path);
+    } else if (header.mip_count - t->mip_levels != end_mip) {
+        LOG("texture::stream: %s was replaced while loading", path);
+    } else if (!upload_mips(renderer, t, &header, first_mip, levels)) {
+        LOG("texture::stream: Couldn't grow %s to mip %u on the GPU", path, first_mip);
+    } else {
+        is_loaded = true;
+        renderer->material_table_dirty = true;
+    }
+    // A destroyed texture's load went with it, the slot may stream another one by now
+    if (is_alive) {
+        texture_streamer::complete(&renderer->texture_streamer, load.id.id, is_loaded);
+    }
+
+    arena::shutdown(&load_arena);
+    async::end_load(scheduler, &load);
+}
+
+static bool get_mip_file(const char *source, bool is_srgb, char *out_path, size_t out_size, MipFileHeader *out_header) {
+    uint64_t key = mip_file::make_key(source, is_srgb);
+    if (key == 0) {
+        LOG("texture::load_streamed: %s isn't there", source);
+        return false;
+    }
+
+    mip_file::get_path(MIP_FILE_DIR, key, out_path, out_size);
+    if (mip_file::read_header(out_path, key, out_header)) {
+        return true;
+    }
+
+    // First time this version of the image is streamed, bake it
+    int h = 0, w = 0;
+    uint8_t *pixels = (uint8_t *)decode_image(source, false, &w, &h);
+    if (!pixels) {
+        LOG("texture::load_streamed: Couldn't decode %s", source);
+        return false;
+    }
+    uint64_t decoded_bytes = (uint64_t)w * h * 4;
+    memory_tracker::track(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
+
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    uint8_t *levels[MIP_FILE_MAX_MIPS] = {};
+    uint32_t mip_count = 0;
+    bool is_baked = mip_file::build_mips(pixels, w, h, is_srgb, scratch, levels, &mip_count) &&
+                    mip_file::write(out_path, key, w, h, is_srgb, levels, mip_count);
+    arena::rewind(scratch, marker);
+
+    memory_tracker::untrack(MEMORY_TAG_TEXTURES, MEMORY_DOMAIN_CPU, decoded_bytes);
+    stbi_image_free(pixels);
+
+    return is_baked && mip_file::read_header(out_path, key, out_header);
+}
+
+static uint32_t get_tail_mip(const MipFileHeader *header) {
+    uint32_t mip = 0;
+    while (mip + 1 < header->mip_count &&
+           (header->levels[mip].width > TEXTURE_STREAM_TAIL_SIZE || header->levels[mip].height > TEXTURE_STREAM_TAIL_SIZE)) {
+        mip++;
+    }
+    return mip;
+}
+
+static bool upload_mips(Renderer *renderer, Texture *texture, const MipFileHeader *header, uint32_t first_mip, uint8_t *const *levels) {
+    // The mips the texture has already are copied over on the GPU, the others come from levels
+    uint32_t old_first_mip = texture->texture.Get() ? header->mip_count - texture->mip_levels : header->mip_count;
+    DXGI_FORMAT format = header->is_srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = header->levels[first_mip].width;
+    desc.Height = header->levels[first_mip].height;
+    desc.MipLevels = header->mip_count - first_mip;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> resource;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+    if (FAILED(renderer->device->CreateTexture2D(&desc, nullptr, resource.GetAddressOf())) ||
+        FAILED(renderer->device->CreateShaderResourceView(resource.Get(), nullptr, srv.GetAddressOf()))) {
+        return false;
+    }
+
+    ID3D11DeviceContext *context = renderer->context.Get();
+    for (uint32_t mip = first_mip; mip < header->mip_count; ++mip) {
+        if (mip >= old_first_mip) {
+            context->CopySubresourceRegion(resource.Get(), mip - first_mip, 0, 0, 0, texture->texture.Get(), mip - old_first_mip, nullptr);
+        } else {
+            assert(levels && levels[mip] && "texture::upload_mips: A mip the texture doesn't have wasn't read");
+            context->UpdateSubresource(resource.Get(), mip - first_mip, nullptr, levels[mip], header->levels[mip].width * 4, 0);
+        }
+    }
+
+    texture->texture = resource;
+    texture->srv = srv;
+    texture->width = (int16_t)desc.Width;
+    texture->height = (int16_t)desc.Height;
+    texture->format = format;
+    texture->mip_levels = desc.MipLevels;
+    texture->array_size = 1;
+    texture->is_cubemap = false;
+    texture->bind_flags = D3D11_BIND_SHADER_RESOURCE;
+    texture->has_srv = true;
+    texture->msaa_samples = 1;
+    track_gpu_bytes(texture, MEMORY_TAG_TEXTURES, texture_format::texture_bytes(format, desc.Width, desc.Height, 1, desc.MipLevels, 1));
+    return true;
+}
+
+static void track_gpu_bytes(Texture *texture, MemoryTag tag, uint64_t bytes) {
+    // Recreated (resized), the old resource is gone
+    if (texture->gpu_bytes > 0) {
+        memory_tracker::untrack(tag, MEMORY_DOMAIN_GPU, texture->gpu_bytes);
+    }
+    texture->gpu_bytes = bytes;
+    memory_tracker::track(tag, MEMORY_DOMAIN_GPU, bytes);
+}
+
+static MemoryTag get_memory_tag(uint32_t bind_flags) {
+    return (bind_flags & (D3D11_BIND_RENDER_TARGET | D3D11_BIND_DEPTH_STENCIL)) ? MEMORY_TAG_RENDER_TARGETS : MEMORY_TAG_TEXTURES;
+}
+
+static void *decode_image(const char *filename, bool is_hdr, int *out_width, int *out_height) {
+    // The file only until it's decoded, stb allocates the pixels
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    void *pixels = nullptr;
+    if (vfs::read(filename, scratch, &data, &size)) {
+        int channels = 0;
+        pixels = is_hdr ? (void *)stbi_loadf_from_memory(data, (int)size, out_width, out_height, &channels, 4)
+                        : (void *)stbi_load_from_memory(data, (int)size, out_width, out_height, &channels, 4);
+    }
+    arena::rewind(scratch, marker);
+    return pixels;
+}
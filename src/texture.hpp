@@ -1,5 +1,6 @@
 #pragma once
 
+#include "async.hpp"
 #include "id.hpp"
 #include "mesh.hpp"
 
@@ -9,9 +10,12 @@
 #include <wrl/client.h>
 
 struct Renderer;
+struct StreamRequest;
 
 using TextureId = Id;
 #define MAX_MIP_LEVELS 16
+// Streamed textures keep the mips this size and smaller resident at all times
+#define TEXTURE_STREAM_TAIL_SIZE 64
 
 struct Texture {
     TextureId id;
@@ -24,6 +28,7 @@ struct Texture {
     uint32_t msaa_samples;
     bool is_cubemap;
     bool has_srv;
+    uint64_t gpu_bytes; // What it's tracked with in the memory tracker
     Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
     Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv[6];
@@ -35,6 +40,26 @@ namespace texture {
 
 TextureId load(const char *filename, bool is_srgb);
 TextureId load_hdr(const char *filename);
+// Return right away with the white fallback in the texture's slot, the file is
+// decoded on a worker and uploaded in job_system::run_main_jobs. Anything baked from the
+// texture (like the IBL maps from the HDR) has to co_await it first.
+AssetLoad load_async(const char *filename, bool is_srgb);
+AssetLoad load_hdr_async(const char *filename);
+// Like load_async, but only the mips up to TEXTURE_STREAM_TAIL_SIZE are
+// uploaded, from a mip file baked on first use (see mip_file.hpp). The renderer's
+// texture streamer brings in the rest as the texture is seen up close.
+AssetLoad load_streamed(const char *filename, bool is_srgb);
+// Carries out the streamer's requests. Evictions shrink the texture right
+// away, loads read the new mips on a worker and grow it in run_main_jobs.
+void stream(Renderer *renderer, const StreamRequest *requests, uint32_t count);
+// The scene's way in: load_streamed or load_async the first time a file is
+// asked for, the same texture with one more reference after that (see
+// asset_registry.hpp). Give each one back with release.
+AssetLoad acquire(const char *filename, bool is_srgb, bool is_streamed);
+// Destroys the texture with its last reference
+void release(TextureId id);
+// Frees the texture right away, however many hold it. Its ids are stale after.
+void destroy(TextureId id);
 TextureId load_from_data(uint8_t *image_data, uint16_t width, uint16_t height);
 TextureId create(uint16_t width,
                  uint16_t height,
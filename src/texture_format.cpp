@@ -0,0 +1,206 @@
+#include "texture_format.hpp"
+
+static uint32_t bits_per_pixel(DXGI_FORMAT format);
+static bool is_block_compressed(DXGI_FORMAT format, uint32_t *out_block_bytes);
+
+uint64_t texture_format::image_bytes(DXGI_FORMAT format, uint32_t width, uint32_t height) {
+    uint64_t w = width;
+    uint64_t h = height;
+
+    uint32_t block_bytes = 0;
+    if (is_block_compressed(format, &block_bytes)) {
+        // Even a 1x1 mip takes a whole block
+        uint64_t blocks_wide = w > 0 ? (w + 3) / 4 : 0;
+        uint64_t blocks_high = h > 0 ? (h + 3) / 4 : 0;
+        return blocks_wide * blocks_high * block_bytes;
+    }
+
+    switch (format) {
+    // 4:2:2 packed, two pixels share one 4 or 8 byte element
+    case DXGI_FORMAT_R8G8_B8G8_UNORM:
+    case DXGI_FORMAT_G8R8_G8B8_UNORM:
+    case DXGI_FORMAT_YUY2:
+        return ((w + 1) / 2) * 4 * h;
+    case DXGI_FORMAT_Y210:
+    case DXGI_FORMAT_Y216:
+        return ((w + 1) / 2) * 8 * h;
+    // Planar, a luma plane and the chroma ones below it
+    case DXGI_FORMAT_NV12:
+    case DXGI_FORMAT_420_OPAQUE:
+        return ((w + 1) / 2) * 2 * (h + (h + 1) / 2);
+    case DXGI_FORMAT_P010:
+    case DXGI_FORMAT_P016:
+        return ((w + 1) / 2) * 4 * (h + (h + 1) / 2);
+    case DXGI_FORMAT_NV11:
+        // D3D gives it as much as 4:2:2, more than the 4:1:1 data needs
+        return ((w + 3) / 4) * 4 * h * 2;
+    case DXGI_FORMAT_P208:
+        return ((w + 1) / 2) * 2 * h * 2;
+    case DXGI_FORMAT_V208:
+        return w * (h + ((h + 1) / 2) * 2);
+    case DXGI_FORMAT_V408:
+        return w * (h + (h / 2) * 4);
+    // Rows are whole bytes
+    case DXGI_FORMAT_R1_UNORM:
+        return ((w + 7) / 8) * h;
+    default:
+        break;
+    }
+
+    return w * h * bits_per_pixel(format) / 8;
+}
+
+uint64_t texture_format::texture_bytes(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t array_size, uint32_t mip_levels, uint32_t samples) {
+    if (mip_levels == 0) {
+        uint32_t largest = width > height ? width : height;
+        mip_levels = 1;
+        while (largest > 1) {
+            largest >>= 1;
+            mip_levels++;
+        }
+    }
+
+    uint64_t bytes = 0;
+    for (uint32_t mip = 0; mip < mip_levels; ++mip) {
+        uint32_t w = width >> mip;
+        uint32_t h = height >> mip;
+        bytes += image_bytes(format, w > 0 ? w : 1, h > 0 ? h : 1);
+    }
+    return bytes * (array_size > 0 ? array_size : 1) * (samples > 0 ? samples : 1);
+}
+
+static uint32_t bits_per_pixel(DXGI_FORMAT format) {
+    switch (format) {
+    case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+    case DXGI_FORMAT_R32G32B32A32_UINT:
+    case DXGI_FORMAT_R32G32B32A32_SINT:
+        return 128;
+
+    case DXGI_FORMAT_R32G32B32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32_FLOAT:
+    case DXGI_FORMAT_R32G32B32_UINT:
+    case DXGI_FORMAT_R32G32B32_SINT:
+        return 96;
+
+    case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+    case DXGI_FORMAT_R16G16B16A16_UINT:
+    case DXGI_FORMAT_R16G16B16A16_SNORM:
+    case DXGI_FORMAT_R16G16B16A16_SINT:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+    case DXGI_FORMAT_R32G32_FLOAT:
+    case DXGI_FORMAT_R32G32_UINT:
+    case DXGI_FORMAT_R32G32_SINT:
+    case DXGI_FORMAT_R32G8X24_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+    case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+    case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+    case DXGI_FORMAT_Y416:
+        return 64;
+
+    case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+    case DXGI_FORMAT_R10G10B10A2_UNORM:
+    case DXGI_FORMAT_R10G10B10A2_UINT:
+    case DXGI_FORMAT_R11G11B10_FLOAT:
+    case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_R8G8B8A8_UINT:
+    case DXGI_FORMAT_R8G8B8A8_SNORM:
+    case DXGI_FORMAT_R8G8B8A8_SINT:
+    case DXGI_FORMAT_R16G16_TYPELESS:
+    case DXGI_FORMAT_R16G16_FLOAT:
+    case DXGI_FORMAT_R16G16_UNORM:
+    case DXGI_FORMAT_R16G16_UINT:
+    case DXGI_FORMAT_R16G16_SNORM:
+    case DXGI_FORMAT_R16G16_SINT:
+    case DXGI_FORMAT_R32_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_R32_UINT:
+    case DXGI_FORMAT_R32_SINT:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+    case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+    case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+    case DXGI_FORMAT_AYUV:
+    case DXGI_FORMAT_Y410:
+        return 32;
+
+    case DXGI_FORMAT_R8G8_TYPELESS:
+    case DXGI_FORMAT_R8G8_UNORM:
+    case DXGI_FORMAT_R8G8_UINT:
+    case DXGI_FORMAT_R8G8_SNORM:
+    case DXGI_FORMAT_R8G8_SINT:
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_R16_UINT:
+    case DXGI_FORMAT_R16_SNORM:
+    case DXGI_FORMAT_R16_SINT:
+    case DXGI_FORMAT_B5G6R5_UNORM:
+    case DXGI_FORMAT_B5G5R5A1_UNORM:
+    case DXGI_FORMAT_A8P8:
+    case DXGI_FORMAT_B4G4R4A4_UNORM:
+        return 16;
+
+    case DXGI_FORMAT_R8_TYPELESS:
+    case DXGI_FORMAT_R8_UNORM:
+    case DXGI_FORMAT_R8_UINT:
+    case DXGI_FORMAT_R8_SNORM:
+    case DXGI_FORMAT_R8_SINT:
+    case DXGI_FORMAT_A8_UNORM:
+    case DXGI_FORMAT_AI44:
+    case DXGI_FORMAT_IA44:
+    case DXGI_FORMAT_P8:
+        return 8;
+
+    default:
+        return 0;
+    }
+}
+
+static bool is_block_compressed(DXGI_FORMAT format, uint32_t *out_block_bytes) {
+    switch (format) {
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+        *out_block_bytes = 8;
+        return true;
+
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        *out_block_bytes = 16;
+        return true;
+
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <dxgiformat.h>
+
+// GPU sizes of textures for the memory tracker, kept apart from it so the
+// tracker itself doesn't need any D3D headers
+namespace texture_format {
+
+// Bytes of one width x height image in the format, with the rows and blocks
+// padded the way D3D lays them out (4x4 blocks for BC, pairs for the packed
+// 4:2:2 formats, planes for the video ones). 0 for unknown formats.
+uint64_t image_bytes(DXGI_FORMAT format, uint32_t width, uint32_t height);
+// Every mip of every layer and sample. mip_levels 0 is the full chain.
+uint64_t texture_bytes(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t array_size, uint32_t mip_levels, uint32_t samples);
+
+} // namespace texture_format
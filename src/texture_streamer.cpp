@@ -0,0 +1,280 @@
+#include "texture_streamer.hpp"
+
+#include "logger.hpp"
+
+#include <cassert>
+
+static void evict(TextureStreamer *streamer, uint32_t texture, uint32_t mip);
+static uint64_t get_excess_bytes(const TextureStreamer *streamer, uint32_t texture);
+static int32_t find_victim(const TextureStreamer *streamer, uint32_t except, bool is_wanted_evictable);
+static int32_t find_load(const TextureStreamer *streamer, const uint8_t *start_mips, const bool *is_tried);
+
+void texture_streamer::initialize(TextureStreamer *streamer, uint64_t budget, uint32_t max_loads) {
+    assert(streamer && "texture_streamer::initialize: Streamer pointer cannot be NULL");
+
+    *streamer = {};
+    streamer->budget = budget;
+    streamer->max_loads = max_loads > 0 ? max_loads : 1;
+}
+
+void texture_streamer::set_budget(TextureStreamer *streamer, uint64_t budget) {
+    streamer->budget = budget;
+}
+
+bool texture_streamer::add(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, const uint64_t *mip_bytes, uint32_t mip_count, uint32_t tail_mip) {
+    if (texture >= STREAMER_MAX_TEXTURES || mip_count == 0 || mip_count > STREAMER_MAX_MIPS || tail_mip >= mip_count) {
+        LOG("%s: Texture %u with %u mips and its tail at %u can't be streamed", __func__, texture, mip_count, tail_mip);
+        return false;
+    }
+    if (streamer->textures[texture].is_used) {
+        LOG("%s: Texture %u is already streamed", __func__, texture);
+        return false;
+    }
+
+    StreamedTexture *t = &streamer->textures[texture];
+    *t = {};
+    t->is_used = true;
+    t->mip_count = (uint8_t)mip_count;
+    t->tail_mip = (uint8_t)tail_mip;
+    t->resident_mip = (uint8_t)tail_mip;
+    t->wanted_mip = (uint8_t)tail_mip;
+    t->loading_mip = STREAMER_MIP_NONE;
+    t->width = width;
+    t->height = height;
+    t->last_used_frame = streamer->frame;
+    for (uint32_t mip = 0; mip < mip_count; ++mip) {
+        t->mip_bytes[mip] = mip_bytes[mip];
+    }
+
+    streamer->resident_bytes += get_bytes(streamer, texture, tail_mip);
+    return true;
+}
+
+void texture_streamer::remove(TextureStreamer *streamer, uint32_t texture) {
+    if (!is_streamed(streamer, texture)) {
+        return;
+    }
+
+    // A load in flight is dropped too, its complete finds nothing to finish
+    StreamedTexture *t = &streamer->textures[texture];
+    uint32_t mip = t->loading_mip != STREAMER_MIP_NONE ? t->loading_mip : t->resident_mip;
+    streamer->resident_bytes -= get_bytes(streamer, texture, mip);
+    if (t->loading_mip != STREAMER_MIP_NONE) {
+        streamer->loads_in_flight--;
+    }
+    *t = {};
+}
+
+bool texture_streamer::is_streamed(const TextureStreamer *streamer, uint32_t texture) {
+    return texture < STREAMER_MAX_TEXTURES && streamer->textures[texture].is_used;
+}
+
+void texture_streamer::begin_frame(TextureStreamer *streamer) {
+    streamer->frame++;
+    for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+        StreamedTexture *t = &streamer->textures[i];
+        t->wanted_mip = t->tail_mip;
+    }
+}
+
+void texture_streamer::request(TextureStreamer *streamer, uint32_t texture, uint32_t mip) {
+    if (!is_streamed(streamer, texture)) {
+        return;
+    }
+
+    StreamedTexture *t = &streamer->textures[texture];
+    if (mip < t->wanted_mip) {
+        t->wanted_mip = (uint8_t)mip;
+    }
+    t->last_used_frame = streamer->frame;
+}
+
+uint32_t texture_streamer::footprint_mip(const TextureStreamer *streamer, uint32_t texture, float screen_pixels) {
+    if (!is_streamed(streamer, texture)) {
+        return 0;
+    }
+
+    // Smallest mip that still has a texel per pixel
+    const StreamedTexture *t = &streamer->textures[texture];
+    uint32_t size = t->width > t->height ? t->width : t->height;
+    uint32_t mip = 0;
+    while (mip < t->tail_mip && (float)(size >> (mip + 1)) >= screen_pixels) {
+        mip++;
+    }
+    return mip;
+}
+
+uint32_t texture_streamer::update(TextureStreamer *streamer, StreamRequest *out_requests) {
+    uint8_t start_mips[STREAMER_MAX_TEXTURES];
+    uint8_t started_loads[STREAMER_MAX_TEXTURES] = {};
+    bool is_tried[STREAMER_MAX_TEXTURES] = {};
+    streamer->stats.wanted_bytes = 0;
+    for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+        start_mips[i] = streamer->textures[i].resident_mip;
+        if (streamer->textures[i].is_used) {
+            streamer->stats.wanted_bytes += get_bytes(streamer, i, streamer->textures[i].wanted_mip);
+        }
+    }
+
+    // The budget went down: first what nobody asked for, oldest first, then
+    // detail that is asked for, a mip at a time
+    while (streamer->resident_bytes > streamer->budget) {
+        int32_t victim = find_victim(streamer, STREAMER_MAX_TEXTURES, false);
+        if (victim < 0) {
+            break;
+        }
+        evict(streamer, victim, streamer->textures[victim].wanted_mip);
+    }
+    bool is_starved = false;
+    while (streamer->resident_bytes > streamer->budget) {
+        int32_t victim = find_victim(streamer, STREAMER_MAX_TEXTURES, true);
+        if (victim < 0) {
+            break;
+        }
+        evict(streamer, victim, streamer->textures[victim].resident_mip + 1);
+        is_starved = true;
+    }
+
+    // Loads, the texture missing the most mips first. Not when asked for
+    // detail just went, a load would only trade it back and forth.
+    while (!is_starved && streamer->loads_in_flight < streamer->max_loads) {
+        int32_t index = find_load(streamer, start_mips, is_tried);
+        if (index < 0) {
+            break;
+        }
+        is_tried[index] = true;
+
+        // Everyone else's unwanted mips can make room, find what fits with them gone
+        uint64_t freeable = 0;
+        for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+            if (i != (uint32_t)index) {
+                freeable += get_excess_bytes(streamer, i);
+            }
+        }
+
+        StreamedTexture *t = &streamer->textures[index];
+        uint64_t resident = get_bytes(streamer, index, t->resident_mip);
+        uint32_t target = t->wanted_mip;
+        while (target < t->resident_mip && streamer->resident_bytes + get_bytes(streamer, index, target) - resident > streamer->budget + freeable) {
+            target++;
+        }
+        if (target == t->resident_mip) {
+            continue;
+        }
+        if (target > t->wanted_mip) {
+            streamer->stats.clamped_loads++;
+        }
+
+        uint64_t load_bytes = get_bytes(streamer, index, target) - resident;
+        while (streamer->resident_bytes + load_bytes > streamer->budget) {
+            int32_t victim = find_victim(streamer, index, false);
+            assert(victim >= 0 && "texture_streamer::update: Counted more freeable bytes than there are");
+            evict(streamer, victim, streamer->textures[victim].wanted_mip);
+        }
+
+        t->loading_mip = (uint8_t)target;
+        started_loads[index] = 1;
+        streamer->resident_bytes += load_bytes;
+        streamer->loads_in_flight++;
+        streamer->stats.loads++;
+        streamer->stats.bytes_loaded += load_bytes;
+    }
+
+    // One request per texture at most, a texture is never evicted and loaded in the same update
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+        StreamedTexture *t = &streamer->textures[i];
+        if (started_loads[i]) {
+            out_requests[count++] = {i, t->loading_mip, true};
+        } else if (t->is_used && t->resident_mip != start_mips[i]) {
+            out_requests[count++] = {i, t->resident_mip, false};
+        }
+    }
+    return count;
+}
+
+void texture_streamer::complete(TextureStreamer *streamer, uint32_t texture, bool is_loaded) {
+    if (!is_streamed(streamer, texture) || streamer->textures[texture].loading_mip == STREAMER_MIP_NONE) {
+        return;
+    }
+
+    StreamedTexture *t = &streamer->textures[texture];
+    if (is_loaded) {
+        t->resident_mip = t->loading_mip;
+    } else {
+        streamer->resident_bytes -= get_bytes(streamer, texture, t->loading_mip) - get_bytes(streamer, texture, t->resident_mip);
+        streamer->stats.failed_loads++;
+    }
+    t->loading_mip = STREAMER_MIP_NONE;
+    streamer->loads_in_flight--;
+}
+
+uint64_t texture_streamer::get_bytes(const TextureStreamer *streamer, uint32_t texture, uint32_t mip) {
+    const StreamedTexture *t = &streamer->textures[texture];
+    uint64_t bytes = 0;
+    for (uint32_t m = mip; m < t->mip_count; ++m) {
+        bytes += t->mip_bytes[m];
+    }
+    return bytes;
+}
+
+static void evict(TextureStreamer *streamer, uint32_t texture, uint32_t mip) {
+    StreamedTexture *t = &streamer->textures[texture];
+    assert(mip > t->resident_mip && mip <= t->tail_mip && t->loading_mip == STREAMER_MIP_NONE && "texture_streamer::evict: Nothing to evict there");
+
+    uint64_t bytes = texture_streamer::get_bytes(streamer, texture, t->resident_mip) - texture_streamer::get_bytes(streamer, texture, mip);
+    t->resident_mip = (uint8_t)mip;
+    streamer->resident_bytes -= bytes;
+    streamer->stats.evictions++;
+    streamer->stats.bytes_evicted += bytes;
+}
+
+static uint64_t get_excess_bytes(const TextureStreamer *streamer, uint32_t texture) {
+    const StreamedTexture *t = &streamer->textures[texture];
+    if (!t->is_used || t->loading_mip != STREAMER_MIP_NONE || t->resident_mip >= t->wanted_mip) {
+        return 0;
+    }
+    return texture_streamer::get_bytes(streamer, texture, t->resident_mip) - texture_streamer::get_bytes(streamer, texture, t->wanted_mip);
+}
+
+static int32_t find_victim(const TextureStreamer *streamer, uint32_t except, bool is_wanted_evictable) {
+    // Least recently used. Loads in flight are left alone, their mips aren't there yet.
+    int32_t victim = -1;
+    for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+        const StreamedTexture *t = &streamer->textures[i];
+        if (i == except || !t->is_used || t->loading_mip != STREAMER_MIP_NONE) {
+            continue;
+        }
+
+        uint32_t floor_mip = is_wanted_evictable ? t->tail_mip : t->wanted_mip;
+        if (t->resident_mip >= floor_mip) {
+            continue;
+        }
+        // Among the ones last used the same frame, the most detailed goes first
+        const StreamedTexture *best = victim >= 0 ? &streamer->textures[victim] : nullptr;
+        if (!best || t->last_used_frame < best->last_used_frame ||
+            (t->last_used_frame == best->last_used_frame && t->resident_mip < best->resident_mip)) {
+            victim = (int32_t)i;
+        }
+    }
+    return victim;
+}
+
+static int32_t find_load(const TextureStreamer *streamer, const uint8_t *start_mips, const bool *is_tried) {
+    int32_t index = -1;
+    uint32_t best_gap = 0;
+    for (uint32_t i = 0; i < STREAMER_MAX_TEXTURES; ++i) {
+        const StreamedTexture *t = &streamer->textures[i];
+        // Evicted this update means the budget doesn't even hold what's wanted
+        if (!t->is_used || is_tried[i] || t->loading_mip != STREAMER_MIP_NONE || t->resident_mip != start_mips[i] || t->wanted_mip >= t->resident_mip) {
+            continue;
+        }
+
+        uint32_t gap = t->resident_mip - t->wanted_mip;
+        if (gap > best_gap) {
+            best_gap = gap;
+            index = (int32_t)i;
+        }
+    }
+    return index;
+}
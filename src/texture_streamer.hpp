@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+
+// Decides which mips of the streamed textures are on the GPU. Every texture
+// keeps its tail (the small mips) resident, the rest comes and goes: the
+// renderer asks for the mip each visible material needs every frame and
+// update hands back what to load and what to drop. Loads never take the
+// resident bytes over the budget, they first evict mips nobody asked for,
+// least recently used first, and get less detail when that's not enough.
+//
+// Only bookkeeping, no API in here, the caller moves the actual data (see
+// texture::stream). Textures are addressed by their slot.
+#define STREAMER_MAX_TEXTURES 64
+#define STREAMER_MAX_MIPS 16
+#define STREAMER_MIP_NONE 0xFF
+
+struct StreamedTexture {
+    bool is_used;
+    uint8_t mip_count;
+    uint8_t tail_mip;     // This mip and the smaller ones are always resident
+    uint8_t resident_mip; // Most detailed mip on the GPU
+    uint8_t wanted_mip;   // Most detailed mip asked for this frame, tail_mip when nobody did
+    uint8_t loading_mip;  // Being streamed in, STREAMER_MIP_NONE when not
+    uint32_t width;       // Of mip 0
+    uint32_t height;
+    uint64_t last_used_frame;
+    uint64_t mip_bytes[STREAMER_MAX_MIPS];
+};
+
+// One texture's new most detailed mip. Evictions are already counted when
+// they're handed out, loads are counted as soon as they start and have to be
+// finished with complete.
+struct StreamRequest {
+    uint32_t texture;
+    uint32_t mip;
+    bool is_load;
+};
+
+struct TextureStreamerStats {
+    uint64_t wanted_bytes; // Last update, what every texture at its wanted mip would take
+    uint32_t loads;        // Since initialize
+    uint32_t evictions;
+    uint32_t failed_loads;
+    uint32_t clamped_loads; // Got less detail than wanted to stay in the budget
+    uint64_t bytes_loaded;
+    uint64_t bytes_evicted;
+};
+
+struct TextureStreamer {
+    StreamedTexture textures[STREAMER_MAX_TEXTURES];
+    uint64_t budget;
+    uint64_t resident_bytes; // Loads in flight included
+    uint64_t frame;
+    uint32_t max_loads; // In flight at once
+    uint32_t loads_in_flight;
+    TextureStreamerStats stats;
+};
+
+namespace texture_streamer {
+
+void initialize(TextureStreamer *streamer, uint64_t budget, uint32_t max_loads);
+// Lowering it evicts in the next update
+void set_budget(TextureStreamer *streamer, uint64_t budget);
+
+// The texture starts with only its tail resident. mip_bytes has the size of
+// each mip, 0 the full size. The tail always counts, over budget or not.
+bool add(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, const uint64_t *mip_bytes, uint32_t mip_count, uint32_t tail_mip);
+void remove(TextureStreamer *streamer, uint32_t texture);
+bool is_streamed(const TextureStreamer *streamer, uint32_t texture);
+
+// Starts a frame of requests, nothing is wanted past the tails until asked for
+void begin_frame(TextureStreamer *streamer);
+// The texture is seen needing this mip, the most detailed ask of the frame wins
+void request(TextureStreamer *streamer, uint32_t texture, uint32_t mip);
+// The mip whose size matches a texture seen screen_pixels across, the tail
+// for anything smaller. The texture is assumed to be mapped once over it.
+uint32_t footprint_mip(const TextureStreamer *streamer, uint32_t texture, float screen_pixels);
+
+// Evicts and starts loads for this frame's requests, fills out_requests
+// (STREAMER_MAX_TEXTURES fit) and returns how many
+uint32_t update(TextureStreamer *streamer, StreamRequest *out_requests);
+// A load handed out by update finished, the texture is at the mip when it worked
+void complete(TextureStreamer *streamer, uint32_t texture, bool is_loaded);
+
+// Bytes of the texture with mips mip and down resident
+uint64_t get_bytes(const TextureStreamer *streamer, uint32_t texture, uint32_t mip);
+
+} // namespace texture_streamer
@@ -0,0 +1,198 @@
+#include "vfs.hpp"
+
+#include "logger.hpp"
+#include "pack_file.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct MountedPack {
+    PackFile pack;
+    uint8_t *view;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static MountedPack s_mounted = {};
+static std::atomic<uint32_t> s_packed_reads{0};
+static std::atomic<uint32_t> s_loose_reads{0};
+static std::atomic<uint64_t> s_bytes_mapped{0};
+static std::atomic<uint64_t> s_bytes_decompressed{0};
+
+static bool map_file(const char *path, MountedPack *out_mounted);
+static void unmap_file(MountedPack *mounted);
+static bool read_loose(const char *path, Arena *arena, const uint8_t **out_data, size_t *out_size);
+
+bool vfs::mount(const char *pack_path) {
+    assert(pack_path && "vfs::mount: pack_path cannot be NULL");
+
+    unmount();
+    if (!map_file(pack_path, &s_mounted)) {
+        return false;
+    }
+    if (!pack_file::open(&s_mounted.pack, s_mounted.view, s_mounted.size)) {
+        LOG("%s: %s isn't a pack of this version, reading loose files", __func__, pack_path);
+        unmap_file(&s_mounted);
+        return false;
+    }
+
+    s_packed_reads = 0;
+    s_loose_reads = 0;
+    s_bytes_mapped = 0;
+    s_bytes_decompressed = 0;
+    LOG("%s: %s has %u files", __func__, pack_path, s_mounted.pack.header->entry_count);
+    return true;
+}
+
+void vfs::unmount() {
+    if (!is_mounted()) {
+        return;
+    }
+    VfsStats stats = get_stats();
+    LOG("%s: %u reads from the pack (%llu bytes mapped, %llu decompressed), %u loose", __func__, stats.packed_reads,
+        (unsigned long long)stats.bytes_mapped, (unsigned long long)stats.bytes_decompressed, stats.loose_reads);
+    unmap_file(&s_mounted);
+}
+
+bool vfs::is_mounted() {
+    return s_mounted.view != nullptr;
+}
+
+bool vfs::read(const char *path, Arena *arena, const uint8_t **out_data, size_t *out_size) {
+    assert(path && arena && out_data && out_size && "vfs::read: path, arena and outputs cannot be NULL");
+
+    const PackEntry *entry = pack_file::find(&s_mounted.pack, path);
+    if (!entry) {
+        return read_loose(path, arena, out_data, out_size);
+    }
+    if (!pack_file::read(&s_mounted.pack, entry, arena, out_data)) {
+        return false;
+    }
+
+    *out_size = (size_t)entry->size;
+    s_packed_reads++;
+    if (entry->compression == PACK_COMPRESSION_NONE) {
+        s_bytes_mapped += entry->size;
+    } else {
+        s_bytes_decompressed += entry->size;
+    }
+    return true;
+}
+
+bool vfs::stat(const char *path, VfsStat *out_stat) {
+    assert(path && out_stat && "vfs::stat: path and out_stat cannot be NULL");
+
+    const PackEntry *entry = pack_file::find(&s_mounted.pack, path);
+    if (entry) {
+        *out_stat = {entry->size, entry->content_hash, true};
+        return true;
+    }
+
+    std::error_code error;
+    uint64_t size = (uint64_t)std::filesystem::file_size(path, error);
+    if (error) {
+        return false;
+    }
+    int64_t time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (error) {
+        return false;
+    }
+    *out_stat = {size, (uint64_t)time, false};
+    return true;
+}
+
+VfsStats vfs::get_stats() {
+    return {s_packed_reads.load(), s_loose_reads.load(), s_bytes_mapped.load(), s_bytes_decompressed.load()};
+}
+
+static bool map_file(const char *path, MountedPack *out_mounted) {
+    *out_mounted = {};
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size = {};
+    HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        LOG("vfs::mount: Couldn't map %s", path);
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    out_mounted->file = file;
+    out_mounted->mapping = mapping;
+    out_mounted->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info = {};
+    void *view = fstat(fd, &info) == 0 && info.st_size > 0 ? mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    // The mapping keeps the file
+    close(fd);
+    if (view == MAP_FAILED) {
+        LOG("vfs::mount: Couldn't map %s", path);
+        return false;
+    }
+    out_mounted->size = (size_t)info.st_size;
+#endif
+
+    out_mounted->view = (uint8_t *)view;
+    return true;
+}
+
+static void unmap_file(MountedPack *mounted) {
+#ifdef _WIN32
+    UnmapViewOfFile(mounted->view);
+    CloseHandle(mounted->mapping);
+    CloseHandle(mounted->file);
+#else
+    munmap(mounted->view, mounted->size);
+#endif
+    *mounted = {};
+}
+
+static bool read_loose(const char *path, Arena *arena, const uint8_t **out_data, size_t *out_size) {
+    // Not there is for the caller to log, it knows what the file was for
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length >= 0 ? (uint8_t *)arena::push(arena, (size_t)length, ARENA_DEFAULT_ALIGN) : nullptr;
+    bool is_read = data && fread(data, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    if (!is_read) {
+        LOG("vfs::read: Couldn't read %s", path);
+        return false;
+    }
+
+    s_loose_reads++;
+    *out_data = data;
+    *out_size = (size_t)length;
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Where the loaders read their files: from the mounted pack (see pack_file.hpp)
+// when it has them, from disk otherwise. The pack is mapped whole, a file in it
+// costs a binary search and no open, stored files aren't even copied.
+// Mount and unmount on the main thread while nothing loads, reads can come from
+// any thread.
+
+struct VfsStat {
+    uint64_t size;
+    // Changes whenever the contents do: the content hash in the pack, the
+    // modification time on disk
+    uint64_t version;
+    bool is_packed;
+};
+
+struct VfsStats {
+    uint32_t packed_reads; // Since mount
+    uint32_t loose_reads;
+    uint64_t bytes_mapped; // Handed out without a copy
+    uint64_t bytes_decompressed;
+};
+
+namespace vfs {
+
+// False (and every read goes to disk) when the pack isn't there or isn't valid
+bool mount(const char *pack_path);
+void unmount();
+bool is_mounted();
+
+// The whole file, ARENA_DEFAULT_ALIGN aligned so it can be read in place.
+// Stored pack files point into the mapping and stay good until unmount,
+// anything else is pushed on the arena.
+bool read(const char *path, Arena *arena, const uint8_t **out_data, size_t *out_size);
+// False when it's in neither
+bool stat(const char *path, VfsStat *out_stat);
+VfsStats get_stats();
+
+} // namespace vfs
@@ -1,9 +1,7 @@
 #include "window.hpp"
 
-#include "application.hpp"
 #include "input.hpp"
 #include "logger.hpp"
-#include "renderer.hpp"
 
 #include <cassert>
 #include <windows.h>
@@ -106,17 +104,11 @@ static LRESULT CALLBACK winproc(HWND hwnd, UINT msg, WPARAM w_param, LPARAM l_pa
         }
 
         case WM_SIZE: {
+            // NOTE: Only recorded. The size goes out with the next render
+            // snapshot, the renderer resizes its targets on its own thread.
+            // Minimized is 0 by 0, the renderer keeps its size then.
             window->width = LOWORD(l_param);
             window->height = HIWORD(l_param);
-
-            // Notify the Renderer
-            // NOTE: Not resizing if minimized or if width/height is 0.
-            // Also, we are directly notifying it right now, but it could
-            // be done through some event system.
-            Renderer *renderer = application::get_renderer();
-            if (renderer && w_param != SIZE_MINIMIZED && window->width > 0 && window->height > 0) {
-                renderer::on_window_resize(renderer, window->width, window->height);
-            }
             return 0;
         }
 
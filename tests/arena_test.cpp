@@ -0,0 +1,157 @@
+#include "test.hpp"
+
+#include "arena.hpp"
+#include "job_system.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#define TEST_ROUNDS 2000
+#define TEST_MAX_PUSHES 32
+#define TEST_MAX_SIZE 4096
+#define TEST_MAX_ALIGN_SHIFT 7
+#define TEST_FRAMES 64
+#define TEST_FRAME_RESERVE (1024 * 1024)
+#define TEST_THREADS 4
+
+// Too big for the stack
+static JobSystem g_jobs;
+static std::atomic<uint32_t> g_thread_errors;
+
+static uint32_t run_round(Arena *arena, uint32_t round);
+static void thread_rounds(void *data, uint32_t begin, uint32_t end);
+
+void arena_test::run() {
+    // Rounded up to whole commits, nothing committed before the first push
+    Arena arena;
+    if (!CHECK(arena::initialize(&arena, ARENA_COMMIT_SIZE * 3 + 1))) return;
+    CHECK(arena.reserved == ARENA_COMMIT_SIZE * 4 && arena.committed == 0 && arena.offset == 0);
+    uint8_t *first = (uint8_t *)arena::push(&arena, 100, 1);
+    CHECK(first == arena.base && arena.committed == ARENA_COMMIT_SIZE && arena.offset == 100);
+    uint8_t *second = (uint8_t *)arena::push(&arena, ARENA_COMMIT_SIZE, 64);
+    CHECK(second == arena.base + 128 && arena.committed == ARENA_COMMIT_SIZE * 2);
+    memset(first, 1, 100);
+    memset(second, 2, ARENA_COMMIT_SIZE);
+
+    // Rewinding keeps the pages, the next push reuses them
+    ArenaMarker marker = arena::get_marker(&arena);
+    arena::push(&arena, 16, 16);
+    arena::rewind(&arena, marker);
+    CHECK(arena::get_marker(&arena) == marker && arena.committed == ARENA_COMMIT_SIZE * 2);
+    arena::reset(&arena);
+    CHECK(arena::push(&arena, 1, 1) == arena.base && arena.peak == ARENA_COMMIT_SIZE + 128 + 16);
+
+    // Exactly the rest fits, one more byte doesn't and leaves the arena as it was
+    arena::reset(&arena);
+    CHECK(arena::push(&arena, arena.reserved, 1) == arena.base && arena.committed == arena.reserved);
+    arena::reset(&arena);
+    marker = arena::get_marker(&arena);
+    CHECK(arena::push(&arena, arena.reserved + 1, 16) == nullptr && arena.failed == 1 && arena::get_marker(&arena) == marker);
+    // Huge sizes don't wrap around
+    CHECK(arena::push(&arena, SIZE_MAX - 8, 16) == nullptr && arena.failed == 2);
+    arena::shutdown(&arena);
+    CHECK(arena.base == nullptr && arena::push(&arena, 1, 1) == nullptr);
+
+    // Random pushes on the scratch arena, aligned, not overlapping and rewound
+    Arena *scratch = arena::scratch();
+    if (!CHECK(scratch->base != nullptr)) return;
+    uint32_t errors = 0;
+    for (uint32_t round = 0; round < TEST_ROUNDS; ++round) {
+        errors += run_round(scratch, round);
+    }
+    CHECK(errors == 0 && scratch->offset == 0);
+
+    // Each frame fills a block, the one from the frame before has to be untouched
+    FrameArena frame;
+    if (!CHECK(arena::frame_initialize(&frame, TEST_FRAME_RESERVE))) return;
+    uint8_t *previous = nullptr;
+    errors = 0;
+    for (uint32_t f = 0; f < TEST_FRAMES; ++f) {
+        Arena *current = arena::frame_begin(&frame);
+        uint8_t *block = ARENA_PUSH_ARRAY(current, uint8_t, TEST_FRAME_RESERVE / 2);
+        if (!block || current != arena::frame_current(&frame)) {
+            errors++;
+            continue;
+        }
+        memset(block, (int)f & 0xFF, TEST_FRAME_RESERVE / 2);
+        if (previous && (previous[0] != (uint8_t)((f - 1) & 0xFF) || previous[TEST_FRAME_RESERVE / 2 - 1] != (uint8_t)((f - 1) & 0xFF))) {
+            errors++;
+        }
+        previous = block;
+    }
+    CHECK(errors == 0);
+    arena::frame_shutdown(&frame);
+
+    // Every thread has its own scratch, none of them see each other's pushes
+    if (!CHECK(job_system::initialize(&g_jobs, TEST_THREADS))) return;
+    g_thread_errors.store(0);
+    job_system::parallel_for(&g_jobs, TEST_ROUNDS, 16, thread_rounds, nullptr);
+    job_system::shutdown(&g_jobs);
+    CHECK(g_thread_errors.load() == 0);
+
+    // A thread of its own gets another scratch arena
+    uintptr_t other_base = 0;
+    std::thread other([&other_base] { other_base = (uintptr_t)arena::scratch()->base; });
+    other.join();
+    CHECK(other_base != 0 && other_base != (uintptr_t)scratch->base);
+}
+
+// Pushes, fills and checks a random batch, nested marker and all. Returns how many things were off.
+static uint32_t run_round(Arena *arena, uint32_t round) {
+    uint8_t *blocks[TEST_MAX_PUSHES];
+    size_t sizes[TEST_MAX_PUSHES];
+    uint32_t errors = 0;
+
+    ArenaMarker marker = arena::get_marker(arena);
+    uint32_t rng = round * 2654435761u + 1;
+    uint32_t count = 1 + test::next_random(&rng) % TEST_MAX_PUSHES;
+    ArenaMarker inner = marker;
+    for (uint32_t i = 0; i < count; ++i) {
+        sizes[i] = 1 + test::next_random(&rng) % TEST_MAX_SIZE;
+        size_t align = (size_t)1 << (test::next_random(&rng) % TEST_MAX_ALIGN_SHIFT);
+        if (i == count / 2) {
+            inner = arena::get_marker(arena);
+        }
+        blocks[i] = (uint8_t *)arena::push(arena, sizes[i], align);
+        if (!blocks[i] || ((uintptr_t)blocks[i] & (align - 1)) != 0) {
+            errors++;
+            blocks[i] = nullptr;
+            continue;
+        }
+        memset(blocks[i], (int)(round + i) & 0xFF, sizes[i]);
+    }
+
+    // Something overlapping shows up as another block's fill
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!blocks[i]) {
+            continue;
+        }
+        uint8_t fill = (uint8_t)((round + i) & 0xFF);
+        if (blocks[i][0] != fill || blocks[i][sizes[i] - 1] != fill) {
+            errors++;
+        }
+    }
+
+    // The second half goes first, the next push lands where it started
+    arena::rewind(arena, inner);
+    void *again = arena::push(arena, 1, 1);
+    if (count > 1 && again != (void *)(arena->base + inner)) {
+        errors++;
+    }
+    arena::rewind(arena, marker);
+    errors += arena::get_marker(arena) != marker;
+    return errors;
+}
+
+static void thread_rounds(void *, uint32_t begin, uint32_t end) {
+    Arena *scratch = arena::scratch();
+    uint32_t errors = 0;
+    for (uint32_t round = begin; round < end; ++round) {
+        errors += run_round(scratch, round);
+    }
+    if (errors > 0) {
+        g_thread_errors.fetch_add(errors);
+    }
+}
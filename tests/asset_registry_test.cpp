@@ -0,0 +1,238 @@
+#include "test.hpp"
+
+#include "asset_registry.hpp"
+#include "async.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#define TEST_REFERENCES 20000
+#define TEST_TEXTURES 40
+#define TEST_MESHES 20
+#define TEST_SPELLINGS 4
+// Slots of the fake loader, per type, every file as sRGB and linear fits
+#define TEST_SLOTS (TEST_TEXTURES * 2)
+
+struct PathCase {
+    const char *path;
+    const char *normalized;
+};
+
+struct HashCase {
+    const char *data;
+    size_t size;
+    uint64_t seed;
+    uint64_t hash;
+};
+
+// Stands in for texture::load_async and mesh::load_async, counts what's read
+struct FakeLoader {
+    bool is_alive[2][TEST_SLOTS];
+    uint8_t generations[2][TEST_SLOTS];
+    uint32_t slot_files[2][TEST_SLOTS]; // Which file and flags went in the slot
+    uint32_t loads[2][TEST_TEXTURES * 2];
+    uint32_t frees;
+};
+
+struct Reference {
+    AssetType type;
+    uint32_t file; // File index * 2 + sRGB, meshes are never sRGB
+    Id id;
+};
+
+static const PathCase s_path_cases[] = {
+    {"assets/brick.png", "assets/brick.png"},
+    {"./assets/brick.png", "assets/brick.png"},
+    {"Assets\\Brick.PNG", "assets/brick.png"},
+    {"assets//maps/./../brick.png", "assets/brick.png"},
+    {"assets/brick.png/", "assets/brick.png"},
+    {"../shared/rock.gltf", "../shared/rock.gltf"},
+    {"a/../../b/./../c", "../c"},
+    {"/abs/../root.png", "/root.png"},
+    {"/../x", "/x"},
+    {"C:\\Assets\\..\\..\\x.png", "c:/x.png"},
+    {"a/..", "."},
+    {"", "."},
+};
+
+// Same as xxHash64's reference
+static const HashCase s_hash_cases[] = {
+    {"", 0, 0, 0xEF46DB3751D8E999ull},
+    {"abc", 3, 0, 0x44BC2CF5AD770999ull},
+    {"abc", 3, 1, 0xBEA9CA8199328908ull},
+};
+
+// Too big for the stack
+static AssetRegistry g_registry;
+static FakeLoader g_loader;
+static Reference g_refs[TEST_REFERENCES];
+
+static void check_content();
+static void check_references();
+static Id fake_load(FakeLoader *loader, AssetType type, uint32_t file);
+static void make_path(AssetType type, uint32_t file, uint32_t spelling, char *out_path, size_t out_size);
+
+void asset_registry_test::run() {
+    for (uint32_t i = 0; i < sizeof(s_path_cases) / sizeof(s_path_cases[0]); ++i) {
+        char normalized[ASSET_PATH_MAX];
+        CHECK(asset_registry::normalize_path(s_path_cases[i].path, normalized, sizeof(normalized)) && strcmp(normalized, s_path_cases[i].normalized) == 0);
+    }
+    // Exactly filling it works, one more doesn't
+    char tight[8];
+    CHECK(!asset_registry::normalize_path("./ab/cdefg", tight, sizeof(tight)));
+    CHECK(asset_registry::normalize_path("./ab/cdef", tight, sizeof(tight)) && strcmp(tight, "ab/cdef") == 0);
+
+    for (uint32_t i = 0; i < sizeof(s_hash_cases) / sizeof(s_hash_cases[0]); ++i) {
+        const HashCase *c = &s_hash_cases[i];
+        CHECK(asset_registry::hash_bytes(c->seed, c->data, c->size) == c->hash);
+    }
+    // Every tail length past a stripe or two, 0..99 as bytes hashes to xxHash64's
+    uint8_t bytes[100];
+    for (uint32_t i = 0; i < sizeof(bytes); ++i) {
+        bytes[i] = (uint8_t)i;
+    }
+    CHECK(asset_registry::hash_bytes(0, bytes, sizeof(bytes)) == 0x6AC1E58032166597ull);
+
+    check_content();
+    check_references();
+}
+
+static void check_content() {
+    // Two copies of a file under different names and a third with one byte off
+    char dir[512];
+    if (!CHECK(test::make_temp_dir("asset_registry", dir, sizeof(dir)))) return;
+    char paths[3][ASSET_PATH_MAX];
+    uint8_t data[3000];
+    for (uint32_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    for (uint32_t f = 0; f < 3; ++f) {
+        snprintf(paths[f], sizeof(paths[f]), "%s/copy_%u.bin", dir, f);
+        data[sizeof(data) - 1] = f == 2 ? 1 : 0;
+        if (!CHECK(test::write_file(paths[f], data, sizeof(data)))) return;
+    }
+
+    AssetRegistry *registry = &g_registry;
+    asset_registry::initialize(registry, true);
+    Id ids[3] = {{0, 0}, {1, 0}, {2, 0}};
+    Id got[4] = {};
+    for (uint32_t f = 0; f < 4; ++f) {
+        // The last one is the first file again, known by its path it isn't read
+        uint32_t file = f % 3;
+        AssetKey key;
+        AssetLoad load;
+        if (!CHECK(asset_registry::make_key(registry, ASSET_TEXTURE, 0, paths[file], &key))) continue;
+        if (!asset_registry::acquire(registry, &key, &load)) {
+            load = async::finished(ids[file]);
+            CHECK(asset_registry::add(registry, &key, load));
+        }
+        got[f] = load.id;
+    }
+
+    CHECK(id::is_fresh(got[0], ids[0]) && id::is_fresh(got[1], ids[0]) && id::is_fresh(got[2], ids[2]) && id::is_fresh(got[3], ids[0]));
+    CHECK(registry->stats.content_hits == 1 && registry->stats.path_hits == 1 && registry->stats.bytes_hashed == 3 * sizeof(data));
+    CHECK(asset_registry::get_refcount(registry, ASSET_TEXTURE, ids[0]) == 3);
+
+    // The copies share it, it goes with the last of the three
+    CHECK(!asset_registry::release(registry, ASSET_TEXTURE, ids[0]));
+    CHECK(!asset_registry::release(registry, ASSET_TEXTURE, ids[0]));
+    CHECK(asset_registry::release(registry, ASSET_TEXTURE, ids[0]));
+    CHECK(asset_registry::release(registry, ASSET_TEXTURE, ids[2]) && registry->count == 0);
+}
+
+// A scene's worth of references, a few dozen files each spelled several ways
+// and as sRGB and linear. Every file is loaded once and freed with its last
+// reference.
+static void check_references() {
+    AssetRegistry *registry = &g_registry;
+    FakeLoader *loader = &g_loader;
+    asset_registry::initialize(registry, false);
+    *loader = {};
+
+    // What deserialize_config does for every texture and mesh of the scene
+    uint32_t rng = 0xa55e7;
+    for (uint32_t i = 0; i < TEST_REFERENCES; ++i) {
+        Reference *ref = &g_refs[i];
+        ref->type = test::next_random(&rng) % 3 == 0 ? ASSET_MESH : ASSET_TEXTURE;
+        uint32_t file_count = ref->type == ASSET_MESH ? TEST_MESHES : TEST_TEXTURES;
+        bool is_srgb = ref->type == ASSET_TEXTURE && test::next_random(&rng) % 2 == 0;
+        ref->file = (test::next_random(&rng) % file_count) * 2 + (is_srgb ? 1 : 0);
+
+        char path[ASSET_PATH_MAX];
+        make_path(ref->type, ref->file / 2, test::next_random(&rng) % TEST_SPELLINGS, path, sizeof(path));
+        AssetKey key;
+        AssetLoad load;
+        if (!CHECK(asset_registry::make_key(registry, ref->type, is_srgb ? ASSET_FLAG_SRGB : 0, path, &key))) return;
+        if (!asset_registry::acquire(registry, &key, &load)) {
+            load = async::finished(fake_load(loader, ref->type, ref->file));
+            CHECK(asset_registry::add(registry, &key, load));
+        }
+        ref->id = load.id;
+        if (!CHECK(!id::is_invalid(ref->id) && loader->is_alive[ref->type][ref->id.id] && loader->slot_files[ref->type][ref->id.id] == ref->file)) return;
+    }
+
+    uint32_t loads = 0;
+    for (uint32_t type = 0; type < 2; ++type) {
+        for (uint32_t file = 0; file < TEST_TEXTURES * 2; ++file) {
+            CHECK(loader->loads[type][file] <= 1);
+            loads += loader->loads[type][file];
+        }
+    }
+    // Every mesh and both flavours of every texture, odds are all of them came up
+    CHECK(loads == TEST_MESHES + TEST_TEXTURES * 2 && registry->count == loads);
+
+    // Back to front in a shuffled order, each is freed with its last reference
+    for (uint32_t i = TEST_REFERENCES; i > 1; --i) {
+        uint32_t j = test::next_random(&rng) % i;
+        Reference swap = g_refs[i - 1];
+        g_refs[i - 1] = g_refs[j];
+        g_refs[j] = swap;
+    }
+    for (uint32_t i = 0; i < TEST_REFERENCES; ++i) {
+        Reference *ref = &g_refs[i];
+        uint32_t before = asset_registry::get_refcount(registry, ref->type, ref->id);
+        bool is_last = asset_registry::release(registry, ref->type, ref->id);
+        if (!CHECK(before > 0 && is_last == (before == 1))) return;
+        if (is_last) {
+            loader->is_alive[ref->type][ref->id.id] = false;
+            loader->generations[ref->type][ref->id.id]++;
+            loader->frees++;
+        }
+    }
+    CHECK(registry->count == 0 && loader->frees == loads);
+
+    // Never loaded through the registry, the caller frees it
+    CHECK(asset_registry::release(registry, ASSET_TEXTURE, Id{3, 9}));
+}
+
+static Id fake_load(FakeLoader *loader, AssetType type, uint32_t file) {
+    for (uint8_t slot = 0; slot < TEST_SLOTS; ++slot) {
+        if (!loader->is_alive[type][slot]) {
+            loader->is_alive[type][slot] = true;
+            loader->slot_files[type][slot] = file;
+            loader->loads[type][file]++;
+            return {slot, loader->generations[type][slot]};
+        }
+    }
+    return id::invalid();
+}
+
+static void make_path(AssetType type, uint32_t file, uint32_t spelling, char *out_path, size_t out_size) {
+    const char *name = type == ASSET_MESH ? "mesh" : "map";
+    const char *extension = type == ASSET_MESH ? "gltf" : "png";
+    switch (spelling) {
+        case 0:
+            snprintf(out_path, out_size, "assets/%s_%u.%s", name, file, extension);
+            break;
+        case 1:
+            snprintf(out_path, out_size, "./assets/%s_%u.%s", name, file, extension);
+            break;
+        case 2:
+            snprintf(out_path, out_size, "Assets\\%s_%u.%s", name, file, extension);
+            break;
+        default:
+            snprintf(out_path, out_size, "assets/maps/../%s_%u.%s", name, file, extension);
+            break;
+    }
+}
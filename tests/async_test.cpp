@@ -0,0 +1,136 @@
+#include "test.hpp"
+
+#include "async.hpp"
+#include "id.hpp"
+#include "job_system.hpp"
+
+#include <cstdint>
+
+#define TEST_LOADS 512
+#define TEST_WORKERS 3
+// Rounds of busy work per fake decode, enough that loads overlap
+#define TEST_DECODE_ROUNDS 2000
+
+// Too big for the stack
+static JobSystem g_jobs;
+static AsyncScheduler g_scheduler;
+static uint64_t g_results[TEST_LOADS]; // 0 is the placeholder, the upload fills it in
+static uint32_t g_main_misses;         // Main thread parts that ran elsewhere
+static uint32_t g_early_wakeups;       // Waiters resumed before their result was in
+static uint32_t g_waiters_done;
+
+static AsyncTask load_task(AssetLoad load, uint32_t index);
+static AsyncTask wait_task(AssetLoad load, uint32_t index);
+static AsyncTask wait_flag_task(AssetLoad load, bool *done);
+static uint64_t decode(uint32_t index);
+
+void async_test::run() {
+    if (!CHECK(job_system::initialize(&g_jobs, TEST_WORKERS))) return;
+    async::initialize(&g_scheduler, &g_jobs);
+
+    // A load that's done already doesn't suspend the waiter
+    Id id = {3, 1};
+    AssetLoad done = async::finished(id);
+    bool resumed = false;
+    CHECK(async::is_done(&done));
+    wait_flag_task(done, &resumed);
+    CHECK(resumed);
+
+    // The waiter only goes on once the load is ended and the main thread
+    // jobs run, the loader is still on the stack when it ends the load
+    AssetLoad load = async::begin_load(&g_scheduler, id);
+    CHECK(!async::is_done(&load) && load.id.id == id.id && g_scheduler.loads_in_flight == 1);
+    resumed = false;
+    wait_flag_task(load, &resumed);
+    job_system::run_main_jobs(&g_jobs);
+    CHECK(!resumed);
+    async::end_load(&g_scheduler, &load);
+    CHECK(async::is_done(&load) && !resumed);
+    CHECK(job_system::run_main_jobs(&g_jobs) == 1 && resumed);
+    // The slot goes to the next load, the old one stays done
+    AssetLoad next = async::begin_load(&g_scheduler, id);
+    CHECK(next.slot == load.slot && async::is_done(&load) && !async::is_done(&next));
+    async::end_load(&g_scheduler, &next);
+
+    // No room once ASYNC_MAX_LOADS are in flight
+    AssetLoad loads[ASYNC_MAX_LOADS];
+    for (uint32_t i = 0; i < ASYNC_MAX_LOADS; ++i) {
+        CHECK(async::has_room(&g_scheduler));
+        loads[i] = async::begin_load(&g_scheduler, id);
+    }
+    CHECK(!async::has_room(&g_scheduler));
+    for (uint32_t i = 0; i < ASYNC_MAX_LOADS; ++i) {
+        async::end_load(&g_scheduler, &loads[i]);
+    }
+    CHECK(async::has_room(&g_scheduler) && g_scheduler.loads_in_flight == 0);
+    CHECK(g_scheduler.loads_started == g_scheduler.loads_finished && g_scheduler.loads_finished == ASYNC_MAX_LOADS + 2);
+
+    // Fake loads, the decode on the workers and the upload on the main thread,
+    // with a second coroutine waiting on each. Same results as decoding in place.
+    async::initialize(&g_scheduler, &g_jobs);
+    uint64_t blocking_sum = 0;
+    for (uint32_t i = 0; i < TEST_LOADS; ++i) {
+        blocking_sum += decode(i);
+    }
+    for (uint32_t i = 0; i < TEST_LOADS; ++i) {
+        while (!async::has_room(&g_scheduler)) {
+            job_system::run_main_jobs(&g_jobs);
+        }
+        AssetLoad asset = async::begin_load(&g_scheduler, {(uint8_t)(i % INVALID_ID), 0});
+        load_task(asset, i);
+        wait_task(asset, i);
+    }
+    async::wait_idle(&g_scheduler);
+
+    uint64_t async_sum = 0;
+    for (uint32_t i = 0; i < TEST_LOADS; ++i) {
+        async_sum += g_results[i];
+    }
+    CHECK(async_sum == blocking_sum);
+    CHECK(g_main_misses == 0);
+    CHECK(g_early_wakeups == 0 && g_waiters_done == TEST_LOADS);
+    CHECK(g_scheduler.loads_finished == TEST_LOADS && g_scheduler.loads_in_flight == 0);
+
+    job_system::shutdown(&g_jobs);
+}
+
+static AsyncTask load_task(AssetLoad load, uint32_t index) {
+    co_await async::to_worker(&g_scheduler);
+
+    uint64_t result = decode(index);
+
+    co_await async::to_main(&g_scheduler);
+
+    if (!job_system::is_main_thread(&g_jobs)) {
+        g_main_misses++;
+    }
+    g_results[index] = result;
+    async::end_load(&g_scheduler, &load);
+}
+
+static AsyncTask wait_task(AssetLoad load, uint32_t index) {
+    co_await load;
+
+    if (g_results[index] == 0 || !job_system::is_main_thread(&g_jobs)) {
+        g_early_wakeups++;
+    }
+    g_waiters_done++;
+}
+
+static AsyncTask wait_flag_task(AssetLoad load, bool *done) {
+    co_await load;
+    *done = true;
+}
+
+static uint64_t decode(uint32_t index) {
+    // splitmix64 chain, never 0 in practice and different per index
+    uint64_t x = index + 1;
+    for (uint32_t i = 0; i < TEST_DECODE_ROUNDS; ++i) {
+        x += 0x9E3779B97F4A7C15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        x ^= z ^ (z >> 31);
+    }
+    return x | 1;
+}
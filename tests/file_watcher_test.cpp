@@ -0,0 +1,161 @@
+#include "test.hpp"
+
+#include "file_watcher.hpp"
+#include "shader_cache.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+// Polls for up to a second, the Windows backend reports a little later
+#define TEST_POLLS 200
+#define TEST_POLL_SLEEP_MS 5
+
+struct NormalizeCase {
+    const char *path;
+    const char *expected;
+};
+
+static const NormalizeCase s_normalize_cases[] = {
+    {"src/shaders/gbuffer.ps.hlsl", "src/shaders/gbuffer.ps.hlsl"},
+    {"src\\shaders\\gbuffer.ps.hlsl", "src/shaders/gbuffer.ps.hlsl"},
+    {"./src//shaders/./common.hlsli", "src/shaders/common.hlsli"},
+    {"src/shaders/lib/../common.hlsli", "src/shaders/common.hlsli"},
+    {"src/shaders/", "src/shaders"},
+    {"/tmp/a/../b", "/tmp/b"},
+    {"\\tmp\\b", "/tmp/b"},
+    // Nothing left to go up from, the ".." stays
+    {"../assets/a.bin", "../assets/a.bin"},
+    {"a/../../b", "../b"},
+    {"a/..", ""},
+    {".", ""},
+    {"", ""},
+};
+
+static bool write_text(const char *dir, const char *name, const char *text);
+static bool poll_for(FileWatcher *watcher, const char *dir, const char *name);
+
+void file_watcher_test::run() {
+    char normalized[FILE_WATCHER_PATH_MAX];
+    for (const NormalizeCase &expected : s_normalize_cases) {
+        file_watcher::normalize_path(expected.path, normalized, sizeof(normalized));
+        CHECK(strcmp(normalized, expected.expected) == 0);
+    }
+#ifdef _WIN32
+    file_watcher::normalize_path("Src\\Shaders\\PBR.hlsl", normalized, sizeof(normalized));
+    CHECK(strcmp(normalized, "src/shaders/pbr.hlsl") == 0);
+#else
+    file_watcher::normalize_path("Src/Shaders/PBR.hlsl", normalized, sizeof(normalized));
+    CHECK(strcmp(normalized, "Src/Shaders/PBR.hlsl") == 0);
+#endif
+    // Cut off, but always terminated
+    char small[8];
+    file_watcher::normalize_path("src/shaders/gbuffer.ps.hlsl", small, sizeof(small));
+    CHECK(strcmp(small, "src/sha") == 0);
+
+    char dir[FILE_WATCHER_PATH_MAX];
+    if (!CHECK(test::make_temp_dir("file_watcher", dir, sizeof(dir)))) return;
+    char lib_dir[FILE_WATCHER_PATH_MAX];
+    snprintf(lib_dir, sizeof(lib_dir), "%s/lib", dir);
+    std::error_code error;
+    if (!CHECK(std::filesystem::create_directory(lib_dir, error))) return;
+
+    // main.hlsl pulls in shared.hlsli through lib/, so the include is
+    // recorded as "lib/../shared.hlsli" and has to match what the watcher says
+    CHECK(write_text(dir, "main.hlsl", "#include \"lib/common.hlsli\"\nfloat4 main() : SV_Target { return color(); }\n"));
+    CHECK(write_text(dir, "lib/common.hlsli", "#include \"../shared.hlsli\"\nfloat4 color() { return SHARED; }\n"));
+    CHECK(write_text(dir, "shared.hlsli", "#define SHARED float4(1, 0, 0, 1)\n"));
+    CHECK(write_text(dir, "other.hlsl", "float4 main() : SV_Target { return 0; }\n"));
+
+    char main_path[FILE_WATCHER_PATH_MAX];
+    char other_path[FILE_WATCHER_PATH_MAX];
+    snprintf(main_path, sizeof(main_path), "%s/main.hlsl", dir);
+    snprintf(other_path, sizeof(other_path), "%s/other.hlsl", dir);
+    ShaderSource main_source;
+    ShaderSource other_source;
+    if (!CHECK(shader_cache::resolve_source(main_path, &main_source))) return;
+    if (!CHECK(shader_cache::resolve_source(other_path, &other_source))) return;
+
+    uint64_t main_dependencies[MAX_SHADER_INCLUDES + 1];
+    uint64_t other_dependencies[MAX_SHADER_INCLUDES + 1];
+    uint32_t main_count = shader_cache::get_dependencies(main_path, &main_source, main_dependencies, MAX_SHADER_INCLUDES + 1);
+    uint32_t other_count = shader_cache::get_dependencies(other_path, &other_source, other_dependencies, MAX_SHADER_INCLUDES + 1);
+    CHECK(main_count == 3 && other_count == 1);
+    // Only as many as fit, the file itself first
+    uint64_t first_only;
+    CHECK(shader_cache::get_dependencies(main_path, &main_source, &first_only, 1) == 1 && first_only == main_dependencies[0]);
+    // A file that couldn't be resolved still depends on itself
+    CHECK(shader_cache::get_dependencies(main_path, nullptr, &first_only, 1) == 1 && first_only == main_dependencies[0]);
+    shader_cache::free_source(&main_source);
+    shader_cache::free_source(&other_source);
+
+    // Changed paths as the watcher reports them map to the modules that use them
+    char changed[FILE_WATCHER_PATH_MAX];
+    snprintf(changed, sizeof(changed), "%s/shared.hlsli", dir);
+    uint64_t shared_hash = shader_cache::hash_path(changed);
+    CHECK(shader_cache::depends_on(main_dependencies, main_count, shared_hash));
+    CHECK(!shader_cache::depends_on(other_dependencies, other_count, shared_hash));
+    snprintf(changed, sizeof(changed), "%s\\lib\\.\\common.hlsli", dir);
+    uint64_t common_hash = shader_cache::hash_path(changed);
+    CHECK(shader_cache::depends_on(main_dependencies, main_count, common_hash));
+    CHECK(!shader_cache::depends_on(other_dependencies, other_count, common_hash));
+    snprintf(changed, sizeof(changed), "%s/lib/../other.hlsl", dir);
+    uint64_t other_hash = shader_cache::hash_path(changed);
+    CHECK(!shader_cache::depends_on(main_dependencies, main_count, other_hash));
+    CHECK(shader_cache::depends_on(other_dependencies, other_count, other_hash));
+    snprintf(changed, sizeof(changed), "%s/unrelated.hlsli", dir);
+    uint64_t unrelated_hash = shader_cache::hash_path(changed);
+    CHECK(!shader_cache::depends_on(main_dependencies, main_count, unrelated_hash) && !shader_cache::depends_on(other_dependencies, other_count, unrelated_hash));
+
+    // Writes below the watched directory are reported too, with the
+    // subdirectory in the path
+    FileWatcher watcher;
+    if (!CHECK(file_watcher::initialize(&watcher, dir))) return;
+    CHECK(write_text(dir, "shared.hlsli", "#define SHARED float4(0, 1, 0, 1)\n"));
+    CHECK(poll_for(&watcher, dir, "shared.hlsli"));
+    CHECK(write_text(dir, "lib/common.hlsli", "#include \"../shared.hlsli\"\nfloat4 color() { return SHARED * 2; }\n"));
+    CHECK(poll_for(&watcher, dir, "lib/common.hlsli"));
+
+    // A directory made after initialize is watched once it showed up in a poll
+    char new_dir[FILE_WATCHER_PATH_MAX];
+    snprintf(new_dir, sizeof(new_dir), "%s/lib/new", dir);
+    CHECK(std::filesystem::create_directory(new_dir, error));
+    char none[1][FILE_WATCHER_PATH_MAX];
+    for (uint32_t i = 0; i < 10; ++i) {
+        file_watcher::poll(&watcher, none, 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(TEST_POLL_SLEEP_MS));
+    }
+    CHECK(write_text(dir, "lib/new/late.hlsli", "#define LATE 1\n"));
+    CHECK(poll_for(&watcher, dir, "lib/new/late.hlsli"));
+    file_watcher::shutdown(&watcher);
+    CHECK(!watcher.active && file_watcher::poll(&watcher, none, 1) == 0);
+}
+
+static bool write_text(const char *dir, const char *name, const char *text) {
+    char path[FILE_WATCHER_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return test::write_file(path, text, strlen(text));
+}
+
+// True once a poll reported dir/name
+static bool poll_for(FileWatcher *watcher, const char *dir, const char *name) {
+    char joined[FILE_WATCHER_PATH_MAX];
+    snprintf(joined, sizeof(joined), "%s/%s", dir, name);
+    char expected[FILE_WATCHER_PATH_MAX];
+    file_watcher::normalize_path(joined, expected, sizeof(expected));
+
+    char changed[8][FILE_WATCHER_PATH_MAX];
+    for (uint32_t i = 0; i < TEST_POLLS; ++i) {
+        uint32_t count = file_watcher::poll(watcher, changed, 8);
+        for (uint32_t j = 0; j < count; ++j) {
+            if (strcmp(changed[j], expected) == 0) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TEST_POLL_SLEEP_MS));
+    }
+    return false;
+}
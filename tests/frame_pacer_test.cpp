@@ -0,0 +1,156 @@
+#include "test.hpp"
+
+#include "frame_pacer.hpp"
+
+#include <cstdint>
+
+#define TEST_STEP (1.0f / 60.0f)
+#define TEST_FRAMES 2000
+// Frame number the hitch case stalls at, and for how long
+#define TEST_HITCH_FRAME 10
+#define TEST_HITCH_NS 500000000ull
+
+// Time only moves when a frame's cost or the limiter moves it
+struct FakeClock {
+    uint64_t now_ns;
+};
+
+struct PacingCase {
+    const char *name;
+    float max_fps;
+    uint64_t frame_ns;  // What a frame costs before the limiter
+    uint64_t jitter_ns; // Up to this much more, varying per frame
+    bool has_hitch;
+};
+
+static const PacingCase s_cases[] = {
+    {"120 Hz frames", 0.0f, 8333333, 0, false},
+    {"30 Hz frames", 0.0f, 33333333, 0, false},
+    {"uneven, limited to 60", 60.0f, 9000000, 6000000, false},
+    {"uneven over the limit", 60.0f, 15000000, 6000000, false},
+    {"hitch", 0.0f, 16666666, 0, true},
+};
+
+static void run_case(const PacingCase *test, PacerStats *out_stats);
+static uint64_t fake_now(void *user_data);
+static void fake_sleep_until(void *user_data, uint64_t deadline_ns);
+static uint64_t frame_cost(const PacingCase *test, uint32_t frame);
+static bool stats_equal(const PacerStats *a, const PacerStats *b);
+
+void frame_pacer_test::run() {
+    // The first frame gets one step, after that it's whole steps with the
+    // rest carried over as alpha. An eighth of a second is exact in a float.
+    FakeClock clock = {1000000000ull};
+    FramePacer pacer;
+    frame_pacer::initialize(&pacer, {fake_now, fake_sleep_until, &clock}, 0.125f, 0.0f, 4);
+    CHECK(pacer.step_ns == 125000000);
+    CHECK(frame_pacer::begin_frame(&pacer) == 1 && frame_pacer::get_alpha(&pacer) == 0.0f);
+    clock.now_ns += 312500000;
+    CHECK(frame_pacer::begin_frame(&pacer) == 2 && frame_pacer::get_alpha(&pacer) == 0.5f);
+    clock.now_ns += 62500000;
+    CHECK(frame_pacer::begin_frame(&pacer) == 1 && frame_pacer::get_alpha(&pacer) == 0.0f);
+    clock.now_ns += 37500000;
+    CHECK(frame_pacer::begin_frame(&pacer) == 0 && pacer.stats.dropped_ns == 0);
+    // Six steps and a half, past max_steps only the half is kept
+    clock.now_ns += 775000000;
+    CHECK(frame_pacer::begin_frame(&pacer) == 4 && pacer.stats.dropped_ns == 250000000 && frame_pacer::get_alpha(&pacer) == 0.5f);
+    CHECK(pacer.stats.frames == 5 && pacer.stats.steps == 8 && pacer.stats.max_steps_per_frame == 4);
+
+    for (const PacingCase &test : s_cases) {
+        // Twice over, the fake clock has to make it come out exactly the same
+        PacerStats first;
+        PacerStats second;
+        run_case(&test, &first);
+        run_case(&test, &second);
+        CHECK(stats_equal(&first, &second));
+    }
+}
+
+static void run_case(const PacingCase *test, PacerStats *out_stats) {
+    FakeClock clock = {1000000000ull};
+    FramePacer pacer;
+    frame_pacer::initialize(&pacer, {fake_now, fake_sleep_until, &clock}, TEST_STEP, test->max_fps, 0);
+
+    uint64_t first_begin_ns = 0;
+    uint64_t last_begin_ns = 0;
+    uint64_t previous_begin_ns = 0;
+    uint32_t early_frames = 0;
+    uint32_t bad_alphas = 0;
+    for (uint32_t frame = 0; frame < TEST_FRAMES; ++frame) {
+        frame_pacer::begin_frame(&pacer);
+        last_begin_ns = clock.now_ns;
+        if (frame == 0) {
+            first_begin_ns = clock.now_ns;
+        } else if (pacer.min_frame_ns > 0 && last_begin_ns - previous_begin_ns < pacer.min_frame_ns) {
+            early_frames++;
+        }
+        previous_begin_ns = last_begin_ns;
+
+        float alpha = frame_pacer::get_alpha(&pacer);
+        if (alpha < 0.0f || alpha >= 1.0f) {
+            bad_alphas++;
+        }
+
+        clock.now_ns += frame_cost(test, frame);
+        frame_pacer::end_frame(&pacer);
+    }
+
+    // Every nanosecond since the first frame (and the step it starts with) is
+    // either simulated, still in the accumulator or dropped
+    const PacerStats *stats = &pacer.stats;
+    uint64_t accounted = stats->steps * pacer.step_ns + pacer.accumulator_ns + stats->dropped_ns;
+    uint64_t elapsed = pacer.step_ns + (last_begin_ns - first_begin_ns);
+    CHECK(accounted == elapsed);
+    CHECK(bad_alphas == 0);
+    // The limiter never lets a frame begin early
+    CHECK(early_frames == 0);
+    CHECK(stats->frames == TEST_FRAMES && stats->max_steps_per_frame <= pacer.max_steps);
+
+    // Only the hitch runs past max_steps, and it's cut off there
+    if (test->has_hitch) {
+        CHECK(stats->dropped_ns > 0 && stats->max_steps_per_frame == pacer.max_steps);
+    } else {
+        CHECK(stats->dropped_ns == 0);
+    }
+    // Limited frames that finish early are waited out, the slower ones aren't
+    if (test->max_fps > 0.0f && test->frame_ns < pacer.min_frame_ns) {
+        CHECK(stats->limiter_ns > 0);
+    } else if (test->max_fps == 0.0f) {
+        CHECK(stats->limiter_ns == 0);
+    }
+
+    *out_stats = *stats;
+}
+
+static uint64_t fake_now(void *user_data) {
+    return ((FakeClock *)user_data)->now_ns;
+}
+
+static void fake_sleep_until(void *user_data, uint64_t deadline_ns) {
+    FakeClock *clock = (FakeClock *)user_data;
+    if (clock->now_ns < deadline_ns) {
+        clock->now_ns = deadline_ns;
+    }
+}
+
+static uint64_t frame_cost(const PacingCase *test, uint32_t frame) {
+    uint64_t cost = test->frame_ns;
+    if (test->jitter_ns > 0) {
+        // Same sequence every run
+        uint32_t x = (frame + 1) * 2654435761u;
+        x ^= x >> 15;
+        cost += x % test->jitter_ns;
+    }
+    if (test->has_hitch && frame == TEST_HITCH_FRAME) {
+        cost += TEST_HITCH_NS;
+    }
+    return cost;
+}
+
+static bool stats_equal(const PacerStats *a, const PacerStats *b) {
+    // Field by field, the padding isn't
+    return a->frames == b->frames && a->steps == b->steps && a->max_steps_per_frame == b->max_steps_per_frame &&
+           a->dropped_ns == b->dropped_ns && a->limiter_ns == b->limiter_ns && a->intervals == b->intervals &&
+           a->interval_sum_ns == b->interval_sum_ns && a->interval_sq_sum_ms == b->interval_sq_sum_ms &&
+           a->interval_max_ns == b->interval_max_ns;
+}
@@ -0,0 +1,211 @@
+#include "test.hpp"
+
+#include "job_system.hpp"
+
+#include <cstdint>
+#include <thread>
+
+// More than a deque or a job pool holds, so submitting also runs jobs inline
+// and waits for pool slots
+#define TEST_JOBS 5000
+#define TEST_ROOTS 16
+#define TEST_MAIN_HOPS 256
+// Rounds of busy work per job, enough that the workers steal from each other
+#define TEST_ROUNDS 200
+
+struct TestItem {
+    uint32_t index;
+};
+
+// Too big for the stack
+static JobSystem g_system;
+static TestItem g_items[TEST_JOBS];
+static JobDecl g_stage_jobs[TEST_JOBS];
+static uint64_t g_expected[TEST_JOBS];
+static uint64_t g_batched[TEST_JOBS];
+static uint64_t g_nested[TEST_JOBS];
+static uint64_t g_first[TEST_JOBS];
+static uint64_t g_second[TEST_JOBS]; // Reads g_first, so only right when run_after waited
+static uint32_t g_main_hops;         // Main thread only, no need for atomics
+static uint32_t g_main_misses;
+
+static bool run_all();
+static void handover_thread(bool *ok);
+static void batch_job(void *data, uint32_t begin, uint32_t end);
+static void root_job(void *data);
+static void nested_job(void *data);
+static void first_job(void *data);
+static void second_job(void *data);
+static void hop_job(void *data);
+static void main_job(void *data);
+static uint64_t work(uint32_t index);
+
+void job_system_test::run() {
+    for (uint32_t i = 0; i < TEST_JOBS; ++i) {
+        g_items[i].index = i;
+        g_expected[i] = work(i);
+    }
+
+    // Batches, jobs that wait on their own children, a second stage held back
+    // until the first is done and jobs that hop to the main thread, with one
+    // worker up to more than most machines have cores
+    for (uint32_t workers = 1; workers <= 8; workers *= 2) {
+        if (!CHECK(job_system::initialize(&g_system, workers))) return;
+        CHECK(g_system.worker_count == workers && job_system::is_main_thread(&g_system));
+        bool ok = CHECK(run_all());
+        job_system::shutdown(&g_system);
+        if (!ok) return;
+    }
+
+    if (!CHECK(job_system::initialize(&g_system, 2))) return;
+
+    // Nothing to do is fine
+    job_system::parallel_for(&g_system, 0, 16, batch_job, nullptr);
+    // A dependency that's done already holds nothing back
+    JobCounter done;
+    JobCounter after;
+    JobDecl job = {first_job, &g_items[0]};
+    g_first[0] = 0;
+    job_system::run_after(&g_system, &done, &job, 1, &after);
+    job_system::wait(&g_system, &after);
+    CHECK(g_first[0] == g_expected[0] && after.value.load() == 0);
+
+    // Another thread takes over the main thread's part and back, main thread
+    // jobs queued in between are run by whoever has it
+    job_system::release_main_thread(&g_system);
+    CHECK(!job_system::is_main_thread(&g_system));
+    bool handover_ok = false;
+    std::thread other(handover_thread, &handover_ok);
+    other.join();
+    job_system::acquire_main_thread(&g_system);
+    CHECK(handover_ok && job_system::is_main_thread(&g_system));
+
+    job_system::shutdown(&g_system);
+    CHECK(!job_system::is_main_thread(&g_system));
+}
+
+static bool run_all() {
+    for (uint32_t i = 0; i < TEST_JOBS; ++i) {
+        g_batched[i] = 0;
+        g_nested[i] = 0;
+        g_first[i] = 0;
+        g_second[i] = 0;
+    }
+    g_main_hops = 0;
+    g_main_misses = 0;
+
+    job_system::parallel_for(&g_system, TEST_JOBS, 16, batch_job, nullptr);
+
+    // Roots spread over the workers, every one waits on its own children
+    JobDecl root_jobs[TEST_ROOTS];
+    for (uint32_t i = 0; i < TEST_ROOTS; ++i) {
+        root_jobs[i] = {root_job, &g_items[i]};
+    }
+    JobCounter roots_done;
+    job_system::run(&g_system, root_jobs, TEST_ROOTS, &roots_done);
+
+    // Queued while the roots are still going
+    JobCounter first_done;
+    JobCounter second_done;
+    for (uint32_t i = 0; i < TEST_JOBS; ++i) {
+        g_stage_jobs[i] = {first_job, &g_items[i]};
+    }
+    job_system::run(&g_system, g_stage_jobs, TEST_JOBS, &first_done);
+    for (uint32_t i = 0; i < TEST_JOBS; ++i) {
+        g_stage_jobs[i] = {second_job, &g_items[i]};
+    }
+    job_system::run_after(&g_system, &first_done, g_stage_jobs, TEST_JOBS, &second_done);
+
+    // Workers hand a job back to the main thread, waiting here runs it
+    for (uint32_t i = 0; i < TEST_MAIN_HOPS; ++i) {
+        g_stage_jobs[i] = {hop_job, &g_items[i]};
+    }
+    JobCounter hops_done;
+    job_system::run(&g_system, g_stage_jobs, TEST_MAIN_HOPS, &hops_done);
+
+    job_system::wait(&g_system, &roots_done);
+    job_system::wait(&g_system, &second_done);
+    job_system::wait(&g_system, &hops_done);
+    // Every hop queued its main thread job before it was done
+    job_system::run_main_jobs(&g_system);
+
+    bool ok = true;
+    for (uint32_t i = 0; i < TEST_JOBS; ++i) {
+        ok &= g_batched[i] == g_expected[i] && g_nested[i] == g_expected[i];
+        ok &= g_second[i] == (g_expected[i] ^ g_expected[(i + 1) % TEST_JOBS]);
+    }
+    return ok && g_main_hops == TEST_MAIN_HOPS && g_main_misses == 0;
+}
+
+static void handover_thread(bool *ok) {
+    job_system::acquire_main_thread(&g_system);
+    g_main_hops = 0;
+    g_main_misses = 0;
+    JobDecl job = {hop_job, &g_items[0]};
+    JobCounter hop_done;
+    job_system::run(&g_system, &job, 1, &hop_done);
+    job_system::wait(&g_system, &hop_done);
+    job_system::run_main_jobs(&g_system);
+    *ok = job_system::is_main_thread(&g_system) && g_main_hops == 1 && g_main_misses == 0;
+    job_system::release_main_thread(&g_system);
+}
+
+static void batch_job(void *, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+        g_batched[i] = work(i);
+    }
+}
+
+static void root_job(void *data) {
+    TestItem *root = (TestItem *)data;
+
+    // Every root takes a slice of the items, one job each
+    uint32_t begin = TEST_JOBS * root->index / TEST_ROOTS;
+    uint32_t end = TEST_JOBS * (root->index + 1) / TEST_ROOTS;
+    JobCounter children_done;
+    for (uint32_t i = begin; i < end; ++i) {
+        JobDecl job = {nested_job, &g_items[i]};
+        job_system::run(&g_system, &job, 1, &children_done);
+    }
+    job_system::wait(&g_system, &children_done);
+}
+
+static void nested_job(void *data) {
+    TestItem *item = (TestItem *)data;
+    g_nested[item->index] = work(item->index);
+}
+
+static void first_job(void *data) {
+    TestItem *item = (TestItem *)data;
+    g_first[item->index] = work(item->index);
+}
+
+static void second_job(void *data) {
+    TestItem *item = (TestItem *)data;
+    g_second[item->index] = g_first[item->index] ^ g_first[(item->index + 1) % TEST_JOBS];
+}
+
+static void hop_job(void *data) {
+    JobDecl job = {main_job, data};
+    job_system::run_on_main(&g_system, &job, 1, nullptr);
+}
+
+static void main_job(void *) {
+    if (!job_system::is_main_thread(&g_system)) {
+        g_main_misses++;
+    }
+    g_main_hops++;
+}
+
+static uint64_t work(uint32_t index) {
+    // splitmix64 chain, different per index
+    uint64_t x = index + 1;
+    for (uint32_t i = 0; i < TEST_ROUNDS; ++i) {
+        x += 0x9E3779B97F4A7C15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        x ^= z ^ (z >> 31);
+    }
+    return x;
+}
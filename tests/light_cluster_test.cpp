@@ -0,0 +1,98 @@
+#include "test.hpp"
+
+#include "light_cluster.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#define TEST_VIEWS 16
+#define TEST_LIGHTS 256
+
+// Too big for the stack
+static LightClusterGrid g_grid;
+static LightClusterList g_reference;
+static LightClusterList g_simd;
+static ClusterLight g_lights[TEST_LIGHTS];
+
+static void random_lights(uint32_t *rng, float zfar, float spread, ClusterLight *out_lights, uint32_t count);
+
+void light_cluster_test::run() {
+    uint32_t rng = 0x2545F491u;
+
+    for (uint32_t view = 0; view < TEST_VIEWS; ++view) {
+        float fov = test::random_float(&rng, 0.5f, 1.8f);
+        float aspect = test::random_float(&rng, 0.5f, 2.5f);
+        float proj_y = 1.0f / tanf(fov * 0.5f);
+        float proj_x = proj_y / aspect;
+        float znear = test::random_float(&rng, 0.01f, 1.0f);
+        float zfar = test::random_float(&rng, 50.0f, 1000.0f);
+
+        light_cluster::build_grid(&g_grid, proj_x, proj_y, znear, zfar);
+        CHECK(light_cluster::grid_matches(&g_grid, proj_x, proj_y, znear, zfar));
+
+        // Lights spread past the frustum on every side, behind the camera too
+        random_lights(&rng, zfar, 2.0f / proj_x, g_lights, TEST_LIGHTS);
+        light_cluster::assign_reference(&g_grid, g_lights, TEST_LIGHTS, &g_reference);
+        light_cluster::assign_simd(&g_grid, g_lights, TEST_LIGHTS, &g_simd);
+
+        uint32_t assigned = 0;
+        for (uint32_t c = 0; c < CLUSTER_COUNT; ++c) {
+            assigned += g_reference.counts[c];
+        }
+        CHECK(assigned > 0);
+        if (!CHECK(light_cluster::compare(&g_reference, &g_simd) == 0)) break;
+    }
+
+    // More lights around the camera than a cluster holds, both paths have to
+    // drop the same ones
+    light_cluster::build_grid(&g_grid, 1.0f, 1.7f, 0.1f, 100.0f);
+    for (uint32_t i = 0; i < TEST_LIGHTS; ++i) {
+        ClusterLight *light = &g_lights[i];
+        *light = {};
+        light->position = {test::random_float(&rng, -1.0f, 1.0f), test::random_float(&rng, -1.0f, 1.0f), test::random_float(&rng, 0.0f, 2.0f)};
+        light->range = 200.0f;
+        light->type = CLUSTER_LIGHT_POINT;
+        light->light_index = i;
+    }
+    light_cluster::assign_reference(&g_grid, g_lights, TEST_LIGHTS, &g_reference);
+    light_cluster::assign_simd(&g_grid, g_lights, TEST_LIGHTS, &g_simd);
+    CHECK(g_reference.counts[0] == CLUSTER_MAX_LIGHTS);
+    CHECK(g_reference.counts[CLUSTER_COUNT - 1] == CLUSTER_MAX_LIGHTS);
+    CHECK(light_cluster::compare(&g_reference, &g_simd) == 0);
+}
+
+// Half point, half spot lights with random directions and cone angles
+static void random_lights(uint32_t *rng, float zfar, float spread, ClusterLight *out_lights, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        ClusterLight *light = &out_lights[i];
+        *light = {};
+
+        float z = test::random_float(rng, -0.1f * zfar, 1.1f * zfar);
+        float half_width = fabsf(z) * spread + 1.0f;
+        light->position = {test::random_float(rng, -half_width, half_width), test::random_float(rng, -half_width, half_width), z};
+        light->range = test::random_float(rng, 0.5f, 0.1f * zfar);
+        light->light_index = i;
+
+        if (i % 2 == 0) {
+            light->type = CLUSTER_LIGHT_POINT;
+            continue;
+        }
+
+        float dx = test::random_float(rng, -1.0f, 1.0f);
+        float dy = test::random_float(rng, -1.0f, 1.0f);
+        float dz = test::random_float(rng, -1.0f, 1.0f);
+        float length = sqrtf(dx * dx + dy * dy + dz * dz);
+        if (length < 1e-3f) {
+            dx = 0.0f;
+            dy = 0.0f;
+            dz = 1.0f;
+            length = 1.0f;
+        }
+        float angle = test::random_float(rng, 0.05f, 1.5f);
+
+        light->type = CLUSTER_LIGHT_SPOT;
+        light->direction = {dx / length, dy / length, dz / length};
+        light->cos_outer = cosf(angle);
+        light->sin_outer = sinf(angle);
+    }
+}
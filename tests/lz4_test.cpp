@@ -0,0 +1,83 @@
+#include "test.hpp"
+
+#include "lz4.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#define TEST_MAX_SIZE 300000
+#define TEST_GARBAGE_ROUNDS 1000
+
+static const size_t s_sizes[] = {0, 1, 4, 5, 12, 13, 14, 15, 16, 100, 255, 256, 270, 4096, 65535, 65536, 65537, TEST_MAX_SIZE};
+static const char *s_words[] = {"albedo", "roughness", "metallic", "normal", "occlusion", "emissive", "mesh", "material", "texture", "scene"};
+
+// Too big for the stack
+static uint8_t g_src[TEST_MAX_SIZE];
+static uint8_t g_compressed[TEST_MAX_SIZE + TEST_MAX_SIZE / 255 + 16];
+static uint8_t g_tight[TEST_MAX_SIZE + TEST_MAX_SIZE / 255 + 16];
+static uint8_t g_dst[TEST_MAX_SIZE + 1];
+
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng);
+
+void lz4_test::run() {
+    if (!CHECK(lz4::get_bound(TEST_MAX_SIZE) <= sizeof(g_compressed))) return;
+
+    // Edge sizes around the literal and match length encodings, every pattern
+    uint32_t rng = 0x124;
+    for (uint32_t pattern = 0; pattern < 4; ++pattern) {
+        for (uint32_t s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); ++s) {
+            size_t size = s_sizes[s];
+            fill(g_src, size, pattern, &rng);
+
+            size_t compressed_size = lz4::compress(g_src, size, g_compressed, lz4::get_bound(size));
+            bool ok = CHECK(compressed_size > 0 && lz4::decompress(g_compressed, compressed_size, g_dst, size) && memcmp(g_src, g_dst, size) == 0);
+            // Too little room, a byte short and a byte too many all have to fail
+            ok &= CHECK(lz4::compress(g_src, size, g_tight, compressed_size - 1) == 0);
+            ok &= CHECK(!lz4::decompress(g_compressed, compressed_size - 1, g_dst, size));
+            ok &= CHECK(!lz4::decompress(g_compressed, compressed_size, g_dst, size + 1));
+            if (!ok) return;
+        }
+    }
+
+    // Garbage mustn't read or write out of bounds, whatever it returns
+    for (uint32_t i = 0; i < TEST_GARBAGE_ROUNDS; ++i) {
+        size_t size = test::next_random(&rng) % 64 + 1;
+        fill(g_compressed, size, 1, &rng);
+        lz4::decompress(g_compressed, size, g_dst, test::next_random(&rng) % 256);
+    }
+}
+
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng) {
+    size_t i = 0;
+    while (i < size) {
+        switch (pattern) {
+            case 0: {
+                // Words, compresses about the way shaders and configs do
+                const char *word = s_words[test::next_random(rng) % (sizeof(s_words) / sizeof(s_words[0]))];
+                for (size_t c = 0; word[c] && i < size; ++c) {
+                    data[i++] = (uint8_t)word[c];
+                }
+                if (i < size) {
+                    data[i++] = ' ';
+                }
+                break;
+            }
+            case 1:
+                data[i++] = (uint8_t)test::next_random(rng);
+                break;
+            case 2: {
+                // Runs of a byte
+                uint8_t value = (uint8_t)test::next_random(rng);
+                for (uint32_t run = test::next_random(rng) % 64 + 1; run > 0 && i < size; --run) {
+                    data[i++] = value;
+                }
+                break;
+            }
+            default:
+                // A match right behind itself, copied byte by byte
+                data[i] = (uint8_t)(i % 3);
+                i++;
+                break;
+        }
+    }
+}
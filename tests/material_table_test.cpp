@@ -0,0 +1,111 @@
+#include "test.hpp"
+
+#include "id.hpp"
+#include "material_table.hpp"
+
+#include <cstdint>
+
+#define TEST_TEXTURES 200
+#define TEST_MATERIALS 64
+// Slots per material, like GPUMaterial::texture_slots
+#define TEST_MATERIAL_SLOTS 6
+
+struct TestTexture {
+    Id id;
+    TextureArrayDesc desc;
+};
+
+static MaterialTable g_table;
+static TestTexture g_textures[TEST_TEXTURES];
+
+static bool desc_equal(const TextureArrayDesc *a, const TextureArrayDesc *b);
+
+void material_table_test::run() {
+    // The slot is the array in the high half and the layer in the low one
+    uint32_t slot = (5u << 16) | 42u;
+    CHECK(material_table::get_slot_array(slot) == 5 && material_table::get_slot_layer(slot) == 42);
+
+    // A few sizes and formats, like the source images and their streamed mips
+    static const uint32_t sizes[] = {256, 512, 1024, 2048};
+    static const uint32_t formats[] = {28, 71, 98}; // R8G8B8A8_UNORM, BC1_UNORM, BC7_UNORM
+    uint32_t rng = 0x85EBCA6Bu;
+    for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+        TestTexture *tex = &g_textures[i];
+        uint32_t size = sizes[test::next_random(&rng) % 4];
+        tex->id = {(uint8_t)i, (uint8_t)(i / 7)};
+        tex->desc = {size, size, formats[test::next_random(&rng) % 3], 0};
+        for (uint32_t s = size; s > 0; s >>= 1) {
+            tex->desc.mip_levels++;
+        }
+    }
+
+    // Pack materials that share some of their textures, every slot has to
+    // lead back to the texture and an array of its desc
+    material_table::reset(&g_table);
+    uint32_t slots[TEST_MATERIALS][TEST_MATERIAL_SLOTS];
+    uint32_t placed = 0;
+    for (uint32_t m = 0; m < TEST_MATERIALS; ++m) {
+        for (uint32_t t = 0; t < TEST_MATERIAL_SLOTS; ++t) {
+            TestTexture *tex = &g_textures[test::next_random(&rng) % 48];
+            slots[m][t] = material_table::add_texture(&g_table, &tex->desc, tex->id);
+            placed += slots[m][t] != MATERIAL_TEXTURE_SLOT_NONE ? 1 : 0;
+
+            uint32_t array = material_table::get_slot_array(slots[m][t]);
+            uint32_t layer = material_table::get_slot_layer(slots[m][t]);
+            if (!CHECK(array < g_table.bucket_count && layer < g_table.buckets[array].layer_count)) break;
+
+            TextureArrayBucket *bucket = &g_table.buckets[array];
+            CHECK(bucket->layers[layer].id == tex->id.id && bucket->layers[layer].generation == tex->id.generation);
+            CHECK(desc_equal(&bucket->desc, &tex->desc));
+        }
+    }
+    CHECK(placed == TEST_MATERIALS * TEST_MATERIAL_SLOTS);
+
+    // One array per desc, and no texture in the table twice
+    for (uint32_t a = 0; a < g_table.bucket_count; ++a) {
+        for (uint32_t b = a + 1; b < g_table.bucket_count; ++b) {
+            CHECK(!desc_equal(&g_table.buckets[a].desc, &g_table.buckets[b].desc));
+        }
+        for (uint32_t l = 0; l < g_table.buckets[a].layer_count; ++l) {
+            for (uint32_t k = l + 1; k < g_table.buckets[a].layer_count; ++k) {
+                Id x = g_table.buckets[a].layers[l];
+                Id y = g_table.buckets[a].layers[k];
+                CHECK(x.id != y.id || x.generation != y.generation);
+            }
+        }
+    }
+
+    // Placing a texture again keeps its slot. A new generation of the same id
+    // is another texture.
+    TestTexture *again = &g_textures[0];
+    uint32_t first = material_table::add_texture(&g_table, &again->desc, again->id);
+    CHECK(material_table::add_texture(&g_table, &again->desc, again->id) == first);
+    Id next_generation = again->id;
+    id::gen_increment(&next_generation);
+    CHECK(material_table::add_texture(&g_table, &again->desc, next_generation) != first);
+
+    // A full array turns new textures of its desc away, other descs still fit
+    material_table::reset(&g_table);
+    CHECK(g_table.bucket_count == 0);
+    TextureArrayDesc desc = {64, 64, 28, 7};
+    for (uint32_t i = 0; i < MATERIAL_ARRAY_MAX_LAYERS; ++i) {
+        Id tex = {(uint8_t)i, 0};
+        uint32_t s = material_table::add_texture(&g_table, &desc, tex);
+        if (!CHECK(material_table::get_slot_array(s) == 0 && material_table::get_slot_layer(s) == i)) break;
+    }
+    Id overflow = {(uint8_t)MATERIAL_ARRAY_MAX_LAYERS, 0};
+    CHECK(material_table::add_texture(&g_table, &desc, overflow) == MATERIAL_TEXTURE_SLOT_NONE);
+
+    // Running out of arrays, one desc per array
+    for (uint32_t a = 1; a < MATERIAL_TEXTURE_ARRAYS; ++a) {
+        TextureArrayDesc other = {64, 64, 28 + a, 7};
+        CHECK(material_table::get_slot_array(material_table::add_texture(&g_table, &other, overflow)) == a);
+    }
+    TextureArrayDesc one_too_many = {128, 128, 28, 8};
+    CHECK(material_table::add_texture(&g_table, &one_too_many, overflow) == MATERIAL_TEXTURE_SLOT_NONE);
+    CHECK(g_table.bucket_count == MATERIAL_TEXTURE_ARRAYS);
+}
+
+static bool desc_equal(const TextureArrayDesc *a, const TextureArrayDesc *b) {
+    return a->width == b->width && a->height == b->height && a->format == b->format && a->mip_levels == b->mip_levels;
+}
@@ -0,0 +1,84 @@
+#include "test.hpp"
+
+#include "job_system.hpp"
+#include "memory_tracker.hpp"
+
+#include <cstdint>
+
+// Any tag works, nothing else tracks CPU buffers in the tests
+#define TEST_TAG MEMORY_TAG_BUFFERS
+#define TEST_ROUNDS 2000
+#define TEST_TRACKS 16
+#define TEST_MAX_SIZE 65536
+#define TEST_THREADS 4
+
+struct BudgetCalls {
+    uint32_t count;
+    uint64_t bytes;
+};
+
+// Too big for the stack
+static JobSystem g_jobs;
+
+static void thread_rounds(void *data, uint32_t begin, uint32_t end);
+static void count_budget_call(void *user_data, MemoryTag tag, MemoryDomain domain, uint64_t bytes, uint64_t budget);
+
+void memory_tracker_test::run() {
+    // Called once going over, not again until it went under and over again
+    MemoryPoolStats start = memory_tracker::get_stats(TEST_TAG, MEMORY_DOMAIN_CPU);
+    BudgetCalls calls = {};
+    memory_tracker::set_budget_callback(count_budget_call, &calls);
+    memory_tracker::set_budget(TEST_TAG, MEMORY_DOMAIN_CPU, start.bytes + 1000);
+
+    memory_tracker::track(TEST_TAG, MEMORY_DOMAIN_CPU, 600);
+    CHECK(calls.count == 0);
+    memory_tracker::track(TEST_TAG, MEMORY_DOMAIN_CPU, 600);
+    CHECK(calls.count == 1 && calls.bytes == start.bytes + 1200);
+    memory_tracker::track(TEST_TAG, MEMORY_DOMAIN_CPU, 100);
+    CHECK(calls.count == 1);
+
+    memory_tracker::untrack(TEST_TAG, MEMORY_DOMAIN_CPU, 600);
+    memory_tracker::retrack(TEST_TAG, MEMORY_DOMAIN_CPU, 100, 500);
+    CHECK(calls.count == 2 && calls.bytes == start.bytes + 1100);
+
+    MemoryPoolStats stats = memory_tracker::get_stats(TEST_TAG, MEMORY_DOMAIN_CPU);
+    CHECK(stats.bytes == start.bytes + 1100 && stats.allocations == start.allocations + 2);
+    CHECK(stats.peak >= start.bytes + 1300);
+
+    // Peaks start over from what's there
+    memory_tracker::untrack(TEST_TAG, MEMORY_DOMAIN_CPU, 600);
+    memory_tracker::untrack(TEST_TAG, MEMORY_DOMAIN_CPU, 500);
+    memory_tracker::reset_peaks();
+    stats = memory_tracker::get_stats(TEST_TAG, MEMORY_DOMAIN_CPU);
+    CHECK(stats.bytes == start.bytes && stats.peak == start.bytes && stats.allocations == start.allocations);
+
+    memory_tracker::set_budget(TEST_TAG, MEMORY_DOMAIN_CPU, 0);
+    memory_tracker::set_budget_callback(nullptr, nullptr);
+
+    // Every thread tracking and untracking at once, it all has to cancel out
+    if (!CHECK(job_system::initialize(&g_jobs, TEST_THREADS))) return;
+    job_system::parallel_for(&g_jobs, TEST_ROUNDS, 16, thread_rounds, nullptr);
+    job_system::shutdown(&g_jobs);
+    stats = memory_tracker::get_stats(TEST_TAG, MEMORY_DOMAIN_CPU);
+    CHECK(stats.bytes == start.bytes && stats.allocations == start.allocations && stats.peak > start.bytes);
+}
+
+static void thread_rounds(void *, uint32_t begin, uint32_t end) {
+    uint64_t sizes[TEST_TRACKS];
+    for (uint32_t round = begin; round < end; ++round) {
+        uint32_t rng = round * 2654435761u + 1;
+        for (uint32_t i = 0; i < TEST_TRACKS; ++i) {
+            sizes[i] = 1 + test::next_random(&rng) % TEST_MAX_SIZE;
+            memory_tracker::track(TEST_TAG, MEMORY_DOMAIN_CPU, sizes[i]);
+        }
+        for (uint32_t i = 0; i < TEST_TRACKS; ++i) {
+            memory_tracker::untrack(TEST_TAG, MEMORY_DOMAIN_CPU, sizes[i]);
+        }
+    }
+}
+
+static void count_budget_call(void *user_data, MemoryTag, MemoryDomain, uint64_t bytes, uint64_t) {
+    BudgetCalls *calls = (BudgetCalls *)user_data;
+    calls->count++;
+    calls->bytes = bytes;
+}
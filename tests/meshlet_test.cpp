@@ -0,0 +1,173 @@
+#include "test.hpp"
+
+#include "mesh.hpp"
+#include "meshlet.hpp"
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// 64 * 128 quads, about 16k triangles in a few hundred meshlets
+#define TEST_RINGS 64
+#define TEST_SEGMENTS 128
+#define TEST_VERTICES ((TEST_RINGS + 1) * (TEST_SEGMENTS + 1))
+#define TEST_INDICES (TEST_RINGS * TEST_SEGMENTS * 6)
+#define TEST_VIEWS 256
+#define TEST_WORDS (MESHLET_MAX_PER_MESH / 32)
+
+static Vertex g_vertices[TEST_VERTICES];
+static uint32_t g_indices[TEST_INDICES];
+static uint32_t g_visible_reference[TEST_WORDS];
+static uint32_t g_visible_simd[TEST_WORDS];
+static MeshletDraw g_draws[MESHLET_MAX_PER_MESH / 2 + 1];
+
+static void build_sphere();
+static MeshletCullView make_view(DirectX::XMVECTOR eye, DirectX::XMVECTOR target, float fov, float rotation);
+static bool check_meshlets(const MeshletSet *set);
+static bool check_draws(const MeshletSet *set, const uint32_t *visible, uint32_t draw_count);
+static bool is_visible(const uint32_t *visible, uint32_t meshlet);
+
+void meshlet_test::run() {
+    build_sphere();
+    MeshletSet set;
+    if (!CHECK(meshlet::build(g_vertices, TEST_VERTICES, g_indices, TEST_INDICES, &set))) return;
+    CHECK(set.count > 1 && set.count <= MESHLET_MAX_PER_MESH);
+    CHECK(check_meshlets(&set));
+
+    // Random cameras around the sphere, both paths set the same bits and the
+    // draws cover exactly the visible meshlets
+    uint32_t rng = 0x9E3779B9u;
+    uint32_t words = (set.count + 31) / 32;
+    uint32_t some_culled = 0;
+    for (uint32_t v = 0; v < TEST_VIEWS; ++v) {
+        float yaw = test::random_float(&rng, 0.0f, DirectX::XM_2PI);
+        float pitch = test::random_float(&rng, -1.4f, 1.4f);
+        float distance = test::random_float(&rng, 2.0f, 8.0f);
+        DirectX::XMVECTOR eye = DirectX::XMVectorSet(distance * cosf(pitch) * cosf(yaw), distance * sinf(pitch), distance * cosf(pitch) * sinf(yaw), 1.0f);
+        DirectX::XMVECTOR target = DirectX::XMVectorSet(test::random_float(&rng, -1.0f, 1.0f), test::random_float(&rng, -1.0f, 1.0f), test::random_float(&rng, -1.0f, 1.0f), 1.0f);
+        MeshletCullView view = make_view(eye, target, test::random_float(&rng, 0.6f, 1.4f), test::random_float(&rng, 0.0f, DirectX::XM_2PI));
+
+        uint32_t reference_count = meshlet::cull_reference(&set, &view, g_visible_reference);
+        uint32_t simd_count = meshlet::cull_simd(&set, &view, g_visible_simd);
+        bool ok = CHECK(reference_count == simd_count && memcmp(g_visible_reference, g_visible_simd, words * sizeof(uint32_t)) == 0);
+
+        uint32_t draw_count = meshlet::build_draws(&set, g_visible_simd, g_draws);
+        ok &= CHECK(check_draws(&set, g_visible_simd, draw_count));
+        some_culled += simd_count < set.count ? 1 : 0;
+        if (!ok) break;
+    }
+    // From outside, the back of the sphere goes
+    CHECK(some_culled == TEST_VIEWS);
+
+    // Looking away sees nothing
+    MeshletCullView away = make_view(DirectX::XMVectorSet(0.0f, 0.0f, -5.0f, 1.0f), DirectX::XMVectorSet(0.0f, 0.0f, -10.0f, 1.0f), 1.0f, 0.0f);
+    CHECK(meshlet::cull_reference(&set, &away, g_visible_reference) == 0 && meshlet::cull_simd(&set, &away, g_visible_simd) == 0);
+    CHECK(meshlet::build_draws(&set, g_visible_simd, g_draws) == 0);
+
+    meshlet::destroy(&set);
+    CHECK(set.count == 0);
+    CHECK(!meshlet::build(g_vertices, TEST_VERTICES, g_indices, 0, &set) && set.count == 0);
+}
+
+// Clockwise from outside, the way the loaders leave glTF meshes
+static void build_sphere() {
+    for (uint32_t r = 0; r <= TEST_RINGS; ++r) {
+        float theta = DirectX::XM_PI * r / TEST_RINGS;
+        for (uint32_t s = 0; s <= TEST_SEGMENTS; ++s) {
+            float phi = DirectX::XM_2PI * s / TEST_SEGMENTS;
+            Vertex *v = &g_vertices[r * (TEST_SEGMENTS + 1) + s];
+            v->position = DirectX::XMFLOAT3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            v->normal = v->position;
+            v->texCoord = DirectX::XMFLOAT2((float)s / TEST_SEGMENTS, (float)r / TEST_RINGS);
+        }
+    }
+
+    uint32_t *out = g_indices;
+    for (uint32_t r = 0; r < TEST_RINGS; ++r) {
+        for (uint32_t s = 0; s < TEST_SEGMENTS; ++s) {
+            uint32_t a = r * (TEST_SEGMENTS + 1) + s;
+            uint32_t b = a + TEST_SEGMENTS + 1;
+            *out++ = a, *out++ = a + 1, *out++ = b;
+            *out++ = a + 1, *out++ = b + 1, *out++ = b;
+        }
+    }
+}
+
+// The sphere scaled up and turned, seen from eye
+static MeshletCullView make_view(DirectX::XMVECTOR eye, DirectX::XMVECTOR target, float fov, float rotation) {
+    DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH(eye, target, DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(fov, 16.0f / 9.0f, 0.1f, 100.0f);
+    DirectX::XMMATRIX world = DirectX::XMMatrixScaling(1.5f, 1.5f, 1.5f) * DirectX::XMMatrixRotationY(rotation);
+
+    DirectX::XMFLOAT4X4 world_matrix;
+    DirectX::XMFLOAT4X4 view_projection;
+    DirectX::XMFLOAT3 camera_position;
+    DirectX::XMStoreFloat4x4(&world_matrix, world);
+    DirectX::XMStoreFloat4x4(&view_projection, view * projection);
+    DirectX::XMStoreFloat3(&camera_position, eye);
+    return meshlet::make_view(&world_matrix, &view_projection, camera_position);
+}
+
+// Meshlets follow each other through the whole index buffer, within the limits
+static bool check_meshlets(const MeshletSet *set) {
+    static uint8_t seen[TEST_VERTICES];
+    uint32_t offset = 0;
+    for (uint32_t m = 0; m < set->count; ++m) {
+        const Meshlet *meshlet = &set->meshlets[m];
+        if (meshlet->index_offset != offset || meshlet->triangle_count == 0 || meshlet->triangle_count > MESHLET_MAX_TRIANGLES) {
+            return false;
+        }
+
+        memset(seen, 0, sizeof(seen));
+        uint32_t unique = 0;
+        for (uint32_t i = 0; i < meshlet->triangle_count * 3; ++i) {
+            uint32_t index = g_indices[offset + i];
+            unique += seen[index] ? 0 : 1;
+            seen[index] = 1;
+        }
+        if (unique > MESHLET_MAX_VERTICES) {
+            return false;
+        }
+        offset += meshlet->triangle_count * 3;
+    }
+    return offset == TEST_INDICES;
+}
+
+// Every visible meshlet's indices are in exactly one draw, nothing else is
+// drawn and visible neighbours share their draw
+static bool check_draws(const MeshletSet *set, const uint32_t *visible, uint32_t draw_count) {
+    uint32_t m = 0;
+    for (uint32_t d = 0; d < draw_count; ++d) {
+        // Skip to the meshlet the draw starts at, none of the ones skipped can be visible
+        while (m < set->count && set->meshlets[m].index_offset < g_draws[d].index_offset) {
+            if (is_visible(visible, m++)) {
+                return false;
+            }
+        }
+        if (m == set->count || set->meshlets[m].index_offset != g_draws[d].index_offset) {
+            return false;
+        }
+
+        uint32_t covered = 0;
+        while (covered < g_draws[d].index_count) {
+            if (m == set->count || !is_visible(visible, m)) {
+                return false;
+            }
+            covered += set->meshlets[m++].triangle_count * 3;
+        }
+        if (covered != g_draws[d].index_count || (m < set->count && is_visible(visible, m))) {
+            return false;
+        }
+    }
+    for (; m < set->count; ++m) {
+        if (is_visible(visible, m)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_visible(const uint32_t *visible, uint32_t meshlet) {
+    return (visible[meshlet / 32] >> (meshlet % 32)) & 1;
+}
@@ -0,0 +1,69 @@
+#include "test.hpp"
+
+#include "arena.hpp"
+#include "mip_file.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#define TEST_KEY 0x62656e6368ull
+
+void mip_file_test::run() {
+    Arena *scratch = arena::scratch();
+    ArenaMarker marker = arena::get_marker(scratch);
+
+    // Odd sizes, every mip clamps its last row or column
+    uint32_t width = 37, height = 20;
+    uint8_t *pixels = ARENA_PUSH_ARRAY(scratch, uint8_t, width * height * 4);
+    if (!CHECK(pixels != nullptr)) return;
+    uint32_t rng = 7;
+    for (uint32_t i = 0; i < width * height * 4; ++i) {
+        pixels[i] = (uint8_t)test::next_random(&rng);
+    }
+    uint8_t *levels[MIP_FILE_MAX_MIPS] = {};
+    uint32_t mip_count = 0;
+    CHECK(mip_file::build_mips(pixels, width, height, true, scratch, levels, &mip_count) && mip_count == 6);
+    CHECK(mip_file::get_mip_count(width, height) == mip_count && mip_file::get_mip_count(1, 1) == 1);
+
+    // Black and white average to half the light in sRGB, to half the value otherwise
+    const uint8_t checker[16] = {0, 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 0};
+    uint8_t *checker_levels[MIP_FILE_MAX_MIPS] = {};
+    uint32_t checker_mips = 0;
+    CHECK(mip_file::build_mips(checker, 2, 2, true, scratch, checker_levels, &checker_mips) && checker_mips == 2);
+    CHECK(checker_levels[1][0] == 188 && checker_levels[1][3] == 128);
+    CHECK(mip_file::build_mips(checker, 2, 2, false, scratch, checker_levels, &checker_mips) && checker_levels[1][0] == 128);
+
+    char dir[512];
+    char path[MIP_FILE_PATH_MAX];
+    if (!CHECK(test::make_temp_dir("mip_file", dir, sizeof(dir)))) return;
+    mip_file::get_path(dir, TEST_KEY, path, sizeof(path));
+    MipFileHeader header = {};
+    if (!CHECK(mip_file::write(path, TEST_KEY, width, height, true, levels, mip_count))) return;
+    if (!CHECK(mip_file::read_header(path, TEST_KEY, &header))) return;
+    CHECK(header.width == width && header.height == height && header.mip_count == mip_count);
+
+    // The whole chain, then a range from the middle
+    uint32_t ranges[2][2] = {{0, mip_count}, {2, 5}};
+    for (uint32_t r = 0; r < 2; ++r) {
+        uint8_t *read[MIP_FILE_MAX_MIPS] = {};
+        if (!CHECK(mip_file::read_mips(path, &header, ranges[r][0], ranges[r][1], scratch, read))) continue;
+        for (uint32_t mip = ranges[r][0]; mip < ranges[r][1]; ++mip) {
+            uint32_t mip_width = width >> mip ? width >> mip : 1;
+            uint32_t mip_height = height >> mip ? height >> mip : 1;
+            CHECK(header.levels[mip].width == mip_width && header.levels[mip].height == mip_height);
+            CHECK(memcmp(read[mip], levels[mip], mip_width * mip_height * 4) == 0);
+        }
+    }
+
+    // Baked from another version of the source, then cut off (both log)
+    MipFileHeader stale = {};
+    CHECK(!mip_file::read_header(path, TEST_KEY + 1, &stale));
+    std::error_code error;
+    std::filesystem::resize_file(path, std::filesystem::file_size(path, error) - 1, error);
+    CHECK(!error && !mip_file::read_header(path, TEST_KEY, &stale));
+    remove(path);
+
+    arena::rewind(scratch, marker);
+}
@@ -0,0 +1,194 @@
+#include "test.hpp"
+
+#include "occlusion.hpp"
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstdint>
+
+#define TEST_WALLS 48
+#define TEST_SPHERES 4096
+#define TEST_FOV 1.0f
+#define TEST_ASPECT (16.0f / 9.0f)
+#define TEST_NEAR 0.1f
+#define TEST_FAR 200.0f
+// Points per sphere for the visibility check
+#define TEST_CHECK_POINTS 256
+// A mapped staging texture's rows are usually wider than the texture
+#define TEST_ROW_PITCH ((HIZ_WIDTH + 16) * sizeof(float))
+
+// View space, the camera sits at the origin looking down +z
+struct TestWall {
+    float min_x, max_x;
+    float min_y, max_y;
+    float z;
+};
+
+static TestWall g_walls[TEST_WALLS];
+static uint32_t g_wall_count;
+static float g_depth[HIZ_HEIGHT * TEST_ROW_PITCH / sizeof(float)];
+static HiZPyramid g_pyramid;
+static DirectX::XMFLOAT4X4 g_view_projection;
+
+static void add_wall(uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, float z);
+static void build_pyramid();
+static bool check_levels();
+static bool sphere_hidden(DirectX::XMFLOAT3 center, float radius);
+static float wall_depth(float view_x_over_z, float view_y_over_z);
+static float project_depth(float view_z);
+static bool point_hidden(float x, float y, float z);
+
+void occlusion_test::run() {
+    // No view matrix, the view projection is just the projection
+    DirectX::XMStoreFloat4x4(&g_view_projection, DirectX::XMMatrixPerspectiveFovLH(TEST_FOV, TEST_ASPECT, TEST_NEAR, TEST_FAR));
+    float scale_x = g_view_projection.m[0][0];
+
+    // No pyramid yet, nothing is hidden
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, 50.0f), 1.0f));
+
+    // One wall over the middle of the screen
+    add_wall(HIZ_WIDTH / 4, HIZ_HEIGHT / 4, HIZ_WIDTH / 2, HIZ_HEIGHT / 2, 10.0f);
+    build_pyramid();
+    CHECK(g_pyramid.is_valid && check_levels());
+    CHECK(occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, 30.0f), 1.0f));
+    // In front of the wall, reaching through it, or off to the side
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, 8.0f), 1.0f));
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, 11.0f), 2.0f));
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.9f / scale_x * 30.0f, 0.0f, 30.0f), 1.0f));
+    // Whatever the pyramid can't say anything about is visible
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, -30.0f), 1.0f));
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(0.0f, 0.0f, 0.5f), 1.0f));
+    CHECK(!occlusion::is_occluded(&g_pyramid, DirectX::XMFLOAT3(3.0f / scale_x * 30.0f, 0.0f, 30.0f), 1.0f));
+
+    // Walls at random depths and spheres scattered behind and between them.
+    // Every culled sphere is checked point by point, none of it may be in view.
+    uint32_t rng = 0x9E3779B9u;
+    g_wall_count = 0;
+    for (uint32_t i = 0; i < TEST_WALLS; ++i) {
+        uint32_t width = 8 + test::next_random(&rng) % (HIZ_WIDTH / 3);
+        uint32_t height = 8 + test::next_random(&rng) % (HIZ_HEIGHT / 3);
+        uint32_t x0 = test::next_random(&rng) % (HIZ_WIDTH - width);
+        uint32_t y0 = test::next_random(&rng) % (HIZ_HEIGHT - height);
+        add_wall(x0, y0, width, height, test::random_float(&rng, 5.0f, 60.0f));
+    }
+    build_pyramid();
+    CHECK(check_levels());
+
+    uint32_t culled = 0;
+    for (uint32_t i = 0; i < TEST_SPHERES; ++i) {
+        float z = test::random_float(&rng, 2.0f, 120.0f);
+        DirectX::XMFLOAT3 center(test::random_float(&rng, -0.9f, 0.9f) * z, test::random_float(&rng, -0.5f, 0.5f) * z, z);
+        float radius = test::random_float(&rng, 0.2f, 3.0f);
+        if (occlusion::is_occluded(&g_pyramid, center, radius)) {
+            culled++;
+            if (!CHECK(sphere_hidden(center, radius))) break;
+        }
+    }
+    // Enough walls that a good share goes
+    CHECK(culled > TEST_SPHERES / 10 && culled < TEST_SPHERES);
+}
+
+// In base level texels, the texel centers give the exact farthest depth under
+// each texel, like the GPU reduction would
+static void add_wall(uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, float z) {
+    float scale_x = g_view_projection.m[0][0];
+    float scale_y = g_view_projection.m[1][1];
+    TestWall *wall = &g_walls[g_wall_count++];
+    wall->z = z;
+    wall->min_x = ((float)x0 / HIZ_WIDTH * 2.0f - 1.0f) / scale_x * z;
+    wall->max_x = ((float)(x0 + width) / HIZ_WIDTH * 2.0f - 1.0f) / scale_x * z;
+    wall->max_y = (1.0f - (float)y0 / HIZ_HEIGHT * 2.0f) / scale_y * z;
+    wall->min_y = (1.0f - (float)(y0 + height) / HIZ_HEIGHT * 2.0f) / scale_y * z;
+}
+
+static void build_pyramid() {
+    float scale_x = g_view_projection.m[0][0];
+    float scale_y = g_view_projection.m[1][1];
+    uint32_t row_floats = TEST_ROW_PITCH / sizeof(float);
+    for (uint32_t y = 0; y < HIZ_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < row_floats; ++x) {
+            float u = (x + 0.5f) / HIZ_WIDTH;
+            float v = (y + 0.5f) / HIZ_HEIGHT;
+            // The padding at the end of the row is garbage, nearer than anything
+            g_depth[y * row_floats + x] = x < HIZ_WIDTH ? wall_depth((u * 2.0f - 1.0f) / scale_x, (1.0f - v * 2.0f) / scale_y) : -1.0f;
+        }
+    }
+    occlusion::build(&g_pyramid, g_depth, TEST_ROW_PITCH, &g_view_projection);
+}
+
+// The base level is the depth without the row padding, every texel above is
+// the farthest of the ones it covers and it goes down to 1x1
+static bool check_levels() {
+    uint32_t row_floats = TEST_ROW_PITCH / sizeof(float);
+    for (uint32_t y = 0; y < HIZ_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < HIZ_WIDTH; ++x) {
+            if (g_pyramid.depth[y * HIZ_WIDTH + x] != g_depth[y * row_floats + x]) {
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t level = 1; level < g_pyramid.level_count; ++level) {
+        const float *src = &g_pyramid.depth[g_pyramid.level_offset[level - 1]];
+        const float *dst = &g_pyramid.depth[g_pyramid.level_offset[level]];
+        uint32_t src_width = g_pyramid.level_width[level - 1];
+        uint32_t src_height = g_pyramid.level_height[level - 1];
+        for (uint32_t y = 0; y < g_pyramid.level_height[level]; ++y) {
+            for (uint32_t x = 0; x < g_pyramid.level_width[level]; ++x) {
+                float farthest = 0.0f;
+                for (uint32_t sy = y * 2; sy < y * 2 + 2 && sy < src_height; ++sy) {
+                    for (uint32_t sx = x * 2; sx < x * 2 + 2 && sx < src_width; ++sx) {
+                        farthest = fmaxf(farthest, src[sy * src_width + sx]);
+                    }
+                }
+                if (dst[y * g_pyramid.level_width[level] + x] != farthest) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    uint32_t last = g_pyramid.level_count - 1;
+    return g_pyramid.level_count == HIZ_MAX_LEVELS && g_pyramid.level_width[last] == 1 && g_pyramid.level_height[last] == 1;
+}
+
+// Points spread over the sphere, none of them in view
+static bool sphere_hidden(DirectX::XMFLOAT3 center, float radius) {
+    for (uint32_t p = 0; p < TEST_CHECK_POINTS; ++p) {
+        float t = (p + 0.5f) / TEST_CHECK_POINTS;
+        float polar = acosf(1.0f - 2.0f * t);
+        float azimuth = p * 2.39996323f; // Golden angle
+        float x = center.x + radius * sinf(polar) * cosf(azimuth);
+        float y = center.y + radius * sinf(polar) * sinf(azimuth);
+        float z = center.z + radius * cosf(polar);
+        if (!point_hidden(x, y, z)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Depth of the nearest wall along a view ray, the far plane when it hits none
+static float wall_depth(float view_x_over_z, float view_y_over_z) {
+    float nearest_z = TEST_FAR;
+    for (uint32_t i = 0; i < g_wall_count; ++i) {
+        const TestWall *wall = &g_walls[i];
+        float x = view_x_over_z * wall->z;
+        float y = view_y_over_z * wall->z;
+        if (wall->z < nearest_z && x >= wall->min_x && x <= wall->max_x && y >= wall->min_y && y <= wall->max_y) {
+            nearest_z = wall->z;
+        }
+    }
+    return project_depth(nearest_z);
+}
+
+static float project_depth(float view_z) {
+    return (TEST_FAR / (TEST_FAR - TEST_NEAR)) * (1.0f - TEST_NEAR / view_z);
+}
+
+static bool point_hidden(float x, float y, float z) {
+    if (z <= TEST_NEAR) {
+        return false;
+    }
+    return wall_depth(x / z, y / z) < project_depth(z);
+}
@@ -0,0 +1,210 @@
+#include "test.hpp"
+
+#include "arena.hpp"
+#include "asset_registry.hpp"
+#include "pack_file.hpp"
+#include "vfs.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#define TEST_FILES 48
+#define TEST_MAX_FILE_SIZE (64 * 1024)
+// File 0 is empty, file 1 has the same bytes as file 3
+#define TEST_EMPTY_FILE 0
+#define TEST_COPY_FILE 1
+#define TEST_COPIED_FILE 3
+#define TEST_LOOSE_FILE 5
+
+struct TestFile {
+    char name[ASSET_PATH_MAX]; // What the pack knows it by
+    char path[ASSET_PATH_MAX]; // Where it is on disk
+    uint8_t *data;
+    size_t size;
+};
+
+// Too big for the stack
+static TestFile g_files[TEST_FILES];
+
+static void check_files(PackFile *pack);
+static void check_open(const uint8_t *pack_data, size_t size);
+static bool read_whole(const char *path, uint8_t **out_data, size_t *out_size);
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng);
+
+void pack_file_test::run() {
+    char dir[512];
+    if (!CHECK(test::make_temp_dir("pack_file", dir, sizeof(dir)))) return;
+
+    // Text-like, noise and long runs, some a few folders down
+    uint32_t rng = 0x9ac4;
+    for (uint32_t i = 0; i < TEST_FILES; ++i) {
+        TestFile *file = &g_files[i];
+        snprintf(file->name, sizeof(file->name), i % 4 == 0 ? "assets/pack_test/nested/deep/file_%u.bin" : "assets/pack_test/file_%u.bin", i);
+        snprintf(file->path, sizeof(file->path), "%s/file_%u.bin", dir, i);
+        file->size = i == TEST_EMPTY_FILE ? 0 : test::next_random(&rng) % TEST_MAX_FILE_SIZE + 1;
+        file->data = new uint8_t[file->size + 1];
+        fill(file->data, file->size, i % 3, &rng);
+    }
+    g_files[TEST_COPY_FILE].size = g_files[TEST_COPIED_FILE].size;
+    delete[] g_files[TEST_COPY_FILE].data;
+    g_files[TEST_COPY_FILE].data = new uint8_t[g_files[TEST_COPY_FILE].size];
+    memcpy(g_files[TEST_COPY_FILE].data, g_files[TEST_COPIED_FILE].data, g_files[TEST_COPY_FILE].size);
+    bool ok = true;
+    for (uint32_t i = 0; i < TEST_FILES; ++i) {
+        ok &= CHECK(test::write_file(g_files[i].path, g_files[i].data, g_files[i].size));
+    }
+
+    // The copy is stored once, something compressed
+    char pack_path[ASSET_PATH_MAX];
+    snprintf(pack_path, sizeof(pack_path), "%s/test" PACK_FILE_EXTENSION, dir);
+    PackSource sources[TEST_FILES];
+    for (uint32_t i = 0; i < TEST_FILES; ++i) {
+        sources[i] = {g_files[i].name, g_files[i].path};
+    }
+    PackWriteStats stats = {};
+    ok &= CHECK(pack_file::write(pack_path, sources, TEST_FILES, &stats));
+    ok &= CHECK(stats.files == TEST_FILES && stats.shared == 1 && stats.compressed > 0);
+
+    // Two names for the same path is a mistake in what was asked for
+    char twice_path[ASSET_PATH_MAX];
+    snprintf(twice_path, sizeof(twice_path), "%s.twice", pack_path);
+    PackSource twice[] = {{"assets/a.bin", g_files[2].path}, {"./Assets\\A.bin", g_files[2].path}};
+    CHECK(!pack_file::write(twice_path, twice, 2, nullptr) && !std::filesystem::exists(twice_path));
+
+    uint8_t *pack_data = nullptr;
+    size_t pack_size = 0;
+    PackFile pack;
+    if (ok && CHECK(read_whole(pack_path, &pack_data, &pack_size)) && CHECK(pack_file::open(&pack, pack_data, pack_size))) {
+        check_open(pack_data, pack_size);
+        if (CHECK(vfs::mount(pack_path))) {
+            check_files(&pack);
+            vfs::unmount();
+            CHECK(!vfs::is_mounted());
+        }
+    }
+
+    delete[] pack_data;
+    for (uint32_t i = 0; i < TEST_FILES; ++i) {
+        delete[] g_files[i].data;
+    }
+}
+
+// Every file through the vfs, spelled a few ways, then what isn't in the pack
+static void check_files(PackFile *pack) {
+    Arena *scratch = arena::scratch();
+    for (uint32_t i = 0; i < TEST_FILES; ++i) {
+        const TestFile *file = &g_files[i];
+        char upper[ASSET_PATH_MAX];
+        char dotted[ASSET_PATH_MAX];
+        for (size_t c = 0; c <= strlen(file->name); ++c) {
+            char ch = file->name[c];
+            upper[c] = ch == '/' ? '\\' : (ch >= 'a' && ch <= 'z' ? (char)(ch - 'a' + 'A') : ch);
+        }
+        snprintf(dotted, sizeof(dotted), "./assets/pack_test/../%s", file->name + strlen("assets/"));
+        const char *spellings[] = {file->name, upper, dotted};
+
+        const PackEntry *entry = pack_file::find(pack, file->name);
+        if (!CHECK(entry != nullptr)) return;
+        for (uint32_t s = 0; s < 3; ++s) {
+            ArenaMarker marker = arena::get_marker(scratch);
+            const uint8_t *data = nullptr;
+            size_t size = 0;
+            VfsStat stat = {};
+            bool ok = CHECK(vfs::read(spellings[s], scratch, &data, &size) && size == file->size && memcmp(data, file->data, size) == 0);
+            // Stored files come straight out of the mapping, aligned to the page
+            if (entry->compression == PACK_COMPRESSION_NONE) {
+                ok &= CHECK(entry->offset % PACK_FILE_ALIGNMENT == 0 && (uintptr_t)data % PACK_FILE_ALIGNMENT == 0);
+            }
+            ok &= CHECK(vfs::stat(spellings[s], &stat) && stat.is_packed && stat.size == file->size);
+            ok &= CHECK(stat.version == asset_registry::hash_bytes(0, file->data, file->size));
+            arena::rewind(scratch, marker);
+            if (!ok) return;
+        }
+    }
+
+    // Not in the pack goes to disk, not anywhere fails
+    ArenaMarker marker = arena::get_marker(scratch);
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    VfsStat stat = {};
+    const TestFile *loose = &g_files[TEST_LOOSE_FILE];
+    CHECK(vfs::read(loose->path, scratch, &data, &size) && size == loose->size && memcmp(data, loose->data, size) == 0);
+    CHECK(vfs::stat(loose->path, &stat) && !stat.is_packed && stat.size == loose->size);
+    CHECK(!vfs::read("assets/pack_test/missing.bin", scratch, &data, &size) && !vfs::stat("assets/pack_test/missing.bin", &stat));
+    arena::rewind(scratch, marker);
+
+    VfsStats vfs_stats = vfs::get_stats();
+    CHECK(vfs_stats.packed_reads == TEST_FILES * 3 && vfs_stats.loose_reads == 1);
+}
+
+// Each of these has to be turned away, one thing broken at a time
+static void check_open(const uint8_t *pack_data, size_t size) {
+    uint8_t *copy = new uint8_t[size];
+    PackFile pack;
+    for (uint32_t c = 0; c < 6; ++c) {
+        memcpy(copy, pack_data, size);
+        PackHeader *header = (PackHeader *)copy;
+        PackEntry *entries = (PackEntry *)(copy + sizeof(PackHeader));
+        size_t copy_size = size;
+        switch (c) {
+            case 0:
+                copy_size = size - 1;
+                break;
+            case 1:
+                header->magic ^= 1;
+                break;
+            case 2:
+                header->version++;
+                break;
+            case 3: {
+                PackEntry swap = entries[0];
+                entries[0] = entries[1];
+                entries[1] = swap;
+                break;
+            }
+            case 4:
+                entries[header->entry_count - 1].stored_size = size;
+                break;
+            default:
+                copy[sizeof(PackHeader) + header->entry_count * sizeof(PackEntry) + header->names_size - 1] = 'x';
+                break;
+        }
+        CHECK(!pack_file::open(&pack, copy, copy_size));
+    }
+    CHECK(!pack_file::open(&pack, pack_data, sizeof(PackHeader) - 1));
+    delete[] copy;
+}
+
+static bool read_whole(const char *path, uint8_t **out_data, size_t *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *out_data = new uint8_t[length > 0 ? length : 1];
+    *out_size = (size_t)length;
+    bool is_read = length >= 0 && fread(*out_data, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    return is_read;
+}
+
+static void fill(uint8_t *data, size_t size, uint32_t pattern, uint32_t *rng) {
+    for (size_t i = 0; i < size;) {
+        if (pattern == 0) {
+            // Letters and spaces, compresses about the way configs do
+            data[i++] = test::next_random(rng) % 8 == 0 ? ' ' : (uint8_t)('a' + test::next_random(rng) % 6);
+        } else if (pattern == 1) {
+            data[i++] = (uint8_t)test::next_random(rng);
+        } else {
+            // Runs of a byte, like uncompressed image rows
+            uint8_t value = (uint8_t)test::next_random(rng);
+            for (uint32_t run = test::next_random(rng) % 64 + 1; run > 0 && i < size; --run) {
+                data[i++] = value;
+            }
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#include "test.hpp"
+
+#include "range_allocator.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+// The geometry arena's vertex buffer
+#define TEST_CAPACITY (1u << 19)
+#define TEST_OPS 20000
+#define TEST_MAX_LIVE 256
+
+static RangeAllocator g_allocator;
+static RangeAllocation g_live[TEST_MAX_LIVE];
+static RangeAllocation g_sorted[TEST_MAX_LIVE];
+static RangeMove g_moves[RANGE_ALLOCATOR_MAX_NODES];
+
+static uint32_t random_size(uint32_t *rng);
+static bool check_live(uint32_t live_count);
+static void refresh_live(uint32_t live_count);
+static int compare_offset(const void *a, const void *b);
+
+void range_allocator_test::run() {
+    range_allocator::initialize(&g_allocator, TEST_CAPACITY);
+    CHECK(range_allocator::allocate(&g_allocator, 0).node == RANGE_ALLOCATOR_NONE);
+    CHECK(range_allocator::allocate(&g_allocator, TEST_CAPACITY + 1).node == RANGE_ALLOCATOR_NONE);
+    RangeAllocation all = range_allocator::allocate(&g_allocator, TEST_CAPACITY);
+    CHECK(all.node != RANGE_ALLOCATOR_NONE && all.offset == 0 && all.size == TEST_CAPACITY);
+    CHECK(range_allocator::allocate(&g_allocator, 1).node == RANGE_ALLOCATOR_NONE);
+    range_allocator::release(&g_allocator, all);
+
+    // Mesh sized loads and unloads at random. The live ranges never overlap,
+    // and an allocation only fails when there isn't that much space left,
+    // after a compact like mesh::load does.
+    uint32_t rng = 0x9E3779B9u;
+    uint32_t live_count = 0;
+    uint32_t compactions = 0;
+    for (uint32_t op = 0; op < TEST_OPS; ++op) {
+        bool load = live_count == 0 || (live_count < TEST_MAX_LIVE && test::next_random(&rng) % 100 < 55);
+        if (!load) {
+            uint32_t index = test::next_random(&rng) % live_count;
+            range_allocator::release(&g_allocator, g_live[index]);
+            g_live[index] = g_live[--live_count];
+        } else {
+            uint32_t size = random_size(&rng);
+            RangeAllocation allocation = range_allocator::allocate(&g_allocator, size);
+            if (allocation.node == RANGE_ALLOCATOR_NONE && size <= g_allocator.free_units) {
+                range_allocator::compact(&g_allocator, g_moves, RANGE_ALLOCATOR_MAX_NODES);
+                refresh_live(live_count);
+                compactions++;
+                allocation = range_allocator::allocate(&g_allocator, size);
+                if (!CHECK(allocation.node != RANGE_ALLOCATOR_NONE)) break;
+            }
+            if (allocation.node != RANGE_ALLOCATOR_NONE) {
+                if (!CHECK(allocation.size >= size)) break;
+                g_live[live_count++] = allocation;
+            }
+        }
+
+        if (!CHECK(check_live(live_count))) break;
+    }
+    // Fragmented enough to need it now and then
+    CHECK(compactions > 0);
+
+    // A compact moves everything down in offset order and leaves one free
+    // block at the end. The nodes stay the same.
+    uint32_t move_count = range_allocator::compact(&g_allocator, g_moves, RANGE_ALLOCATOR_MAX_NODES);
+    for (uint32_t i = 0; i < move_count; ++i) {
+        RangeAllocation moved = range_allocator::get(&g_allocator, g_moves[i].node);
+        CHECK(moved.offset == g_moves[i].to && moved.size == g_moves[i].size && g_moves[i].to < g_moves[i].from);
+        CHECK(i == 0 || g_moves[i].to > g_moves[i - 1].to);
+    }
+    refresh_live(live_count);
+    CHECK(check_live(live_count));
+    RangeAllocatorStats stats = range_allocator::get_stats(&g_allocator);
+    CHECK(stats.free_blocks <= 1 && stats.largest_free == stats.free_units);
+    uint32_t end = 0;
+    for (uint32_t i = 0; i < live_count; ++i) {
+        end = g_sorted[i].offset == end ? end + g_sorted[i].size : UINT32_MAX;
+    }
+    CHECK(end == stats.used_units);
+
+    for (uint32_t i = 0; i < live_count; ++i) {
+        range_allocator::release(&g_allocator, g_live[i]);
+    }
+    stats = range_allocator::get_stats(&g_allocator);
+    CHECK(stats.allocations == 0 && stats.free_blocks == 1 && stats.largest_free == TEST_CAPACITY);
+}
+
+// Log-uniform from a cube to a big scanned model, most meshes are small
+static uint32_t random_size(uint32_t *rng) {
+    uint32_t bits = 5 + test::next_random(rng) % 11;
+    uint32_t base = 1u << bits;
+    return base + test::next_random(rng) % base;
+}
+
+// No overlaps, all inside the space and the stats add up. Leaves the ranges
+// sorted by offset in g_sorted.
+static bool check_live(uint32_t live_count) {
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < live_count; ++i) {
+        g_sorted[i] = g_live[i];
+        used += g_live[i].size;
+    }
+    qsort(g_sorted, live_count, sizeof(RangeAllocation), compare_offset);
+
+    uint32_t end = 0;
+    for (uint32_t i = 0; i < live_count; ++i) {
+        if (g_sorted[i].offset < end || g_sorted[i].offset + g_sorted[i].size > TEST_CAPACITY) {
+            return false;
+        }
+        end = g_sorted[i].offset + g_sorted[i].size;
+    }
+
+    RangeAllocatorStats stats = range_allocator::get_stats(&g_allocator);
+    return stats.allocations == live_count && stats.used_units == used && stats.used_units + stats.free_units == TEST_CAPACITY;
+}
+
+// Ranges keep their node through a compact
+static void refresh_live(uint32_t live_count) {
+    for (uint32_t i = 0; i < live_count; ++i) {
+        RangeAllocation now = range_allocator::get(&g_allocator, g_live[i].node);
+        if (now.size != g_live[i].size) {
+            now.size = 0; // check_live's sums won't add up
+        }
+        g_live[i] = now;
+    }
+}
+
+static int compare_offset(const void *a, const void *b) {
+    uint32_t lhs = ((const RangeAllocation *)a)->offset;
+    uint32_t rhs = ((const RangeAllocation *)b)->offset;
+    return (lhs > rhs) - (lhs < rhs);
+}
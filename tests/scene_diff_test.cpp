@@ -0,0 +1,204 @@
+#include "test.hpp"
+
+#include "arena.hpp"
+#include "scene_diff.hpp"
+#include "scene_file.hpp"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#define TEST_INSTANCES 3000
+#define TEST_TEXTURES 60
+#define TEST_MATERIALS 30
+#define TEST_MESHES 40
+// Every this many instances the edited config moves one
+#define TEST_MOVE_EVERY 100
+
+// The config every case starts from, a case swaps out one part of it
+static const char s_base_textures[] = R"([{"id": 10, "path": "a.png", "srgb": true}, {"id": 11, "path": "b.png"}, {"id": 12, "path": "c.png"}])";
+static const char s_base_materials[] = R"([{"id": 20, "albedo_map": 10, "normal_map": 11, "roughness": 0.5}, {"id": 21, "albedo_map": 12}, {"id": 22, "metallic": 1.0}])";
+static const char s_base_meshes[] = R"([{"id": 30, "path": "a.glb"}, {"id": 31, "path": "b.glb"}])";
+static const char s_base_scenes[] = R"([{"meshes": [
+    {"mesh_id": 30, "material_id": 20, "position": [0, 0, 0]}, {"mesh_id": 30, "material_id": 20, "position": [1, 0, 0]},
+    {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]},
+    {"meshes": [{"mesh_id": 30, "material_id": 22}]}])";
+
+// NULL parts are the base ones. The expected diff is each list in turn
+// (textures, materials, meshes, instances): an action per new index with the
+// old index it came from, k(eep) u(pdate) r(eload) a(dd), then every old
+// index that was removed.
+struct DiffCase {
+    const char *name;
+    const char *textures;
+    const char *materials;
+    const char *meshes;
+    const char *scenes;
+    const char *expected;
+};
+
+static const DiffCase s_cases[] = {
+    {"nothing changed", nullptr, nullptr, nullptr, nullptr, "k0k1k2 k0k1k2 k0k1 k0k1k2k3k4"},
+    {"a material value", nullptr, R"([{"id": 20, "albedo_map": 10, "normal_map": 11, "roughness": 0.75}, {"id": 21, "albedo_map": 12}, {"id": 22, "metallic": 1.0}])",
+     nullptr, nullptr, "k0k1k2 u0k1k2 k0k1 k0k1k2k3k4"},
+    {"a texture file", R"([{"id": 10, "path": "a.png", "srgb": true}, {"id": 11, "path": "b.png"}, {"id": 12, "path": "d.png"}])", nullptr, nullptr, nullptr,
+     "k0k1r2 k0u1k2 k0k1 k0k1k2k3k4"},
+    {"a texture flag", R"([{"id": 10, "path": "a.png"}, {"id": 11, "path": "b.png"}, {"id": 12, "path": "c.png"}])", nullptr, nullptr, nullptr,
+     "r0k1k2 u0k1k2 k0k1 k0k1k2k3k4"},
+    {"a texture removed", R"([{"id": 10, "path": "a.png", "srgb": true}, {"id": 12, "path": "c.png"}])", nullptr, nullptr, nullptr,
+     "k0k2-1 u0k1k2 k0k1 k0k1k2k3k4"},
+    {"textures in another order", R"([{"id": 12, "path": "c.png"}, {"id": 10, "path": "a.png", "srgb": true}, {"id": 11, "path": "b.png"}])", nullptr, nullptr,
+     nullptr, "k2k0k1 k0k1k2 k0k1 k0k1k2k3k4"},
+    {"a mesh file", nullptr, nullptr, R"([{"id": 30, "path": "a.glb"}, {"id": 31, "path": "c.glb"}])", nullptr, "k0k1k2 k0k1k2 k0r1 k0k1aak4-2-3"},
+    {"a material removed", nullptr, R"([{"id": 20, "albedo_map": 10, "normal_map": 11, "roughness": 0.5}, {"id": 21, "albedo_map": 12}])", nullptr, nullptr,
+     "k0k1k2 k0k1-2 k0k1 k0k1k2k3a-4"},
+    {"an instance moved", nullptr, nullptr, nullptr, R"([{"meshes": [
+        {"mesh_id": 30, "material_id": 20, "position": [0, 0, 0]}, {"mesh_id": 30, "material_id": 20, "position": [1, 5, 0]},
+        {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]},
+        {"meshes": [{"mesh_id": 30, "material_id": 22}]}])",
+     "k0k1k2 k0k1k2 k0k1 k0u1k2k3k4"},
+    {"an instance added in front", nullptr, nullptr, nullptr, R"([{"meshes": [{"mesh_id": 30, "material_id": 20, "position": [9, 0, 0]},
+        {"mesh_id": 30, "material_id": 20, "position": [0, 0, 0]}, {"mesh_id": 30, "material_id": 20, "position": [1, 0, 0]},
+        {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]},
+        {"meshes": [{"mesh_id": 30, "material_id": 22}]}])",
+     "k0k1k2 k0k1k2 k0k1 ak0k1k2k3k4"},
+    {"an instance removed", nullptr, nullptr, nullptr, R"([{"meshes": [
+        {"mesh_id": 30, "material_id": 20, "position": [0, 0, 0]},
+        {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]},
+        {"meshes": [{"mesh_id": 30, "material_id": 22}]}])",
+     "k0k1k2 k0k1k2 k0k1 k0k2k3k4-1"},
+    {"an instance's material", nullptr, nullptr, nullptr, R"([{"meshes": [
+        {"mesh_id": 30, "material_id": 22, "position": [0, 0, 0]}, {"mesh_id": 30, "material_id": 20, "position": [1, 0, 0]},
+        {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]},
+        {"meshes": [{"mesh_id": 30, "material_id": 22}]}])",
+     "k0k1k2 k0k1k2 k0k1 ak1k2k3k4-0"},
+    {"a scene removed", nullptr, nullptr, nullptr, R"([{"meshes": [
+        {"mesh_id": 30, "material_id": 20, "position": [0, 0, 0]}, {"mesh_id": 30, "material_id": 20, "position": [1, 0, 0]},
+        {"mesh_id": 31, "material_id": 21, "position": [2, 0, 0]}, {"mesh_id": 31, "position": [3, 0, 0]}]}])",
+     "k0k1k2 k0k1k2 k0k1 k0k1k2k3-4"},
+    {"everything removed", "[]", "[]", "[]", "[]", "-0-1-2 -0-1-2 -0-1 -0-1-2-3-4"},
+};
+
+static bool load(const char *textures, const char *materials, const char *meshes, const char *scenes, Arena *arena, SceneFile *out_file);
+static void describe(const SceneDiff *diff, std::string *out);
+static void generate(std::string *out, uint32_t instances, bool is_edited);
+static void append(std::string *out, const char *format, ...);
+
+void scene_diff_test::run() {
+    Arena arena;
+    if (!CHECK(arena::initialize(&arena, ARENA_SCRATCH_RESERVE))) return;
+    SceneFile base = {};
+    if (!CHECK(load(nullptr, nullptr, nullptr, nullptr, &arena, &base))) {
+        arena::shutdown(&arena);
+        return;
+    }
+
+    for (uint32_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); ++i) {
+        const DiffCase *test = &s_cases[i];
+        ArenaMarker marker = arena::get_marker(&arena);
+        SceneFile file = {};
+        SceneDiff diff = {};
+        std::string described;
+        if (CHECK(load(test->textures, test->materials, test->meshes, test->scenes, &arena, &file)) &&
+            CHECK(scene_diff::compute(&base, &file, &arena, &diff))) {
+            describe(&diff, &described);
+            if (!CHECK(described == test->expected)) {
+                printf("  %s gave %s, expected %s\n", test->name, described.c_str(), test->expected);
+            }
+        }
+        arena::rewind(&arena, marker);
+    }
+
+    // Nothing loaded before adds everything
+    ArenaMarker marker = arena::get_marker(&arena);
+    SceneDiff diff = {};
+    std::string described;
+    CHECK(scene_diff::compute(nullptr, &base, &arena, &diff));
+    describe(&diff, &described);
+    CHECK(described == "aaa aaa aa aaaaa");
+    arena::rewind(&arena, marker);
+
+    // A big config against itself and against an edit: one material and every
+    // TEST_MOVE_EVERY instance moved, one instance more at the front
+    std::string json;
+    std::string edited_json;
+    generate(&json, TEST_INSTANCES, false);
+    generate(&edited_json, TEST_INSTANCES, true);
+    SceneFile file = {};
+    SceneFile edited = {};
+    SceneDiff same = {};
+    SceneDiff changed = {};
+    if (CHECK(scene_file::from_json(json.data(), json.size(), &arena, &file)) &&
+        CHECK(scene_file::from_json(edited_json.data(), edited_json.size(), &arena, &edited))) {
+        CHECK(scene_diff::compute(&file, &file, &arena, &same) && scene_diff::is_empty(&same));
+        CHECK(scene_diff::compute(&file, &edited, &arena, &changed) && !scene_diff::is_empty(&changed));
+        uint32_t moved = (TEST_INSTANCES + TEST_MOVE_EVERY - 1) / TEST_MOVE_EVERY;
+        CHECK(changed.materials.changed_count == 1 && changed.textures.changed_count == 0 && changed.meshes.changed_count == 0);
+        CHECK(changed.instances.changed_count == moved + 1 && changed.instances.removed_count == 0);
+    }
+    arena::shutdown(&arena);
+}
+
+static bool load(const char *textures, const char *materials, const char *meshes, const char *scenes, Arena *arena, SceneFile *out_file) {
+    std::string json;
+    append(&json, "{\"textures\": %s, \"materials\": %s, \"meshes\": %s, \"scenes\": %s}", textures ? textures : s_base_textures,
+           materials ? materials : s_base_materials, meshes ? meshes : s_base_meshes, scenes ? scenes : s_base_scenes);
+    return scene_file::from_json(json.data(), json.size(), arena, out_file);
+}
+
+static void describe(const SceneDiff *diff, std::string *out) {
+    static const char actions[] = {'k', 'u', 'r', 'a'};
+    const SceneDiffList *lists[] = {&diff->textures, &diff->materials, &diff->meshes, &diff->instances};
+    for (uint32_t l = 0; l < 4; ++l) {
+        if (l > 0) {
+            out->push_back(' ');
+        }
+        for (uint32_t i = 0; i < lists[l]->count; ++i) {
+            out->push_back(actions[lists[l]->actions[i]]);
+            if (lists[l]->actions[i] != SCENE_DIFF_ADD) {
+                append(out, "%u", lists[l]->sources[i]);
+            }
+        }
+        for (uint32_t r = 0; r < lists[l]->removed_count; ++r) {
+            append(out, "-%u", lists[l]->removed[r]);
+        }
+    }
+}
+
+static void generate(std::string *out, uint32_t instances, bool is_edited) {
+    out->reserve((size_t)instances * 120 + 64 * 1024);
+    append(out, "{\"textures\": [");
+    for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+        append(out, "%s{\"id\": %u, \"path\": \"assets/generated/texture_%u.png\"}", i ? ", " : "", i * 7 + 100, i);
+    }
+    append(out, "], \"materials\": [");
+    for (uint32_t i = 0; i < TEST_MATERIALS; ++i) {
+        float roughness = is_edited && i == TEST_MATERIALS / 2 ? 0.125f : 0.5f;
+        append(out, "%s{\"id\": %u, \"albedo_map\": %u, \"normal_map\": %u, \"roughness\": %g}", i ? ", " : "", i + 5000, (i * 2) * 7 + 100,
+               (i * 2 + 1) * 7 + 100, roughness);
+    }
+    append(out, "], \"meshes\": [");
+    for (uint32_t i = 0; i < TEST_MESHES; ++i) {
+        append(out, "%s{\"id\": %u, \"path\": \"assets/generated/mesh_%u.glb\"}", i ? ", " : "", i * 3 + 90000, i);
+    }
+    append(out, "], \"scenes\": [{\"meshes\": [\n");
+    if (is_edited) {
+        append(out, "{\"mesh_id\": 90000, \"material_id\": 5000, \"position\": [-1, -1, -1]},\n");
+    }
+    for (uint32_t i = 0; i < instances; ++i) {
+        float y = is_edited && i % TEST_MOVE_EVERY == 0 ? 10.0f : 0.0f;
+        append(out, "{\"mesh_id\": %u, \"material_id\": %u, \"position\": [%u, %g, %u], \"rotation\": [0, %u, 0]}%s\n", (i % TEST_MESHES) * 3 + 90000,
+               i % TEST_MATERIALS + 5000, i % 100, y, i / 100, i % 360, i + 1 < instances ? "," : "");
+    }
+    append(out, "]}]}\n");
+}
+
+static void append(std::string *out, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out->append(line, length > 0 ? (size_t)length : 0);
+}
@@ -0,0 +1,231 @@
+#include "test.hpp"
+
+#include "arena.hpp"
+#include "scene_file.hpp"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define TEST_INSTANCES 3000
+#define TEST_TEXTURES 300
+#define TEST_MATERIALS 400
+#define TEST_MESHES 500
+#define TEST_SCENES 3
+
+// Fields left out and references to nothing, every one has to load with its default
+static const char s_sparse_json[] = R"({
+    "textures": [{"id": 300}, {"id": 301, "path": "assets/a.png", "srgb": true}, {"id": 302, "path": "assets/b.png", "srgb": 1}],
+    "materials": [{"id": 1000, "albedo_map": 300, "normal_map": 302, "albedo": [0.5]}, {"roughness": 0.25}],
+    "meshes": [{"id": 70000, "path": "assets/a.glb"}, {"id": 70001}],
+    "scenes": [{"meshes": [{"mesh_id": 70000, "material_id": 1000}, {"mesh_id": 5}, {"mesh_id": 70000, "material_id": 9, "scale": [2.0, 3.0]}], "cameras": [{}]}, {}]
+})";
+
+// Ones without an id go past the highest, wherever they are in the array
+static const char s_missing_ids_json[] = R"({
+    "textures": [{"path": "assets/a.png"}, {"id": 1, "path": "assets/b.png"}, {"path": "assets/c.png"}],
+    "materials": [{"id": 1}, {}, {"albedo_map": 3}],
+    "meshes": [{"path": "assets/a.glb"}, {"path": "assets/b.glb"}],
+    "scenes": [{"meshes": [{"mesh_id": 1, "material_id": 3}, {"mesh_id": 0, "material_id": 2}]}]
+})";
+
+static const char *s_broken_json[] = {
+    "{\"meshes\": [{\"id\": 1, \"path\": \"a.glb\"}, {\"id\": 1, \"path\": \"b.glb\"}]}",
+    "{\"textures\": [{\"id\": 4, \"path\": \"a.png\"}, {\"id\": 4, \"path\": \"b.png\"}]}",
+    // No id left for the one without
+    "{\"materials\": [{\"id\": 2147483647}, {}]}",
+    "{\"scenes\": [",
+    "",
+};
+
+static void check_round_trip(const char *dir, Arena *arena);
+static void check_sparse(Arena *arena);
+static void check_missing_ids(Arena *arena);
+static void check_broken(const SceneFile *file, Arena *arena);
+static bool is_same(const SceneFile *a, const SceneFile *b);
+static void generate(std::string *out, uint32_t instances);
+static void append(std::string *out, const char *format, ...);
+
+void scene_file_test::run() {
+    char dir[512];
+    if (!CHECK(test::make_temp_dir("scene_file", dir, sizeof(dir)))) return;
+    Arena arena;
+    if (!CHECK(arena::initialize(&arena, ARENA_SCRATCH_RESERVE))) return;
+
+    check_round_trip(dir, &arena);
+    check_sparse(&arena);
+    check_missing_ids(&arena);
+
+    for (uint32_t i = 0; i < sizeof(s_broken_json) / sizeof(s_broken_json[0]); ++i) {
+        SceneFile broken = {};
+        CHECK(!scene_file::from_json(s_broken_json[i], strlen(s_broken_json[i]), &arena, &broken));
+    }
+    arena::shutdown(&arena);
+}
+
+// JSON -> file -> JSON -> file has to come out the same block, and so does
+// the file written to disk and read back either way. Ids far past a byte.
+static void check_round_trip(const char *dir, Arena *arena) {
+    std::string json;
+    generate(&json, TEST_INSTANCES);
+    SceneFile first = {};
+    SceneFile second = {};
+    SceneFile from_disk = {};
+    SceneFile from_json_file = {};
+    char *text = nullptr;
+    size_t text_size = 0;
+    if (!CHECK(scene_file::from_json(json.c_str(), json.size(), arena, &first))) return;
+    CHECK(first.header->instance_count == TEST_INSTANCES && first.header->material_count == TEST_MATERIALS);
+    CHECK(scene_file::to_json(&first, arena, &text, &text_size) && scene_file::from_json(text, text_size, arena, &second) && is_same(&first, &second));
+
+    std::string scene_path = std::string(dir) + "/round_trip" SCENE_FILE_EXTENSION;
+    std::string json_path = std::string(dir) + "/round_trip.json";
+    CHECK(scene_file::write(scene_path.c_str(), &first) && scene_file::read(scene_path.c_str(), arena, &from_disk) && is_same(&first, &from_disk));
+    CHECK(scene_file::write_json(json_path.c_str(), &first) && scene_file::read(json_path.c_str(), arena, &from_json_file) &&
+          is_same(&first, &from_json_file));
+
+    check_broken(&first, arena);
+    arena::reset(arena);
+}
+
+static void check_sparse(Arena *arena) {
+    ArenaMarker marker = arena::get_marker(arena);
+    SceneFile file = {};
+    if (!CHECK(scene_file::from_json(s_sparse_json, sizeof(s_sparse_json) - 1, arena, &file))) return;
+
+    // The texture without a path is gone, so are the mesh without one and its instance
+    const SceneFileHeader *header = file.header;
+    CHECK(header->texture_count == 2 && header->material_count == 2 && header->mesh_count == 1 && header->scene_count == 2);
+    CHECK(header->camera_count == 1 && header->instance_count == 2);
+    CHECK(file.textures[0].json_id == 301 && file.textures[0].is_srgb && file.textures[1].is_srgb);
+    CHECK(strcmp(scene_file::get_string(&file, file.meshes[0].path_offset), "assets/a.glb") == 0 && file.meshes[0].json_id == 70000);
+
+    const SceneFileMaterial *material = &file.materials[0];
+    CHECK(material->maps[SCENE_FILE_MAP_ALBEDO] == SCENE_FILE_NONE && material->maps[SCENE_FILE_MAP_NORMAL] == 1);
+    CHECK(material->maps[SCENE_FILE_MAP_METALLIC] == SCENE_FILE_NONE && material->albedo[0] == 0.5f && material->albedo[1] == 1.0f);
+    CHECK(material->roughness == 1.0f && file.materials[1].roughness == 0.25f && file.materials[1].json_id == 1001);
+
+    const SceneFileInstance *instances = file.instances;
+    CHECK(instances[0].mesh == 0 && instances[0].material == 0 && instances[1].material == SCENE_FILE_NONE);
+    CHECK(instances[1].scale[0] == 2.0f && instances[1].scale[1] == 3.0f && instances[1].scale[2] == 1.0f);
+    CHECK(file.cameras[0].fov == 45.0f && file.cameras[0].position[2] == -10.0f && file.scenes[1].instance_count == 0);
+    arena::rewind(arena, marker);
+}
+
+static void check_missing_ids(Arena *arena) {
+    ArenaMarker marker = arena::get_marker(arena);
+    SceneFile file = {};
+    if (!CHECK(scene_file::from_json(s_missing_ids_json, sizeof(s_missing_ids_json) - 1, arena, &file))) return;
+
+    CHECK(file.textures[0].json_id == 2 && file.textures[1].json_id == 1 && file.textures[2].json_id == 3);
+    CHECK(file.materials[0].json_id == 1 && file.materials[1].json_id == 2 && file.materials[2].json_id == 3);
+    CHECK(file.materials[2].maps[SCENE_FILE_MAP_ALBEDO] == 2);
+    // Nothing there to go past, the same as their index
+    CHECK(file.meshes[0].json_id == 0 && file.meshes[1].json_id == 1);
+    CHECK(file.header->instance_count == 2 && file.instances[0].mesh == 1 && file.instances[0].material == 2);
+    CHECK(file.instances[1].mesh == 0 && file.instances[1].material == 1);
+
+    // Written back with the ids they got, so it loads the same
+    char *text = nullptr;
+    size_t text_size = 0;
+    SceneFile again = {};
+    CHECK(scene_file::to_json(&file, arena, &text, &text_size) && scene_file::from_json(text, text_size, arena, &again) && is_same(&file, &again));
+    arena::rewind(arena, marker);
+}
+
+// Each of these has to be turned away, one thing broken at a time
+static void check_broken(const SceneFile *file, Arena *arena) {
+    ArenaMarker marker = arena::get_marker(arena);
+    uint8_t *copy = (uint8_t *)arena::push(arena, file->size, ARENA_DEFAULT_ALIGN);
+    if (!CHECK(copy != nullptr)) return;
+
+    for (uint32_t c = 0; c < 7; ++c) {
+        memcpy(copy, file->data, file->size);
+        SceneFileHeader *header = (SceneFileHeader *)copy;
+        size_t size = file->size;
+        switch (c) {
+            case 0:
+                size -= 8;
+                break;
+            case 1:
+                header->magic ^= 1;
+                break;
+            case 2:
+                header->version++;
+                break;
+            case 3:
+                ((SceneFileInstance *)(copy + header->instances_offset))[header->instance_count - 1].mesh = header->mesh_count;
+                break;
+            case 4:
+                ((SceneFileMaterial *)(copy + header->materials_offset))[0].maps[SCENE_FILE_MAP_NORMAL] = header->texture_count;
+                break;
+            case 5:
+                ((SceneFileScene *)(copy + header->scenes_offset))[0].instance_count = header->instance_count + 1;
+                break;
+            default:
+                header->instances_offset = size;
+                break;
+        }
+        SceneFile opened = {};
+        CHECK(!scene_file::open(&opened, copy, size));
+    }
+
+    // Not aligned can't be read in place
+    SceneFile opened = {};
+    memcpy(copy, file->data, file->size);
+    CHECK(scene_file::open(&opened, copy, file->size) && !scene_file::open(&opened, copy + 4, file->size - 4));
+    arena::rewind(arena, marker);
+}
+
+static bool is_same(const SceneFile *a, const SceneFile *b) {
+    return a->size == b->size && memcmp(a->data, b->data, a->size) == 0;
+}
+
+static void generate(std::string *out, uint32_t instances) {
+    // Ids spread out far past a byte, the way an editor hands them out
+    append(out, "{\n    \"textures\": [\n");
+    for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+        append(out, "        {\"id\": %u, \"path\": \"assets/generated/texture_%u.png\", \"srgb\": %s}%s\n", i * 37 + 500, i,
+               i % 3 == 0 ? "true" : "false", i + 1 < TEST_TEXTURES ? "," : "");
+    }
+    append(out, "    ],\n    \"materials\": [\n");
+    for (uint32_t i = 0; i < TEST_MATERIALS; ++i) {
+        int map = (int)(i % TEST_TEXTURES) * 37 + 500;
+        append(out,
+               "        {\"id\": %u, \"albedo\": [%g, %g, %g], \"albedo_map\": %d, \"roughness\": %g, \"roughness_map\": -1, \"coat\": 0.0, "
+               "\"coat_map\": -1, \"metallic\": %g, \"metallic_map\": %d, \"normal_map\": %d, \"emission\": 0.0, \"emission_map\": -1}%s\n",
+               i * 1000 + 7, (i % 10) / 10.0, 0.5, 1.0 / (i + 1), map, (i % 7) / 7.0, (i % 2) * 1.0, i % 2 ? map : -1, map,
+               i + 1 < TEST_MATERIALS ? "," : "");
+    }
+    append(out, "    ],\n    \"meshes\": [\n");
+    for (uint32_t i = 0; i < TEST_MESHES; ++i) {
+        append(out, "        {\"id\": %u, \"path\": \"assets/generated/mesh_%u.glb\"}%s\n", 100000 + i * 3, i, i + 1 < TEST_MESHES ? "," : "");
+    }
+    append(out, "    ],\n    \"scenes\": [\n");
+    for (uint32_t s = 0; s < TEST_SCENES; ++s) {
+        uint32_t first = instances * s / TEST_SCENES;
+        uint32_t end = instances * (s + 1) / TEST_SCENES;
+        append(out, "        {\n            \"meshes\": [\n");
+        for (uint32_t i = first; i < end; ++i) {
+            append(out,
+                   "                {\"mesh_id\": %u, \"material_id\": %u, \"position\": [%g, %g, %g], \"rotation\": [0.0, %g, 0.0], \"scale\": [%g, %g, %g]}%s\n",
+                   100000 + (i % TEST_MESHES) * 3, (i % TEST_MATERIALS) * 1000 + 7, (double)(i % 100) * 2.5, (double)(i / 100 % 10),
+                   (double)(i / 1000) * -2.5, (double)(i % 360), 1.0 + (i % 3) * 0.25, 1.0, 1.0 + (i % 5) * 0.1, i + 1 < end ? "," : "");
+        }
+        append(out, "            ],\n            \"cameras\": [\n");
+        append(out, "                {\"fov\": %g, \"znear\": 0.1, \"zfar\": 1000.0, \"position\": [0.0, 5.0, -15.0], \"target\": [0.0, 0.0, 0.0]}\n", 45.0 + s);
+        append(out, "            ]\n        }%s\n", s + 1 < TEST_SCENES ? "," : "");
+    }
+    append(out, "    ]\n}\n");
+}
+
+static void append(std::string *out, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out->append(line, length > 0 ? (size_t)length : 0);
+}
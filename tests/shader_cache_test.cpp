@@ -0,0 +1,161 @@
+#include "test.hpp"
+
+#include "shader_cache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+static bool write_text(const char *dir, const char *name, const char *text);
+static uint64_t resolve_key(const char *path);
+static bool truncate_entry(const char *dir, uint64_t key, long drop);
+static bool corrupt_entry(const char *dir, uint64_t key, long offset_from_end);
+
+void shader_cache_test::run() {
+    char dir[SHADER_PATH_MAX];
+    if (!CHECK(test::make_temp_dir("shader_cache", dir, sizeof(dir)))) return;
+
+    CHECK(write_text(dir, "main.hlsl", "#include \"common.hlsli\"\nfloat4 main() : SV_Target { return color(); }\n"));
+    CHECK(write_text(dir, "common.hlsli", "  #include \"inner.hlsli\"\nfloat4 color() { return INNER; }\n"));
+    CHECK(write_text(dir, "inner.hlsli", "#define INNER float4(1, 0, 0, 1)\n"));
+    CHECK(write_text(dir, "cycle.hlsl", "#include \"cycle.hlsl\"\n"));
+
+    char main_path[SHADER_PATH_MAX];
+    snprintf(main_path, sizeof(main_path), "%s/main.hlsl", dir);
+    ShaderSource source;
+    if (!CHECK(shader_cache::resolve_source(main_path, &source))) return;
+    CHECK(source.include_count == 2);
+    CHECK(strstr(source.text, "#define INNER") && strstr(source.text, "float4 color()") && !strstr(source.text, "#include"));
+    CHECK(strlen(source.text) == source.size);
+    // Each include starts at its own line 1, the file it's in goes on after the include
+    char directive[SHADER_PATH_MAX + 32];
+    snprintf(directive, sizeof(directive), "#line 1 \"%s/inner.hlsli\"\n", dir);
+    CHECK(strstr(source.text, directive));
+    snprintf(directive, sizeof(directive), "\n#line 2 \"%s/common.hlsli\"\nfloat4 color()", dir);
+    CHECK(strstr(source.text, directive));
+    snprintf(directive, sizeof(directive), "\n#line 2 \"%s/main.hlsl\"\nfloat4 main()", dir);
+    CHECK(strstr(source.text, directive));
+
+    // The same compile is the same key, anything that changes the output isn't
+    const char *features[] = {"HAS_ALBEDO_MAP", "HAS_NORMAL_MAP"};
+    const char *other[] = {"HAS_ALBEDO_MAP", "HAS_EMISSION"};
+    uint64_t key = shader_cache::make_key(&source, "main", "ps_5_0", 0, features, 2);
+    CHECK(key == shader_cache::make_key(&source, "main", "ps_5_0", 0, features, 2));
+    CHECK(key != shader_cache::make_key(&source, "main", "ps_5_0", 0, features, 1));
+    CHECK(key != shader_cache::make_key(&source, "main", "ps_5_0", 0, other, 2));
+    CHECK(key != shader_cache::make_key(&source, "main", "ps_5_0", 0, nullptr, 0));
+    CHECK(key != shader_cache::make_key(&source, "main_alpha", "ps_5_0", 0, features, 2));
+    CHECK(key != shader_cache::make_key(&source, "main", "vs_5_0", 0, features, 2));
+    CHECK(key != shader_cache::make_key(&source, "main", "ps_5_0", 1, features, 2));
+    // Where one string ends and the next starts matters
+    CHECK(shader_cache::make_key(&source, "ab", "c", 0, nullptr, 0) != shader_cache::make_key(&source, "a", "bc", 0, nullptr, 0));
+    const char *joined[] = {"AB"};
+    const char *split[] = {"A", "B"};
+    CHECK(shader_cache::make_key(&source, "main", "ps_5_0", 0, joined, 1) != shader_cache::make_key(&source, "main", "ps_5_0", 0, split, 2));
+    shader_cache::free_source(&source);
+
+    // Editing a file two includes down changes the key, touching nothing doesn't
+    uint64_t before = resolve_key(main_path);
+    CHECK(before != 0 && before == resolve_key(main_path));
+    CHECK(write_text(dir, "inner.hlsli", "#define INNER float4(0, 1, 0, 1)\n"));
+    uint64_t after = resolve_key(main_path);
+    CHECK(after != 0 && after != before);
+
+    // Missing includes and cycles don't resolve, nothing to compile then
+    char cycle_path[SHADER_PATH_MAX];
+    snprintf(cycle_path, sizeof(cycle_path), "%s/cycle.hlsl", dir);
+    CHECK(!shader_cache::resolve_source(cycle_path, &source));
+    CHECK(write_text(dir, "inner.hlsli", "#include \"missing.hlsli\"\n"));
+    CHECK(!shader_cache::resolve_source(main_path, &source));
+
+    // Store and load back, then every kind of broken entry is a miss
+    char cache_dir[SHADER_PATH_MAX];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    uint8_t bytecode[1000];
+    for (uint32_t i = 0; i < sizeof(bytecode); ++i) {
+        bytecode[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    ShaderCacheBlob blob = {};
+    CHECK(!shader_cache::load(cache_dir, key, &blob));
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    if (CHECK(shader_cache::load(cache_dir, key, &blob))) {
+        CHECK(blob.size == sizeof(bytecode) && memcmp(blob.data, bytecode, blob.size) == 0);
+        shader_cache::free_blob(&blob);
+    }
+    CHECK(!shader_cache::load(cache_dir, key + 1, &blob));
+
+    CHECK(truncate_entry(cache_dir, key, 10));
+    CHECK(!shader_cache::load(cache_dir, key, &blob));
+
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    CHECK(truncate_entry(cache_dir, key, sizeof(bytecode) + 8)); // Into the header
+    CHECK(!shader_cache::load(cache_dir, key, &blob));
+
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    CHECK(corrupt_entry(cache_dir, key, 500));
+    CHECK(!shader_cache::load(cache_dir, key, &blob));
+
+    // An entry renamed to another key
+    char path[SHADER_PATH_MAX];
+    char other_path[SHADER_PATH_MAX];
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    shader_cache::get_path(cache_dir, key, path, sizeof(path));
+    shader_cache::get_path(cache_dir, key ^ 1, other_path, sizeof(other_path));
+    CHECK(rename(path, other_path) == 0);
+    CHECK(!shader_cache::load(cache_dir, key ^ 1, &blob));
+
+    // Storing again replaces a broken entry
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    CHECK(corrupt_entry(cache_dir, key, 1));
+    CHECK(shader_cache::store(cache_dir, key, bytecode, sizeof(bytecode)));
+    if (CHECK(shader_cache::load(cache_dir, key, &blob))) {
+        shader_cache::free_blob(&blob);
+    }
+}
+
+static bool write_text(const char *dir, const char *name, const char *text) {
+    char path[SHADER_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return test::write_file(path, text, strlen(text));
+}
+
+// 0 when it doesn't resolve
+static uint64_t resolve_key(const char *path) {
+    ShaderSource source;
+    if (!shader_cache::resolve_source(path, &source)) {
+        return 0;
+    }
+    uint64_t key = shader_cache::make_key(&source, "main", "ps_5_0", 0, nullptr, 0);
+    shader_cache::free_source(&source);
+    return key;
+}
+
+// Rewrites the entry without its last drop bytes, like a crash halfway through a copy
+static bool truncate_entry(const char *dir, uint64_t key, long drop) {
+    char path[SHADER_PATH_MAX];
+    shader_cache::get_path(dir, key, path, sizeof(path));
+
+    uint8_t data[4096];
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    long size = (long)fread(data, 1, sizeof(data), file);
+    fclose(file);
+    return size > drop && test::write_file(path, data, (size_t)(size - drop));
+}
+
+static bool corrupt_entry(const char *dir, uint64_t key, long offset_from_end) {
+    char path[SHADER_PATH_MAX];
+    shader_cache::get_path(dir, key, path, sizeof(path));
+
+    FILE *file = fopen(path, "r+b");
+    if (!file) {
+        return false;
+    }
+    bool ok = fseek(file, -offset_from_end, SEEK_END) == 0;
+    int c = ok ? fgetc(file) : EOF;
+    ok = ok && c != EOF && fseek(file, -offset_from_end, SEEK_END) == 0 && fputc(c ^ 0x5A, file) != EOF;
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,89 @@
+#include "test.hpp"
+
+#include "id.hpp"
+#include "shader_permutation.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+struct FakeBuild {
+    uint32_t calls;
+    uint32_t last_key;
+    uint32_t last_define_count;
+};
+
+// Nothing gets compiled, every other variant "fails" so the cache has to
+// remember failed ones just the same
+static Id fake_build(const char *const *defines, uint32_t define_count, uint32_t key, void *user_data) {
+    FakeBuild *build = (FakeBuild *)user_data;
+    build->calls++;
+    build->last_key = key;
+    build->last_define_count = define_count;
+    if (define_count == 0 || strcmp(defines[0], SHADER_SPECIALIZED_DEFINE) != 0 || (key & 1)) {
+        return id::invalid();
+    }
+    return {(uint8_t)key, 1};
+}
+
+void shader_permutation_test::run() {
+    static const ShaderFeatureDefine features[] = {
+        {1 << 0, "HAS_A"},
+        {1 << 1, "HAS_B"},
+        {1 << 2, "HAS_C"},
+        {1 << 3, "HAS_D"},
+        {1 << 4, "HAS_E"},
+    };
+    uint32_t feature_count = sizeof(features) / sizeof(features[0]);
+
+    Id fallback = {7, 3};
+    ShaderVariantCache set;
+    if (!CHECK(shader_permutation::initialize(&set, 0x1F, features, feature_count, fallback))) return;
+
+    // SPECIALIZED needs a define of its own
+    ShaderVariantCache rejected;
+    CHECK(!shader_permutation::initialize(&rejected, 0x1F, features, MAX_SHADER_DEFINES, fallback));
+
+    // Features outside the mask don't make a variant of their own
+    CHECK(shader_permutation::make_key(&set, 0x05) == 0x05);
+    CHECK(shader_permutation::make_key(&set, 0xE5) == 0x05);
+
+    // SPECIALIZED first, then every set bit in the order of the feature table
+    const char *defines[MAX_SHADER_DEFINES];
+    CHECK(shader_permutation::get_defines(&set, 0, defines, MAX_SHADER_DEFINES) == 1 && strcmp(defines[0], SHADER_SPECIALIZED_DEFINE) == 0);
+    uint32_t count = shader_permutation::get_defines(&set, 0x15, defines, MAX_SHADER_DEFINES);
+    CHECK(count == 4 && strcmp(defines[0], SHADER_SPECIALIZED_DEFINE) == 0 && strcmp(defines[1], "HAS_A") == 0 &&
+          strcmp(defines[2], "HAS_C") == 0 && strcmp(defines[3], "HAS_E") == 0);
+    CHECK(shader_permutation::get_defines(&set, 0x1F, defines, 3) == 3);
+
+    // Variant cache, the build gets the defines of the masked key
+    FakeBuild build = {};
+    CHECK(shader_permutation::find(&set, 0x01) == -1);
+    Id first = shader_permutation::request(&set, 0x01, fake_build, &build);
+    CHECK(id::is_invalid(first) && set.count == 1 && shader_permutation::find(&set, 0x01) == 0);
+    CHECK(build.calls == 1 && build.last_key == 0x01 && build.last_define_count == 2);
+    // Asking again, with or without bits outside the mask, is a hit even when the build failed
+    shader_permutation::request(&set, 0x01, fake_build, &build);
+    shader_permutation::request(&set, 0x41, fake_build, &build);
+    CHECK(set.count == 1 && build.calls == 1);
+
+    Id second = shader_permutation::request(&set, 0x86, fake_build, &build);
+    CHECK(build.calls == 2 && build.last_key == 0x06 && build.last_define_count == 3);
+    CHECK(second.id == 0x06 && shader_permutation::find(&set, 0x06) == 1);
+    Id again = shader_permutation::request(&set, 0x06, fake_build, &build);
+    CHECK(again.id == second.id && again.generation == second.generation && build.calls == 2);
+
+    for (uint32_t features = 2; set.count < MAX_SHADER_PERMUTATIONS; ++features) {
+        shader_permutation::request(&set, features, fake_build, &build);
+    }
+    CHECK(build.calls == MAX_SHADER_PERMUTATIONS);
+    for (uint32_t i = 0; i < set.count; ++i) {
+        CHECK(shader_permutation::find(&set, set.keys[i]) == (int32_t)i);
+    }
+
+    // Full, new keys get the generic pipeline and aren't cached
+    uint32_t uncached = 0x1F;
+    CHECK(shader_permutation::find(&set, uncached) == -1);
+    Id full = shader_permutation::request(&set, uncached, fake_build, &build);
+    CHECK(full.id == fallback.id && full.generation == fallback.generation && build.calls == MAX_SHADER_PERMUTATIONS);
+    CHECK(set.count == MAX_SHADER_PERMUTATIONS && shader_permutation::find(&set, uncached) == -1);
+}
@@ -0,0 +1,197 @@
+#include "test.hpp"
+
+#include "shadow_atlas.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#define TEST_ATLAS_SIZE 4096
+#define TEST_CHURN_OPS 20000
+// Smallest tiles per side, the coverage map has one cell per tile
+#define TEST_GRID (1u << (SHADOW_ATLAS_LEVELS - 1))
+
+static ShadowAtlas g_atlas;
+static uint16_t g_live[SHADOW_ATLAS_NODE_COUNT];
+
+static bool fill_coverage(const uint16_t *nodes, uint32_t count, uint8_t *out_coverage);
+static bool has_free_block(const uint8_t *coverage, uint32_t level);
+static ShadowAtlasEntry *find(ShadowAtlasEntry *entries, uint64_t key);
+
+void shadow_atlas_test::run() {
+    shadow_atlas::initialize(&g_atlas, TEST_ATLAS_SIZE);
+    CHECK(shadow_atlas::get_level_for_size(&g_atlas, 8000) == 0);
+    CHECK(shadow_atlas::get_level_for_size(&g_atlas, 2048) == 1);
+    CHECK(shadow_atlas::get_level_for_size(&g_atlas, 300) == 3);
+    CHECK(shadow_atlas::get_level_for_size(&g_atlas, 10) == SHADOW_ATLAS_LEVELS - 1);
+
+    // Random allocs and releases at every level. Tiles never overlap, and an
+    // alloc only fails when no aligned block of that size is left, which also
+    // means released tiles were merged back.
+    uint32_t rng = 0x68E31DA4u;
+    uint32_t live_count = 0;
+    uint8_t coverage[TEST_GRID * TEST_GRID];
+    for (uint32_t op = 0; op < TEST_CHURN_OPS; ++op) {
+        if (live_count > 0 && test::next_random(&rng) % 100 < 45) {
+            uint32_t index = test::next_random(&rng) % live_count;
+            shadow_atlas::release(&g_atlas, g_live[index]);
+            g_live[index] = g_live[--live_count];
+            continue;
+        }
+
+        // Mostly small tiles, like spot lights
+        uint32_t level = 1 + test::next_random(&rng) % (SHADOW_ATLAS_LEVELS - 1);
+        if (test::next_random(&rng) % 4 != 0) {
+            level = SHADOW_ATLAS_LEVELS - 1;
+        }
+
+        uint16_t node = shadow_atlas::alloc(&g_atlas, level);
+        if (node == SHADOW_ATLAS_NODE_NONE) {
+            if (!CHECK(fill_coverage(g_live, live_count, coverage) && !has_free_block(coverage, level))) break;
+            continue;
+        }
+        CHECK(shadow_atlas::get_level(node) == level);
+        g_live[live_count++] = node;
+        if (!CHECK(fill_coverage(g_live, live_count, coverage))) break;
+    }
+    for (uint32_t i = 0; i < live_count; ++i) {
+        shadow_atlas::release(&g_atlas, g_live[i]);
+    }
+    CHECK(g_atlas.nodes[0] == SHADOW_NODE_FREE);
+
+    // Down to the smallest tile: exactly TEST_GRID^2 of them fit
+    for (uint32_t i = 0; i < TEST_GRID * TEST_GRID; ++i) {
+        g_live[i] = shadow_atlas::alloc(&g_atlas, SHADOW_ATLAS_LEVELS - 1);
+        if (!CHECK(g_live[i] != SHADOW_ATLAS_NODE_NONE)) break;
+    }
+    CHECK(shadow_atlas::alloc(&g_atlas, SHADOW_ATLAS_LEVELS - 1) == SHADOW_ATLAS_NODE_NONE);
+    CHECK(fill_coverage(g_live, TEST_GRID * TEST_GRID, coverage));
+    for (uint32_t i = 0; i < TEST_GRID * TEST_GRID; ++i) {
+        shadow_atlas::release(&g_atlas, g_live[i]);
+    }
+    CHECK(g_atlas.nodes[0] == SHADOW_NODE_FREE);
+    CHECK(shadow_atlas::alloc(&g_atlas, 0) == 0);
+
+    // Eviction by priority: four views fill the atlas, a more important one
+    // takes its space from the least important, which falls back to a smaller tile
+    ShadowAtlasEntry entries[MAX_SHADOW_VIEWS];
+    memset(entries, 0, sizeof(entries));
+    shadow_atlas::initialize(&g_atlas, TEST_ATLAS_SIZE);
+    shadow_atlas::begin_requests(entries, MAX_SHADOW_VIEWS);
+    for (uint64_t key = 1; key <= 4; ++key) {
+        shadow_atlas::request(entries, MAX_SHADOW_VIEWS, key, (float)key, 1);
+    }
+    shadow_atlas::resolve(&g_atlas, entries, MAX_SHADOW_VIEWS);
+    uint16_t kept_nodes[4];
+    for (uint64_t key = 1; key <= 4; ++key) {
+        ShadowAtlasEntry *entry = find(entries, key);
+        CHECK(entry && entry->node != SHADOW_ATLAS_NODE_NONE && entry->level == 1);
+        kept_nodes[key - 1] = entry ? entry->node : SHADOW_ATLAS_NODE_NONE;
+        if (entry) entry->cache.valid = true;
+    }
+
+    shadow_atlas::begin_requests(entries, MAX_SHADOW_VIEWS);
+    for (uint64_t key = 1; key <= 4; ++key) {
+        shadow_atlas::request(entries, MAX_SHADOW_VIEWS, key, (float)key, 1);
+    }
+    shadow_atlas::request(entries, MAX_SHADOW_VIEWS, 10, 10.0f, 2);
+    shadow_atlas::resolve(&g_atlas, entries, MAX_SHADOW_VIEWS);
+
+    ShadowAtlasEntry *important = find(entries, 10);
+    ShadowAtlasEntry *lowest = find(entries, 1);
+    CHECK(important && important->node != SHADOW_ATLAS_NODE_NONE && important->level == 2);
+    CHECK(lowest && lowest->node != SHADOW_ATLAS_NODE_NONE && lowest->level == 2 && !lowest->cache.valid);
+    for (uint64_t key = 2; key <= 4; ++key) {
+        ShadowAtlasEntry *entry = find(entries, key);
+        CHECK(entry && entry->node == kept_nodes[key - 1] && entry->cache.valid);
+    }
+    uint16_t placed[5];
+    for (uint64_t key = 1; key <= 5; ++key) {
+        ShadowAtlasEntry *entry = find(entries, key == 5 ? 10 : key);
+        placed[key - 1] = entry ? entry->node : SHADOW_ATLAS_NODE_NONE;
+    }
+    CHECK(fill_coverage(placed, 5, coverage));
+
+    // A view that isn't requested gives its tile back, a one level change in
+    // size keeps the tile (and its cache)
+    shadow_atlas::begin_requests(entries, MAX_SHADOW_VIEWS);
+    shadow_atlas::request(entries, MAX_SHADOW_VIEWS, 4, 4.0f, 2);
+    shadow_atlas::resolve(&g_atlas, entries, MAX_SHADOW_VIEWS);
+    CHECK(find(entries, 1) == NULL && find(entries, 10) == NULL);
+    ShadowAtlasEntry *resized = find(entries, 4);
+    CHECK(resized && resized->node == kept_nodes[3] && resized->cache.valid);
+
+    shadow_atlas::begin_requests(entries, MAX_SHADOW_VIEWS);
+    shadow_atlas::resolve(&g_atlas, entries, MAX_SHADOW_VIEWS);
+    CHECK(g_atlas.nodes[0] == SHADOW_NODE_FREE);
+
+    // Static vs dynamic invalidation
+    ShadowCacheState cache = {};
+    CHECK(shadow_atlas::update_cache(&cache, 1, 2, 3) == SHADOW_UPDATE_FULL);
+    CHECK(shadow_atlas::update_cache(&cache, 1, 2, 3) == SHADOW_UPDATE_NONE);
+    // Only dynamic casters moved, the static layer is restored
+    CHECK(shadow_atlas::update_cache(&cache, 1, 2, 4) == SHADOW_UPDATE_DYNAMIC);
+    CHECK(shadow_atlas::update_cache(&cache, 1, 2, 4) == SHADOW_UPDATE_NONE);
+    // A static caster or the light moved, everything is redrawn
+    CHECK(shadow_atlas::update_cache(&cache, 1, 5, 4) == SHADOW_UPDATE_FULL);
+    CHECK(shadow_atlas::update_cache(&cache, 9, 5, 4) == SHADOW_UPDATE_FULL);
+    CHECK(shadow_atlas::update_cache(&cache, 9, 5, 4) == SHADOW_UPDATE_NONE);
+    // The tile moved
+    cache.valid = false;
+    CHECK(shadow_atlas::update_cache(&cache, 9, 5, 4) == SHADOW_UPDATE_FULL);
+
+    uint32_t a = 1;
+    uint32_t b = 2;
+    CHECK(shadow_atlas::hash(SHADOW_HASH_SEED, &a, sizeof(a)) == shadow_atlas::hash(SHADOW_HASH_SEED, &a, sizeof(a)));
+    CHECK(shadow_atlas::hash(SHADOW_HASH_SEED, &a, sizeof(a)) != shadow_atlas::hash(SHADOW_HASH_SEED, &b, sizeof(b)));
+}
+
+// Marks the smallest tiles each node covers, false when two of them overlap
+static bool fill_coverage(const uint16_t *nodes, uint32_t count, uint8_t *out_coverage) {
+    memset(out_coverage, 0, TEST_GRID * TEST_GRID);
+    uint32_t cell = TEST_ATLAS_SIZE / TEST_GRID;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t x, y, size;
+        shadow_atlas::get_node_rect(&g_atlas, nodes[i], &x, &y, &size);
+        if (size != shadow_atlas::get_level_size(&g_atlas, shadow_atlas::get_level(nodes[i]))) {
+            return false;
+        }
+
+        for (uint32_t cy = y / cell; cy < (y + size) / cell; ++cy) {
+            for (uint32_t cx = x / cell; cx < (x + size) / cell; ++cx) {
+                if (out_coverage[cy * TEST_GRID + cx]) {
+                    return false;
+                }
+                out_coverage[cy * TEST_GRID + cx] = 1;
+            }
+        }
+    }
+    return true;
+}
+
+static bool has_free_block(const uint8_t *coverage, uint32_t level) {
+    uint32_t cells = TEST_GRID >> level;
+    for (uint32_t by = 0; by < TEST_GRID; by += cells) {
+        for (uint32_t bx = 0; bx < TEST_GRID; bx += cells) {
+            bool is_free = true;
+            for (uint32_t cy = by; cy < by + cells && is_free; ++cy) {
+                for (uint32_t cx = bx; cx < bx + cells && is_free; ++cx) {
+                    is_free = coverage[cy * TEST_GRID + cx] == 0;
+                }
+            }
+            if (is_free) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static ShadowAtlasEntry *find(ShadowAtlasEntry *entries, uint64_t key) {
+    for (uint32_t i = 0; i < MAX_SHADOW_VIEWS; ++i) {
+        if (entries[i].key == key) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
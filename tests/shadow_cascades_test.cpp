@@ -0,0 +1,165 @@
+#include "test.hpp"
+
+#include "shadow_cascades.hpp"
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstdint>
+
+#define TEST_CAMERAS 32
+#define TEST_RESOLUTION 1024
+#define TEST_CASTER_DISTANCE 50.0f
+// Texel space rounding, the points are at most a few thousand texels out
+#define TEST_TEXEL_EPSILON 0.02f
+
+static ShadowCameraDesc random_camera(uint32_t *rng, DirectX::XMFLOAT3 eye);
+static DirectX::XMFLOAT3 random_direction(uint32_t *rng);
+static DirectX::XMFLOAT3 transform(const DirectX::XMFLOAT4X4 *matrix, DirectX::XMFLOAT3 p);
+static DirectX::XMFLOAT3 offset(DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 direction, float distance);
+static bool is_whole(float x);
+
+void shadow_cascades_test::run() {
+    uint32_t rng = 0x1B873593u;
+
+    // Every corner of a slice lands in its cascade, give or take the snapping
+    for (uint32_t i = 0; i < TEST_CAMERAS; ++i) {
+        DirectX::XMFLOAT3 eye = {test::random_float(&rng, -50.0f, 50.0f), test::random_float(&rng, 0.0f, 20.0f), test::random_float(&rng, -50.0f, 50.0f)};
+        ShadowCameraDesc camera = random_camera(&rng, eye);
+        DirectX::XMFLOAT3 light_direction = random_direction(&rng);
+
+        float splits[SHADOW_CASCADE_COUNT + 1];
+        shadow_cascades::compute_splits(camera.znear, camera.zfar, SHADOW_CASCADE_COUNT, 0.75f, splits);
+        CHECK(splits[0] == camera.znear && splits[SHADOW_CASCADE_COUNT] == camera.zfar);
+
+        float tan_y = tanf(camera.fov_y * 0.5f);
+        float tan_x = tan_y * camera.aspect_ratio;
+        bool inside = true;
+        for (uint32_t c = 0; c < SHADOW_CASCADE_COUNT && inside; ++c) {
+            CHECK(splits[c] < splits[c + 1]);
+
+            ShadowCascade cascade;
+            shadow_cascades::fit(&camera, splits[c], splits[c + 1], light_direction, TEST_RESOLUTION, TEST_CASTER_DISTANCE, &cascade);
+            float margin = 2.0f / TEST_RESOLUTION;
+
+            for (uint32_t corner = 0; corner < 8; ++corner) {
+                float z = splits[c + (corner >> 2)];
+                DirectX::XMFLOAT3 view_corner = {(corner & 1 ? 1.0f : -1.0f) * z * tan_x, (corner & 2 ? 1.0f : -1.0f) * z * tan_y, z};
+                DirectX::XMFLOAT3 world_corner = transform(&camera.inv_view_matrix, view_corner);
+                DirectX::XMFLOAT3 p = transform(&cascade.view_projection_matrix, world_corner);
+
+                inside &= CHECK(fabsf(p.x) <= 1.0f + margin && fabsf(p.y) <= 1.0f + margin);
+                // In front of the far plane, and at least caster_distance behind the near one
+                inside &= CHECK(p.z <= 1.0f && p.z * cascade.depth_far >= TEST_CASTER_DISTANCE - 1e-3f);
+            }
+        }
+    }
+
+    // Moving the camera moves the cascade by whole texels, and turning it doesn't
+    // change the texel size
+    for (uint32_t i = 0; i < TEST_CAMERAS; ++i) {
+        DirectX::XMFLOAT3 eye = {test::random_float(&rng, -20.0f, 20.0f), test::random_float(&rng, 0.0f, 10.0f), test::random_float(&rng, -20.0f, 20.0f)};
+        ShadowCameraDesc camera = random_camera(&rng, eye);
+        DirectX::XMFLOAT3 light_direction = random_direction(&rng);
+
+        ShadowCascade before;
+        shadow_cascades::fit(&camera, camera.znear, 20.0f, light_direction, TEST_RESOLUTION, TEST_CASTER_DISTANCE, &before);
+
+        ShadowCameraDesc moved = camera;
+        moved.inv_view_matrix.m[3][0] += test::random_float(&rng, -3.0f, 3.0f);
+        moved.inv_view_matrix.m[3][1] += test::random_float(&rng, -3.0f, 3.0f);
+        moved.inv_view_matrix.m[3][2] += test::random_float(&rng, -3.0f, 3.0f);
+        ShadowCascade after;
+        shadow_cascades::fit(&moved, camera.znear, 20.0f, light_direction, TEST_RESOLUTION, TEST_CASTER_DISTANCE, &after);
+
+        // The light's rotation doesn't depend on the camera, so any world point
+        // lands on the same spot within its texel
+        float half_resolution = TEST_RESOLUTION * 0.5f;
+        DirectX::XMFLOAT3 points[2] = {{0.0f, 0.0f, 0.0f}, eye};
+        bool snapped = true;
+        for (uint32_t p = 0; p < 2 && snapped; ++p) {
+            DirectX::XMFLOAT3 a = transform(&before.view_projection_matrix, points[p]);
+            DirectX::XMFLOAT3 b = transform(&after.view_projection_matrix, points[p]);
+            snapped &= CHECK(is_whole((b.x - a.x) * half_resolution) && is_whole((b.y - a.y) * half_resolution));
+        }
+        // The world origin sits on a texel corner
+        DirectX::XMFLOAT3 origin = transform(&after.view_projection_matrix, {0.0f, 0.0f, 0.0f});
+        CHECK(is_whole(origin.x * half_resolution) && is_whole(origin.y * half_resolution));
+
+        ShadowCameraDesc turned = random_camera(&rng, eye);
+        turned.fov_y = camera.fov_y;
+        turned.aspect_ratio = camera.aspect_ratio;
+        ShadowCascade rotated;
+        shadow_cascades::fit(&turned, camera.znear, 20.0f, light_direction, TEST_RESOLUTION, TEST_CASTER_DISTANCE, &rotated);
+        CHECK(rotated.texel_size == before.texel_size && rotated.radius == before.radius);
+        if (!snapped) break;
+    }
+
+    // Caster culling keeps what's in the cascade or between it and the light
+    for (uint32_t i = 0; i < TEST_CAMERAS; ++i) {
+        ShadowCameraDesc camera = random_camera(&rng, {0.0f, 5.0f, 0.0f});
+        DirectX::XMFLOAT3 light_direction = random_direction(&rng);
+        ShadowCascade cascade;
+        shadow_cascades::fit(&camera, camera.znear, 30.0f, light_direction, TEST_RESOLUTION, TEST_CASTER_DISTANCE, &cascade);
+
+        DirectX::XMFLOAT3 direction;
+        DirectX::XMStoreFloat3(&direction, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&light_direction)));
+        // The light's x axis, the map is a square around it
+        DirectX::XMFLOAT3 side = {cascade.view_matrix.m[0][0], cascade.view_matrix.m[1][0], cascade.view_matrix.m[2][0]};
+
+        float r = cascade.radius;
+        float caster = 1.0f;
+        DirectX::XMFLOAT3 c = cascade.center;
+        CHECK(shadow_cascades::sphere_visible(&cascade, c, caster));
+        // Straddles the side
+        CHECK(shadow_cascades::sphere_visible(&cascade, offset(c, side, r + 0.5f * caster), caster));
+        // Between the light and the cascade
+        CHECK(shadow_cascades::sphere_visible(&cascade, offset(c, direction, -(r + 0.5f * TEST_CASTER_DISTANCE)), caster));
+        // Off to the side, past the far plane and behind the light
+        CHECK(!shadow_cascades::sphere_visible(&cascade, offset(c, side, r + caster + 1.0f), caster));
+        CHECK(!shadow_cascades::sphere_visible(&cascade, offset(c, direction, r + caster + 1.0f), caster));
+        CHECK(!shadow_cascades::sphere_visible(&cascade, offset(c, direction, -(r + TEST_CASTER_DISTANCE + caster + 1.0f)), caster));
+    }
+}
+
+// Looking from eye at a random point, with a random lens
+static ShadowCameraDesc random_camera(uint32_t *rng, DirectX::XMFLOAT3 eye) {
+    DirectX::XMFLOAT3 direction = random_direction(rng);
+    DirectX::XMVECTOR eye_v = DirectX::XMLoadFloat3(&eye);
+    DirectX::XMVECTOR at = DirectX::XMVectorAdd(eye_v, DirectX::XMLoadFloat3(&direction));
+    DirectX::XMVECTOR up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    if (fabsf(direction.y) > 0.99f) {
+        up = DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+    }
+
+    ShadowCameraDesc camera = {};
+    DirectX::XMStoreFloat4x4(&camera.inv_view_matrix, DirectX::XMMatrixInverse(nullptr, DirectX::XMMatrixLookAtLH(eye_v, at, up)));
+    camera.fov_y = test::random_float(rng, 0.6f, 1.6f);
+    camera.aspect_ratio = test::random_float(rng, 1.0f, 2.4f);
+    camera.znear = test::random_float(rng, 0.05f, 0.5f);
+    camera.zfar = test::random_float(rng, 50.0f, 300.0f);
+    return camera;
+}
+
+static DirectX::XMFLOAT3 random_direction(uint32_t *rng) {
+    for (;;) {
+        DirectX::XMFLOAT3 d = {test::random_float(rng, -1.0f, 1.0f), test::random_float(rng, -1.0f, 1.0f), test::random_float(rng, -1.0f, 1.0f)};
+        float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+        if (length > 0.1f && length <= 1.0f) {
+            return {d.x / length, d.y / length, d.z / length};
+        }
+    }
+}
+
+static DirectX::XMFLOAT3 transform(const DirectX::XMFLOAT4X4 *matrix, DirectX::XMFLOAT3 p) {
+    DirectX::XMFLOAT3 out;
+    DirectX::XMStoreFloat3(&out, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&p), DirectX::XMLoadFloat4x4(matrix)));
+    return out;
+}
+
+static DirectX::XMFLOAT3 offset(DirectX::XMFLOAT3 p, DirectX::XMFLOAT3 direction, float distance) {
+    return {p.x + direction.x * distance, p.y + direction.y * distance, p.z + direction.z * distance};
+}
+
+static bool is_whole(float x) {
+    return fabsf(x - roundf(x)) <= TEST_TEXEL_EPSILON;
+}
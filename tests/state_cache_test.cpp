@@ -0,0 +1,175 @@
+#include "test.hpp"
+
+#include "id.hpp"
+#include "state_cache.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#define TEST_CAPACITY 8
+#define TEST_CHURN_OPS 5000
+// More descs than fit, so the churn also runs into a full cache
+#define TEST_OBJECTS (TEST_CAPACITY * 4)
+
+// Stands in for a D3D state, counts the references the cache holds
+struct TestObject {
+    uint32_t ref_count;
+
+    unsigned long AddRef() { return ++ref_count; }
+    unsigned long Release() { return --ref_count; }
+};
+
+struct TestDesc {
+    uint32_t value;
+    uint32_t flags;
+};
+
+using TestCache = StateCache<TestDesc, TestObject, TEST_CAPACITY>;
+
+static TestCache g_cache;
+static TestObject g_objects[TEST_OBJECTS];
+
+static Id add(TestDesc desc, uint64_t hash, TestObject *object);
+static Id acquire(TestDesc desc, uint64_t hash);
+static uint32_t count_tombstones();
+
+void state_cache_test::run() {
+    state_cache::initialize(&g_cache);
+
+    // Same hash, different descs: two entries, each found by its own desc
+    TestDesc a = {1, 0};
+    TestDesc b = {2, 0};
+    TestDesc c = {3, 0};
+    Id a_id = add(a, 5, &g_objects[0]);
+    Id b_id = add(b, 5, &g_objects[1]);
+    // Another hash that lands on the same slot
+    Id c_id = add(c, 5 + TestCache::TABLE_SIZE, &g_objects[2]);
+    CHECK(id::is_valid(a_id) && id::is_valid(b_id) && id::is_valid(c_id));
+    CHECK(a_id.id != b_id.id && b_id.id != c_id.id && a_id.id != c_id.id);
+    CHECK(state_cache::get(&g_cache, a_id) == &g_objects[0] && g_objects[0].ref_count == 1);
+    CHECK(state_cache::get(&g_cache, b_id) == &g_objects[1]);
+    CHECK(state_cache::get(&g_cache, c_id) == &g_objects[2]);
+    CHECK(acquire(b, 5).id == b_id.id && acquire(c, 5 + TestCache::TABLE_SIZE).id == c_id.id);
+    // A desc nobody added, with a hash that's in the table
+    CHECK(id::is_invalid(acquire({4, 0}, 5)));
+    // The same desc under another hash isn't a match either
+    CHECK(id::is_invalid(acquire(a, 6)));
+
+    // The first one in the chain goes, the ones behind it are still found
+    CHECK(state_cache::release(&g_cache, a_id) == 0);
+    CHECK(state_cache::get(&g_cache, a_id) == nullptr && g_objects[0].ref_count == 0);
+    CHECK(id::is_invalid(acquire(a, 5)));
+    CHECK(acquire(b, 5).id == b_id.id && acquire(c, 5 + TestCache::TABLE_SIZE).id == c_id.id);
+
+    // Every acquire is a reference, the state goes with the last release
+    CHECK(state_cache::release(&g_cache, b_id) == 2);
+    CHECK(state_cache::release(&g_cache, b_id) == 1);
+    CHECK(state_cache::get(&g_cache, b_id) == &g_objects[1]);
+    CHECK(state_cache::release(&g_cache, b_id) == 0);
+    CHECK(state_cache::get(&g_cache, b_id) == nullptr && g_objects[1].ref_count == 0);
+    // Releasing a stale id does nothing
+    CHECK(state_cache::release(&g_cache, b_id) == 0);
+    CHECK(g_cache.count == 1);
+
+    // Adding it again takes the first free entry, a's, under a new generation.
+    // Neither old id reaches the new state.
+    Id again = add(b, 5, &g_objects[3]);
+    CHECK(id::is_valid(again) && again.id == a_id.id && again.generation != a_id.generation);
+    CHECK(state_cache::get(&g_cache, a_id) == nullptr && state_cache::release(&g_cache, a_id) == 0);
+    CHECK(state_cache::get(&g_cache, b_id) == nullptr && state_cache::release(&g_cache, b_id) == 0);
+    CHECK(state_cache::get(&g_cache, again) == &g_objects[3] && g_objects[3].ref_count == 1);
+    CHECK(acquire(b, 5).id == again.id);
+    CHECK(state_cache::release(&g_cache, again) == 1 && state_cache::release(&g_cache, again) == 0);
+    // Added once and acquired twice
+    CHECK(state_cache::release(&g_cache, c_id) == 2);
+    state_cache::release(&g_cache, c_id);
+    state_cache::release(&g_cache, c_id);
+    CHECK(g_cache.count == 0 && g_objects[2].ref_count == 0 && g_objects[3].ref_count == 0);
+
+    // Full, then one more doesn't fit
+    state_cache::initialize(&g_cache);
+    Id ids[TEST_CAPACITY];
+    for (uint32_t i = 0; i < TEST_CAPACITY; ++i) {
+        ids[i] = add({i, 1}, 3, &g_objects[i]);
+        if (!CHECK(id::is_valid(ids[i]))) break;
+    }
+    CHECK(id::is_invalid(add({TEST_CAPACITY, 1}, 3, &g_objects[TEST_CAPACITY])));
+
+    // Enough releases rebuild the table without its tombstones, whatever is
+    // left keeps its id and is still found
+    uint32_t released = 0;
+    for (uint32_t i = 0; i < TEST_CAPACITY; i += 2, ++released) {
+        state_cache::release(&g_cache, ids[i]);
+        CHECK(g_cache.tombstone_count == count_tombstones());
+    }
+    state_cache::release(&g_cache, ids[1]);
+    released++;
+    CHECK(released > TEST_CAPACITY / 2 && g_cache.tombstone_count == 0 && count_tombstones() == 0);
+    CHECK(g_cache.count == TEST_CAPACITY - released);
+    for (uint32_t i = 3; i < TEST_CAPACITY; i += 2) {
+        CHECK(acquire({i, 1}, 3).id == ids[i].id && state_cache::get(&g_cache, ids[i]) == &g_objects[i]);
+        state_cache::release(&g_cache, ids[i]);
+    }
+    for (uint32_t i = 0; i < TEST_CAPACITY; ++i) {
+        bool live = i >= 3 && (i & 1);
+        CHECK(live == (state_cache::get(&g_cache, ids[i]) != nullptr));
+        CHECK(g_objects[i].ref_count == (live ? 1u : 0u));
+    }
+
+    // Random adds, acquires and releases over a handful of colliding hashes,
+    // checked against the references the test keeps itself
+    state_cache::initialize(&g_cache);
+    memset(g_objects, 0, sizeof(g_objects));
+    uint32_t refs[TEST_OBJECTS] = {};
+    Id live_ids[TEST_OBJECTS];
+    uint32_t rng = 0xC2B2AE35u;
+    for (uint32_t op = 0; op < TEST_CHURN_OPS; ++op) {
+        uint32_t i = test::next_random(&rng) % TEST_OBJECTS;
+        TestDesc desc = {i, 2};
+        uint64_t hash = i % 3;
+
+        if (refs[i] > 0 && test::next_random(&rng) % 2 == 0) {
+            CHECK(state_cache::release(&g_cache, live_ids[i]) == --refs[i]);
+        } else if (refs[i] > 0) {
+            CHECK(acquire(desc, hash).id == live_ids[i].id);
+            refs[i]++;
+        } else {
+            bool has_room = g_cache.count < TEST_CAPACITY;
+            Id id = add(desc, hash, &g_objects[i]);
+            CHECK(id::is_valid(id) == has_room);
+            if (id::is_valid(id)) {
+                live_ids[i] = id;
+                refs[i] = 1;
+            }
+        }
+
+        uint32_t live = 0;
+        bool found = true;
+        for (uint32_t k = 0; k < TEST_OBJECTS; ++k) {
+            TestDesc key = {k, 2};
+            live += refs[k] > 0 ? 1 : 0;
+            // The cache holds one reference on the object however often it was acquired
+            found &= g_objects[k].ref_count == (refs[k] > 0 ? 1u : 0u);
+            found &= (refs[k] > 0) == (state_cache::find_slot(&g_cache, &key, k % 3) >= 0);
+        }
+        bool ok = CHECK(found && live == g_cache.count);
+        ok &= CHECK(g_cache.tombstone_count == count_tombstones() && g_cache.tombstone_count <= TEST_CAPACITY / 2);
+        if (!ok) break;
+    }
+}
+
+static Id add(TestDesc desc, uint64_t hash, TestObject *object) {
+    return state_cache::add(&g_cache, &desc, hash, object);
+}
+
+static Id acquire(TestDesc desc, uint64_t hash) {
+    return state_cache::acquire(&g_cache, &desc, hash);
+}
+
+static uint32_t count_tombstones() {
+    uint32_t count = 0;
+    for (uint32_t slot = 0; slot < TestCache::TABLE_SIZE; ++slot) {
+        count += g_cache.table[slot] == STATE_CACHE_TOMBSTONE ? 1 : 0;
+    }
+    return count;
+}
@@ -0,0 +1,205 @@
+#include "test.hpp"
+
+// Only where there are D3D headers, see the test target
+#ifdef _WIN32
+
+#include "state_tracker.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+// Too big for the stack
+static StateTracker g_tracker;
+// The tracker only compares pointers, these are never dereferenced
+static uint8_t g_objects[64];
+
+template <typename T>
+static T *fake(uint32_t index);
+static uint32_t issued_by(void (*fn)(StateTracker *tracker));
+static void flush(StateTracker *tracker);
+static void draw(StateTracker *tracker);
+static void set_srv(ShaderStage stage, UINT slot, ID3D11ShaderResourceView *srv);
+
+void state_tracker_test::run() {
+    StateTracker *t = &g_tracker;
+    // No context, nothing is sent but the shadow state and the counters work
+    state_tracker::initialize(t, nullptr);
+
+    // The first set of anything is sent, the same again is dropped
+    state_tracker::set_rasterizer_state(t, fake<ID3D11RasterizerState>(0));
+    state_tracker::set_rasterizer_state(t, fake<ID3D11RasterizerState>(0));
+    state_tracker::set_rasterizer_state(t, fake<ID3D11RasterizerState>(1));
+    CHECK(t->stats.requests == 3 && t->stats.filtered == 1 && t->stats.issued == 2);
+    // So is NULL, it's a state like any other
+    state_tracker::set_rasterizer_state(t, nullptr);
+    state_tracker::set_rasterizer_state(t, nullptr);
+    CHECK(t->stats.requests == 5 && t->stats.filtered == 2 && t->stats.issued == 3);
+
+    state_tracker::reset_stats(t);
+    state_tracker::set_depth_stencil_state(t, fake<ID3D11DepthStencilState>(0), 0);
+    state_tracker::set_depth_stencil_state(t, fake<ID3D11DepthStencilState>(0), 1);
+    state_tracker::set_depth_stencil_state(t, fake<ID3D11DepthStencilState>(0), 1);
+    CHECK(t->stats.filtered == 1 && t->stats.issued == 2);
+
+    // A NULL blend factor is the same as all ones
+    const float ones[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    const float half[4] = {0.5f, 0.5f, 0.5f, 0.5f};
+    state_tracker::reset_stats(t);
+    state_tracker::set_blend_state(t, fake<ID3D11BlendState>(0), nullptr, 0xFFFFFFFF);
+    state_tracker::set_blend_state(t, fake<ID3D11BlendState>(0), ones, 0xFFFFFFFF);
+    state_tracker::set_blend_state(t, fake<ID3D11BlendState>(0), half, 0xFFFFFFFF);
+    state_tracker::set_blend_state(t, fake<ID3D11BlendState>(0), half, 0x0000FFFF);
+    CHECK(t->stats.requests == 4 && t->stats.filtered == 1 && t->stats.issued == 3);
+
+    state_tracker::reset_stats(t);
+    D3D11_VIEWPORT viewport = {0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f};
+    state_tracker::set_viewport(t, &viewport);
+    state_tracker::set_viewport(t, &viewport);
+    viewport.Height = 800.0f;
+    state_tracker::set_viewport(t, &viewport);
+    state_tracker::set_topology(t, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    state_tracker::set_topology(t, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    state_tracker::set_vertex_buffer(t, fake<ID3D11Buffer>(0), 32, 0);
+    state_tracker::set_vertex_buffer(t, fake<ID3D11Buffer>(0), 32, 0);
+    state_tracker::set_vertex_buffer(t, fake<ID3D11Buffer>(0), 32, 64);
+    state_tracker::set_index_buffer(t, fake<ID3D11Buffer>(1), DXGI_FORMAT_R32_UINT, 0);
+    state_tracker::set_index_buffer(t, fake<ID3D11Buffer>(1), DXGI_FORMAT_R32_UINT, 0);
+    CHECK(t->stats.requests == 10 && t->stats.filtered == 4 && t->stats.issued == 6);
+
+    // After a reset everything is sent again
+    state_tracker::reset(t);
+    state_tracker::reset_stats(t);
+    state_tracker::set_rasterizer_state(t, nullptr);
+    state_tracker::set_topology(t, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    CHECK(t->stats.filtered == 0 && t->stats.issued == 2);
+
+    // After a reset the slots in between could hold anything, so they're sent
+    // along and it's one call
+    state_tracker::reset_stats(t);
+    set_srv(SHADER_STAGE_CS, 10, fake<ID3D11ShaderResourceView>(0));
+    set_srv(SHADER_STAGE_CS, 40, fake<ID3D11ShaderResourceView>(1));
+    CHECK(issued_by(flush) == 1);
+
+    // From here on every slot is known to be empty
+    for (uint32_t stage = 0; stage < SHADER_STAGE_COUNT; ++stage) {
+        state_tracker::unbind_srvs(t, (ShaderStage)stage);
+        state_tracker::set_constant_buffers(t, (ShaderStage)stage, 0, STATE_TRACKER_CB_SLOTS, nullptr);
+        state_tracker::set_samplers(t, (ShaderStage)stage, 0, STATE_TRACKER_SAMPLER_SLOTS, nullptr);
+    }
+    CHECK(issued_by(flush) == 2 * SHADER_STAGE_COUNT);
+
+    // Inputs wait for the draw. Changed slots close enough together go out as
+    // one call, gaps of more than STATE_TRACKER_MERGE_GAP unchanged slots split them.
+    state_tracker::reset_stats(t);
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(0));
+    set_srv(SHADER_STAGE_PS, 1 + STATE_TRACKER_MERGE_GAP, fake<ID3D11ShaderResourceView>(1));
+    CHECK(t->stats.requests == 2 && t->stats.issued == 0);
+    CHECK(issued_by(draw) == 1);
+    CHECK(t->stages[SHADER_STAGE_PS].srvs.bound[0] == fake<ID3D11ShaderResourceView>(0));
+    CHECK(t->stages[SHADER_STAGE_PS].srvs.bound[1 + STATE_TRACKER_MERGE_GAP] == fake<ID3D11ShaderResourceView>(1));
+
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(2));
+    set_srv(SHADER_STAGE_PS, 2 + STATE_TRACKER_MERGE_GAP, fake<ID3D11ShaderResourceView>(3));
+    CHECK(issued_by(flush) == 2);
+
+    // Three ranges over two stages
+    set_srv(SHADER_STAGE_VS, 0, fake<ID3D11ShaderResourceView>(4));
+    set_srv(SHADER_STAGE_VS, 1, fake<ID3D11ShaderResourceView>(5));
+    set_srv(SHADER_STAGE_CS, 10, fake<ID3D11ShaderResourceView>(6));
+    set_srv(SHADER_STAGE_CS, 40, fake<ID3D11ShaderResourceView>(7));
+    CHECK(issued_by(flush) == 3);
+
+    // Setting what's bound is dropped, and a slot that went back to what's
+    // bound before the draw isn't sent
+    uint32_t filtered = t->stats.filtered;
+    set_srv(SHADER_STAGE_VS, 0, fake<ID3D11ShaderResourceView>(4));
+    CHECK(t->stats.filtered == filtered + 1);
+    set_srv(SHADER_STAGE_VS, 1, fake<ID3D11ShaderResourceView>(8));
+    set_srv(SHADER_STAGE_VS, 1, fake<ID3D11ShaderResourceView>(5));
+    CHECK(issued_by(flush) == 0);
+
+    // Constant buffers and samplers work the same
+    ID3D11Buffer *cbs[3] = {fake<ID3D11Buffer>(2), fake<ID3D11Buffer>(3), fake<ID3D11Buffer>(4)};
+    state_tracker::set_constant_buffers(t, SHADER_STAGE_PS, 0, 3, cbs);
+    CHECK(issued_by(draw) == 1);
+    filtered = t->stats.filtered;
+    state_tracker::set_constant_buffers(t, SHADER_STAGE_PS, 0, 3, cbs);
+    CHECK(t->stats.filtered == filtered + 1 && issued_by(draw) == 0);
+    cbs[0] = fake<ID3D11Buffer>(5);
+    cbs[2] = fake<ID3D11Buffer>(6);
+    state_tracker::set_constant_buffers(t, SHADER_STAGE_PS, 0, 3, cbs);
+    ID3D11Buffer *far_cb = fake<ID3D11Buffer>(7);
+    state_tracker::set_constant_buffers(t, SHADER_STAGE_PS, 12, 1, &far_cb);
+    CHECK(issued_by(draw) == 2);
+    ID3D11SamplerState *sampler = fake<ID3D11SamplerState>(0);
+    state_tracker::set_samplers(t, SHADER_STAGE_PS, 3, 1, &sampler);
+    state_tracker::set_samplers(t, SHADER_STAGE_PS, 3, 1, &sampler);
+    CHECK(issued_by(draw) == 1);
+
+    // Binding a target forgets the SRVs, the runtime may have unbound them.
+    // Constant buffers are kept.
+    filtered = t->stats.filtered;
+    ID3D11RenderTargetView *rtv = fake<ID3D11RenderTargetView>(0);
+    state_tracker::set_render_targets(t, 1, &rtv, nullptr);
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(2));
+    state_tracker::set_constant_buffers(t, SHADER_STAGE_PS, 0, 3, cbs);
+    CHECK(t->stats.filtered == filtered + 1);
+    CHECK(issued_by(draw) == 1);
+    // The same targets again change nothing
+    filtered = t->stats.filtered;
+    state_tracker::set_render_targets(t, 1, &rtv, nullptr);
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(2));
+    CHECK(t->stats.filtered == filtered + 2 && issued_by(draw) == 0);
+    // Unbinding the targets binds no output, the SRVs stay known
+    state_tracker::set_render_targets(t, 0, nullptr, nullptr);
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(2));
+    CHECK(issued_by(draw) == 0);
+    // So does a UAV
+    ID3D11UnorderedAccessView *uav = fake<ID3D11UnorderedAccessView>(0);
+    state_tracker::set_cs_uavs(t, 0, 1, &uav);
+    set_srv(SHADER_STAGE_PS, 0, fake<ID3D11ShaderResourceView>(2));
+    CHECK(issued_by(draw) == 1);
+
+    // Unbinding the stage's SRVs is one call over whatever may be bound
+    set_srv(SHADER_STAGE_PS, 5, fake<ID3D11ShaderResourceView>(9));
+    CHECK(issued_by(flush) == 1);
+    uint32_t issued = t->stats.issued;
+    state_tracker::unbind_srvs(t, SHADER_STAGE_PS);
+    CHECK(t->stats.issued == issued + 1);
+    bool all_null = true;
+    for (uint32_t i = 0; i < STATE_TRACKER_SRV_SLOTS; ++i) {
+        all_null &= t->stages[SHADER_STAGE_PS].srvs.bound[i] == nullptr;
+    }
+    CHECK(all_null);
+    filtered = t->stats.filtered;
+    state_tracker::unbind_srvs(t, SHADER_STAGE_PS);
+    CHECK(t->stats.filtered == filtered + 1 && t->stats.issued == issued + 1);
+
+    CHECK(t->stats.filtered <= t->stats.requests);
+}
+
+template <typename T>
+static T *fake(uint32_t index) {
+    return reinterpret_cast<T *>(&g_objects[index]);
+}
+
+// Calls the tracker made from running fn
+static uint32_t issued_by(void (*fn)(StateTracker *tracker)) {
+    uint32_t before = g_tracker.stats.issued;
+    fn(&g_tracker);
+    return g_tracker.stats.issued - before;
+}
+
+static void flush(StateTracker *tracker) {
+    state_tracker::flush(tracker);
+}
+
+static void draw(StateTracker *tracker) {
+    state_tracker::draw(tracker, 3, 0);
+}
+
+static void set_srv(ShaderStage stage, UINT slot, ID3D11ShaderResourceView *srv) {
+    state_tracker::set_srvs(&g_tracker, stage, slot, 1, &srv);
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include "test.hpp"
+
+#include "logger.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+struct TestSuite {
+    const char *name;
+    void (*run)();
+};
+
+static const TestSuite g_suites[] = {
+    {"light_cluster", light_cluster_test::run},
+    {"shadow_cascades", shadow_cascades_test::run},
+    {"shadow_atlas", shadow_atlas_test::run},
+    {"material_table", material_table_test::run},
+    {"shader_cache", shader_cache_test::run},
+    {"shader_permutation", shader_permutation_test::run},
+    {"state_cache", state_cache_test::run},
+#ifdef _WIN32
+    {"state_tracker", state_tracker_test::run},
+#endif
+    {"range_allocator", range_allocator_test::run},
+    {"meshlet", meshlet_test::run},
+    {"occlusion", occlusion_test::run},
+    {"async", async_test::run},
+    {"job_system", job_system_test::run},
+    {"arena", arena_test::run},
+    {"memory_tracker", memory_tracker_test::run},
+#ifdef _WIN32
+    {"texture_format", texture_format_test::run},
+#endif
+    {"mip_file", mip_file_test::run},
+    {"texture_streamer", texture_streamer_test::run},
+    {"asset_registry", asset_registry_test::run},
+    {"lz4", lz4_test::run},
+    {"pack_file", pack_file_test::run},
+    {"scene_file", scene_file_test::run},
+    {"scene_diff", scene_diff_test::run},
+    {"file_watcher", file_watcher_test::run},
+    {"frame_pacer", frame_pacer_test::run},
+};
+
+static uint32_t g_failed_checks = 0;
+
+static bool is_selected(const char *name, int argc, char *argv[]);
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        bool known = false;
+        for (const TestSuite &suite : g_suites) {
+            known |= strcmp(suite.name, argv[i]) == 0;
+        }
+        if (!known) {
+            LOG("test: Unknown suite %s", argv[i]);
+            return 1;
+        }
+    }
+
+    uint32_t ran = 0;
+    uint32_t failed = 0;
+    for (const TestSuite &suite : g_suites) {
+        if (!is_selected(suite.name, argc, argv)) continue;
+
+        uint32_t failed_before = g_failed_checks;
+        suite.run();
+        bool passed = g_failed_checks == failed_before;
+        printf("%-20s %s\n", suite.name, passed ? "ok" : "FAILED");
+
+        ran++;
+        failed += passed ? 0 : 1;
+    }
+
+    printf("%u of %u suites passed\n", ran - failed, ran);
+    return failed > 0 ? 1 : 0;
+}
+
+bool test::check(bool condition, const char *expression, const char *file, int line) {
+    if (!condition) {
+        LOG("%s:%d: CHECK(%s) failed", file, line, expression);
+        g_failed_checks++;
+    }
+    return condition;
+}
+
+uint32_t test::next_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+float test::random_float(uint32_t *state, float min, float max) {
+    return min + (max - min) * (float)(next_random(state) >> 8) / (float)(1u << 24);
+}
+
+bool test::make_temp_dir(const char *name, char *out_path, size_t out_size) {
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "pbr_tests" / name;
+    if (!error) {
+        std::filesystem::remove_all(path, error);
+        std::filesystem::create_directories(path, error);
+    }
+    if (error) {
+        LOG("test: Couldn't make the temp directory for %s", name);
+        return false;
+    }
+
+    std::string generic = path.generic_string();
+    if (generic.size() >= out_size) {
+        LOG("test: Temp directory path too long for %s", name);
+        return false;
+    }
+    memcpy(out_path, generic.c_str(), generic.size() + 1);
+    return true;
+}
+
+bool test::write_file(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        LOG("test: Couldn't open %s for writing", path);
+        return false;
+    }
+    bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+// No arguments runs everything
+static bool is_selected(const char *name, int argc, char *argv[]) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(name, argv[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
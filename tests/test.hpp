@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Checks for the CPU side of the engine, no device or window needed.
+//
+//   test [suite...]
+//
+// Runs every suite, or only the ones named. A CHECK that fails logs where it
+// was and carries on, the suite is reported as failed at the end. Exit code 1
+// when any of them failed.
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+namespace test {
+
+// Returns condition, so loops can stop at the first failure
+bool check(bool condition, const char *expression, const char *file, int line);
+
+// xorshift32, the same sequence on every platform
+uint32_t next_random(uint32_t *state);
+float random_float(uint32_t *state, float min, float max);
+
+// An empty directory of the suite's own in the system temp directory, with
+// forward slashes. Whatever an earlier run left in there is deleted.
+bool make_temp_dir(const char *name, char *out_path, size_t out_size);
+bool write_file(const char *path, const void *data, size_t size);
+
+} // namespace test
+
+// One run per suite, see test.cpp for the list
+namespace light_cluster_test { void run(); }
+namespace shadow_cascades_test { void run(); }
+namespace shadow_atlas_test { void run(); }
+namespace material_table_test { void run(); }
+namespace shader_cache_test { void run(); }
+namespace shader_permutation_test { void run(); }
+namespace state_cache_test { void run(); }
+namespace state_tracker_test { void run(); }
+namespace range_allocator_test { void run(); }
+namespace meshlet_test { void run(); }
+namespace occlusion_test { void run(); }
+namespace async_test { void run(); }
+namespace job_system_test { void run(); }
+namespace arena_test { void run(); }
+namespace memory_tracker_test { void run(); }
+namespace texture_format_test { void run(); }
+namespace mip_file_test { void run(); }
+namespace texture_streamer_test { void run(); }
+namespace asset_registry_test { void run(); }
+namespace lz4_test { void run(); }
+namespace pack_file_test { void run(); }
+namespace scene_file_test { void run(); }
+namespace scene_diff_test { void run(); }
+namespace file_watcher_test { void run(); }
+namespace frame_pacer_test { void run(); }
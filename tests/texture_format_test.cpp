@@ -0,0 +1,182 @@
+#include "test.hpp"
+
+// Only where there are D3D headers, see the test target
+#ifdef _WIN32
+
+#include "texture_format.hpp"
+
+#include <cstdint>
+
+// Bytes of a 4x4 and a 5x3 image, the odd one pads blocks, pairs and planes
+#define SIZES_128 256, 240
+#define SIZES_96 192, 180
+#define SIZES_64 128, 120
+#define SIZES_32 64, 60
+#define SIZES_16 32, 30
+#define SIZES_8 16, 15
+#define SIZES_BC8 8, 16
+#define SIZES_BC16 16, 32
+
+struct FormatSize {
+    DXGI_FORMAT format;
+    uint64_t bytes_4x4;
+    uint64_t bytes_5x3;
+};
+
+struct TextureSize {
+    const char *name;
+    DXGI_FORMAT format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t array_size;
+    uint32_t mip_levels;
+    uint32_t samples;
+    uint64_t bytes;
+};
+
+static const FormatSize s_format_sizes[] = {
+    {DXGI_FORMAT_UNKNOWN, 0, 0},
+    {DXGI_FORMAT_R32G32B32A32_TYPELESS, SIZES_128},
+    {DXGI_FORMAT_R32G32B32A32_FLOAT, SIZES_128},
+    {DXGI_FORMAT_R32G32B32A32_UINT, SIZES_128},
+    {DXGI_FORMAT_R32G32B32A32_SINT, SIZES_128},
+    {DXGI_FORMAT_R32G32B32_TYPELESS, SIZES_96},
+    {DXGI_FORMAT_R32G32B32_FLOAT, SIZES_96},
+    {DXGI_FORMAT_R32G32B32_UINT, SIZES_96},
+    {DXGI_FORMAT_R32G32B32_SINT, SIZES_96},
+    {DXGI_FORMAT_R16G16B16A16_TYPELESS, SIZES_64},
+    {DXGI_FORMAT_R16G16B16A16_FLOAT, SIZES_64},
+    {DXGI_FORMAT_R16G16B16A16_UNORM, SIZES_64},
+    {DXGI_FORMAT_R16G16B16A16_UINT, SIZES_64},
+    {DXGI_FORMAT_R16G16B16A16_SNORM, SIZES_64},
+    {DXGI_FORMAT_R16G16B16A16_SINT, SIZES_64},
+    {DXGI_FORMAT_R32G32_TYPELESS, SIZES_64},
+    {DXGI_FORMAT_R32G32_FLOAT, SIZES_64},
+    {DXGI_FORMAT_R32G32_UINT, SIZES_64},
+    {DXGI_FORMAT_R32G32_SINT, SIZES_64},
+    {DXGI_FORMAT_R32G8X24_TYPELESS, SIZES_64},
+    {DXGI_FORMAT_D32_FLOAT_S8X24_UINT, SIZES_64},
+    {DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS, SIZES_64},
+    {DXGI_FORMAT_X32_TYPELESS_G8X24_UINT, SIZES_64},
+    {DXGI_FORMAT_R10G10B10A2_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_R10G10B10A2_UNORM, SIZES_32},
+    {DXGI_FORMAT_R10G10B10A2_UINT, SIZES_32},
+    {DXGI_FORMAT_R11G11B10_FLOAT, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_UNORM, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_UINT, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_SNORM, SIZES_32},
+    {DXGI_FORMAT_R8G8B8A8_SINT, SIZES_32},
+    {DXGI_FORMAT_R16G16_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_R16G16_FLOAT, SIZES_32},
+    {DXGI_FORMAT_R16G16_UNORM, SIZES_32},
+    {DXGI_FORMAT_R16G16_UINT, SIZES_32},
+    {DXGI_FORMAT_R16G16_SNORM, SIZES_32},
+    {DXGI_FORMAT_R16G16_SINT, SIZES_32},
+    {DXGI_FORMAT_R32_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_D32_FLOAT, SIZES_32},
+    {DXGI_FORMAT_R32_FLOAT, SIZES_32},
+    {DXGI_FORMAT_R32_UINT, SIZES_32},
+    {DXGI_FORMAT_R32_SINT, SIZES_32},
+    {DXGI_FORMAT_R24G8_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_D24_UNORM_S8_UINT, SIZES_32},
+    {DXGI_FORMAT_R24_UNORM_X8_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_X24_TYPELESS_G8_UINT, SIZES_32},
+    {DXGI_FORMAT_R8G8_TYPELESS, SIZES_16},
+    {DXGI_FORMAT_R8G8_UNORM, SIZES_16},
+    {DXGI_FORMAT_R8G8_UINT, SIZES_16},
+    {DXGI_FORMAT_R8G8_SNORM, SIZES_16},
+    {DXGI_FORMAT_R8G8_SINT, SIZES_16},
+    {DXGI_FORMAT_R16_TYPELESS, SIZES_16},
+    {DXGI_FORMAT_R16_FLOAT, SIZES_16},
+    {DXGI_FORMAT_D16_UNORM, SIZES_16},
+    {DXGI_FORMAT_R16_UNORM, SIZES_16},
+    {DXGI_FORMAT_R16_UINT, SIZES_16},
+    {DXGI_FORMAT_R16_SNORM, SIZES_16},
+    {DXGI_FORMAT_R16_SINT, SIZES_16},
+    {DXGI_FORMAT_R8_TYPELESS, SIZES_8},
+    {DXGI_FORMAT_R8_UNORM, SIZES_8},
+    {DXGI_FORMAT_R8_UINT, SIZES_8},
+    {DXGI_FORMAT_R8_SNORM, SIZES_8},
+    {DXGI_FORMAT_R8_SINT, SIZES_8},
+    {DXGI_FORMAT_A8_UNORM, SIZES_8},
+    {DXGI_FORMAT_R1_UNORM, 4, 3},
+    {DXGI_FORMAT_R9G9B9E5_SHAREDEXP, SIZES_32},
+    {DXGI_FORMAT_R8G8_B8G8_UNORM, 32, 36},
+    {DXGI_FORMAT_G8R8_G8B8_UNORM, 32, 36},
+    {DXGI_FORMAT_BC1_TYPELESS, SIZES_BC8},
+    {DXGI_FORMAT_BC1_UNORM, SIZES_BC8},
+    {DXGI_FORMAT_BC1_UNORM_SRGB, SIZES_BC8},
+    {DXGI_FORMAT_BC2_TYPELESS, SIZES_BC16},
+    {DXGI_FORMAT_BC2_UNORM, SIZES_BC16},
+    {DXGI_FORMAT_BC2_UNORM_SRGB, SIZES_BC16},
+    {DXGI_FORMAT_BC3_TYPELESS, SIZES_BC16},
+    {DXGI_FORMAT_BC3_UNORM, SIZES_BC16},
+    {DXGI_FORMAT_BC3_UNORM_SRGB, SIZES_BC16},
+    {DXGI_FORMAT_BC4_TYPELESS, SIZES_BC8},
+    {DXGI_FORMAT_BC4_UNORM, SIZES_BC8},
+    {DXGI_FORMAT_BC4_SNORM, SIZES_BC8},
+    {DXGI_FORMAT_BC5_TYPELESS, SIZES_BC16},
+    {DXGI_FORMAT_BC5_UNORM, SIZES_BC16},
+    {DXGI_FORMAT_BC5_SNORM, SIZES_BC16},
+    {DXGI_FORMAT_B5G6R5_UNORM, SIZES_16},
+    {DXGI_FORMAT_B5G5R5A1_UNORM, SIZES_16},
+    {DXGI_FORMAT_B8G8R8A8_UNORM, SIZES_32},
+    {DXGI_FORMAT_B8G8R8X8_UNORM, SIZES_32},
+    {DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM, SIZES_32},
+    {DXGI_FORMAT_B8G8R8A8_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_B8G8R8A8_UNORM_SRGB, SIZES_32},
+    {DXGI_FORMAT_B8G8R8X8_TYPELESS, SIZES_32},
+    {DXGI_FORMAT_B8G8R8X8_UNORM_SRGB, SIZES_32},
+    {DXGI_FORMAT_BC6H_TYPELESS, SIZES_BC16},
+    {DXGI_FORMAT_BC6H_UF16, SIZES_BC16},
+    {DXGI_FORMAT_BC6H_SF16, SIZES_BC16},
+    {DXGI_FORMAT_BC7_TYPELESS, SIZES_BC16},
+    {DXGI_FORMAT_BC7_UNORM, SIZES_BC16},
+    {DXGI_FORMAT_BC7_UNORM_SRGB, SIZES_BC16},
+    {DXGI_FORMAT_AYUV, SIZES_32},
+    {DXGI_FORMAT_Y410, SIZES_32},
+    {DXGI_FORMAT_Y416, SIZES_64},
+    {DXGI_FORMAT_NV12, 24, 30},
+    {DXGI_FORMAT_P010, 48, 60},
+    {DXGI_FORMAT_P016, 48, 60},
+    {DXGI_FORMAT_420_OPAQUE, 24, 30},
+    {DXGI_FORMAT_YUY2, 32, 36},
+    {DXGI_FORMAT_Y210, 64, 72},
+    {DXGI_FORMAT_Y216, 64, 72},
+    {DXGI_FORMAT_NV11, 32, 48},
+    {DXGI_FORMAT_AI44, SIZES_8},
+    {DXGI_FORMAT_IA44, SIZES_8},
+    {DXGI_FORMAT_P8, SIZES_8},
+    {DXGI_FORMAT_A8P8, SIZES_16},
+    {DXGI_FORMAT_B4G4R4A4_UNORM, SIZES_16},
+    {DXGI_FORMAT_P208, 32, 36},
+    {DXGI_FORMAT_V208, 32, 35},
+    {DXGI_FORMAT_V408, 48, 35},
+};
+
+// The renderer's own and a few edge cases
+static const TextureSize s_texture_sizes[] = {
+    {"rgba8 256 full chain", DXGI_FORMAT_R8G8B8A8_UNORM, 256, 256, 1, 0, 1, 349524},
+    {"rgba8 256 one mip", DXGI_FORMAT_R8G8B8A8_UNORM, 256, 256, 1, 1, 1, 262144},
+    {"rgba8 1x256 full chain", DXGI_FORMAT_R8G8B8A8_UNORM, 1, 256, 1, 0, 1, 2044},
+    {"bc1 256 full chain", DXGI_FORMAT_BC1_UNORM, 256, 256, 1, 0, 1, 43704},
+    {"bc7 1024", DXGI_FORMAT_BC7_UNORM, 1024, 1024, 1, 1, 1, 1048576},
+    {"rgba16f 512 cubemap", DXGI_FORMAT_R16G16B16A16_FLOAT, 512, 512, 6, 0, 1, 16777200},
+    {"d24s8 1080p 4x msaa", DXGI_FORMAT_D24_UNORM_S8_UINT, 1920, 1080, 1, 1, 4, 33177600},
+    {"r32 typeless 4096 shadow atlas", DXGI_FORMAT_R32_TYPELESS, 4096, 4096, 1, 1, 1, 67108864},
+    {"r11g11b10 960x540 bloom, 6 mips", DXGI_FORMAT_R11G11B10_FLOAT, 960, 540, 1, 6, 1, 2763600},
+};
+
+void texture_format_test::run() {
+    for (const FormatSize &expected : s_format_sizes) {
+        CHECK(texture_format::image_bytes(expected.format, 4, 4) == expected.bytes_4x4 &&
+              texture_format::image_bytes(expected.format, 5, 3) == expected.bytes_5x3);
+    }
+    for (const TextureSize &expected : s_texture_sizes) {
+        CHECK(texture_format::texture_bytes(expected.format, expected.width, expected.height, expected.array_size, expected.mip_levels, expected.samples) == expected.bytes);
+    }
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "test.hpp"
+
+#include "mip_file.hpp"
+#include "texture_streamer.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#define TEST_TEXTURES 48
+#define TEST_FRAMES 4000
+#define TEST_MAX_LOADS 4
+#define TEST_LATENCY 4 // Frames a load takes at most
+#define TEST_FAIL_RATE 50 // One load in this many fails
+#define TEST_TAIL_SIZE 64 // Same as TEXTURE_STREAM_TAIL_SIZE
+
+struct PendingLoad {
+    uint32_t texture;
+    uint32_t frames_left;
+};
+
+// Too big for the stack
+static TextureStreamer g_streamer;
+static StreamRequest g_requests[STREAMER_MAX_TEXTURES];
+
+static void check_lru();
+static void check_scene();
+static bool check_frame(const TextureStreamer *streamer, const StreamRequest *requests, uint32_t count, const uint8_t *last_wanted);
+static bool add_texture(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, uint64_t *out_tail_bytes, uint64_t *out_full_bytes);
+static uint32_t complete_all(TextureStreamer *streamer, const StreamRequest *requests, uint32_t count);
+
+void texture_streamer_test::run() {
+    check_lru();
+    check_scene();
+}
+
+static void check_lru() {
+    TextureStreamer *streamer = &g_streamer;
+    StreamRequest *requests = g_requests;
+
+    // Three 1024s, room for two of them whole
+    uint64_t tail_bytes = 0, full_bytes = 0;
+    texture_streamer::initialize(streamer, 0, TEST_MAX_LOADS);
+    for (uint32_t i = 0; i < 3; ++i) {
+        CHECK(add_texture(streamer, i, 1024, 1024, &tail_bytes, &full_bytes));
+    }
+    uint64_t texture_bytes = full_bytes / 3;
+    uint64_t texture_tail = tail_bytes / 3;
+    texture_streamer::set_budget(streamer, tail_bytes + 2 * (texture_bytes - texture_tail));
+
+    // 0 and 1 come in
+    texture_streamer::begin_frame(streamer);
+    texture_streamer::request(streamer, 0, 0);
+    texture_streamer::request(streamer, 1, 0);
+    uint32_t count = texture_streamer::update(streamer, requests);
+    CHECK(count == 2 && complete_all(streamer, requests, count) == 2);
+
+    // 0 goes unused for a frame, so it goes first when 2 wants in
+    texture_streamer::begin_frame(streamer);
+    texture_streamer::request(streamer, 1, 0);
+    CHECK(texture_streamer::update(streamer, requests) == 0);
+    texture_streamer::begin_frame(streamer);
+    texture_streamer::request(streamer, 1, 0);
+    texture_streamer::request(streamer, 2, 0);
+    count = texture_streamer::update(streamer, requests);
+    CHECK(count == 2 && !requests[0].is_load && requests[0].texture == 0 && requests[0].mip == streamer->textures[0].tail_mip);
+    CHECK(requests[1].is_load && requests[1].texture == 2 && requests[1].mip == 0);
+    CHECK(streamer->textures[1].resident_mip == 0 && complete_all(streamer, requests, count) == 1);
+
+    // All three asked for, only two fit: the third gets what's left
+    texture_streamer::begin_frame(streamer);
+    for (uint32_t i = 0; i < 3; ++i) {
+        texture_streamer::request(streamer, i, 0);
+    }
+    uint32_t clamped = streamer->stats.clamped_loads;
+    count = texture_streamer::update(streamer, requests);
+    CHECK(count == 0 && streamer->stats.clamped_loads == clamped && streamer->resident_bytes <= streamer->budget);
+
+    // Half the budget, detail that's asked for has to go too now
+    texture_streamer::set_budget(streamer, streamer->budget / 2);
+    texture_streamer::begin_frame(streamer);
+    for (uint32_t i = 0; i < 3; ++i) {
+        texture_streamer::request(streamer, i, 0);
+    }
+    count = texture_streamer::update(streamer, requests);
+    CHECK(count > 0 && streamer->resident_bytes <= streamer->budget);
+    for (uint32_t r = 0; r < count; ++r) {
+        CHECK(!requests[r].is_load);
+    }
+
+    // Room again, but not for all of it
+    texture_streamer::set_budget(streamer, tail_bytes + texture_bytes / 2);
+    texture_streamer::begin_frame(streamer);
+    texture_streamer::request(streamer, 0, 0);
+    count = texture_streamer::update(streamer, requests);
+    CHECK(count >= 1 && streamer->stats.clamped_loads == clamped + 1 && streamer->resident_bytes <= streamer->budget);
+}
+
+// Objects strewn along a line, the camera goes back and forth over it and
+// sees what's within 30 units, closer is bigger on screen. Up close it asks
+// for more than the budget, far away less. Loads are slow and some fail, the
+// budget is halved halfway.
+static void check_scene() {
+    TextureStreamer *streamer = &g_streamer;
+    float positions[TEST_TEXTURES];
+    uint64_t tail_bytes = 0, full_bytes = 0;
+    texture_streamer::initialize(streamer, 0, TEST_MAX_LOADS);
+    uint32_t rng = 0x5eed;
+    for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+        uint32_t size = 256u << (test::next_random(&rng) % 5);
+        uint32_t height = test::next_random(&rng) % 4 == 0 ? size / 2 : size;
+        CHECK(add_texture(streamer, i, size, height, &tail_bytes, &full_bytes));
+        positions[i] = (float)(test::next_random(&rng) % 1000) / 10.0f;
+    }
+    texture_streamer::set_budget(streamer, full_bytes / 4);
+
+    PendingLoad loads[TEST_MAX_LOADS];
+    uint32_t load_count = 0;
+    uint8_t last_wanted[TEST_TEXTURES];
+    for (uint32_t frame = 0; frame < TEST_FRAMES; ++frame) {
+        // Uploads finish before the frame asks for more, like run_main_jobs
+        for (uint32_t l = 0; l < load_count;) {
+            if (--loads[l].frames_left > 0) {
+                l++;
+                continue;
+            }
+            texture_streamer::complete(streamer, loads[l].texture, test::next_random(&rng) % TEST_FAIL_RATE != 0);
+            loads[l] = loads[--load_count];
+        }
+
+        if (frame == TEST_FRAMES / 2) {
+            texture_streamer::set_budget(streamer, streamer->budget / 2);
+        }
+
+        texture_streamer::begin_frame(streamer);
+        float camera = 50.0f + 50.0f * sinf(frame * 0.01f);
+        for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+            float distance = fabsf(positions[i] - camera);
+            if (distance < 30.0f) {
+                texture_streamer::request(streamer, i, texture_streamer::footprint_mip(streamer, i, 16384.0f / (1.0f + distance)));
+            }
+        }
+        for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+            last_wanted[i] = streamer->textures[i].wanted_mip;
+        }
+
+        uint32_t count = texture_streamer::update(streamer, g_requests);
+        if (!CHECK(check_frame(streamer, g_requests, count, last_wanted))) break;
+
+        for (uint32_t r = 0; r < count; ++r) {
+            if (g_requests[r].is_load) {
+                loads[load_count++] = {g_requests[r].texture, 1 + test::next_random(&rng) % TEST_LATENCY};
+            }
+        }
+    }
+    // Enough going on that all of it was exercised
+    CHECK(streamer->stats.loads > 0 && streamer->stats.failed_loads > 0 && streamer->stats.evictions > 0);
+}
+
+static bool check_frame(const TextureStreamer *streamer, const StreamRequest *requests, uint32_t count, const uint8_t *last_wanted) {
+    // What's resident and loading adds up to what the streamer counts
+    uint64_t bytes = 0;
+    uint64_t wanted_bytes = 0;
+    uint32_t loading = 0;
+    bool is_evictable = false;
+    for (uint32_t i = 0; i < TEST_TEXTURES; ++i) {
+        const StreamedTexture *t = &streamer->textures[i];
+        uint32_t mip = t->loading_mip != STREAMER_MIP_NONE ? t->loading_mip : t->resident_mip;
+        bytes += texture_streamer::get_bytes(streamer, i, mip);
+        // Loads can't be stopped, one asked for last frame counts as asked for
+        uint32_t wanted_mip = t->loading_mip < last_wanted[i] ? t->loading_mip : last_wanted[i];
+        wanted_bytes += texture_streamer::get_bytes(streamer, i, wanted_mip);
+        loading += t->loading_mip != STREAMER_MIP_NONE;
+        is_evictable |= t->loading_mip == STREAMER_MIP_NONE && t->resident_mip < t->tail_mip;
+    }
+    if (bytes != streamer->resident_bytes || loading != streamer->loads_in_flight || loading > TEST_MAX_LOADS) {
+        return false;
+    }
+
+    // Over the budget only with nothing left to evict (the rest is loading)
+    if (streamer->resident_bytes > streamer->budget && is_evictable) {
+        return false;
+    }
+
+    // Asked for detail only goes when the asks don't fit
+    for (uint32_t r = 0; r < count; ++r) {
+        const StreamRequest *request = &requests[r];
+        if (!request->is_load && request->mip > last_wanted[request->texture] && wanted_bytes <= streamer->budget) {
+            return false;
+        }
+        if (request->is_load && request->mip < last_wanted[request->texture]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool add_texture(TextureStreamer *streamer, uint32_t texture, uint32_t width, uint32_t height, uint64_t *out_tail_bytes, uint64_t *out_full_bytes) {
+    uint64_t mip_bytes[STREAMER_MAX_MIPS];
+    uint32_t mip_count = mip_file::get_mip_count(width, height);
+    uint32_t tail_mip = mip_count - 1;
+    for (uint32_t mip = 0; mip < mip_count; ++mip) {
+        uint32_t mip_width = width >> mip ? width >> mip : 1;
+        uint32_t mip_height = height >> mip ? height >> mip : 1;
+        mip_bytes[mip] = (uint64_t)mip_width * mip_height * 4;
+        if (mip < tail_mip && mip_width <= TEST_TAIL_SIZE && mip_height <= TEST_TAIL_SIZE) {
+            tail_mip = mip;
+        }
+    }
+
+    if (!texture_streamer::add(streamer, texture, width, height, mip_bytes, mip_count, tail_mip)) {
+        return false;
+    }
+    *out_tail_bytes += texture_streamer::get_bytes(streamer, texture, tail_mip);
+    *out_full_bytes += texture_streamer::get_bytes(streamer, texture, 0);
+    return true;
+}
+
+static uint32_t complete_all(TextureStreamer *streamer, const StreamRequest *requests, uint32_t count) {
+    uint32_t loads = 0;
+    for (uint32_t r = 0; r < count; ++r) {
+        if (requests[r].is_load) {
+            texture_streamer::complete(streamer, requests[r].texture, true);
+            loads++;
+        }
+    }
+    return loads;
+}
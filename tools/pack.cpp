@@ -0,0 +1,52 @@
+#include "logger.hpp"
+#include "pack_file.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Packs every file under a directory, named by their path from where it runs,
+// so `pack assets assets.pack` from the project dir has "assets/crab.png" the
+// way the scene config names it
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        LOG("Usage: pack <dir> <out%s>", PACK_FILE_EXTENSION);
+        return 1;
+    }
+    const char *dir = argv[1];
+    const char *out_path = argv[2];
+
+    std::error_code error;
+    std::vector<std::string> paths;
+    for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(dir, error)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        // Nor any other pack, or one left over from a packer that didn't finish
+        std::string path = entry.path().generic_string();
+        std::string extension = entry.path().extension().generic_string();
+        if (extension == PACK_FILE_EXTENSION || extension == ".tmp") {
+            continue;
+        }
+        paths.push_back(path);
+    }
+    if (error) {
+        LOG("Couldn't walk %s: %s", dir, error.message().c_str());
+        return 1;
+    }
+
+    std::vector<PackSource> sources(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        sources[i] = {paths[i].c_str(), paths[i].c_str()};
+    }
+
+    PackWriteStats stats = {};
+    if (!pack_file::write(out_path, sources.data(), (uint32_t)sources.size(), &stats)) {
+        LOG("Couldn't write %s", out_path);
+        return 1;
+    }
+
+    LOG("%s: %u files (%u compressed, %u shared), %llu -> %llu bytes", out_path, stats.files, stats.compressed, stats.shared,
+        (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out);
+    return 0;
+}
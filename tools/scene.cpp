@@ -0,0 +1,36 @@
+#include "arena.hpp"
+#include "logger.hpp"
+#include "scene_file.hpp"
+
+#include <cstring>
+
+// Compiles a JSON scene config to a scene file and back, by the extension of
+// the output: `scene assets/config.json assets/config.scene` to compile,
+// `scene assets/config.scene edit.json` to get something to edit
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        LOG("Usage: scene <in.json|in%s> <out.json|out%s>", SCENE_FILE_EXTENSION, SCENE_FILE_EXTENSION);
+        return 1;
+    }
+    const char *in_path = argv[1];
+    const char *out_path = argv[2];
+
+    Arena *scratch = arena::scratch();
+    SceneFile file = {};
+    if (!scene_file::read(in_path, scratch, &file)) {
+        return 1;
+    }
+
+    size_t length = strlen(out_path);
+    size_t extension_length = strlen(SCENE_FILE_EXTENSION);
+    bool is_binary = length >= extension_length && strcmp(out_path + length - extension_length, SCENE_FILE_EXTENSION) == 0;
+    if (!(is_binary ? scene_file::write(out_path, &file) : scene_file::write_json(out_path, &file))) {
+        return 1;
+    }
+
+    const SceneFileHeader *header = file.header;
+    LOG("%s: %u scenes, %u instances, %u cameras, %u meshes, %u materials, %u textures (%llu bytes compiled)", out_path, header->scene_count,
+        header->instance_count, header->camera_count, header->mesh_count, header->material_count, header->texture_count,
+        (unsigned long long)file.size);
+    return 0;
+}
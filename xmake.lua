@@ -4,7 +4,16 @@ set_languages("c++20")
 set_toolchains("clang")
 set_warnings("all", "error", "extra", "pedantic")
 
-if is_mode("debug") then
+-- xmake f -m debug --tsan=y builds the tests with ThreadSanitizer instead,
+-- it doesn't mix with the address sanitizer. Clang only has it on Linux and
+-- macOS, not for mingw.
+option("tsan")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the tests with ThreadSanitizer")
+option_end()
+
+if is_mode("debug") and not has_config("tsan") then
     set_policy("build.sanitizer.address", true)
     set_policy("build.sanitizer.undefined", true)
 end
@@ -16,7 +25,6 @@ target("pbr")
     set_kind("binary")
     add_includedirs("deps/DirectXMath/Inc", "deps/tinyobjloader", "deps/stb", "deps/cgltf", "deps/cjson")
     add_files("src/*.cpp", "deps/cjson/cJSON.c")
-    add_syslinks("d3d11", "d3dcompiler")
     add_cxflags("-fno-sanitize=vptr", "-Wno-defaulted-function-deleted")
 
     if is_mode("debug") then
@@ -24,3 +32,68 @@ target("pbr")
     end
     
     set_rundir(os.projectdir())
+
+-- Deterministic replay benchmark, same sources as the app minus its entry point
+-- xmake run bench --synthetic 100,32,8 --frames 2000 --max-p95 8
+target("bench")
+    set_kind("binary")
+    add_includedirs("src", "deps/DirectXMath/Inc", "deps/tinyobjloader", "deps/stb", "deps/cgltf", "deps/cjson")
+    add_files("src/*.cpp|main.cpp", "bench/*.cpp", "deps/cjson/cJSON.c")
+    add_cxflags("-fno-sanitize=vptr", "-Wno-defaulted-function-deleted")
+
+    if is_mode("debug") then
+        add_defines("_DEBUG")
+    end
+
+    set_rundir(os.projectdir())
+
+-- Asset packer, only the CPU side it needs
+-- xmake run pack assets assets.pack
+target("pack")
+    set_kind("binary")
+    add_includedirs("src")
+    add_files("tools/pack.cpp", "src/pack_file.cpp", "src/lz4.cpp", "src/asset_registry.cpp", "src/vfs.cpp", "src/arena.cpp", "src/memory_tracker.cpp", "src/id.cpp")
+    add_cxflags("-fno-sanitize=vptr")
+
+    if is_mode("debug") then
+        add_defines("_DEBUG")
+    end
+
+    set_rundir(os.projectdir())
+
+-- Scene config compiler, JSON to scene file and back
+-- xmake run scene assets/config.json assets/config.scene
+target("scene")
+    set_kind("binary")
+    add_includedirs("src", "deps/cjson")
+    add_files("tools/scene.cpp", "src/scene_file.cpp", "src/vfs.cpp", "src/pack_file.cpp", "src/lz4.cpp", "src/asset_registry.cpp", "src/arena.cpp", "src/memory_tracker.cpp", "src/id.cpp", "deps/cjson/cJSON.c")
+    add_cxflags("-fno-sanitize=vptr")
+
+    if is_mode("debug") then
+        add_defines("_DEBUG")
+    end
+
+    set_rundir(os.projectdir())
+
+-- Checks for the CPU side, no device or window. Sources are listed one by one,
+-- only what the tests reach.
+-- xmake run test [suite...]
+target("test")
+    set_kind("binary")
+    add_includedirs("src", "deps/DirectXMath/Inc", "deps/cjson")
+    add_files("tests/*.cpp", "src/light_cluster.cpp", "src/shadow_cascades.cpp", "src/shadow_atlas.cpp", "src/material_table.cpp", "src/id.cpp", "src/shader_cache.cpp", "src/shader_permutation.cpp", "src/range_allocator.cpp", "src/meshlet.cpp", "src/arena.cpp", "src/memory_tracker.cpp", "src/occlusion.cpp", "src/async.cpp", "src/job_system.cpp", "src/mip_file.cpp", "src/vfs.cpp", "src/pack_file.cpp", "src/lz4.cpp", "src/asset_registry.cpp", "src/texture_streamer.cpp", "src/scene_file.cpp", "deps/cjson/cJSON.c", "src/scene_diff.cpp", "src/file_watcher.cpp", "src/frame_pacer.cpp")
+    add_cxflags("-fno-sanitize=vptr")
+    -- Texture sizes and the state tracker need the D3D headers, the rest
+    -- builds anywhere (the tsan build is Linux or macOS)
+    if is_plat("windows", "mingw") then
+        add_files("src/texture_format.cpp", "src/state_tracker.cpp")
+    end
+
+    if is_mode("debug") then
+        add_defines("_DEBUG")
+    end
+    if has_config("tsan") then
+        set_policy("build.sanitizer.thread", true)
+    end
+
+    set_rundir(os.projectdir())